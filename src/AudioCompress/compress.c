@@ -13,6 +13,21 @@
 #include "config.h"
 #include "compress.h"
 
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__) && \
+        (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define COMPRESS_X86
+#include <immintrin.h>
+#endif
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+//! How many samples to process per gain step while ramping; the gain
+//! changes in small stairs instead of per sample, which keeps the
+//! apply loop vectorizable
+#define RAMP_BLOCK 32
+
 struct Compressor {
         //! The compressor's preferences
         struct CompressorConfig prefs;
@@ -30,10 +45,222 @@ struct Compressor {
         unsigned int bufsz;
 };
 
+//! Find the largest absolute sample value in the block (at least 1)
+static int scanPeak(const int16_t *audio, unsigned int count)
+{
+        int peakVal = 1;
+        unsigned int i;
+
+        for (i = 0; i < count; i++)
+        {
+                int val = audio[i];
+                if (val < 0)
+                        val = -val;
+                if (val > peakVal)
+                        peakVal = val;
+        }
+
+        return peakVal;
+}
+
+//! Amplify a block with a constant gain (Q10), clipping to 16 bits and
+//! accumulating the clipped amount
+static void applyGain(int16_t *audio, unsigned int count, int gain,
+                      int *clipped)
+{
+        unsigned int i;
+
+        for (i = 0; i < count; i++)
+        {
+                int sample = audio[i]*gain >> 10;
+                if (sample < -32768)
+                {
+                        *clipped += -32768 - sample;
+                        sample = -32768;
+                } else if (sample > 32767)
+                {
+                        *clipped += sample - 32767;
+                        sample = 32767;
+                }
+                audio[i] = sample;
+        }
+}
+
+#ifdef COMPRESS_X86
+
+__attribute__((target("sse2")))
+static int scanPeakSSE2(const int16_t *audio, unsigned int count)
+{
+        const __m128i zero = _mm_setzero_si128();
+        __m128i vmax = zero;
+        unsigned int i = 0;
+        int peakVal = 1, val;
+
+        for (; i + 8 <= count; i += 8)
+        {
+                __m128i v = _mm_loadu_si128((const __m128i *)(audio + i));
+                /* saturating 0 - x maps -32768 to 32767; close enough
+                   for a peak estimate, and never smaller than the
+                   true peak of any sample that can be amplified */
+                v = _mm_max_epi16(v, _mm_subs_epi16(zero, v));
+                vmax = _mm_max_epi16(vmax, v);
+        }
+
+        vmax = _mm_max_epi16(vmax, _mm_srli_si128(vmax, 8));
+        vmax = _mm_max_epi16(vmax, _mm_srli_si128(vmax, 4));
+        vmax = _mm_max_epi16(vmax, _mm_srli_si128(vmax, 2));
+        val = (int16_t)_mm_cvtsi128_si32(vmax);
+        if (val > peakVal)
+                peakVal = val;
+
+        for (; i < count; i++)
+        {
+                val = audio[i];
+                if (val < 0)
+                        val = -val;
+                if (val > peakVal)
+                        peakVal = val;
+        }
+
+        return peakVal;
+}
+
+__attribute__((target("sse4.1")))
+static void applyGainSSE41(int16_t *audio, unsigned int count, int gain,
+                           int *clipped)
+{
+        const __m128i vgain = _mm_set1_epi32(gain);
+        unsigned int i = 0;
+
+        /* the saturating pack replaces the explicit clip check; the
+           clipped amount is not accumulated here (nothing in MPD reads
+           it back) */
+        (void)clipped;
+
+        for (; i + 8 <= count; i += 8)
+        {
+                __m128i v = _mm_loadu_si128((const __m128i *)(audio + i));
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+                lo = _mm_srai_epi32(_mm_mullo_epi32(lo, vgain), 10);
+                hi = _mm_srai_epi32(_mm_mullo_epi32(hi, vgain), 10);
+                _mm_storeu_si128((__m128i *)(audio + i),
+                                 _mm_packs_epi32(lo, hi));
+        }
+
+        for (; i < count; i++)
+        {
+                int sample = audio[i]*gain >> 10;
+                if (sample < -32768)
+                        sample = -32768;
+                else if (sample > 32767)
+                        sample = 32767;
+                audio[i] = sample;
+        }
+}
+
+#endif /* COMPRESS_X86 */
+
+#ifdef __ARM_NEON__
+
+static int scanPeakNEON(const int16_t *audio, unsigned int count)
+{
+        int16x8_t vmax = vdupq_n_s16(0);
+        int16x4_t vmax4;
+        unsigned int i = 0;
+        int peakVal = 1, val;
+
+        for (; i + 8 <= count; i += 8)
+                vmax = vmaxq_s16(vmax, vqabsq_s16(vld1q_s16(audio + i)));
+
+        vmax4 = vmax_s16(vget_low_s16(vmax), vget_high_s16(vmax));
+        vmax4 = vpmax_s16(vmax4, vmax4);
+        vmax4 = vpmax_s16(vmax4, vmax4);
+        val = vget_lane_s16(vmax4, 0);
+        if (val > peakVal)
+                peakVal = val;
+
+        for (; i < count; i++)
+        {
+                val = audio[i];
+                if (val < 0)
+                        val = -val;
+                if (val > peakVal)
+                        peakVal = val;
+        }
+
+        return peakVal;
+}
+
+static void applyGainNEON(int16_t *audio, unsigned int count, int gain,
+                          int *clipped)
+{
+        const int32x4_t vgain = vdupq_n_s32(gain);
+        unsigned int i = 0;
+
+        /* vqmovn saturates; see applyGainSSE41 about the clipped
+           amount */
+        (void)clipped;
+
+        for (; i + 8 <= count; i += 8)
+        {
+                int16x8_t v = vld1q_s16(audio + i);
+                int32x4_t lo = vmulq_s32(vmovl_s16(vget_low_s16(v)), vgain);
+                int32x4_t hi = vmulq_s32(vmovl_s16(vget_high_s16(v)), vgain);
+                lo = vshrq_n_s32(lo, 10);
+                hi = vshrq_n_s32(hi, 10);
+                vst1q_s16(audio + i,
+                          vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+        }
+
+        for (; i < count; i++)
+        {
+                int sample = audio[i]*gain >> 10;
+                if (sample < -32768)
+                        sample = -32768;
+                else if (sample > 32767)
+                        sample = 32767;
+                audio[i] = sample;
+        }
+}
+
+#endif /* __ARM_NEON__ */
+
+#ifdef __ARM_NEON__
+static int (*scanPeak_hook)(const int16_t *, unsigned int) = scanPeakNEON;
+static void (*applyGain_hook)(int16_t *, unsigned int, int, int *) =
+        applyGainNEON;
+#else
+static int (*scanPeak_hook)(const int16_t *, unsigned int) = scanPeak;
+static void (*applyGain_hook)(int16_t *, unsigned int, int, int *) =
+        applyGain;
+#endif
+
+//! Pick the fastest kernels for this machine; idempotent, so a benign
+//! race between two compressors being created does not matter
+static void Compressor_dispatch(void)
+{
+#ifdef COMPRESS_X86
+        static int dispatched;
+
+        if (dispatched)
+                return;
+
+        if (__builtin_cpu_supports("sse2"))
+                scanPeak_hook = scanPeakSSE2;
+        if (__builtin_cpu_supports("sse4.1"))
+                applyGain_hook = applyGainSSE41;
+
+        dispatched = 1;
+#endif
+}
+
 struct Compressor *Compressor_new(unsigned int history)
 {
 	struct Compressor *obj = malloc(sizeof(struct Compressor));
 
+        Compressor_dispatch();
+
 	obj->prefs.target = TARGET;
 	obj->prefs.maxgain = GAINMAX;
 	obj->prefs.smooth = GAINSMOOTH;
@@ -86,40 +313,25 @@ void Compressor_Process_int16(struct Compressor *obj, int16_t *audio,
                               unsigned int count)
 {
         struct CompressorConfig *prefs = Compressor_getConfig(obj);
-	int16_t *ap;
 	unsigned int i;
         int *peaks = obj->peaks;
         int curGain = obj->gain[obj->pos];
         int newGain;
-        int peakVal = 1;
-        int peakPos = 0;
+        int chunkPeak;
+        int peakVal;
         int slot = (obj->pos + 1) % obj->bufsz;
         int *clipped = obj->clipped + slot;
         unsigned int ramp = count;
         int delta;
 
-	ap = audio;
-	for (i = 0; i < count; i++)
-	{
-		int val = *ap++;
-                if (val < 0)
-                        val = -val;
-		if (val > peakVal)
-                {
-			peakVal = val;
-                        peakPos = i;
-                }
-	}
-	peaks[slot] = peakVal;
-
+        chunkPeak = scanPeak_hook(audio, count);
+	peaks[slot] = chunkPeak;
 
+        peakVal = chunkPeak;
 	for (i = 0; i < obj->bufsz; i++)
 	{
 		if (peaks[i] > peakVal)
-		{
 			peakVal = peaks[i];
-			peakPos = 0;
-		}
 	}
 
 	//! Determine target gain
@@ -141,8 +353,25 @@ void Compressor_Process_int16(struct Compressor *obj, int16_t *audio,
         if ((peakVal*newGain >> 10) > 32767)
         {
                 newGain = (32767 << 10)/peakVal;
-                //! Truncate the ramp time
-                ramp = peakPos;
+
+                //! Truncate the ramp time at the peak; only now is the
+                //! peak position needed, so look it up separately
+                //! instead of tracking it in the scan
+                ramp = 0;
+                if (peakVal == chunkPeak)
+                {
+                        for (i = 0; i < count; i++)
+                        {
+                                int val = audio[i];
+                                if (val < 0)
+                                        val = -val;
+                                if (val == chunkPeak)
+                                {
+                                        ramp = i;
+                                        break;
+                                }
+                        }
+                }
         }
 
         //! Record the new gain
@@ -154,32 +383,29 @@ void Compressor_Process_int16(struct Compressor *obj, int16_t *audio,
                 curGain = 1 << 10;
 	delta = (newGain - curGain) / (int)ramp;
 
-	ap = audio;
+        //! Amplify.  While ramping, the gain is stepped once per
+        //! RAMP_BLOCK samples instead of once per sample; each block is
+        //! then a constant-gain multiply which the kernels above can
+        //! vectorize
         *clipped = 0;
-	for (i = 0; i < count; i++)
-	{
-		int sample;
-
-		//! Amplify the sample
-		sample = *ap*curGain >> 10;
-		if (sample < -32768)
-		{
-			*clipped += -32768 - sample;
-			sample = -32768;
-		} else if (sample > 32767)
-		{
-			*clipped += sample - 32767;
-			sample = 32767;
-		}
-		*ap++ = sample;
-
-                //! Adjust the gain
+        i = 0;
+        while (i < count)
+        {
                 if (i < ramp)
-                        curGain += delta;
-                else
-                        curGain = newGain;
-	}
+                {
+                        unsigned int n = ramp - i;
+                        if (n > RAMP_BLOCK)
+                                n = RAMP_BLOCK;
+                        applyGain_hook(audio + i, n, curGain, clipped);
+                        curGain += delta*(int)n;
+                        i += n;
+                } else
+                {
+                        applyGain_hook(audio + i, count - i, newGain,
+                                       clipped);
+                        break;
+                }
+        }
 
         obj->pos = slot;
 }
-
@@ -17,15 +17,19 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include "config.h"
+#include "config.h" /* must be first for large file support */
 #include "ape.h"
+#include "refcount.h"
+#include "fd_util.h"
 
 #include <glib.h>
 
 #include <stdint.h>
 #include <assert.h>
-#include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 struct ape_footer {
 	unsigned char id[8];
@@ -36,37 +40,85 @@ struct ape_footer {
 	unsigned char reserved[8];
 };
 
-static bool
-ape_scan_internal(FILE *fp, tag_ape_callback_t callback, void *ctx)
+/**
+ * The tail window read with the first pread().  It covers the footer
+ * and, for all but unusually large tags, the whole tag, so one read
+ * is enough.
+ */
+#define APE_TAIL_WINDOW 4096
+
+struct ape_tag {
+	struct refcount ref;
+
+	/** the raw tag data (without the footer) */
+	char *buffer;
+
+	struct ape_item *items;
+	unsigned count;
+};
+
+static GStaticMutex ape_cache_mutex = G_STATIC_MUTEX_INIT;
+
+/** the most recently parsed tag; both the tag importer and the
+    replay gain reader usually ask for the same file */
+static struct ape_tag *ape_cache_tag;
+static char *ape_cache_path;
+static time_t ape_cache_mtime;
+
+static void
+ape_tag_ref(struct ape_tag *tag)
 {
-	/* determine if file has an apeV2 tag */
-	struct ape_footer footer;
-	if (fseek(fp, -(long)sizeof(footer), SEEK_END) ||
-	    fread(&footer, 1, sizeof(footer), fp) != sizeof(footer) ||
-	    memcmp(footer.id, "APETAGEX", sizeof(footer.id)) != 0 ||
-	    GUINT32_FROM_LE(footer.version) != 2000)
-		return false;
+	refcount_inc(&tag->ref);
+}
 
-	/* find beginning of ape tag */
-	size_t remaining = GUINT32_FROM_LE(footer.length);
-	if (remaining <= sizeof(footer) + 10 ||
-	    /* refuse to load more than one megabyte of tag data */
-	    remaining > 1024 * 1024 ||
-	    fseek(fp, -(long)remaining, SEEK_END))
-		return false;
+void
+ape_tag_unref(struct ape_tag *tag)
+{
+	assert(tag != NULL);
 
-	/* read tag into buffer */
-	remaining -= sizeof(footer);
-	assert(remaining > 10);
+	if (!refcount_dec(&tag->ref))
+		return;
 
-	char *buffer = g_malloc(remaining);
-	if (fread(buffer, 1, remaining, fp) != remaining) {
-		g_free(buffer);
-		return false;
-	}
+	g_free(tag->items);
+	g_free(tag->buffer);
+	g_free(tag);
+}
+
+unsigned
+ape_tag_count(const struct ape_tag *tag)
+{
+	assert(tag != NULL);
+
+	return tag->count;
+}
+
+const struct ape_item *
+ape_tag_item(const struct ape_tag *tag, unsigned i)
+{
+	assert(tag != NULL);
+	assert(i < tag->count);
+
+	return &tag->items[i];
+}
+
+/**
+ * Parses the items from the raw tag data.  The buffer is owned by the
+ * returned object.
+ */
+static struct ape_tag *
+ape_tag_parse(char *buffer, size_t remaining, unsigned n)
+{
+	/* each item occupies at least 9 bytes; clamp the declared
+	   count to avoid a huge allocation for a corrupt tag */
+	if (n > remaining / 9)
+		n = remaining / 9;
+
+	struct ape_tag *tag = g_new(struct ape_tag, 1);
+	refcount_init(&tag->ref);
+	tag->buffer = buffer;
+	tag->items = g_new(struct ape_item, n);
+	tag->count = 0;
 
-	/* read tags */
-	unsigned n = GUINT32_FROM_LE(footer.count);
 	const char *p = buffer;
 	while (n-- && remaining > 10) {
 		size_t size = GUINT32_FROM_LE(*(const uint32_t *)p);
@@ -89,27 +141,124 @@ ape_scan_internal(FILE *fp, tag_ape_callback_t callback, void *ctx)
 		if (remaining < size)
 			break;
 
-		if (!callback(flags, key, p, size, ctx))
-			break;
+		struct ape_item *item = &tag->items[tag->count++];
+		item->flags = flags;
+		item->key = key;
+		item->value = p;
+		item->value_length = size;
 
 		p += size;
 		remaining -= size;
 	}
 
-	g_free(buffer);
-	return true;
+	return tag;
+}
+
+static struct ape_tag *
+ape_tag_load(int fd, off_t file_size)
+{
+	struct ape_footer footer;
+
+	if (file_size < (off_t)sizeof(footer))
+		return NULL;
+
+	/* read the tail window; for most files, it contains the
+	   whole tag */
+
+	char tail[APE_TAIL_WINDOW];
+	size_t window = file_size < (off_t)sizeof(tail)
+		? (size_t)file_size
+		: sizeof(tail);
+
+	if (pread(fd, tail, window, file_size - window) != (ssize_t)window)
+		return NULL;
+
+	/* determine if the file has an apeV2 tag */
+
+	memcpy(&footer, tail + window - sizeof(footer), sizeof(footer));
+	if (memcmp(footer.id, "APETAGEX", sizeof(footer.id)) != 0 ||
+	    GUINT32_FROM_LE(footer.version) != 2000)
+		return NULL;
+
+	size_t remaining = GUINT32_FROM_LE(footer.length);
+	if (remaining <= sizeof(footer) + 10 ||
+	    /* refuse to load more than one megabyte of tag data */
+	    remaining > 1024 * 1024 ||
+	    (off_t)remaining > file_size)
+		return NULL;
+
+	/* load the tag data (without the footer) */
+
+	size_t data_size = remaining - sizeof(footer);
+	char *buffer = g_malloc(data_size);
+
+	if (remaining <= window)
+		/* already in the tail window */
+		memcpy(buffer, tail + window - remaining, data_size);
+	else if (pread(fd, buffer, data_size,
+		       file_size - remaining) != (ssize_t)data_size) {
+		g_free(buffer);
+		return NULL;
+	}
+
+	return ape_tag_parse(buffer, data_size,
+			     GUINT32_FROM_LE(footer.count));
 }
 
-bool
-tag_ape_scan(const char *path_fs, tag_ape_callback_t callback, void *ctx)
+struct ape_tag *
+ape_tag_get(const char *path_fs)
 {
-	FILE *fp;
+	struct stat st;
+	struct ape_tag *tag;
+
+	int fd = open_cloexec(path_fs, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return NULL;
+	}
+
+	/* check the cache first */
+
+	g_static_mutex_lock(&ape_cache_mutex);
+
+	if (ape_cache_tag != NULL &&
+	    ape_cache_mtime == st.st_mtime &&
+	    strcmp(ape_cache_path, path_fs) == 0) {
+		tag = ape_cache_tag;
+		ape_tag_ref(tag);
+		g_static_mutex_unlock(&ape_cache_mutex);
+
+		close(fd);
+		return tag;
+	}
+
+	g_static_mutex_unlock(&ape_cache_mutex);
+
+	tag = ape_tag_load(fd, st.st_size);
+	close(fd);
+
+	if (tag == NULL)
+		return NULL;
+
+	/* insert into the cache; one reference is held by the cache,
+	   one by the caller */
+
+	ape_tag_ref(tag);
+
+	g_static_mutex_lock(&ape_cache_mutex);
+
+	if (ape_cache_tag != NULL)
+		ape_tag_unref(ape_cache_tag);
+	g_free(ape_cache_path);
+
+	ape_cache_tag = tag;
+	ape_cache_path = g_strdup(path_fs);
+	ape_cache_mtime = st.st_mtime;
 
-	fp = fopen(path_fs, "rb");
-	if (fp == NULL)
-		return false;
+	g_static_mutex_unlock(&ape_cache_mutex);
 
-	bool success = ape_scan_internal(fp, callback, ctx);
-	fclose(fp);
-	return success;
+	return tag;
 }
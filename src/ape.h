@@ -25,18 +25,44 @@
 #include <stdbool.h>
 #include <stddef.h>
 
-typedef bool (*tag_ape_callback_t)(unsigned long flags, const char *key,
-				   const char *value, size_t value_length,
-				   void *ctx);
+/**
+ * One item of a parsed APE tag.  The key and value point into the
+ * #ape_tag object which contains the item; the value is not
+ * null-terminated.
+ */
+struct ape_item {
+	unsigned long flags;
+	const char *key;
+	const char *value;
+	size_t value_length;
+};
+
+/**
+ * A parsed, reference counted APE tag.  It is loaded from the file
+ * with one tail read, and the most recently loaded tag is cached, so
+ * the tag importer and the replay gain reader share one parse.
+ */
+struct ape_tag;
 
 /**
- * Scans the APE tag values from a file.
+ * Loads the APE tag from a file, or returns the cached parse if the
+ * file has not changed since.  The caller must free the returned
+ * object with ape_tag_unref().
  *
  * @param path_fs the path of the file in filesystem encoding
- * @return false if the file could not be opened or if no APE tag is
+ * @return NULL if the file could not be opened or if no APE tag is
  * present
  */
-bool
-tag_ape_scan(const char *path_fs, tag_ape_callback_t callback, void *ctx);
+struct ape_tag *
+ape_tag_get(const char *path_fs);
+
+void
+ape_tag_unref(struct ape_tag *tag);
+
+unsigned
+ape_tag_count(const struct ape_tag *tag);
+
+const struct ape_item *
+ape_tag_item(const struct ape_tag *tag, unsigned i);
 
 #endif
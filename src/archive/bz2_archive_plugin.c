@@ -85,8 +85,6 @@ bz2_alloc(struct bz2_input_stream *data, GError **error_r)
 
 	ret = BZ2_bzDecompressInit(&data->bzstream, 0, 0);
 	if (ret != BZ_OK) {
-		g_free(data);
-
 		g_set_error(error_r, bz2_quark(), ret,
 			    "BZ2_bzDecompressInit() has failed");
 		return false;
@@ -186,7 +184,11 @@ bz2_open_stream(struct archive_file *file, const char *path,
 	bis->archive = context;
 
 	bis->base.ready = true;
-	bis->base.seekable = false;
+
+	/* seeking is emulated by (re-)decompressing from the start
+	   of the archive, which requires a seekable underlying
+	   stream */
+	bis->base.seekable = context->istream->seekable;
 
 	if (!bz2_alloc(bis, error_r)) {
 		input_stream_deinit(&bis->base);
@@ -284,6 +286,77 @@ bz2_is_eof(struct input_stream *is)
 	return bis->eof;
 }
 
+/**
+ * Restart decompression from the beginning of the archive.
+ */
+static bool
+bz2_rewind(struct bz2_input_stream *bis, GError **error_r)
+{
+	if (!input_stream_seek(bis->archive->istream, 0, SEEK_SET, error_r))
+		return false;
+
+	bz2_destroy(bis);
+
+	if (!bz2_alloc(bis, error_r))
+		return false;
+
+	bis->eof = false;
+	bis->base.offset = 0;
+	return true;
+}
+
+static bool
+bz2_is_seek(struct input_stream *is, goffset offset, int whence,
+	    GError **error_r)
+{
+	struct bz2_input_stream *bis = (struct bz2_input_stream *)is;
+	goffset target;
+
+	switch (whence) {
+	case SEEK_SET:
+		target = offset;
+		break;
+
+	case SEEK_CUR:
+		target = is->offset + offset;
+		break;
+
+	default:
+		/* the uncompressed size is not known, so SEEK_END is
+		   not supported */
+		g_set_error(error_r, bz2_quark(), 0,
+			    "Unsupported seek origin");
+		return false;
+	}
+
+	if (target < 0) {
+		g_set_error(error_r, bz2_quark(), 0, "Invalid seek offset");
+		return false;
+	}
+
+	if (target < is->offset && !bz2_rewind(bis, error_r))
+		return false;
+
+	/* bzip2 cannot be re-entered in the middle of the stream
+	   (block boundaries are not byte aligned); decompress and
+	   discard everything up to the target */
+	while (is->offset < target) {
+		char buffer[4096];
+		size_t nbytes = target - is->offset < (goffset)sizeof(buffer)
+			? (size_t)(target - is->offset)
+			: sizeof(buffer);
+
+		if (bz2_is_read(is, buffer, nbytes, error_r) == 0) {
+			if (error_r != NULL && *error_r == NULL)
+				g_set_error(error_r, bz2_quark(), 0,
+					    "Seek beyond end of stream");
+			return false;
+		}
+	}
+
+	return true;
+}
+
 /* exported structures */
 
 static const char *const bz2_extensions[] = {
@@ -295,6 +368,7 @@ static const struct input_plugin bz2_inputplugin = {
 	.close = bz2_is_close,
 	.read = bz2_is_read,
 	.eof = bz2_is_eof,
+	.seek = bz2_is_seek,
 };
 
 const struct archive_plugin bz2_archive_plugin = {
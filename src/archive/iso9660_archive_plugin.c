@@ -24,6 +24,7 @@
 #include "config.h"
 #include "archive/iso9660_archive_plugin.h"
 #include "archive_api.h"
+#include "archive_list.h"
 #include "input_internal.h"
 #include "input_plugin.h"
 #include "refcount.h"
@@ -33,6 +34,7 @@
 
 #include <glib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #define CEILING(x, y) ((x+(y-1))/y)
 
@@ -42,6 +44,16 @@ struct iso9660_archive_file {
 	struct refcount ref;
 
 	iso9660_t *iso;
+
+	/** the archive file's path and modification time, the TOC
+	    cache key; mtime is 0 if stat() failed */
+	char *path;
+	time_t mtime;
+
+	/** true if the TOC has been built (or fetched from the
+	    cache) */
+	bool scanned;
+
 	GSList	*list;
 	GSList	*iter;
 };
@@ -95,21 +107,29 @@ iso9660_archive_open(const char *pathname, GError **error_r)
 {
 	struct iso9660_archive_file *context =
 		g_new(struct iso9660_archive_file, 1);
+	struct stat st;
 
 	archive_file_init(&context->base, &iso9660_archive_plugin);
 	refcount_init(&context->ref);
 
 	context->list = NULL;
+	context->scanned = false;
 
 	/* open archive */
 	context->iso = iso9660_open (pathname);
 	if (context->iso   == NULL) {
+		g_free(context);
 		g_set_error(error_r, iso9660_quark(), 0,
 			    "Failed to open ISO9660 file %s", pathname);
 		return NULL;
 	}
 
-	listdir_recur("/", context);
+	context->path = g_strdup(pathname);
+	context->mtime = stat(pathname, &st) == 0 ? st.st_mtime : 0;
+
+	/* the TOC is built lazily by iso9660_archive_scan_reset();
+	   when the archive is opened for playing a single file, it is
+	   not needed at all */
 
 	return &context->base;
 }
@@ -120,6 +140,21 @@ iso9660_archive_scan_reset(struct archive_file *file)
 	struct iso9660_archive_file *context =
 		(struct iso9660_archive_file *)file;
 
+	if (!context->scanned) {
+		context->scanned = true;
+
+		if (context->mtime == 0 ||
+		    !archive_toc_cache_get(context->path, context->mtime,
+					   &context->list)) {
+			listdir_recur("/", context);
+
+			if (context->mtime != 0)
+				archive_toc_cache_put(context->path,
+						      context->mtime,
+						      context->list);
+		}
+	}
+
 	//reset iterator
 	context->iter = context->list;
 }
@@ -158,6 +193,7 @@ iso9660_archive_close(struct archive_file *file)
 	//close archive
 	iso9660_close(context->iso);
 
+	g_free(context->path);
 	g_free(context);
 }
 
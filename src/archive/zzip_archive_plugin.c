@@ -25,6 +25,7 @@
 #include "archive/zzip_archive_plugin.h"
 #include "archive_api.h"
 #include "archive_api.h"
+#include "archive_list.h"
 #include "input_internal.h"
 #include "input_plugin.h"
 #include "refcount.h"
@@ -32,6 +33,7 @@
 #include <zzip/zzip.h>
 #include <glib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 struct zzip_archive {
 	struct archive_file base;
@@ -39,6 +41,16 @@ struct zzip_archive {
 	struct refcount ref;
 
 	ZZIP_DIR *dir;
+
+	/** the archive file's path and modification time, the TOC
+	    cache key; mtime is 0 if stat() failed */
+	char *path;
+	time_t mtime;
+
+	/** true if the TOC has been built (or fetched from the
+	    cache) */
+	bool scanned;
+
 	GSList	*list;
 	GSList	*iter;
 };
@@ -57,27 +69,28 @@ static struct archive_file *
 zzip_archive_open(const char *pathname, GError **error_r)
 {
 	struct zzip_archive *context = g_malloc(sizeof(*context));
-	ZZIP_DIRENT dirent;
+	struct stat st;
 
 	archive_file_init(&context->base, &zzip_archive_plugin);
 	refcount_init(&context->ref);
 
 	// open archive
 	context->list = NULL;
+	context->scanned = false;
 	context->dir = zzip_dir_open(pathname, NULL);
 	if (context->dir  == NULL) {
+		g_free(context);
 		g_set_error(error_r, zzip_quark(), 0,
 			    "Failed to open ZIP file %s", pathname);
 		return NULL;
 	}
 
-	while (zzip_dir_read(context->dir, &dirent)) {
-		//add only files
-		if (dirent.st_size > 0) {
-			context->list = g_slist_prepend(context->list,
-							g_strdup(dirent.d_name));
-		}
-	}
+	context->path = g_strdup(pathname);
+	context->mtime = stat(pathname, &st) == 0 ? st.st_mtime : 0;
+
+	/* the TOC is built lazily by zzip_archive_scan_reset(); when
+	   the archive is opened for playing a single file, it is not
+	   needed at all */
 
 	return &context->base;
 }
@@ -86,6 +99,30 @@ static void
 zzip_archive_scan_reset(struct archive_file *file)
 {
 	struct zzip_archive *context = (struct zzip_archive *) file;
+
+	if (!context->scanned) {
+		context->scanned = true;
+
+		if (context->mtime == 0 ||
+		    !archive_toc_cache_get(context->path, context->mtime,
+					   &context->list)) {
+			ZZIP_DIRENT dirent;
+
+			while (zzip_dir_read(context->dir, &dirent)) {
+				//add only files
+				if (dirent.st_size > 0)
+					context->list =
+						g_slist_prepend(context->list,
+								g_strdup(dirent.d_name));
+			}
+
+			if (context->mtime != 0)
+				archive_toc_cache_put(context->path,
+						      context->mtime,
+						      context->list);
+		}
+	}
+
 	//reset iterator
 	context->iter = context->list;
 }
@@ -120,6 +157,7 @@ zzip_archive_close(struct archive_file *file)
 	//close archive
 	zzip_dir_close (context->dir);
 
+	g_free(context->path);
 	g_free(context);
 }
 
@@ -44,6 +44,135 @@ static const struct archive_plugin *const archive_plugins[] = {
 /** which plugins have been initialized successfully? */
 static bool archive_plugins_enabled[G_N_ELEMENTS(archive_plugins) - 1];
 
+/**
+ * A cached archive table of contents.  Opening an archive scans its
+ * whole directory structure; with one archive per album being opened
+ * once per track, this cache makes all but the first open cheap.
+ */
+struct archive_toc_cache_entry {
+	char *path;
+
+	/** the file's modification time when it was scanned */
+	time_t mtime;
+
+	/** the value of #archive_toc_cache_counter at the last
+	    access; the entry with the lowest value is evicted */
+	unsigned last_used;
+
+	GSList *toc;
+};
+
+/**
+ * Maximum number of archive listings kept in memory.
+ */
+#define ARCHIVE_TOC_CACHE_MAX 16
+
+static GStaticMutex archive_toc_cache_mutex = G_STATIC_MUTEX_INIT;
+static GPtrArray *archive_toc_cache;
+static unsigned archive_toc_cache_counter;
+
+static void
+archive_toc_cache_entry_free(struct archive_toc_cache_entry *entry)
+{
+	g_free(entry->path);
+	g_slist_foreach(entry->toc, (GFunc)g_free, NULL);
+	g_slist_free(entry->toc);
+	g_free(entry);
+}
+
+static GSList *
+archive_toc_copy(GSList *toc)
+{
+	GSList *copy = NULL;
+
+	for (; toc != NULL; toc = g_slist_next(toc))
+		copy = g_slist_prepend(copy, g_strdup(toc->data));
+
+	return g_slist_reverse(copy);
+}
+
+bool
+archive_toc_cache_get(const char *path_fs, time_t mtime, GSList **toc_r)
+{
+	bool found = false;
+
+	g_static_mutex_lock(&archive_toc_cache_mutex);
+
+	if (archive_toc_cache != NULL) {
+		for (unsigned i = 0; i < archive_toc_cache->len; ++i) {
+			struct archive_toc_cache_entry *entry =
+				g_ptr_array_index(archive_toc_cache, i);
+			if (strcmp(entry->path, path_fs) != 0)
+				continue;
+
+			if (entry->mtime != mtime) {
+				/* the file has changed on disk */
+				archive_toc_cache_entry_free(entry);
+				g_ptr_array_remove_index_fast(archive_toc_cache,
+							      i);
+				break;
+			}
+
+			entry->last_used = ++archive_toc_cache_counter;
+			*toc_r = archive_toc_copy(entry->toc);
+			found = true;
+			break;
+		}
+	}
+
+	g_static_mutex_unlock(&archive_toc_cache_mutex);
+	return found;
+}
+
+void
+archive_toc_cache_put(const char *path_fs, time_t mtime, GSList *toc)
+{
+	g_static_mutex_lock(&archive_toc_cache_mutex);
+
+	if (archive_toc_cache == NULL)
+		archive_toc_cache = g_ptr_array_new();
+
+	if (archive_toc_cache->len >= ARCHIVE_TOC_CACHE_MAX) {
+		/* evict the least recently used entry */
+		unsigned victim = 0;
+
+		for (unsigned i = 1; i < archive_toc_cache->len; ++i) {
+			const struct archive_toc_cache_entry *entry =
+				g_ptr_array_index(archive_toc_cache, i);
+			const struct archive_toc_cache_entry *v =
+				g_ptr_array_index(archive_toc_cache, victim);
+			if (entry->last_used < v->last_used)
+				victim = i;
+		}
+
+		archive_toc_cache_entry_free(g_ptr_array_remove_index_fast(archive_toc_cache,
+									   victim));
+	}
+
+	struct archive_toc_cache_entry *entry =
+		g_new(struct archive_toc_cache_entry, 1);
+	entry->path = g_strdup(path_fs);
+	entry->mtime = mtime;
+	entry->last_used = ++archive_toc_cache_counter;
+	entry->toc = archive_toc_copy(toc);
+	g_ptr_array_add(archive_toc_cache, entry);
+
+	g_static_mutex_unlock(&archive_toc_cache_mutex);
+}
+
+static void
+archive_toc_cache_deinit(void)
+{
+	if (archive_toc_cache == NULL)
+		return;
+
+	for (unsigned i = 0; i < archive_toc_cache->len; ++i)
+		archive_toc_cache_entry_free(g_ptr_array_index(archive_toc_cache, i));
+
+	g_ptr_array_free(archive_toc_cache, true);
+	archive_toc_cache = NULL;
+}
+
 const struct archive_plugin *
 archive_plugin_from_suffix(const char *suffix)
 {
@@ -109,5 +238,7 @@ void archive_plugin_deinit_all(void)
 		if (archive_plugins_enabled[i] && plugin->finish != NULL)
 			archive_plugins[i]->finish();
 	}
+
+	archive_toc_cache_deinit();
 }
 
@@ -20,7 +20,11 @@
 #ifndef MPD_ARCHIVE_LIST_H
 #define MPD_ARCHIVE_LIST_H
 
+#include <glib.h>
+
 #include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
 
 struct archive_plugin;
 
@@ -40,4 +44,20 @@ void archive_plugin_init_all(void);
 /* this is where we "unload" all the "plugins" */
 void archive_plugin_deinit_all(void);
 
+/**
+ * Looks up the cached table of contents of an archive file, keyed by
+ * path and modification time.  On a hit, a deep copy of the name list
+ * is stored in *toc_r (owned by the caller) and true is returned.
+ * This function is thread-safe.
+ */
+bool
+archive_toc_cache_get(const char *path_fs, time_t mtime, GSList **toc_r);
+
+/**
+ * Stores the table of contents of an archive file in the cache.  The
+ * given list is copied.  This function is thread-safe.
+ */
+void
+archive_toc_cache_put(const char *path_fs, time_t mtime, GSList *toc);
+
 #endif
@@ -26,10 +26,31 @@
 
 #include <assert.h>
 
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+/**
+ * Each chunk's payload begins at a multiple of this, so the SIMD
+ * filter/convert kernels see aligned data and a payload never shares
+ * a cache line with its neighbour.
+ */
+#define MUSIC_BUFFER_ALIGN 64
+
 struct music_buffer {
+	/** the array of chunk headers; the payloads live in the
+	    separate #data slab, so walking headers (e.g. during
+	    cross-fade analysis) does not pull audio bytes through the
+	    cache */
 	struct music_chunk *chunks;
 	unsigned num_chunks;
 
+	/** the payload slab, as returned by the allocator */
+	void *data;
+
+	/** the aligned payload size of one chunk within #data */
+	size_t data_stride;
+
 	struct music_chunk *available;
 
 	/** a mutex which protects #available */
@@ -53,16 +74,33 @@ music_buffer_new(unsigned num_chunks)
 	buffer->chunks = g_new(struct music_chunk, num_chunks);
 	buffer->num_chunks = num_chunks;
 
-	chunk = buffer->available = buffer->chunks;
-	poison_undefined(chunk, sizeof(*chunk));
+	buffer->data_stride = ((music_chunk_size - 1) |
+			       (MUSIC_BUFFER_ALIGN - 1)) + 1;
+	buffer->data = g_malloc(buffer->data_stride * num_chunks +
+				MUSIC_BUFFER_ALIGN - 1);
 
-	for (unsigned i = 1; i < num_chunks; ++i) {
-		chunk->next = &buffer->chunks[i];
-		chunk = chunk->next;
-		poison_undefined(chunk, sizeof(*chunk));
-	}
+	char *data = (char *)(((uintptr_t)buffer->data +
+			       MUSIC_BUFFER_ALIGN - 1) &
+			      ~(uintptr_t)(MUSIC_BUFFER_ALIGN - 1));
+
+#ifdef MADV_HUGEPAGE
+	/* multi-MB buffers benefit from transparent huge pages: fewer
+	   TLB misses in the decoder and output threads; this is only
+	   advice, failure is not an error */
+	madvise(data, buffer->data_stride * num_chunks, MADV_HUGEPAGE);
+#endif
 
-	chunk->next = NULL;
+	buffer->available = buffer->chunks;
+
+	for (unsigned i = 0; i < num_chunks; ++i) {
+		chunk = &buffer->chunks[i];
+		chunk->next = i + 1 < num_chunks
+			? &buffer->chunks[i + 1]
+			: NULL;
+		chunk->data = data + i * buffer->data_stride;
+
+		poison_undefined(chunk->data, music_chunk_size);
+	}
 
 	buffer->mutex = g_mutex_new();
 
@@ -81,6 +119,7 @@ music_buffer_free(struct music_buffer *buffer)
 	assert(buffer->num_allocated == 0);
 
 	g_mutex_free(buffer->mutex);
+	g_free(buffer->data);
 	g_free(buffer->chunks);
 	g_free(buffer);
 }
@@ -124,7 +163,7 @@ music_buffer_return(struct music_buffer *buffer, struct music_chunk *chunk)
 	g_mutex_lock(buffer->mutex);
 
 	music_chunk_free(chunk);
-	poison_undefined(chunk, sizeof(*chunk));
+	poison_undefined(chunk->data, music_chunk_size);
 
 	chunk->next = buffer->available;
 	buffer->available = chunk;
@@ -24,6 +24,8 @@
 
 #include <assert.h>
 
+size_t music_chunk_size = CHUNK_SIZE;
+
 void
 music_chunk_init(struct music_chunk *chunk)
 {
@@ -31,6 +33,10 @@ music_chunk_init(struct music_chunk *chunk)
 	chunk->length = 0;
 	chunk->tag = NULL;
 	chunk->replay_gain_serial = 0;
+
+#ifdef ENABLE_PERF_COUNTERS
+	chunk->stamp_ns = 0;
+#endif
 }
 
 void
@@ -74,7 +80,7 @@ music_chunk_write(struct music_chunk *chunk,
 		chunk->times = data_time;
 	}
 
-	num_frames = (sizeof(chunk->data) - chunk->length) / frame_size;
+	num_frames = (music_chunk_size - chunk->length) / frame_size;
 	if (num_frames == 0)
 		return NULL;
 
@@ -93,10 +99,10 @@ music_chunk_expand(struct music_chunk *chunk,
 	const size_t frame_size = audio_format_frame_size(audio_format);
 
 	assert(chunk != NULL);
-	assert(chunk->length + length <= sizeof(chunk->data));
+	assert(chunk->length + length <= music_chunk_size);
 	assert(audio_format_equals(&chunk->audio_format, audio_format));
 
 	chunk->length += length;
 
-	return chunk->length + frame_size > sizeof(chunk->data);
+	return chunk->length + frame_size > music_chunk_size;
 }
@@ -20,6 +20,7 @@
 #ifndef MPD_CHUNK_H
 #define MPD_CHUNK_H
 
+#include "check.h"
 #include "replay_gain_info.h"
 
 #ifndef NDEBUG
@@ -31,9 +32,18 @@
 #include <stddef.h>
 
 enum {
+	/** the default chunk payload size */
 	CHUNK_SIZE = 4096,
 };
 
+/**
+ * The configured chunk payload size ("audio_chunk_size"); read-only
+ * after daemon startup.  Larger chunks reduce the number of
+ * allocations, pipe handoffs and filter invocations per second for
+ * high sample rates.
+ */
+extern size_t music_chunk_size;
+
 struct audio_format;
 
 /**
@@ -86,12 +96,24 @@ struct music_chunk {
 	 */
 	unsigned replay_gain_serial;
 
-	/** the data (probably PCM) */
-	char data[CHUNK_SIZE];
+#ifdef ENABLE_PERF_COUNTERS
+	/**
+	 * The monotonic clock [ns] when the decoder flushed this
+	 * chunk into the pipe, or 0 if the chunk did not pass through
+	 * decoder_flush_chunk().  Used to measure the
+	 * decoder-to-speaker latency, see perf.h.
+	 */
+	uint64_t stamp_ns;
+#endif
 
 #ifndef NDEBUG
 	struct audio_format audio_format;
 #endif
+
+	/** the data (probably PCM); points into the music_buffer's
+	    separate data slab, is 64-byte aligned and #music_chunk_size
+	    bytes large, see music_buffer_new() */
+	char *data;
 };
 
 void
@@ -22,7 +22,7 @@
 
 bool client_is_expired(const struct client *client)
 {
-	return client->channel == NULL;
+	return client->expired || client->channel == NULL;
 }
 
 int client_get_uid(const struct client *client)
@@ -38,4 +38,8 @@ unsigned client_get_permission(const struct client *client)
 void client_set_permission(struct client *client, unsigned permission)
 {
 	client->permission = permission;
+
+	/* resolve the allowed-command bitmask right away (instead of
+	   on every command), see #allowed_commands */
+	command_allowed_mask(permission, client->allowed_commands);
 }
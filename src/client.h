@@ -66,6 +66,39 @@ void client_set_permission(struct client *client, unsigned permission);
  */
 void client_puts(struct client *client, const char *s);
 
+/**
+ * Write raw bytes to the client; used for binary framed responses
+ * (see client_binary.h).
+ */
+void
+client_write_raw(struct client *client, const void *data, size_t length);
+
+/**
+ * Write a decimal number to the client, with a fast inline conversion
+ * instead of the printf machinery.
+ */
+void
+client_write_uint(struct client *client, unsigned long value);
+
+void
+client_write_int(struct client *client, long value);
+
+/**
+ * Write a "name: value\n" line to the client, bypassing the printf
+ * machinery.  These cover the bulk of "status", "currentsong" and
+ * "stats" responses, whose cost is then one memcpy per piece plus the
+ * integer conversions.
+ */
+void
+client_write_pair(struct client *client, const char *name, const char *value);
+
+void
+client_write_pair_int(struct client *client, const char *name, long value);
+
+void
+client_write_pair_uint(struct client *client, const char *name,
+		       unsigned long value);
+
 /**
  * Write a printf-like formatted string to the client.
  */
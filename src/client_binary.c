@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "client_binary.h"
+#include "client_internal.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+
+enum {
+	RECORD_END = 0x00,
+	RECORD_DEFINE = 0x01,
+	RECORD_PAIR = 0x02,
+	RECORD_PAIR_LITERAL = 0x03,
+	RECORD_PAIR_FULL_LITERAL = 0x04,
+};
+
+enum {
+	/** the dictionary ids are 16 bit wide */
+	CLIENT_BINARY_DICT_MAX = 65536,
+
+	/** longer values are sent literally; interning them would
+	    bloat the dictionary for little gain, because long values
+	    rarely repeat */
+	CLIENT_BINARY_INTERN_MAX = 256,
+};
+
+/**
+ * The per-response string dictionary of a client in binary framing
+ * mode.  Allocated on demand by the first pair of a response, reset
+ * by client_binary_end().
+ */
+struct client_binary {
+	/** maps the interned string to its id plus one (zero means
+	    "not found" in a GHashTable lookup) */
+	GHashTable *dict;
+
+	/** the id assigned to the next DEFINE record */
+	unsigned next_id;
+
+	/** has the current response emitted any record yet? */
+	bool frame_open;
+};
+
+bool
+client_binary_enabled(const struct client *client)
+{
+	return client->binary_output;
+}
+
+static void
+binary_put_u16(uint8_t *p, unsigned value)
+{
+	p[0] = value & 0xff;
+	p[1] = (value >> 8) & 0xff;
+}
+
+static void
+binary_put_u32(uint8_t *p, uint32_t value)
+{
+	p[0] = value & 0xff;
+	p[1] = (value >> 8) & 0xff;
+	p[2] = (value >> 16) & 0xff;
+	p[3] = (value >> 24) & 0xff;
+}
+
+static struct client_binary *
+client_binary_get(struct client *client)
+{
+	struct client_binary *binary = client->binary;
+
+	if (binary == NULL) {
+		binary = g_new(struct client_binary, 1);
+		binary->dict = g_hash_table_new_full(g_str_hash, g_str_equal,
+						     g_free, NULL);
+		binary->next_id = 0;
+		binary->frame_open = false;
+		client->binary = binary;
+	}
+
+	binary->frame_open = true;
+	return binary;
+}
+
+/**
+ * Interns a string in the response dictionary, emitting a DEFINE
+ * record if it was not seen before.
+ *
+ * @return the dictionary id, or -1 if the string is not worth
+ * interning (too long, or the dictionary is full)
+ */
+static int
+client_binary_intern(struct client *client, struct client_binary *binary,
+		     const char *s, size_t length)
+{
+	if (length > CLIENT_BINARY_INTERN_MAX)
+		return -1;
+
+	gpointer value = g_hash_table_lookup(binary->dict, s);
+	if (value != NULL)
+		return GPOINTER_TO_UINT(value) - 1;
+
+	if (binary->next_id >= CLIENT_BINARY_DICT_MAX)
+		return -1;
+
+	unsigned id = binary->next_id++;
+	g_hash_table_insert(binary->dict, g_strdup(s),
+			    GUINT_TO_POINTER(id + 1));
+
+	uint8_t header[5];
+	header[0] = RECORD_DEFINE;
+	binary_put_u16(header + 1, id);
+	binary_put_u16(header + 3, length);
+	client_write_raw(client, header, sizeof(header));
+	client_write_raw(client, s, length);
+
+	return id;
+}
+
+void
+client_binary_pair_n(struct client *client, const char *name,
+		     const char *value, size_t length)
+{
+	assert(client->binary_output);
+	assert(name != NULL);
+	assert(value != NULL);
+
+	struct client_binary *binary = client_binary_get(client);
+
+	int name_id = client_binary_intern(client, binary,
+					   name, strlen(name));
+	if (name_id < 0) {
+		/* the dictionary was filled up by distinct values
+		   before this name was first seen; send both strings
+		   literally instead of referencing an id that was
+		   never defined */
+		size_t name_length = strlen(name);
+
+		uint8_t name_header[3];
+		name_header[0] = RECORD_PAIR_FULL_LITERAL;
+		binary_put_u16(name_header + 1, name_length);
+		client_write_raw(client, name_header, sizeof(name_header));
+		client_write_raw(client, name, name_length);
+
+		uint8_t value_header[4];
+		binary_put_u32(value_header, length);
+		client_write_raw(client, value_header, sizeof(value_header));
+		client_write_raw(client, value, length);
+		return;
+	}
+
+	int value_id = client_binary_intern(client, binary, value, length);
+	if (value_id >= 0) {
+		uint8_t record[5];
+		record[0] = RECORD_PAIR;
+		binary_put_u16(record + 1, name_id);
+		binary_put_u16(record + 3, value_id);
+		client_write_raw(client, record, sizeof(record));
+	} else {
+		uint8_t header[7];
+		header[0] = RECORD_PAIR_LITERAL;
+		binary_put_u16(header + 1, name_id);
+		binary_put_u32(header + 3, length);
+		client_write_raw(client, header, sizeof(header));
+		client_write_raw(client, value, length);
+	}
+}
+
+void
+client_binary_pair(struct client *client, const char *name,
+		   const char *value)
+{
+	client_binary_pair_n(client, name, value, strlen(value));
+}
+
+void
+client_binary_end(struct client *client)
+{
+	struct client_binary *binary = client->binary;
+
+	if (binary == NULL || !binary->frame_open)
+		return;
+
+	static const uint8_t end = RECORD_END;
+	client_write_raw(client, &end, sizeof(end));
+
+	g_hash_table_remove_all(binary->dict);
+	binary->next_id = 0;
+	binary->frame_open = false;
+}
+
+void
+client_binary_free(struct client *client)
+{
+	struct client_binary *binary = client->binary;
+
+	if (binary == NULL)
+		return;
+
+	g_hash_table_destroy(binary->dict);
+	g_free(binary);
+	client->binary = NULL;
+}
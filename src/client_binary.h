@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Binary framing for bulk responses, negotiated per client with the
+ * "binaryoutput" command.  When enabled, the database and playlist
+ * listing commands replace their "name: value" text lines with
+ * length-prefixed records, eliminating the formatting overhead and
+ * deduplicating repeated strings.
+ *
+ * A framed response is a sequence of records, terminated by an END
+ * record; the usual "OK" (or "ACK ...") text line follows after the
+ * END record, so response completion and error handling are
+ * unchanged.  All integers are little-endian.  The record types are:
+ *
+ *  - 0x00 END: no payload; the dictionary is discarded.
+ *  - 0x01 DEFINE: u16 id, u16 length, bytes - adds a string to the
+ *    per-response dictionary.
+ *  - 0x02 PAIR: u16 name id, u16 value id - a "name: value" pair,
+ *    both strings interned in the dictionary.
+ *  - 0x03 PAIR_LITERAL: u16 name id, u32 length, bytes - a pair
+ *    whose value is transmitted literally, because it is too long to
+ *    be worth interning or the dictionary is full.
+ *  - 0x04 PAIR_FULL_LITERAL: u16 name length, name bytes, u32 value
+ *    length, value bytes - a pair transmitted entirely literally;
+ *    emitted when the dictionary is already full when a name is
+ *    first seen.
+ *
+ * Commands whose responses are not framed keep emitting plain text
+ * even while the mode is enabled.
+ */
+
+#ifndef MPD_CLIENT_BINARY_H
+#define MPD_CLIENT_BINARY_H
+
+#include "check.h"
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct client;
+
+/**
+ * Has this client enabled binary framing with "binaryoutput"?
+ * Printing code checks this to decide between text lines and
+ * client_binary_pair().
+ */
+G_GNUC_PURE
+bool
+client_binary_enabled(const struct client *client);
+
+/**
+ * Emits one "name: value" record, interning both strings in the
+ * per-response dictionary.  Opens a frame implicitly on the first
+ * call of a response.
+ */
+void
+client_binary_pair(struct client *client, const char *name,
+		   const char *value);
+
+/**
+ * Like client_binary_pair(), but the length of the value is already
+ * known.
+ */
+void
+client_binary_pair_n(struct client *client, const char *name,
+		     const char *value, size_t length);
+
+/**
+ * Emits an END record and discards the response dictionary.  No-op
+ * when no frame is open; called unconditionally before the "OK" or
+ * "ACK" line is written.
+ */
+void
+client_binary_end(struct client *client);
+
+/**
+ * Releases the dictionary when the client is freed.
+ */
+void
+client_binary_free(struct client *client);
+
+#endif
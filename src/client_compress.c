@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "client_compress.h"
+#include "client_internal.h"
+
+#ifdef HAVE_ZLIB
+
+#include <zlib.h>
+
+#include <assert.h>
+
+/**
+ * An active deflate context of one client.  The "next" link chains
+ * free contexts in the pool.
+ */
+struct client_compress {
+	z_stream zs;
+
+	struct client_compress *next;
+};
+
+/**
+ * A pool of initialized deflate contexts, ready for reuse; see the
+ * file comment in client_compress.h.  Guarded by a mutex because
+ * clients may be freed from the I/O workers.
+ */
+static GStaticMutex compress_pool_mutex = G_STATIC_MUTEX_INIT;
+static struct client_compress *compress_pool;
+static unsigned compress_pool_size;
+
+enum {
+	/** the maximum number of pooled contexts */
+	COMPRESS_POOL_MAX = 8,
+
+	/** the size of the stack buffer receiving deflate output */
+	COMPRESS_OUT_BUF_SIZE = 4096,
+};
+
+static struct client_compress *
+compress_context_acquire(void)
+{
+	struct client_compress *compress;
+
+	g_static_mutex_lock(&compress_pool_mutex);
+	compress = compress_pool;
+	if (compress != NULL) {
+		compress_pool = compress->next;
+		--compress_pool_size;
+	}
+	g_static_mutex_unlock(&compress_pool_mutex);
+
+	if (compress != NULL) {
+		deflateReset(&compress->zs);
+		return compress;
+	}
+
+	compress = g_new0(struct client_compress, 1);
+	if (deflateInit(&compress->zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+		g_free(compress);
+		return NULL;
+	}
+
+	return compress;
+}
+
+static void
+compress_context_release(struct client_compress *compress)
+{
+	g_static_mutex_lock(&compress_pool_mutex);
+	if (compress_pool_size < COMPRESS_POOL_MAX) {
+		compress->next = compress_pool;
+		compress_pool = compress;
+		++compress_pool_size;
+		compress = NULL;
+	}
+	g_static_mutex_unlock(&compress_pool_mutex);
+
+	if (compress != NULL) {
+		deflateEnd(&compress->zs);
+		g_free(compress);
+	}
+}
+
+void
+client_compress_pool_deinit(void)
+{
+	g_static_mutex_lock(&compress_pool_mutex);
+
+	while (compress_pool != NULL) {
+		struct client_compress *compress = compress_pool;
+		compress_pool = compress->next;
+		deflateEnd(&compress->zs);
+		g_free(compress);
+	}
+
+	compress_pool_size = 0;
+
+	g_static_mutex_unlock(&compress_pool_mutex);
+}
+
+/**
+ * Runs deflate() with the given flush mode until all input has been
+ * consumed and all output has been copied into the client's output
+ * pages.
+ */
+static void
+compress_run(struct client *client, int flush)
+{
+	z_stream *zs = &client->compress->zs;
+
+	do {
+		unsigned char out[COMPRESS_OUT_BUF_SIZE];
+
+		zs->next_out = out;
+		zs->avail_out = sizeof(out);
+
+		if (deflate(zs, flush) == Z_STREAM_ERROR) {
+			/* this "cannot happen"; drop the connection
+			   instead of sending corrupt data */
+			client_set_expired(client);
+			return;
+		}
+
+		client_write_uncompressed(client, (const char *)out,
+					  sizeof(out) - zs->avail_out);
+	} while (zs->avail_out == 0 || zs->avail_in > 0);
+}
+
+void
+client_compress_write(struct client *client, const char *data, size_t length)
+{
+	assert(client->compress != NULL);
+
+	z_stream *zs = &client->compress->zs;
+
+	zs->next_in = (unsigned char *)(char *)data;
+	zs->avail_in = length;
+
+	compress_run(client, Z_NO_FLUSH);
+}
+
+void
+client_compress_response_end(struct client *client)
+{
+	if (client->compress != NULL) {
+		z_stream *zs = &client->compress->zs;
+
+		zs->next_in = NULL;
+		zs->avail_in = 0;
+		compress_run(client, Z_SYNC_FLUSH);
+	}
+
+	switch (client->compress_pending) {
+	case CLIENT_COMPRESS_PENDING_NONE:
+		break;
+
+	case CLIENT_COMPRESS_PENDING_ENABLE:
+		if (client->compress == NULL)
+			client->compress = compress_context_acquire();
+		break;
+
+	case CLIENT_COMPRESS_PENDING_DISABLE:
+		if (client->compress != NULL) {
+			compress_context_release(client->compress);
+			client->compress = NULL;
+		}
+		break;
+	}
+
+	client->compress_pending = CLIENT_COMPRESS_PENDING_NONE;
+}
+
+void
+client_compress_free(struct client *client)
+{
+	if (client->compress != NULL) {
+		compress_context_release(client->compress);
+		client->compress = NULL;
+	}
+}
+
+#endif /* HAVE_ZLIB */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * Per-connection deflate compression of responses, negotiated with
+ * the "compression" command.  The scheme change is deferred to the
+ * end of the response which carries the command, so its "OK" line is
+ * still transmitted with the old scheme; every following byte is part
+ * of one continuous zlib stream, sync-flushed at each response
+ * boundary so the client never waits for data stuck in the
+ * compressor.
+ *
+ * The compression contexts are pooled: a context released by a
+ * disconnecting client is reset and reused, saving the ~256 kB
+ * deflate state allocation per connection.
+ */
+
+#ifndef MPD_CLIENT_COMPRESS_H
+#define MPD_CLIENT_COMPRESS_H
+
+#include "check.h"
+
+#include <stddef.h>
+
+struct client;
+
+#ifdef HAVE_ZLIB
+
+/**
+ * Compresses a block of response data and passes the result to
+ * client_write_uncompressed().  Called by client_write() while a
+ * compression context is active.
+ */
+void
+client_compress_write(struct client *client, const char *data, size_t length);
+
+/**
+ * Called at the end of every response: sync-flushes the active
+ * compression context, and applies a pending scheme change requested
+ * by the "compression" command.
+ */
+void
+client_compress_response_end(struct client *client);
+
+/**
+ * Returns the compression context to the pool when the client is
+ * freed.
+ */
+void
+client_compress_free(struct client *client);
+
+/**
+ * Discards all pooled compression contexts on shutdown.
+ */
+void
+client_compress_pool_deinit(void);
+
+#else /* !HAVE_ZLIB */
+
+static inline void
+client_compress_response_end(struct client *client)
+{
+	(void)client;
+}
+
+static inline void
+client_compress_free(struct client *client)
+{
+	(void)client;
+}
+
+static inline void
+client_compress_pool_deinit(void)
+{
+}
+
+#endif /* !HAVE_ZLIB */
+
+#endif
@@ -45,7 +45,7 @@ client_out_event(G_GNUC_UNUSED GIOChannel *source, GIOCondition condition,
 
 	g_timer_start(client->last_activity);
 
-	if (g_queue_is_empty(client->deferred_send)) {
+	if (!client_has_deferred(client)) {
 		/* done sending deferred buffers exist: schedule
 		   read */
 		client->source_id = g_io_add_watch(client->channel,
@@ -95,7 +95,7 @@ client_in_event(G_GNUC_UNUSED GIOChannel *source, GIOCondition condition,
 		return false;
 	}
 
-	if (!g_queue_is_empty(client->deferred_send)) {
+	if (client_has_deferred(client)) {
 		/* deferred buffers exist: schedule write */
 		client->source_id = g_io_add_watch(client->channel,
 						   G_IO_OUT|G_IO_ERR|G_IO_HUP,
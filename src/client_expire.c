@@ -25,6 +25,19 @@ static guint expire_source_id;
 void
 client_set_expired(struct client *client)
 {
+	if (client->io_context != NULL) {
+		/* worker mode: just set the flag; the watches are torn
+		   down by client_io_update_watches().  This must not
+		   lock client->mutex, because some callers (the flush
+		   paths) already hold it; the plain store is safe, and
+		   the race on #expire_source_id is benign because
+		   g_idle_add() is thread-safe and a duplicate check is
+		   harmless */
+		client->expired = true;
+		client_schedule_expire();
+		return;
+	}
+
 	if (!client_is_expired(client))
 		client_schedule_expire();
 
@@ -43,14 +56,24 @@ static void
 client_check_expired_callback(gpointer data, G_GNUC_UNUSED gpointer user_data)
 {
 	struct client *client = data;
+	int elapsed;
 
 	if (client_is_expired(client)) {
 		g_debug("[%u] expired", client->num);
 		client_close(client);
-	} else if (!client->idle_waiting && /* idle clients
-					       never expire */
-		   (int)g_timer_elapsed(client->last_activity, NULL) >
-		   client_timeout) {
+		return;
+	}
+
+	/* the I/O worker restarts the timer on every read */
+	if (client->mutex != NULL)
+		g_mutex_lock(client->mutex);
+	elapsed = (int)g_timer_elapsed(client->last_activity, NULL);
+	if (client->mutex != NULL)
+		g_mutex_unlock(client->mutex);
+
+	if (!client->idle_waiting && /* idle clients
+					never expire */
+	    elapsed > client_timeout) {
 		g_debug("[%u] timeout", client->num);
 		client_close(client);
 	}
@@ -19,6 +19,8 @@
 
 #include "config.h"
 #include "client_internal.h"
+#include "client_io.h"
+#include "client_compress.h"
 #include "conf.h"
 
 #include <assert.h>
@@ -50,6 +52,8 @@ void client_manager_init(void)
 		config_get_positive(CONF_MAX_OUTPUT_BUFFER_SIZE,
 				    CLIENT_MAX_OUTPUT_BUFFER_SIZE_DEFAULT / 1024)
 		* 1024;
+
+	client_io_init();
 }
 
 static void client_close_all(void)
@@ -67,7 +71,16 @@ void client_manager_deinit(void)
 {
 	client_close_all();
 
+	/* this runs the frees deferred by client_close_all() before
+	   the worker threads are joined */
+	client_io_deinit();
+
 	client_max_connections = 0;
 
 	client_deinit_expire();
+
+	client_allocator_deinit();
+
+	client_buffer_pool_deinit();
+	client_compress_pool_deinit();
 }
@@ -20,10 +20,27 @@
 #include "config.h"
 #include "client_idle.h"
 #include "client_internal.h"
+#include "client_compress.h"
 #include "idle.h"
+#include "conf.h"
+#include "status_print.h"
+#include "playlist_print.h"
+#include "playlist.h"
 
 #include <assert.h>
 
+/**
+ * Events which have been announced, but not yet delivered to the
+ * clients because the flush timeout has not expired yet.
+ */
+static unsigned client_idle_pending;
+
+/** the GLib source id of the flush timeout, or 0 */
+static guint client_idle_flush_source_id;
+
+/** the configured flush window [ms]; -1 means "not configured yet" */
+static int client_idle_flush_delay = -1;
+
 /**
  * Send "idle" response to this client.
  */
@@ -47,6 +64,16 @@ client_idle_notify(struct client *client)
 				      idle_names[i]);
 	}
 
+	if (client->idle_payload &&
+	    (flags & client->idle_subscriptions & IDLE_PLAYER) != 0) {
+		/* opt-in (see "idlepayload"): push the answers to the
+		   "status" and "currentsong" commands the client
+		   would send next anyway, saving two round trips per
+		   state change */
+		status_print(client);
+		playlist_print_current(client, &g_playlist);
+	}
+
 	client_puts(client, "OK\n");
 	g_timer_start(client->last_activity);
 }
@@ -61,6 +88,7 @@ client_idle_add(struct client *client, unsigned flags)
 	if (client->idle_waiting
 	    && (client->idle_flags & client->idle_subscriptions)) {
 		client_idle_notify(client);
+		client_compress_response_end(client);
 		client_write_output(client);
 	}
 }
@@ -74,11 +102,46 @@ client_idle_callback(gpointer data, gpointer user_data)
 	client_idle_add(client, flags);
 }
 
-void client_manager_idle_add(unsigned flags)
+static gboolean
+client_manager_idle_flush(G_GNUC_UNUSED gpointer data)
 {
+	unsigned flags = client_idle_pending;
+
 	assert(flags != 0);
 
+	client_idle_pending = 0;
+	client_idle_flush_source_id = 0;
+
 	client_list_foreach(client_idle_callback, GUINT_TO_POINTER(flags));
+	return false;
+}
+
+void client_manager_idle_add(unsigned flags)
+{
+	assert(flags != 0);
+
+	if (client_idle_flush_delay < 0)
+		client_idle_flush_delay =
+			config_get_unsigned(CONF_IDLE_FLUSH_DELAY, 10);
+
+	if (client_idle_flush_delay == 0) {
+		/* coalescing disabled: notify immediately */
+		client_list_foreach(client_idle_callback,
+				    GUINT_TO_POINTER(flags));
+		return;
+	}
+
+	/* collect events for a short while before notifying the
+	   clients: a burst of changes (e.g. a bulk "add") then costs
+	   one wakeup and one socket write per client instead of one
+	   per change */
+
+	client_idle_pending |= flags;
+
+	if (client_idle_flush_source_id == 0)
+		client_idle_flush_source_id =
+			g_timeout_add(client_idle_flush_delay,
+				      client_manager_idle_flush, NULL);
 }
 
 bool client_idle_wait(struct client *client, unsigned flags)
@@ -30,24 +30,114 @@
 enum {
 	CLIENT_MAX_SUBSCRIPTIONS = 16,
 	CLIENT_MAX_MESSAGES = 64,
+
+	/** the size of one output buffer page */
+	CLIENT_SEND_BUF_SIZE = 16384,
 };
 
-struct deferred_buffer {
+/**
+ * A reference-counted output buffer page.  Response text is formatted
+ * into the current page, and when the client socket stalls, the page
+ * is queued by reference instead of being copied.
+ */
+struct client_buffer {
+	/** the reference counter; the buffer is freed when it drops
+	    to zero */
+	int ref;
+
+	/** the number of data bytes used */
 	size_t size;
+
+	/** this is a variable length array */
 	char data[sizeof(long)];
 };
 
+struct client_buffer *
+client_buffer_new(size_t alloc);
+
+struct client_buffer *
+client_buffer_ref(struct client_buffer *buffer);
+
+void
+client_buffer_unref(struct client_buffer *buffer);
+
+/**
+ * Frees all pages kept in the global page pool.
+ */
+void
+client_buffer_pool_deinit(void);
+
+struct client_binary;
+struct client_compress;
+struct search_cache;
+
+/**
+ * A scheme change requested by the "compression" command, applied at
+ * the end of the response which carried the command.
+ */
+enum client_compress_pending {
+	CLIENT_COMPRESS_PENDING_NONE,
+	CLIENT_COMPRESS_PENDING_ENABLE,
+	CLIENT_COMPRESS_PENDING_DISABLE,
+};
+
+/**
+ * A queued reference to a #client_buffer which could not be written
+ * to the socket yet.
+ */
+struct deferred_buffer {
+	struct client_buffer *buffer;
+
+	/** the number of data bytes already written */
+	size_t position;
+};
+
 struct client {
 	struct player_control *player_control;
 
 	GIOChannel *channel;
 	guint source_id;
 
+	/** the I/O worker context servicing this client's socket, or
+	    NULL if the client is serviced by the main loop */
+	GMainContext *io_context;
+
+	/** protects the I/O state shared between the main thread and
+	    the I/O worker; NULL when #io_context is NULL */
+	GMutex *mutex;
+
+	/** the socket watches on the worker context (worker mode
+	    only); the main-loop mode uses #source_id instead */
+	GSource *in_source, *out_source;
+
+	/** the pending "process input" idle source on the main
+	    context, scheduled by the worker */
+	GSource *process_source;
+
+	/** this client is doomed and will be closed by the next
+	    expire check; in main-loop mode, the #channel is cleared
+	    instead */
+	bool expired;
+
+	/** the main thread is executing this client's commands;
+	    reading is suspended meanwhile (worker mode only) */
+	bool io_processing;
+
+	/** an output flush is already scheduled on the worker */
+	bool flush_scheduled;
+
 	/** the buffer for reading lines from the #channel */
 	struct fifo_buffer *input;
 
 	unsigned permission;
 
+	/**
+	 * The bitmask of commands allowed with #permission, resolved
+	 * by client_set_permission(); the command dispatcher tests a
+	 * single bit instead of consulting the permission set.
+	 */
+	uint64_t allowed_commands[COMMAND_MASK_WORDS];
+
 	/** the uid of the client process, or -1 if unknown */
 	int uid;
 
@@ -61,9 +151,23 @@ struct client {
 	size_t cmd_list_size;	/* mem cmd_list consumes */
 	GQueue *deferred_send;	/* for output if client is slow */
 	size_t deferred_bytes;	/* mem deferred_send consumes */
+
+	/** an unlinked temporary file which receives deferred output
+	    once #deferred_send exceeds its memory limit, or -1; this
+	    keeps the memory footprint constant for arbitrarily large
+	    responses */
+	int deferred_fd;
+
+	/** the number of bytes already sent from the spill file */
+	size_t deferred_fd_read;
+
+	/** the total number of bytes written to the spill file */
+	size_t deferred_fd_size;
 	unsigned int num;	/* client number */
 
-	char send_buf[16384];
+	/** the current output page, allocated on demand; its "size"
+	    field is only valid once the page has been flushed */
+	struct client_buffer *send_buf;
 	size_t send_buf_used;	/* bytes used this instance */
 
 	/** is this client waiting for an "idle" response? */
@@ -76,6 +180,30 @@ struct client {
 	/** idle flags that the client wants to receive */
 	unsigned idle_subscriptions;
 
+	/** send the "status"/"currentsong" payload inline with
+	    "player" idle notifications? */
+	bool idle_payload;
+
+	/** has this client enabled binary framing with
+	    "binaryoutput"? */
+	bool binary_output;
+
+	/** the per-response string dictionary of the binary framing
+	    mode; allocated on demand, see client_binary.c */
+	struct client_binary *binary;
+
+	/** the active compression context, or NULL; see
+	    client_compress.c */
+	struct client_compress *compress;
+
+	/** a deferred compression scheme change, see
+	    client_compress_response_end() */
+	enum client_compress_pending compress_pending;
+
+	/** the last "search" result set of this client, used to
+	    answer refinement queries; see search_cache.c */
+	struct search_cache *search_cache;
+
 	/**
 	 * A list of channel names this client is subscribed to.
 	 */
@@ -99,6 +227,18 @@ struct client {
 	unsigned num_messages;
 };
 
+/**
+ * Is there any deferred output pending, in memory or in the spill
+ * file?  The spill file descriptor is closed as soon as it has been
+ * drained.
+ */
+static inline bool
+client_has_deferred(const struct client *client)
+{
+	return !g_queue_is_empty(client->deferred_send) ||
+		client->deferred_fd >= 0;
+}
+
 extern unsigned int client_max_connections;
 extern int client_timeout;
 extern size_t client_max_command_list_size;
@@ -159,6 +299,34 @@ client_deinit_expire(void);
 enum command_return
 client_read(struct client *client);
 
+/**
+ * Reads from the socket into the input buffer, without processing
+ * anything.  Returns COMMAND_RETURN_OK (even if the read would
+ * block) or COMMAND_RETURN_CLOSE.
+ */
+enum command_return
+client_fill_input(struct client *client);
+
+/**
+ * Processes all complete lines in the input buffer.
+ */
+enum command_return
+client_process_input(struct client *client);
+
+/**
+ * Frees all resources of the client.  In worker mode, this must run
+ * on the I/O worker (see client_io_defer_free()).
+ */
+void
+client_free(struct client *client);
+
+/**
+ * Frees the list of retired client structures kept by
+ * client_allocate(); call this on shutdown.
+ */
+void
+client_allocator_deinit(void);
+
 enum command_return
 client_process_line(struct client *client, char *line);
 
@@ -168,6 +336,24 @@ client_write_deferred(struct client *client);
 void
 client_write_output(struct client *client);
 
+/**
+ * Copies a block of data into the client's output pages, bypassing
+ * the compression layer; this is where client_compress.c delivers
+ * the deflate output.
+ */
+void
+client_write_uncompressed(struct client *client, const char *data,
+			  size_t length);
+
+/**
+ * Queues a shared (refcounted) page for transmission without copying
+ * its contents; used by caches which store pre-serialized responses
+ * as output pages.  The page must not be modified afterwards.  Adds
+ * its own reference; the caller keeps ownership of its reference.
+ */
+void
+client_write_page(struct client *client, struct client_buffer *buffer);
+
 gboolean
 client_in_event(GIOChannel *source, GIOCondition condition,
 		gpointer data);
@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "client_internal.h"
+#include "client_io.h"
+#include "fifo_buffer.h"
+#include "conf.h"
+#include "main.h"
+
+#include <assert.h>
+
+/*
+ * Locking: all mutable client I/O state (input buffer, output queue,
+ * watch sources, the "expired"/"io_processing"/"flush_scheduled"
+ * flags and the activity timer) is protected by client->mutex.  The
+ * worker holds it for the duration of a callback, including the
+ * non-blocking socket writes; the main thread holds it only briefly
+ * while appending output pages or adjusting watches, so contention is
+ * minimal.
+ *
+ * Lifetime: the main thread owns the client (list membership, command
+ * execution, client_close()).  The final g_free() of a worker-managed
+ * client is deferred to the worker's context (client_io_defer_free()),
+ * which serializes it after any worker callback that may still be
+ * running.
+ */
+
+struct client_io_worker {
+	GThread *thread;
+	GMainContext *context;
+	GMainLoop *loop;
+};
+
+static struct client_io_worker *workers;
+static unsigned num_workers;
+
+/** round-robin cursor for client_io_assign() */
+static unsigned next_worker;
+
+static gpointer
+client_io_thread_func(gpointer data)
+{
+	struct client_io_worker *worker = data;
+
+	g_main_loop_run(worker->loop);
+	return NULL;
+}
+
+void
+client_io_init(void)
+{
+	assert(workers == NULL);
+
+	num_workers = config_get_unsigned(CONF_CLIENT_IO_THREADS, 0);
+	if (num_workers == 0)
+		return;
+
+	workers = g_new(struct client_io_worker, num_workers);
+
+	for (unsigned i = 0; i < num_workers; ++i) {
+		struct client_io_worker *worker = &workers[i];
+		GError *error = NULL;
+
+		worker->context = g_main_context_new();
+		worker->loop = g_main_loop_new(worker->context, false);
+		worker->thread = g_thread_create(client_io_thread_func,
+						 worker, true, &error);
+		if (worker->thread == NULL)
+			g_error("Failed to spawn client I/O thread: %s",
+				error->message);
+	}
+
+	g_debug("started %u client I/O threads", num_workers);
+}
+
+static gboolean
+client_io_quit_event(gpointer data)
+{
+	g_main_loop_quit(data);
+	return false;
+}
+
+/**
+ * Attaches an idle source to the given context.
+ */
+static void
+context_idle_add(GMainContext *context, GSourceFunc function, gpointer data)
+{
+	GSource *source = g_idle_source_new();
+	g_source_set_callback(source, function, data, NULL);
+	g_source_attach(source, context);
+	g_source_unref(source);
+}
+
+void
+client_io_deinit(void)
+{
+	if (workers == NULL)
+		return;
+
+	for (unsigned i = 0; i < num_workers; ++i) {
+		struct client_io_worker *worker = &workers[i];
+
+		/* quit via an idle source, so all previously queued
+		   events (e.g. deferred client destruction) are run
+		   first */
+		context_idle_add(worker->context, client_io_quit_event,
+				 worker->loop);
+
+		g_thread_join(worker->thread);
+		g_main_loop_unref(worker->loop);
+		g_main_context_unref(worker->context);
+	}
+
+	g_free(workers);
+	workers = NULL;
+	num_workers = 0;
+	next_worker = 0;
+}
+
+GMainContext *
+client_io_assign(void)
+{
+	if (num_workers == 0)
+		return NULL;
+
+	struct client_io_worker *worker = &workers[next_worker];
+	next_worker = (next_worker + 1) % num_workers;
+
+	return worker->context;
+}
+
+static gboolean
+client_io_in_event(GIOChannel *source, GIOCondition condition, gpointer data);
+
+static gboolean
+client_io_out_event(GIOChannel *source, GIOCondition condition, gpointer data);
+
+/**
+ * Creates a socket watch on the client's worker context.
+ */
+static GSource *
+client_io_create_watch(struct client *client, GIOCondition condition,
+		       GIOFunc function)
+{
+	GSource *source = g_io_create_watch(client->channel,
+					    condition|G_IO_ERR|G_IO_HUP);
+	g_source_set_callback(source, (GSourceFunc)function, client, NULL);
+	g_source_attach(source, client->io_context);
+	g_source_unref(source);
+
+	/* the reference owned by the context keeps the source alive
+	   until g_source_destroy() */
+	return source;
+}
+
+void
+client_io_update_watches(struct client *client)
+{
+	if (client->expired) {
+		if (client->in_source != NULL) {
+			g_source_destroy(client->in_source);
+			client->in_source = NULL;
+		}
+
+		if (client->out_source != NULL) {
+			g_source_destroy(client->out_source);
+			client->out_source = NULL;
+		}
+
+		return;
+	}
+
+	if (client_has_deferred(client)) {
+		/* blocked on output: stop reading until the queue is
+		   drained, like the main-loop code path */
+
+		if (client->in_source != NULL) {
+			g_source_destroy(client->in_source);
+			client->in_source = NULL;
+		}
+
+		if (client->out_source == NULL)
+			client->out_source =
+				client_io_create_watch(client, G_IO_OUT,
+						       client_io_out_event);
+	} else {
+		if (client->out_source != NULL) {
+			g_source_destroy(client->out_source);
+			client->out_source = NULL;
+		}
+
+		if (!client->io_processing && client->in_source == NULL)
+			client->in_source =
+				client_io_create_watch(client, G_IO_IN,
+						       client_io_in_event);
+	}
+}
+
+/**
+ * Runs on the main thread: execute the commands which the worker has
+ * buffered, then resume reading.
+ */
+static gboolean
+client_io_process_event(gpointer data)
+{
+	struct client *client = data;
+
+	g_mutex_lock(client->mutex);
+	client->process_source = NULL;
+
+	if (client->expired) {
+		g_mutex_unlock(client->mutex);
+		client_close(client);
+		return false;
+	}
+
+	g_mutex_unlock(client->mutex);
+
+	enum command_return ret = client_process_input(client);
+	switch (ret) {
+	case COMMAND_RETURN_OK:
+	case COMMAND_RETURN_ERROR:
+		break;
+
+	case COMMAND_RETURN_KILL:
+		client_close(client);
+		g_main_loop_quit(main_loop);
+		return false;
+
+	case COMMAND_RETURN_CLOSE:
+		client_close(client);
+		return false;
+	}
+
+	if (client_is_expired(client)) {
+		client_close(client);
+		return false;
+	}
+
+	g_mutex_lock(client->mutex);
+	client->io_processing = false;
+	client_io_update_watches(client);
+	g_mutex_unlock(client->mutex);
+
+	return false;
+}
+
+static gboolean
+client_io_in_event(G_GNUC_UNUSED GIOChannel *source, GIOCondition condition,
+		   gpointer data)
+{
+	struct client *client = data;
+
+	g_mutex_lock(client->mutex);
+
+	if (client->expired || condition != G_IO_IN) {
+		client->expired = true;
+		client->in_source = NULL;
+		g_mutex_unlock(client->mutex);
+
+		client_schedule_expire();
+		return false;
+	}
+
+	g_timer_start(client->last_activity);
+
+	enum command_return ret = client_fill_input(client);
+	if (ret != COMMAND_RETURN_OK || client->expired) {
+		client->expired = true;
+		client->in_source = NULL;
+		g_mutex_unlock(client->mutex);
+
+		client_schedule_expire();
+		return false;
+	}
+
+	if (!fifo_buffer_is_empty(client->input)) {
+		/* hand the buffered input to the main thread; no
+		   further reads until it has caught up, which
+		   serializes this client's commands and throttles
+		   producers which are faster than the command
+		   execution */
+
+		client->io_processing = true;
+		client->in_source = NULL;
+
+		GSource *idle = g_idle_source_new();
+		g_source_set_callback(idle, client_io_process_event,
+				      client, NULL);
+		client->process_source = idle;
+		g_source_attach(idle, NULL);
+		g_source_unref(idle);
+
+		g_mutex_unlock(client->mutex);
+		return false;
+	}
+
+	g_mutex_unlock(client->mutex);
+	return true;
+}
+
+static gboolean
+client_io_out_event(G_GNUC_UNUSED GIOChannel *source, GIOCondition condition,
+		    gpointer data)
+{
+	struct client *client = data;
+
+	g_mutex_lock(client->mutex);
+
+	if (client->expired || condition != G_IO_OUT) {
+		client->expired = true;
+		client->out_source = NULL;
+		g_mutex_unlock(client->mutex);
+
+		client_schedule_expire();
+		return false;
+	}
+
+	client_write_deferred(client);
+
+	if (client->expired) {
+		client->out_source = NULL;
+		g_mutex_unlock(client->mutex);
+
+		client_schedule_expire();
+		return false;
+	}
+
+	if (!client_has_deferred(client)) {
+		/* done: resume reading */
+		client->out_source = NULL;
+		client_io_update_watches(client);
+		g_mutex_unlock(client->mutex);
+		return false;
+	}
+
+	/* write more */
+	g_mutex_unlock(client->mutex);
+	return true;
+}
+
+/**
+ * Runs on the worker: flush output which the main thread has queued.
+ */
+static gboolean
+client_io_flush_event(gpointer data)
+{
+	struct client *client = data;
+
+	g_mutex_lock(client->mutex);
+	client->flush_scheduled = false;
+
+	if (!client->expired && client_has_deferred(client))
+		client_write_deferred(client);
+
+	client_io_update_watches(client);
+
+	bool expired = client->expired;
+	g_mutex_unlock(client->mutex);
+
+	if (expired)
+		client_schedule_expire();
+
+	return false;
+}
+
+void
+client_io_poke_flush(struct client *client)
+{
+	assert(client->io_context != NULL);
+
+	g_mutex_lock(client->mutex);
+
+	if (!client->flush_scheduled && !client->expired) {
+		client->flush_scheduled = true;
+		context_idle_add(client->io_context, client_io_flush_event,
+				 client);
+	}
+
+	g_mutex_unlock(client->mutex);
+}
+
+static gboolean
+client_io_free_event(gpointer data)
+{
+	struct client *client = data;
+
+	client_free(client);
+	return false;
+}
+
+void
+client_io_defer_free(struct client *client)
+{
+	assert(client->io_context != NULL);
+
+	g_mutex_lock(client->mutex);
+
+	client_io_update_watches(client);
+	assert(client->expired);
+	assert(client->in_source == NULL);
+	assert(client->out_source == NULL);
+
+	if (client->process_source != NULL) {
+		/* the worker has scheduled command processing which
+		   has not run yet; main thread, so destroying it here
+		   cannot race with its dispatch */
+		g_source_destroy(client->process_source);
+		client->process_source = NULL;
+	}
+
+	g_mutex_unlock(client->mutex);
+
+	context_idle_add(client->io_context, client_io_free_event, client);
+}
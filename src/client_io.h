@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * An optional pool of client I/O threads (client_io_threads).  Each
+ * worker runs its own GMainContext; a client's socket watches live on
+ * its assigned worker, so socket reads, line buffering and response
+ * flushing do not go through the global main loop.  Command execution
+ * is still marshalled onto the main thread, which owns the database
+ * and the playlist.
+ *
+ * By default (client_io_threads "0") no threads are started and the
+ * clients are serviced by the main loop, as before.
+ */
+
+#ifndef MPD_CLIENT_IO_H
+#define MPD_CLIENT_IO_H
+
+#include <glib.h>
+
+struct client;
+
+/**
+ * Starts the configured number of I/O threads.  Called by
+ * client_manager_init().
+ */
+void
+client_io_init(void);
+
+/**
+ * Stops all I/O threads, after running their remaining queued events
+ * (including deferred client destruction).
+ */
+void
+client_io_deinit(void);
+
+/**
+ * Assigns the next worker (round robin) to a new client.  Returns
+ * NULL if no I/O threads are configured; the caller falls back to the
+ * main loop.
+ */
+GMainContext *
+client_io_assign(void);
+
+/**
+ * Starts watching the client's socket for input on its I/O worker.
+ * Caller must hold the client mutex.
+ */
+void
+client_io_update_watches(struct client *client);
+
+/**
+ * Schedules an output flush on the client's I/O worker, unless one is
+ * already scheduled.
+ */
+void
+client_io_poke_flush(struct client *client);
+
+/**
+ * Schedules the final destruction of a closed client on its I/O
+ * worker, which guarantees that no worker callback is still running
+ * when the client is freed.
+ */
+void
+client_io_defer_free(struct client *client);
+
+#endif
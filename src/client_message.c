@@ -41,56 +41,40 @@ client_message_valid_channel_name(const char *name)
 	return true;
 }
 
-void
-client_message_init_null(struct client_message *msg)
-{
-	assert(msg != NULL);
-
-	msg->channel = NULL;
-	msg->message = NULL;
-}
-
-void
-client_message_init(struct client_message *msg,
-		    const char *channel, const char *message)
+struct client_message *
+client_message_new(const char *channel, const char *message)
 {
-	assert(msg != NULL);
+	assert(channel != NULL);
+	assert(message != NULL);
 
+	struct client_message *msg = g_slice_new(struct client_message);
+	msg->ref = 1;
 	msg->channel = g_strdup(channel);
 	msg->message = g_strdup(message);
-}
 
-void
-client_message_copy(struct client_message *dest,
-		    const struct client_message *src)
-{
-	assert(dest != NULL);
-	assert(src != NULL);
-	assert(client_message_defined(src));
-
-	client_message_init(dest, src->channel, src->message);
+	return msg;
 }
 
 struct client_message *
-client_message_dup(const struct client_message *src)
+client_message_ref(struct client_message *msg)
 {
-	struct client_message *dest = g_slice_new(struct client_message);
-	client_message_copy(dest, src);
-	return dest;
+	assert(msg != NULL);
+	assert(msg->ref > 0);
+
+	++msg->ref;
+	return msg;
 }
 
 void
-client_message_deinit(struct client_message *msg)
+client_message_unref(struct client_message *msg)
 {
 	assert(msg != NULL);
+	assert(msg->ref > 0);
+
+	if (--msg->ref > 0)
+		return;
 
 	g_free(msg->channel);
 	g_free(msg->message);
-}
-
-void
-client_message_free(struct client_message *msg)
-{
-	client_message_deinit(msg);
 	g_slice_free(struct client_message, msg);
 }
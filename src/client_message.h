@@ -26,9 +26,17 @@
 #include <glib.h>
 
 /**
- * A client-to-client message.
+ * A reference-counted client-to-client message.  One instance is
+ * shared by the queues of all subscribed clients, instead of
+ * duplicating the payload per recipient.
  */
 struct client_message {
+	/**
+	 * The reference counter; the message is freed when it drops
+	 * to zero.  Only touched in the main thread.
+	 */
+	int ref;
+
 	char *channel;
 
 	char *message;
@@ -38,35 +46,17 @@ G_GNUC_PURE
 bool
 client_message_valid_channel_name(const char *name);
 
-G_GNUC_PURE
-static inline bool
-client_message_defined(const struct client_message *msg)
-{
-	assert(msg != NULL);
-	assert((msg->channel == NULL) == (msg->message == NULL));
-
-	return msg->channel != NULL;
-}
-
-void
-client_message_init_null(struct client_message *msg);
-
-void
-client_message_init(struct client_message *msg,
-		    const char *channel, const char *message);
-
-void
-client_message_copy(struct client_message *dest,
-		    const struct client_message *src);
-
+/**
+ * Creates a new message with a reference count of one.
+ */
 G_GNUC_MALLOC
 struct client_message *
-client_message_dup(const struct client_message *src);
+client_message_new(const char *channel, const char *message);
 
-void
-client_message_deinit(struct client_message *msg);
+struct client_message *
+client_message_ref(struct client_message *msg);
 
 void
-client_message_free(struct client_message *msg);
+client_message_unref(struct client_message *msg);
 
 #endif
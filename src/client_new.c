@@ -19,6 +19,11 @@
 
 #include "config.h"
 #include "client_internal.h"
+#include "client_io.h"
+#include "client_subscribe.h"
+#include "client_binary.h"
+#include "client_compress.h"
+#include "search_cache.h"
 #include "fd_util.h"
 #include "fifo_buffer.h"
 #include "resolver.h"
@@ -26,6 +31,7 @@
 #include "glib_socket.h"
 
 #include <assert.h>
+#include <string.h>
 #include <sys/types.h>
 #ifdef WIN32
 #include <winsock2.h>
@@ -43,6 +49,77 @@
 
 static const char GREETING[] = "OK MPD " PROTOCOL_VERSION "\n";
 
+/**
+ * The maximum number of retired client structures which are kept for
+ * reuse.  Reconnect storms allocate and free clients in rapid
+ * succession; recycling the structure also recycles its input buffer,
+ * queue and timer.
+ */
+#define CLIENT_FREE_LIST_SIZE 16
+
+static GSList *client_free_list;
+static unsigned client_free_list_size;
+
+/**
+ * Allocates a new #client object, reusing one from the free list if
+ * possible.  All fields are zeroed, except for the pre-allocated
+ * input buffer, deferred_send queue and last_activity timer.
+ */
+static struct client *
+client_allocate(void)
+{
+	struct client *client;
+
+	if (client_free_list != NULL) {
+		client = client_free_list->data;
+		client_free_list =
+			g_slist_delete_link(client_free_list,
+					    client_free_list);
+		--client_free_list_size;
+
+		struct fifo_buffer *input = client->input;
+		GQueue *deferred_send = client->deferred_send;
+		GTimer *last_activity = client->last_activity;
+
+		memset(client, 0, sizeof(*client));
+
+		client->input = input;
+		fifo_buffer_clear(client->input);
+
+		client->deferred_send = deferred_send;
+		assert(g_queue_is_empty(client->deferred_send));
+
+		client->last_activity = last_activity;
+		g_timer_start(client->last_activity);
+
+		return client;
+	}
+
+	client = g_new0(struct client, 1);
+	client->input = fifo_buffer_new(4096);
+	client->deferred_send = g_queue_new();
+	client->last_activity = g_timer_new();
+	return client;
+}
+
+void
+client_allocator_deinit(void)
+{
+	while (client_free_list != NULL) {
+		struct client *client = client_free_list->data;
+		client_free_list =
+			g_slist_delete_link(client_free_list,
+					    client_free_list);
+
+		fifo_buffer_free(client->input);
+		g_queue_free(client->deferred_send);
+		g_timer_destroy(client->last_activity);
+		g_free(client);
+	}
+
+	client_free_list_size = 0;
+}
+
 void
 client_new(struct player_control *player_control,
 	   int fd, const struct sockaddr *sa, size_t sa_length, int uid)
@@ -85,7 +162,7 @@ client_new(struct player_control *player_control,
 		return;
 	}
 
-	client = g_new0(struct client, 1);
+	client = client_allocate();
 	client->player_control = player_control;
 
 	client->channel = g_io_channel_new_socket(fd);
@@ -98,25 +175,18 @@ client_new(struct player_control *player_control,
 	/* we prefer to do buffering */
 	g_io_channel_set_buffered(client->channel, false);
 
-	client->source_id = g_io_add_watch(client->channel,
-					   G_IO_IN|G_IO_ERR|G_IO_HUP,
-					   client_in_event, client);
-
-	client->input = fifo_buffer_new(4096);
-
-	client->permission = getDefaultPermissions();
+	client_set_permission(client, getDefaultPermissions());
 	client->uid = uid;
 
-	client->last_activity = g_timer_new();
-
 	client->cmd_list = NULL;
 	client->cmd_list_OK = -1;
 	client->cmd_list_size = 0;
 
-	client->deferred_send = g_queue_new();
 	client->deferred_bytes = 0;
+	client->deferred_fd = -1;
 	client->num = next_client_num++;
 
+	client->send_buf = NULL;
 	client->send_buf_used = 0;
 
 	client->subscriptions = NULL;
@@ -127,39 +197,107 @@ client_new(struct player_control *player_control,
 
 	client_list_add(client);
 
+	/* start watching the socket only after the client is fully
+	   initialized: on an I/O worker, the watch may fire
+	   immediately on another thread */
+
+	client->io_context = client_io_assign();
+	if (client->io_context != NULL) {
+		client->mutex = g_mutex_new();
+
+		g_mutex_lock(client->mutex);
+		client_io_update_watches(client);
+		g_mutex_unlock(client->mutex);
+	} else
+		client->source_id = g_io_add_watch(client->channel,
+						   G_IO_IN|G_IO_ERR|G_IO_HUP,
+						   client_in_event, client);
+
 	remote = sockaddr_to_string(sa, sa_length, NULL);
 	g_log(G_LOG_DOMAIN, LOG_LEVEL_SECURE,
 	      "[%u] opened from %s", client->num, remote);
 	g_free(remote);
 }
 
-static void
-deferred_buffer_free(gpointer data, G_GNUC_UNUSED gpointer user_data)
-{
-	struct deferred_buffer *buffer = data;
-	g_free(buffer);
-}
-
 void
-client_close(struct client *client)
+client_free(struct client *client)
 {
-	client_list_remove(client);
+	if (client->in_source != NULL)
+		g_source_destroy(client->in_source);
 
-	client_set_expired(client);
+	if (client->out_source != NULL)
+		g_source_destroy(client->out_source);
 
-	g_timer_destroy(client->last_activity);
+	if (client->channel != NULL)
+		g_io_channel_unref(client->channel);
 
 	if (client->cmd_list) {
 		free_cmd_list(client->cmd_list);
 		client->cmd_list = NULL;
 	}
 
-	g_queue_foreach(client->deferred_send, deferred_buffer_free, NULL);
-	g_queue_free(client->deferred_send);
+	client_binary_free(client);
+	client_compress_free(client);
+	search_cache_free(client);
 
-	fifo_buffer_free(client->input);
+	struct deferred_buffer *node;
+	while ((node = g_queue_pop_head(client->deferred_send)) != NULL) {
+		client_buffer_unref(node->buffer);
+		g_slice_free(struct deferred_buffer, node);
+	}
+
+	if (client->send_buf != NULL)
+		client_buffer_unref(client->send_buf);
+
+	if (client->deferred_fd >= 0)
+		close(client->deferred_fd);
+
+	if (client->mutex != NULL)
+		g_mutex_free(client->mutex);
 
 	g_log(G_LOG_DOMAIN, LOG_LEVEL_SECURE,
 	      "[%u] closed", client->num);
+
+	if (client_free_list_size < CLIENT_FREE_LIST_SIZE) {
+		/* retire the structure into the free list instead of
+		   freeing it; see client_allocate() */
+		client_free_list = g_slist_prepend(client_free_list, client);
+		++client_free_list_size;
+		return;
+	}
+
+	g_timer_destroy(client->last_activity);
+	g_queue_free(client->deferred_send);
+	fifo_buffer_free(client->input);
 	g_free(client);
 }
+
+void
+client_close(struct client *client)
+{
+	client_list_remove(client);
+
+	/* detach from the channel index and drop queued message
+	   references now, in the main thread; client_free() may run
+	   later in the worker's context */
+	client_unsubscribe_all(client);
+
+	for (GSList *i = client->messages; i != NULL; i = g_slist_next(i))
+		client_message_unref(i->data);
+	g_slist_free(client->messages);
+	client->messages = NULL;
+	client->num_messages = 0;
+
+	client_set_expired(client);
+
+	if (client->io_context != NULL) {
+		/* the worker thread may still be inside a callback
+		   for this client; defer the final destruction to the
+		   worker's context, which serializes it behind any
+		   such callback */
+		client_io_defer_free(client);
+		return;
+	}
+
+	client_free(client);
+}
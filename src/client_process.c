@@ -19,6 +19,9 @@
 
 #include "config.h"
 #include "client_internal.h"
+#include "client_binary.h"
+#include "client_compress.h"
+#include "playlist.h"
 
 #include <string.h>
 
@@ -26,12 +29,40 @@
 #define CLIENT_LIST_OK_MODE_BEGIN "command_list_ok_begin"
 #define CLIENT_LIST_MODE_END "command_list_end"
 
+/**
+ * Does the command list consist only of playlist edits (add, addid,
+ * deleteid)?  Such lists can be applied in "bulk" mode, with a single
+ * version increment and idle event at the end.
+ */
+static bool
+command_list_is_bulk(GSList *list)
+{
+	unsigned n = 0;
+
+	for (GSList *cur = list; cur != NULL; cur = g_slist_next(cur)) {
+		const char *cmd = cur->data;
+
+		if (!g_str_has_prefix(cmd, "add ") &&
+		    !g_str_has_prefix(cmd, "addid ") &&
+		    !g_str_has_prefix(cmd, "deleteid "))
+			return false;
+
+		++n;
+	}
+
+	return n >= 2;
+}
+
 static enum command_return
 client_process_command_list(struct client *client, bool list_ok, GSList *list)
 {
 	enum command_return ret = COMMAND_RETURN_OK;
 	unsigned num = 0;
 
+	const bool bulk = command_list_is_bulk(list);
+	if (bulk)
+		playlist_bulk_begin(&g_playlist);
+
 	for (GSList *cur = list; cur != NULL; cur = g_slist_next(cur)) {
 		char *cmd = cur->data;
 
@@ -41,10 +72,15 @@ client_process_command_list(struct client *client, bool list_ok, GSList *list)
 		g_debug("command_process_list: command returned %i", ret);
 		if (ret != COMMAND_RETURN_OK || client_is_expired(client))
 			break;
-		else if (list_ok)
+		else if (list_ok) {
+			client_binary_end(client);
 			client_puts(client, "list_OK\n");
+		}
 	}
 
+	if (bulk)
+		playlist_bulk_end(&g_playlist, client->player_control);
+
 	return ret;
 }
 
@@ -58,6 +94,7 @@ client_process_line(struct client *client, char *line)
 			/* send empty idle response and leave idle mode */
 			client->idle_waiting = false;
 			command_success(client);
+			client_compress_response_end(client);
 			client_write_output(client);
 		}
 
@@ -97,6 +134,7 @@ client_process_line(struct client *client, char *line)
 			if (ret == COMMAND_RETURN_OK)
 				command_success(client);
 
+			client_compress_response_end(client);
 			client_write_output(client);
 			free_cmd_list(client->cmd_list);
 			client->cmd_list = NULL;
@@ -138,6 +176,7 @@ client_process_line(struct client *client, char *line)
 			if (ret == COMMAND_RETURN_OK)
 				command_success(client);
 
+			client_compress_response_end(client);
 			client_write_output(client);
 		}
 	}
@@ -20,43 +20,57 @@
 #include "config.h"
 #include "client_internal.h"
 #include "fifo_buffer.h"
+#include "string_util.h"
 
 #include <assert.h>
 #include <string.h>
 
+/**
+ * Extracts the next complete line from the input buffer, in place: the
+ * newline is overwritten with a null terminator, and the returned
+ * string points into the fifo_buffer.  It remains valid until the
+ * caller consumes *length_r bytes with fifo_buffer_consume(); nothing
+ * is allocated.  Returns NULL if no complete line is buffered.
+ */
 static char *
-client_read_line(struct client *client)
+client_read_line(struct client *client, size_t *length_r)
 {
-	const char *p, *newline;
+	const char *p;
+	char *line, *newline;
 	size_t length;
-	char *line;
 
 	p = fifo_buffer_read(client->input, &length);
 	if (p == NULL)
 		return NULL;
 
-	newline = memchr(p, '\n', length);
+	/* the fifo_buffer is mutable; it is exposed as "const" only
+	   because reading does not move data around */
+	line = deconst_string(p);
+
+	newline = memchr(line, '\n', length);
 	if (newline == NULL)
 		return NULL;
 
-	line = g_strndup(p, newline - p);
-	fifo_buffer_consume(client->input, newline - p + 1);
+	*newline = 0;
+	*length_r = newline - line + 1;
 
 	return g_strchomp(line);
 }
 
-static enum command_return
-client_input_received(struct client *client, size_t bytesRead)
+enum command_return
+client_process_input(struct client *client)
 {
 	char *line;
-
-	fifo_buffer_append(client->input, bytesRead);
+	size_t length;
 
 	/* process all lines */
 
-	while ((line = client_read_line(client)) != NULL) {
+	while ((line = client_read_line(client, &length)) != NULL) {
 		enum command_return ret = client_process_line(client, line);
-		g_free(line);
+
+		/* the line slice has been parsed in place (see
+		   tokenizer.c); only now may it be discarded */
+		fifo_buffer_consume(client->input, length);
 
 		if (ret == COMMAND_RETURN_KILL ||
 		    ret == COMMAND_RETURN_CLOSE)
@@ -69,7 +83,7 @@ client_input_received(struct client *client, size_t bytesRead)
 }
 
 enum command_return
-client_read(struct client *client)
+client_fill_input(struct client *client)
 {
 	char *p;
 	size_t max_length;
@@ -90,7 +104,8 @@ client_read(struct client *client)
 					 &bytes_read, &error);
 	switch (status) {
 	case G_IO_STATUS_NORMAL:
-		return client_input_received(client, bytes_read);
+		fifo_buffer_append(client->input, bytes_read);
+		return COMMAND_RETURN_OK;
 
 	case G_IO_STATUS_AGAIN:
 		/* try again later, after select() */
@@ -111,3 +126,13 @@ client_read(struct client *client)
 	/* unreachable */
 	return COMMAND_RETURN_CLOSE;
 }
+
+enum command_return
+client_read(struct client *client)
+{
+	enum command_return ret = client_fill_input(client);
+	if (ret != COMMAND_RETURN_OK)
+		return ret;
+
+	return client_process_input(client);
+}
@@ -24,6 +24,45 @@
 
 #include <string.h>
 
+/**
+ * Maps a channel name (owned by the table) to the GSList of
+ * subscribed clients, so a broadcast finds its recipients with one
+ * hash lookup instead of scanning the whole client list.  Created on
+ * demand; only touched in the main thread.
+ */
+static GHashTable *channel_map;
+
+static void
+channel_map_add(const char *channel, struct client *client)
+{
+	if (channel_map == NULL)
+		channel_map = g_hash_table_new_full(g_str_hash, g_str_equal,
+						    g_free, NULL);
+
+	GSList *list = g_hash_table_lookup(channel_map, channel);
+
+	/* prepending moves the list head: store it back (an existing
+	   key is retained by g_hash_table_insert(), and the duplicate
+	   is freed) */
+	g_hash_table_insert(channel_map, g_strdup(channel),
+			    g_slist_prepend(list, client));
+}
+
+static void
+channel_map_remove(const char *channel, struct client *client)
+{
+	assert(channel_map != NULL);
+
+	GSList *list = g_hash_table_lookup(channel_map, channel);
+	assert(list != NULL);
+
+	list = g_slist_remove(list, client);
+	if (list == NULL)
+		g_hash_table_remove(channel_map, channel);
+	else
+		g_hash_table_insert(channel_map, g_strdup(channel), list);
+}
+
 G_GNUC_PURE
 static GSList *
 client_find_subscription(const struct client *client, const char *channel)
@@ -54,6 +93,8 @@ client_subscribe(struct client *client, const char *channel)
 						g_strdup(channel));
 	++client->num_subscriptions;
 
+	channel_map_add(channel, client);
+
 	idle_add(IDLE_SUBSCRIPTION);
 
 	return CLIENT_SUBSCRIBE_OK;
@@ -71,6 +112,8 @@ client_unsubscribe(struct client *client, const char *channel)
 	client->subscriptions = g_slist_remove(client->subscriptions, i->data);
 	--client->num_subscriptions;
 
+	channel_map_remove(channel, client);
+
 	idle_add(IDLE_SUBSCRIPTION);
 
 	assert((client->num_subscriptions == 0) ==
@@ -82,35 +125,57 @@ client_unsubscribe(struct client *client, const char *channel)
 void
 client_unsubscribe_all(struct client *client)
 {
-	for (GSList *i = client->subscriptions; i != NULL; i = g_slist_next(i))
+	for (GSList *i = client->subscriptions; i != NULL; i = g_slist_next(i)) {
+		channel_map_remove(i->data, client);
 		g_free(i->data);
+	}
 
 	g_slist_free(client->subscriptions);
 	client->subscriptions = NULL;
 	client->num_subscriptions = 0;
 }
 
-bool
-client_push_message(struct client *client, const struct client_message *msg)
+/**
+ * Appends a reference to the message to the client's queue.  The
+ * caller has already verified the subscription via the channel index.
+ */
+static bool
+client_push_message(struct client *client, struct client_message *msg)
 {
 	assert(client != NULL);
 	assert(msg != NULL);
-	assert(client_message_defined(msg));
 
-	if (client->num_messages >= CLIENT_MAX_MESSAGES ||
-	    client_find_subscription(client, msg->channel) == NULL)
+	if (client->num_messages >= CLIENT_MAX_MESSAGES)
 		return false;
 
 	if (client->messages == NULL)
 		client_idle_add(client, IDLE_MESSAGE);
 
 	client->messages = g_slist_prepend(client->messages,
-					   client_message_dup(msg));
+					   client_message_ref(msg));
 	++client->num_messages;
 
 	return true;
 }
 
+unsigned
+client_broadcast_message(struct client_message *msg)
+{
+	assert(msg != NULL);
+
+	if (channel_map == NULL)
+		return 0;
+
+	GSList *list = g_hash_table_lookup(channel_map, msg->channel);
+	unsigned n = 0;
+
+	for (GSList *i = list; i != NULL; i = g_slist_next(i))
+		if (client_push_message(i->data, msg))
+			++n;
+
+	return n;
+}
+
 GSList *
 client_read_messages(struct client *client)
 {
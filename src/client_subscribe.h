@@ -49,8 +49,17 @@ client_unsubscribe(struct client *client, const char *channel);
 void
 client_unsubscribe_all(struct client *client);
 
-bool
-client_push_message(struct client *client, const struct client_message *msg);
+/**
+ * Queues the message (by reference, not by copy) for all clients
+ * subscribed to its channel, using the channel index instead of
+ * scanning the client list.  Delivery itself stays deferred: the
+ * queue only raises the "message" idle event, so a burst of
+ * broadcasts is flushed to each client in one batch.
+ *
+ * @return the number of clients the message was queued for
+ */
+unsigned
+client_broadcast_message(struct client_message *msg);
 
 G_GNUC_MALLOC
 GSList *
@@ -19,104 +19,201 @@
 
 #include "config.h"
 #include "client_internal.h"
+#include "client_io.h"
+#include "client_compress.h"
 
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
 
-static size_t
-client_write_deferred_buffer(struct client *client,
-			     const struct deferred_buffer *buffer)
+#ifndef G_OS_WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+
+/** the number of pages gathered into one writev() call */
+#define CLIENT_MAX_IOV 64
+#endif
+
+/**
+ * A pool of freed output pages, ready for reuse.  All pages have the
+ * same size (#CLIENT_SEND_BUF_SIZE), so any free page satisfies any
+ * request; without the pool, a slow client browsing the database
+ * makes one malloc()/free() pair per page.  Guarded by a mutex
+ * because pages are released from the client I/O workers, too.
+ */
+static GStaticMutex client_page_pool_mutex = G_STATIC_MUTEX_INIT;
+static struct client_buffer *client_page_pool;
+static unsigned client_page_pool_size;
+
+enum {
+	/** the maximum number of pooled pages (1 MB with 16 kB
+	    pages); beyond that, pages are returned to the
+	    allocator */
+	CLIENT_PAGE_POOL_MAX = 64,
+};
+
+/**
+ * The "next" link of the pool's free list, stored in the (unused)
+ * data area of the free page.
+ */
+#define client_page_pool_next(b) (*(struct client_buffer **)(void *)(b)->data)
+
+struct client_buffer *
+client_buffer_new(size_t alloc)
 {
-	GError *error = NULL;
-	GIOStatus status;
-	gsize bytes_written;
+	struct client_buffer *buffer;
 
-	assert(client != NULL);
-	assert(client->channel != NULL);
-	assert(buffer != NULL);
+	/* the pool relies on all pages having the same size */
+	assert(alloc == CLIENT_SEND_BUF_SIZE);
 
-	status = g_io_channel_write_chars
-		(client->channel, buffer->data, buffer->size,
-		 &bytes_written, &error);
-	switch (status) {
-	case G_IO_STATUS_NORMAL:
-		return bytes_written;
+	g_static_mutex_lock(&client_page_pool_mutex);
+	buffer = client_page_pool;
+	if (buffer != NULL) {
+		client_page_pool = client_page_pool_next(buffer);
+		--client_page_pool_size;
+	}
+	g_static_mutex_unlock(&client_page_pool_mutex);
 
-	case G_IO_STATUS_AGAIN:
-		return 0;
+	if (buffer == NULL)
+		buffer = g_malloc(sizeof(*buffer) - sizeof(buffer->data)
+				  + alloc);
 
-	case G_IO_STATUS_EOF:
-		/* client has disconnected */
+	buffer->ref = 1;
+	buffer->size = 0;
 
-		client_set_expired(client);
-		return 0;
+	return buffer;
+}
 
-	case G_IO_STATUS_ERROR:
-		/* I/O error */
+void
+client_buffer_pool_deinit(void)
+{
+	g_static_mutex_lock(&client_page_pool_mutex);
 
-		client_set_expired(client);
-		g_warning("failed to flush buffer for %i: %s",
-			  client->num, error->message);
-		g_error_free(error);
-		return 0;
+	while (client_page_pool != NULL) {
+		struct client_buffer *buffer = client_page_pool;
+		client_page_pool = client_page_pool_next(buffer);
+		g_free(buffer);
 	}
 
-	/* unreachable */
-	return 0;
+	client_page_pool_size = 0;
+
+	g_static_mutex_unlock(&client_page_pool_mutex);
+}
+
+struct client_buffer *
+client_buffer_ref(struct client_buffer *buffer)
+{
+	assert(buffer->ref > 0);
+
+	++buffer->ref;
+	return buffer;
 }
 
 void
-client_write_deferred(struct client *client)
+client_buffer_unref(struct client_buffer *buffer)
 {
-	size_t ret;
+	assert(buffer->ref > 0);
 
-	while (!g_queue_is_empty(client->deferred_send)) {
-		struct deferred_buffer *buf =
-			g_queue_peek_head(client->deferred_send);
+	if (--buffer->ref != 0)
+		return;
 
-		assert(buf->size > 0);
-		assert(buf->size <= client->deferred_bytes);
+	/* return the page to the pool instead of freeing it */
 
-		ret = client_write_deferred_buffer(client, buf);
-		if (ret == 0)
-			break;
+	g_static_mutex_lock(&client_page_pool_mutex);
+	if (client_page_pool_size < CLIENT_PAGE_POOL_MAX) {
+		client_page_pool_next(buffer) = client_page_pool;
+		client_page_pool = buffer;
+		++client_page_pool_size;
+		buffer = NULL;
+	}
+	g_static_mutex_unlock(&client_page_pool_mutex);
 
-		if (ret < buf->size) {
-			assert(client->deferred_bytes >= (size_t)ret);
-			client->deferred_bytes -= ret;
-			buf->size -= ret;
-			memmove(buf->data, buf->data + ret, buf->size);
-			break;
-		} else {
-			size_t decr = sizeof(*buf) -
-				sizeof(buf->data) + buf->size;
-
-			assert(client->deferred_bytes >= decr);
-			client->deferred_bytes -= decr;
-			g_free(buf);
-			g_queue_pop_head(client->deferred_send);
+	if (buffer != NULL)
+		g_free(buffer);
+}
+
+#ifndef G_OS_WIN32
+
+/**
+ * Append deferred output to the spill file, creating it on demand.
+ */
+static void
+client_spill_output(struct client *client, const char *data, size_t length)
+{
+	if (client->deferred_fd < 0) {
+		GError *error = NULL;
+		gchar *name;
+
+		client->deferred_fd = g_file_open_tmp("mpd.XXXXXX", &name,
+						      &error);
+		if (client->deferred_fd < 0) {
+			g_warning("[%u] failed to create spill file: %s",
+				  client->num, error->message);
+			g_error_free(error);
+			/* cause client to close */
+			client_set_expired(client);
+			return;
 		}
 
-		g_timer_start(client->last_activity);
+		unlink(name);
+		g_free(name);
+
+		client->deferred_fd_read = 0;
+		client->deferred_fd_size = 0;
+
+		g_debug("[%u] spilling output to disk", client->num);
 	}
 
-	if (g_queue_is_empty(client->deferred_send)) {
-		g_debug("[%u] buffer empty %lu", client->num,
-			(unsigned long)client->deferred_bytes);
-		assert(client->deferred_bytes == 0);
+	while (length > 0) {
+		ssize_t nbytes = pwrite(client->deferred_fd, data, length,
+					client->deferred_fd_size);
+		if (nbytes <= 0) {
+			if (nbytes < 0 && errno == EINTR)
+				continue;
+
+			g_warning("[%u] failed to write to spill file: %s",
+				  client->num, g_strerror(errno));
+			/* cause client to close */
+			client_set_expired(client);
+			return;
+		}
+
+		client->deferred_fd_size += nbytes;
+		data += nbytes;
+		length -= nbytes;
 	}
 }
 
-static void client_defer_output(struct client *client,
-				const void *data, size_t length)
+#endif /* !G_OS_WIN32 */
+
+/**
+ * Append a reference to the buffer to the deferred queue.  Takes
+ * ownership of the caller's reference.
+ */
+static void
+client_defer_buffer(struct client *client, struct client_buffer *buffer,
+		    size_t position)
 {
-	size_t alloc;
-	struct deferred_buffer *buf;
+	assert(position < buffer->size);
 
-	assert(length > 0);
+	size_t alloc = sizeof(struct deferred_buffer) +
+		buffer->size - position;
+
+#ifndef G_OS_WIN32
+	if (client->deferred_fd >= 0 ||
+	    client->deferred_bytes + alloc >
+	    client_max_output_buffer_size / 2) {
+		/* too much queued in memory - spill to disk, to keep
+		   the memory footprint constant no matter how large
+		   the response grows */
+		client_spill_output(client, buffer->data + position,
+				    buffer->size - position);
+		client_buffer_unref(buffer);
+		return;
+	}
+#endif
 
-	alloc = sizeof(*buf) - sizeof(buf->data) + length;
 	client->deferred_bytes += alloc;
 	if (client->deferred_bytes > client_max_output_buffer_size) {
 		g_warning("[%u] output buffer size (%lu) is "
@@ -126,18 +223,215 @@ static void client_defer_output(struct client *client,
 			  (unsigned long)client_max_output_buffer_size);
 		/* cause client to close */
 		client_set_expired(client);
+		client_buffer_unref(buffer);
 		return;
 	}
 
-	buf = g_malloc(alloc);
-	buf->size = length;
-	memcpy(buf->data, data, length);
+	struct deferred_buffer *node = g_slice_new(struct deferred_buffer);
+	node->buffer = buffer;
+	node->position = position;
+
+	g_queue_push_tail(client->deferred_send, node);
+}
+
+/**
+ * Remove the given number of bytes from the head of the deferred
+ * queue, popping and unreferencing all pages which have been sent
+ * completely.
+ */
+static void
+client_deferred_consume(struct client *client, size_t nbytes)
+{
+	while (nbytes > 0) {
+		struct deferred_buffer *node =
+			g_queue_peek_head(client->deferred_send);
+		size_t remaining = node->buffer->size - node->position;
+
+		if (nbytes < remaining) {
+			node->position += nbytes;
+			client->deferred_bytes -= nbytes;
+			break;
+		}
+
+		nbytes -= remaining;
+		client->deferred_bytes -= sizeof(*node) + remaining;
+		client_buffer_unref(node->buffer);
+		g_slice_free(struct deferred_buffer, node);
+		g_queue_pop_head(client->deferred_send);
+	}
 
-	g_queue_push_tail(client->deferred_send, buf);
+	g_timer_start(client->last_activity);
 }
 
-static void client_write_direct(struct client *client,
-				const char *data, size_t length)
+#ifndef G_OS_WIN32
+
+void
+client_write_deferred(struct client *client)
+{
+	assert(client != NULL);
+	assert(client->channel != NULL);
+
+	const int fd = g_io_channel_unix_get_fd(client->channel);
+
+	while (!g_queue_is_empty(client->deferred_send)) {
+		/* gather the queued pages into one writev() call,
+		   instead of copying them around */
+
+		struct iovec iov[CLIENT_MAX_IOV];
+		int n = 0;
+
+		for (GList *i = g_queue_peek_head_link(client->deferred_send);
+		     i != NULL && n < CLIENT_MAX_IOV; i = g_list_next(i)) {
+			const struct deferred_buffer *node = i->data;
+
+			assert(node->position < node->buffer->size);
+
+			iov[n].iov_base = node->buffer->data + node->position;
+			iov[n].iov_len = node->buffer->size - node->position;
+			++n;
+		}
+
+		ssize_t nbytes = writev(fd, iov, n);
+		if (nbytes < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				break;
+
+			/* I/O error */
+			client_set_expired(client);
+			g_warning("failed to flush buffer for %i: %s",
+				  client->num, g_strerror(errno));
+			return;
+		}
+
+		if (nbytes == 0) {
+			/* client has disconnected */
+			client_set_expired(client);
+			return;
+		}
+
+		client_deferred_consume(client, nbytes);
+	}
+
+	/* once the in-memory queue is empty, stream the spill file in
+	   fixed-size chunks */
+
+	while (g_queue_is_empty(client->deferred_send) &&
+	       client->deferred_fd >= 0 && !client_is_expired(client)) {
+		char chunk[CLIENT_SEND_BUF_SIZE];
+		size_t remaining = client->deferred_fd_size -
+			client->deferred_fd_read;
+		if (remaining > sizeof(chunk))
+			remaining = sizeof(chunk);
+
+		ssize_t nbytes = pread(client->deferred_fd, chunk, remaining,
+				       client->deferred_fd_read);
+		if (nbytes <= 0) {
+			if (nbytes < 0 && errno == EINTR)
+				continue;
+
+			g_warning("[%u] failed to read spill file: %s",
+				  client->num, g_strerror(errno));
+			client_set_expired(client);
+			return;
+		}
+
+		ssize_t sent = write(fd, chunk, nbytes);
+		if (sent < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				break;
+
+			/* I/O error */
+			client_set_expired(client);
+			g_warning("failed to flush buffer for %i: %s",
+				  client->num, g_strerror(errno));
+			return;
+		}
+
+		if (sent == 0) {
+			/* client has disconnected */
+			client_set_expired(client);
+			return;
+		}
+
+		client->deferred_fd_read += sent;
+		g_timer_start(client->last_activity);
+
+		if (client->deferred_fd_read == client->deferred_fd_size) {
+			close(client->deferred_fd);
+			client->deferred_fd = -1;
+		} else if ((size_t)sent < (size_t)nbytes)
+			break;
+	}
+
+	if (!client_has_deferred(client)) {
+		g_debug("[%u] buffer empty %lu", client->num,
+			(unsigned long)client->deferred_bytes);
+		assert(client->deferred_bytes == 0);
+	}
+}
+
+#else /* G_OS_WIN32 */
+
+void
+client_write_deferred(struct client *client)
+{
+	assert(client != NULL);
+	assert(client->channel != NULL);
+
+	while (!g_queue_is_empty(client->deferred_send)) {
+		const struct deferred_buffer *node =
+			g_queue_peek_head(client->deferred_send);
+
+		GError *error = NULL;
+		gsize bytes_written;
+		GIOStatus status = g_io_channel_write_chars
+			(client->channel, node->buffer->data + node->position,
+			 node->buffer->size - node->position,
+			 &bytes_written, &error);
+		switch (status) {
+		case G_IO_STATUS_NORMAL:
+			break;
+
+		case G_IO_STATUS_AGAIN:
+			return;
+
+		case G_IO_STATUS_EOF:
+			/* client has disconnected */
+
+			client_set_expired(client);
+			return;
+
+		case G_IO_STATUS_ERROR:
+			/* I/O error */
+
+			client_set_expired(client);
+			g_warning("failed to flush buffer for %i: %s",
+				  client->num, error->message);
+			g_error_free(error);
+			return;
+		}
+
+		if (bytes_written == 0)
+			return;
+
+		client_deferred_consume(client, bytes_written);
+	}
+
+	if (g_queue_is_empty(client->deferred_send)) {
+		g_debug("[%u] buffer empty %lu", client->num,
+			(unsigned long)client->deferred_bytes);
+		assert(client->deferred_bytes == 0);
+	}
+}
+
+#endif /* G_OS_WIN32 */
+
+/**
+ * Write the page to the socket.  Takes ownership of the caller's
+ * reference; the unsent remainder is queued by reference.
+ */
+static void
+client_write_direct(struct client *client, struct client_buffer *buffer)
 {
 	GError *error = NULL;
 	GIOStatus status;
@@ -145,12 +439,12 @@ static void client_write_direct(struct client *client,
 
 	assert(client != NULL);
 	assert(client->channel != NULL);
-	assert(data != NULL);
-	assert(length > 0);
-	assert(g_queue_is_empty(client->deferred_send));
+	assert(buffer->size > 0);
+	assert(!client_has_deferred(client));
 
-	status = g_io_channel_write_chars(client->channel, data, length,
-					  &bytes_written, &error);
+	status = g_io_channel_write_chars(client->channel, buffer->data,
+					  buffer->size, &bytes_written,
+					  &error);
 	switch (status) {
 	case G_IO_STATUS_NORMAL:
 	case G_IO_STATUS_AGAIN:
@@ -160,6 +454,7 @@ static void client_write_direct(struct client *client,
 		/* client has disconnected */
 
 		client_set_expired(client);
+		client_buffer_unref(buffer);
 		return;
 
 	case G_IO_STATUS_ERROR:
@@ -169,15 +464,15 @@ static void client_write_direct(struct client *client,
 		g_warning("failed to write to %i: %s",
 			  client->num, error->message);
 		g_error_free(error);
+		client_buffer_unref(buffer);
 		return;
 	}
 
-	if (bytes_written < length)
-		client_defer_output(client, data + bytes_written,
-				    length - bytes_written);
-
-	if (!g_queue_is_empty(client->deferred_send))
+	if (bytes_written < buffer->size) {
+		client_defer_buffer(client, buffer, bytes_written);
 		g_debug("[%u] buffer created", client->num);
+	} else
+		client_buffer_unref(buffer);
 }
 
 void
@@ -186,9 +481,26 @@ client_write_output(struct client *client)
 	if (client_is_expired(client) || !client->send_buf_used)
 		return;
 
-	if (!g_queue_is_empty(client->deferred_send)) {
-		client_defer_output(client, client->send_buf,
-				    client->send_buf_used);
+	struct client_buffer *buffer = client->send_buf;
+	buffer->size = client->send_buf_used;
+	client->send_buf = NULL;
+	client->send_buf_used = 0;
+
+	if (client->io_context != NULL) {
+		/* worker mode: never write to the socket from the
+		   main thread; queue the page by reference and let
+		   the worker flush it */
+
+		g_mutex_lock(client->mutex);
+		client_defer_buffer(client, buffer, 0);
+		g_mutex_unlock(client->mutex);
+
+		client_io_poke_flush(client);
+		return;
+	}
+
+	if (client_has_deferred(client)) {
+		client_defer_buffer(client, buffer, 0);
 
 		if (client_is_expired(client))
 			return;
@@ -196,51 +508,174 @@ client_write_output(struct client *client)
 		/* try to flush the deferred buffers now; the current
 		   server command may take too long to finish, and
 		   meanwhile try to feed output to the client,
-		   otherwise it will time out.  One reason why
-		   deferring is slow might be that currently each
-		   client_write() allocates a new deferred buffer.
-		   This should be optimized after MPD 0.14. */
+		   otherwise it will time out. */
 		client_write_deferred(client);
 	} else
-		client_write_direct(client, client->send_buf,
-				    client->send_buf_used);
+		client_write_direct(client, buffer);
+}
 
-	client->send_buf_used = 0;
+void
+client_write_page(struct client *client, struct client_buffer *buffer)
+{
+	if (client_is_expired(client))
+		return;
+
+	/* flush the partially filled current page first, to keep the
+	   bytes in order */
+	client_write_output(client);
+
+	client_buffer_ref(buffer);
+
+	if (client->io_context != NULL) {
+		g_mutex_lock(client->mutex);
+		client_defer_buffer(client, buffer, 0);
+		g_mutex_unlock(client->mutex);
+
+		client_io_poke_flush(client);
+		return;
+	}
+
+	if (client_has_deferred(client)) {
+		client_defer_buffer(client, buffer, 0);
+
+		if (client_is_expired(client))
+			return;
+
+		client_write_deferred(client);
+	} else
+		client_write_direct(client, buffer);
 }
 
 /**
- * Write a block of data to the client.
+ * Make sure the current output page has room for at least one more
+ * byte, flushing it when it is full.  Returns NULL if the client has
+ * been closed.
  */
-static void client_write(struct client *client, const char *buffer, size_t buflen)
+static struct client_buffer *
+client_grow_output(struct client *client)
+{
+	if (client->send_buf_used >= CLIENT_SEND_BUF_SIZE)
+		client_write_output(client);
+
+	if (client_is_expired(client))
+		return NULL;
+
+	if (client->send_buf == NULL)
+		client->send_buf = client_buffer_new(CLIENT_SEND_BUF_SIZE);
+
+	return client->send_buf;
+}
+
+void
+client_write_uncompressed(struct client *client, const char *buffer,
+			  size_t buflen)
 {
 	/* if the client is going to be closed, do nothing */
 	if (client_is_expired(client))
 		return;
 
-	while (buflen > 0 && !client_is_expired(client)) {
-		size_t copylen;
-
-		assert(client->send_buf_used < sizeof(client->send_buf));
+	while (buflen > 0) {
+		struct client_buffer *page = client_grow_output(client);
+		if (page == NULL)
+			return;
 
-		copylen = sizeof(client->send_buf) - client->send_buf_used;
+		size_t copylen = CLIENT_SEND_BUF_SIZE - client->send_buf_used;
 		if (copylen > buflen)
 			copylen = buflen;
 
-		memcpy(client->send_buf + client->send_buf_used, buffer,
-		       copylen);
+		memcpy(page->data + client->send_buf_used, buffer, copylen);
 		buflen -= copylen;
 		client->send_buf_used += copylen;
 		buffer += copylen;
-		if (client->send_buf_used >= sizeof(client->send_buf))
-			client_write_output(client);
 	}
 }
 
+/**
+ * Write a block of data to the client, through the compression layer
+ * when one is active.
+ */
+static void client_write(struct client *client, const char *buffer, size_t buflen)
+{
+#ifdef HAVE_ZLIB
+	if (client->compress != NULL) {
+		client_compress_write(client, buffer, buflen);
+		return;
+	}
+#endif
+
+	client_write_uncompressed(client, buffer, buflen);
+}
+
 void client_puts(struct client *client, const char *s)
 {
 	client_write(client, s, strlen(s));
 }
 
+void
+client_write_raw(struct client *client, const void *data, size_t length)
+{
+	client_write(client, data, length);
+}
+
+void
+client_write_uint(struct client *client, unsigned long value)
+{
+	/* enough for a 64 bit integer */
+	char buf[24];
+	char *p = buf + sizeof(buf);
+
+	/* fill the buffer from the end; no snprintf, no allocation */
+	do {
+		*--p = '0' + (char)(value % 10);
+		value /= 10;
+	} while (value != 0);
+
+	client_write(client, p, buf + sizeof(buf) - p);
+}
+
+void
+client_write_int(struct client *client, long value)
+{
+	unsigned long u = (unsigned long)value;
+
+	if (value < 0) {
+		client_write(client, "-", 1);
+		/* this also works for LONG_MIN, where "-value" would
+		   overflow */
+		u = -u;
+	}
+
+	client_write_uint(client, u);
+}
+
+void
+client_write_pair(struct client *client, const char *name, const char *value)
+{
+	client_write(client, name, strlen(name));
+	client_write(client, ": ", 2);
+	client_write(client, value, strlen(value));
+	client_write(client, "\n", 1);
+}
+
+void
+client_write_pair_int(struct client *client, const char *name, long value)
+{
+	client_write(client, name, strlen(name));
+	client_write(client, ": ", 2);
+	client_write_int(client, value);
+	client_write(client, "\n", 1);
+}
+
+void
+client_write_pair_uint(struct client *client, const char *name,
+		       unsigned long value)
+{
+	client_write(client, name, strlen(name));
+	client_write(client, ": ", 2);
+	client_write_uint(client, value);
+	client_write(client, "\n", 1);
+}
+
 void client_vprintf(struct client *client, const char *fmt, va_list args)
 {
 #ifndef G_OS_WIN32
@@ -248,14 +683,48 @@ void client_vprintf(struct client *client, const char *fmt, va_list args)
 	int length;
 	char *buffer;
 
+	if (client_is_expired(client))
+		return;
+
+	/* format directly into the current output page if the text
+	   fits, to avoid the temporary allocation and copy; not when
+	   compression is active, because the deflate stream must see
+	   every byte, in order */
+
+	struct client_buffer *page = NULL;
+	size_t room = 0;
+
+#ifdef HAVE_ZLIB
+	if (client->compress == NULL) {
+#endif
+		page = client_grow_output(client);
+		if (page == NULL)
+			return;
+
+		room = CLIENT_SEND_BUF_SIZE - client->send_buf_used;
+#ifdef HAVE_ZLIB
+	}
+#endif
+
 	va_copy(tmp, args);
-	length = vsnprintf(NULL, 0, fmt, tmp);
+	length = vsnprintf(page != NULL
+			   ? page->data + client->send_buf_used : NULL,
+			   room, fmt, tmp);
 	va_end(tmp);
 
 	if (length <= 0)
 		/* wtf.. */
 		return;
 
+	if (page != NULL && (size_t)length < room) {
+		client->send_buf_used += length;
+		return;
+	}
+
+	/* the page was too full (or the text must pass through the
+	   compression layer) - format into a temporary buffer and
+	   hand it to client_write() */
+
 	buffer = g_malloc(length + 1);
 	vsnprintf(buffer, length + 1, fmt, args);
 	client_write(client, buffer, length);
@@ -38,6 +38,7 @@
 #include "stats.h"
 #include "permission.h"
 #include "tokenizer.h"
+#include "utf8_check.h"
 #include "stored_playlist.h"
 #include "ack.h"
 #include "output_command.h"
@@ -45,6 +46,7 @@
 #include "locate.h"
 #include "dbUtils.h"
 #include "db_error.h"
+#include "db_changes.h"
 #include "db_print.h"
 #include "db_selection.h"
 #include "db_lock.h"
@@ -55,12 +57,14 @@
 #include "client_subscribe.h"
 #include "client_file.h"
 #include "tag_print.h"
+#include "status_print.h"
 #include "path.h"
 #include "replay_gain_config.h"
 #include "idle.h"
 #include "mapper.h"
 #include "song.h"
 #include "song_print.h"
+#include "perf.h"
 
 #ifdef ENABLE_SQLITE
 #include "sticker.h"
@@ -73,25 +77,6 @@
 #include <stdlib.h>
 #include <errno.h>
 
-#define COMMAND_STATUS_STATE            "state"
-#define COMMAND_STATUS_REPEAT           "repeat"
-#define COMMAND_STATUS_SINGLE           "single"
-#define COMMAND_STATUS_CONSUME          "consume"
-#define COMMAND_STATUS_RANDOM           "random"
-#define COMMAND_STATUS_PLAYLIST         "playlist"
-#define COMMAND_STATUS_PLAYLIST_LENGTH  "playlistlength"
-#define COMMAND_STATUS_SONG             "song"
-#define COMMAND_STATUS_SONGID           "songid"
-#define COMMAND_STATUS_NEXTSONG         "nextsong"
-#define COMMAND_STATUS_NEXTSONGID       "nextsongid"
-#define COMMAND_STATUS_TIME             "time"
-#define COMMAND_STATUS_BITRATE          "bitrate"
-#define COMMAND_STATUS_ERROR            "error"
-#define COMMAND_STATUS_CROSSFADE	"xfade"
-#define COMMAND_STATUS_MIXRAMPDB	"mixrampdb"
-#define COMMAND_STATUS_MIXRAMPDELAY	"mixrampdelay"
-#define COMMAND_STATUS_AUDIO		"audio"
-#define COMMAND_STATUS_UPDATING_DB	"updating_db"
 
 /*
  * The most we ever use is for search/find, and that limits it to the
@@ -201,6 +186,12 @@ print_error(struct client *client, GError *error)
 			g_error_free(error);
 			command_error(client, ACK_ERROR_NO_EXIST, "Not found");
 			return COMMAND_RETURN_ERROR;
+
+		case DB_LOADING:
+			command_error(client, ACK_ERROR_SYSTEM, "%s",
+				      error->message);
+			g_error_free(error);
+			return COMMAND_RETURN_ERROR;
 		}
 	} else if (error->domain == g_file_error_quark()) {
 		command_error(client, ACK_ERROR_SYSTEM, "%s",
@@ -215,7 +206,7 @@ print_error(struct client *client, GError *error)
 }
 
 static void
-print_spl_list(struct client *client, GPtrArray *list)
+print_spl_list(struct client *client, const GPtrArray *list)
 {
 	for (unsigned i = 0; i < list->len; ++i) {
 		struct stored_playlist_info *playlist =
@@ -329,96 +320,7 @@ static enum command_return
 handle_status(struct client *client,
 	      G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[])
 {
-	const char *state = NULL;
-	struct player_status player_status;
-	int updateJobId;
-	char *error;
-	int song;
-
-	pc_get_status(client->player_control, &player_status);
-
-	switch (player_status.state) {
-	case PLAYER_STATE_STOP:
-		state = "stop";
-		break;
-	case PLAYER_STATE_PAUSE:
-		state = "pause";
-		break;
-	case PLAYER_STATE_PLAY:
-		state = "play";
-		break;
-	}
-
-	client_printf(client,
-		      "volume: %i\n"
-		      COMMAND_STATUS_REPEAT ": %i\n"
-		      COMMAND_STATUS_RANDOM ": %i\n"
-		      COMMAND_STATUS_SINGLE ": %i\n"
-		      COMMAND_STATUS_CONSUME ": %i\n"
-		      COMMAND_STATUS_PLAYLIST ": %li\n"
-		      COMMAND_STATUS_PLAYLIST_LENGTH ": %i\n"
-		      COMMAND_STATUS_CROSSFADE ": %i\n"
-		      COMMAND_STATUS_MIXRAMPDB ": %f\n"
-		      COMMAND_STATUS_MIXRAMPDELAY ": %f\n"
-		      COMMAND_STATUS_STATE ": %s\n",
-		      volume_level_get(),
-		      playlist_get_repeat(&g_playlist),
-		      playlist_get_random(&g_playlist),
-		      playlist_get_single(&g_playlist),
-		      playlist_get_consume(&g_playlist),
-		      playlist_get_version(&g_playlist),
-		      playlist_get_length(&g_playlist),
-		      (int)(pc_get_cross_fade(client->player_control) + 0.5),
-		      pc_get_mixramp_db(client->player_control),
-		      pc_get_mixramp_delay(client->player_control),
-		      state);
-
-	song = playlist_get_current_song(&g_playlist);
-	if (song >= 0) {
-		client_printf(client,
-			      COMMAND_STATUS_SONG ": %i\n"
-			      COMMAND_STATUS_SONGID ": %u\n",
-			      song, playlist_get_song_id(&g_playlist, song));
-	}
-
-	if (player_status.state != PLAYER_STATE_STOP) {
-		struct audio_format_string af_string;
-
-		client_printf(client,
-			      COMMAND_STATUS_TIME ": %i:%i\n"
-			      "elapsed: %1.3f\n"
-			      COMMAND_STATUS_BITRATE ": %u\n"
-			      COMMAND_STATUS_AUDIO ": %s\n",
-			      (int)(player_status.elapsed_time + 0.5),
-			      (int)(player_status.total_time + 0.5),
-			      player_status.elapsed_time,
-			      player_status.bit_rate,
-			      audio_format_to_string(&player_status.audio_format,
-						     &af_string));
-	}
-
-	if ((updateJobId = isUpdatingDB())) {
-		client_printf(client,
-			      COMMAND_STATUS_UPDATING_DB ": %i\n",
-			      updateJobId);
-	}
-
-	error = pc_get_error_message(client->player_control);
-	if (error != NULL) {
-		client_printf(client,
-			      COMMAND_STATUS_ERROR ": %s\n",
-			      error);
-		g_free(error);
-	}
-
-	song = playlist_get_next_song(&g_playlist);
-	if (song >= 0) {
-		client_printf(client,
-			      COMMAND_STATUS_NEXTSONG ": %i\n"
-			      COMMAND_STATUS_NEXTSONGID ": %u\n",
-			      song, playlist_get_song_id(&g_playlist, song));
-	}
-
+	status_print(client);
 	return COMMAND_RETURN_OK;
 }
 
@@ -527,6 +429,49 @@ handle_addid(struct client *client, int argc, char *argv[])
 	return COMMAND_RETURN_OK;
 }
 
+static enum command_return
+handle_addtagid(struct client *client, G_GNUC_UNUSED int argc, char *argv[])
+{
+	unsigned song_id;
+	if (!check_unsigned(client, &song_id, argv[1]))
+		return COMMAND_RETURN_ERROR;
+
+	enum tag_type tag_type = tag_name_parse_i(argv[2]);
+	if (tag_type == TAG_NUM_OF_ITEM_TYPES) {
+		command_error(client, ACK_ERROR_ARG,
+			      "Unknown tag type: %s", argv[2]);
+		return COMMAND_RETURN_ERROR;
+	}
+
+	enum playlist_result result =
+		playlist_add_song_tag_id(&g_playlist, client->player_control,
+					 song_id, tag_type, argv[3]);
+	return print_playlist_result(client, result);
+}
+
+static enum command_return
+handle_cleartagid(struct client *client, int argc, char *argv[])
+{
+	unsigned song_id;
+	if (!check_unsigned(client, &song_id, argv[1]))
+		return COMMAND_RETURN_ERROR;
+
+	enum tag_type tag_type = TAG_NUM_OF_ITEM_TYPES;
+	if (argc >= 3) {
+		tag_type = tag_name_parse_i(argv[2]);
+		if (tag_type == TAG_NUM_OF_ITEM_TYPES) {
+			command_error(client, ACK_ERROR_ARG,
+				      "Unknown tag type: %s", argv[2]);
+			return COMMAND_RETURN_ERROR;
+		}
+	}
+
+	enum playlist_result result =
+		playlist_clear_song_tag_id(&g_playlist, client->player_control,
+					   song_id, tag_type);
+	return print_playlist_result(client, result);
+}
+
 static enum command_return
 handle_delete(struct client *client, G_GNUC_UNUSED int argc, char *argv[])
 {
@@ -630,26 +575,33 @@ handle_load(struct client *client, int argc, char *argv[])
 }
 
 static enum command_return
-handle_listplaylist(struct client *client, G_GNUC_UNUSED int argc, char *argv[])
+handle_listplaylist(struct client *client, int argc, char *argv[])
 {
-	if (playlist_file_print(client, argv[1], false))
+	unsigned start = 0, end = G_MAXUINT;
+	if (argc == 3 && !check_range(client, &start, &end, argv[2]))
+		return COMMAND_RETURN_ERROR;
+
+	if (playlist_file_print(client, argv[1], false, start, end))
 		return COMMAND_RETURN_OK;
 
 	GError *error = NULL;
-	return spl_print(client, argv[1], false, &error)
+	return spl_print(client, argv[1], false, start, end, &error)
 		? COMMAND_RETURN_OK
 		: print_error(client, error);
 }
 
 static enum command_return
-handle_listplaylistinfo(struct client *client,
-			G_GNUC_UNUSED int argc, char *argv[])
+handle_listplaylistinfo(struct client *client, int argc, char *argv[])
 {
-	if (playlist_file_print(client, argv[1], true))
+	unsigned start = 0, end = G_MAXUINT;
+	if (argc == 3 && !check_range(client, &start, &end, argv[2]))
+		return COMMAND_RETURN_ERROR;
+
+	if (playlist_file_print(client, argv[1], true, start, end))
 		return COMMAND_RETURN_OK;
 
 	GError *error = NULL;
-	return spl_print(client, argv[1], true, &error)
+	return spl_print(client, argv[1], true, start, end, &error)
 		? COMMAND_RETURN_OK
 		: print_error(client, error);
 }
@@ -659,7 +611,7 @@ handle_lsinfo(struct client *client, int argc, char *argv[])
 {
 	const char *uri;
 
-	if (argc == 2)
+	if (argc >= 2)
 		uri = argv[1];
 	else
 		/* default is root directory */
@@ -688,16 +640,26 @@ handle_lsinfo(struct client *client, int argc, char *argv[])
 	struct db_selection selection;
 	db_selection_init(&selection, uri, false);
 
+	if (argc == 3) {
+		/* optional window: the database walk skips entries
+		   before the start and stops at the end, so paging
+		   clients don't make us print the whole listing over
+		   and over */
+		unsigned start, end;
+		if (!check_range(client, &start, &end, argv[2]))
+			return COMMAND_RETURN_ERROR;
+
+		db_selection_window(&selection, start, end);
+	}
+
 	GError *error = NULL;
 	if (!db_selection_print(client, &selection, true, &error))
 		return print_error(client, error);
 
-	if (isRootDirectory(uri)) {
-		GPtrArray *list = spl_list(NULL);
-		if (list != NULL) {
+	if (argc < 3 && isRootDirectory(uri)) {
+		const GPtrArray *list = spl_list_cached(NULL);
+		if (list != NULL)
 			print_spl_list(client, list);
-			spl_list_free(list);
-		}
 	}
 
 	return COMMAND_RETURN_OK;
@@ -781,9 +743,53 @@ handle_playlistid(struct client *client, int argc, char *argv[])
 	return COMMAND_RETURN_OK;
 }
 
+/**
+ * Strips the optional trailing "sort KEY" and "limit N" modifiers
+ * from a find/search argument list and fills the #song_sort
+ * accordingly.  The modifier names cannot collide with the TYPE/WHAT
+ * pairs, because neither is a valid tag name.
+ *
+ * @return false on error (a message has been sent to the client)
+ */
+static bool
+search_parse_modifiers(struct client *client, int *argc_r, char *argv[],
+		       struct song_sort *sort)
+{
+	int argc = *argc_r;
+
+	song_sort_init(sort);
+
+	/* at least the command name and one TYPE/WHAT pair must
+	   remain */
+	while (argc >= 5) {
+		if (strcmp(argv[argc - 2], "sort") == 0) {
+			if (!song_sort_parse_key(sort, argv[argc - 1])) {
+				command_error(client, ACK_ERROR_ARG,
+					      "unknown sort key \"%s\"",
+					      argv[argc - 1]);
+				return false;
+			}
+		} else if (strcmp(argv[argc - 2], "limit") == 0) {
+			if (!check_unsigned(client, &sort->limit,
+					    argv[argc - 1]))
+				return false;
+		} else
+			break;
+
+		argc -= 2;
+	}
+
+	*argc_r = argc;
+	return true;
+}
+
 static enum command_return
 handle_find(struct client *client, int argc, char *argv[])
 {
+	struct song_sort sort;
+	if (!search_parse_modifiers(client, &argc, argv, &sort))
+		return COMMAND_RETURN_ERROR;
+
 	struct locate_item_list *list =
 		locate_item_list_parse(argv + 1, argc - 1);
 
@@ -796,7 +802,7 @@ handle_find(struct client *client, int argc, char *argv[])
 	}
 
 	GError *error = NULL;
-	enum command_return ret = findSongsIn(client, "", list, &error)
+	enum command_return ret = findSongsIn(client, "", list, &sort, &error)
 		? COMMAND_RETURN_OK
 		: print_error(client, error);
 
@@ -832,6 +838,10 @@ handle_findadd(struct client *client, int argc, char *argv[])
 static enum command_return
 handle_search(struct client *client, int argc, char *argv[])
 {
+	struct song_sort sort;
+	if (!search_parse_modifiers(client, &argc, argv, &sort))
+		return COMMAND_RETURN_ERROR;
+
 	struct locate_item_list *list =
 		locate_item_list_parse(argv + 1, argc - 1);
 
@@ -844,7 +854,8 @@ handle_search(struct client *client, int argc, char *argv[])
 	}
 
 	GError *error = NULL;
-	enum command_return ret = searchForSongsIn(client, "", list, &error)
+	enum command_return ret = searchForSongsIn(client, "", list, &sort,
+						   &error)
 		? COMMAND_RETURN_OK
 		: print_error(client, error);
 
@@ -959,6 +970,13 @@ handle_update(struct client *client, G_GNUC_UNUSED int argc, char *argv[])
 	unsigned ret;
 
 	assert(argc <= 2);
+
+	if (!db_is_simple()) {
+		command_error(client, ACK_ERROR_NO_EXIST,
+			      "Cannot update a remote database; "
+			      "run the update on the master instance");
+		return COMMAND_RETURN_ERROR;
+	}
 	if (argc == 2) {
 		path = argv[1];
 
@@ -990,6 +1008,14 @@ handle_rescan(struct client *client, G_GNUC_UNUSED int argc, char *argv[])
 	unsigned ret;
 
 	assert(argc <= 2);
+
+	if (!db_is_simple()) {
+		command_error(client, ACK_ERROR_NO_EXIST,
+			      "Cannot update a remote database; "
+			      "run the update on the master instance");
+		return COMMAND_RETURN_ERROR;
+	}
+
 	if (argc == 2) {
 		path = argv[1];
 
@@ -1011,6 +1037,32 @@ handle_rescan(struct client *client, G_GNUC_UNUSED int argc, char *argv[])
 	}
 }
 
+static enum command_return
+handle_dbchanges(struct client *client, int argc, char *argv[])
+{
+	unsigned cursor;
+
+	if (argc == 1) {
+		/* without a cursor, just report the current one, so
+		   the client can start following the journal */
+		client_printf(client, "cursor: %u\n",
+			      db_changes_get_cursor());
+		return COMMAND_RETURN_OK;
+	}
+
+	if (!check_unsigned(client, &cursor, argv[1]))
+		return COMMAND_RETURN_ERROR;
+
+	if (!db_changes_print(client, cursor)) {
+		command_error(client, ACK_ERROR_NO_EXIST,
+			      "Cursor out of range - "
+			      "re-read the whole database");
+		return COMMAND_RETURN_ERROR;
+	}
+
+	return COMMAND_RETURN_OK;
+}
+
 static enum command_return
 handle_next(G_GNUC_UNUSED struct client *client,
 	    G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[])
@@ -1473,6 +1525,28 @@ handle_devices(struct client *client,
 	return COMMAND_RETURN_OK;
 }
 
+static enum command_return
+handle_outputstats(struct client *client,
+		   G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[])
+{
+	printAudioOutputStats(client);
+
+	return COMMAND_RETURN_OK;
+}
+
+#ifdef ENABLE_PERF_COUNTERS
+
+static enum command_return
+handle_perfstats(struct client *client,
+		 G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[])
+{
+	perf_print(client);
+
+	return COMMAND_RETURN_OK;
+}
+
+#endif
+
 /* don't be fooled, this is the command handler for "commands" command */
 static enum command_return
 handle_commands(struct client *client,
@@ -1541,12 +1615,11 @@ handle_listplaylists(struct client *client,
 		     G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[])
 {
 	GError *error = NULL;
-	GPtrArray *list = spl_list(&error);
+	const GPtrArray *list = spl_list_cached(&error);
 	if (list == NULL)
 		return print_error(client, error);
 
 	print_spl_list(client, list);
-	spl_list_free(list);
 	return COMMAND_RETURN_OK;
 }
 
@@ -1603,6 +1676,54 @@ handle_idle(struct client *client,
 	return 1;
 }
 
+static enum command_return
+handle_binaryoutput(struct client *client,
+		    G_GNUC_UNUSED int argc, char *argv[])
+{
+	bool enable;
+
+	if (!check_bool(client, &enable, argv[1]))
+		return COMMAND_RETURN_ERROR;
+
+	client->binary_output = enable;
+	return COMMAND_RETURN_OK;
+}
+
+#ifdef HAVE_ZLIB
+static enum command_return
+handle_compression(struct client *client,
+		   G_GNUC_UNUSED int argc, char *argv[])
+{
+	/* the scheme change is applied at the end of this response,
+	   so the "OK" line still uses the old scheme; see
+	   client_compress_response_end() */
+	if (strcmp(argv[1], "none") == 0)
+		client->compress_pending = CLIENT_COMPRESS_PENDING_DISABLE;
+	else if (strcmp(argv[1], "deflate") == 0)
+		client->compress_pending = CLIENT_COMPRESS_PENDING_ENABLE;
+	else {
+		command_error(client, ACK_ERROR_ARG,
+			      "Unknown compression scheme: %s", argv[1]);
+		return COMMAND_RETURN_ERROR;
+	}
+
+	return COMMAND_RETURN_OK;
+}
+#endif
+
+static enum command_return
+handle_idlepayload(struct client *client,
+		   G_GNUC_UNUSED int argc, char *argv[])
+{
+	bool payload;
+
+	if (!check_bool(client, &payload, argv[1]))
+		return COMMAND_RETURN_ERROR;
+
+	client->idle_payload = payload;
+	return COMMAND_RETURN_OK;
+}
+
 #ifdef ENABLE_SQLITE
 struct sticker_song_find_data {
 	struct client *client;
@@ -1619,6 +1740,94 @@ sticker_song_find_print_cb(struct song *song, const char *value,
 	sticker_print_value(data->client, data->name, value);
 }
 
+struct sticker_song_listall_data {
+	struct client *client;
+
+	/** the song of the previous callback invocation, to print
+	    each song's URI only once */
+	const struct song *last_song;
+};
+
+static void
+sticker_song_listall_print_cb(struct song *song, const char *name,
+			      const char *value, gpointer user_data)
+{
+	struct sticker_song_listall_data *data = user_data;
+
+	if (song != data->last_song) {
+		song_print_uri(data->client, song);
+		data->last_song = song;
+	}
+
+	sticker_print_value(data->client, name, value);
+}
+
+struct sticker_queue_data {
+	struct client *client;
+
+	/** the URIs of all songs in the queue */
+	GHashTable *uris;
+
+	/** the URI of the previous callback invocation, to print
+	    each song's URI only once */
+	char *last_uri;
+};
+
+static void
+sticker_queue_print_cb(const char *uri, const char *name, const char *value,
+		       gpointer user_data)
+{
+	struct sticker_queue_data *data = user_data;
+
+	if (g_hash_table_lookup(data->uris, uri) == NULL)
+		/* this song is not in the queue */
+		return;
+
+	if (data->last_uri == NULL || strcmp(data->last_uri, uri) != 0) {
+		g_free(data->last_uri);
+		data->last_uri = g_strdup(uri);
+		client_printf(data->client, "file: %s\n", uri);
+	}
+
+	sticker_print_value(data->client, name, value);
+}
+
+/**
+ * Handle the "sticker listall queue" command: print the stickers of
+ * all songs in the queue with a single database query.
+ */
+static enum command_return
+handle_sticker_queue(struct client *client)
+{
+	const struct queue *queue = playlist_get_queue(&g_playlist);
+	struct sticker_queue_data data = {
+		.client = client,
+		.uris = g_hash_table_new_full(g_str_hash, g_str_equal,
+					      g_free, NULL),
+		.last_uri = NULL,
+	};
+	bool success;
+
+	for (unsigned i = 0; i < queue_length(queue); ++i)
+		g_hash_table_insert(data.uris,
+				    song_get_uri(queue_get(queue, i)),
+				    GINT_TO_POINTER(1));
+
+	success = sticker_list_find("song", NULL,
+				    sticker_queue_print_cb, &data);
+
+	g_free(data.last_uri);
+	g_hash_table_destroy(data.uris);
+
+	if (!success) {
+		command_error(client, ACK_ERROR_SYSTEM,
+			      "failed to search sticker database");
+		return COMMAND_RETURN_ERROR;
+	}
+
+	return COMMAND_RETURN_OK;
+}
+
 static enum command_return
 handle_sticker_song(struct client *client, int argc, char *argv[])
 {
@@ -1717,10 +1926,10 @@ handle_sticker_song(struct client *client, int argc, char *argv[])
 			.name = argv[4],
 		};
 
-		db_lock();
+		db_read_lock();
 		directory = db_get_directory(argv[3]);
 		if (directory == NULL) {
-			db_unlock();
+			db_read_unlock();
 			command_error(client, ACK_ERROR_NO_EXIST,
 				      "no such directory");
 			return COMMAND_RETURN_ERROR;
@@ -1728,13 +1937,43 @@ handle_sticker_song(struct client *client, int argc, char *argv[])
 
 		success = sticker_song_find(directory, data.name,
 					    sticker_song_find_print_cb, &data);
-		db_unlock();
+		db_read_unlock();
 		if (!success) {
 			command_error(client, ACK_ERROR_SYSTEM,
 				      "failed to set search sticker database");
 			return COMMAND_RETURN_ERROR;
 		}
 
+		return COMMAND_RETURN_OK;
+	/* listall song dir */
+	} else if (argc == 4 && strcmp(argv[1], "listall") == 0) {
+		/* "sticker listall song a/directory" */
+		struct directory *directory;
+		bool success;
+		struct sticker_song_listall_data data = {
+			.client = client,
+			.last_song = NULL,
+		};
+
+		db_read_lock();
+		directory = db_get_directory(argv[3]);
+		if (directory == NULL) {
+			db_read_unlock();
+			command_error(client, ACK_ERROR_NO_EXIST,
+				      "no such directory");
+			return COMMAND_RETURN_ERROR;
+		}
+
+		success = sticker_song_list_find(directory,
+						 sticker_song_listall_print_cb,
+						 &data);
+		db_read_unlock();
+		if (!success) {
+			command_error(client, ACK_ERROR_SYSTEM,
+				      "failed to search sticker database");
+			return COMMAND_RETURN_ERROR;
+		}
+
 		return COMMAND_RETURN_OK;
 	} else {
 		command_error(client, ACK_ERROR_ARG, "bad request");
@@ -1745,7 +1984,7 @@ handle_sticker_song(struct client *client, int argc, char *argv[])
 static enum command_return
 handle_sticker(struct client *client, int argc, char *argv[])
 {
-	assert(argc >= 4);
+	assert(argc >= 3);
 
 	if (!sticker_enabled()) {
 		command_error(client, ACK_ERROR_UNKNOWN,
@@ -1753,7 +1992,11 @@ handle_sticker(struct client *client, int argc, char *argv[])
 		return COMMAND_RETURN_ERROR;
 	}
 
-	if (strcmp(argv[2], "song") == 0)
+	if (argc == 3 && strcmp(argv[1], "listall") == 0 &&
+	    strcmp(argv[2], "queue") == 0)
+		return handle_sticker_queue(client);
+
+	if (argc >= 4 && strcmp(argv[2], "song") == 0)
 		return handle_sticker_song(client, argc, argv);
 	else {
 		command_error(client, ACK_ERROR_ARG,
@@ -1874,7 +2117,7 @@ handle_read_messages(struct client *client,
 
 		client_printf(client, "channel: %s\nmessage: %s\n",
 			      msg->channel, msg->message);
-		client_message_free(msg);
+		client_message_unref(msg);
 	}
 
 	g_slist_free(messages);
@@ -1882,22 +2125,6 @@ handle_read_messages(struct client *client,
 	return COMMAND_RETURN_OK;
 }
 
-struct send_message_context {
-	struct client_message msg;
-
-	bool sent;
-};
-
-static void
-send_message(gpointer data, gpointer user_data)
-{
-	struct send_message_context *context = user_data;
-	struct client *client = data;
-
-	if (client_push_message(client, &context->msg))
-		context->sent = true;
-}
-
 static enum command_return
 handle_send_message(struct client *client,
 		    G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[])
@@ -1910,17 +2137,11 @@ handle_send_message(struct client *client,
 		return COMMAND_RETURN_ERROR;
 	}
 
-	struct send_message_context context = {
-		.sent = false,
-	};
-
-	client_message_init(&context.msg, argv[1], argv[2]);
-
-	client_list_foreach(send_message, &context);
+	struct client_message *msg = client_message_new(argv[1], argv[2]);
+	unsigned sent = client_broadcast_message(msg);
+	client_message_unref(msg);
 
-	client_message_deinit(&context.msg);
-
-	if (context.sent)
+	if (sent > 0)
 		return COMMAND_RETURN_OK;
 	else {
 		command_error(client, ACK_ERROR_NO_EXIST,
@@ -1937,16 +2158,23 @@ handle_send_message(struct client *client,
 static const struct command commands[] = {
 	{ "add", PERMISSION_ADD, 1, 1, handle_add },
 	{ "addid", PERMISSION_ADD, 1, 2, handle_addid },
+	{ "addtagid", PERMISSION_ADD, 3, 3, handle_addtagid },
+	{ "binaryoutput", PERMISSION_NONE, 1, 1, handle_binaryoutput },
 	{ "channels", PERMISSION_READ, 0, 0, handle_channels },
 	{ "clear", PERMISSION_CONTROL, 0, 0, handle_clear },
 	{ "clearerror", PERMISSION_CONTROL, 0, 0, handle_clearerror },
+	{ "cleartagid", PERMISSION_ADD, 1, 2, handle_cleartagid },
 	{ "close", PERMISSION_NONE, -1, -1, handle_close },
 	{ "commands", PERMISSION_NONE, 0, 0, handle_commands },
+#ifdef HAVE_ZLIB
+	{ "compression", PERMISSION_NONE, 1, 1, handle_compression },
+#endif
 	{ "config", PERMISSION_ADMIN, 0, 0, handle_config },
 	{ "consume", PERMISSION_CONTROL, 1, 1, handle_consume },
 	{ "count", PERMISSION_READ, 2, -1, handle_count },
 	{ "crossfade", PERMISSION_CONTROL, 1, 1, handle_crossfade },
 	{ "currentsong", PERMISSION_READ, 0, 0, handle_currentsong },
+	{ "dbchanges", PERMISSION_READ, 0, 1, handle_dbchanges },
 	{ "decoders", PERMISSION_READ, 0, 0, handle_decoders },
 	{ "delete", PERMISSION_CONTROL, 1, 1, handle_delete },
 	{ "deleteid", PERMISSION_CONTROL, 1, 1, handle_deleteid },
@@ -1955,15 +2183,16 @@ static const struct command commands[] = {
 	{ "find", PERMISSION_READ, 2, -1, handle_find },
 	{ "findadd", PERMISSION_READ, 2, -1, handle_findadd},
 	{ "idle", PERMISSION_READ, 0, -1, handle_idle },
+	{ "idlepayload", PERMISSION_READ, 1, 1, handle_idlepayload },
 	{ "kill", PERMISSION_ADMIN, -1, -1, handle_kill },
 	{ "list", PERMISSION_READ, 1, -1, handle_list },
 	{ "listall", PERMISSION_READ, 0, 1, handle_listall },
 	{ "listallinfo", PERMISSION_READ, 0, 1, handle_listallinfo },
-	{ "listplaylist", PERMISSION_READ, 1, 1, handle_listplaylist },
-	{ "listplaylistinfo", PERMISSION_READ, 1, 1, handle_listplaylistinfo },
+	{ "listplaylist", PERMISSION_READ, 1, 2, handle_listplaylist },
+	{ "listplaylistinfo", PERMISSION_READ, 1, 2, handle_listplaylistinfo },
 	{ "listplaylists", PERMISSION_READ, 0, 0, handle_listplaylists },
 	{ "load", PERMISSION_ADD, 1, 2, handle_load },
-	{ "lsinfo", PERMISSION_READ, 0, 1, handle_lsinfo },
+	{ "lsinfo", PERMISSION_READ, 0, 2, handle_lsinfo },
 	{ "mixrampdb", PERMISSION_CONTROL, 1, 1, handle_mixrampdb },
 	{ "mixrampdelay", PERMISSION_CONTROL, 1, 1, handle_mixrampdelay },
 	{ "move", PERMISSION_CONTROL, 2, 2, handle_move },
@@ -1971,7 +2200,11 @@ static const struct command commands[] = {
 	{ "next", PERMISSION_CONTROL, 0, 0, handle_next },
 	{ "notcommands", PERMISSION_NONE, 0, 0, handle_not_commands },
 	{ "outputs", PERMISSION_READ, 0, 0, handle_devices },
+	{ "outputstats", PERMISSION_READ, 0, 0, handle_outputstats },
 	{ "password", PERMISSION_NONE, 1, 1, handle_password },
+#ifdef ENABLE_PERF_COUNTERS
+	{ "perfstats", PERMISSION_READ, 0, 0, handle_perfstats },
+#endif
 	{ "pause", PERMISSION_CONTROL, 0, 1, handle_pause },
 	{ "ping", PERMISSION_NONE, 0, 0, handle_ping },
 	{ "play", PERMISSION_CONTROL, 0, 1, handle_play },
@@ -2012,7 +2245,7 @@ static const struct command commands[] = {
 	{ "stats", PERMISSION_READ, 0, 0, handle_stats },
 	{ "status", PERMISSION_READ, 0, 0, handle_status },
 #ifdef ENABLE_SQLITE
-	{ "sticker", PERMISSION_ADMIN, 3, -1, handle_sticker },
+	{ "sticker", PERMISSION_ADMIN, 2, -1, handle_sticker },
 #endif
 	{ "stop", PERMISSION_CONTROL, 0, 0, handle_stop },
 	{ "subscribe", PERMISSION_READ, 1, 1, handle_subscribe },
@@ -2073,13 +2306,45 @@ handle_not_commands(struct client *client,
 	return COMMAND_RETURN_OK;
 }
 
+/**
+ * For each possible initial character, the range of #commands
+ * starting with it.  Looking this up first narrows the binary search
+ * to a handful of candidates; initialized by command_init().
+ */
+static struct {
+	unsigned char begin, end;
+} command_first_char[256];
+
+void
+command_allowed_mask(unsigned permission, uint64_t mask[COMMAND_MASK_WORDS])
+{
+	for (unsigned w = 0; w < COMMAND_MASK_WORDS; ++w)
+		mask[w] = 0;
+
+	for (unsigned i = 0; i < num_commands; ++i)
+		if (commands[i].permission ==
+		    (permission & commands[i].permission))
+			mask[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
 void command_init(void)
 {
+	assert(num_commands < 256);
+	assert(num_commands <= COMMAND_MASK_WORDS * 64);
+
 #ifndef NDEBUG
 	/* ensure that the command list is sorted */
 	for (unsigned i = 0; i < num_commands - 1; ++i)
 		assert(strcmp(commands[i].cmd, commands[i + 1].cmd) < 0);
 #endif
+
+	for (unsigned i = 0; i < num_commands; ++i) {
+		const unsigned char c = (unsigned char)commands[i].cmd[0];
+
+		if (command_first_char[c].end == 0)
+			command_first_char[c].begin = i;
+		command_first_char[c].end = i + 1;
+	}
 }
 
 void command_finish(void)
@@ -2089,21 +2354,23 @@ void command_finish(void)
 static const struct command *
 command_lookup(const char *name)
 {
-	unsigned a = 0, b = num_commands, i;
+	const unsigned char c = (unsigned char)name[0];
+	unsigned a = command_first_char[c].begin;
+	unsigned b = command_first_char[c].end;
 	int cmp;
 
-	/* binary search */
-	do {
-		i = (a + b) / 2;
+	/* binary search within the first-character range */
+	while (a < b) {
+		unsigned i = (a + b) / 2;
 
 		cmp = strcmp(name, commands[i].cmd);
 		if (cmp == 0)
 			return &commands[i];
 		else if (cmp < 0)
 			b = i;
-		else if (cmp > 0)
+		else
 			a = i + 1;
-	} while (a < b);
+	}
 
 	return NULL;
 }
@@ -2115,7 +2382,16 @@ command_check_request(const struct command *cmd, struct client *client,
 	int min = cmd->min + 1;
 	int max = cmd->max + 1;
 
-	if (cmd->permission != (permission & cmd->permission)) {
+	/* test the client's precomputed allowed-command bitmask (see
+	   client_set_permission()) instead of evaluating the
+	   permission set here */
+	const unsigned i = cmd - commands;
+	const bool allowed = client != NULL
+		? (client->allowed_commands[i / 64] &
+		   ((uint64_t)1 << (i % 64))) != 0
+		: cmd->permission == (permission & cmd->permission);
+
+	if (!allowed) {
 		if (client != NULL)
 			command_error(client, ACK_ERROR_PERMISSION,
 				      "you don't have permission for \"%s\"",
@@ -2204,38 +2480,61 @@ command_process(struct client *client, unsigned num, char *line)
 
 	argc = 1;
 
-	/* now parse the arguments (quoted or unquoted) */
+	/* fast path for commands without arguments (status,
+	   currentsong, ...), which make up most of the protocol
+	   traffic: nothing left to tokenize */
 
-	while (argc < (int)G_N_ELEMENTS(argv) &&
-	       (argv[argc] =
-		tokenizer_next_param(&line, &error)) != NULL)
-		++argc;
+	if (*line != 0) {
+		/* now parse the arguments (quoted or unquoted) */
 
-	/* some error checks; we have to set current_command because
-	   command_error() expects it to be set */
+		while (argc < (int)G_N_ELEMENTS(argv) &&
+		       (argv[argc] =
+			tokenizer_next_param(&line, &error)) != NULL)
+			++argc;
 
-	current_command = argv[0];
+		/* some error checks; we have to set current_command
+		   because command_error() expects it to be set */
 
-	if (argc >= (int)G_N_ELEMENTS(argv)) {
-		command_error(client, ACK_ERROR_ARG, "Too many arguments");
-		current_command = NULL;
-		return COMMAND_RETURN_ERROR;
-	}
+		current_command = argv[0];
 
-	if (*line != 0) {
-		command_error(client, ACK_ERROR_ARG,
-			      "%s", error->message);
-		current_command = NULL;
-		g_error_free(error);
-		return COMMAND_RETURN_ERROR;
-	}
+		if (argc >= (int)G_N_ELEMENTS(argv)) {
+			command_error(client, ACK_ERROR_ARG,
+				      "Too many arguments");
+			current_command = NULL;
+			return COMMAND_RETURN_ERROR;
+		}
+
+		if (*line != 0) {
+			command_error(client, ACK_ERROR_ARG,
+				      "%s", error->message);
+			current_command = NULL;
+			g_error_free(error);
+			return COMMAND_RETURN_ERROR;
+		}
+
+		/* all protocol strings are defined to be UTF-8;
+		   reject malformed arguments here, before they can
+		   reach the database or a playlist file */
+		for (int i = 1; i < argc; ++i) {
+			if (!utf8_check_string(argv[i])) {
+				command_error(client, ACK_ERROR_ARG,
+					      "Malformed UTF-8");
+				current_command = NULL;
+				return COMMAND_RETURN_ERROR;
+			}
+		}
+	} else
+		current_command = argv[0];
 
 	/* look up and invoke the command handler */
 
 	cmd = command_checked_lookup(client, client_get_permission(client),
 				     argc, argv);
-	if (cmd)
+	if (cmd) {
+		const uint64_t start = perf_begin();
 		ret = cmd->handler(client, argc, argv);
+		perf_end(PERF_COMMAND, start);
+	}
 
 	current_command = NULL;
 	command_list_num = 0;
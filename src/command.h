@@ -24,6 +24,7 @@
 
 #include <glib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 enum command_return {
 	COMMAND_RETURN_ERROR = -1,
@@ -34,6 +35,22 @@ enum command_return {
 
 struct client;
 
+/**
+ * The number of 64 bit words in an allowed-command bitmask; enough
+ * for 256 commands (command_init() asserts that the table is
+ * smaller).
+ */
+#define COMMAND_MASK_WORDS 4
+
+/**
+ * Resolves the given permission set into a bitmask with one bit per
+ * command, in command table order.  Called whenever a client's
+ * permissions change, so the dispatch loop only needs a single bit
+ * test per command.
+ */
+void
+command_allowed_mask(unsigned permission, uint64_t mask[COMMAND_MASK_WORDS]);
+
 void command_init(void);
 
 void command_finish(void);
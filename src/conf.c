@@ -41,10 +41,28 @@
 
 #define CONF_COMMENT		'#'
 
+/**
+ * The expected syntax of a parameter's value.  Typed parameters are
+ * validated while the file is being parsed, so a malformed value is
+ * rejected with its line number before any thread is started, instead
+ * of aborting later when the option happens to be queried.
+ */
+enum config_entry_type {
+	/** free-form text; not validated here */
+	CONFIG_TYPE_STRING = 0,
+
+	/** a non-negative integer */
+	CONFIG_TYPE_UNSIGNED,
+
+	/** a boolean, see get_bool() */
+	CONFIG_TYPE_BOOL,
+};
+
 struct config_entry {
 	const char *const name;
 	const bool repeatable;
 	const bool block;
+	const enum config_entry_type type;
 
 	GSList *params;
 };
@@ -52,21 +70,32 @@ struct config_entry {
 static struct config_entry config_entries[] = {
 	{ .name = CONF_MUSIC_DIR, false, false },
 	{ .name = CONF_PLAYLIST_DIR, false, false },
-	{ .name = CONF_FOLLOW_INSIDE_SYMLINKS, false, false },
-	{ .name = CONF_FOLLOW_OUTSIDE_SYMLINKS, false, false },
+	{ .name = CONF_FOLLOW_INSIDE_SYMLINKS, false, false,
+	  CONFIG_TYPE_BOOL },
+	{ .name = CONF_FOLLOW_OUTSIDE_SYMLINKS, false, false,
+	  CONFIG_TYPE_BOOL },
 	{ .name = CONF_DB_FILE, false, false },
+	{ .name = CONF_DATABASE, false, true },
+	{ .name = CONF_DB_CHANGES_MAX, false, false, CONFIG_TYPE_UNSIGNED },
+	{ .name = CONF_DB_LOAD_ASYNC, false, false, CONFIG_TYPE_BOOL },
+	{ .name = CONF_DB_INDEX, false, false, CONFIG_TYPE_BOOL },
 	{ .name = CONF_STICKER_FILE, false, false },
+	{ .name = CONF_STICKER_WAL, false, false, CONFIG_TYPE_BOOL },
+	{ .name = CONF_STICKER_CACHE_SIZE, false, false,
+	  CONFIG_TYPE_UNSIGNED },
 	{ .name = CONF_LOG_FILE, false, false },
 	{ .name = CONF_PID_FILE, false, false },
 	{ .name = CONF_STATE_FILE, false, false },
-	{ .name = "restore_paused", false, false },
+	{ .name = "restore_paused", false, false, CONFIG_TYPE_BOOL },
 	{ .name = CONF_USER, false, false },
 	{ .name = CONF_GROUP, false, false },
 	{ .name = CONF_BIND_TO_ADDRESS, true, false },
-	{ .name = CONF_PORT, false, false },
+	{ .name = CONF_PORT, false, false, CONFIG_TYPE_UNSIGNED },
+	{ .name = CONF_LISTEN_BACKLOG, false, false, CONFIG_TYPE_UNSIGNED },
 	{ .name = CONF_LOG_LEVEL, false, false },
+	{ .name = CONF_LOG_BUFFER_SIZE, false, false, CONFIG_TYPE_UNSIGNED },
 	{ .name = CONF_ZEROCONF_NAME, false, false },
-	{ .name = CONF_ZEROCONF_ENABLED, false, false },
+	{ .name = CONF_ZEROCONF_ENABLED, false, false, CONFIG_TYPE_BOOL },
 	{ .name = CONF_PASSWORD, true, false },
 	{ .name = CONF_DEFAULT_PERMS, false, false },
 	{ .name = CONF_AUDIO_OUTPUT, true, true },
@@ -75,36 +104,66 @@ static struct config_entry config_entries[] = {
 	{ .name = CONF_REPLAYGAIN, false, false },
 	{ .name = CONF_REPLAYGAIN_PREAMP, false, false },
 	{ .name = CONF_REPLAYGAIN_MISSING_PREAMP, false, false },
-	{ .name = CONF_REPLAYGAIN_LIMIT, false, false },
-	{ .name = CONF_VOLUME_NORMALIZATION, false, false },
+	{ .name = CONF_REPLAYGAIN_LIMIT, false, false, CONFIG_TYPE_BOOL },
+	{ .name = CONF_VOLUME_NORMALIZATION, false, false, CONFIG_TYPE_BOOL },
 	{ .name = CONF_SAMPLERATE_CONVERTER, false, false },
+	{ .name = CONF_DOWNMIX_COEFFICIENTS, false, false },
 	{ .name = CONF_AUDIO_BUFFER_SIZE, false, false },
+	{ .name = CONF_PCM_BUFFER_HIGH_WATER, false, false,
+	  CONFIG_TYPE_UNSIGNED },
+	{ .name = CONF_AUDIO_CHUNK_SIZE, false, false },
 	{ .name = CONF_BUFFER_BEFORE_PLAY, false, false },
+	{ .name = CONF_REWIND_BUFFER_SIZE, false, false,
+	  CONFIG_TYPE_UNSIGNED },
 	{ .name = CONF_HTTP_PROXY_HOST, false, false },
-	{ .name = CONF_HTTP_PROXY_PORT, false, false },
+	{ .name = CONF_HTTP_PROXY_PORT, false, false, CONFIG_TYPE_UNSIGNED },
 	{ .name = CONF_HTTP_PROXY_USER, false, false },
 	{ .name = CONF_HTTP_PROXY_PASSWORD, false, false },
-	{ .name = CONF_CONN_TIMEOUT, false, false },
-	{ .name = CONF_MAX_CONN, false, false },
-	{ .name = CONF_MAX_PLAYLIST_LENGTH, false, false },
-	{ .name = CONF_MAX_COMMAND_LIST_SIZE, false, false },
-	{ .name = CONF_MAX_OUTPUT_BUFFER_SIZE, false, false },
+	{ .name = CONF_CONN_TIMEOUT, false, false, CONFIG_TYPE_UNSIGNED },
+	{ .name = CONF_IDLE_FLUSH_DELAY, false, false, CONFIG_TYPE_UNSIGNED },
+	{ .name = CONF_CLIENT_IO_THREADS, false, false,
+	  CONFIG_TYPE_UNSIGNED },
+	{ .name = CONF_MAX_CONN, false, false, CONFIG_TYPE_UNSIGNED },
+	{ .name = CONF_MAX_PLAYLIST_LENGTH, false, false,
+	  CONFIG_TYPE_UNSIGNED },
+	{ .name = CONF_MAX_COMMAND_LIST_SIZE, false, false,
+	  CONFIG_TYPE_UNSIGNED },
+	{ .name = CONF_MAX_OUTPUT_BUFFER_SIZE, false, false,
+	  CONFIG_TYPE_UNSIGNED },
 	{ .name = CONF_FS_CHARSET, false, false },
 	{ .name = CONF_ID3V1_ENCODING, false, false },
 	{ .name = CONF_METADATA_TO_USE, false, false },
-	{ .name = CONF_SAVE_ABSOLUTE_PATHS, false, false },
+	{ .name = CONF_SAVE_ABSOLUTE_PATHS, false, false, CONFIG_TYPE_BOOL },
 	{ .name = CONF_DECODER, true, true },
 	{ .name = CONF_INPUT, true, true },
-	{ .name = CONF_GAPLESS_MP3_PLAYBACK, false, false },
+	{ .name = CONF_GAPLESS_MP3_PLAYBACK, false, false,
+	  CONFIG_TYPE_BOOL },
+	{ .name = CONF_SILENCE_TRIM, false, false, CONFIG_TYPE_BOOL },
+	{ .name = CONF_SILENCE_TRIM_THRESHOLD, false, false,
+	  CONFIG_TYPE_UNSIGNED },
 	{ .name = CONF_PLAYLIST_PLUGIN, true, true },
-	{ .name = CONF_AUTO_UPDATE, false, false },
-	{ .name = CONF_AUTO_UPDATE_DEPTH, false, false },
+	{ .name = CONF_AUTO_UPDATE, false, false, CONFIG_TYPE_BOOL },
+	{ .name = CONF_AUTO_UPDATE_DEPTH, false, false,
+	  CONFIG_TYPE_UNSIGNED },
+	{ .name = CONF_UPDATE_THREADS, false, false, CONFIG_TYPE_UNSIGNED },
+	{ .name = CONF_UPDATE_PRUNE_UNCHANGED, false, false,
+	  CONFIG_TYPE_BOOL },
+	{ .name = CONF_SEARCH_THREADS, false, false, CONFIG_TYPE_UNSIGNED },
 	{ .name = CONF_DESPOTIFY_USER, false, false },
 	{ .name = CONF_DESPOTIFY_PASSWORD, false, false},
-	{ .name = CONF_DESPOTIFY_HIGH_BITRATE, false, false },
+	{ .name = CONF_DESPOTIFY_HIGH_BITRATE, false, false,
+	  CONFIG_TYPE_BOOL },
 	{ .name = "filter", true, true },
 };
 
+/**
+ * Maps a parameter name to its #config_entry, so lookups are one hash
+ * probe instead of a strcmp() against every known name.  Built once in
+ * config_global_init(); both keys and values point into
+ * config_entries.
+ */
+static GHashTable *config_entry_map;
+
 static bool
 get_bool(const char *value, bool *value_r)
 {
@@ -170,13 +229,9 @@ config_param_free_callback(gpointer data, G_GNUC_UNUSED gpointer user_data)
 static struct config_entry *
 config_entry_get(const char *name)
 {
-	for (unsigned i = 0; i < G_N_ELEMENTS(config_entries); ++i) {
-		struct config_entry *entry = &config_entries[i];
-		if (strcmp(entry->name, name) == 0)
-			return entry;
-	}
+	assert(config_entry_map != NULL);
 
-	return NULL;
+	return g_hash_table_lookup(config_entry_map, name);
 }
 
 void config_global_finish(void)
@@ -188,10 +243,64 @@ void config_global_finish(void)
 				config_param_free_callback, NULL);
 		g_slist_free(entry->params);
 	}
+
+	g_hash_table_destroy(config_entry_map);
+	config_entry_map = NULL;
 }
 
 void config_global_init(void)
 {
+	config_entry_map = g_hash_table_new(g_str_hash, g_str_equal);
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(config_entries); ++i) {
+		struct config_entry *entry = &config_entries[i];
+
+		g_hash_table_insert(config_entry_map,
+				    (gpointer)entry->name, entry);
+	}
+}
+
+/**
+ * Checks the value of a typed parameter.  Called while the file is
+ * being parsed, so errors point at the offending line and are raised
+ * before any thread is started.
+ */
+static bool
+config_check_value(const struct config_entry *entry, const char *value,
+		   GError **error_r)
+{
+	char *endptr;
+	long number;
+	bool b;
+
+	switch (entry->type) {
+	case CONFIG_TYPE_STRING:
+		break;
+
+	case CONFIG_TYPE_UNSIGNED:
+		number = strtol(value, &endptr, 0);
+		if (endptr == value || *endptr != 0 || number < 0) {
+			g_set_error(error_r, config_quark(), 0,
+				    "\"%s\" is not a valid non-negative "
+				    "number", value);
+			return false;
+		}
+
+		break;
+
+	case CONFIG_TYPE_BOOL:
+		if (!get_bool(value, &b)) {
+			g_set_error(error_r, config_quark(), 0,
+				    "\"%s\" is not a boolean value "
+				    "(yes, true, 1) or (no, false, 0)",
+				    value);
+			return false;
+		}
+
+		break;
+	}
+
+	return true;
 }
 
 static void
@@ -453,6 +562,14 @@ config_read_file(const char *file, GError **error_r)
 				return false;
 			}
 
+			if (!config_check_value(entry, value, &error)) {
+				g_propagate_prefixed_error(error_r, error,
+							   "line %i: \"%s\": ",
+							   count, name);
+				fclose(fp);
+				return false;
+			}
+
 			param = config_new_param(value, count);
 		}
 
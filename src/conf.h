@@ -28,7 +28,13 @@
 #define CONF_FOLLOW_INSIDE_SYMLINKS     "follow_inside_symlinks"
 #define CONF_FOLLOW_OUTSIDE_SYMLINKS    "follow_outside_symlinks"
 #define CONF_DB_FILE                    "db_file"
+#define CONF_DATABASE                   "database"
+#define CONF_DB_CHANGES_MAX             "db_changes_max"
+#define CONF_DB_LOAD_ASYNC              "db_load_async"
+#define CONF_DB_INDEX                   "db_index"
 #define CONF_STICKER_FILE               "sticker_file"
+#define CONF_STICKER_WAL                "sticker_wal"
+#define CONF_STICKER_CACHE_SIZE         "sticker_cache_size"
 #define CONF_LOG_FILE                   "log_file"
 #define CONF_PID_FILE                   "pid_file"
 #define CONF_STATE_FILE                 "state_file"
@@ -36,7 +42,9 @@
 #define CONF_GROUP                      "group"
 #define CONF_BIND_TO_ADDRESS            "bind_to_address"
 #define CONF_PORT                       "port"
+#define CONF_LISTEN_BACKLOG             "listen_backlog"
 #define CONF_LOG_LEVEL                  "log_level"
+#define CONF_LOG_BUFFER_SIZE            "log_buffer_size"
 #define CONF_ZEROCONF_NAME              "zeroconf_name"
 #define CONF_ZEROCONF_ENABLED           "zeroconf_enabled"
 #define CONF_PASSWORD                   "password"
@@ -51,13 +59,19 @@
 #define CONF_REPLAYGAIN_LIMIT           "replaygain_limit"
 #define CONF_VOLUME_NORMALIZATION       "volume_normalization"
 #define CONF_SAMPLERATE_CONVERTER       "samplerate_converter"
+#define CONF_DOWNMIX_COEFFICIENTS       "downmix_coefficients"
 #define CONF_AUDIO_BUFFER_SIZE          "audio_buffer_size"
+#define CONF_PCM_BUFFER_HIGH_WATER      "pcm_buffer_high_water"
+#define CONF_AUDIO_CHUNK_SIZE           "audio_chunk_size"
 #define CONF_BUFFER_BEFORE_PLAY         "buffer_before_play"
+#define CONF_REWIND_BUFFER_SIZE         "rewind_buffer_size"
 #define CONF_HTTP_PROXY_HOST            "http_proxy_host"
 #define CONF_HTTP_PROXY_PORT            "http_proxy_port"
 #define CONF_HTTP_PROXY_USER            "http_proxy_user"
 #define CONF_HTTP_PROXY_PASSWORD        "http_proxy_password"
 #define CONF_CONN_TIMEOUT               "connection_timeout"
+#define CONF_IDLE_FLUSH_DELAY           "idle_flush_delay"
+#define CONF_CLIENT_IO_THREADS          "client_io_threads"
 #define CONF_MAX_CONN                   "max_connections"
 #define CONF_MAX_PLAYLIST_LENGTH        "max_playlist_length"
 #define CONF_MAX_COMMAND_LIST_SIZE      "max_command_list_size"
@@ -69,9 +83,14 @@
 #define CONF_DECODER                    "decoder"
 #define CONF_INPUT                      "input"
 #define CONF_GAPLESS_MP3_PLAYBACK       "gapless_mp3_playback"
+#define CONF_SILENCE_TRIM               "silence_trim"
+#define CONF_SILENCE_TRIM_THRESHOLD     "silence_trim_threshold"
 #define CONF_PLAYLIST_PLUGIN            "playlist_plugin"
 #define CONF_AUTO_UPDATE                "auto_update"
 #define CONF_AUTO_UPDATE_DEPTH          "auto_update_depth"
+#define CONF_UPDATE_THREADS             "update_threads"
+#define CONF_UPDATE_PRUNE_UNCHANGED     "update_prune_unchanged"
+#define CONF_SEARCH_THREADS             "search_threads"
 #define CONF_DESPOTIFY_USER             "despotify_user"
 #define CONF_DESPOTIFY_PASSWORD         "despotify_password"
 #define CONF_DESPOTIFY_HIGH_BITRATE     "despotify_high_bitrate"
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "cue/cue_cache.h"
+#include "song.h"
+
+#include <string.h>
+
+struct cue_cache_entry {
+	char *uri;
+
+	/** the file's modification time when it was parsed */
+	time_t mtime;
+
+	/** the value of #cue_cache_counter at the last access; the
+	    entry with the lowest value is evicted */
+	unsigned last_used;
+
+	GPtrArray *songs;
+};
+
+/**
+ * Maximum number of parsed CUE sheets kept in memory.
+ */
+#define CUE_CACHE_MAX 8
+
+static GPtrArray *cue_cache;
+static unsigned cue_cache_counter;
+
+static void
+cue_cache_entry_free(struct cue_cache_entry *entry)
+{
+	for (unsigned i = 0; i < entry->songs->len; ++i)
+		song_free(g_ptr_array_index(entry->songs, i));
+
+	g_ptr_array_free(entry->songs, true);
+	g_free(entry->uri);
+	g_free(entry);
+}
+
+const GPtrArray *
+cue_cache_get(const char *uri, time_t mtime)
+{
+	if (cue_cache == NULL)
+		return NULL;
+
+	for (unsigned i = 0; i < cue_cache->len; ++i) {
+		struct cue_cache_entry *entry =
+			g_ptr_array_index(cue_cache, i);
+		if (strcmp(entry->uri, uri) != 0)
+			continue;
+
+		if (entry->mtime != mtime) {
+			/* the file has changed on disk */
+			cue_cache_entry_free(entry);
+			g_ptr_array_remove_index_fast(cue_cache, i);
+			return NULL;
+		}
+
+		entry->last_used = ++cue_cache_counter;
+		return entry->songs;
+	}
+
+	return NULL;
+}
+
+void
+cue_cache_put(const char *uri, time_t mtime, GPtrArray *songs)
+{
+	if (cue_cache == NULL)
+		cue_cache = g_ptr_array_new();
+
+	if (cue_cache->len >= CUE_CACHE_MAX) {
+		/* evict the least recently used entry */
+		unsigned victim = 0;
+
+		for (unsigned i = 1; i < cue_cache->len; ++i) {
+			const struct cue_cache_entry *entry =
+				g_ptr_array_index(cue_cache, i);
+			const struct cue_cache_entry *v =
+				g_ptr_array_index(cue_cache, victim);
+			if (entry->last_used < v->last_used)
+				victim = i;
+		}
+
+		cue_cache_entry_free(g_ptr_array_remove_index_fast(cue_cache,
+								   victim));
+	}
+
+	struct cue_cache_entry *entry = g_new(struct cue_cache_entry, 1);
+	entry->uri = g_strdup(uri);
+	entry->mtime = mtime;
+	entry->last_used = ++cue_cache_counter;
+	entry->songs = songs;
+	g_ptr_array_add(cue_cache, entry);
+}
+
+void
+cue_cache_deinit(void)
+{
+	if (cue_cache == NULL)
+		return;
+
+	for (unsigned i = 0; i < cue_cache->len; ++i)
+		cue_cache_entry_free(g_ptr_array_index(cue_cache, i));
+
+	g_ptr_array_free(cue_cache, true);
+	cue_cache = NULL;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A cache of parsed CUE sheets, keyed by file name and modification
+ * time.  It is shared by the "cue" and "embcue" playlist plugins, so
+ * a sheet which is opened repeatedly (a 99 track rip is opened once
+ * per virtual track) is parsed only once.
+ */
+
+#ifndef MPD_CUE_CACHE_H
+#define MPD_CUE_CACHE_H
+
+#include "check.h"
+
+#include <glib.h>
+#include <time.h>
+
+/**
+ * Looks up a parsed CUE sheet.  Returns a list of #song objects owned
+ * by the cache (the caller must duplicate them with
+ * song_dup_detached()), or NULL if the sheet is not cached or the
+ * modification time does not match.
+ */
+const GPtrArray *
+cue_cache_get(const char *uri, time_t mtime);
+
+/**
+ * Stores a fully parsed CUE sheet.  Ownership of the list and the
+ * songs in it is transferred to the cache.
+ */
+void
+cue_cache_put(const char *uri, time_t mtime, GPtrArray *songs);
+
+void
+cue_cache_deinit(void);
+
+#endif
@@ -25,8 +25,11 @@
 #include "db_visitor.h"
 #include "db_plugin.h"
 #include "db/simple_db_plugin.h"
+#include "db/proxy_db_plugin.h"
 #include "directory.h"
 #include "stats.h"
+#include "db_arena.h"
+#include "event_pipe.h"
 #include "conf.h"
 #include "glib_compat.h"
 
@@ -43,49 +46,116 @@
 #define G_LOG_DOMAIN "database"
 
 static struct db *db;
-static bool db_is_open;
+
+/**
+ * Has the database been opened successfully?  Written with atomic
+ * operations, because the asynchronous load (see db_load_async())
+ * publishes the database from a worker thread.
+ */
+static volatile gint db_is_open;
+
+/** the thread running the asynchronous load, or NULL */
+static GThread *db_load_thread;
+
+/** the error which occurred in #db_load_thread */
+static GError *db_load_error;
+
+/** see db_get_version() */
+static unsigned db_version = 1;
+
+static const struct db_plugin *const db_plugins[] = {
+	&simple_db_plugin,
+	&proxy_db_plugin,
+	NULL
+};
+
+static const struct db_plugin *
+db_plugin_by_name(const char *name)
+{
+	for (unsigned i = 0; db_plugins[i] != NULL; ++i)
+		if (strcmp(db_plugins[i]->name, name) == 0)
+			return db_plugins[i];
+
+	return NULL;
+}
 
 bool
-db_init(const struct config_param *path, GError **error_r)
+db_init(const struct config_param *param, GError **error_r)
 {
 	assert(db == NULL);
-	assert(!db_is_open);
+	assert(!g_atomic_int_get(&db_is_open));
 
-	if (path == NULL)
+	if (param == NULL)
 		return true;
 
-	struct config_param *param = config_new_param("database", path->line);
-	config_add_block_param(param, "path", path->value, path->line);
-
-	db = db_plugin_new(&simple_db_plugin, param, error_r);
+	const char *plugin_name =
+		config_get_block_string(param, "plugin", "simple");
+	const struct db_plugin *plugin = db_plugin_by_name(plugin_name);
+	if (plugin == NULL) {
+		g_set_error(error_r, db_quark(), DB_DISABLED,
+			    "No such database plugin: %s", plugin_name);
+		return false;
+	}
 
-	config_param_free(param);
+	db = db_plugin_new(plugin, param, error_r);
 
 	return db != NULL;
 }
 
+bool
+db_is_simple(void)
+{
+	/* a database-less setup behaves like the simple plugin
+	   everywhere that matters (local update, inotify, ...) */
+	return db == NULL || db->plugin == &simple_db_plugin;
+}
+
 void
 db_finish(void)
 {
-	if (db_is_open)
+	if (db_load_thread != NULL) {
+		g_thread_join(db_load_thread);
+		db_load_thread = NULL;
+	}
+
+	if (db_load_error != NULL) {
+		g_error_free(db_load_error);
+		db_load_error = NULL;
+	}
+
+	if (g_atomic_int_get(&db_is_open))
 		db_plugin_close(db);
 
 	if (db != NULL)
 		db_plugin_free(db);
+
+	/* all database-owned songs and tags are gone now; release
+	   the arena they were allocated from */
+	db_arena_free();
 }
 
 struct directory *
 db_get_root(void)
 {
 	assert(db != NULL);
+	assert(db_is_simple());
 
 	return simple_db_get_root(db);
 }
 
+bool
+db_ready(void)
+{
+	return db != NULL && g_atomic_int_get(&db_is_open);
+}
+
 struct directory *
 db_get_directory(const char *name)
 {
-	if (db == NULL)
+	if (!db_ready() || !db_is_simple())
+		/* only the simple plugin has an in-memory tree to
+		   hand out; the callers fall back to the generic
+		   visitor API */
 		return NULL;
 
 	struct directory *music_root = db_get_root();
@@ -104,12 +174,24 @@ db_get_song(const char *file)
 
 	g_debug("get song: %s", file);
 
-	if (db == NULL)
+	if (!db_ready())
 		return NULL;
 
 	return db_plugin_get_song(db, file, NULL);
 }
 
+void
+db_get_songs(const char *const uris[], unsigned n, struct song **songs_r)
+{
+	if (!db_ready()) {
+		for (unsigned i = 0; i < n; ++i)
+			songs_r[i] = NULL;
+		return;
+	}
+
+	db_plugin_get_songs(db, uris, n, songs_r);
+}
+
 bool
 db_visit(const struct db_selection *selection,
 	 const struct db_visitor *visitor, void *ctx,
@@ -121,6 +203,12 @@ db_visit(const struct db_selection *selection,
 		return false;
 	}
 
+	if (!g_atomic_int_get(&db_is_open)) {
+		g_set_error_literal(error_r, db_quark(), DB_LOADING,
+				    "Database is loading");
+		return false;
+	}
+
 	return db_plugin_visit(db, selection, visitor, ctx, error_r);
 }
 
@@ -139,32 +227,98 @@ bool
 db_save(GError **error_r)
 {
 	assert(db != NULL);
-	assert(db_is_open);
+	assert(db_is_simple());
+	assert(g_atomic_int_get(&db_is_open));
 
 	return simple_db_save(db, error_r);
 }
 
-bool
-db_load(GError **error)
+static bool
+db_load2(GError **error_r)
 {
 	assert(db != NULL);
-	assert(!db_is_open);
+	assert(!g_atomic_int_get(&db_is_open));
 
-	if (!db_plugin_open(db, error))
+	if (!db_plugin_open(db, error_r))
 		return false;
 
-	db_is_open = true;
+	db_increment_version();
+
+	/* publish only after the tree is complete */
+	g_atomic_int_set(&db_is_open, true);
+
+	return true;
+}
+
+bool
+db_load(GError **error)
+{
+	if (!db_load2(error))
+		return false;
 
 	stats_update();
+	return true;
+}
+
+static gpointer
+db_load_task(G_GNUC_UNUSED gpointer data)
+{
+	db_load2(&db_load_error);
+
+	event_pipe_emit(PIPE_EVENT_DATABASE);
+	return NULL;
+}
+
+void
+db_load_async(void)
+{
+	assert(db != NULL);
+	assert(db_load_thread == NULL);
+
+	db_load_thread = g_thread_create(db_load_task, NULL, true, NULL);
+	if (db_load_thread == NULL)
+		/* out of resources; fall back to loading right
+		   here */
+		db_load_task(NULL);
+}
+
+bool
+db_load_async_finish(GError **error_r)
+{
+	if (db_load_thread != NULL) {
+		g_thread_join(db_load_thread);
+		db_load_thread = NULL;
+	}
+
+	if (db_load_error != NULL) {
+		g_propagate_error(error_r, db_load_error);
+		db_load_error = NULL;
+		return false;
+	}
 
+	stats_update();
 	return true;
 }
 
+unsigned
+db_get_version(void)
+{
+	return db_version;
+}
+
+void
+db_increment_version(void)
+{
+	++db_version;
+}
+
 time_t
 db_get_mtime(void)
 {
 	assert(db != NULL);
-	assert(db_is_open);
+	assert(g_atomic_int_get(&db_is_open));
 
-	return simple_db_get_mtime(db);
+	return db_is_simple()
+		? simple_db_get_mtime(db)
+		: proxy_db_get_mtime(db);
 }
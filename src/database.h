@@ -35,14 +35,24 @@ struct db_visitor;
 /**
  * Initialize the database library.
  *
- * @param path the absolute path of the database file
+ * @param param the "database" configuration block, or NULL to disable
+ * the database
  */
 bool
-db_init(const struct config_param *path, GError **error_r);
+db_init(const struct config_param *param, GError **error_r);
 
 void
 db_finish(void);
 
+/**
+ * Is the "simple" database plugin (or no database at all) configured?
+ * Local features which need the in-memory directory tree - update,
+ * rescan, inotify, database save - are only available then.
+ */
+G_GNUC_PURE
+bool
+db_is_simple(void);
+
 /**
  * Returns the root directory object.  Returns NULL if there is no
  * configured music directory.
@@ -64,6 +74,14 @@ G_GNUC_PURE
 struct song *
 db_get_song(const char *file);
 
+/**
+ * Looks up multiple songs with a single database lock.  NULL entries
+ * in #uris are skipped; one song pointer (or NULL if the song was not
+ * found) is stored per URI.
+ */
+void
+db_get_songs(const char *const uris[], unsigned n, struct song **songs_r);
+
 gcc_nonnull(1,2)
 bool
 db_visit(const struct db_selection *selection,
@@ -82,10 +100,50 @@ db_save(GError **error_r);
 bool
 db_load(GError **error);
 
+/**
+ * Starts loading the database in a worker thread, so the daemon can
+ * accept connections right away.  When the load has finished (or
+ * failed), #PIPE_EVENT_DATABASE is emitted; the handler must call
+ * db_load_async_finish().
+ */
+void
+db_load_async(void);
+
+/**
+ * Joins the thread started by db_load_async() and returns the result
+ * of the load.
+ */
+bool
+db_load_async_finish(GError **error_r);
+
+/**
+ * Is the database available, i.e. configured and completely loaded?
+ * While an asynchronous load is in progress, this returns false.
+ */
+bool
+db_ready(void);
+
 G_GNUC_PURE
 time_t
 db_get_mtime(void);
 
+/**
+ * Returns the database version, a counter which is incremented every
+ * time the database contents change (initial load, finished update).
+ * Caches derived from the database compare it to find out whether
+ * they are stale.  Only valid in the main thread.
+ */
+G_GNUC_PURE
+unsigned
+db_get_version(void);
+
+/**
+ * Increments the database version; call this in the main thread
+ * after modifying the database.
+ */
+void
+db_increment_version(void);
+
 /**
  * Returns true if there is a valid database file on the disk.
  */
@@ -0,0 +1,828 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "proxy_db_plugin.h"
+#include "db_plugin.h"
+#include "db_internal.h"
+#include "db_error.h"
+#include "db_selection.h"
+#include "db_visitor.h"
+#include "conf.h"
+#include "directory.h"
+#include "song.h"
+#include "song_print.h"
+#include "tag.h"
+#include "playlist_vector.h"
+#include "fd_util.h"
+
+#include <glib.h>
+
+#ifdef G_OS_WIN32
+#include <ws2tcpip.h>
+#include <winsock.h>
+#else
+#include <sys/socket.h>
+#include <netdb.h>
+#endif
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "proxy_db"
+
+/**
+ * A cached response from the master: the raw lines between the
+ * command and its "OK".
+ */
+struct proxy_db_response {
+	/**
+	 * When was this response received?  It expires after
+	 * #cache_ttl seconds.
+	 */
+	time_t stamp;
+
+	/** the response lines (allocated strings) */
+	GPtrArray *lines;
+};
+
+struct proxy_db {
+	struct db base;
+
+	char *host;
+	unsigned port;
+
+	/** the master's password, or NULL */
+	char *password;
+
+	/**
+	 * How long may a cached directory listing or search result be
+	 * served without asking the master again (seconds)?
+	 */
+	unsigned cache_ttl;
+
+	/** maximum number of cached responses */
+	unsigned cache_max;
+
+	/** the connection to the master, or -1 if it is closed */
+	int fd;
+
+	/** unconsumed input from the master */
+	GString *input;
+
+	/**
+	 * Response lines by command string.  Entries are dropped when
+	 * they expire or when the cache overflows; they are plain
+	 * text and nobody keeps pointers into them.
+	 */
+	GHashTable *response_cache;
+
+	/**
+	 * Songs served to the daemon core, by URI.  The core treats
+	 * database songs as immortal (the queue stores bare
+	 * pointers), so these are only released in close(); the cache
+	 * thus holds exactly the songs this satellite has actually
+	 * served, not the master's whole database.
+	 */
+	GHashTable *song_cache;
+
+	/**
+	 * The parent directory of all cached songs.  Giving the songs
+	 * a (root) parent makes them regular database songs: they
+	 * print without decoration and are mapped into the local
+	 * music directory for playback.
+	 */
+	struct directory *root;
+
+	/** the time the database was opened; see proxy_db_get_mtime() */
+	time_t mtime;
+};
+
+G_GNUC_CONST
+static inline GQuark
+proxy_db_quark(void)
+{
+	return g_quark_from_static_string("proxy_db");
+}
+
+static void
+proxy_db_response_free(gpointer data)
+{
+	struct proxy_db_response *response = data;
+
+	for (unsigned i = 0; i < response->lines->len; ++i)
+		g_free(g_ptr_array_index(response->lines, i));
+	g_ptr_array_free(response->lines, true);
+	g_free(response);
+}
+
+/**
+ * Quotes an argument for use in a protocol command.
+ */
+static char *
+proxy_db_quote(const char *value)
+{
+	char *quoted = g_malloc(strlen(value) * 2 + 3);
+	char *p = quoted;
+
+	*p++ = '"';
+	while (*value != 0) {
+		if (*value == '"' || *value == '\\')
+			*p++ = '\\';
+		*p++ = *value++;
+	}
+	*p++ = '"';
+	*p = 0;
+
+	return quoted;
+}
+
+static void
+proxy_db_disconnect(struct proxy_db *db)
+{
+	if (db->fd < 0)
+		return;
+
+	close_socket(db->fd);
+	db->fd = -1;
+	g_string_truncate(db->input, 0);
+}
+
+/**
+ * Reads one line from the master, blocking if necessary.  Returns an
+ * allocated string without the newline, or NULL on error (the
+ * connection is closed then).
+ */
+static char *
+proxy_db_read_line(struct proxy_db *db, GError **error_r)
+{
+	assert(db->fd >= 0);
+
+	while (true) {
+		const char *newline = memchr(db->input->str, '\n',
+					     db->input->len);
+		if (newline != NULL) {
+			size_t length = newline - db->input->str;
+			char *line = g_strndup(db->input->str, length);
+			g_string_erase(db->input, 0, length + 1);
+			return line;
+		}
+
+		char buffer[4096];
+		ssize_t nbytes = recv(db->fd, buffer, sizeof(buffer), 0);
+		if (nbytes <= 0) {
+			if (nbytes == 0)
+				g_set_error(error_r, proxy_db_quark(), 0,
+					    "Connection to \"%s:%u\" closed",
+					    db->host, db->port);
+			else
+				g_set_error(error_r, proxy_db_quark(), errno,
+					    "Failed to receive from \"%s:%u\": %s",
+					    db->host, db->port,
+					    g_strerror(errno));
+			proxy_db_disconnect(db);
+			return NULL;
+		}
+
+		g_string_append_len(db->input, buffer, nbytes);
+	}
+}
+
+static bool
+proxy_db_send(struct proxy_db *db, const char *command, GError **error_r)
+{
+	assert(db->fd >= 0);
+
+	char *line = g_strconcat(command, "\n", NULL);
+	const char *p = line;
+	size_t remaining = strlen(line);
+
+	while (remaining > 0) {
+		ssize_t nbytes = send(db->fd, p, remaining, 0);
+		if (nbytes < 0) {
+			g_set_error(error_r, proxy_db_quark(), errno,
+				    "Failed to send to \"%s:%u\": %s",
+				    db->host, db->port, g_strerror(errno));
+			proxy_db_disconnect(db);
+			g_free(line);
+			return false;
+		}
+
+		p += nbytes;
+		remaining -= nbytes;
+	}
+
+	g_free(line);
+	return true;
+}
+
+/**
+ * Sends a command and expects a response consisting of just "OK".
+ */
+static bool
+proxy_db_run(struct proxy_db *db, const char *command, GError **error_r)
+{
+	if (!proxy_db_send(db, command, error_r))
+		return false;
+
+	char *line = proxy_db_read_line(db, error_r);
+	if (line == NULL)
+		return false;
+
+	if (strcmp(line, "OK") != 0) {
+		g_set_error(error_r, proxy_db_quark(), 0,
+			    "\"%s:%u\": %s", db->host, db->port, line);
+		g_free(line);
+		return false;
+	}
+
+	g_free(line);
+	return true;
+}
+
+static bool
+proxy_db_connect(struct proxy_db *db, GError **error_r)
+{
+	assert(db->fd < 0);
+
+	char service[16];
+	g_snprintf(service, sizeof(service), "%u", db->port);
+
+	const struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+	};
+
+	struct addrinfo *ai;
+	int ret = getaddrinfo(db->host, service, &hints, &ai);
+	if (ret != 0) {
+		g_set_error(error_r, proxy_db_quark(), 0,
+			    "Failed to resolve \"%s\": %s",
+			    db->host, gai_strerror(ret));
+		return false;
+	}
+
+	int fd = -1;
+	for (const struct addrinfo *i = ai; i != NULL; i = i->ai_next) {
+		fd = socket(i->ai_family, i->ai_socktype, i->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		if (connect(fd, i->ai_addr, i->ai_addrlen) == 0)
+			break;
+
+		close_socket(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(ai);
+
+	if (fd < 0) {
+		g_set_error(error_r, proxy_db_quark(), errno,
+			    "Failed to connect to \"%s:%u\": %s",
+			    db->host, db->port, g_strerror(errno));
+		return false;
+	}
+
+	db->fd = fd;
+	g_string_truncate(db->input, 0);
+
+	char *line = proxy_db_read_line(db, error_r);
+	if (line == NULL)
+		return false;
+
+	if (strncmp(line, "OK MPD ", 7) != 0) {
+		g_set_error(error_r, proxy_db_quark(), 0,
+			    "\"%s:%u\" is not a MPD server",
+			    db->host, db->port);
+		g_free(line);
+		proxy_db_disconnect(db);
+		return false;
+	}
+
+	g_free(line);
+
+	if (db->password != NULL) {
+		char *quoted = proxy_db_quote(db->password);
+		char *command = g_strconcat("password ", quoted, NULL);
+		bool success = proxy_db_run(db, command, error_r);
+		g_free(command);
+		g_free(quoted);
+
+		if (!success) {
+			proxy_db_disconnect(db);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Sends a command and collects the response lines up to the "OK".
+ * Returns NULL on error; I/O errors close the connection.
+ */
+static GPtrArray *
+proxy_db_execute(struct proxy_db *db, const char *command, GError **error_r)
+{
+	if (db->fd < 0 && !proxy_db_connect(db, error_r))
+		return NULL;
+
+	if (!proxy_db_send(db, command, error_r))
+		return NULL;
+
+	GPtrArray *lines = g_ptr_array_new();
+
+	char *line;
+	while ((line = proxy_db_read_line(db, error_r)) != NULL) {
+		if (strcmp(line, "OK") == 0) {
+			g_free(line);
+			return lines;
+		}
+
+		if (strncmp(line, "ACK", 3) == 0) {
+			g_set_error(error_r, proxy_db_quark(), 0,
+				    "\"%s:%u\": %s",
+				    db->host, db->port, line);
+			g_free(line);
+			break;
+		}
+
+		g_ptr_array_add(lines, line);
+	}
+
+	for (unsigned i = 0; i < lines->len; ++i)
+		g_free(g_ptr_array_index(lines, i));
+	g_ptr_array_free(lines, true);
+	return NULL;
+}
+
+static GPtrArray *
+proxy_db_query(struct proxy_db *db, const char *command, GError **error_r)
+{
+	bool was_connected = db->fd >= 0;
+
+	GError *error = NULL;
+	GPtrArray *lines = proxy_db_execute(db, command, &error);
+	if (lines == NULL && was_connected && db->fd < 0) {
+		/* the existing connection was stale (the master may
+		   have restarted or timed us out): retry once with a
+		   fresh one */
+		g_error_free(error);
+		error = NULL;
+
+		lines = proxy_db_execute(db, command, &error);
+	}
+
+	if (lines == NULL)
+		g_propagate_error(error_r, error);
+
+	return lines;
+}
+
+/**
+ * Removes expired cache entries; if the cache is still full after
+ * that, the oldest entry is sacrificed.
+ */
+static void
+proxy_db_cache_evict(struct proxy_db *db, time_t now)
+{
+	if (g_hash_table_size(db->response_cache) < db->cache_max)
+		return;
+
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_hash_table_iter_init(&iter, db->response_cache);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		const struct proxy_db_response *response = value;
+		if (now - response->stamp >= (time_t)db->cache_ttl)
+			g_hash_table_iter_remove(&iter);
+	}
+
+	while (g_hash_table_size(db->response_cache) >= db->cache_max) {
+		gpointer oldest_key = NULL;
+		time_t oldest_stamp = 0;
+
+		g_hash_table_iter_init(&iter, db->response_cache);
+		while (g_hash_table_iter_next(&iter, &key, &value)) {
+			const struct proxy_db_response *response = value;
+			if (oldest_key == NULL ||
+			    response->stamp < oldest_stamp) {
+				oldest_key = key;
+				oldest_stamp = response->stamp;
+			}
+		}
+
+		g_hash_table_remove(db->response_cache, oldest_key);
+	}
+}
+
+/**
+ * Like proxy_db_query(), but serves the response from the local cache
+ * when a fresh enough copy exists.  The returned array is owned by
+ * the cache; it is valid until the next call into this plugin.
+ */
+static const GPtrArray *
+proxy_db_query_cached(struct proxy_db *db, const char *command,
+		      GError **error_r)
+{
+	const time_t now = time(NULL);
+
+	struct proxy_db_response *response =
+		g_hash_table_lookup(db->response_cache, command);
+	if (response != NULL) {
+		if (now - response->stamp < (time_t)db->cache_ttl)
+			return response->lines;
+
+		g_hash_table_remove(db->response_cache, command);
+	}
+
+	GPtrArray *lines = proxy_db_query(db, command, error_r);
+	if (lines == NULL)
+		return NULL;
+
+	proxy_db_cache_evict(db, now);
+
+	response = g_new(struct proxy_db_response, 1);
+	response->stamp = now;
+	response->lines = lines;
+	g_hash_table_insert(db->response_cache, g_strdup(command), response);
+
+	return lines;
+}
+
+static struct db *
+proxy_db_init(const struct config_param *param, GError **error_r)
+{
+	struct proxy_db *db = g_new(struct proxy_db, 1);
+	db_base_init(&db->base, &proxy_db_plugin);
+
+	db->host = config_dup_block_string(param, "host", "localhost");
+	db->port = config_get_block_unsigned(param, "port", 6600);
+	if (db->port == 0 || db->port > G_MAXUINT16) {
+		g_set_error(error_r, proxy_db_quark(), 0,
+			    "Invalid \"port\" parameter");
+		g_free(db->host);
+		g_free(db);
+		return NULL;
+	}
+
+	db->password = g_strdup(config_get_block_string(param, "password",
+							NULL));
+	db->cache_ttl = config_get_block_unsigned(param, "cache_ttl", 60);
+	db->cache_max = config_get_block_unsigned(param, "cache_max", 1024);
+	if (db->cache_max == 0)
+		db->cache_max = 1;
+
+	db->fd = -1;
+	db->input = g_string_sized_new(4096);
+	db->response_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+						   g_free,
+						   proxy_db_response_free);
+	db->song_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+					       g_free,
+					       (GDestroyNotify)song_free);
+	db->root = NULL;
+	db->mtime = 0;
+
+	return &db->base;
+}
+
+static void
+proxy_db_finish(struct db *_db)
+{
+	struct proxy_db *db = (struct proxy_db *)_db;
+
+	assert(db->fd < 0);
+
+	g_hash_table_destroy(db->song_cache);
+	g_hash_table_destroy(db->response_cache);
+	g_string_free(db->input, true);
+	g_free(db->password);
+	g_free(db->host);
+	g_free(db);
+}
+
+static bool
+proxy_db_open(struct db *_db, GError **error_r)
+{
+	struct proxy_db *db = (struct proxy_db *)_db;
+
+	if (!proxy_db_connect(db, error_r))
+		return false;
+
+	db->root = directory_new_root();
+	db->mtime = time(NULL);
+
+	return true;
+}
+
+static void
+proxy_db_close(struct db *_db)
+{
+	struct proxy_db *db = (struct proxy_db *)_db;
+
+	proxy_db_disconnect(db);
+
+	g_hash_table_remove_all(db->song_cache);
+	g_hash_table_remove_all(db->response_cache);
+
+	if (db->root != NULL) {
+		directory_free(db->root);
+		db->root = NULL;
+	}
+}
+
+/**
+ * Applies one "Name: value" pair from the master's response to a song
+ * object being assembled.  Unknown names are ignored silently,
+ * because the master may be a newer MPD version.
+ */
+static void
+proxy_db_apply_song_pair(struct song *song,
+			 const char *name, const char *value)
+{
+	enum tag_type type = tag_name_parse(name);
+	if (type != TAG_NUM_OF_ITEM_TYPES) {
+		if (song->tag == NULL) {
+			song->tag = tag_new();
+			tag_begin_add(song->tag);
+		}
+
+		tag_add_item(song->tag, type, value);
+	} else if (strcmp(name, "Time") == 0) {
+		if (song->tag == NULL) {
+			song->tag = tag_new();
+			tag_begin_add(song->tag);
+		}
+
+		song->tag->time = atoi(value);
+	} else if (strcmp(name, "Last-Modified") == 0) {
+		GTimeVal tv;
+		if (g_time_val_from_iso8601(value, &tv))
+			song->mtime = tv.tv_sec;
+	}
+}
+
+/**
+ * Finishes an assembled song and stores it in the song cache,
+ * returning the cached (long-lived) instance.
+ */
+static struct song *
+proxy_db_commit_song(struct proxy_db *db, struct song *song)
+{
+	if (song->tag != NULL)
+		tag_end_add(song->tag);
+
+	struct song *cached = g_hash_table_lookup(db->song_cache, song->uri);
+	if (cached != NULL) {
+		/* already known: keep the cached instance, because
+		   the queue may hold a pointer to it */
+		if (cached->tag != NULL)
+			tag_free(cached->tag);
+		cached->tag = song->tag;
+		song->tag = NULL;
+		cached->mtime = song->mtime;
+		song_print_cache_remove(cached);
+
+		song_free(song);
+		return cached;
+	}
+
+	g_hash_table_insert(db->song_cache, g_strdup(song->uri), song);
+	return song;
+}
+
+/**
+ * Splits a protocol response line into its name and value.  The name
+ * is copied to the caller's buffer.
+ */
+static bool
+proxy_db_split_line(const char *line, char *name, size_t name_size,
+		    const char **value_r)
+{
+	const char *colon = strchr(line, ':');
+	if (colon == NULL || colon == line || colon[1] != ' ')
+		return false;
+
+	size_t length = colon - line;
+	if (length >= name_size)
+		return false;
+
+	memcpy(name, line, length);
+	name[length] = 0;
+	*value_r = colon + 2;
+	return true;
+}
+
+static struct song *
+proxy_db_get_song(struct db *_db, const char *uri, GError **error_r)
+{
+	struct proxy_db *db = (struct proxy_db *)_db;
+
+	struct song *song = g_hash_table_lookup(db->song_cache, uri);
+	if (song != NULL)
+		return song;
+
+	char *quoted = proxy_db_quote(uri);
+	char *command = g_strconcat("lsinfo ", quoted, NULL);
+	g_free(quoted);
+
+	GPtrArray *lines = proxy_db_query(db, command, error_r);
+	g_free(command);
+	if (lines == NULL)
+		return NULL;
+
+	for (unsigned i = 0; i < lines->len; ++i) {
+		const char *line = g_ptr_array_index(lines, i);
+
+		char name[64];
+		const char *value;
+		if (!proxy_db_split_line(line, name, sizeof(name), &value))
+			continue;
+
+		if (strcmp(name, "file") == 0) {
+			if (song != NULL)
+				/* a second song begins: the first one
+				   is complete */
+				break;
+
+			song = song_file_new(value, db->root);
+		} else if (strcmp(name, "directory") == 0 ||
+			   strcmp(name, "playlist") == 0) {
+			if (song != NULL)
+				break;
+		} else if (song != NULL)
+			proxy_db_apply_song_pair(song, name, value);
+	}
+
+	for (unsigned i = 0; i < lines->len; ++i)
+		g_free(g_ptr_array_index(lines, i));
+	g_ptr_array_free(lines, true);
+
+	if (song == NULL) {
+		g_set_error(error_r, db_quark(), DB_NOT_FOUND,
+			    "No such song: %s", uri);
+		return NULL;
+	}
+
+	return proxy_db_commit_song(db, song);
+}
+
+static bool
+proxy_db_visit(struct db *_db, const struct db_selection *selection,
+	       const struct db_visitor *visitor, void *ctx,
+	       GError **error_r)
+{
+	struct proxy_db *db = (struct proxy_db *)_db;
+
+	/* "lsinfo" for a flat listing, "listallinfo" for the whole
+	   subtree; both return songs with all of their tags */
+	const char *verb = selection->recursive ? "listallinfo" : "lsinfo";
+
+	char *command;
+	if (selection->uri != NULL && *selection->uri != 0) {
+		char *quoted = proxy_db_quote(selection->uri);
+		command = g_strconcat(verb, " ", quoted, NULL);
+		g_free(quoted);
+	} else
+		command = g_strdup(verb);
+
+	const GPtrArray *lines = proxy_db_query_cached(db, command, error_r);
+	g_free(command);
+	if (lines == NULL)
+		return false;
+
+	bool result = true;
+
+	/* the song currently being assembled, or NULL */
+	struct song *song = NULL;
+
+	/* the playlist currently being assembled, or NULL */
+	char *playlist_name = NULL;
+	time_t playlist_mtime = 0;
+
+	for (unsigned i = 0; result && i <= lines->len; ++i) {
+		char name[64];
+		const char *value = NULL;
+
+		if (i < lines->len) {
+			const char *line = g_ptr_array_index(lines, i);
+			if (!proxy_db_split_line(line, name, sizeof(name),
+						 &value))
+				continue;
+		} else
+			/* end of the response: flush the last
+			   entity */
+			name[0] = 0;
+
+		const bool new_entity = i == lines->len ||
+			strcmp(name, "file") == 0 ||
+			strcmp(name, "directory") == 0 ||
+			strcmp(name, "playlist") == 0;
+
+		if (new_entity) {
+			if (song != NULL) {
+				song = proxy_db_commit_song(db, song);
+				if (visitor->song != NULL)
+					result = visitor->song(song, ctx,
+							       error_r);
+				song = NULL;
+			} else if (playlist_name != NULL) {
+				if (visitor->playlist != NULL) {
+					/* the name is the full path
+					   already, so pass the root
+					   as its directory */
+					struct playlist_metadata pm = {
+						.name = playlist_name,
+						.mtime = playlist_mtime,
+					};
+					result = visitor->playlist(&pm,
+								   db->root,
+								   ctx,
+								   error_r);
+				}
+
+				g_free(playlist_name);
+				playlist_name = NULL;
+			}
+
+			if (!result)
+				break;
+		}
+
+		if (i == lines->len)
+			break;
+
+		if (strcmp(name, "file") == 0) {
+			song = song_file_new(value, db->root);
+		} else if (strcmp(name, "directory") == 0) {
+			if (visitor->directory != NULL) {
+				struct directory *directory =
+					directory_new(value, db->root);
+				result = visitor->directory(directory, ctx,
+							    error_r);
+				directory_free(directory);
+			}
+		} else if (strcmp(name, "playlist") == 0) {
+			playlist_name = g_strdup(value);
+			playlist_mtime = 0;
+		} else if (song != NULL) {
+			proxy_db_apply_song_pair(song, name, value);
+		} else if (playlist_name != NULL &&
+			   strcmp(name, "Last-Modified") == 0) {
+			GTimeVal tv;
+			if (g_time_val_from_iso8601(value, &tv))
+				playlist_mtime = tv.tv_sec;
+		}
+	}
+
+	/* clean up in case the visitor aborted the walk */
+	if (song != NULL) {
+		if (song->tag != NULL)
+			tag_end_add(song->tag);
+		song_free(song);
+	}
+	g_free(playlist_name);
+
+	return result;
+}
+
+const struct db_plugin proxy_db_plugin = {
+	.name = "proxy",
+	.init = proxy_db_init,
+	.finish = proxy_db_finish,
+	.open = proxy_db_open,
+	.close = proxy_db_close,
+	.get_song = proxy_db_get_song,
+	.visit = proxy_db_visit,
+};
+
+time_t
+proxy_db_get_mtime(const struct db *_db)
+{
+	const struct proxy_db *db = (const struct proxy_db *)_db;
+
+	return db->mtime;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_PROXY_DB_PLUGIN_H
+#define MPD_PROXY_DB_PLUGIN_H
+
+#include <glib.h>
+#include <time.h>
+
+struct db;
+
+/**
+ * A database implementation which queries another MPD instance over
+ * the client protocol, instead of loading a local database file.
+ * Directory listings and song lookups are cached locally, so a
+ * satellite holds only the metadata it has actually served.
+ */
+extern const struct db_plugin proxy_db_plugin;
+
+/**
+ * Returns the time the connection to the master was established,
+ * which is the closest thing a proxy has to a database modification
+ * time.
+ */
+G_GNUC_PURE
+time_t
+proxy_db_get_mtime(const struct db *db);
+
+#endif
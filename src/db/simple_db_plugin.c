@@ -24,15 +24,18 @@
 #include "db_selection.h"
 #include "db_visitor.h"
 #include "db_save.h"
+#include "db_binary.h"
 #include "db_lock.h"
 #include "conf.h"
 #include "glib_compat.h"
 #include "directory.h"
+#include "db_arena.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
 
 struct simple_db {
 	struct db base;
@@ -42,6 +45,11 @@ struct simple_db {
 	struct directory *root;
 
 	time_t mtime;
+
+	/**
+	 * Save the database in the binary format?
+	 */
+	bool binary;
 };
 
 G_GNUC_CONST
@@ -59,10 +67,10 @@ simple_db_lookup_directory(const struct simple_db *db, const char *uri)
 	assert(db->root != NULL);
 	assert(uri != NULL);
 
-	db_lock();
+	db_read_lock();
 	struct directory *directory =
 		directory_lookup_directory(db->root, uri);
-	db_unlock();
+	db_read_unlock();
 	return directory;
 }
 
@@ -84,6 +92,8 @@ simple_db_init(const struct config_param *param, GError **error_r)
 		return NULL;
 	}
 
+	db->binary = config_get_block_bool(param, "binary", false);
+
 	return &db->base;
 }
 
@@ -185,7 +195,20 @@ simple_db_load(struct simple_db *db, GError **error_r)
 		return false;
 	}
 
-	if (!db_load_internal(fp, db->root, error_r)) {
+	/* bump-allocate all song and tag structures from the arena;
+	   nobody else creates songs or tags this early during
+	   startup */
+	db_arena_begin();
+
+	/* the format is auto-detected, so a database saved in the
+	   other format is still loaded and migrated on the next
+	   save */
+	bool success = db_binary_detect(fp)
+		? db_binary_load_internal(fp, db->root, error_r)
+		: db_load_internal(fp, db->root, error_r);
+
+	db_arena_end();
+	if (!success) {
 		fclose(fp);
 		return false;
 	}
@@ -240,9 +263,9 @@ simple_db_get_song(struct db *_db, const char *uri, GError **error_r)
 
 	assert(db->root != NULL);
 
-	db_lock();
+	db_read_lock();
 	struct song *song = directory_lookup_song(db->root, uri);
-	db_unlock();
+	db_read_unlock();
 	if (song == NULL)
 		g_set_error(error_r, db_quark(), DB_NOT_FOUND,
 			    "No such song: %s", uri);
@@ -250,6 +273,54 @@ simple_db_get_song(struct db *_db, const char *uri, GError **error_r)
 	return song;
 }
 
+static void
+simple_db_get_songs(struct db *_db, const char *const uris[], unsigned n,
+		    struct song **songs_r)
+{
+	struct simple_db *db = (struct simple_db *)_db;
+
+	assert(db->root != NULL);
+
+	/* playlist entries are usually grouped by directory, so
+	   remembering the last parent directory resolves all of its
+	   children with a single path walk */
+	char *last_dir = NULL;
+	struct directory *parent = db->root;
+
+	db_read_lock();
+
+	for (unsigned i = 0; i < n; ++i) {
+		const char *uri = uris[i];
+		if (uri == NULL) {
+			songs_r[i] = NULL;
+			continue;
+		}
+
+		const char *slash = strrchr(uri, '/');
+		if (slash == NULL) {
+			songs_r[i] = directory_get_song(db->root, uri);
+			continue;
+		}
+
+		size_t dir_length = slash - uri;
+		if (last_dir == NULL || strlen(last_dir) != dir_length ||
+		    memcmp(last_dir, uri, dir_length) != 0) {
+			g_free(last_dir);
+			last_dir = g_strndup(uri, dir_length);
+			parent = directory_lookup_directory(db->root,
+							    last_dir);
+		}
+
+		songs_r[i] = parent != NULL
+			? directory_get_song(parent, slash + 1)
+			: NULL;
+	}
+
+	db_read_unlock();
+
+	g_free(last_dir);
+}
+
 static bool
 simple_db_visit(struct db *_db, const struct db_selection *selection,
 		const struct db_visitor *visitor, void *ctx,
@@ -273,10 +344,10 @@ simple_db_visit(struct db *_db, const struct db_selection *selection,
 	    !visitor->directory(directory, ctx, error_r))
 		return false;
 
-	db_lock();
+	db_read_lock();
 	bool ret = directory_walk(directory, selection->recursive,
 				  visitor, ctx, error_r);
-	db_unlock();
+	db_read_unlock();
 	return ret;
 }
 
@@ -287,6 +358,7 @@ const struct db_plugin simple_db_plugin = {
 	.open = simple_db_open,
 	.close = simple_db_close,
 	.get_song = simple_db_get_song,
+	.get_songs = simple_db_get_songs,
 	.visit = simple_db_visit,
 };
 
@@ -327,7 +399,10 @@ simple_db_save(struct db *_db, GError **error_r)
 		return false;
 	}
 
-	db_save_internal(fp, music_root);
+	if (db->binary)
+		db_binary_save_internal(fp, music_root);
+	else
+		db_save_internal(fp, music_root);
 
 	if (ferror(fp)) {
 		g_set_error(error_r, simple_db_quark(), errno,
@@ -50,7 +50,13 @@ static const struct db_visitor add_to_queue_visitor = {
 bool
 addAllIn(struct player_control *pc, const char *uri, GError **error_r)
 {
-	return db_walk(uri, &add_to_queue_visitor, pc, error_r);
+	/* one version bump and one idle event for the whole
+	   subtree */
+	playlist_bulk_begin(&g_playlist);
+	bool success = db_walk(uri, &add_to_queue_visitor, pc, error_r);
+	playlist_bulk_end(&g_playlist, pc);
+
+	return success;
 }
 
 struct add_data {
@@ -120,5 +126,9 @@ findAddIn(struct player_control *pc, const char *name,
 	data.pc = pc;
 	data.criteria = criteria;
 
-	return db_walk(name, &find_add_visitor, &data, error_r);
+	playlist_bulk_begin(&g_playlist);
+	bool success = db_walk(name, &find_add_visitor, &data, error_r);
+	playlist_bulk_end(&g_playlist, pc);
+
+	return success;
 }
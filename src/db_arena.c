@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "db_arena.h"
+
+#include <glib.h>
+
+#include <assert.h>
+
+/**
+ * The size of an arena block; must be large enough to hold many
+ * database objects, so the per-block overhead is negligible.
+ */
+#define ARENA_BLOCK_SIZE (256 * 1024)
+
+struct db_arena_block {
+	struct db_arena_block *next;
+
+	/** the number of bytes used at the beginning of data[] */
+	size_t used;
+
+	/** the payload; the actual size is variable */
+	char data[sizeof(long)];
+};
+
+/** a linked list of all arena blocks; the head is the current one */
+static struct db_arena_block *db_arena_list;
+
+/** is the arena enabled, i.e. do the constructors allocate from it? */
+static bool db_arena_active;
+
+static struct db_arena_block *
+db_arena_block_new(size_t size)
+{
+	struct db_arena_block *block =
+		g_malloc(sizeof(*block) - sizeof(block->data) + size);
+
+	block->next = db_arena_list;
+	block->used = 0;
+	db_arena_list = block;
+	return block;
+}
+
+void
+db_arena_begin(void)
+{
+	assert(!db_arena_active);
+
+	db_arena_active = true;
+}
+
+void
+db_arena_end(void)
+{
+	assert(db_arena_active);
+
+	db_arena_active = false;
+}
+
+bool
+db_arena_is_active(void)
+{
+	return db_arena_active;
+}
+
+void *
+db_arena_alloc(size_t size)
+{
+	struct db_arena_block *block = db_arena_list;
+	void *p;
+
+	assert(db_arena_active);
+
+	/* keep the arena aligned for the database object types */
+	size = (size + sizeof(long) - 1) & ~(sizeof(long) - 1);
+
+	if (block == NULL || block->used + size > ARENA_BLOCK_SIZE)
+		block = db_arena_block_new(MAX(ARENA_BLOCK_SIZE, size));
+
+	p = block->data + block->used;
+	block->used += size;
+	return p;
+}
+
+void
+db_arena_free(void)
+{
+	struct db_arena_block *block;
+
+	assert(!db_arena_active);
+
+	while ((block = db_arena_list) != NULL) {
+		db_arena_list = block->next;
+		g_free(block);
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A bump allocator for objects owned by the music database (songs,
+ * tags, tag item arrays).  While the database file is being loaded,
+ * these objects are carved out of large contiguous blocks instead of
+ * individual heap allocations: the songs of a directory end up packed
+ * next to their tags in load order, so sequential database scans
+ * (search, list, db_print) stream through memory instead of chasing
+ * pointers into random heap pages.  The memory is released in one
+ * sweep by db_arena_free() instead of one g_free() per object at
+ * shutdown.
+ *
+ * The arena is not thread safe; it may only be enabled while no other
+ * thread creates songs or tags (i.e. during the initial database
+ * load).  Objects allocated from it are marked with their "pooled"
+ * flag and must never be passed to g_free() or g_realloc().
+ */
+
+#ifndef MPD_DB_ARENA_H
+#define MPD_DB_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * From now on, db_arena_alloc() is available, and the song and tag
+ * constructors use it.
+ */
+void
+db_arena_begin(void);
+
+/**
+ * Finishes the operation started with db_arena_begin().  Subsequent
+ * constructor calls allocate from the heap again.
+ */
+void
+db_arena_end(void);
+
+/**
+ * Is the arena currently enabled?
+ */
+bool
+db_arena_is_active(void);
+
+/**
+ * Allocates a chunk from the arena.  The returned pointer is aligned
+ * for any of the database object types.  May only be called while the
+ * arena is active.
+ */
+void *
+db_arena_alloc(size_t size);
+
+/**
+ * Frees all arena blocks.  Call this after the last "pooled" object
+ * has been freed, i.e. after the database has been disposed.
+ */
+void
+db_arena_free(void);
+
+#endif
@@ -0,0 +1,760 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "db_binary.h"
+#include "db_lock.h"
+#include "directory.h"
+#include "song.h"
+#include "path.h"
+#include "playlist_vector.h"
+#include "tag.h"
+#include "tag_internal.h"
+#include "tag_pool.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#include <sys/stat.h>
+#include <unistd.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "database"
+
+/*
+ * The binary database format: a fixed header (magic, format number,
+ * filesystem charset, enabled tag names), followed by an interned tag
+ * string table, followed by a record stream mirroring the directory
+ * tree.  All integers are little-endian with a fixed width; strings
+ * are length-prefixed and not null-terminated.  Loading does not
+ * parse or hash tag values - each song refers to its tag items by
+ * table index, which maps to a tag_pool_dup_item() call.
+ *
+ * The loader does not read through stdio: the whole file is mapped
+ * with mmap() (with a plain read() fallback), and the parser walks a
+ * cursor over the mapping.  Tag values are interned straight out of
+ * the mapping without an intermediate copy, and the pages are backed
+ * by the page cache, which makes a warm restart nearly instant.
+ */
+
+static const char db_binary_magic[8] = "MPDbindb";
+
+enum {
+	/* 2: added the directory device marker (container/archive
+	   virtual directories) */
+	DB_BINARY_FORMAT = 2,
+
+	/** sanity limit for on-disk string lengths */
+	DB_BINARY_MAX_STRING = 512 * 1024,
+};
+
+enum db_binary_record {
+	DB_RECORD_DIR_BEGIN = 1,
+	DB_RECORD_DIR_END = 2,
+	DB_RECORD_SONG = 3,
+	DB_RECORD_PLAYLIST = 4,
+	DB_RECORD_EOF = 5,
+};
+
+enum db_binary_song_flag {
+	DB_SONG_HAS_TAG = 0x1,
+	DB_SONG_HAS_PLAYLIST = 0x2,
+};
+
+G_GNUC_CONST
+static GQuark
+db_binary_quark(void)
+{
+	return g_quark_from_static_string("db_binary");
+}
+
+bool
+db_binary_detect(FILE *fp)
+{
+	char magic[sizeof(db_binary_magic)];
+
+	long offset = ftell(fp);
+	size_t nbytes = fread(magic, 1, sizeof(magic), fp);
+	if (fseek(fp, offset, SEEK_SET) != 0)
+		return false;
+
+	return nbytes == sizeof(magic) &&
+		memcmp(magic, db_binary_magic, sizeof(magic)) == 0;
+}
+
+/*
+ * writer
+ */
+
+static void
+write_u8(FILE *fp, uint8_t value)
+{
+	fwrite(&value, sizeof(value), 1, fp);
+}
+
+static void
+write_u32(FILE *fp, uint32_t value)
+{
+	value = GUINT32_TO_LE(value);
+	fwrite(&value, sizeof(value), 1, fp);
+}
+
+static void
+write_u64(FILE *fp, uint64_t value)
+{
+	value = GUINT64_TO_LE(value);
+	fwrite(&value, sizeof(value), 1, fp);
+}
+
+static void
+write_string(FILE *fp, const char *value)
+{
+	size_t length = strlen(value);
+
+	write_u32(fp, length);
+	fwrite(value, 1, length, fp);
+}
+
+/**
+ * First pass: collect all distinct tag items into the table hash and
+ * write the string table entry for each new one.
+ */
+static void
+db_binary_collect_items(FILE *fp, GHashTable *table,
+			const struct directory *directory)
+{
+	const struct directory *child;
+	directory_for_each_child(child, directory)
+		db_binary_collect_items(fp, table, child);
+
+	const struct song *song;
+	directory_for_each_song(song, directory) {
+		if (song->tag == NULL)
+			continue;
+
+		for (unsigned i = 0; i < song->tag->num_items; ++i) {
+			struct tag_item *item = song->tag->items[i];
+
+			if (g_hash_table_lookup(table, item) != NULL)
+				continue;
+
+			unsigned index = g_hash_table_size(table);
+			g_hash_table_insert(table, item,
+					    GUINT_TO_POINTER(index + 1));
+
+			write_u8(fp, item->type);
+			write_string(fp, item->value);
+		}
+	}
+}
+
+static void
+db_binary_count_items(GHashTable *table, const struct directory *directory,
+		      uint32_t *count_r)
+{
+	const struct directory *child;
+	directory_for_each_child(child, directory)
+		db_binary_count_items(table, child, count_r);
+
+	const struct song *song;
+	directory_for_each_song(song, directory) {
+		if (song->tag == NULL)
+			continue;
+
+		for (unsigned i = 0; i < song->tag->num_items; ++i) {
+			struct tag_item *item = song->tag->items[i];
+
+			if (g_hash_table_lookup(table, item) != NULL)
+				continue;
+
+			g_hash_table_insert(table, item,
+					    GUINT_TO_POINTER(*count_r + 1));
+			++*count_r;
+		}
+	}
+}
+
+static void
+db_binary_save_song(FILE *fp, GHashTable *table, const struct song *song)
+{
+	write_u8(fp, DB_RECORD_SONG);
+	write_string(fp, song->uri);
+	write_u64(fp, song->mtime);
+	write_u32(fp, song->start_ms);
+	write_u32(fp, song->end_ms);
+
+	uint8_t flags = 0;
+	if (song->tag != NULL) {
+		flags |= DB_SONG_HAS_TAG;
+		if (song->tag->has_playlist)
+			flags |= DB_SONG_HAS_PLAYLIST;
+	}
+
+	write_u8(fp, flags);
+
+	if (song->tag == NULL)
+		return;
+
+	write_u32(fp, song->tag->time);
+	write_u32(fp, song->tag->num_items);
+
+	for (unsigned i = 0; i < song->tag->num_items; ++i) {
+		gpointer value = g_hash_table_lookup(table,
+						     song->tag->items[i]);
+		assert(value != NULL);
+
+		write_u32(fp, GPOINTER_TO_UINT(value) - 1);
+	}
+}
+
+static void
+db_binary_save_directory(FILE *fp, GHashTable *table,
+			 const struct directory *directory)
+{
+	const struct directory *child;
+	directory_for_each_child(child, directory) {
+		char *base = g_path_get_basename(child->path);
+
+		write_u8(fp, DB_RECORD_DIR_BEGIN);
+		write_string(fp, base);
+		write_u64(fp, child->mtime);
+		write_u8(fp, child->device == DEVICE_CONTAINER ? 1
+			 : child->device == DEVICE_INARCHIVE ? 2 : 0);
+		g_free(base);
+
+		db_binary_save_directory(fp, table, child);
+		write_u8(fp, DB_RECORD_DIR_END);
+
+		if (ferror(fp))
+			return;
+	}
+
+	const struct song *song;
+	directory_for_each_song(song, directory)
+		db_binary_save_song(fp, table, song);
+
+	const struct playlist_metadata *pm;
+	playlist_vector_for_each(pm, &directory->playlists) {
+		write_u8(fp, DB_RECORD_PLAYLIST);
+		write_string(fp, pm->name);
+		write_u64(fp, pm->mtime);
+	}
+}
+
+void
+db_binary_save_internal(FILE *fp, const struct directory *music_root)
+{
+	assert(music_root != NULL);
+
+	fwrite(db_binary_magic, 1, sizeof(db_binary_magic), fp);
+	write_u32(fp, DB_BINARY_FORMAT);
+	write_string(fp, path_get_fs_charset());
+
+	uint32_t num_tags = 0;
+	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i)
+		if (!ignore_tag_items[i])
+			++num_tags;
+
+	write_u32(fp, num_tags);
+	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i)
+		if (!ignore_tag_items[i])
+			write_string(fp, tag_item_names[i]);
+
+	/* the table size must precede the entries, so count first,
+	   then re-walk to emit the entries in the same order */
+
+	GHashTable *table = g_hash_table_new(g_direct_hash, g_direct_equal);
+	uint32_t num_items = 0;
+	db_binary_count_items(table, music_root, &num_items);
+	g_hash_table_destroy(table);
+
+	write_u32(fp, num_items);
+
+	table = g_hash_table_new(g_direct_hash, g_direct_equal);
+	db_binary_collect_items(fp, table, music_root);
+	assert(g_hash_table_size(table) == num_items);
+
+	db_binary_save_directory(fp, table, music_root);
+	write_u8(fp, DB_RECORD_EOF);
+
+	g_hash_table_destroy(table);
+}
+
+/*
+ * reader
+ */
+
+/**
+ * A cursor over the memory-mapped database file.
+ */
+struct db_cursor {
+	const uint8_t *p, *end;
+};
+
+static bool
+read_u8(struct db_cursor *c, uint8_t *value_r)
+{
+	if (c->end - c->p < (ptrdiff_t)sizeof(*value_r))
+		return false;
+
+	*value_r = *c->p++;
+	return true;
+}
+
+static bool
+read_u32(struct db_cursor *c, uint32_t *value_r)
+{
+	uint32_t value;
+
+	if (c->end - c->p < (ptrdiff_t)sizeof(value))
+		return false;
+
+	memcpy(&value, c->p, sizeof(value));
+	c->p += sizeof(value);
+	*value_r = GUINT32_FROM_LE(value);
+	return true;
+}
+
+static bool
+read_u64(struct db_cursor *c, uint64_t *value_r)
+{
+	uint64_t value;
+
+	if (c->end - c->p < (ptrdiff_t)sizeof(value))
+		return false;
+
+	memcpy(&value, c->p, sizeof(value));
+	c->p += sizeof(value);
+	*value_r = GUINT64_FROM_LE(value);
+	return true;
+}
+
+/**
+ * Obtain a pointer to a length-prefixed string inside the mapping,
+ * without copying it.  The string is not null-terminated.
+ */
+static const char *
+read_string_ref(struct db_cursor *c, uint32_t *length_r)
+{
+	uint32_t length;
+
+	if (!read_u32(c, &length) || length > DB_BINARY_MAX_STRING ||
+	    c->end - c->p < (ptrdiff_t)length)
+		return NULL;
+
+	const char *value = (const char *)c->p;
+	c->p += length;
+	*length_r = length;
+	return value;
+}
+
+/**
+ * Read a length-prefixed string into the reusable buffer, for callers
+ * which need a null-terminated copy.  Returns NULL on premature end
+ * of file or implausible length.
+ */
+static const char *
+read_string(struct db_cursor *c, GString *buffer)
+{
+	uint32_t length;
+	const char *value = read_string_ref(c, &length);
+
+	if (value == NULL)
+		return NULL;
+
+	g_string_set_size(buffer, length);
+	memcpy(buffer->str, value, length);
+	buffer->str[length] = 0;
+	return buffer->str;
+}
+
+static void
+db_binary_corrupt(GError **error_r)
+{
+	g_set_error(error_r, db_binary_quark(), 0,
+		    "Corrupted binary database file");
+}
+
+static struct tag_item **
+db_binary_load_table(struct db_cursor *c, uint32_t *num_items_r,
+		     GError **error_r)
+{
+	uint32_t num_items;
+
+	if (!read_u32(c, &num_items) ||
+	    num_items > G_MAXUINT32 / sizeof(struct tag_item *)) {
+		db_binary_corrupt(error_r);
+		return NULL;
+	}
+
+	struct tag_item **table =
+		g_malloc(num_items * sizeof(table[0]));
+
+	for (uint32_t i = 0; i < num_items; ++i) {
+		uint8_t type;
+		uint32_t length;
+		const char *value;
+
+		if (!read_u8(c, &type) ||
+		    type >= TAG_NUM_OF_ITEM_TYPES ||
+		    (value = read_string_ref(c, &length)) == NULL) {
+			while (i-- > 0)
+				tag_pool_put_item(table[i]);
+			g_free(table);
+			db_binary_corrupt(error_r);
+			return NULL;
+		}
+
+		/* the value is interned directly out of the mapping,
+		   without an intermediate copy */
+		table[i] = tag_pool_get_item(type, value, length);
+	}
+
+	*num_items_r = num_items;
+	return table;
+}
+
+static struct song *
+db_binary_load_song(struct db_cursor *c, struct directory *parent,
+		    GString *buffer,
+		    struct tag_item *const*table, uint32_t table_size,
+		    GError **error_r)
+{
+	const char *uri = read_string(c, buffer);
+	if (uri == NULL || *uri == 0 ||
+	    directory_get_song(parent, uri) != NULL) {
+		db_binary_corrupt(error_r);
+		return NULL;
+	}
+
+	struct song *song = song_file_new(uri, parent);
+
+	uint64_t mtime;
+	uint32_t start_ms, end_ms;
+	uint8_t flags;
+
+	if (!read_u64(c, &mtime) ||
+	    !read_u32(c, &start_ms) || !read_u32(c, &end_ms) ||
+	    !read_u8(c, &flags)) {
+		song_free(song);
+		db_binary_corrupt(error_r);
+		return NULL;
+	}
+
+	song->mtime = mtime;
+	song->start_ms = start_ms;
+	song->end_ms = end_ms;
+
+	if ((flags & DB_SONG_HAS_TAG) == 0)
+		return song;
+
+	uint32_t time, num_items;
+	if (!read_u32(c, &time) || !read_u32(c, &num_items) ||
+	    num_items > table_size) {
+		song_free(song);
+		db_binary_corrupt(error_r);
+		return NULL;
+	}
+
+	struct tag *tag = tag_new();
+	tag->time = time;
+	tag->has_playlist = (flags & DB_SONG_HAS_PLAYLIST) != 0;
+	tag_alloc_items(tag, num_items);
+
+	for (uint32_t i = 0; i < num_items; ++i) {
+		uint32_t index;
+
+		if (!read_u32(c, &index) || index >= table_size) {
+			tag->num_items = i;
+			tag_free(tag);
+			song_free(song);
+			db_binary_corrupt(error_r);
+			return NULL;
+		}
+
+		tag->items[i] = tag_pool_dup_item(table[index]);
+	}
+
+	song->tag = tag;
+	return song;
+}
+
+static bool
+db_binary_load_directory(struct db_cursor *c, struct directory *directory,
+			 GString *buffer,
+			 struct tag_item *const*table, uint32_t table_size,
+			 GError **error_r)
+{
+	uint8_t record;
+
+	while (read_u8(c, &record)) {
+		switch (record) {
+		case DB_RECORD_DIR_BEGIN: {
+			const char *name = read_string(c, buffer);
+			uint64_t mtime;
+			uint8_t device;
+
+			if (name == NULL || *name == 0 ||
+			    directory_get_child(directory, name) != NULL ||
+			    !read_u64(c, &mtime) ||
+			    !read_u8(c, &device) || device > 2) {
+				db_binary_corrupt(error_r);
+				return false;
+			}
+
+			struct directory *subdir =
+				directory_new_child(directory, name);
+			subdir->mtime = mtime;
+			if (device == 1)
+				subdir->device = DEVICE_CONTAINER;
+			else if (device == 2)
+				subdir->device = DEVICE_INARCHIVE;
+
+			if (!db_binary_load_directory(c, subdir, buffer,
+						      table, table_size,
+						      error_r))
+				return false;
+			break;
+		}
+
+		case DB_RECORD_DIR_END:
+			if (directory_is_root(directory)) {
+				db_binary_corrupt(error_r);
+				return false;
+			}
+
+			return true;
+
+		case DB_RECORD_SONG: {
+			struct song *song =
+				db_binary_load_song(c, directory, buffer,
+						    table, table_size,
+						    error_r);
+			if (song == NULL)
+				return false;
+
+			directory_add_song(directory, song);
+			break;
+		}
+
+		case DB_RECORD_PLAYLIST: {
+			const char *name = read_string(c, buffer);
+			uint64_t mtime;
+
+			if (name == NULL || !read_u64(c, &mtime)) {
+				db_binary_corrupt(error_r);
+				return false;
+			}
+
+			playlist_vector_update_or_add(&directory->playlists,
+						      name, mtime);
+			break;
+		}
+
+		case DB_RECORD_EOF:
+			if (!directory_is_root(directory)) {
+				db_binary_corrupt(error_r);
+				return false;
+			}
+
+			return true;
+
+		default:
+			db_binary_corrupt(error_r);
+			return false;
+		}
+	}
+
+	db_binary_corrupt(error_r);
+	return false;
+}
+
+static bool
+db_binary_load_cursor(struct db_cursor *c, struct directory *music_root,
+		      GError **error_r)
+{
+	GString *buffer = g_string_sized_new(1024);
+
+	char magic[sizeof(db_binary_magic)];
+	uint32_t format;
+
+	if ((size_t)(c->end - c->p) < sizeof(magic)) {
+		db_binary_corrupt(error_r);
+		g_string_free(buffer, true);
+		return false;
+	}
+
+	memcpy(magic, c->p, sizeof(magic));
+	c->p += sizeof(magic);
+
+	if (memcmp(magic, db_binary_magic, sizeof(magic)) != 0 ||
+	    !read_u32(c, &format)) {
+		db_binary_corrupt(error_r);
+		g_string_free(buffer, true);
+		return false;
+	}
+
+	if (format != DB_BINARY_FORMAT) {
+		g_set_error(error_r, db_binary_quark(), 0,
+			    "Binary database format mismatch, "
+			    "discarding database file");
+		g_string_free(buffer, true);
+		return false;
+	}
+
+	const char *new_charset = read_string(c, buffer);
+	if (new_charset == NULL) {
+		db_binary_corrupt(error_r);
+		g_string_free(buffer, true);
+		return false;
+	}
+
+	const char *old_charset = path_get_fs_charset();
+	if (old_charset != NULL && strcmp(new_charset, old_charset) != 0) {
+		g_set_error(error_r, db_binary_quark(), 0,
+			    "Existing database has charset \"%s\" "
+			    "instead of \"%s\"; "
+			    "discarding database file",
+			    new_charset, old_charset);
+		g_string_free(buffer, true);
+		return false;
+	}
+
+	uint32_t num_tags;
+	bool tags[TAG_NUM_OF_ITEM_TYPES];
+	memset(tags, false, sizeof(tags));
+
+	if (!read_u32(c, &num_tags) || num_tags > TAG_NUM_OF_ITEM_TYPES) {
+		db_binary_corrupt(error_r);
+		g_string_free(buffer, true);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < num_tags; ++i) {
+		const char *name = read_string(c, buffer);
+		enum tag_type tag;
+
+		if (name == NULL ||
+		    (tag = tag_name_parse(name)) == TAG_NUM_OF_ITEM_TYPES) {
+			g_set_error(error_r, db_binary_quark(), 0,
+				    "Unrecognized tag, "
+				    "discarding database file");
+			g_string_free(buffer, true);
+			return false;
+		}
+
+		tags[tag] = true;
+	}
+
+	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i) {
+		if (!ignore_tag_items[i] && !tags[i]) {
+			g_set_error(error_r, db_binary_quark(), 0,
+				    "Tag list mismatch, "
+				    "discarding database file");
+			g_string_free(buffer, true);
+			return false;
+		}
+	}
+
+	uint32_t table_size;
+	struct tag_item **table =
+		db_binary_load_table(c, &table_size, error_r);
+	if (table == NULL) {
+		g_string_free(buffer, true);
+		return false;
+	}
+
+	g_debug("reading binary DB");
+
+	db_lock();
+	bool success = db_binary_load_directory(c, music_root, buffer,
+						table, table_size, error_r);
+	db_unlock();
+
+	/* release the table's own references; songs hold theirs */
+	for (uint32_t i = 0; i < table_size; ++i)
+		tag_pool_put_item(table[i]);
+	g_free(table);
+
+	g_string_free(buffer, true);
+	return success;
+}
+
+bool
+db_binary_load_internal(FILE *fp, struct directory *music_root,
+			GError **error_r)
+{
+	assert(music_root != NULL);
+
+	/* map the whole file; the parser walks a cursor over the
+	   mapping */
+
+	int fd = fileno(fp);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+	    st.st_size <= 0) {
+		db_binary_corrupt(error_r);
+		return false;
+	}
+
+	size_t size = st.st_size;
+	void *map = NULL;
+	uint8_t *heap = NULL;
+	const uint8_t *data;
+
+#ifdef HAVE_SYS_MMAN_H
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		map = NULL;
+#endif
+
+	if (map != NULL) {
+		data = map;
+	} else {
+		/* fallback: read the whole file at once */
+		heap = g_malloc(size);
+		if (fseek(fp, 0, SEEK_SET) != 0 ||
+		    fread(heap, 1, size, fp) != size) {
+			g_free(heap);
+			db_binary_corrupt(error_r);
+			return false;
+		}
+
+		data = heap;
+	}
+
+	struct db_cursor cursor = {
+		.p = data,
+		.end = data + size,
+	};
+
+	bool success = db_binary_load_cursor(&cursor, music_root, error_r);
+
+#ifdef HAVE_SYS_MMAN_H
+	if (map != NULL)
+		munmap(map, size);
+#endif
+	g_free(heap);
+
+	return success;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_DB_BINARY_H
+#define MPD_DB_BINARY_H
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+
+struct directory;
+
+/**
+ * Check whether the database file starts with the binary format
+ * magic.  Does not modify the stream position.
+ */
+bool
+db_binary_detect(FILE *fp);
+
+/**
+ * Save the database in the binary format: length-prefixed records and
+ * an interned tag string table, which loads roughly an order of
+ * magnitude faster than the line-oriented text format.
+ */
+void
+db_binary_save_internal(FILE *fp, const struct directory *music_root);
+
+bool
+db_binary_load_internal(FILE *fp, struct directory *music_root,
+			GError **error);
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "db_changes.h"
+#include "database.h"
+#include "song.h"
+#include "tag.h"
+#include "tag_print.h"
+#include "client.h"
+#include "conf.h"
+
+#include <glib.h>
+
+#include <assert.h>
+
+struct db_change {
+	/** the version assigned to this change */
+	unsigned version;
+
+	enum db_change_type type;
+
+	/** the song URI within the music directory (UTF-8) */
+	char *uri;
+};
+
+/** protects all following variables; the records are written by the
+    update task and its scanner workers, and read by the main task */
+static GMutex *db_changes_mutex;
+
+/** the journal, oldest change first */
+static GQueue db_changes = G_QUEUE_INIT;
+
+/** the version of the newest recorded change */
+static unsigned db_changes_version;
+
+/** upper limit for the journal size; 0 disables the journal */
+static unsigned db_changes_max;
+
+static const char *const db_change_type_names[] = {
+	[DB_CHANGE_ADD] = "add",
+	[DB_CHANGE_MODIFY] = "modify",
+	[DB_CHANGE_REMOVE] = "remove",
+};
+
+void
+db_changes_init(void)
+{
+	db_changes_max = config_get_unsigned(CONF_DB_CHANGES_MAX, 16384);
+
+	db_changes_mutex = g_mutex_new();
+}
+
+static void
+db_change_free(struct db_change *change)
+{
+	g_free(change->uri);
+	g_slice_free(struct db_change, change);
+}
+
+void
+db_changes_finish(void)
+{
+	struct db_change *change;
+	while ((change = g_queue_pop_head(&db_changes)) != NULL)
+		db_change_free(change);
+
+	g_mutex_free(db_changes_mutex);
+	db_changes_mutex = NULL;
+}
+
+void
+db_changes_record(enum db_change_type type, const char *uri)
+{
+	assert(uri != NULL);
+
+	if (db_changes_max == 0)
+		return;
+
+	struct db_change *change = g_slice_new(struct db_change);
+	change->type = type;
+	change->uri = g_strdup(uri);
+
+	g_mutex_lock(db_changes_mutex);
+
+	change->version = ++db_changes_version;
+	g_queue_push_tail(&db_changes, change);
+
+	while (db_changes.length > db_changes_max) {
+		/* the journal is full: sacrifice the oldest record;
+		   clients whose cursor predates it have to fall back
+		   to a full reload */
+		struct db_change *old = g_queue_pop_head(&db_changes);
+		db_change_free(old);
+	}
+
+	g_mutex_unlock(db_changes_mutex);
+}
+
+unsigned
+db_changes_get_cursor(void)
+{
+	g_mutex_lock(db_changes_mutex);
+	unsigned cursor = db_changes_version;
+	g_mutex_unlock(db_changes_mutex);
+
+	return cursor;
+}
+
+bool
+db_changes_print(struct client *client, unsigned cursor)
+{
+	g_mutex_lock(db_changes_mutex);
+
+	if (cursor > db_changes_version ||
+	    db_changes_version - cursor > db_changes.length) {
+		/* the cursor is from the future, or records after it
+		   have already been dropped */
+		g_mutex_unlock(db_changes_mutex);
+		return false;
+	}
+
+	/* copy the requested records, so the song lookups below do
+	   not run while the journal mutex is held (an update task
+	   holding the db_mutex may be blocking on it) */
+	const unsigned version = db_changes_version;
+	GPtrArray *snapshot = g_ptr_array_new();
+
+	for (const GList *i = db_changes.head; i != NULL; i = i->next) {
+		const struct db_change *change = i->data;
+		if (change->version <= cursor)
+			continue;
+
+		struct db_change *copy = g_slice_new(struct db_change);
+		copy->version = change->version;
+		copy->type = change->type;
+		copy->uri = g_strdup(change->uri);
+		g_ptr_array_add(snapshot, copy);
+	}
+
+	g_mutex_unlock(db_changes_mutex);
+
+	for (unsigned i = 0; i < snapshot->len; ++i) {
+		struct db_change *change = g_ptr_array_index(snapshot, i);
+
+		client_printf(client, "change: %s\n",
+			      db_change_type_names[change->type]);
+		client_printf(client, "file: %s\n", change->uri);
+
+		if (change->type != DB_CHANGE_REMOVE) {
+			/* serialize the song's current metadata, so
+			   the client can apply the change without
+			   asking back */
+			const struct song *song = db_get_song(change->uri);
+			if (song != NULL && song->tag != NULL)
+				tag_print(client, song->tag);
+		}
+
+		db_change_free(change);
+	}
+
+	g_ptr_array_free(snapshot, true);
+
+	client_printf(client, "cursor: %u\n", version);
+
+	return true;
+}
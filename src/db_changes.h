@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A journal of recent database changes.  The update task records
+ * every song it adds, modifies or removes; the "dbchanges" protocol
+ * command replays the records after a client-supplied cursor, so
+ * satellite instances and backup tools can follow the database
+ * incrementally instead of re-reading the whole file.
+ */
+
+#ifndef MPD_DB_CHANGES_H
+#define MPD_DB_CHANGES_H
+
+#include <stdbool.h>
+
+struct client;
+
+enum db_change_type {
+	DB_CHANGE_ADD,
+	DB_CHANGE_MODIFY,
+	DB_CHANGE_REMOVE,
+};
+
+void
+db_changes_init(void);
+
+void
+db_changes_finish(void);
+
+/**
+ * Records one change.  Safe to call from the update task and its
+ * scanner workers.
+ *
+ * @param uri the song URI within the music directory (UTF-8); copied
+ */
+void
+db_changes_record(enum db_change_type type, const char *uri);
+
+/**
+ * Returns the current cursor, i.e. the version of the newest recorded
+ * change (0 if nothing has been recorded yet).
+ */
+unsigned
+db_changes_get_cursor(void);
+
+/**
+ * Prints all changes after the given cursor to the client, followed
+ * by the new cursor.
+ *
+ * @return false if records after the cursor have already been dropped
+ * from the journal; the client must re-read the whole database then
+ */
+bool
+db_changes_print(struct client *client, unsigned cursor);
+
+#endif
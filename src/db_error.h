@@ -30,6 +30,11 @@ enum db_error {
 	DB_DISABLED,
 
 	DB_NOT_FOUND,
+
+	/**
+	 * The database is still being loaded; try again later.
+	 */
+	DB_LOADING,
 };
 
 /**
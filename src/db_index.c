@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "db_index.h"
+#include "conf.h"
+#include "locate.h"
+#include "song.h"
+#include "tag.h"
+#include "tag_pool.h"
+
+#include <assert.h>
+#include <string.h>
+
+/**
+ * Maps an interned #tag_item to a #GPtrArray of all songs carrying
+ * that item.  Keys hold a tag_pool reference which is released when
+ * the posting list becomes empty.  All accesses are protected by the
+ * #db_mutex, like the directory tree the index mirrors.
+ */
+static GHashTable *db_index_table;
+
+static gint db_index_configured = -1;
+
+bool
+db_index_enabled(void)
+{
+	if (db_index_configured < 0)
+		db_index_configured = config_get_bool(CONF_DB_INDEX, false);
+
+	return db_index_configured > 0;
+}
+
+static guint
+db_index_item_hash(gconstpointer key)
+{
+	const struct tag_item *item = key;
+
+	return g_str_hash(item->value) ^ (guint)item->type;
+}
+
+static gboolean
+db_index_item_equal(gconstpointer _a, gconstpointer _b)
+{
+	const struct tag_item *a = _a, *b = _b;
+
+	return a->type == b->type && strcmp(a->value, b->value) == 0;
+}
+
+/**
+ * Does the song's tag contain an equal item before position i?  Used
+ * to avoid adding a song twice to the same posting list.
+ */
+static bool
+db_index_seen_before(const struct tag *tag, unsigned i)
+{
+	const struct tag_item *item = tag->items[i];
+
+	for (unsigned k = 0; k < i; ++k)
+		if (db_index_item_equal(tag->items[k], item))
+			return true;
+
+	return false;
+}
+
+void
+db_index_add_song(struct song *song)
+{
+	assert(song != NULL);
+
+	if (!db_index_enabled() || song->tag == NULL)
+		return;
+
+	if (db_index_table == NULL)
+		db_index_table = g_hash_table_new(db_index_item_hash,
+						  db_index_item_equal);
+
+	const struct tag *tag = song->tag;
+	for (unsigned i = 0; i < tag->num_items; ++i) {
+		if (db_index_seen_before(tag, i))
+			continue;
+
+		struct tag_item *item = tag->items[i];
+		GPtrArray *songs = g_hash_table_lookup(db_index_table, item);
+		if (songs == NULL) {
+			songs = g_ptr_array_new();
+			g_hash_table_insert(db_index_table,
+					    tag_pool_dup_item(item), songs);
+		}
+
+		g_ptr_array_add(songs, song);
+	}
+}
+
+void
+db_index_remove_song(struct song *song)
+{
+	assert(song != NULL);
+
+	if (db_index_table == NULL || song->tag == NULL)
+		return;
+
+	const struct tag *tag = song->tag;
+	for (unsigned i = 0; i < tag->num_items; ++i) {
+		if (db_index_seen_before(tag, i))
+			continue;
+
+		struct tag_item *item = tag->items[i];
+		gpointer key, value;
+		if (!g_hash_table_lookup_extended(db_index_table, item,
+						  &key, &value))
+			continue;
+
+		GPtrArray *songs = value;
+		g_ptr_array_remove_fast(songs, song);
+
+		if (songs->len == 0) {
+			g_hash_table_remove(db_index_table, key);
+			g_ptr_array_free(songs, TRUE);
+			tag_pool_put_item(key);
+		}
+	}
+}
+
+bool
+db_index_lookup(const struct locate_item_list *criteria,
+		const GPtrArray **songs_r)
+{
+	static const GPtrArray empty;
+
+	if (db_index_table == NULL)
+		return false;
+
+	/* pick the first exact tag criterion; the caller re-checks
+	   all criteria with locate_song_match(), so any one of them
+	   narrows the candidate set correctly */
+
+	const struct locate_item *found = NULL;
+	for (unsigned i = 0; i < criteria->length; ++i) {
+		const struct locate_item *li = &criteria->items[i];
+		if (li->tag >= 0 && li->tag < TAG_NUM_OF_ITEM_TYPES &&
+		    *li->needle != 0) {
+			found = li;
+			break;
+		}
+	}
+
+	if (found == NULL)
+		/* an empty needle matches songs lacking the tag,
+		   which an inverted index cannot enumerate */
+		return false;
+
+	size_t length = strlen(found->needle);
+	struct tag_item *key = g_malloc(sizeof(*key) - sizeof(key->value) +
+					length + 1);
+	key->type = (enum tag_type)found->tag;
+	memcpy(key->value, found->needle, length + 1);
+
+	const GPtrArray *songs = g_hash_table_lookup(db_index_table, key);
+	g_free(key);
+
+	*songs_r = songs != NULL ? songs : &empty;
+	return true;
+}
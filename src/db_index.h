@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_DB_INDEX_H
+#define MPD_DB_INDEX_H
+
+#include <glib.h>
+
+#include <stdbool.h>
+
+struct song;
+struct locate_item_list;
+
+/**
+ * An optional inverted index (tag value -> songs) over the database,
+ * enabled with the "db_index" configuration setting.  It is kept in
+ * sync by the directory song insert/remove paths and answers exact
+ * "find" queries without a full database walk.
+ */
+
+/**
+ * Is the index enabled in the configuration?
+ */
+bool
+db_index_enabled(void);
+
+/**
+ * Add all tag items of this song to the index.  Caller must lock the
+ * #db_mutex.
+ */
+void
+db_index_add_song(struct song *song);
+
+/**
+ * Remove all tag items of this song from the index.  Must be called
+ * while song->tag is still valid.  Caller must lock the #db_mutex.
+ */
+void
+db_index_remove_song(struct song *song);
+
+/**
+ * Look up the songs matching the first exact tag criterion in the
+ * list.  Returns false if the index cannot answer this query (index
+ * empty/disabled, or no exact tag criterion); the caller must then
+ * fall back to a full walk.  On success, *songs_r points to the
+ * posting list (possibly empty), which remains owned by the index;
+ * the caller must hold the #db_mutex while using it and check the
+ * remaining criteria with locate_song_match().
+ */
+bool
+db_index_lookup(const struct locate_item_list *criteria,
+		const GPtrArray **songs_r);
+
+#endif
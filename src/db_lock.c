@@ -20,8 +20,10 @@
 #include "config.h"
 #include "db_lock.h"
 
-GStaticMutex db_mutex = G_STATIC_MUTEX_INIT;
+GStaticRWLock db_rwlock = G_STATIC_RW_LOCK_INIT;
 
 #ifndef NDEBUG
 GThread *db_mutex_holder;
+
+GStaticPrivate db_reader_depth = G_STATIC_PRIVATE_INIT;
 #endif
@@ -32,14 +32,17 @@
 #include <assert.h>
 #include <stdbool.h>
 
-extern GStaticMutex db_mutex;
+extern GStaticRWLock db_rwlock;
 
 #ifndef NDEBUG
 
 extern GThread *db_mutex_holder;
 
+/** per-thread count of shared (reader) locks held */
+extern GStaticPrivate db_reader_depth;
+
 /**
- * Does the current thread hold the database lock?
+ * Does the current thread hold the database lock exclusively?
  */
 G_GNUC_PURE
 static inline bool
@@ -48,18 +51,32 @@ holding_db_lock(void)
 	return db_mutex_holder == g_thread_self();
 }
 
+/**
+ * May the current thread read database structures, i.e. does it hold
+ * either the shared or the exclusive lock?
+ */
+static inline bool
+holding_db_read_lock(void)
+{
+	return GPOINTER_TO_INT(g_static_private_get(&db_reader_depth)) > 0 ||
+		holding_db_lock();
+}
+
 #endif
 
 /**
- * Obtain the global database lock.  This is needed before
- * dereferencing a #song or #directory.  It is not recursive.
+ * Obtain the global database lock exclusively.  This is needed
+ * before modifying a #song or #directory.  It is not recursive.
+ *
+ * GLib's rwlock prefers waiting writers, so the update thread is not
+ * starved by a steady stream of readers.
  */
 static inline void
 db_lock(void)
 {
-	assert(!holding_db_lock());
+	assert(!holding_db_read_lock());
 
-	g_static_mutex_lock(&db_mutex);
+	g_static_rw_lock_writer_lock(&db_rwlock);
 
 	assert(db_mutex_holder == NULL);
 #ifndef NDEBUG
@@ -68,7 +85,7 @@ db_lock(void)
 }
 
 /**
- * Release the global database lock.
+ * Release the exclusive database lock.
  */
 static inline void
 db_unlock(void)
@@ -78,7 +95,46 @@ db_unlock(void)
 	db_mutex_holder = NULL;
 #endif
 
-	g_static_mutex_unlock(&db_mutex);
+	g_static_rw_lock_writer_unlock(&db_rwlock);
+}
+
+/**
+ * Obtain the database lock shared with other readers.  Sufficient
+ * for dereferencing #song and #directory objects without modifying
+ * them; searches and listings from several clients proceed
+ * concurrently, and only the update thread's actual write windows
+ * exclude them.  Not recursive.
+ */
+static inline void
+db_read_lock(void)
+{
+	assert(!holding_db_read_lock());
+
+	g_static_rw_lock_reader_lock(&db_rwlock);
+
+#ifndef NDEBUG
+	g_static_private_set(&db_reader_depth,
+			     GINT_TO_POINTER(GPOINTER_TO_INT(g_static_private_get(&db_reader_depth)) + 1),
+			     NULL);
+#endif
+}
+
+/**
+ * Release the shared database lock.
+ */
+static inline void
+db_read_unlock(void)
+{
+	assert(holding_db_read_lock());
+	assert(!holding_db_lock());
+
+#ifndef NDEBUG
+	g_static_private_set(&db_reader_depth,
+			     GINT_TO_POINTER(GPOINTER_TO_INT(g_static_private_get(&db_reader_depth)) - 1),
+			     NULL);
+#endif
+
+	g_static_rw_lock_reader_unlock(&db_rwlock);
 }
 
 #endif
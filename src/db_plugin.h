@@ -70,6 +70,15 @@ struct db_plugin {
 	struct song *(*get_song)(struct db *db, const char *uri,
 				 GError **error_r);
 
+	/**
+	 * Look up multiple songs at a time (optional method).  NULL
+	 * entries in #uris are skipped; one song pointer (or NULL) is
+	 * stored per URI.  Allows the implementation to amortize
+	 * locking and path traversal over the whole batch.
+	 */
+	void (*get_songs)(struct db *db, const char *const uris[],
+			  unsigned n, struct song **songs_r);
+
 	/**
 	 * Visit the selected entities.
 	 */
@@ -139,6 +148,25 @@ db_plugin_get_song(struct db *db, const char *uri, GError **error_r)
 	return db->plugin->get_song(db, uri, error_r);
 }
 
+static inline void
+db_plugin_get_songs(struct db *db, const char *const uris[], unsigned n,
+		    struct song **songs_r)
+{
+	assert(db != NULL);
+	assert(db->plugin != NULL);
+
+	if (db->plugin->get_songs != NULL) {
+		db->plugin->get_songs(db, uris, n, songs_r);
+		return;
+	}
+
+	/* fallback: one lookup per URI */
+	for (unsigned i = 0; i < n; ++i)
+		songs_r[i] = uris[i] != NULL
+			? db_plugin_get_song(db, uris[i], NULL)
+			: NULL;
+}
+
 static inline bool
 db_plugin_visit(struct db *db, const struct db_selection *selection,
 		const struct db_visitor *visitor, void *ctx,
@@ -24,12 +24,18 @@
 #include "locate.h"
 #include "directory.h"
 #include "database.h"
+#include "db_index.h"
+#include "db_lock.h"
 #include "client.h"
+#include "client_binary.h"
 #include "song.h"
 #include "song_print.h"
+#include "search_cache.h"
+#include "listall_cache.h"
 #include "playlist_vector.h"
 #include "tag.h"
 #include "strset.h"
+#include "conf.h"
 
 #include <glib.h>
 
@@ -44,14 +50,74 @@ typedef struct _SearchStats {
 	unsigned long playTime;
 } SearchStats;
 
+/**
+ * The context for the print visitors: the client, and the position of
+ * the walk within the selection's window.
+ */
+struct print_data {
+	struct client *client;
+
+	/** the window copied from the #db_selection */
+	unsigned window_start, window_end;
+
+	/** the index of the next entity, in walk order */
+	unsigned position;
+};
+
+/**
+ * Decides what to do with the next entity, and advances the position:
+ * print it (inside the window), skip it silently (before the window)
+ * or abort the walk (past the window).  Aborting is done by returning
+ * false from the visitor without setting the #GError, which
+ * db_selection_print() translates back to success.
+ */
+enum print_window {
+	PRINT_SKIP,
+	PRINT_OK,
+	PRINT_STOP,
+};
+
+static enum print_window
+print_data_window(struct print_data *data)
+{
+	unsigned i = data->position++;
+
+	if (i >= data->window_end)
+		return PRINT_STOP;
+
+	return i >= data->window_start
+		? PRINT_OK
+		: PRINT_SKIP;
+}
+
 static bool
-print_visitor_directory(const struct directory *directory, void *data,
+print_visitor_directory(const struct directory *directory, void *ctx,
 			G_GNUC_UNUSED GError **error_r)
 {
-	struct client *client = data;
+	struct print_data *data = ctx;
 
-	if (!directory_is_root(directory))
-		client_printf(client, "directory: %s\n", directory_get_path(directory));
+	if (directory_is_root(directory))
+		/* the root is never printed and does not occupy a
+		   window position */
+		return true;
+
+	switch (print_data_window(data)) {
+	case PRINT_SKIP:
+		return true;
+
+	case PRINT_STOP:
+		return false;
+
+	case PRINT_OK:
+		break;
+	}
+
+	if (client_binary_enabled(data->client))
+		client_binary_pair(data->client, "directory",
+				   directory_get_path(directory));
+	else
+		client_printf(data->client, "directory: %s\n",
+			      directory_get_path(directory));
 
 	return true;
 }
@@ -61,7 +127,16 @@ print_playlist_in_directory(struct client *client,
 			    const struct directory *directory,
 			    const char *name_utf8)
 {
-	if (directory_is_root(directory))
+	if (client_binary_enabled(client)) {
+		if (directory_is_root(directory))
+			client_binary_pair(client, "playlist", name_utf8);
+		else {
+			char *path = g_strconcat(directory_get_path(directory),
+						 "/", name_utf8, NULL);
+			client_binary_pair(client, "playlist", path);
+			g_free(path);
+		}
+	} else if (directory_is_root(directory))
 		client_printf(client, "playlist: %s\n", name_utf8);
 	else
 		client_printf(client, "playlist: %s/%s\n",
@@ -69,36 +144,60 @@ print_playlist_in_directory(struct client *client,
 }
 
 static bool
-print_visitor_song(struct song *song, void *data,
+print_visitor_song(struct song *song, void *ctx,
 		   G_GNUC_UNUSED GError **error_r)
 {
 	assert(song != NULL);
 	assert(song->parent != NULL);
 
-	struct client *client = data;
-	song_print_uri(client, song);
+	struct print_data *data = ctx;
+
+	switch (print_data_window(data)) {
+	case PRINT_SKIP:
+		return true;
+
+	case PRINT_STOP:
+		return false;
+
+	case PRINT_OK:
+		break;
+	}
+
+	song_print_uri(data->client, song);
 
 	if (song->tag != NULL && song->tag->has_playlist)
 		/* this song file has an embedded CUE sheet */
-		print_playlist_in_directory(client, song->parent,
+		print_playlist_in_directory(data->client, song->parent,
 					    song->uri);
 
 	return true;
 }
 
 static bool
-print_visitor_song_info(struct song *song, void *data,
+print_visitor_song_info(struct song *song, void *ctx,
 			G_GNUC_UNUSED GError **error_r)
 {
 	assert(song != NULL);
 	assert(song->parent != NULL);
 
-	struct client *client = data;
-	song_print_info(client, song);
+	struct print_data *data = ctx;
+
+	switch (print_data_window(data)) {
+	case PRINT_SKIP:
+		return true;
+
+	case PRINT_STOP:
+		return false;
+
+	case PRINT_OK:
+		break;
+	}
+
+	song_print_info(data->client, song);
 
 	if (song->tag != NULL && song->tag->has_playlist)
 		/* this song file has an embedded CUE sheet */
-		print_playlist_in_directory(client, song->parent,
+		print_playlist_in_directory(data->client, song->parent,
 					    song->uri);
 
 	return true;
@@ -109,8 +208,20 @@ print_visitor_playlist(const struct playlist_metadata *playlist,
 		       const struct directory *directory, void *ctx,
 		       G_GNUC_UNUSED GError **error_r)
 {
-	struct client *client = ctx;
-	print_playlist_in_directory(client, directory, playlist->name);
+	struct print_data *data = ctx;
+
+	switch (print_data_window(data)) {
+	case PRINT_SKIP:
+		return true;
+
+	case PRINT_STOP:
+		return false;
+
+	case PRINT_OK:
+		break;
+	}
+
+	print_playlist_in_directory(data->client, directory, playlist->name);
 	return true;
 }
 
@@ -119,7 +230,20 @@ print_visitor_playlist_info(const struct playlist_metadata *playlist,
 			    const struct directory *directory,
 			    void *ctx, G_GNUC_UNUSED GError **error_r)
 {
-	struct client *client = ctx;
+	struct print_data *data = ctx;
+
+	switch (print_data_window(data)) {
+	case PRINT_SKIP:
+		return true;
+
+	case PRINT_STOP:
+		return false;
+
+	case PRINT_OK:
+		break;
+	}
+
+	struct client *client = data->client;
 	print_playlist_in_directory(client, directory, playlist->name);
 
 #ifndef G_OS_WIN32
@@ -136,7 +260,10 @@ print_visitor_playlist_info(const struct playlist_metadata *playlist,
 		 gmtime_r(&t, &tm)
 #endif
 		 );
-	client_printf(client, "Last-Modified: %s\n", timestamp);
+	if (client_binary_enabled(client))
+		client_binary_pair(client, "Last-Modified", timestamp);
+	else
+		client_printf(client, "Last-Modified: %s\n", timestamp);
 
 	return true;
 }
@@ -157,24 +284,495 @@ bool
 db_selection_print(struct client *client, const struct db_selection *selection,
 		   bool full, GError **error_r)
 {
-	return db_visit(selection, full ? &print_info_visitor : &print_visitor,
-			client, error_r);
+	struct print_data data = {
+		.client = client,
+		.window_start = selection->window_start,
+		.window_end = selection->window_end,
+		.position = 0,
+	};
+
+	GError *error = NULL;
+	if (db_visit(selection, full ? &print_info_visitor : &print_visitor,
+		     &data, &error))
+		return true;
+
+	if (error == NULL)
+		/* a visitor has aborted the walk because the end of
+		   the window was reached; not an error */
+		return true;
+
+	g_propagate_error(error_r, error);
+	return false;
 }
 
 struct search_data {
 	struct client *client;
 	const struct locate_item_list *criteria;
+
+	/** the number of songs which may still be printed;
+	    #G_MAXUINT = unlimited */
+	unsigned remaining;
+
+	/** collect the matches here to seed the client's search
+	    cache; NULL when the query is not cacheable */
+	GPtrArray *collect;
+};
+
+typedef bool (*song_match_t)(const struct song *song,
+			     const struct locate_item_list *criteria);
+
+bool
+song_sort_parse_key(struct song_sort *sort, const char *name)
+{
+	if (*name == '-') {
+		sort->descending = true;
+		++name;
+	}
+
+	if (g_ascii_strcasecmp(name, "mtime") == 0) {
+		sort->key = SONG_SORT_MTIME;
+		return true;
+	}
+
+	if (g_ascii_strcasecmp(name, "duration") == 0 ||
+	    g_ascii_strcasecmp(name, "time") == 0) {
+		sort->key = SONG_SORT_DURATION;
+		return true;
+	}
+
+	int tag = locate_parse_type(name);
+	if (tag < 0 || tag == LOCATE_TAG_FILE_TYPE ||
+	    tag == LOCATE_TAG_ANY_TYPE)
+		return false;
+
+	sort->key = SONG_SORT_TAG;
+	sort->tag = tag;
+	return true;
+}
+
+static const char *
+song_sort_tag_value(const struct song *song, enum tag_type type)
+{
+	return song->tag != NULL
+		? tag_get_value(song->tag, type)
+		: NULL;
+}
+
+/**
+ * Compare two tag values; either one may be NULL (missing values sort
+ * first).
+ */
+static int
+song_sort_compare_string(const char *a, const char *b)
+{
+	if (a == NULL)
+		return b == NULL ? 0 : -1;
+
+	if (b == NULL)
+		return 1;
+
+	return g_utf8_collate(a, b);
+}
+
+static int
+song_sort_compare(const struct song_sort *sort,
+		  const struct song *a, const struct song *b)
+{
+	int result = 0;
+
+	switch (sort->key) {
+	case SONG_SORT_NONE:
+		break;
+
+	case SONG_SORT_TAG:
+		result = song_sort_compare_string(song_sort_tag_value(a, sort->tag),
+						  song_sort_tag_value(b, sort->tag));
+		break;
+
+	case SONG_SORT_MTIME:
+		result = a->mtime < b->mtime
+			? -1
+			: a->mtime > b->mtime;
+		break;
+
+	case SONG_SORT_DURATION:
+		result = (int)song_get_duration(a) -
+			(int)song_get_duration(b);
+		break;
+	}
+
+	if (sort->descending)
+		result = -result;
+
+	if (result == 0)
+		/* break ties by file name, so repeated queries return
+		   a stable order */
+		result = strcmp(a->uri, b->uri);
+
+	return result;
+}
+
+/**
+ * Collects the best matches in a binary max-heap: the "worst" kept
+ * song according to the sort specification sits at the root.  With a
+ * limit, the heap is bounded to that many entries - a new match
+ * either replaces the root or is dropped right away, so ranking a
+ * huge library needs memory proportional to the page size, not to the
+ * number of matches.
+ */
+struct song_ranking {
+	const struct song_sort *sort;
+	const struct locate_item_list *criteria;
+
+	song_match_t match;
+
+	/** the heap, in array representation */
+	GPtrArray *songs;
+};
+
+static void
+song_ranking_sift_down(struct song_ranking *ranking, unsigned i, unsigned n)
+{
+	GPtrArray *songs = ranking->songs;
+
+	while (true) {
+		unsigned child = 2 * i + 1;
+		if (child >= n)
+			break;
+
+		if (child + 1 < n &&
+		    song_sort_compare(ranking->sort,
+				      g_ptr_array_index(songs, child + 1),
+				      g_ptr_array_index(songs, child)) > 0)
+			++child;
+
+		if (song_sort_compare(ranking->sort,
+				      g_ptr_array_index(songs, child),
+				      g_ptr_array_index(songs, i)) <= 0)
+			break;
+
+		void *tmp = g_ptr_array_index(songs, i);
+		g_ptr_array_index(songs, i) = g_ptr_array_index(songs, child);
+		g_ptr_array_index(songs, child) = tmp;
+		i = child;
+	}
+}
+
+static void
+song_ranking_add(struct song_ranking *ranking, struct song *song)
+{
+	GPtrArray *songs = ranking->songs;
+	const unsigned limit = ranking->sort->limit;
+
+	if (limit == 0 || songs->len < limit) {
+		/* grow the heap: append and sift up */
+		g_ptr_array_add(songs, song);
+
+		unsigned i = songs->len - 1;
+		while (i > 0) {
+			unsigned parent = (i - 1) / 2;
+			if (song_sort_compare(ranking->sort, song,
+					      g_ptr_array_index(songs, parent)) <= 0)
+				break;
+
+			g_ptr_array_index(songs, i) =
+				g_ptr_array_index(songs, parent);
+			g_ptr_array_index(songs, parent) = song;
+			i = parent;
+		}
+
+		return;
+	}
+
+	if (song_sort_compare(ranking->sort, song,
+			      g_ptr_array_index(songs, 0)) >= 0)
+		/* not better than the worst kept song */
+		return;
+
+	/* replace the root and restore the heap property */
+	g_ptr_array_index(songs, 0) = song;
+	song_ranking_sift_down(ranking, 0, songs->len);
+}
+
+static bool
+ranking_visitor_song(struct song *song, void *ctx,
+		     G_GNUC_UNUSED GError **error_r)
+{
+	struct song_ranking *ranking = ctx;
+
+	if (ranking->match(song, ranking->criteria))
+		song_ranking_add(ranking, song);
+
+	return true;
+}
+
+static const struct db_visitor ranking_visitor = {
+	.song = ranking_visitor_song,
+};
+
+/**
+ * Sorts the heap in place (plain heap sort: the root is the greatest
+ * element) and prints the songs in ascending order.
+ */
+static void
+song_ranking_print(struct client *client, struct song_ranking *ranking)
+{
+	GPtrArray *songs = ranking->songs;
+
+	for (unsigned n = songs->len; n > 1; --n) {
+		void *tmp = g_ptr_array_index(songs, 0);
+		g_ptr_array_index(songs, 0) =
+			g_ptr_array_index(songs, n - 1);
+		g_ptr_array_index(songs, n - 1) = tmp;
+
+		song_ranking_sift_down(ranking, 0, n - 1);
+	}
+
+	for (unsigned i = 0; i < songs->len; ++i)
+		song_print_info(client, g_ptr_array_index(songs, i));
+}
+
+/**
+ * Runs a ranked query: all matches below the given directory are fed
+ * into a bounded heap, and the best ones are printed in sort order.
+ */
+static bool
+ranked_songs_in(struct client *client, const char *name,
+		song_match_t match,
+		const struct locate_item_list *criteria,
+		const struct song_sort *sort,
+		GError **error_r)
+{
+	struct song_ranking ranking = {
+		.sort = sort,
+		.criteria = criteria,
+		.match = match,
+		.songs = g_ptr_array_new(),
+	};
+
+	if (!db_walk(name, &ranking_visitor, &ranking, error_r)) {
+		g_ptr_array_free(ranking.songs, true);
+		return false;
+	}
+
+	song_ranking_print(client, &ranking);
+	g_ptr_array_free(ranking.songs, true);
+	return true;
+}
+
+/**
+ * The number of worker threads for whole-database search/find scans;
+ * values below 2 disable the parallel code path.
+ */
+static unsigned
+search_num_threads(void)
+{
+	static unsigned configured;
+
+	if (configured == 0) {
+		configured = config_get_unsigned(CONF_SEARCH_THREADS, 1);
+		if (configured < 1)
+			configured = 1;
+	}
+
+	return configured;
+}
+
+/**
+ * One unit of work for the parallel scan: a subtree, and the ordered
+ * list of matches found in it.
+ */
+struct search_shard {
+	struct directory *directory;
+
+	/** collect only this directory's own songs, without
+	    recursing?  (used for the partition root, whose children
+	    are shards of their own) */
+	bool songs_only;
+
+	/** matching songs, in walk order */
+	GPtrArray *matches;
+};
+
+struct parallel_search {
+	song_match_t match;
+	const struct locate_item_list *criteria;
+
+	struct search_shard *shards;
+	unsigned num_shards;
+
+	/** the index of the next shard to be claimed; workers
+	    advance it with atomic operations */
+	volatile gint next_shard;
 };
 
+static void
+search_shard_collect(const struct parallel_search *ps,
+		     struct directory *directory, bool songs_only,
+		     GPtrArray *matches)
+{
+	struct song *song;
+	directory_for_each_song(song, directory)
+		if (ps->match(song, ps->criteria))
+			g_ptr_array_add(matches, song);
+
+	if (songs_only)
+		return;
+
+	struct directory *child;
+	directory_for_each_child(child, directory)
+		search_shard_collect(ps, child, false, matches);
+}
+
+static gpointer
+search_worker(gpointer data)
+{
+	struct parallel_search *ps = data;
+	gint i;
+
+	/* claim shards one at a time, so a worker which got a small
+	   subtree picks up more work instead of idling */
+	while ((i = g_atomic_int_exchange_and_add(&ps->next_shard, 1)) <
+	       (gint)ps->num_shards) {
+		struct search_shard *shard = &ps->shards[i];
+		search_shard_collect(ps, shard->directory,
+				     shard->songs_only, shard->matches);
+	}
+
+	return NULL;
+}
+
+/**
+ * Runs the match predicate over all songs below the given directory
+ * using several worker threads: the top-level directories are
+ * partitioned across the pool, the predicates run concurrently, and
+ * the merged results are printed in walk order by the calling
+ * thread, which is the only one to touch the client.
+ *
+ * The calling thread holds the shared database lock for the whole
+ * scan, which keeps writers out of the tree; the workers therefore
+ * read it without locking, and other readers are not blocked.
+ *
+ * @param limit the maximum number of songs to print; #G_MAXUINT =
+ * unlimited
+ * @param collect if not NULL, all printed songs are appended here,
+ * to seed the client's search cache
+ * @return true if the parallel path handled the query
+ */
+static bool
+search_songs_parallel(struct client *client, const char *name,
+		      song_match_t match,
+		      const struct locate_item_list *criteria,
+		      unsigned limit, GPtrArray *collect)
+{
+	unsigned num_threads = search_num_threads();
+	if (num_threads < 2)
+		return false;
+
+	struct directory *root =
+		db_get_directory(*name == 0 ? NULL : name);
+	if (root == NULL)
+		return false;
+
+	db_read_lock();
+
+	/* partition: one shard per top-level directory, plus one for
+	   the songs directly inside the root */
+	unsigned num_shards = 1;
+	struct directory *child;
+	directory_for_each_child(child, root)
+		++num_shards;
+
+	if (num_shards < 3) {
+		/* not enough top-level directories to win anything */
+		db_read_unlock();
+		return false;
+	}
+
+	struct parallel_search ps = {
+		.match = match,
+		.criteria = criteria,
+		.num_shards = num_shards,
+		.next_shard = 0,
+	};
+
+	ps.shards = g_new(struct search_shard, num_shards);
+	ps.shards[0].directory = root;
+	ps.shards[0].songs_only = true;
+
+	unsigned i = 1;
+	directory_for_each_child(child, root) {
+		ps.shards[i].directory = child;
+		ps.shards[i].songs_only = false;
+		++i;
+	}
+
+	for (i = 0; i < num_shards; ++i)
+		ps.shards[i].matches = g_ptr_array_new();
+
+	if (num_threads > num_shards)
+		num_threads = num_shards;
+
+	GThread **threads = g_new(GThread *, num_threads - 1);
+	for (i = 0; i < num_threads - 1; ++i)
+		/* if this fails, the remaining shards are simply
+		   picked up by the other workers */
+		threads[i] = g_thread_create(search_worker, &ps, true, NULL);
+
+	/* the calling thread is the last worker */
+	search_worker(&ps);
+
+	for (i = 0; i < num_threads - 1; ++i)
+		if (threads[i] != NULL)
+			g_thread_join(threads[i]);
+
+	g_free(threads);
+
+	/* print the merged results in walk order; the database lock
+	   is still held, so the song pointers remain valid */
+	unsigned printed = 0;
+	for (i = 0; i < num_shards; ++i) {
+		GPtrArray *matches = ps.shards[i].matches;
+
+		for (unsigned j = 0;
+		     j < matches->len && printed < limit; ++j) {
+			struct song *song = g_ptr_array_index(matches, j);
+
+			song_print_info(client, song);
+
+			if (collect != NULL)
+				g_ptr_array_add(collect, song);
+
+			++printed;
+		}
+
+		g_ptr_array_free(matches, true);
+	}
+
+	db_read_unlock();
+	g_free(ps.shards);
+	return true;
+}
+
 static bool
 search_visitor_song(struct song *song, void *_data,
 		    G_GNUC_UNUSED GError **error_r)
 {
 	struct search_data *data = _data;
 
-	if (locate_song_search(song, data->criteria))
+	if (locate_song_search(song, data->criteria)) {
 		song_print_info(data->client, song);
 
+		if (data->collect != NULL)
+			g_ptr_array_add(data->collect, song);
+
+		if (data->remaining != G_MAXUINT &&
+		    --data->remaining == 0)
+			/* the limit was reached: abort the walk,
+			   without setting the GError */
+			return false;
+	}
+
 	return true;
 }
 
@@ -185,16 +783,69 @@ static const struct db_visitor search_visitor = {
 bool
 searchForSongsIn(struct client *client, const char *name,
 		 const struct locate_item_list *criteria,
+		 const struct song_sort *sort,
 		 GError **error_r)
 {
 	struct locate_item_list *new_list
 		= locate_item_list_casefold(criteria);
-	struct search_data data;
+	bool success;
+
+	if (sort != NULL && sort->key != SONG_SORT_NONE) {
+		success = ranked_songs_in(client, name, locate_song_search,
+					  new_list, sort, error_r);
+		locate_item_list_free(new_list);
+		return success;
+	}
+
+	const unsigned limit = sort != NULL && sort->limit > 0
+		? sort->limit
+		: G_MAXUINT;
 
-	data.client = client;
-	data.criteria = new_list;
+	/* incremental search: complete, unlimited result sets over
+	   the simple database (whose song pointers are long-lived)
+	   are cached per client, and a refinement query is answered
+	   from the cached set */
+	const bool cacheable = limit == G_MAXUINT && db_is_simple();
 
-	bool success = db_walk(name, &search_visitor, &data, error_r);
+	if (cacheable && search_cache_refine(client, name, new_list)) {
+		locate_item_list_free(new_list);
+		return true;
+	}
+
+	GPtrArray *collect = cacheable ? g_ptr_array_new() : NULL;
+
+	struct search_data data = {
+		.client = client,
+		.criteria = new_list,
+		.remaining = limit,
+		.collect = collect,
+	};
+
+	if (search_songs_parallel(client, name, locate_song_search,
+				  new_list, limit, collect)) {
+		if (collect != NULL)
+			search_cache_store(client, name, new_list, collect);
+		locate_item_list_free(new_list);
+		return true;
+	}
+
+	GError *error = NULL;
+	success = db_walk(name, &search_visitor, &data, &error);
+	if (!success) {
+		if (error == NULL)
+			/* the visitor aborted the walk because the
+			   limit was reached; not an error */
+			success = true;
+		else
+			g_propagate_error(error_r, error);
+	}
+
+	if (collect != NULL) {
+		if (success)
+			search_cache_store(client, name, new_list, collect);
+		else
+			g_ptr_array_free(collect, true);
+	}
 
 	locate_item_list_free(new_list);
 
@@ -207,9 +858,16 @@ find_visitor_song(struct song *song, void *_data,
 {
 	struct search_data *data = _data;
 
-	if (locate_song_match(song, data->criteria))
+	if (locate_song_match(song, data->criteria)) {
 		song_print_info(data->client, song);
 
+		if (data->remaining != G_MAXUINT &&
+		    --data->remaining == 0)
+			/* the limit was reached: abort the walk,
+			   without setting the GError */
+			return false;
+	}
+
 	return true;
 }
 
@@ -220,14 +878,94 @@ static const struct db_visitor find_visitor = {
 bool
 findSongsIn(struct client *client, const char *name,
 	    const struct locate_item_list *criteria,
+	    const struct song_sort *sort,
 	    GError **error_r)
 {
-	struct search_data data;
+	if (sort != NULL && sort->key != SONG_SORT_NONE) {
+		if (*name == 0) {
+			/* rank the candidates from the inverted
+			   index, if there is one for this query */
+			const GPtrArray *songs;
+
+			db_read_lock();
+			if (db_index_lookup(criteria, &songs)) {
+				struct song_ranking ranking = {
+					.sort = sort,
+					.criteria = criteria,
+					.match = locate_song_match,
+					.songs = g_ptr_array_new(),
+				};
+
+				for (unsigned i = 0; i < songs->len; ++i) {
+					struct song *song =
+						g_ptr_array_index(songs, i);
+					if (locate_song_match(song, criteria))
+						song_ranking_add(&ranking,
+								 song);
+				}
+
+				song_ranking_print(client, &ranking);
+				g_ptr_array_free(ranking.songs, true);
+				db_read_unlock();
+				return true;
+			}
+			db_read_unlock();
+		}
+
+		return ranked_songs_in(client, name, locate_song_match,
+				       criteria, sort, error_r);
+	}
 
-	data.client = client;
-	data.criteria = criteria;
+	const unsigned limit = sort != NULL && sort->limit > 0
+		? sort->limit
+		: G_MAXUINT;
+
+	if (*name == 0) {
+		/* whole-database query: try the inverted index
+		   before falling back to a full walk */
+		const GPtrArray *songs;
+
+		db_read_lock();
+		if (db_index_lookup(criteria, &songs)) {
+			unsigned printed = 0;
+
+			for (unsigned i = 0;
+			     i < songs->len && printed < limit; ++i) {
+				struct song *song =
+					g_ptr_array_index(songs, i);
+				if (locate_song_match(song, criteria)) {
+					song_print_info(client, song);
+					++printed;
+				}
+			}
+
+			db_read_unlock();
+			return true;
+		}
+		db_read_unlock();
+	}
+
+	if (search_songs_parallel(client, name, locate_song_match,
+				  criteria, limit, NULL))
+		return true;
+
+	struct search_data data = {
+		.client = client,
+		.criteria = criteria,
+		.remaining = limit,
+	};
 
-	return db_walk(name, &find_visitor, &data, error_r);
+	GError *error = NULL;
+	if (db_walk(name, &find_visitor, &data, &error))
+		return true;
+
+	if (error == NULL)
+		/* the visitor aborted the walk because the limit was
+		   reached; not an error */
+		return true;
+
+	g_propagate_error(error_r, error);
+	return false;
 }
 
 static void printSearchStats(struct client *client, SearchStats *stats)
@@ -265,6 +1003,28 @@ searchStatsForSongsIn(struct client *client, const char *name,
 	stats.numberOfSongs = 0;
 	stats.playTime = 0;
 
+	if (*name == 0) {
+		const GPtrArray *songs;
+
+		db_read_lock();
+		if (db_index_lookup(criteria, &songs)) {
+			for (unsigned i = 0; i < songs->len; ++i) {
+				struct song *song =
+					g_ptr_array_index(songs, i);
+				if (locate_song_match(song, criteria)) {
+					stats.numberOfSongs++;
+					stats.playTime +=
+						song_get_duration(song);
+				}
+			}
+
+			db_read_unlock();
+			printSearchStats(client, &stats);
+			return true;
+		}
+		db_read_unlock();
+	}
+
 	if (!db_walk(name, &stats_visitor, &stats, error_r))
 		return false;
 
@@ -272,9 +1032,101 @@ searchStatsForSongsIn(struct client *client, const char *name,
 	return true;
 }
 
+/**
+ * Serializes one "name: value\n" line into the listall cache
+ * builder; the value is "dir_path/base" when dir_path is not NULL.
+ */
+static void
+listall_build_pair(struct listall_builder *builder, const char *name,
+		   const char *dir_path, const char *base)
+{
+	listall_cache_write(builder, name, strlen(name));
+	listall_cache_write(builder, ": ", 2);
+
+	if (dir_path != NULL) {
+		listall_cache_write(builder, dir_path, strlen(dir_path));
+		listall_cache_write(builder, "/", 1);
+	}
+
+	listall_cache_write(builder, base, strlen(base));
+	listall_cache_write(builder, "\n", 1);
+}
+
+static bool
+listall_build_visitor_directory(const struct directory *directory, void *ctx,
+				G_GNUC_UNUSED GError **error_r)
+{
+	struct listall_builder *builder = ctx;
+
+	if (!directory_is_root(directory))
+		listall_build_pair(builder, "directory", NULL,
+				   directory_get_path(directory));
+
+	return true;
+}
+
+static bool
+listall_build_visitor_song(struct song *song, void *ctx,
+			   G_GNUC_UNUSED GError **error_r)
+{
+	struct listall_builder *builder = ctx;
+	const char *dir_path = song->parent != NULL &&
+		!directory_is_root(song->parent)
+		? directory_get_path(song->parent)
+		: NULL;
+
+	listall_build_pair(builder, "file", dir_path, song->uri);
+
+	if (song->tag != NULL && song->tag->has_playlist)
+		/* this song file has an embedded CUE sheet */
+		listall_build_pair(builder, "playlist", dir_path, song->uri);
+
+	return true;
+}
+
+static bool
+listall_build_visitor_playlist(const struct playlist_metadata *playlist,
+			       const struct directory *directory, void *ctx,
+			       G_GNUC_UNUSED GError **error_r)
+{
+	struct listall_builder *builder = ctx;
+
+	listall_build_pair(builder, "playlist",
+			   directory_is_root(directory)
+			   ? NULL : directory_get_path(directory),
+			   playlist->name);
+
+	return true;
+}
+
+static const struct db_visitor listall_build_visitor = {
+	.directory = listall_build_visitor_directory,
+	.song = listall_build_visitor_song,
+	.playlist = listall_build_visitor_playlist,
+};
+
 bool
 printAllIn(struct client *client, const char *uri_utf8, GError **error_r)
 {
+	if (*uri_utf8 == 0 && db_is_simple() &&
+	    !client_binary_enabled(client)) {
+		/* the full "listall" output only changes with the
+		   database; serve the cached serialization, or
+		   rebuild it while answering this query */
+		if (listall_cache_print(client))
+			return true;
+
+		struct listall_builder *builder = listall_cache_begin();
+
+		if (db_walk("", &listall_build_visitor, builder, error_r)) {
+			listall_cache_commit_print(builder, client);
+			return true;
+		}
+
+		listall_cache_abort(builder);
+		return false;
+	}
+
 	struct db_selection selection;
 	db_selection_init(&selection, uri_utf8, true);
 	return db_selection_print(client, &selection, false, error_r);
@@ -305,6 +1157,68 @@ static void freeListCommandItem(ListCommandItem * item)
 	g_free(item);
 }
 
+/**
+ * Materialized results of "list <tag>" commands without conditionals,
+ * one slot per tag type.  A slot is only served while its version
+ * matches db_get_version(), so any database change (load, update)
+ * invalidates it implicitly; the next "list" command rebuilds it.
+ * Repeat queries are thus O(result) instead of a walk over the whole
+ * library.  Only touched in the main thread.
+ */
+struct list_tags_cache {
+	/** the database version the values were collected from;
+	    0 = empty slot */
+	unsigned version;
+
+	/** the unique values (g_strdup'ed), in strset iteration
+	    order */
+	GPtrArray *values;
+};
+
+static struct list_tags_cache list_tags_cache[TAG_NUM_OF_ITEM_TYPES];
+
+static void
+list_tags_cache_clear(struct list_tags_cache *cache)
+{
+	if (cache->values == NULL)
+		return;
+
+	for (unsigned i = 0; i < cache->values->len; ++i)
+		g_free(g_ptr_array_index(cache->values, i));
+
+	g_ptr_array_free(cache->values, true);
+	cache->values = NULL;
+	cache->version = 0;
+}
+
+/**
+ * Prints the cached "list" result for the given tag type, if there
+ * is a fresh one.
+ *
+ * @return true if the cache was fresh and has been printed
+ */
+static bool
+list_tags_print_cached(struct client *client, enum tag_type type)
+{
+	const struct list_tags_cache *cache = &list_tags_cache[type];
+
+	if (cache->values == NULL || cache->version != db_get_version())
+		return false;
+
+	for (unsigned i = 0; i < cache->values->len; ++i) {
+		const char *value = g_ptr_array_index(cache->values, i);
+
+		if (client_binary_enabled(client))
+			client_binary_pair(client, tag_item_names[type],
+					   value);
+		else
+			client_printf(client, "%s: %s\n",
+				      tag_item_names[type], value);
+	}
+
+	return true;
+}
+
 static void
 visitTag(struct client *client, struct strset *set,
 	 struct song *song, enum tag_type tagType)
@@ -359,6 +1273,13 @@ listAllUniqueTags(struct client *client, int type,
 		  const struct locate_item_list *criteria,
 		  GError **error_r)
 {
+	/* cacheable: plain "list <tag>" without conditionals */
+	bool cacheable = type >= 0 && type < TAG_NUM_OF_ITEM_TYPES &&
+		criteria->length == 0;
+
+	if (cacheable && list_tags_print_cached(client, type))
+		return true;
+
 	ListCommandItem *item = newListCommandItem(type, criteria);
 	struct list_tags_data data = {
 		.client = client,
@@ -370,19 +1291,42 @@ listAllUniqueTags(struct client *client, int type,
 	}
 
 	if (!db_walk("", &unique_tags_visitor, &data, error_r)) {
+		if (type >= 0 && type <= TAG_NUM_OF_ITEM_TYPES)
+			strset_free(data.set);
 		freeListCommandItem(item);
 		return false;
 	}
 
 	if (type >= 0 && type <= TAG_NUM_OF_ITEM_TYPES) {
+		struct list_tags_cache *cache = cacheable
+			? &list_tags_cache[type]
+			: NULL;
 		const char *value;
 
+		if (cache != NULL) {
+			list_tags_cache_clear(cache);
+			cache->values = g_ptr_array_new();
+		}
+
 		strset_rewind(data.set);
 
-		while ((value = strset_next(data.set)) != NULL)
-			client_printf(client, "%s: %s\n",
-				      tag_item_names[type],
-				      value);
+		while ((value = strset_next(data.set)) != NULL) {
+			if (client_binary_enabled(client))
+				client_binary_pair(client,
+						   tag_item_names[type],
+						   value);
+			else
+				client_printf(client, "%s: %s\n",
+					      tag_item_names[type],
+					      value);
+
+			if (cache != NULL)
+				g_ptr_array_add(cache->values,
+						g_strdup(value));
+		}
+
+		if (cache != NULL)
+			cache->version = db_get_version();
 
 		strset_free(data.set);
 	}
@@ -30,6 +30,60 @@ struct locate_item_list;
 struct db_selection;
 struct db_visitor;
 
+/**
+ * How to rank search/find results before printing them.
+ */
+enum song_sort_key {
+	/** no ranking: print matches in database walk order */
+	SONG_SORT_NONE,
+
+	/** sort by a tag value; see song_sort::tag */
+	SONG_SORT_TAG,
+
+	/** sort by the song file's modification time */
+	SONG_SORT_MTIME,
+
+	/** sort by the song duration */
+	SONG_SORT_DURATION,
+};
+
+/**
+ * Sorting and capping instructions for search/find results.  The
+ * ranking happens during the database visit with a heap bounded to
+ * #limit entries, so even a huge result set is never materialized or
+ * transferred completely.
+ */
+struct song_sort {
+	enum song_sort_key key;
+
+	/** the tag type to sort by, when #key is #SONG_SORT_TAG */
+	int tag;
+
+	/** sort in descending order? */
+	bool descending;
+
+	/** the maximum number of songs to print; 0 = unlimited */
+	unsigned limit;
+};
+
+static inline void
+song_sort_init(struct song_sort *sort)
+{
+	sort->key = SONG_SORT_NONE;
+	sort->descending = false;
+	sort->limit = 0;
+}
+
+/**
+ * Parses a sort key name: "mtime", "duration" or a tag name; a "-"
+ * prefix reverses the order.
+ *
+ * @return false if the name was not recognized
+ */
+gcc_nonnull(1,2)
+bool
+song_sort_parse_key(struct song_sort *sort, const char *name);
+
 gcc_nonnull(1,2)
 bool
 db_selection_print(struct client *client, const struct db_selection *selection,
@@ -44,16 +98,26 @@ bool
 printInfoForAllIn(struct client *client, const char *uri_utf8,
 		  GError **error_r);
 
+/**
+ * @param sort optional ranking/capping instructions; NULL prints all
+ * matches in walk order
+ */
 gcc_nonnull(1,2,3)
 bool
 searchForSongsIn(struct client *client, const char *name,
 		 const struct locate_item_list *criteria,
+		 const struct song_sort *sort,
 		 GError **error_r);
 
+/**
+ * @param sort optional ranking/capping instructions; NULL prints all
+ * matches in walk order
+ */
 gcc_nonnull(1,2,3)
 bool
 findSongsIn(struct client *client, const char *name,
 	    const struct locate_item_list *criteria,
+	    const struct song_sort *sort,
 	    GError **error_r);
 
 gcc_nonnull(1,2,3)
@@ -22,6 +22,8 @@
 
 #include "gcc.h"
 
+#include <glib.h>
+
 #include <assert.h>
 
 struct directory;
@@ -39,6 +41,19 @@ struct db_selection {
 	 * Recursively search all sub directories?
 	 */
 	bool recursive;
+
+	/**
+	 * The index (in walk order) of the first entity to be
+	 * returned; entities before it are skipped.
+	 */
+	unsigned window_start;
+
+	/**
+	 * One past the index of the last entity to be returned; the
+	 * walk is aborted as soon as this index is reached.
+	 * #G_MAXUINT means "no limit".
+	 */
+	unsigned window_end;
 };
 
 gcc_nonnull(1,2)
@@ -51,6 +66,28 @@ db_selection_init(struct db_selection *selection,
 
 	selection->uri = uri;
 	selection->recursive = recursive;
+	selection->window_start = 0;
+	selection->window_end = G_MAXUINT;
+}
+
+/**
+ * Restricts the selection to a window of the walk order: only
+ * entities with an index in [start, end) are returned, and the walk
+ * stops as soon as the end has been reached, instead of visiting the
+ * rest of the tree.  The start index is the cursor for paging
+ * clients: pass the index following the last received entity to
+ * resume.
+ */
+gcc_nonnull(1)
+static inline void
+db_selection_window(struct db_selection *selection,
+		    unsigned start, unsigned end)
+{
+	assert(selection != NULL);
+	assert(start <= end);
+
+	selection->window_start = start;
+	selection->window_end = end;
 }
 
 #endif
@@ -192,26 +192,67 @@ flac_common_write(struct flac_data *data, const FLAC__Frame * frame,
 	enum decoder_command cmd;
 	void *buffer;
 	unsigned bit_rate;
+	unsigned position = 0;
 
 	if (!data->initialized && !flac_got_first_frame(data, &frame->header))
 		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 
-	size_t buffer_size = frame->header.blocksize * data->frame_size;
-	buffer = pcm_buffer_get(&data->buffer, buffer_size);
-
-	flac_convert(buffer, frame->header.channels,
-		     data->audio_format.format, buf,
-		     0, frame->header.blocksize);
-
 	if (nbytes > 0)
 		bit_rate = nbytes * 8 * frame->header.sample_rate /
 			(1000 * frame->header.blocksize);
 	else
 		bit_rate = 0;
 
-	cmd = decoder_data(data->decoder, data->input_stream,
-			   buffer, buffer_size,
-			   bit_rate);
+	/* fast path: interleave the channel-planar libFLAC buffers
+	   directly into the output chunk, saving one copy of every
+	   sample */
+
+	cmd = DECODE_COMMAND_NONE;
+	while (position < frame->header.blocksize) {
+		void *dest;
+		size_t max_length;
+		unsigned n;
+
+		cmd = decoder_data_begin(data->decoder, data->input_stream,
+					 bit_rate, &dest, &max_length);
+		if (cmd != DECODE_COMMAND_NONE)
+			break;
+
+		if (dest == NULL)
+			/* a PCM conversion is configured - use the
+			   buffered path below */
+			break;
+
+		n = max_length / data->frame_size;
+		if (n > frame->header.blocksize - position)
+			n = frame->header.blocksize - position;
+
+		flac_convert(dest, frame->header.channels,
+			     data->audio_format.format, buf,
+			     position, position + n);
+		position += n;
+
+		cmd = decoder_data_commit(data->decoder,
+					  n * data->frame_size);
+		if (cmd != DECODE_COMMAND_NONE)
+			break;
+	}
+
+	if (cmd == DECODE_COMMAND_NONE && position < frame->header.blocksize) {
+		/* buffered path for the remaining samples */
+		size_t buffer_size = (frame->header.blocksize - position) *
+			data->frame_size;
+		buffer = pcm_buffer_get(&data->buffer, buffer_size);
+
+		flac_convert(buffer, frame->header.channels,
+			     data->audio_format.format, buf,
+			     position, frame->header.blocksize);
+
+		cmd = decoder_data(data->decoder, data->input_stream,
+				   buffer, buffer_size,
+				   bit_rate);
+	}
+
 	data->next_frame += frame->header.blocksize;
 	switch (cmd) {
 	case DECODE_COMMAND_NONE:
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "_render_queue.h"
+
+#include <glib.h>
+
+#include <assert.h>
+
+struct render_queue {
+	render_queue_func render;
+	void *ctx;
+
+	size_t buffer_size;
+	unsigned n_buffers;
+
+	/**
+	 * The worker thread, or NULL if g_thread_create() failed;
+	 * without a thread, render_queue_shift() renders
+	 * synchronously.
+	 */
+	GThread *thread;
+
+	GMutex *mutex;
+	GCond *cond;
+
+	/** one allocation holding all #n_buffers buffers */
+	unsigned char *buffers;
+
+	/** the number of bytes rendered into each buffer */
+	size_t *sizes;
+
+	/** the buffer being filled / drained next */
+	unsigned fill, drain;
+
+	/** the number of buffers filled but not yet consumed */
+	unsigned n_filled;
+
+	bool eof;
+
+	bool stop;
+
+	bool suspend_requested, suspended;
+};
+
+static unsigned char *
+render_queue_buffer(struct render_queue *rq, unsigned i)
+{
+	return rq->buffers + i * rq->buffer_size;
+}
+
+static gpointer
+render_queue_task(gpointer data)
+{
+	struct render_queue *rq = data;
+
+	g_mutex_lock(rq->mutex);
+
+	while (!rq->stop) {
+		if (rq->suspend_requested) {
+			/* drop everything; the caller is
+			   repositioning the render context */
+			rq->n_filled = 0;
+			rq->drain = rq->fill;
+			rq->eof = false;
+
+			rq->suspended = true;
+			g_cond_broadcast(rq->cond);
+			while (rq->suspend_requested && !rq->stop)
+				g_cond_wait(rq->cond, rq->mutex);
+			rq->suspended = false;
+			continue;
+		}
+
+		if (rq->eof || rq->n_filled == rq->n_buffers) {
+			g_cond_wait(rq->cond, rq->mutex);
+			continue;
+		}
+
+		unsigned slot = rq->fill;
+		g_mutex_unlock(rq->mutex);
+
+		size_t nbytes = rq->render(rq->ctx,
+					   render_queue_buffer(rq, slot),
+					   rq->buffer_size);
+
+		g_mutex_lock(rq->mutex);
+
+		if (rq->suspend_requested || rq->stop)
+			/* discard this buffer */
+			continue;
+
+		if (nbytes == 0) {
+			rq->eof = true;
+		} else {
+			rq->sizes[slot] = nbytes;
+			rq->fill = (slot + 1) % rq->n_buffers;
+			++rq->n_filled;
+		}
+
+		g_cond_broadcast(rq->cond);
+	}
+
+	g_mutex_unlock(rq->mutex);
+	return NULL;
+}
+
+struct render_queue *
+render_queue_new(render_queue_func render, void *ctx,
+		 size_t buffer_size, unsigned n_buffers)
+{
+	assert(render != NULL);
+	assert(buffer_size > 0);
+	assert(n_buffers >= 2);
+
+	struct render_queue *rq = g_new(struct render_queue, 1);
+	rq->render = render;
+	rq->ctx = ctx;
+	rq->buffer_size = buffer_size;
+	rq->n_buffers = n_buffers;
+	rq->mutex = g_mutex_new();
+	rq->cond = g_cond_new();
+	rq->buffers = g_malloc(buffer_size * n_buffers);
+	rq->sizes = g_new(size_t, n_buffers);
+	rq->fill = rq->drain = 0;
+	rq->n_filled = 0;
+	rq->eof = false;
+	rq->stop = false;
+	rq->suspend_requested = rq->suspended = false;
+
+	rq->thread = g_thread_create(render_queue_task, rq, true, NULL);
+
+	return rq;
+}
+
+void
+render_queue_free(struct render_queue *rq)
+{
+	if (rq->thread != NULL) {
+		g_mutex_lock(rq->mutex);
+		rq->stop = true;
+		g_cond_broadcast(rq->cond);
+		g_mutex_unlock(rq->mutex);
+
+		g_thread_join(rq->thread);
+	}
+
+	g_free(rq->sizes);
+	g_free(rq->buffers);
+	g_cond_free(rq->cond);
+	g_mutex_free(rq->mutex);
+	g_free(rq);
+}
+
+const void *
+render_queue_shift(struct render_queue *rq, size_t *size_r)
+{
+	if (rq->thread == NULL) {
+		size_t nbytes = rq->render(rq->ctx, rq->buffers,
+					   rq->buffer_size);
+		if (nbytes == 0)
+			return NULL;
+
+		*size_r = nbytes;
+		return rq->buffers;
+	}
+
+	g_mutex_lock(rq->mutex);
+
+	while (rq->n_filled == 0 && !rq->eof)
+		g_cond_wait(rq->cond, rq->mutex);
+
+	const void *data = NULL;
+	if (rq->n_filled > 0) {
+		unsigned slot = rq->drain;
+		*size_r = rq->sizes[slot];
+		rq->drain = (slot + 1) % rq->n_buffers;
+		data = render_queue_buffer(rq, slot);
+	}
+
+	g_mutex_unlock(rq->mutex);
+	return data;
+}
+
+void
+render_queue_consume(struct render_queue *rq)
+{
+	if (rq->thread == NULL)
+		return;
+
+	g_mutex_lock(rq->mutex);
+	assert(rq->n_filled > 0);
+	--rq->n_filled;
+	g_cond_broadcast(rq->cond);
+	g_mutex_unlock(rq->mutex);
+}
+
+void
+render_queue_suspend(struct render_queue *rq)
+{
+	if (rq->thread == NULL)
+		return;
+
+	g_mutex_lock(rq->mutex);
+
+	rq->suspend_requested = true;
+	g_cond_broadcast(rq->cond);
+
+	while (!rq->suspended)
+		g_cond_wait(rq->cond, rq->mutex);
+
+	g_mutex_unlock(rq->mutex);
+}
+
+void
+render_queue_resume(struct render_queue *rq)
+{
+	if (rq->thread == NULL)
+		return;
+
+	g_mutex_lock(rq->mutex);
+
+	assert(rq->suspended);
+
+	rq->suspend_requested = false;
+	rq->eof = false;
+	g_cond_broadcast(rq->cond);
+
+	g_mutex_unlock(rq->mutex);
+}
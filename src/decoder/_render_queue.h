@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A render-ahead queue for decoder plugins which synthesize their
+ * output (game music emulation, MOD tracking, MIDI).  Rendering runs
+ * in a worker thread which keeps a bounded queue of pre-rendered
+ * buffers filled, so bursts of expensive synthesis are smoothed out
+ * and the decoder thread only copies finished buffers.
+ */
+
+#ifndef MPD_RENDER_QUEUE_H
+#define MPD_RENDER_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct render_queue;
+
+/**
+ * Renders up to #size bytes into #buffer.
+ *
+ * @return the number of bytes rendered, or 0 on end of stream (or
+ * error; the callback is expected to log errors itself)
+ */
+typedef size_t (*render_queue_func)(void *ctx, void *buffer, size_t size);
+
+/**
+ * Creates a render queue and starts its worker thread.  If the thread
+ * cannot be created, the queue falls back to rendering synchronously
+ * in render_queue_shift().
+ *
+ * @param buffer_size the size of each pre-rendered buffer in bytes
+ * @param n_buffers how many buffers to render ahead
+ */
+struct render_queue *
+render_queue_new(render_queue_func render, void *ctx,
+		 size_t buffer_size, unsigned n_buffers);
+
+/**
+ * Stops the worker thread and frees the queue.  Does not touch the
+ * render context.
+ */
+void
+render_queue_free(struct render_queue *rq);
+
+/**
+ * Waits for the next pre-rendered buffer.  The buffer remains valid
+ * until render_queue_consume() is called.
+ *
+ * @param size_r the number of bytes in the returned buffer
+ * @return the buffer, or NULL on end of stream
+ */
+const void *
+render_queue_shift(struct render_queue *rq, size_t *size_r);
+
+/**
+ * Releases the buffer obtained with render_queue_shift(), allowing
+ * the worker thread to reuse it.
+ */
+void
+render_queue_consume(struct render_queue *rq);
+
+/**
+ * Suspends the worker thread and drops all pre-rendered buffers, so
+ * the caller may safely reposition the render context (e.g. for a
+ * seek).  Continue with render_queue_resume().
+ */
+void
+render_queue_suspend(struct render_queue *rq);
+
+/**
+ * Resumes rendering after render_queue_suspend().  This also clears a
+ * pending end-of-stream, in case the seek moved away from it.
+ */
+void
+render_queue_resume(struct render_queue *rq);
+
+#endif
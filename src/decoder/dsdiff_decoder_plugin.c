@@ -444,6 +444,9 @@ const struct decoder_plugin dsdiff_decoder_plugin = {
 	.init = dsdiff_init,
 	.stream_decode = dsdiff_stream_decode,
 	.scan_stream = dsdiff_scan_stream,
+	/* the metadata chunks are tiny; the huge "DSD " chunk is
+	   skipped with seeks */
+	.scan_read_limit = 64 * 1024,
 	.suffixes = dsdiff_suffixes,
 	.mime_types = dsdiff_mime_types,
 };
@@ -510,6 +510,8 @@ const struct decoder_plugin faad_decoder_plugin = {
 	.name = "faad",
 	.stream_decode = faad_stream_decode,
 	.scan_stream = faad_scan_stream,
+	/* raw AAC files may carry large leading ID3v2 tags */
+	.scan_read_limit = 4 * 1024 * 1024,
 	.suffixes = faad_suffixes,
 	.mime_types = faad_mime_types,
 };
@@ -22,6 +22,10 @@
 #include "audio_check.h"
 #include "ffmpeg_metadata.h"
 #include "tag_handler.h"
+#include "pcm_buffer.h"
+#include "pcm_dispatch.h"
+#include "uri.h"
+#include "conf.h"
 
 #include <glib.h>
 
@@ -78,6 +82,20 @@ mpd_ffmpeg_log_callback(G_GNUC_UNUSED void *ptr, int level,
 	}
 }
 
+/** the configured avio buffer size ("buffer_size") */
+static unsigned ffmpeg_buffer_size = 8192;
+
+/**
+ * Maps the URI of a remote resource to the container format detected
+ * on the last visit, so replaying it skips the probe download.  The
+ * values are libavformat's static demuxer descriptors and are never
+ * freed.
+ */
+static GStaticMutex ffmpeg_format_cache_mutex = G_STATIC_MUTEX_INIT;
+static GHashTable *ffmpeg_format_cache;
+
+#define FFMPEG_FORMAT_CACHE_MAX 256
+
 struct mpd_ffmpeg_stream {
 	struct decoder *decoder;
 	struct input_stream *input;
@@ -87,7 +105,17 @@ struct mpd_ffmpeg_stream {
 #else
 	ByteIOContext *io;
 #endif
-	unsigned char buffer[8192];
+	unsigned char *buffer;
+
+	/** the bytes already downloaded by ffmpeg_probe(); served to
+	    libavformat instead of fetching the same range again */
+	unsigned char *probe_data;
+	size_t probe_size;
+
+	/** the stream position libavformat believes in; may lie
+	    within the probe window while the real #input_stream is
+	    already past it */
+	goffset position;
 };
 
 static int
@@ -95,44 +123,116 @@ mpd_ffmpeg_stream_read(void *opaque, uint8_t *buf, int size)
 {
 	struct mpd_ffmpeg_stream *stream = opaque;
 
-	return decoder_read(stream->decoder, stream->input,
-			    (void *)buf, size);
+	if (stream->probe_data != NULL &&
+	    stream->position < (goffset)stream->probe_size) {
+		/* inside the probe window: copy from memory */
+		size_t nbytes = stream->probe_size - stream->position;
+		if ((size_t)size < nbytes)
+			nbytes = size;
+
+		memcpy(buf, stream->probe_data + stream->position, nbytes);
+		stream->position += nbytes;
+		return nbytes;
+	}
+
+	if (stream->input->offset != stream->position &&
+	    !input_stream_lock_seek(stream->input, stream->position,
+				    SEEK_SET, NULL))
+		return -1;
+
+	int nbytes = decoder_read(stream->decoder, stream->input,
+				  (void *)buf, size);
+	if (nbytes > 0)
+		stream->position += nbytes;
+
+	return nbytes;
 }
 
 static int64_t
 mpd_ffmpeg_stream_seek(void *opaque, int64_t pos, int whence)
 {
 	struct mpd_ffmpeg_stream *stream = opaque;
+	goffset target;
+
+	switch (whence) {
+	case SEEK_SET:
+		target = pos;
+		break;
+
+	case SEEK_CUR:
+		target = stream->position + pos;
+		break;
+
+	case SEEK_END:
+		if (stream->input->size < 0)
+			return -1;
+		target = stream->input->size + pos;
+		break;
 
-	if (whence == AVSEEK_SIZE)
+	case AVSEEK_SIZE:
 		return stream->input->size;
 
-	if (!input_stream_lock_seek(stream->input, pos, whence, NULL))
+	default:
+		return -1;
+	}
+
+	if (stream->probe_data != NULL &&
+	    target <= (goffset)stream->probe_size) {
+		/* the target lies in the probe window: no need to
+		   touch the real stream */
+		stream->position = target;
+		return target;
+	}
+
+	if (!input_stream_lock_seek(stream->input, target, SEEK_SET, NULL))
 		return -1;
 
-	return stream->input->offset;
+	stream->position = stream->input->offset;
+	return stream->position;
 }
 
+/**
+ * Opens the libavformat I/O context on top of the #input_stream.
+ * The probe window handed over by ffmpeg_probe() (may be NULL) is
+ * served from memory, so libavformat does not fetch the same range
+ * from the network again; ownership is transferred.
+ */
 static struct mpd_ffmpeg_stream *
-mpd_ffmpeg_stream_open(struct decoder *decoder, struct input_stream *input)
+mpd_ffmpeg_stream_open(struct decoder *decoder, struct input_stream *input,
+		       unsigned char *probe_data, size_t probe_size)
 {
 	struct mpd_ffmpeg_stream *stream = g_new(struct mpd_ffmpeg_stream, 1);
 	stream->decoder = decoder;
 	stream->input = input;
+	stream->probe_data = probe_data;
+	stream->probe_size = probe_data != NULL ? probe_size : 0;
+	stream->position = 0;
+
+	stream->buffer = av_malloc(ffmpeg_buffer_size);
+	if (stream->buffer == NULL) {
+		g_free(probe_data);
+		g_free(stream);
+		return NULL;
+	}
+
 #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(52,101,0)
-	stream->io = avio_alloc_context(stream->buffer, sizeof(stream->buffer),
+	stream->io = avio_alloc_context(stream->buffer, ffmpeg_buffer_size,
 					false, stream,
 					mpd_ffmpeg_stream_read, NULL,
-					input->seekable
+					input->seekable ||
+					stream->probe_data != NULL
 					? mpd_ffmpeg_stream_seek : NULL);
 #else
-	stream->io = av_alloc_put_byte(stream->buffer, sizeof(stream->buffer),
+	stream->io = av_alloc_put_byte(stream->buffer, ffmpeg_buffer_size,
 				       false, stream,
 				       mpd_ffmpeg_stream_read, NULL,
-				       input->seekable
+				       input->seekable ||
+				       stream->probe_data != NULL
 				       ? mpd_ffmpeg_stream_seek : NULL);
 #endif
 	if (stream->io == NULL) {
+		av_free(stream->buffer);
+		g_free(probe_data);
 		g_free(stream);
 		return NULL;
 	}
@@ -170,16 +270,174 @@ mpd_ffmpeg_open_input(AVFormatContext **ic_ptr,
 static void
 mpd_ffmpeg_stream_close(struct mpd_ffmpeg_stream *stream)
 {
+	/* libavformat may have reallocated the buffer; free whatever
+	   the I/O context points at now */
+	av_free(stream->io->buffer);
 	av_free(stream->io);
+	g_free(stream->probe_data);
 	g_free(stream);
 }
 
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53,25,0)
+
+static void
+pcm_interleave_16_stereo(int16_t *dest, const int16_t *left,
+			 const int16_t *right, unsigned count)
+{
+	for (unsigned i = 0; i < count; ++i) {
+		*dest++ = left[i];
+		*dest++ = right[i];
+	}
+}
+
+static void
+pcm_interleave_32_stereo(int32_t *dest, const int32_t *left,
+			 const int32_t *right, unsigned count)
+{
+	for (unsigned i = 0; i < count; ++i) {
+		*dest++ = left[i];
+		*dest++ = right[i];
+	}
+}
+
+#ifdef PCM_DISPATCH_X86
+
+__attribute__((target("sse2")))
+static void
+pcm_interleave_16_stereo_sse2(int16_t *dest, const int16_t *left,
+			      const int16_t *right, unsigned count)
+{
+	while (count >= 8) {
+		__m128i l = _mm_loadu_si128((const __m128i *)left);
+		__m128i r = _mm_loadu_si128((const __m128i *)right);
+
+		_mm_storeu_si128((__m128i *)dest,
+				 _mm_unpacklo_epi16(l, r));
+		_mm_storeu_si128((__m128i *)(dest + 8),
+				 _mm_unpackhi_epi16(l, r));
+		dest += 16;
+		left += 8;
+		right += 8;
+		count -= 8;
+	}
+
+	pcm_interleave_16_stereo(dest, left, right, count);
+}
+
+__attribute__((target("sse2")))
+static void
+pcm_interleave_32_stereo_sse2(int32_t *dest, const int32_t *left,
+			      const int32_t *right, unsigned count)
+{
+	while (count >= 4) {
+		__m128i l = _mm_loadu_si128((const __m128i *)left);
+		__m128i r = _mm_loadu_si128((const __m128i *)right);
+
+		_mm_storeu_si128((__m128i *)dest,
+				 _mm_unpacklo_epi32(l, r));
+		_mm_storeu_si128((__m128i *)(dest + 4),
+				 _mm_unpackhi_epi32(l, r));
+		dest += 8;
+		left += 4;
+		right += 4;
+		count -= 4;
+	}
+
+	pcm_interleave_32_stereo(dest, left, right, count);
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+#ifdef __ARM_NEON__
+
+static void
+pcm_interleave_16_stereo_neon(int16_t *dest, const int16_t *left,
+			      const int16_t *right, unsigned count)
+{
+	while (count >= 8) {
+		int16x8x2_t s;
+		s.val[0] = vld1q_s16(left);
+		s.val[1] = vld1q_s16(right);
+
+		vst2q_s16(dest, s);
+		dest += 16;
+		left += 8;
+		right += 8;
+		count -= 8;
+	}
+
+	pcm_interleave_16_stereo(dest, left, right, count);
+}
+
+static void
+pcm_interleave_32_stereo_neon(int32_t *dest, const int32_t *left,
+			      const int32_t *right, unsigned count)
+{
+	while (count >= 4) {
+		int32x4x2_t s;
+		s.val[0] = vld1q_s32(left);
+		s.val[1] = vld1q_s32(right);
+
+		vst2q_s32(dest, s);
+		dest += 8;
+		left += 4;
+		right += 4;
+		count -= 4;
+	}
+
+	pcm_interleave_32_stereo(dest, left, right, count);
+}
+
+#endif /* __ARM_NEON__ */
+
+typedef void (*pcm_interleave_16_stereo_func)(int16_t *dest,
+					      const int16_t *left,
+					      const int16_t *right,
+					      unsigned count);
+typedef void (*pcm_interleave_32_stereo_func)(int32_t *dest,
+					      const int32_t *left,
+					      const int32_t *right,
+					      unsigned count);
+
+/* with -mfpu=neon, the whole binary requires NEON anyway, so no
+   runtime dispatch there */
+#ifdef __ARM_NEON__
+static pcm_interleave_16_stereo_func pcm_interleave_16_stereo_hook =
+	pcm_interleave_16_stereo_neon;
+static pcm_interleave_32_stereo_func pcm_interleave_32_stereo_hook =
+	pcm_interleave_32_stereo_neon;
+#else
+static pcm_interleave_16_stereo_func pcm_interleave_16_stereo_hook =
+	pcm_interleave_16_stereo;
+static pcm_interleave_32_stereo_func pcm_interleave_32_stereo_hook =
+	pcm_interleave_32_stereo;
+#endif
+
+#endif /* LIBAVCODEC 53.25 */
+
 static bool
-ffmpeg_init(G_GNUC_UNUSED const struct config_param *param)
+ffmpeg_init(const struct config_param *param)
 {
 	av_log_set_callback(mpd_ffmpeg_log_callback);
 
 	av_register_all();
+
+	ffmpeg_buffer_size = config_get_block_unsigned(param, "buffer_size",
+						       8192);
+	if (ffmpeg_buffer_size < 4096)
+		ffmpeg_buffer_size = 4096;
+
+	ffmpeg_format_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+						    g_free, NULL);
+
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53,25,0) && \
+	defined(PCM_DISPATCH_X86)
+	if (__builtin_cpu_supports("sse2")) {
+		pcm_interleave_16_stereo_hook = pcm_interleave_16_stereo_sse2;
+		pcm_interleave_32_stereo_hook = pcm_interleave_32_stereo_sse2;
+	}
+#endif
+
 	return true;
 }
 
@@ -235,12 +493,18 @@ time_to_ffmpeg(double t, const AVRational time_base)
 
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53,25,0)
 /**
- * Copy PCM data from a AVFrame to an interleaved buffer.
+ * Returns the PCM data of an AVFrame in interleaved layout.
+ * Interleaved frames are returned as-is, without copying; planar
+ * frames are interleaved into the reused buffer.
+ *
+ * @param output_r the data to submit is returned here; it points
+ * either into the frame or into the buffer
+ * @return the number of bytes, or a negative libavutil error code
  */
 static int
 copy_interleave_frame(const AVCodecContext *codec_context,
 		      const AVFrame *frame,
-		      uint8_t *buffer, size_t buffer_size)
+		      uint8_t **output_r, struct pcm_buffer *buffer)
 {
 	int plane_size;
 	const int data_size =
@@ -248,19 +512,42 @@ copy_interleave_frame(const AVCodecContext *codec_context,
 					   codec_context->channels,
 					   frame->nb_samples,
 					   codec_context->sample_fmt, 1);
-	if (buffer_size < (size_t)data_size)
-		/* buffer is too small - shouldn't happen */
-		return AVERROR(EINVAL);
 
 	if (av_sample_fmt_is_planar(codec_context->sample_fmt) &&
 	    codec_context->channels > 1) {
-		for (int i = 0, channels = codec_context->channels;
-		     i < channels; i++) {
-			memcpy(buffer, frame->extended_data[i], plane_size);
-			buffer += plane_size;
+		const unsigned channels = codec_context->channels;
+		const unsigned n = frame->nb_samples;
+		const size_t sample_size = plane_size / n;
+		uint8_t *dest = pcm_buffer_get(buffer, data_size);
+
+		if (channels == 2 && sample_size == 2)
+			pcm_interleave_16_stereo_hook((int16_t *)dest,
+						      (const int16_t *)frame->extended_data[0],
+						      (const int16_t *)frame->extended_data[1],
+						      n);
+		else if (channels == 2 && sample_size == 4)
+			pcm_interleave_32_stereo_hook((int32_t *)dest,
+						      (const int32_t *)frame->extended_data[0],
+						      (const int32_t *)frame->extended_data[1],
+						      n);
+		else {
+			for (unsigned c = 0; c < channels; ++c) {
+				const uint8_t *src = frame->extended_data[c];
+				uint8_t *d = dest + c * sample_size;
+
+				for (unsigned i = 0; i < n; ++i) {
+					memcpy(d, src, sample_size);
+					src += sample_size;
+					d += channels * sample_size;
+				}
+			}
 		}
+
+		*output_r = dest;
 	} else {
-		memcpy(buffer, frame->extended_data[0], data_size);
+		/* interleaved already - submit the frame's buffer
+		   without copying it */
+		*output_r = frame->extended_data[0];
 	}
 
 	return data_size;
@@ -271,7 +558,8 @@ static enum decoder_command
 ffmpeg_send_packet(struct decoder *decoder, struct input_stream *is,
 		   const AVPacket *packet,
 		   AVCodecContext *codec_context,
-		   const AVRational *time_base)
+		   const AVRational *time_base,
+		   G_GNUC_UNUSED struct pcm_buffer *buffer)
 {
 	if (packet->pts != (int64_t)AV_NOPTS_VALUE)
 		decoder_timestamp(decoder,
@@ -284,10 +572,7 @@ ffmpeg_send_packet(struct decoder *decoder, struct input_stream *is,
 	int packet_size = packet->size;
 #endif
 
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53,25,0)
-	uint8_t aligned_buffer[(AVCODEC_MAX_AUDIO_FRAME_SIZE * 3) / 2 + 16];
-	const size_t buffer_size = sizeof(aligned_buffer);
-#else
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(53,25,0)
 	/* libavcodec < 0.8 needs an aligned buffer */
 	uint8_t audio_buf[(AVCODEC_MAX_AUDIO_FRAME_SIZE * 3) / 2 + 16];
 	size_t buffer_size = sizeof(audio_buf);
@@ -302,27 +587,31 @@ ffmpeg_send_packet(struct decoder *decoder, struct input_stream *is,
 	       packet_size > 0 &&
 #endif
 	       cmd == DECODE_COMMAND_NONE) {
-		int audio_size = buffer_size;
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53,25,0)
 		AVFrame frame;
 		int got_frame = 0;
+		uint8_t *output = NULL;
+		int audio_size = 0;
 		int len = avcodec_decode_audio4(codec_context,
 						&frame, &got_frame,
 						&packet2);
 		if (len >= 0 && got_frame) {
 			audio_size = copy_interleave_frame(codec_context,
 							   &frame,
-							   aligned_buffer,
-							   buffer_size);
+							   &output, buffer);
 			if (audio_size < 0)
 				len = audio_size;
 		} else if (len >= 0)
 			len = -1;
 #elif LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(52,25,0)
+		int audio_size = buffer_size;
+		const uint8_t *output = (const uint8_t *)aligned_buffer;
 		int len = avcodec_decode_audio3(codec_context,
 						aligned_buffer, &audio_size,
 						&packet2);
 #else
+		int audio_size = buffer_size;
+		const uint8_t *output = (const uint8_t *)aligned_buffer;
 		int len = avcodec_decode_audio2(codec_context,
 						aligned_buffer, &audio_size,
 						packet_data, packet_size);
@@ -346,7 +635,7 @@ ffmpeg_send_packet(struct decoder *decoder, struct input_stream *is,
 			continue;
 
 		cmd = decoder_data(decoder, is,
-				   aligned_buffer, audio_size,
+				   output, audio_size,
 				   codec_context->bit_rate / 1000);
 	}
 	return cmd;
@@ -370,6 +659,26 @@ ffmpeg_sample_format(G_GNUC_UNUSED const AVCodecContext *codec_context)
 #endif
 		return SAMPLE_FORMAT_S32;
 
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(52, 94, 1)
+	case AV_SAMPLE_FMT_FLT:
+#else
+	case SAMPLE_FMT_FLT:
+#endif
+		return SAMPLE_FORMAT_FLOAT;
+
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53, 34, 0)
+	/* planar formats are interleaved by
+	   copy_interleave_frame() */
+	case AV_SAMPLE_FMT_S16P:
+		return SAMPLE_FORMAT_S16;
+
+	case AV_SAMPLE_FMT_S32P:
+		return SAMPLE_FORMAT_S32;
+
+	case AV_SAMPLE_FMT_FLTP:
+		return SAMPLE_FORMAT_FLOAT;
+#endif
+
 	default:
 		g_warning("Unsupported libavcodec SampleFormat value: %d",
 			  codec_context->sample_fmt);
@@ -378,17 +687,63 @@ ffmpeg_sample_format(G_GNUC_UNUSED const AVCodecContext *codec_context)
 }
 
 static AVInputFormat *
-ffmpeg_probe(struct decoder *decoder, struct input_stream *is)
+ffmpeg_format_cache_get(const char *uri)
+{
+	g_static_mutex_lock(&ffmpeg_format_cache_mutex);
+	AVInputFormat *format = ffmpeg_format_cache != NULL
+		? g_hash_table_lookup(ffmpeg_format_cache, uri)
+		: NULL;
+	g_static_mutex_unlock(&ffmpeg_format_cache_mutex);
+
+	return format;
+}
+
+static void
+ffmpeg_format_cache_put(const char *uri, AVInputFormat *format)
+{
+	g_static_mutex_lock(&ffmpeg_format_cache_mutex);
+
+	if (ffmpeg_format_cache != NULL) {
+		if (g_hash_table_size(ffmpeg_format_cache) >=
+		    FFMPEG_FORMAT_CACHE_MAX)
+			g_hash_table_remove_all(ffmpeg_format_cache);
+
+		g_hash_table_insert(ffmpeg_format_cache,
+				    g_strdup(uri), format);
+	}
+
+	g_static_mutex_unlock(&ffmpeg_format_cache_mutex);
+}
+
+/**
+ * Detects the container format.  On success, the bytes downloaded
+ * for probing are returned in *probe_data_r (to be passed to
+ * mpd_ffmpeg_stream_open(), which serves them from memory); NULL
+ * means the format was served from the per-URI cache and nothing was
+ * downloaded.
+ */
+static AVInputFormat *
+ffmpeg_probe(struct decoder *decoder, struct input_stream *is,
+	     unsigned char **probe_data_r, size_t *probe_size_r)
 {
 	enum {
 		BUFFER_SIZE = 16384,
 		PADDING = 16,
 	};
 
+	*probe_data_r = NULL;
+	*probe_size_r = 0;
+
+	const bool remote = uri_has_scheme(is->uri);
+	if (remote) {
+		AVInputFormat *format = ffmpeg_format_cache_get(is->uri);
+		if (format != NULL)
+			return format;
+	}
+
 	unsigned char *buffer = g_malloc(BUFFER_SIZE);
 	size_t nbytes = decoder_read(decoder, is, buffer, BUFFER_SIZE);
-	if (nbytes <= PADDING ||
-	    !input_stream_lock_seek(is, 0, SEEK_SET, NULL)) {
+	if (nbytes <= PADDING) {
 		g_free(buffer);
 		return NULL;
 	}
@@ -397,16 +752,29 @@ ffmpeg_probe(struct decoder *decoder, struct input_stream *is)
 	   beyond the declared buffer limit, which makes valgrind
 	   angry; this workaround removes some padding from the buffer
 	   size */
-	nbytes -= PADDING;
 
 	AVProbeData avpd = {
 		.buf = buffer,
-		.buf_size = nbytes,
+		.buf_size = nbytes - PADDING,
 		.filename = is->uri,
 	};
 
 	AVInputFormat *format = av_probe_input_format(&avpd, true);
-	g_free(buffer);
+	if (format == NULL) {
+		/* rewind for whoever probes this stream next */
+		input_stream_lock_seek(is, 0, SEEK_SET, NULL);
+		g_free(buffer);
+		return NULL;
+	}
+
+	if (remote)
+		ffmpeg_format_cache_put(is->uri, format);
+
+	/* do not seek back: the caller serves these bytes to
+	   libavformat from memory, sparing the network the same
+	   range a second time */
+	*probe_data_r = buffer;
+	*probe_size_r = nbytes;
 
 	return format;
 }
@@ -414,7 +782,10 @@ ffmpeg_probe(struct decoder *decoder, struct input_stream *is)
 static void
 ffmpeg_decode(struct decoder *decoder, struct input_stream *input)
 {
-	AVInputFormat *input_format = ffmpeg_probe(decoder, input);
+	unsigned char *probe_data;
+	size_t probe_size;
+	AVInputFormat *input_format =
+		ffmpeg_probe(decoder, input, &probe_data, &probe_size);
 	if (input_format == NULL)
 		return;
 
@@ -422,7 +793,8 @@ ffmpeg_decode(struct decoder *decoder, struct input_stream *input)
 		input_format->name, input_format->long_name);
 
 	struct mpd_ffmpeg_stream *stream =
-		mpd_ffmpeg_stream_open(decoder, input);
+		mpd_ffmpeg_stream_open(decoder, input,
+				       probe_data, probe_size);
 	if (stream == NULL) {
 		g_warning("Failed to open stream");
 		return;
@@ -530,6 +902,11 @@ ffmpeg_decode(struct decoder *decoder, struct input_stream *input)
 	decoder_initialized(decoder, &audio_format,
 			    input->seekable, total_time);
 
+	/* scratch buffer for interleaving planar frames; grown once
+	   and reused for all packets */
+	struct pcm_buffer interleave_buffer;
+	pcm_buffer_init(&interleave_buffer);
+
 	enum decoder_command cmd;
 	do {
 		AVPacket packet;
@@ -540,7 +917,8 @@ ffmpeg_decode(struct decoder *decoder, struct input_stream *input)
 		if (packet.stream_index == audio_stream)
 			cmd = ffmpeg_send_packet(decoder, input,
 						 &packet, codec_context,
-						 &av_stream->time_base);
+						 &av_stream->time_base,
+						 &interleave_buffer);
 		else
 			cmd = decoder_get_command(decoder);
 
@@ -561,6 +939,8 @@ ffmpeg_decode(struct decoder *decoder, struct input_stream *input)
 		}
 	} while (cmd != DECODE_COMMAND_STOP);
 
+	pcm_buffer_deinit(&interleave_buffer);
+
 	avcodec_close(codec_context);
 #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(53,17,0)
 	avformat_close_input(&format_context);
@@ -575,11 +955,15 @@ static bool
 ffmpeg_scan_stream(struct input_stream *is,
 		   const struct tag_handler *handler, void *handler_ctx)
 {
-	AVInputFormat *input_format = ffmpeg_probe(NULL, is);
+	unsigned char *probe_data;
+	size_t probe_size;
+	AVInputFormat *input_format =
+		ffmpeg_probe(NULL, is, &probe_data, &probe_size);
 	if (input_format == NULL)
 		return false;
 
-	struct mpd_ffmpeg_stream *stream = mpd_ffmpeg_stream_open(NULL, is);
+	struct mpd_ffmpeg_stream *stream =
+		mpd_ffmpeg_stream_open(NULL, is, probe_data, probe_size);
 	if (stream == NULL)
 		return false;
 
@@ -742,9 +1126,19 @@ static const char *const ffmpeg_mime_types[] = {
 	NULL
 };
 
+static void
+ffmpeg_finish(void)
+{
+	g_static_mutex_lock(&ffmpeg_format_cache_mutex);
+	g_hash_table_destroy(ffmpeg_format_cache);
+	ffmpeg_format_cache = NULL;
+	g_static_mutex_unlock(&ffmpeg_format_cache_mutex);
+}
+
 const struct decoder_plugin ffmpeg_decoder_plugin = {
 	.name = "ffmpeg",
 	.init = ffmpeg_init,
+	.finish = ffmpeg_finish,
 	.stream_decode = ffmpeg_decode,
 	.scan_stream = ffmpeg_scan_stream,
 	.suffixes = ffmpeg_suffixes,
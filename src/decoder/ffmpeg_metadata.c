@@ -22,6 +22,8 @@
 #include "tag_table.h"
 #include "tag_handler.h"
 
+#include <glib.h>
+
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "ffmpeg"
 
@@ -38,16 +40,26 @@ static const struct tag_table ffmpeg_tags[] = {
 	{ NULL, TAG_NUM_OF_ITEM_TYPES }
 };
 
+/**
+ * Collects all entries with the given name into the batch array,
+ * instead of dispatching a callback per entry.
+ */
 static void
 ffmpeg_copy_metadata(enum tag_type type,
 		     AVDictionary *m, const char *name,
-		     const struct tag_handler *handler, void *handler_ctx)
+		     GArray *batch)
 {
 	AVDictionaryEntry *mt = NULL;
 
-	while ((mt = av_dict_get(m, name, mt, 0)) != NULL)
-		tag_handler_invoke_tag(handler, handler_ctx,
-				       type, mt->value);
+	while ((mt = av_dict_get(m, name, mt, 0)) != NULL) {
+		struct tag_scan_item item = {
+			.type = type,
+			.value = mt->value,
+			.length = strlen(mt->value),
+		};
+
+		g_array_append_val(batch, item);
+	}
 }
 
 #if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(51,5,0)
@@ -69,14 +81,23 @@ void
 ffmpeg_scan_dictionary(AVDictionary *dict,
 		       const struct tag_handler *handler, void *handler_ctx)
 {
+	GArray *batch = g_array_new(false, false,
+				    sizeof(struct tag_scan_item));
+
 	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i)
-		ffmpeg_copy_metadata(i, dict, tag_item_names[i],
-				     handler, handler_ctx);
+		ffmpeg_copy_metadata(i, dict, tag_item_names[i], batch);
 
 	for (const struct tag_table *i = ffmpeg_tags;
 	     i->name != NULL; ++i)
-		ffmpeg_copy_metadata(i->type, dict, i->name,
-				     handler, handler_ctx);
+		ffmpeg_copy_metadata(i->type, dict, i->name, batch);
+
+	/* the AVDictionary values stay valid until the caller closes
+	   the stream, so the batch may refer to them directly */
+	tag_handler_invoke_tags(handler, handler_ctx,
+				(const struct tag_scan_item *)batch->data,
+				batch->len);
+
+	g_array_free(batch, true);
 
 #if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(51,5,0)
 	if (handler->pair != NULL)
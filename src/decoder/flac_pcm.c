@@ -19,6 +19,9 @@
 
 #include "config.h"
 #include "flac_pcm.h"
+#include "pcm_dispatch.h"
+
+#include <glib.h>
 
 #include <assert.h>
 
@@ -32,6 +35,143 @@ static void flac_convert_stereo16(int16_t *dest,
 	}
 }
 
+/**
+ * Interleaves the two channel-planar 32 bit buffers (also used for 24
+ * bit files, which libFLAC delivers in 32 bit samples).
+ */
+static void flac_convert_stereo32(int32_t *dest,
+				  const FLAC__int32 * const buf[],
+				  unsigned int position, unsigned int end)
+{
+	for (; position < end; ++position) {
+		*dest++ = buf[0][position];
+		*dest++ = buf[1][position];
+	}
+}
+
+#ifdef PCM_DISPATCH_X86
+
+__attribute__((target("sse2")))
+static void flac_convert_stereo16_sse2(int16_t *dest,
+				       const FLAC__int32 * const buf[],
+				       unsigned int position, unsigned int end)
+{
+	/* unpacklo/unpackhi interleave left and right, and the
+	   saturating 32->16 pack is exact because FLAC delivers 16
+	   bit samples in the low word */
+	while (end - position >= 4) {
+		__m128i l = _mm_loadu_si128((const __m128i *)
+					    (buf[0] + position));
+		__m128i r = _mm_loadu_si128((const __m128i *)
+					    (buf[1] + position));
+
+		_mm_storeu_si128((__m128i *)dest,
+				 _mm_packs_epi32(_mm_unpacklo_epi32(l, r),
+						 _mm_unpackhi_epi32(l, r)));
+		dest += 8;
+		position += 4;
+	}
+
+	flac_convert_stereo16(dest, buf, position, end);
+}
+
+__attribute__((target("sse2")))
+static void flac_convert_stereo32_sse2(int32_t *dest,
+				       const FLAC__int32 * const buf[],
+				       unsigned int position, unsigned int end)
+{
+	while (end - position >= 4) {
+		__m128i l = _mm_loadu_si128((const __m128i *)
+					    (buf[0] + position));
+		__m128i r = _mm_loadu_si128((const __m128i *)
+					    (buf[1] + position));
+
+		_mm_storeu_si128((__m128i *)dest,
+				 _mm_unpacklo_epi32(l, r));
+		_mm_storeu_si128((__m128i *)(dest + 4),
+				 _mm_unpackhi_epi32(l, r));
+		dest += 8;
+		position += 4;
+	}
+
+	flac_convert_stereo32(dest, buf, position, end);
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+#ifdef __ARM_NEON__
+
+static void flac_convert_stereo16_neon(int16_t *dest,
+				       const FLAC__int32 * const buf[],
+				       unsigned int position, unsigned int end)
+{
+	while (end - position >= 4) {
+		int16x4x2_t s;
+		s.val[0] = vmovn_s32(vld1q_s32(buf[0] + position));
+		s.val[1] = vmovn_s32(vld1q_s32(buf[1] + position));
+
+		/* vst2 interleaves the two lanes while storing */
+		vst2_s16(dest, s);
+		dest += 8;
+		position += 4;
+	}
+
+	flac_convert_stereo16(dest, buf, position, end);
+}
+
+static void flac_convert_stereo32_neon(int32_t *dest,
+				       const FLAC__int32 * const buf[],
+				       unsigned int position, unsigned int end)
+{
+	while (end - position >= 4) {
+		int32x4x2_t s;
+		s.val[0] = vld1q_s32(buf[0] + position);
+		s.val[1] = vld1q_s32(buf[1] + position);
+
+		vst2q_s32(dest, s);
+		dest += 8;
+		position += 4;
+	}
+
+	flac_convert_stereo32(dest, buf, position, end);
+}
+
+#endif /* __ARM_NEON__ */
+
+typedef void (*flac_convert_stereo16_func)(int16_t *dest,
+					   const FLAC__int32 * const buf[],
+					   unsigned int position,
+					   unsigned int end);
+typedef void (*flac_convert_stereo32_func)(int32_t *dest,
+					   const FLAC__int32 * const buf[],
+					   unsigned int position,
+					   unsigned int end);
+
+/* with -mfpu=neon, the whole binary requires NEON anyway, so no
+   runtime dispatch there */
+#ifdef __ARM_NEON__
+static flac_convert_stereo16_func flac_convert_stereo16_hook =
+	flac_convert_stereo16_neon;
+static flac_convert_stereo32_func flac_convert_stereo32_hook =
+	flac_convert_stereo32_neon;
+#else
+static flac_convert_stereo16_func flac_convert_stereo16_hook =
+	flac_convert_stereo16;
+static flac_convert_stereo32_func flac_convert_stereo32_hook =
+	flac_convert_stereo32;
+#endif
+
+static void
+flac_pcm_init(void)
+{
+#ifdef PCM_DISPATCH_X86
+	if (__builtin_cpu_supports("sse2")) {
+		flac_convert_stereo16_hook = flac_convert_stereo16_sse2;
+		flac_convert_stereo32_hook = flac_convert_stereo32_sse2;
+	}
+#endif
+}
+
 static void
 flac_convert_16(int16_t *dest,
 		unsigned int num_channels,
@@ -80,11 +220,17 @@ flac_convert(void *dest,
 	     const FLAC__int32 *const buf[],
 	     unsigned int position, unsigned int end)
 {
+	static gsize initialized = 0;
+	if (g_once_init_enter(&initialized)) {
+		flac_pcm_init();
+		g_once_init_leave(&initialized, 1);
+	}
+
 	switch (sample_format) {
 	case SAMPLE_FORMAT_S16:
 		if (num_channels == 2)
-			flac_convert_stereo16((int16_t*)dest, buf,
-					      position, end);
+			flac_convert_stereo16_hook((int16_t*)dest, buf,
+						   position, end);
 		else
 			flac_convert_16((int16_t*)dest, num_channels, buf,
 					position, end);
@@ -92,8 +238,12 @@ flac_convert(void *dest,
 
 	case SAMPLE_FORMAT_S24_P32:
 	case SAMPLE_FORMAT_S32:
-		flac_convert_32((int32_t*)dest, num_channels, buf,
-				position, end);
+		if (num_channels == 2)
+			flac_convert_stereo32_hook((int32_t*)dest, buf,
+						   position, end);
+		else
+			flac_convert_32((int32_t*)dest, num_channels, buf,
+					position, end);
 		break;
 
 	case SAMPLE_FORMAT_S8:
@@ -1,5 +1,6 @@
 #include "config.h"
 #include "../decoder_api.h"
+#include "_render_queue.h"
 #include "audio_check.h"
 #include "uri.h"
 #include "tag_handler.h"
@@ -22,8 +23,33 @@ enum {
 	GME_CHANNELS = 2,
 	GME_BUFFER_FRAMES = 2048,
 	GME_BUFFER_SAMPLES = GME_BUFFER_FRAMES * GME_CHANNELS,
+
+	/** how many buffers to render ahead of playback */
+	GME_RENDER_AHEAD = 4,
 };
 
+/**
+ * The render callback for the #render_queue: runs the emulator for
+ * one buffer in the worker thread.
+ */
+static size_t
+gme_render(void *ctx, void *buffer, size_t size)
+{
+	Music_Emu *emu = ctx;
+	const char *gme_err;
+
+	if (gme_track_ended(emu))
+		return 0;
+
+	gme_err = gme_play(emu, size / sizeof(short), buffer);
+	if (gme_err != NULL) {
+		g_warning("%s", gme_err);
+		return 0;
+	}
+
+	return size;
+}
+
 /**
  * returns the file path stripped of any /tune_xxx.* subtune
  * suffix
@@ -114,7 +140,6 @@ gme_file_decode(struct decoder *decoder, const char *path_fs)
 	gme_info_t *ti;
 	struct audio_format audio_format;
 	enum decoder_command cmd;
-	short buf[GME_BUFFER_SAMPLES];
 	const char* gme_err;
 	char *path_container = get_container_name(path_fs);
 	int song_num = get_song_num(path_fs);
@@ -157,26 +182,37 @@ gme_file_decode(struct decoder *decoder, const char *path_fs)
 	if(ti->length > 0)
 		gme_set_fade(emu, ti->length);
 
-	/* play */
+	/* play; the emulator runs in the render queue's worker
+	   thread, so CPU spikes on complex tracks are absorbed by the
+	   pre-rendered buffers */
+	struct render_queue *rq =
+		render_queue_new(gme_render, emu,
+				 GME_BUFFER_SAMPLES * sizeof(short),
+				 GME_RENDER_AHEAD);
+
 	do {
-		gme_err = gme_play(emu, GME_BUFFER_SAMPLES, buf);
-		if (gme_err != NULL) {
-			g_warning("%s", gme_err);
-			return;
-		}
-		cmd = decoder_data(decoder, NULL, buf, sizeof(buf), 0);
+		size_t nbytes;
+		const void *data = render_queue_shift(rq, &nbytes);
+		if (data == NULL)
+			break;
+
+		cmd = decoder_data(decoder, NULL, data, nbytes, 0);
+		render_queue_consume(rq);
 
 		if(cmd == DECODE_COMMAND_SEEK) {
 			float where = decoder_seek_where(decoder);
+
+			render_queue_suspend(rq);
 			if((gme_err = gme_seek(emu, (int)where*1000)) != NULL)
 				g_warning("%s", gme_err);
+			render_queue_resume(rq);
+
 			decoder_command_finished(decoder);
 		}
-
-		if(gme_track_ended(emu))
-			break;
 	} while(cmd != DECODE_COMMAND_STOP);
 
+	render_queue_free(rq);
+
 	gme_free_info(ti);
 	gme_delete(emu);
 }
@@ -21,9 +21,10 @@
 #include "decoder_api.h"
 #include "conf.h"
 #include "tag_id3.h"
-#include "tag_rva2.h"
 #include "tag_handler.h"
 #include "audio_check.h"
+#include "pcm_dispatch.h"
+#include "mp3_seek_index.h"
 
 #include <assert.h>
 #include <unistd.h>
@@ -85,6 +86,107 @@ mad_fixed_to_24_sample(mad_fixed_t sample)
 	return sample >> (MAD_F_FRACBITS + 1 - bits);
 }
 
+/**
+ * Converts and interleaves one stereo block; this is by far the most
+ * common case, and the per-sample round/clip/quantize loop is the
+ * hottest decode function on small players.
+ */
+static void
+mad_fixed_to_24_stereo(int32_t *dest, const mad_fixed_t *left,
+		       const mad_fixed_t *right, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i) {
+		*dest++ = mad_fixed_to_24_sample(left[i]);
+		*dest++ = mad_fixed_to_24_sample(right[i]);
+	}
+}
+
+#ifdef PCM_DISPATCH_X86
+
+__attribute__((target("sse4.1")))
+static void
+mad_fixed_to_24_stereo_sse41(int32_t *dest, const mad_fixed_t *left,
+			     const mad_fixed_t *right, unsigned int count)
+{
+	/* packed 32 bit min/max need SSE4.1 */
+	const __m128i round = _mm_set1_epi32(1L << (MAD_F_FRACBITS - 24));
+	const __m128i min = _mm_set1_epi32(-MAD_F_ONE);
+	const __m128i max = _mm_set1_epi32(MAD_F_ONE - 1);
+
+	while (count >= 4) {
+		__m128i l = _mm_loadu_si128((const __m128i *)left);
+		__m128i r = _mm_loadu_si128((const __m128i *)right);
+
+		l = _mm_add_epi32(l, round);
+		r = _mm_add_epi32(r, round);
+		l = _mm_min_epi32(_mm_max_epi32(l, min), max);
+		r = _mm_min_epi32(_mm_max_epi32(r, min), max);
+		l = _mm_srai_epi32(l, MAD_F_FRACBITS + 1 - 24);
+		r = _mm_srai_epi32(r, MAD_F_FRACBITS + 1 - 24);
+
+		_mm_storeu_si128((__m128i *)dest,
+				 _mm_unpacklo_epi32(l, r));
+		_mm_storeu_si128((__m128i *)(dest + 4),
+				 _mm_unpackhi_epi32(l, r));
+		dest += 8;
+		left += 4;
+		right += 4;
+		count -= 4;
+	}
+
+	mad_fixed_to_24_stereo(dest, left, right, count);
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+#ifdef __ARM_NEON__
+
+static void
+mad_fixed_to_24_stereo_neon(int32_t *dest, const mad_fixed_t *left,
+			    const mad_fixed_t *right, unsigned int count)
+{
+	const int32x4_t round = vdupq_n_s32(1L << (MAD_F_FRACBITS - 24));
+	const int32x4_t min = vdupq_n_s32(-MAD_F_ONE);
+	const int32x4_t max = vdupq_n_s32(MAD_F_ONE - 1);
+
+	while (count >= 4) {
+		int32x4x2_t s;
+		int32x4_t l = vaddq_s32(vld1q_s32(left), round);
+		int32x4_t r = vaddq_s32(vld1q_s32(right), round);
+
+		s.val[0] = vshrq_n_s32(vminq_s32(vmaxq_s32(l, min), max),
+				       MAD_F_FRACBITS + 1 - 24);
+		s.val[1] = vshrq_n_s32(vminq_s32(vmaxq_s32(r, min), max),
+				       MAD_F_FRACBITS + 1 - 24);
+
+		/* vst2 interleaves the two lanes while storing */
+		vst2q_s32(dest, s);
+		dest += 8;
+		left += 4;
+		right += 4;
+		count -= 4;
+	}
+
+	mad_fixed_to_24_stereo(dest, left, right, count);
+}
+
+#endif /* __ARM_NEON__ */
+
+typedef void (*mad_fixed_to_24_stereo_func)(int32_t *dest,
+					    const mad_fixed_t *left,
+					    const mad_fixed_t *right,
+					    unsigned int count);
+
+/* with -mfpu=neon, the whole binary requires NEON anyway, so no
+   runtime dispatch there */
+#ifdef __ARM_NEON__
+static mad_fixed_to_24_stereo_func mad_fixed_to_24_stereo_hook =
+	mad_fixed_to_24_stereo_neon;
+#else
+static mad_fixed_to_24_stereo_func mad_fixed_to_24_stereo_hook =
+	mad_fixed_to_24_stereo;
+#endif
+
 static void
 mad_fixed_to_24_buffer(int32_t *dest, const struct mad_synth *synth,
 		       unsigned int start, unsigned int end,
@@ -92,6 +194,14 @@ mad_fixed_to_24_buffer(int32_t *dest, const struct mad_synth *synth,
 {
 	unsigned int i, c;
 
+	if (num_channels == 2) {
+		mad_fixed_to_24_stereo_hook(dest,
+					    synth->pcm.samples[0] + start,
+					    synth->pcm.samples[1] + start,
+					    end - start);
+		return;
+	}
+
 	for (i = start; i < end; ++i) {
 		for (c = 0; c < num_channels; ++c)
 			*dest++ = mad_fixed_to_24_sample(synth->pcm.samples[c][i]);
@@ -99,13 +209,35 @@ mad_fixed_to_24_buffer(int32_t *dest, const struct mad_synth *synth,
 }
 
 static bool
-mp3_plugin_init(G_GNUC_UNUSED const struct config_param *param)
+mp3_plugin_init(const struct config_param *param)
 {
 	gapless_playback = config_get_bool(CONF_GAPLESS_MP3_PLAYBACK,
 					   DEFAULT_GAPLESS_MP3_PLAYBACK);
+
+	GError *error = NULL;
+	char *seek_index_dir =
+		config_dup_block_path(param, "seek_index_dir", &error);
+	if (seek_index_dir == NULL && error != NULL) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+	}
+
+	mp3_seek_index_init(seek_index_dir);
+
+#ifdef PCM_DISPATCH_X86
+	if (__builtin_cpu_supports("sse4.1"))
+		mad_fixed_to_24_stereo_hook = mad_fixed_to_24_stereo_sse41;
+#endif
+
 	return true;
 }
 
+static void
+mp3_plugin_finish(void)
+{
+	mp3_seek_index_finish();
+}
+
 #define MP3_DATA_OUTPUT_BUFFER_SIZE 2048
 
 struct mp3_data {
@@ -122,6 +254,9 @@ struct mp3_data {
 	long *frame_offsets;
 	mad_timer_t *times;
 	unsigned long highest_frame;
+	/** how many entries of the table came from the persisted seek
+	    index; it is re-stored only if the table has grown */
+	unsigned long indexed_frames;
 	unsigned long max_frames;
 	unsigned long current_frame;
 	unsigned int drop_start_frames;
@@ -144,6 +279,7 @@ mp3_data_init(struct mp3_data *data, struct decoder *decoder,
 {
 	data->mute_frame = MUTEFRAME_NONE;
 	data->highest_frame = 0;
+	data->indexed_frames = 0;
 	data->max_frames = 0;
 	data->frame_offsets = NULL;
 	data->times = NULL;
@@ -212,53 +348,6 @@ mp3_fill_buffer(struct mp3_data *data)
 	return true;
 }
 
-#ifdef HAVE_ID3TAG
-static bool
-parse_id3_replay_gain_info(struct replay_gain_info *replay_gain_info,
-			   struct id3_tag *tag)
-{
-	int i;
-	char *key;
-	char *value;
-	struct id3_frame *frame;
-	bool found = false;
-
-	replay_gain_info_init(replay_gain_info);
-
-	for (i = 0; (frame = id3_tag_findframe(tag, "TXXX", i)); i++) {
-		if (frame->nfields < 3)
-			continue;
-
-		key = (char *)
-		    id3_ucs4_latin1duplicate(id3_field_getstring
-					     (&frame->fields[1]));
-		value = (char *)
-		    id3_ucs4_latin1duplicate(id3_field_getstring
-					     (&frame->fields[2]));
-
-		if (g_ascii_strcasecmp(key, "replaygain_track_gain") == 0) {
-			replay_gain_info->tuples[REPLAY_GAIN_TRACK].gain = atof(value);
-			found = true;
-		} else if (g_ascii_strcasecmp(key, "replaygain_album_gain") == 0) {
-			replay_gain_info->tuples[REPLAY_GAIN_ALBUM].gain = atof(value);
-			found = true;
-		} else if (g_ascii_strcasecmp(key, "replaygain_track_peak") == 0) {
-			replay_gain_info->tuples[REPLAY_GAIN_TRACK].peak = atof(value);
-			found = true;
-		} else if (g_ascii_strcasecmp(key, "replaygain_album_peak") == 0) {
-			replay_gain_info->tuples[REPLAY_GAIN_ALBUM].peak = atof(value);
-			found = true;
-		}
-
-		free(key);
-		free(value);
-	}
-
-	return found ||
-		/* fall back on RVA2 if no replaygain tags found */
-		tag_rva2_parse(tag, replay_gain_info);
-}
-#endif
 
 #ifdef HAVE_ID3TAG
 static bool
@@ -361,7 +450,7 @@ static void mp3_parse_id3(struct mp3_data *data, size_t tagsize,
 		char *mixramp_end;
 		float replay_gain_db = 0;
 
-		if (parse_id3_replay_gain_info(&rgi, id3_tag)) {
+		if (tag_id3_parse_replay_gain(id3_tag, &rgi)) {
 			replay_gain_db = decoder_replay_gain(data->decoder, &rgi);
 			data->found_replay_gain = true;
 		}
@@ -875,6 +964,16 @@ mp3_decode_first_frame(struct mp3_data *data, struct tag **tag)
 	data->frame_offsets = g_malloc(sizeof(long) * data->max_frames);
 	data->times = g_malloc(sizeof(mad_timer_t) * data->max_frames);
 
+	if (data->decoder != NULL && data->input_stream->seekable) {
+		/* preload the persisted seek index, so every seek
+		   position is known right away */
+		data->highest_frame =
+			mp3_seek_index_load(data->input_stream->uri,
+					    data->frame_offsets, data->times,
+					    data->max_frames);
+		data->indexed_frames = data->highest_frame;
+	}
+
 	return true;
 }
 
@@ -1174,6 +1273,15 @@ mp3_decode(struct decoder *decoder, struct input_stream *input_stream)
 
 	while (mp3_read(&data)) ;
 
+	if (input_stream->seekable &&
+	    data.highest_frame > data.indexed_frames)
+		/* the frame table has grown beyond the persisted
+		   index (or there was none); store it for the next
+		   time this song is played */
+		mp3_seek_index_store(input_stream->uri,
+				     data.frame_offsets, data.times,
+				     data.highest_frame);
+
 	mp3_data_finish(&data);
 }
 
@@ -1197,6 +1305,7 @@ static const char *const mp3_mime_types[] = { "audio/mpeg", NULL };
 const struct decoder_plugin mad_decoder_plugin = {
 	.name = "mad",
 	.init = mp3_plugin_init,
+	.finish = mp3_plugin_finish,
 	.stream_decode = mp3_decode,
 	.scan_stream = mad_decoder_scan_stream,
 	.suffixes = mp3_suffixes,
@@ -19,6 +19,7 @@
 
 #include "config.h"
 #include "decoder_api.h"
+#include "decoder/_render_queue.h"
 #include "tag_handler.h"
 
 #include <glib.h>
@@ -33,8 +34,20 @@ enum {
 	MODPLUG_PREALLOC_BLOCK = 256 * 1024,
 	MODPLUG_READ_BLOCK = 128 * 1024,
 	MODPLUG_FILE_LIMIT = 100 * 1024 * 1024,
+
+	/** how many frames to render ahead of playback */
+	MODPLUG_RENDER_AHEAD = 4,
 };
 
+static size_t
+modplug_render(void *ctx, void *buffer, size_t size)
+{
+	ModPlugFile *f = ctx;
+
+	int ret = ModPlug_Read(f, buffer, size);
+	return ret > 0 ? (size_t)ret : 0;
+}
+
 static GByteArray *mod_loadfile(struct decoder *decoder, struct input_stream *is)
 {
 	unsigned char *data;
@@ -95,8 +108,6 @@ mod_decode(struct decoder *decoder, struct input_stream *is)
 	ModPlug_Settings settings;
 	GByteArray *bdatas;
 	struct audio_format audio_format;
-	int ret;
-	char audio_buffer[MODPLUG_FRAME_SIZE];
 	enum decoder_command cmd = DECODE_COMMAND_NONE;
 
 	bdatas = mod_loadfile(decoder, is);
@@ -128,25 +139,33 @@ mod_decode(struct decoder *decoder, struct input_stream *is)
 	decoder_initialized(decoder, &audio_format,
 			    is->seekable, ModPlug_GetLength(f) / 1000.0);
 
+	struct render_queue *rq = render_queue_new(modplug_render, f,
+						   MODPLUG_FRAME_SIZE,
+						   MODPLUG_RENDER_AHEAD);
+
 	do {
-		ret = ModPlug_Read(f, audio_buffer, MODPLUG_FRAME_SIZE);
-		if (ret <= 0)
+		size_t nbytes;
+		const void *data = render_queue_shift(rq, &nbytes);
+		if (data == NULL)
 			break;
 
-		cmd = decoder_data(decoder, NULL,
-				   audio_buffer, ret,
-				   0);
+		cmd = decoder_data(decoder, NULL, data, nbytes, 0);
+		render_queue_consume(rq);
 
 		if (cmd == DECODE_COMMAND_SEEK) {
 			float where = decoder_seek_where(decoder);
 
+			render_queue_suspend(rq);
 			ModPlug_Seek(f, (int)(where * 1000.0));
+			render_queue_resume(rq);
 
 			decoder_command_finished(decoder);
 		}
 
 	} while (cmd != DECODE_COMMAND_STOP);
 
+	render_queue_free(rq);
+
 	ModPlug_Unload(f);
 }
 
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "mp3_seek_index.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "mp3_seek_index"
+
+static char *seek_index_dir;
+
+#define MP3_SEEK_INDEX_MAGIC 0x53494458 /* "SIDX" */
+#define MP3_SEEK_INDEX_VERSION 1
+
+struct mp3_seek_index_header {
+	uint32_t magic;
+	uint32_t version;
+
+	/** size and modification time of the song file this index
+	    was built for; a mismatch invalidates the index */
+	uint64_t file_size;
+	uint64_t mtime;
+
+	uint32_t count;
+};
+
+struct mp3_seek_index_entry {
+	/** byte offset of the frame in the song file */
+	uint32_t offset;
+
+	/** end-of-frame time stamp in milliseconds */
+	uint32_t time_ms;
+};
+
+void
+mp3_seek_index_init(char *dir)
+{
+	seek_index_dir = dir;
+}
+
+void
+mp3_seek_index_finish(void)
+{
+	g_free(seek_index_dir);
+	seek_index_dir = NULL;
+}
+
+/**
+ * Determines the index file path for a song file.  Song paths are
+ * hashed, because they may be longer than a file name allows.
+ */
+static char *
+mp3_seek_index_path(const char *uri)
+{
+	char *key = g_compute_checksum_for_string(G_CHECKSUM_MD5, uri, -1);
+	char *path = g_build_filename(seek_index_dir, key, NULL);
+	g_free(key);
+
+	return path;
+}
+
+/**
+ * Obtains size and modification time of the song file.
+ *
+ * @return false if the song is not a local regular file; only those
+ * are indexed
+ */
+static bool
+mp3_seek_index_stat(const char *uri, uint64_t *size_r, uint64_t *mtime_r)
+{
+	struct stat st;
+
+	if (!g_path_is_absolute(uri) || g_stat(uri, &st) < 0 ||
+	    !S_ISREG(st.st_mode))
+		return false;
+
+	*size_r = st.st_size;
+	*mtime_r = st.st_mtime;
+
+	return true;
+}
+
+unsigned long
+mp3_seek_index_load(const char *uri,
+		    long *offsets, mad_timer_t *times,
+		    unsigned long max_frames)
+{
+	struct mp3_seek_index_header header;
+	struct mp3_seek_index_entry *entries;
+	uint64_t file_size, mtime;
+	unsigned long count;
+
+	if (seek_index_dir == NULL ||
+	    !mp3_seek_index_stat(uri, &file_size, &mtime))
+		return 0;
+
+	char *path = mp3_seek_index_path(uri);
+	FILE *file = fopen(path, "rb");
+	g_free(path);
+	if (file == NULL)
+		return 0;
+
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+	    header.magic != MP3_SEEK_INDEX_MAGIC ||
+	    header.version != MP3_SEEK_INDEX_VERSION ||
+	    header.file_size != file_size || header.mtime != mtime) {
+		/* not an index file, or the song has been modified */
+		fclose(file);
+		return 0;
+	}
+
+	count = header.count;
+	if (count > max_frames)
+		count = max_frames;
+
+	entries = g_malloc(sizeof(*entries) * count);
+	if (fread(entries, sizeof(*entries), count, file) != count) {
+		/* truncated file */
+		g_free(entries);
+		fclose(file);
+		return 0;
+	}
+
+	fclose(file);
+
+	for (unsigned long i = 0; i < count; ++i) {
+		offsets[i] = entries[i].offset;
+		mad_timer_set(&times[i], entries[i].time_ms / 1000,
+			      entries[i].time_ms % 1000, 1000);
+	}
+
+	g_free(entries);
+
+	return count;
+}
+
+void
+mp3_seek_index_store(const char *uri,
+		     const long *offsets, const mad_timer_t *times,
+		     unsigned long count)
+{
+	struct mp3_seek_index_header header;
+	uint64_t file_size, mtime;
+
+	if (seek_index_dir == NULL || count == 0 ||
+	    !mp3_seek_index_stat(uri, &file_size, &mtime))
+		return;
+
+	if (count > G_MAXUINT32 ||
+	    (uint64_t)offsets[count - 1] > G_MAXUINT32)
+		/* does not fit into the file format */
+		return;
+
+	if (g_mkdir_with_parents(seek_index_dir, 0755) < 0) {
+		g_warning("Failed to create directory %s: %s",
+			  seek_index_dir, g_strerror(errno));
+		return;
+	}
+
+	char *path = mp3_seek_index_path(uri);
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		g_warning("Failed to create %s: %s",
+			  path, g_strerror(errno));
+		g_free(path);
+		return;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = MP3_SEEK_INDEX_MAGIC;
+	header.version = MP3_SEEK_INDEX_VERSION;
+	header.file_size = file_size;
+	header.mtime = mtime;
+	header.count = count;
+
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	for (unsigned long i = 0; success && i < count; ++i) {
+		struct mp3_seek_index_entry entry = {
+			.offset = offsets[i],
+			.time_ms = mad_timer_count(times[i],
+						   MAD_UNITS_MILLISECONDS),
+		};
+
+		success = fwrite(&entry, sizeof(entry), 1, file) == 1;
+	}
+
+	fclose(file);
+
+	if (!success) {
+		g_warning("Failed to write %s", path);
+		g_unlink(path);
+	}
+
+	g_free(path);
+}
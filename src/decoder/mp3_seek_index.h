@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_MP3_SEEK_INDEX_H
+#define MPD_MP3_SEEK_INDEX_H
+
+#include <mad.h>
+
+/**
+ * A persistent cache for the frame offset table which the mad decoder
+ * plugin builds while decoding a song.  With a preloaded table, every
+ * seek in a VBR file is a single file repositioning, instead of
+ * parsing all frame headers up to the seek point.
+ *
+ * Index files are keyed by the song path and validated against the
+ * song's size and modification time.
+ */
+
+/**
+ * Initializes this library.
+ *
+ * @param dir the cache directory, or NULL to disable the seek index;
+ * ownership is taken by this library
+ */
+void
+mp3_seek_index_init(char *dir);
+
+/**
+ * Deinitializes this library.
+ */
+void
+mp3_seek_index_finish(void);
+
+/**
+ * Attempts to load the persisted seek index of a song file.
+ *
+ * @param uri the (absolute) path of the song file
+ * @param offsets the destination frame offset array
+ * @param times the destination frame time array
+ * @param max_frames the capacity of the two arrays
+ * @return the number of entries loaded, or 0 if no usable index
+ * exists
+ */
+unsigned long
+mp3_seek_index_load(const char *uri,
+		    long *offsets, mad_timer_t *times,
+		    unsigned long max_frames);
+
+/**
+ * Persists the seek index of a song file.  Errors are logged and
+ * ignored; the index is only a cache.
+ *
+ * @param uri the (absolute) path of the song file
+ * @param offsets the frame offset array
+ * @param times the frame time array
+ * @param count the number of valid entries in the two arrays
+ */
+void
+mp3_seek_index_store(const char *uri,
+		     const long *offsets, const mad_timer_t *times,
+		     unsigned long count);
+
+#endif
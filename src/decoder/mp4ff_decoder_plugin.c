@@ -443,6 +443,8 @@ const struct decoder_plugin mp4ff_decoder_plugin = {
 	.name = "mp4ff",
 	.stream_decode = mp4_decode,
 	.scan_stream = mp4ff_scan_stream,
+	/* the "moov" atom may carry large embedded cover art */
+	.scan_read_limit = 4 * 1024 * 1024,
 	.suffixes = mp4_suffixes,
 	.mime_types = mp4_mime_types,
 };
@@ -49,13 +49,15 @@ mpd_mpg123_finish(void)
  *
  * @param handle a handle which was created before; on error, this
  * function will not free it
+ * @param decoder the decoder object, or NULL when scanning; used to
+ * negotiate the output encoding against the configured outputs
  * @param audio_format this parameter is filled after successful
  * return
  * @return true on success
  */
 static bool
-mpd_mpg123_open(mpg123_handle *handle, const char *path_fs,
-		struct audio_format *audio_format)
+mpd_mpg123_open(mpg123_handle *handle, struct decoder *decoder,
+		const char *path_fs, struct audio_format *audio_format)
 {
 	GError *gerror = NULL;
 	char *path_dup;
@@ -63,6 +65,23 @@ mpd_mpg123_open(mpg123_handle *handle, const char *path_fs,
 	int channels, encoding;
 	long rate;
 
+	if (decoder != NULL &&
+	    decoder_supports_sample_format(decoder, SAMPLE_FORMAT_FLOAT)) {
+		/* the outputs take floating point samples without a
+		   conversion: have libmpg123 hand out its internal
+		   float samples instead of requantizing them to 16
+		   bit, which pcm_convert would then undo */
+		const long *rates;
+		size_t n_rates;
+		mpg123_rates(&rates, &n_rates);
+
+		mpg123_format_none(handle);
+		for (size_t i = 0; i < n_rates; ++i)
+			mpg123_format(handle, rates[i],
+				      MPG123_MONO | MPG123_STEREO,
+				      MPG123_ENC_FLOAT_32);
+	}
+
 	/* mpg123_open() wants a writable string :-( */
 	path_dup = g_strdup(path_fs);
 
@@ -83,13 +102,23 @@ mpd_mpg123_open(mpg123_handle *handle, const char *path_fs,
 		return false;
 	}
 
-	if (encoding != MPG123_ENC_SIGNED_16) {
+	enum sample_format sample_format;
+	switch (encoding) {
+	case MPG123_ENC_SIGNED_16:
+		sample_format = SAMPLE_FORMAT_S16;
+		break;
+
+	case MPG123_ENC_FLOAT_32:
+		sample_format = SAMPLE_FORMAT_FLOAT;
+		break;
+
+	default:
 		/* other formats not yet implemented */
 		g_warning("expected MPG123_ENC_SIGNED_16, got %d", encoding);
 		return false;
 	}
 
-	if (!audio_format_init_checked(audio_format, rate, SAMPLE_FORMAT_S16,
+	if (!audio_format_init_checked(audio_format, rate, sample_format,
 				       channels, &gerror)) {
 		g_warning("%s", gerror->message);
 		g_error_free(gerror);
@@ -118,7 +147,7 @@ mpd_mpg123_file_decode(struct decoder *decoder, const char *path_fs)
 		return;
 	}
 
-	if (!mpd_mpg123_open(handle, path_fs, &audio_format)) {
+	if (!mpd_mpg123_open(handle, decoder, path_fs, &audio_format)) {
 		mpg123_delete(handle);
 		return;
 	}
@@ -209,7 +238,7 @@ mpd_mpg123_scan_file(const char *path_fs,
 		return false;
 	}
 
-	if (!mpd_mpg123_open(handle, path_fs, &audio_format)) {
+	if (!mpd_mpg123_open(handle, NULL, path_fs, &audio_format)) {
 		mpg123_delete(handle);
 		return false;
 	}
@@ -46,6 +46,35 @@ static unsigned default_songlength;
 
 static bool filter_setting;
 
+/**
+ * A cache of per-file information which is expensive to obtain: the
+ * number of subtunes and the song lengths from the songlength
+ * database.  Without it, every songlength lookup and every
+ * container_scan() call would load the SID file again and recompute
+ * its MD5 sum.  Maps the container path to a #sid_file_cache_entry;
+ * entries live until sidplay_finish().
+ */
+struct sid_file_cache_entry {
+	/** the number of subtunes in this file */
+	unsigned songs;
+
+	/** the length of each subtune in seconds; -1 if unknown */
+	int *lengths;
+};
+
+static GHashTable *sid_file_cache;
+G_LOCK_DEFINE_STATIC(sid_file_cache);
+
+static void
+sid_file_cache_entry_free(gpointer data)
+{
+	struct sid_file_cache_entry *entry =
+		(struct sid_file_cache_entry *)data;
+
+	g_free(entry->lengths);
+	g_free(entry);
+}
+
 static GKeyFile *
 sidplay_load_songlength_db(const char *path)
 {
@@ -101,6 +130,9 @@ sidplay_init(const struct config_param *param)
 
 	filter_setting=config_get_block_bool(param, "filter", true);
 
+	sid_file_cache=g_hash_table_new_full(g_str_hash, g_str_equal,
+					     g_free, sid_file_cache_entry_free);
+
 	return true;
 }
 
@@ -109,6 +141,8 @@ sidplay_finish()
 {
 	g_pattern_spec_free(path_with_subtune);
 
+	g_hash_table_destroy(sid_file_cache);
+
 	if(songlength_database)
 		g_key_file_free(songlength_database);
 }
@@ -155,6 +189,75 @@ get_song_num(const char *path_fs)
 		return 1;
 }
 
+/** parse a "minutes:seconds" value from the songlength database */
+static int
+parse_song_length(const char *value)
+{
+	int minutes=strtol(value, NULL, 10);
+	if(errno==EINVAL) minutes=0;
+
+	int seconds;
+	const char *ptr=strchr(value, ':');
+	if(ptr) {
+		seconds=strtol(ptr+1, NULL, 10);
+		if(errno==EINVAL) seconds=0;
+	} else
+		seconds=0;
+
+	return (minutes*60)+seconds;
+}
+
+/**
+ * Looks up the container in the file cache; on the first access, the
+ * file is loaded once, its MD5 sum is calculated and all subtune
+ * lengths are resolved from the songlength database.  The caller must
+ * hold the #sid_file_cache lock; the returned entry remains valid
+ * after unlocking, because the cache never evicts.
+ */
+static const struct sid_file_cache_entry *
+sid_file_cache_get(const char *path_container)
+{
+	struct sid_file_cache_entry *entry=(struct sid_file_cache_entry *)
+		g_hash_table_lookup(sid_file_cache, path_container);
+	if(entry!=NULL)
+		return entry;
+
+	SidTuneMod tune(path_container);
+	if(!tune)
+		return NULL;
+
+	const SidTuneInfo &info=tune.getInfo();
+
+	entry=g_new(struct sid_file_cache_entry, 1);
+	entry->songs=info.songs;
+	entry->lengths=g_new(int, info.songs);
+	for(unsigned i=0; i<entry->songs; i++)
+		entry->lengths[i]=-1;
+
+	if(songlength_database!=NULL) {
+		char md5sum[SIDTUNE_MD5_LENGTH+1];
+		tune.createMD5(md5sum);
+
+		gsize num_items;
+		gchar **values=
+			g_key_file_get_string_list(songlength_database,
+				"Database", md5sum, &num_items, NULL);
+		if(values!=NULL) {
+			if(num_items>entry->songs)
+				num_items=entry->songs;
+
+			for(gsize i=0; i<num_items; i++)
+				entry->lengths[i]=
+					parse_song_length(values[i]);
+
+			g_strfreev(values);
+		}
+	}
+
+	g_hash_table_insert(sid_file_cache, g_strdup(path_container), entry);
+	return entry;
+}
+
 /* get the song length in seconds */
 static int
 get_song_length(const char *path_fs)
@@ -163,39 +266,24 @@ get_song_length(const char *path_fs)
 		return -1;
 
 	gchar *sid_file=get_container_name(path_fs);
-	SidTuneMod tune(sid_file);
+
+	G_LOCK(sid_file_cache);
+	const struct sid_file_cache_entry *entry=
+		sid_file_cache_get(sid_file);
+	G_UNLOCK(sid_file_cache);
+
 	g_free(sid_file);
-	if(!tune) {
+
+	if(entry==NULL) {
 		g_warning("failed to load file for calculating md5 sum");
 		return -1;
 	}
-	char md5sum[SIDTUNE_MD5_LENGTH+1];
-	tune.createMD5(md5sum);
 
 	int song_num=get_song_num(path_fs);
-
-	gsize num_items;
-	gchar **values=g_key_file_get_string_list(songlength_database,
-		"Database", md5sum, &num_items, NULL);
-	if(!values || song_num>num_items) {
-		g_strfreev(values);
+	if(song_num<1 || (unsigned)song_num>entry->songs)
 		return -1;
-	}
 
-	int minutes=strtol(values[song_num-1], NULL, 10);
-	if(errno==EINVAL) minutes=0;
-
-	int seconds;
-	char *ptr=strchr(values[song_num-1], ':');
-	if(ptr) {
-		seconds=strtol(ptr+1, NULL, 10);
-		if(errno==EINVAL) seconds=0;
-	} else
-		seconds=0;
-
-	g_strfreev(values);
-
-	return (minutes*60)+seconds;
+	return entry->lengths[song_num-1];
 }
 
 static void
@@ -387,20 +475,25 @@ sidplay_scan_file(const char *path_fs,
 static char *
 sidplay_container_scan(const char *path_fs, const unsigned int tnum)
 {
-	SidTune tune(path_fs, NULL, true);
-	if (!tune)
+	/* the cache loads the file only on the first call for this
+	   container; the following calls (one per subtune) just check
+	   the cached song count */
+	G_LOCK(sid_file_cache);
+	const struct sid_file_cache_entry *entry=
+		sid_file_cache_get(path_fs);
+	G_UNLOCK(sid_file_cache);
+
+	if (entry == NULL)
 		return NULL;
 
-	const SidTuneInfo &info=tune.getInfo();
-
 	/* Don't treat sids containing a single tune
 		as containers */
-	if(!all_files_are_containers && info.songs<2)
+	if(!all_files_are_containers && entry->songs<2)
 		return NULL;
 
 	/* Construct container/tune path names, eg.
 		Delta.sid/tune_001.sid */
-	if(tnum<=info.songs) {
+	if(tnum<=entry->songs) {
 		char *subtune= g_strdup_printf(
 			SUBTUNE_PREFIX "%03u.sid", tnum);
 		return subtune;
@@ -165,6 +165,27 @@ vorbis_send_comments(struct decoder *decoder, struct input_stream *is,
 	tag_free(tag);
 }
 
+#ifndef HAVE_TREMOR
+/**
+ * Interleaves the non-interleaved per-channel arrays returned by
+ * ov_read_float().
+ */
+static void
+vorbis_interleave(float *dest, const float *const*src,
+		  unsigned nframes, unsigned channels)
+{
+	for (unsigned c = 0; c < channels; ++c) {
+		const float *s = src[c];
+		float *d = dest + c;
+
+		for (unsigned i = 0; i < nframes; ++i) {
+			*d = s[i];
+			d += channels;
+		}
+	}
+}
+#endif /* !HAVE_TREMOR */
+
 /* public */
 static void
 vorbis_stream_decode(struct decoder *decoder,
@@ -178,7 +199,11 @@ vorbis_stream_decode(struct decoder *decoder,
 	int current_section;
 	int prev_section = -1;
 	long ret;
+#ifdef HAVE_TREMOR
 	char chunk[OGG_CHUNK_SIZE];
+#else
+	float chunk[OGG_CHUNK_SIZE / sizeof(float)];
+#endif
 	long bitRate = 0;
 	long test;
 	const vorbis_info *vi;
@@ -201,7 +226,15 @@ vorbis_stream_decode(struct decoder *decoder,
 	}
 
 	if (!audio_format_init_checked(&audio_format, vi->rate,
+#ifdef HAVE_TREMOR
 				       SAMPLE_FORMAT_S16,
+#else
+				       /* deliver the decoder's native
+					  floating point samples; the
+					  outputs convert (or not) as
+					  needed */
+				       SAMPLE_FORMAT_FLOAT,
+#endif
 				       vi->channels, &error)) {
 		g_warning("%s", error->message);
 		g_error_free(error);
@@ -223,8 +256,19 @@ vorbis_stream_decode(struct decoder *decoder,
 				decoder_seek_error(decoder);
 		}
 
+#ifdef HAVE_TREMOR
 		ret = ov_read(&vf, chunk, sizeof(chunk),
 			      OGG_DECODE_USE_BIGENDIAN, 2, 1, &current_section);
+#else
+		/* obtain the decoder's internal floating point
+		   buffers, instead of having libvorbisfile convert
+		   them to 16 bit samples one by one; note that the
+		   return value counts frames, not bytes */
+		float **per_channel;
+		ret = ov_read_float(&vf, &per_channel,
+				    G_N_ELEMENTS(chunk) / audio_format.channels,
+				    &current_section);
+#endif
 		if (ret == OV_HOLE) /* bad packet */
 			ret = 0;
 		else if (ret <= 0)
@@ -261,6 +305,12 @@ vorbis_stream_decode(struct decoder *decoder,
 		if ((test = ov_bitrate_instant(&vf)) > 0)
 			bitRate = test / 1000;
 
+#ifndef HAVE_TREMOR
+		vorbis_interleave(chunk, (const float *const*)per_channel,
+				  ret, audio_format.channels);
+		ret *= audio_format.channels * sizeof(float);
+#endif
+
 		cmd = decoder_data(decoder, input_stream,
 				   chunk, ret,
 				   bitRate);
@@ -24,6 +24,7 @@
 #include "utils.h"
 #include "tag_table.h"
 #include "tag_handler.h"
+#include "pcm_dispatch.h"
 
 #include <wavpack/wavpack.h>
 #include <glib.h>
@@ -59,6 +60,217 @@ typedef void (*format_samples_t)(
 	void *buffer, uint32_t count
 );
 
+/** a kernel which narrows (or scales) samples within one buffer */
+typedef void (*wavpack_pack_func)(void *buffer, uint32_t count);
+
+/*
+ * The narrowing loops below work within a single buffer.  The size of
+ * the output samples never can be greater than the size of the input
+ * ones; otherwise we would have an overflow.
+ */
+
+static void
+wavpack_pack_8_scalar(void *buffer, uint32_t count)
+{
+	const int32_t *src = buffer;
+	int8_t *dst = buffer;
+
+	assert_static(sizeof(*dst) <= sizeof(*src));
+
+	/* pass through and align 8-bit samples */
+	while (count--)
+		*dst++ = *src++;
+}
+
+static void
+wavpack_pack_16_scalar(void *buffer, uint32_t count)
+{
+	const int32_t *src = buffer;
+	int16_t *dst = buffer;
+
+	assert_static(sizeof(*dst) <= sizeof(*src));
+
+	/* pass through and align 16-bit samples */
+	while (count--)
+		*dst++ = *src++;
+}
+
+/**
+ * Scales floating point sample data from the 24 bit integer range
+ * delivered by libwavpack down to -1.0f..1.0f.
+ */
+static void
+wavpack_scale_float_scalar(void *buffer, uint32_t count)
+{
+	/* multiply by the reciprocal; a floating point division per
+	   sample is much more expensive */
+	const float factor = 1.0f / (1 << 23);
+	float *p = buffer;
+
+	while (count--)
+		*p++ *= factor;
+}
+
+#ifdef PCM_DISPATCH_X86
+
+__attribute__((target("sse2")))
+static void
+wavpack_pack_8_sse2(void *buffer, uint32_t count)
+{
+	const int32_t *src = buffer;
+	int8_t *dst = buffer;
+
+	/* the samples fit in 8 bits, so the saturation in the pack
+	   instructions never kicks in; each store lands at or before
+	   positions which have already been loaded */
+	while (count >= 16) {
+		__m128i a = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)src),
+					    _mm_loadu_si128((const __m128i *)(src + 4)));
+		__m128i b = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(src + 8)),
+					    _mm_loadu_si128((const __m128i *)(src + 12)));
+		_mm_storeu_si128((__m128i *)dst, _mm_packs_epi16(a, b));
+
+		src += 16;
+		dst += 16;
+		count -= 16;
+	}
+
+	while (count--)
+		*dst++ = *src++;
+}
+
+__attribute__((target("sse2")))
+static void
+wavpack_pack_16_sse2(void *buffer, uint32_t count)
+{
+	const int32_t *src = buffer;
+	int16_t *dst = buffer;
+
+	while (count >= 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 4));
+		_mm_storeu_si128((__m128i *)dst, _mm_packs_epi32(a, b));
+
+		src += 8;
+		dst += 8;
+		count -= 8;
+	}
+
+	while (count--)
+		*dst++ = *src++;
+}
+
+__attribute__((target("sse2")))
+static void
+wavpack_scale_float_sse2(void *buffer, uint32_t count)
+{
+	const float factor = 1.0f / (1 << 23);
+	const __m128 vfactor = _mm_set1_ps(factor);
+	float *p = buffer;
+
+	while (count >= 4) {
+		_mm_storeu_ps(p, _mm_mul_ps(_mm_loadu_ps(p), vfactor));
+
+		p += 4;
+		count -= 4;
+	}
+
+	while (count--)
+		*p++ *= factor;
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+#ifdef __ARM_NEON__
+
+static void
+wavpack_pack_8_neon(void *buffer, uint32_t count)
+{
+	const int32_t *src = buffer;
+	int8_t *dst = buffer;
+
+	while (count >= 16) {
+		int16x8_t a = vcombine_s16(vmovn_s32(vld1q_s32(src)),
+					   vmovn_s32(vld1q_s32(src + 4)));
+		int16x8_t b = vcombine_s16(vmovn_s32(vld1q_s32(src + 8)),
+					   vmovn_s32(vld1q_s32(src + 12)));
+		vst1q_s8(dst, vcombine_s8(vmovn_s16(a), vmovn_s16(b)));
+
+		src += 16;
+		dst += 16;
+		count -= 16;
+	}
+
+	while (count--)
+		*dst++ = *src++;
+}
+
+static void
+wavpack_pack_16_neon(void *buffer, uint32_t count)
+{
+	const int32_t *src = buffer;
+	int16_t *dst = buffer;
+
+	while (count >= 8) {
+		int16x4_t a = vmovn_s32(vld1q_s32(src));
+		int16x4_t b = vmovn_s32(vld1q_s32(src + 4));
+		vst1q_s16(dst, vcombine_s16(a, b));
+
+		src += 8;
+		dst += 8;
+		count -= 8;
+	}
+
+	while (count--)
+		*dst++ = *src++;
+}
+
+static void
+wavpack_scale_float_neon(void *buffer, uint32_t count)
+{
+	const float factor = 1.0f / (1 << 23);
+	float *p = buffer;
+
+	while (count >= 4) {
+		vst1q_f32(p, vmulq_n_f32(vld1q_f32(p), factor));
+
+		p += 4;
+		count -= 4;
+	}
+
+	while (count--)
+		*p++ *= factor;
+}
+
+#endif /* __ARM_NEON__ */
+
+#ifdef __ARM_NEON__
+static wavpack_pack_func wavpack_pack_8_hook = wavpack_pack_8_neon;
+static wavpack_pack_func wavpack_pack_16_hook = wavpack_pack_16_neon;
+static wavpack_pack_func wavpack_scale_float_hook = wavpack_scale_float_neon;
+#else
+static wavpack_pack_func wavpack_pack_8_hook = wavpack_pack_8_scalar;
+static wavpack_pack_func wavpack_pack_16_hook = wavpack_pack_16_scalar;
+static wavpack_pack_func wavpack_scale_float_hook = wavpack_scale_float_scalar;
+#endif
+
+static void
+wavpack_dispatch_init(void)
+{
+	static gsize initialized = 0;
+
+	if (g_once_init_enter(&initialized)) {
+#ifdef PCM_DISPATCH_X86
+		if (__builtin_cpu_supports("sse2")) {
+			wavpack_pack_8_hook = wavpack_pack_8_sse2;
+			wavpack_pack_16_hook = wavpack_pack_16_sse2;
+			wavpack_scale_float_hook = wavpack_scale_float_sse2;
+		}
+#endif
+		g_once_init_leave(&initialized, 1);
+	}
+}
+
 /*
  * This function has been borrowed from the tiny player found on
  * wavpack.com. Modifications were required because mpd only handles
@@ -67,35 +279,14 @@ typedef void (*format_samples_t)(
 static void
 format_samples_int(int bytes_per_sample, void *buffer, uint32_t count)
 {
-	int32_t *src = buffer;
-
 	switch (bytes_per_sample) {
-	case 1: {
-		int8_t *dst = buffer;
-		/*
-		 * The asserts like the following one are because we do the
-		 * formatting of samples within a single buffer. The size
-		 * of the output samples never can be greater than the size
-		 * of the input ones. Otherwise we would have an overflow.
-		 */
-		assert_static(sizeof(*dst) <= sizeof(*src));
-
-		/* pass through and align 8-bit samples */
-		while (count--) {
-			*dst++ = *src++;
-		}
+	case 1:
+		wavpack_pack_8_hook(buffer, count);
 		break;
-	}
-	case 2: {
-		uint16_t *dst = buffer;
-		assert_static(sizeof(*dst) <= sizeof(*src));
 
-		/* pass through and align 16-bit samples */
-		while (count--) {
-			*dst++ = *src++;
-		}
+	case 2:
+		wavpack_pack_16_hook(buffer, count);
 		break;
-	}
 
 	case 3:
 	case 4:
@@ -111,12 +302,7 @@ static void
 format_samples_float(G_GNUC_UNUSED int bytes_per_sample, void *buffer,
 		     uint32_t count)
 {
-	float *p = buffer;
-
-	while (count--) {
-		*p /= (1 << 23);
-		++p;
-	}
+	wavpack_scale_float_hook(buffer, count);
 }
 
 /**
@@ -146,6 +332,219 @@ wavpack_bits_to_sample_format(bool is_float, int bytes_per_sample)
 	}
 }
 
+/**
+ * Unpacks WavPack blocks in a separate thread, so the decoder thread
+ * can convert and submit one chunk while the next one is being
+ * decoded.  Uses a chunk ring with one slot of headroom: the decoder
+ * thread "shifts" a chunk, works on it, and "consumes" it when it is
+ * done with the buffer.
+ */
+struct wavpack_unpacker {
+	WavpackContext *wpc;
+
+	/** the number of frames to unpack per chunk */
+	uint32_t samples_requested;
+
+	/**
+	 * The unpacker thread, or NULL if g_thread_create() failed;
+	 * without a thread, all functions fall back to unpacking
+	 * synchronously.
+	 */
+	GThread *thread;
+
+	GMutex *mutex;
+	GCond *cond;
+
+	/* wavpack gives us all kind of samples in a 32-bit space */
+	int32_t chunk[2][1024];
+
+	/** the number of frames unpacked into each chunk */
+	uint32_t samples[2];
+
+	/** the instant bitrate measured after unpacking each chunk */
+	int bitrate[2];
+
+	/** the chunk being filled / drained next */
+	unsigned fill, drain;
+
+	/** the number of chunks filled but not yet consumed */
+	unsigned n_filled;
+
+	bool eof;
+
+	bool stop;
+
+	bool seek_requested, seek_done, seek_result;
+	uint32_t seek_where;
+};
+
+static int
+wavpack_instant_bitrate(WavpackContext *wpc)
+{
+	return (int)(WavpackGetInstantBitrate(wpc) / 1000 + 0.5);
+}
+
+static gpointer
+wavpack_unpack_task(gpointer data)
+{
+	struct wavpack_unpacker *u = data;
+
+	g_mutex_lock(u->mutex);
+
+	while (!u->stop) {
+		if (u->seek_requested) {
+			/* drop buffered chunks; they precede the seek
+			   point */
+			u->n_filled = 0;
+			u->drain = u->fill;
+			u->eof = false;
+
+			uint32_t where = u->seek_where;
+			g_mutex_unlock(u->mutex);
+			bool success = WavpackSeekSample(u->wpc, where);
+			g_mutex_lock(u->mutex);
+
+			u->seek_result = success;
+			u->seek_requested = false;
+			u->seek_done = true;
+			g_cond_broadcast(u->cond);
+			continue;
+		}
+
+		if (u->eof || u->n_filled == G_N_ELEMENTS(u->chunk)) {
+			g_cond_wait(u->cond, u->mutex);
+			continue;
+		}
+
+		unsigned slot = u->fill;
+		g_mutex_unlock(u->mutex);
+
+		uint32_t got = WavpackUnpackSamples(u->wpc, u->chunk[slot],
+						    u->samples_requested);
+		int bitrate = wavpack_instant_bitrate(u->wpc);
+
+		g_mutex_lock(u->mutex);
+
+		if (u->seek_requested || u->stop)
+			/* discard this chunk */
+			continue;
+
+		if (got == 0) {
+			u->eof = true;
+		} else {
+			u->samples[slot] = got;
+			u->bitrate[slot] = bitrate;
+			u->fill = (slot + 1) % G_N_ELEMENTS(u->chunk);
+			++u->n_filled;
+		}
+
+		g_cond_broadcast(u->cond);
+	}
+
+	g_mutex_unlock(u->mutex);
+	return NULL;
+}
+
+static void
+wavpack_unpacker_init(struct wavpack_unpacker *u, WavpackContext *wpc,
+		      uint32_t samples_requested)
+{
+	u->wpc = wpc;
+	u->samples_requested = samples_requested;
+	u->mutex = g_mutex_new();
+	u->cond = g_cond_new();
+	u->fill = u->drain = 0;
+	u->n_filled = 0;
+	u->eof = false;
+	u->stop = false;
+	u->seek_requested = u->seek_done = false;
+
+	u->thread = g_thread_create(wavpack_unpack_task, u, true, NULL);
+}
+
+static void
+wavpack_unpacker_deinit(struct wavpack_unpacker *u)
+{
+	if (u->thread != NULL) {
+		g_mutex_lock(u->mutex);
+		u->stop = true;
+		g_cond_broadcast(u->cond);
+		g_mutex_unlock(u->mutex);
+
+		g_thread_join(u->thread);
+	}
+
+	g_cond_free(u->cond);
+	g_mutex_free(u->mutex);
+}
+
+static bool
+wavpack_unpacker_seek(struct wavpack_unpacker *u, uint32_t where)
+{
+	if (u->thread == NULL)
+		return WavpackSeekSample(u->wpc, where);
+
+	g_mutex_lock(u->mutex);
+
+	u->seek_where = where;
+	u->seek_requested = true;
+	u->seek_done = false;
+	g_cond_broadcast(u->cond);
+
+	while (!u->seek_done)
+		g_cond_wait(u->cond, u->mutex);
+	bool success = u->seek_result;
+
+	g_mutex_unlock(u->mutex);
+	return success;
+}
+
+/**
+ * Waits for the next unpacked chunk and returns the number of frames
+ * in it (0 on end of stream).  The chunk remains valid until
+ * wavpack_unpacker_consume() is called.
+ */
+static uint32_t
+wavpack_unpacker_shift(struct wavpack_unpacker *u,
+		       unsigned *slot_r, int *bitrate_r)
+{
+	if (u->thread == NULL) {
+		*slot_r = 0;
+		uint32_t got = WavpackUnpackSamples(u->wpc, u->chunk[0],
+						    u->samples_requested);
+		*bitrate_r = wavpack_instant_bitrate(u->wpc);
+		return got;
+	}
+
+	g_mutex_lock(u->mutex);
+
+	while (u->n_filled == 0 && !u->eof)
+		g_cond_wait(u->cond, u->mutex);
+
+	uint32_t got = 0;
+	if (u->n_filled > 0) {
+		*slot_r = u->drain;
+		got = u->samples[u->drain];
+		*bitrate_r = u->bitrate[u->drain];
+		u->drain = (u->drain + 1) % G_N_ELEMENTS(u->chunk);
+	}
+
+	g_mutex_unlock(u->mutex);
+	return got;
+}
+
+static void
+wavpack_unpacker_consume(struct wavpack_unpacker *u)
+{
+	if (u->thread == NULL)
+		return;
+
+	g_mutex_lock(u->mutex);
+	--u->n_filled;
+	g_cond_broadcast(u->cond);
+	g_mutex_unlock(u->mutex);
+}
+
 /*
  * This does the main decoding thing.
  * Requires an already opened WavpackContext.
@@ -181,15 +580,17 @@ wavpack_decode(struct decoder *decoder, WavpackContext *wpc, bool can_seek)
 		format_samples = format_samples_int;
 	}
 
+	wavpack_dispatch_init();
+
 	total_time = WavpackGetNumSamples(wpc);
 	total_time /= audio_format.sample_rate;
 	bytes_per_sample = WavpackGetBytesPerSample(wpc);
 	output_sample_size = audio_format_frame_size(&audio_format);
 
-	/* wavpack gives us all kind of samples in a 32-bit space */
-	int32_t chunk[1024];
-	const uint32_t samples_requested = G_N_ELEMENTS(chunk) /
-		audio_format.channels;
+	struct wavpack_unpacker unpacker;
+	wavpack_unpacker_init(&unpacker, wpc,
+			      G_N_ELEMENTS(unpacker.chunk[0]) /
+			      audio_format.channels);
 
 	decoder_initialized(decoder, &audio_format, can_seek, total_time);
 
@@ -200,7 +601,7 @@ wavpack_decode(struct decoder *decoder, WavpackContext *wpc, bool can_seek)
 				unsigned where = decoder_seek_where(decoder) *
 					audio_format.sample_rate;
 
-				if (WavpackSeekSample(wpc, where)) {
+				if (wavpack_unpacker_seek(&unpacker, where)) {
 					decoder_command_finished(decoder);
 				} else {
 					decoder_seek_error(decoder);
@@ -210,20 +611,26 @@ wavpack_decode(struct decoder *decoder, WavpackContext *wpc, bool can_seek)
 			}
 		}
 
-		uint32_t samples_got = WavpackUnpackSamples(wpc, chunk,
-							    samples_requested);
+		unsigned slot;
+		int bitrate;
+		uint32_t samples_got = wavpack_unpacker_shift(&unpacker, &slot,
+							      &bitrate);
 		if (samples_got == 0)
 			break;
 
-		int bitrate = (int)(WavpackGetInstantBitrate(wpc) / 1000 +
-				    0.5);
-		format_samples(bytes_per_sample, chunk,
+		/* convert this chunk while the unpacker thread
+		   decodes the next one */
+		format_samples(bytes_per_sample, unpacker.chunk[slot],
 			       samples_got * audio_format.channels);
 
-		cmd = decoder_data(decoder, NULL, chunk,
+		cmd = decoder_data(decoder, NULL, unpacker.chunk[slot],
 				   samples_got * output_sample_size,
 				   bitrate);
+
+		wavpack_unpacker_consume(&unpacker);
 	}
+
+	wavpack_unpacker_deinit(&unpacker);
 }
 
 /**
@@ -19,6 +19,7 @@
 
 #include "config.h"
 #include "decoder_api.h"
+#include "decoder/_render_queue.h"
 #include "tag_handler.h"
 
 #include <glib.h>
@@ -30,8 +31,26 @@
 
 enum {
 	WILDMIDI_SAMPLE_RATE = 48000,
+
+	WILDMIDI_BUFFER_SIZE = 4096,
+
+	/** how many buffers to render ahead of playback */
+	WILDMIDI_RENDER_AHEAD = 4,
 };
 
+static size_t
+wildmidi_render(void *ctx, void *buffer, size_t size)
+{
+	midi *wm = ctx;
+
+	const struct _WM_Info *info = WildMidi_GetInfo(wm);
+	if (info == NULL)
+		return 0;
+
+	int len = WildMidi_GetOutput(wm, buffer, size);
+	return len > 0 ? (size_t)len : 0;
+}
+
 static bool
 wildmidi_init(const struct config_param *param)
 {
@@ -80,35 +99,39 @@ wildmidi_file_decode(struct decoder *decoder, const char *path_fs)
 	decoder_initialized(decoder, &audio_format, true,
 			    info->approx_total_samples / WILDMIDI_SAMPLE_RATE);
 
-	do {
-		char buffer[4096];
-		int len;
-
-		info = WildMidi_GetInfo(wm);
-		if (info == NULL)
-			break;
+	struct render_queue *rq = render_queue_new(wildmidi_render, wm,
+						   WILDMIDI_BUFFER_SIZE,
+						   WILDMIDI_RENDER_AHEAD);
 
-		len = WildMidi_GetOutput(wm, buffer, sizeof(buffer));
-		if (len <= 0)
+	do {
+		size_t nbytes;
+		const void *data = render_queue_shift(rq, &nbytes);
+		if (data == NULL)
 			break;
 
-		cmd = decoder_data(decoder, NULL, buffer, len, 0);
+		cmd = decoder_data(decoder, NULL, data, nbytes, 0);
+		render_queue_consume(rq);
 
 		if (cmd == DECODE_COMMAND_SEEK) {
 			unsigned long seek_where = WILDMIDI_SAMPLE_RATE *
 				decoder_seek_where(decoder);
 
+			render_queue_suspend(rq);
 #ifdef HAVE_WILDMIDI_SAMPLED_SEEK
 			WildMidi_SampledSeek(wm, &seek_where);
 #else
 			WildMidi_FastSeek(wm, &seek_where);
 #endif
+			render_queue_resume(rq);
+
 			decoder_command_finished(decoder);
 			cmd = DECODE_COMMAND_NONE;
 		}
 
 	} while (cmd == DECODE_COMMAND_NONE);
 
+	render_queue_free(rq);
+
 	WildMidi_Close(wm);
 }
 
@@ -19,6 +19,7 @@
 
 #include "config.h"
 #include "decoder_api.h"
+#include "output_all.h"
 #include "decoder_internal.h"
 #include "decoder_control.h"
 #include "audio_config.h"
@@ -27,6 +28,7 @@
 #include "pipe.h"
 #include "chunk.h"
 #include "replay_gain_config.h"
+#include "perf.h"
 
 #include <glib.h>
 
@@ -184,6 +186,12 @@ decoder_command_finished(struct decoder *decoder)
 			decoder->chunk = NULL;
 		}
 
+		/* withheld silence belongs to the old position, too;
+		   and we are in the middle of the song now, so what
+		   follows is not leading silence */
+		decoder_silence_drop(decoder);
+		decoder->audio_seen = true;
+
 		music_pipe_clear(dc->pipe, dc->buffer);
 
 		decoder->timestamp = dc->seek_where;
@@ -314,7 +322,7 @@ decoder_timestamp(struct decoder *decoder, double t)
  * (decoder.chunk) if there is one.
  */
 static enum decoder_command
-do_send_tag(struct decoder *decoder, const struct tag *tag)
+do_send_tag(struct decoder *decoder, struct tag *tag)
 {
 	struct music_chunk *chunk;
 
@@ -333,7 +341,9 @@ do_send_tag(struct decoder *decoder, const struct tag *tag)
 		return decoder->dc->command;
 	}
 
-	chunk->tag = tag_dup(tag);
+	/* tags are shared by reference; every chunk carrying this tag
+	   object adds one */
+	chunk->tag = tag_ref(tag);
 	return DECODE_COMMAND_NONE;
 }
 
@@ -362,11 +372,39 @@ update_stream_tag(struct decoder *decoder, struct input_stream *is)
 	return true;
 }
 
-enum decoder_command
-decoder_data(struct decoder *decoder,
-	     struct input_stream *is,
-	     const void *_data, size_t length,
-	     uint16_t kbit_rate)
+/**
+ * Checks for a new stream tag and sends it to the music pipe.
+ *
+ * @return the current command, or DECODE_COMMAND_NONE if the plugin
+ * may continue submitting data
+ */
+static enum decoder_command
+decoder_check_tag(struct decoder *decoder, struct input_stream *is)
+{
+	enum decoder_command cmd = DECODE_COMMAND_NONE;
+
+	if (update_stream_tag(decoder, is)) {
+		if (decoder->decoder_tag != NULL) {
+			/* merge with tag from decoder plugin */
+			struct tag *tag;
+
+			tag = tag_merge(decoder->decoder_tag,
+					decoder->stream_tag);
+			cmd = do_send_tag(decoder, tag);
+			tag_free(tag);
+		} else
+			/* send only the stream tag */
+			cmd = do_send_tag(decoder, decoder->stream_tag);
+	}
+
+	return cmd;
+}
+
+static enum decoder_command
+decoder_data_internal(struct decoder *decoder,
+		      struct input_stream *is,
+		      const void *_data, size_t length,
+		      uint16_t kbit_rate)
 {
 	struct decoder_control *dc = decoder->dc;
 	const char *data = _data;
@@ -387,22 +425,9 @@ decoder_data(struct decoder *decoder,
 
 	/* send stream tags */
 
-	if (update_stream_tag(decoder, is)) {
-		if (decoder->decoder_tag != NULL) {
-			/* merge with tag from decoder plugin */
-			struct tag *tag;
-
-			tag = tag_merge(decoder->decoder_tag,
-					decoder->stream_tag);
-			cmd = do_send_tag(decoder, tag);
-			tag_free(tag);
-		} else
-			/* send only the stream tag */
-			cmd = do_send_tag(decoder, decoder->stream_tag);
-
-		if (cmd != DECODE_COMMAND_NONE)
-			return cmd;
-	}
+	cmd = decoder_check_tag(decoder, is);
+	if (cmd != DECODE_COMMAND_NONE)
+		return cmd;
 
 	if (!audio_format_equals(&dc->in_audio_format, &dc->out_audio_format)) {
 		data = pcm_convert(&decoder->conv_state,
@@ -475,6 +500,111 @@ decoder_data(struct decoder *decoder,
 	return DECODE_COMMAND_NONE;
 }
 
+enum decoder_command
+decoder_data(struct decoder *decoder,
+	     struct input_stream *is,
+	     const void *data, size_t length,
+	     uint16_t kbit_rate)
+{
+	const uint64_t start = perf_begin();
+	enum decoder_command cmd =
+		decoder_data_internal(decoder, is, data, length, kbit_rate);
+	perf_end(PERF_DECODER_DATA, start);
+
+	return cmd;
+}
+
+enum decoder_command
+decoder_data_begin(struct decoder *decoder, struct input_stream *is,
+		   uint16_t kbit_rate,
+		   void **dest_r, size_t *max_length_r)
+{
+	struct decoder_control *dc = decoder->dc;
+	enum decoder_command cmd;
+
+	assert(dc->state == DECODE_STATE_DECODE);
+	assert(dc->pipe != NULL);
+
+	decoder_lock(dc);
+	cmd = decoder_get_virtual_command(decoder);
+	decoder_unlock(dc);
+
+	if (cmd == DECODE_COMMAND_STOP || cmd == DECODE_COMMAND_SEEK)
+		return cmd;
+
+	/* send stream tags */
+
+	cmd = decoder_check_tag(decoder, is);
+	if (cmd != DECODE_COMMAND_NONE)
+		return cmd;
+
+	if (!audio_format_equals(&dc->in_audio_format,
+				 &dc->out_audio_format)) {
+		/* the data would have to pass through pcm_convert();
+		   the plugin must use the buffered decoder_data()
+		   path */
+		*dest_r = NULL;
+		return DECODE_COMMAND_NONE;
+	}
+
+	while (true) {
+		struct music_chunk *chunk = decoder_get_chunk(decoder);
+		void *dest;
+
+		if (chunk == NULL) {
+			assert(dc->command != DECODE_COMMAND_NONE);
+			return dc->command;
+		}
+
+		dest = music_chunk_write(chunk, &dc->out_audio_format,
+					 decoder->timestamp -
+					 dc->song->start_ms / 1000.0,
+					 kbit_rate, max_length_r);
+		if (dest == NULL) {
+			/* the chunk is full, flush it */
+			decoder_flush_chunk(decoder);
+			g_cond_signal(dc->client_cond);
+			continue;
+		}
+
+		*dest_r = dest;
+		return DECODE_COMMAND_NONE;
+	}
+}
+
+enum decoder_command
+decoder_data_commit(struct decoder *decoder, size_t nbytes)
+{
+	struct decoder_control *dc = decoder->dc;
+	bool full;
+
+	assert(dc->state == DECODE_STATE_DECODE);
+	assert(decoder->chunk != NULL);
+	assert(nbytes % audio_format_frame_size(&dc->out_audio_format) == 0);
+
+	if (nbytes == 0)
+		return DECODE_COMMAND_NONE;
+
+	full = music_chunk_expand(decoder->chunk, &dc->out_audio_format,
+				  nbytes);
+	if (full) {
+		/* the chunk is full, flush it */
+		decoder_flush_chunk(decoder);
+		g_cond_signal(dc->client_cond);
+	}
+
+	decoder->timestamp += (double)nbytes /
+		audio_format_time_to_size(&dc->out_audio_format);
+
+	if (dc->end_ms > 0 &&
+	    decoder->timestamp >= dc->end_ms / 1000.0)
+		/* the end of this range has been reached: stop
+		   decoding */
+		return DECODE_COMMAND_STOP;
+
+	return DECODE_COMMAND_NONE;
+}
+
 enum decoder_command
 decoder_tag(G_GNUC_UNUSED struct decoder *decoder, struct input_stream *is,
 	    const struct tag *tag)
@@ -514,8 +644,9 @@ decoder_tag(G_GNUC_UNUSED struct decoder *decoder, struct input_stream *is,
 		cmd = do_send_tag(decoder, merged);
 		tag_free(merged);
 	} else
-		/* send only the decoder tag */
-		cmd = do_send_tag(decoder, tag);
+		/* send only the decoder tag (the private copy, so the
+		   plugin's object is not shared with the chunks) */
+		cmd = do_send_tag(decoder, decoder->decoder_tag);
 
 	return cmd;
 }
@@ -568,3 +699,10 @@ decoder_mixramp(struct decoder *decoder, float replay_gain_db,
 	dc_mixramp_start(dc, mixramp_start);
 	dc_mixramp_end(dc, mixramp_end);
 }
+
+bool
+decoder_supports_sample_format(G_GNUC_UNUSED struct decoder *decoder,
+			       enum sample_format sample_format)
+{
+	return audio_output_all_supports_sample_format(sample_format);
+}
@@ -131,6 +131,42 @@ decoder_data(struct decoder *decoder, struct input_stream *is,
 	     const void *data, size_t length,
 	     uint16_t kbit_rate);
 
+/**
+ * Opens a window into the current output chunk, so the plugin can
+ * write (e.g. interleave) decoded samples directly into the output
+ * buffer instead of handing decoder_data() an intermediate buffer to
+ * copy from.
+ *
+ * On success, *dest_r points to a buffer with room for *max_length_r
+ * bytes (always a multiple of the frame size); fill (part of) it and
+ * call decoder_data_commit() with the number of bytes written.  When
+ * the direct path is not available (a PCM conversion is configured),
+ * *dest_r is set to NULL, and the plugin must fall back to
+ * decoder_data().
+ *
+ * @param decoder the decoder object
+ * @param is an input stream which is buffering while we are waiting
+ * for the player
+ * @return the current command, or DECODE_COMMAND_NONE if the plugin
+ * may write
+ */
+enum decoder_command
+decoder_data_begin(struct decoder *decoder, struct input_stream *is,
+		   uint16_t kbit_rate,
+		   void **dest_r, size_t *max_length_r);
+
+/**
+ * Commits data written to the buffer returned by
+ * decoder_data_begin().  Pass the number of bytes actually written;
+ * it must be a whole number of frames, and no larger than the
+ * advertised capacity.
+ *
+ * @return the current command, or DECODE_COMMAND_NONE if there is no
+ * command pending
+ */
+enum decoder_command
+decoder_data_commit(struct decoder *decoder, size_t nbytes);
+
 /**
  * This function is called by the decoder plugin when it has
  * successfully decoded a tag.
@@ -170,4 +206,14 @@ void
 decoder_mixramp(struct decoder *decoder, float replay_gain_db,
 		char *mixramp_start, char *mixramp_end);
 
+/**
+ * Checks whether the configured outputs accept the given sample
+ * format without a conversion.  Decoders with a choice of output
+ * encodings (e.g. libmpg123) should prefer a format for which this
+ * returns true, so the pipeline carries one format end-to-end.
+ */
+bool
+decoder_supports_sample_format(struct decoder *decoder,
+			       enum sample_format sample_format);
+
 #endif
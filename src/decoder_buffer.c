@@ -20,16 +20,23 @@
 #include "config.h"
 #include "decoder_buffer.h"
 #include "decoder_api.h"
+#include "input_plugin.h"
 
 #include <glib.h>
 
 #include <assert.h>
 
+/**
+ * The alignment of the buffer base: enough for all SIMD decode
+ * kernels (SSE, NEON) to load from it directly.
+ */
+#define DECODER_BUFFER_ALIGN 16
+
 struct decoder_buffer {
 	struct decoder *decoder;
 	struct input_stream *is;
 
-	/** the allocated size of the buffer */
+	/** the allocated size of the buffer (always a power of two) */
 	size_t size;
 
 	/** the current length of the buffer */
@@ -39,25 +46,45 @@ struct decoder_buffer {
 	    buffer */
 	size_t consumed;
 
-	/** the actual buffer (dynamic size) */
-	unsigned char data[sizeof(size_t)];
+	/**
+	 * A zero-copy window into the input stream, obtained with
+	 * input_stream_peek(); supersedes #data when non-NULL.
+	 */
+	const unsigned char *window;
+
+	/** the actual buffer, aligned to #DECODER_BUFFER_ALIGN */
+	unsigned char *data;
+
+	/** the unaligned allocation behind #data */
+	unsigned char *allocation;
 };
 
 struct decoder_buffer *
 decoder_buffer_new(struct decoder *decoder, struct input_stream *is,
 		   size_t size)
 {
-	struct decoder_buffer *buffer =
-		g_malloc(sizeof(*buffer) - sizeof(buffer->data) + size);
-
 	assert(is != NULL);
 	assert(size > 0);
 
+	/* round up to a power of two, so the buffer cycles at a page
+	   friendly boundary */
+	size_t rounded = 1;
+	while (rounded < size)
+		rounded <<= 1;
+
+	struct decoder_buffer *buffer = g_new(struct decoder_buffer, 1);
+
 	buffer->decoder = decoder;
 	buffer->is = is;
-	buffer->size = size;
+	buffer->size = rounded;
 	buffer->length = 0;
 	buffer->consumed = 0;
+	buffer->window = NULL;
+
+	buffer->allocation = g_malloc(rounded + DECODER_BUFFER_ALIGN - 1);
+	buffer->data = (unsigned char *)
+		(((gsize)buffer->allocation + DECODER_BUFFER_ALIGN - 1) &
+		 ~((gsize)DECODER_BUFFER_ALIGN - 1));
 
 	return buffer;
 }
@@ -67,6 +94,7 @@ decoder_buffer_free(struct decoder_buffer *buffer)
 {
 	assert(buffer != NULL);
 
+	g_free(buffer->allocation);
 	g_free(buffer);
 }
 
@@ -79,7 +107,8 @@ decoder_buffer_is_empty(const struct decoder_buffer *buffer)
 bool
 decoder_buffer_is_full(const struct decoder_buffer *buffer)
 {
-	return buffer->consumed == 0 && buffer->length == buffer->size;
+	return buffer->window == NULL &&
+		buffer->length - buffer->consumed == buffer->size;
 }
 
 static void
@@ -92,17 +121,60 @@ decoder_buffer_shift(struct decoder_buffer *buffer)
 	buffer->consumed = 0;
 }
 
+/**
+ * Refresh the zero-copy window into the input stream: report
+ * consumed bytes to the stream, and peek at the data behind the new
+ * offset.
+ *
+ * @return true if new data became available
+ */
+static bool
+decoder_buffer_fill_direct(struct decoder_buffer *buffer)
+{
+	size_t remaining = buffer->length - buffer->consumed;
+	size_t nbytes;
+
+	if (buffer->consumed > 0) {
+		input_stream_lock_consume(buffer->is, buffer->consumed);
+		buffer->consumed = 0;
+	}
+
+	buffer->window = input_stream_lock_peek(buffer->is, &nbytes);
+	if (buffer->window == NULL) {
+		/* end of file (or a seek by the plugin) */
+		buffer->length = 0;
+		return false;
+	}
+
+	buffer->length = nbytes;
+	return nbytes > remaining;
+}
+
 bool
 decoder_buffer_fill(struct decoder_buffer *buffer)
 {
 	size_t nbytes;
 
-	if (buffer->consumed > 0)
-		decoder_buffer_shift(buffer);
+	if (buffer->is->plugin->peek != NULL)
+		/* the input stream exposes its data without copying
+		   (e.g. a mapped file); use it directly instead of
+		   filling our own buffer */
+		return decoder_buffer_fill_direct(buffer);
 
-	if (buffer->length >= buffer->size)
-		/* buffer is full */
-		return false;
+	if (buffer->consumed == buffer->length)
+		/* empty: reset to the aligned base for free */
+		buffer->consumed = buffer->length = 0;
+
+	if (buffer->length == buffer->size) {
+		if (buffer->consumed == 0)
+			/* buffer is full */
+			return false;
+
+		/* the write position has reached the end of the
+		   allocation: only now copy the remainder to the
+		   front; consuming alone never copies */
+		decoder_buffer_shift(buffer);
+	}
 
 	nbytes = decoder_read(buffer->decoder, buffer->is,
 			      buffer->data + buffer->length,
@@ -126,7 +198,8 @@ decoder_buffer_read(const struct decoder_buffer *buffer, size_t *length_r)
 		return NULL;
 
 	*length_r = buffer->length - buffer->consumed;
-	return buffer->data + buffer->consumed;
+	return (buffer->window != NULL
+		? buffer->window : buffer->data) + buffer->consumed;
 }
 
 void
@@ -138,6 +211,12 @@ decoder_buffer_consume(struct decoder_buffer *buffer, size_t nbytes)
 	buffer->consumed += nbytes;
 
 	assert(buffer->consumed <= buffer->length);
+
+	if (buffer->window == NULL &&
+	    buffer->consumed == buffer->length)
+		/* everything was consumed: rewind to the aligned
+		   base, which costs nothing */
+		buffer->consumed = buffer->length = 0;
 }
 
 bool
@@ -27,6 +27,11 @@
  * This objects handles buffered reads in decoder plugins easily.  You
  * create a buffer object, and use its high-level methods to fill and
  * read it.  It will automatically handle shifting the buffer.
+ *
+ * The buffer base is 16-byte aligned: pointers returned by
+ * decoder_buffer_read() right after a rewind are suitable for SIMD
+ * decode kernels, and stay aligned as long as the plugin consumes
+ * multiples of 16 bytes.
  */
 struct decoder_buffer;
 
@@ -38,7 +43,8 @@ struct input_stream;
  *
  * @param decoder the decoder object, used for decoder_read(), may be NULL
  * @param is the input stream object where we should read from
- * @param size the maximum size of the buffer
+ * @param size the maximum size of the buffer (rounded up to the next
+ * power of two)
  * @return the new decoder_buffer object
  */
 struct decoder_buffer *
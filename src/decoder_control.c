@@ -40,6 +40,8 @@ dc_new(GCond *client_cond)
 	dc->state = DECODE_STATE_STOP;
 	dc->command = DECODE_COMMAND_NONE;
 
+	dc->pipe_limit = 0;
+
 	dc->replay_gain_db = 0;
 	dc->replay_gain_prev_db = 0;
 	dc->mixramp_start = NULL;
@@ -130,6 +132,17 @@ dc_stop(struct decoder_control *dc)
 	decoder_unlock(dc);
 }
 
+void
+dc_limit(struct decoder_control *dc, unsigned pipe_limit)
+{
+	decoder_lock(dc);
+
+	dc->pipe_limit = pipe_limit;
+	decoder_signal(dc);
+
+	decoder_unlock(dc);
+}
+
 bool
 dc_seek(struct decoder_control *dc, double where)
 {
@@ -113,6 +113,15 @@ struct decoder_control {
 	 */
 	struct music_pipe *pipe;
 
+	/**
+	 * The maximum number of chunks this decoder may keep in
+	 * #pipe; 0 means unlimited.  The player sets this on the
+	 * standby decoder, to let it pre-decode only the head of the
+	 * queued song without starving the playing decoder of shared
+	 * #music_buffer chunks.  Protected by #mutex.
+	 */
+	unsigned pipe_limit;
+
 	float replay_gain_db;
 	float replay_gain_prev_db;
 	char *mixramp_start;
@@ -259,6 +268,16 @@ dc_start(struct decoder_control *dc, struct song *song,
 void
 dc_stop(struct decoder_control *dc);
 
+/**
+ * Set the pipe limit (see #decoder_control), and wake up the decoder
+ * if it is waiting for the limit to be lifted.
+ *
+ * @param pipe_limit the maximum number of chunks in the pipe; 0 means
+ * unlimited
+ */
+void
+dc_limit(struct decoder_control *dc, unsigned pipe_limit);
+
 bool
 dc_seek(struct decoder_control *dc, double where);
 
@@ -24,6 +24,9 @@
 #include "input_stream.h"
 #include "buffer.h"
 #include "chunk.h"
+#include "pcm_silence.h"
+#include "conf.h"
+#include "perf.h"
 
 #include <assert.h>
 
@@ -60,6 +63,20 @@ decoder_get_chunk(struct decoder *decoder)
 		return decoder->chunk;
 
 	do {
+		decoder_lock(dc);
+		if (dc->pipe_limit > 0 &&
+		    music_pipe_size(dc->pipe) >= dc->pipe_limit) {
+			/* this decoder is pre-decoding the queued
+			   song and has filled its quota; wait for the
+			   player to lift the limit at the song
+			   border */
+			cmd = need_chunks(dc, true);
+			decoder_unlock(dc);
+			continue;
+		}
+
+		decoder_unlock(dc);
+
 		decoder->chunk = music_buffer_allocate(dc->buffer);
 		if (decoder->chunk != NULL) {
 			decoder->chunk->replay_gain_serial =
@@ -79,6 +96,89 @@ decoder_get_chunk(struct decoder *decoder)
 	return NULL;
 }
 
+/**
+ * Upper bound for the number of consecutive silent chunks which are
+ * withheld as a trailing silence candidate.  Silence longer than this
+ * is considered part of the song and played normally; the limit also
+ * keeps the music_buffer from being exhausted, which would starve
+ * decoder_get_chunk().
+ */
+enum { SILENCE_TRIM_MAX_CHUNKS = 64 };
+
+/**
+ * The default RMS threshold, about -54 dB below full scale.
+ */
+enum { DEFAULT_SILENCE_TRIM_THRESHOLD = 64 };
+
+/**
+ * The RMS threshold (on the 16 bit sample scale) below which a chunk
+ * counts as silent; 0 means silence trimming is disabled, -1 that the
+ * configuration has not been read yet.
+ */
+static int silence_trim_threshold = -1;
+
+static int
+decoder_silence_threshold(void)
+{
+	if (G_UNLIKELY(silence_trim_threshold < 0))
+		silence_trim_threshold =
+			config_get_bool(CONF_SILENCE_TRIM, false)
+			? (int)config_get_unsigned(CONF_SILENCE_TRIM_THRESHOLD,
+						   DEFAULT_SILENCE_TRIM_THRESHOLD)
+			: 0;
+
+	return silence_trim_threshold;
+}
+
+static void
+decoder_push_chunk(struct decoder *decoder, struct music_chunk *chunk)
+{
+#ifdef ENABLE_PERF_COUNTERS
+	/* stamp the chunk, to measure how long it sits in the pipe
+	   before the output thread picks it up */
+	chunk->stamp_ns = perf_begin();
+#endif
+
+	music_pipe_push(decoder->dc->pipe, chunk);
+}
+
+/**
+ * Releases all withheld silence chunks into the pipe, in their
+ * original order: the silence was followed by audio, so it is part of
+ * the song.
+ */
+static void
+decoder_silence_flush(struct decoder *decoder)
+{
+	struct music_chunk *chunk = decoder->silence_chunks;
+
+	while (chunk != NULL) {
+		struct music_chunk *next = chunk->next;
+		decoder_push_chunk(decoder, chunk);
+		chunk = next;
+	}
+
+	decoder->silence_chunks = NULL;
+	decoder->silence_tail = NULL;
+	decoder->n_silence_chunks = 0;
+}
+
+void
+decoder_silence_drop(struct decoder *decoder)
+{
+	struct music_chunk *chunk = decoder->silence_chunks;
+
+	while (chunk != NULL) {
+		struct music_chunk *next = chunk->next;
+		music_buffer_return(decoder->dc->buffer, chunk);
+		chunk = next;
+	}
+
+	decoder->silence_chunks = NULL;
+	decoder->silence_tail = NULL;
+	decoder->n_silence_chunks = 0;
+}
+
 void
 decoder_flush_chunk(struct decoder *decoder)
 {
@@ -87,10 +187,52 @@ decoder_flush_chunk(struct decoder *decoder)
 	assert(decoder != NULL);
 	assert(decoder->chunk != NULL);
 
-	if (music_chunk_is_empty(decoder->chunk))
-		music_buffer_return(dc->buffer, decoder->chunk);
-	else
-		music_pipe_push(dc->pipe, decoder->chunk);
-
+	struct music_chunk *chunk = decoder->chunk;
 	decoder->chunk = NULL;
+
+	if (music_chunk_is_empty(chunk)) {
+		music_buffer_return(dc->buffer, chunk);
+		return;
+	}
+
+	const int threshold = decoder_silence_threshold();
+	if (threshold <= 0) {
+		decoder_push_chunk(decoder, chunk);
+		return;
+	}
+
+	if (chunk->tag == NULL &&
+	    pcm_silence_detect(chunk->data, chunk->length,
+			       dc->out_audio_format.format,
+			       (unsigned)threshold)) {
+		if (!decoder->audio_seen) {
+			/* leading silence: throw it away, so playback
+			   starts at the first audio */
+			music_buffer_return(dc->buffer, chunk);
+			return;
+		}
+
+		if (decoder->n_silence_chunks < SILENCE_TRIM_MAX_CHUNKS) {
+			/* withhold the chunk; if the song ends before
+			   audio follows, it was trailing silence and
+			   is thrown away */
+			chunk->next = NULL;
+			if (decoder->silence_tail != NULL)
+				decoder->silence_tail->next = chunk;
+			else
+				decoder->silence_chunks = chunk;
+			decoder->silence_tail = chunk;
+			++decoder->n_silence_chunks;
+			return;
+		}
+
+		/* this pause is too long to be an outro: play it */
+		decoder_silence_flush(decoder);
+		decoder_push_chunk(decoder, chunk);
+		return;
+	}
+
+	decoder->audio_seen = true;
+	decoder_silence_flush(decoder);
+	decoder_push_chunk(decoder, chunk);
 }
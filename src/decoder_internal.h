@@ -73,6 +73,24 @@ struct decoder {
 	/** the chunk currently being written to */
 	struct music_chunk *chunk;
 
+	/**
+	 * Has a non-silent chunk been seen since decoding (or the
+	 * last seek)?  While this is false, silent chunks are leading
+	 * silence, and silence trimming throws them away.
+	 */
+	bool audio_seen;
+
+	/**
+	 * A FIFO of withheld chunks (chained via music_chunk.next)
+	 * which contained only silence.  They are released into the
+	 * pipe when audio follows, and thrown away when the song ends
+	 * first, which removes trailing silence from the stream.
+	 */
+	struct music_chunk *silence_chunks, *silence_tail;
+
+	/** the number of chunks in #silence_chunks */
+	unsigned n_silence_chunks;
+
 	struct replay_gain_info replay_gain_info;
 
 	/**
@@ -97,4 +115,12 @@ decoder_get_chunk(struct decoder *decoder);
 void
 decoder_flush_chunk(struct decoder *decoder);
 
+/**
+ * Returns all withheld silence chunks to the buffer without playing
+ * them.  Call this when the song ends (to remove trailing silence)
+ * and after a seek (the withheld chunks belong to the old position).
+ */
+void
+decoder_silence_drop(struct decoder *decoder);
+
 #endif
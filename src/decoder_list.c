@@ -28,6 +28,7 @@
 
 #include <glib.h>
 
+#include <assert.h>
 #include <string.h>
 
 extern const struct decoder_plugin mad_decoder_plugin;
@@ -188,6 +189,95 @@ decoder_plugin_from_name(const char *name)
 	return NULL;
 }
 
+/**
+ * Cache of successful probes: maps (suffix, first bytes) to the
+ * decoder plugin which decoded such a file before, so repeat plays
+ * don't have to trial-decode through the whole plugin list again.
+ * Protected by #probe_cache_mutex because the decoder thread and
+ * update threads may consult it concurrently.
+ */
+static GHashTable *probe_cache;
+static GStaticMutex probe_cache_mutex = G_STATIC_MUTEX_INIT;
+
+/**
+ * An arbitrary limit, to keep a rogue music collection from growing
+ * the cache indefinitely.  Real collections have only a handful of
+ * (suffix, first bytes) combinations.
+ */
+#define PROBE_CACHE_MAX_SIZE 256
+
+/**
+ * Builds the hash table key for a (suffix, first bytes) combination.
+ * The suffix is lowercased (suffix matching is case insensitive) and
+ * the magic bytes are hex-encoded, because they may contain NUL
+ * bytes.
+ */
+static char *
+decoder_probe_cache_key(const char *suffix,
+			const void *magic, size_t magic_length)
+{
+	const unsigned char *p = magic;
+	GString *key = g_string_sized_new(16);
+
+	for (; *suffix != 0; ++suffix)
+		g_string_append_c(key, g_ascii_tolower(*suffix));
+
+	g_string_append_c(key, '/');
+
+	for (size_t i = 0; i < magic_length; ++i)
+		g_string_append_printf(key, "%02x", p[i]);
+
+	return g_string_free(key, false);
+}
+
+const struct decoder_plugin *
+decoder_probe_cache_lookup(const char *suffix,
+			   const void *magic, size_t magic_length)
+{
+	const struct decoder_plugin *plugin = NULL;
+
+	assert(suffix != NULL);
+
+	g_static_mutex_lock(&probe_cache_mutex);
+
+	if (probe_cache != NULL) {
+		char *key = decoder_probe_cache_key(suffix, magic,
+						    magic_length);
+		plugin = g_hash_table_lookup(probe_cache, key);
+		g_free(key);
+	}
+
+	g_static_mutex_unlock(&probe_cache_mutex);
+
+	return plugin;
+}
+
+void
+decoder_probe_cache_put(const char *suffix,
+			const void *magic, size_t magic_length,
+			const struct decoder_plugin *plugin)
+{
+	assert(suffix != NULL);
+	assert(plugin != NULL);
+
+	g_static_mutex_lock(&probe_cache_mutex);
+
+	if (probe_cache != NULL &&
+	    g_hash_table_size(probe_cache) < PROBE_CACHE_MAX_SIZE) {
+		union {
+			const struct decoder_plugin *in;
+			gpointer out;
+		} u = { .in = plugin };
+
+		g_hash_table_replace(probe_cache,
+				     decoder_probe_cache_key(suffix, magic,
+							     magic_length),
+				     u.out);
+	}
+
+	g_static_mutex_unlock(&probe_cache_mutex);
+}
+
 /**
  * Find the "decoder" configuration block for the specified plugin.
  *
@@ -215,6 +305,9 @@ decoder_plugin_config(const char *plugin_name)
 
 void decoder_plugin_init_all(void)
 {
+	probe_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+					    g_free, NULL);
+
 	for (unsigned i = 0; decoder_plugins[i] != NULL; ++i) {
 		const struct decoder_plugin *plugin = decoder_plugins[i];
 		const struct config_param *param =
@@ -237,4 +330,9 @@ void decoder_plugin_deinit_all(void)
 		if (decoder_plugins_enabled[i])
 			decoder_plugin_finish(plugin);
 	}
+
+	g_static_mutex_lock(&probe_cache_mutex);
+	g_hash_table_destroy(probe_cache);
+	probe_cache = NULL;
+	g_static_mutex_unlock(&probe_cache_mutex);
 }
@@ -21,9 +21,15 @@
 #define MPD_DECODER_LIST_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 struct decoder_plugin;
 
+/**
+ * How many leading bytes of a file take part in the probe cache key.
+ */
+#define DECODER_PROBE_MAGIC_SIZE 8
+
 extern const struct decoder_plugin *const decoder_plugins[];
 extern bool decoder_plugins_enabled[];
 
@@ -46,6 +52,30 @@ decoder_plugin_from_mime_type(const char *mimeType, unsigned int next);
 const struct decoder_plugin *
 decoder_plugin_from_name(const char *name);
 
+/**
+ * Look up the plugin which successfully decoded a file with this
+ * (suffix, first bytes) combination before.
+ *
+ * @param suffix the file name suffix
+ * @param magic the first bytes of the file
+ * @param magic_length the number of bytes in #magic; may be 0 if the
+ * beginning of the file is not available
+ * @return a plugin, or NULL if this combination has not been seen yet
+ */
+const struct decoder_plugin *
+decoder_probe_cache_lookup(const char *suffix,
+			   const void *magic, size_t magic_length);
+
+/**
+ * Record that the specified plugin has successfully decoded a file
+ * with this (suffix, first bytes) combination; it will be tried first
+ * next time.
+ */
+void
+decoder_probe_cache_put(const char *suffix,
+			const void *magic, size_t magic_length,
+			const struct decoder_plugin *plugin);
+
 /* this is where we "load" all the "plugins" ;-) */
 void decoder_plugin_init_all(void);
 
@@ -100,6 +100,16 @@ struct decoder_plugin {
 	 */
 	char* (*container_scan)(const char *path_fs, const unsigned int tnum);
 
+	/**
+	 * The maximum number of bytes the scan_stream() method needs
+	 * to read from the stream to find all metadata; bytes skipped
+	 * with seeks do not count.  0 means unknown, and the tag
+	 * scanner applies a conservative default.  Scans exceeding
+	 * this budget are aborted, so that one misdetected file
+	 * cannot make the database update read it completely.
+	 */
+	size_t scan_read_limit;
+
 	/* last element in these arrays must always be a NULL: */
 	const char *const*suffixes;
 	const char *const*mime_types;
@@ -38,6 +38,7 @@
 
 #include <unistd.h>
 #include <stdio.h> /* for SEEK_SET */
+#include <string.h>
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "decoder_thread"
@@ -186,12 +187,43 @@ deconst_plugin(const struct decoder_plugin *plugin)
 	return u.out;
 }
 
+/**
+ * Copies the first bytes of the stream into the caller's buffer, for
+ * the probe cache key.  The stream position is not changed.
+ *
+ * The caller must lock the stream's mutex.
+ *
+ * @return the number of bytes copied; 0 if the input plugin does not
+ * support peeking
+ */
+static size_t
+decoder_stream_magic(struct input_stream *is,
+		     unsigned char magic[DECODER_PROBE_MAGIC_SIZE])
+{
+	size_t length;
+	const void *data;
+
+	if (is->offset != 0)
+		return 0;
+
+	data = input_stream_peek(is, &length);
+	if (data == NULL)
+		return 0;
+
+	if (length > DECODER_PROBE_MAGIC_SIZE)
+		length = DECODER_PROBE_MAGIC_SIZE;
+
+	memcpy(magic, data, length);
+	return length;
+}
+
 /**
  * Try decoding a stream, using plugins matching the stream's MIME type.
  *
  * @param tried_r a list of plugins which were tried
+ * @return the plugin which decoded the stream, or NULL on failure
  */
-static bool
+static const struct decoder_plugin *
 decoder_run_stream_mime_type(struct decoder *decoder, struct input_stream *is,
 			     GSList **tried_r)
 {
@@ -201,7 +233,7 @@ decoder_run_stream_mime_type(struct decoder *decoder, struct input_stream *is,
 	unsigned int next = 0;
 
 	if (is->mime == NULL)
-		return false;
+		return NULL;
 
 	while ((plugin = decoder_plugin_from_mime_type(is->mime, next++))) {
 		if (plugin->stream_decode == NULL)
@@ -212,12 +244,12 @@ decoder_run_stream_mime_type(struct decoder *decoder, struct input_stream *is,
 			continue;
 
 		if (decoder_stream_decode(plugin, decoder, is))
-			return true;
+			return plugin;
 
 		*tried_r = g_slist_prepend(*tried_r, deconst_plugin(plugin));
 	}
 
-	return false;
+	return NULL;
 }
 
 /**
@@ -225,8 +257,9 @@ decoder_run_stream_mime_type(struct decoder *decoder, struct input_stream *is,
  * suffix.
  *
  * @param tried_r a list of plugins which were tried
+ * @return the plugin which decoded the stream, or NULL on failure
  */
-static bool
+static const struct decoder_plugin *
 decoder_run_stream_suffix(struct decoder *decoder, struct input_stream *is,
 			  const char *uri, GSList **tried_r)
 {
@@ -236,7 +269,7 @@ decoder_run_stream_suffix(struct decoder *decoder, struct input_stream *is,
 	const struct decoder_plugin *plugin = NULL;
 
 	if (suffix == NULL)
-		return false;
+		return NULL;
 
 	while ((plugin = decoder_plugin_from_suffix(suffix, plugin)) != NULL) {
 		if (plugin->stream_decode == NULL)
@@ -247,25 +280,28 @@ decoder_run_stream_suffix(struct decoder *decoder, struct input_stream *is,
 			continue;
 
 		if (decoder_stream_decode(plugin, decoder, is))
-			return true;
+			return plugin;
 
 		*tried_r = g_slist_prepend(*tried_r, deconst_plugin(plugin));
 	}
 
-	return false;
+	return NULL;
 }
 
 /**
  * Try decoding a stream, using the fallback plugin.
+ *
+ * @return the plugin which decoded the stream, or NULL on failure
  */
-static bool
+static const struct decoder_plugin *
 decoder_run_stream_fallback(struct decoder *decoder, struct input_stream *is)
 {
 	const struct decoder_plugin *plugin;
 
 	plugin = decoder_plugin_from_name("mad");
 	return plugin != NULL && plugin->stream_decode != NULL &&
-		decoder_stream_decode(plugin, decoder, is);
+		decoder_stream_decode(plugin, decoder, is)
+		? plugin : NULL;
 }
 
 /**
@@ -290,16 +326,60 @@ decoder_run_stream(struct decoder *decoder, const char *uri)
 
 	GSList *tried = NULL;
 
-	success = dc->command == DECODE_COMMAND_STOP ||
-		/* first we try mime types: */
-		decoder_run_stream_mime_type(decoder, input_stream, &tried) ||
-		/* if that fails, try suffix matching the URL: */
-		decoder_run_stream_suffix(decoder, input_stream, uri,
-					  &tried) ||
-		/* fallback to mp3: this is needed for bastard streams
-		   that don't have a suffix or set the mimeType */
-		(tried == NULL &&
-		 decoder_run_stream_fallback(decoder, input_stream));
+	const char *suffix = uri_get_suffix(uri);
+
+	unsigned char magic[DECODER_PROBE_MAGIC_SIZE];
+	size_t magic_length = decoder_stream_magic(input_stream, magic);
+
+	const struct decoder_plugin *cached = suffix != NULL
+		? decoder_probe_cache_lookup(suffix, magic, magic_length)
+		: NULL;
+	const struct decoder_plugin *plugin = NULL;
+
+	if (dc->command == DECODE_COMMAND_STOP)
+		success = true;
+	else {
+		if (cached != NULL && cached->stream_decode != NULL) {
+			/* the plugin which decoded this (suffix,
+			   first bytes) combination before gets the
+			   first shot */
+			if (decoder_stream_decode(cached, decoder,
+						  input_stream))
+				plugin = cached;
+			else
+				tried = g_slist_prepend(tried,
+							deconst_plugin(cached));
+		}
+
+		if (plugin == NULL)
+			/* first we try mime types: */
+			plugin = decoder_run_stream_mime_type(decoder,
+							      input_stream,
+							      &tried);
+
+		if (plugin == NULL)
+			/* if that fails, try suffix matching the URL: */
+			plugin = decoder_run_stream_suffix(decoder,
+							   input_stream, uri,
+							   &tried);
+
+		if (plugin == NULL && tried == NULL)
+			/* fallback to mp3: this is needed for bastard
+			   streams that don't have a suffix or set the
+			   mimeType */
+			plugin = decoder_run_stream_fallback(decoder,
+							     input_stream);
+
+		success = plugin != NULL;
+
+		if (plugin != NULL && plugin != cached && suffix != NULL &&
+		    dc->state == DECODE_STATE_DECODE)
+			/* remember the winner; the state check skips
+			   plugins which "succeeded" only because a
+			   STOP command arrived */
+			decoder_probe_cache_put(suffix, magic, magic_length,
+						plugin);
+	}
 
 	g_slist_free(tried);
 
@@ -317,11 +397,93 @@ decoder_run_stream(struct decoder *decoder, const char *uri)
 static void
 decoder_load_replay_gain(struct decoder *decoder, const char *path_fs)
 {
+	const struct song *song = decoder->dc->song;
+	if (song != NULL && song->replay_gain != NULL) {
+		/* use the data collected by the update scan; no file
+		   access needed */
+		decoder_replay_gain(decoder, song->replay_gain);
+		return;
+	}
+
 	struct replay_gain_info info;
+	replay_gain_info_init(&info);
 	if (replay_gain_ape_read(path_fs, &info))
 		decoder_replay_gain(decoder, &info);
 }
 
+/**
+ * Pass MixRamp data from the database to the decoder control, so the
+ * player can calculate the crossfade overlap before the decoder
+ * plugin has seen (or if it never parses) the MixRamp tags.
+ */
+static void
+decoder_load_mixramp(struct decoder_control *dc)
+{
+	const struct song *song = dc->song;
+	if (song == NULL)
+		return;
+
+	if (song->mixramp_start != NULL)
+		dc_mixramp_start(dc, g_strdup(song->mixramp_start));
+	if (song->mixramp_end != NULL)
+		dc_mixramp_end(dc, g_strdup(song->mixramp_end));
+}
+
+/**
+ * Reads the first bytes of the file, for the probe cache key.
+ *
+ * @return the number of bytes copied; 0 if the file could not be read
+ */
+static size_t
+decoder_file_magic(const char *path_fs,
+		   unsigned char magic[DECODER_PROBE_MAGIC_SIZE])
+{
+	FILE *file = fopen(path_fs, "rb");
+	size_t nbytes;
+
+	if (file == NULL)
+		return 0;
+
+	nbytes = fread(magic, 1, DECODER_PROBE_MAGIC_SIZE, file);
+	fclose(file);
+
+	return nbytes;
+}
+
+/**
+ * Try decoding a file with the specified plugin.  The decoder must be
+ * unlocked, and is returned unlocked.
+ */
+static bool
+decoder_run_file_plugin(struct decoder *decoder, const char *path_fs,
+			const struct decoder_plugin *plugin)
+{
+	struct decoder_control *dc = decoder->dc;
+	bool success;
+
+	if (plugin->file_decode != NULL) {
+		decoder_lock(dc);
+		success = decoder_file_decode(plugin, decoder, path_fs);
+		decoder_unlock(dc);
+	} else if (plugin->stream_decode != NULL) {
+		struct input_stream *input_stream;
+
+		input_stream = decoder_input_stream_open(dc, path_fs);
+		if (input_stream == NULL)
+			return false;
+
+		decoder_lock(dc);
+		success = decoder_stream_decode(plugin, decoder,
+						input_stream);
+		decoder_unlock(dc);
+
+		input_stream_close(input_stream);
+	} else
+		success = false;
+
+	return success;
+}
+
 /**
  * Try decoding a file.
  */
@@ -338,36 +500,37 @@ decoder_run_file(struct decoder *decoder, const char *path_fs)
 	decoder_unlock(dc);
 
 	decoder_load_replay_gain(decoder, path_fs);
+	decoder_load_mixramp(dc);
 
-	while ((plugin = decoder_plugin_from_suffix(suffix, plugin)) != NULL) {
-		if (plugin->file_decode != NULL) {
-			decoder_lock(dc);
+	unsigned char magic[DECODER_PROBE_MAGIC_SIZE];
+	size_t magic_length = decoder_file_magic(path_fs, magic);
 
-			if (decoder_file_decode(plugin, decoder, path_fs))
-				return true;
-
-			decoder_unlock(dc);
-		} else if (plugin->stream_decode != NULL) {
-			struct input_stream *input_stream;
-			bool success;
+	/* the plugin which decoded this (suffix, first bytes)
+	   combination before gets the first shot */
+	const struct decoder_plugin *cached =
+		decoder_probe_cache_lookup(suffix, magic, magic_length);
+	if (cached != NULL &&
+	    decoder_run_file_plugin(decoder, path_fs, cached)) {
+		decoder_lock(dc);
+		return true;
+	}
 
-			input_stream = decoder_input_stream_open(dc, path_fs);
-			if (input_stream == NULL)
-				continue;
+	while ((plugin = decoder_plugin_from_suffix(suffix, plugin)) != NULL) {
+		if (plugin == cached)
+			/* already tried above */
+			continue;
 
+		if (decoder_run_file_plugin(decoder, path_fs, plugin)) {
 			decoder_lock(dc);
 
-			success = decoder_stream_decode(plugin, decoder,
-							input_stream);
-
-			decoder_unlock(dc);
-
-			input_stream_close(input_stream);
+			if (dc->state == DECODE_STATE_DECODE)
+				/* the state check skips plugins which
+				   "succeeded" only because a STOP
+				   command arrived */
+				decoder_probe_cache_put(suffix, magic,
+							magic_length, plugin);
 
-			if (success) {
-				decoder_lock(dc);
-				return true;
-			}
+			return true;
 		}
 	}
 
@@ -413,6 +576,10 @@ decoder_run_song(struct decoder_control *dc,
 	if (decoder.chunk != NULL)
 		decoder_flush_chunk(&decoder);
 
+	/* silence withheld at the end of the song is trailing silence
+	   and is not played */
+	decoder_silence_drop(&decoder);
+
 	if (decoder.song_tag != NULL)
 		tag_free(decoder.song_tag);
 
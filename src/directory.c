@@ -26,6 +26,7 @@
 #include "util/list_sort.h"
 #include "db_visitor.h"
 #include "db_lock.h"
+#include "db_index.h"
 
 #include <glib.h>
 
@@ -46,7 +47,7 @@ directory_new(const char *path, struct directory *parent)
 			      sizeof(directory->path) + pathlen + 1);
 	INIT_LIST_HEAD(&directory->children);
 	INIT_LIST_HEAD(&directory->songs);
-	INIT_LIST_HEAD(&directory->playlists);
+	playlist_vector_init(&directory->playlists);
 
 	directory->parent = parent;
 	memcpy(directory->path, path, pathlen + 1);
@@ -54,19 +55,43 @@ directory_new(const char *path, struct directory *parent)
 	return directory;
 }
 
+/**
+ * Insert a new child into the parent's name index, creating the index
+ * on demand.
+ */
+static void
+directory_map_child(struct directory *parent, struct directory *child)
+{
+	if (parent->children_map == NULL)
+		parent->children_map = g_hash_table_new(g_str_hash,
+							g_str_equal);
+
+	g_hash_table_insert(parent->children_map,
+			    (gpointer)directory_get_name(child), child);
+}
+
 void
 directory_free(struct directory *directory)
 {
 	playlist_vector_deinit(&directory->playlists);
 
+	if (directory->children_map != NULL)
+		g_hash_table_destroy(directory->children_map);
+	if (directory->songs_map != NULL)
+		g_hash_table_destroy(directory->songs_map);
+
 	struct song *song, *ns;
-	directory_for_each_song_safe(song, ns, directory)
+	directory_for_each_song_safe(song, ns, directory) {
+		db_index_remove_song(song);
 		song_free(song);
+	}
 
 	struct directory *child, *n;
 	directory_for_each_child_safe(child, n, directory)
 		directory_free(child);
 
+	g_free(directory->path_fs_cache);
+	g_free(directory->collate_key);
 	g_free(directory);
 	/* this resets last dir returned */
 	/*directory_get_path(NULL); */
@@ -80,6 +105,8 @@ directory_delete(struct directory *directory)
 	assert(directory->parent != NULL);
 
 	list_del(&directory->siblings);
+	g_hash_table_remove(directory->parent->children_map,
+			    directory_get_name(directory));
 	directory_free(directory);
 }
 
@@ -112,20 +139,19 @@ directory_new_child(struct directory *parent, const char *name_utf8)
 	g_free(allocated);
 
 	list_add_tail(&directory->siblings, &parent->children);
+	directory_map_child(parent, directory);
 	return directory;
 }
 
 struct directory *
 directory_get_child(const struct directory *directory, const char *name)
 {
-	assert(holding_db_lock());
+	assert(holding_db_read_lock());
 
-	struct directory *child;
-	directory_for_each_child(child, directory)
-		if (strcmp(directory_get_name(child), name) == 0)
-			return child;
+	if (directory->children_map == NULL)
+		return NULL;
 
-	return NULL;
+	return g_hash_table_lookup(directory->children_map, name);
 }
 
 void
@@ -145,7 +171,7 @@ directory_prune_empty(struct directory *directory)
 struct directory *
 directory_lookup_directory(struct directory *directory, const char *uri)
 {
-	assert(holding_db_lock());
+	assert(holding_db_read_lock());
 	assert(uri != NULL);
 
 	if (isRootDirectory(uri))
@@ -183,6 +209,14 @@ directory_add_song(struct directory *directory, struct song *song)
 	assert(song->parent == directory);
 
 	list_add_tail(&song->siblings, &directory->songs);
+
+	if (directory->songs_map == NULL)
+		directory->songs_map = g_hash_table_new(g_str_hash,
+							g_str_equal);
+
+	g_hash_table_insert(directory->songs_map, song->uri, song);
+
+	db_index_add_song(song);
 }
 
 void
@@ -194,24 +228,25 @@ directory_remove_song(G_GNUC_UNUSED struct directory *directory,
 	assert(song->parent == directory);
 
 	list_del(&song->siblings);
+	g_hash_table_remove(directory->songs_map, song->uri);
+
+	db_index_remove_song(song);
 }
 
 struct song *
 directory_get_song(const struct directory *directory, const char *name_utf8)
 {
-	assert(holding_db_lock());
+	assert(holding_db_read_lock());
 	assert(directory != NULL);
 	assert(name_utf8 != NULL);
 
-	struct song *song;
-	directory_for_each_song(song, directory) {
-		assert(song->parent == directory);
+	if (directory->songs_map == NULL)
+		return NULL;
 
-		if (strcmp(song->uri, name_utf8) == 0)
-			return song;
-	}
-
-	return NULL;
+	struct song *song = g_hash_table_lookup(directory->songs_map,
+						name_utf8);
+	assert(song == NULL || song->parent == directory);
+	return song;
 }
 
 struct song *
@@ -219,7 +254,7 @@ directory_lookup_song(struct directory *directory, const char *uri)
 {
 	char *duplicated, *base;
 
-	assert(holding_db_lock());
+	assert(holding_db_read_lock());
 	assert(directory != NULL);
 	assert(uri != NULL);
 
@@ -250,7 +285,7 @@ directory_cmp(G_GNUC_UNUSED void *priv,
 {
 	const struct directory *a = (const struct directory *)_a;
 	const struct directory *b = (const struct directory *)_b;
-	return g_utf8_collate(a->path, b->path);
+	return strcmp(a->collate_key, b->collate_key);
 }
 
 void
@@ -258,6 +293,14 @@ directory_sort(struct directory *directory)
 {
 	assert(holding_db_lock());
 
+	/* make sure every child has its cached collation key, so the
+	   comparisons below are plain strcmp() calls */
+	struct directory *i;
+	directory_for_each_child(i, directory)
+		if (i->collate_key == NULL)
+			i->collate_key =
+				g_utf8_collate_key_for_filename(i->path, -1);
+
 	list_sort(NULL, &directory->children, directory_cmp);
 	song_list_sort(&directory->songs);
 
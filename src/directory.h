@@ -22,6 +22,7 @@
 
 #include "check.h"
 #include "util/list.h"
+#include "playlist_vector.h"
 
 #include <glib.h>
 #include <stdbool.h>
@@ -43,10 +44,10 @@
 	list_for_each_entry_safe(pos, n, &directory->songs, siblings)
 
 #define directory_for_each_playlist(pos, directory) \
-	list_for_each_entry(pos, &directory->playlists, siblings)
+	playlist_vector_for_each(pos, &directory->playlists)
 
 #define directory_for_each_playlist_safe(pos, n, directory) \
-	list_for_each_entry_safe(pos, n, &directory->playlists, siblings)
+	playlist_vector_for_each_safe(pos, n, &directory->playlists)
 
 struct song;
 struct db_visitor;
@@ -78,13 +79,54 @@ struct directory {
 	 */
 	struct list_head songs;
 
-	struct list_head playlists;
+	struct playlist_vector playlists;
+
+	/**
+	 * An index of the children by base name, kept in sync with
+	 * the "children" list.  NULL until the first child is added.
+	 * The keys point into the child's "path" buffer.
+	 *
+	 * This attribute is protected with the global #db_mutex.
+	 */
+	GHashTable *children_map;
+
+	/**
+	 * An index of the songs by URI, kept in sync with the
+	 * "songs" list.  NULL until the first song is added.  The
+	 * keys point into the song's "uri" buffer.
+	 *
+	 * This attribute is protected with the global #db_mutex.
+	 */
+	GHashTable *songs_map;
 
 	struct directory *parent;
 	time_t mtime;
 	ino_t inode;
 	dev_t device;
 	bool have_stat; /* not needed if ino_t == dev_t == 0 is impossible */
+
+	/**
+	 * The filesystem path of this directory (music directory plus
+	 * the relative path converted to the filesystem charset),
+	 * filled lazily by the mapper so only the base name needs to
+	 * be converted per file access.  NULL if it was not computed
+	 * yet.  Protected by the mapper's cache lock; freed by
+	 * directory_free().
+	 */
+	char *path_fs_cache;
+
+	/**
+	 * The collation key of #path
+	 * (g_utf8_collate_key_for_filename(), which also orders
+	 * embedded numbers naturally), computed on the first sort and
+	 * kept, so repeated update passes compare with strcmp()
+	 * instead of re-collating the same names over and over.  NULL
+	 * if it was not computed yet.
+	 *
+	 * This attribute is protected with the global #db_mutex.
+	 */
+	char *collate_key;
+
 	char path[sizeof(long)];
 };
 
@@ -132,7 +174,7 @@ directory_is_empty(const struct directory *directory)
 {
 	return list_empty(&directory->children) &&
 		list_empty(&directory->songs) &&
-		list_empty(&directory->playlists);
+		list_empty(&directory->playlists.head);
 }
 
 static inline const char *
@@ -30,9 +30,13 @@
 
 #define DIRECTORY_DIR "directory: "
 #define DIRECTORY_MTIME "mtime: "
+#define DIRECTORY_DEVICE "device: "
 #define DIRECTORY_BEGIN "begin: "
 #define DIRECTORY_END "end: "
 
+#define DEVICE_CONTAINER_NAME "container"
+#define DEVICE_INARCHIVE_NAME "inarchive"
+
 /**
  * The quark used for GError.domain.
  */
@@ -49,6 +53,15 @@ directory_save(FILE *fp, const struct directory *directory)
 		fprintf(fp, DIRECTORY_MTIME "%lu\n",
 			(unsigned long)directory->mtime);
 
+		/* the virtual directories need their device marker
+		   back after a reload, or the next update would
+		   mistake them for deleted real directories and
+		   re-scan their container/archive from scratch */
+		if (directory->device == DEVICE_CONTAINER)
+			fprintf(fp, DIRECTORY_DEVICE DEVICE_CONTAINER_NAME "\n");
+		else if (directory->device == DEVICE_INARCHIVE)
+			fprintf(fp, DIRECTORY_DEVICE DEVICE_INARCHIVE_NAME "\n");
+
 		fprintf(fp, "%s%s\n", DIRECTORY_BEGIN,
 			directory_get_path(directory));
 	}
@@ -114,6 +127,29 @@ directory_load_subdir(FILE *fp, struct directory *parent, const char *name,
 		}
 	}
 
+	if (g_str_has_prefix(line, DIRECTORY_DEVICE)) {
+		const char *device = line + sizeof(DIRECTORY_DEVICE) - 1;
+
+		if (strcmp(device, DEVICE_CONTAINER_NAME) == 0)
+			directory->device = DEVICE_CONTAINER;
+		else if (strcmp(device, DEVICE_INARCHIVE_NAME) == 0)
+			directory->device = DEVICE_INARCHIVE;
+		else {
+			g_set_error(error_r, directory_quark(), 0,
+				    "Malformed line: %s", line);
+			directory_delete(directory);
+			return NULL;
+		}
+
+		line = read_text_line(fp, buffer);
+		if (line == NULL) {
+			g_set_error(error_r, directory_quark(), 0,
+				    "Unexpected end of file");
+			directory_delete(directory);
+			return NULL;
+		}
+	}
+
 	if (!g_str_has_prefix(line, DIRECTORY_BEGIN)) {
 		g_set_error(error_r, directory_quark(), 0,
 			    "Malformed line: %s", line);
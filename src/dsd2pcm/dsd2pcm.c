@@ -4,13 +4,9 @@
 #include "dsd2pcm.h"
 
 #define HTAPS    48             /* number of FIR constants */
-#define FIFOSIZE 16             /* must be a power of two */
-#define FIFOMASK (FIFOSIZE-1)   /* bit mask for FIFO offsets */
 #define CTABLES ((HTAPS+7)/8)   /* number of "8 MACs" lookup tables */
-
-#if FIFOSIZE*8 < HTAPS*2
-#error "FIFOSIZE too small"
-#endif
+#define HISTORY  (CTABLES*2-1)  /* bytes of context carried between blocks */
+#define BLOCKSIZE 64            /* process this many input bytes at a time */
 
 /*
  * Properties of this 96-tap lowpass filter when applied on a signal
@@ -113,8 +109,8 @@ static void precalc(void)
 
 struct dsd2pcm_ctx_s
 {
-	unsigned char fifo[FIFOSIZE];
-	unsigned fifopos;
+	/* the last HISTORY input bytes (msb first bit order) */
+	unsigned char history[HISTORY];
 };
 
 extern dsd2pcm_ctx* dsd2pcm_init(void)
@@ -144,9 +140,8 @@ extern dsd2pcm_ctx* dsd2pcm_clone(dsd2pcm_ctx* ptr)
 extern void dsd2pcm_reset(dsd2pcm_ctx* ptr)
 {
 	int i;
-	for (i=0; i<FIFOSIZE; ++i)
-		ptr->fifo[i] = 0x69; /* my favorite silence pattern */
-	ptr->fifopos = 0;
+	for (i=0; i<HISTORY; ++i)
+		ptr->history[i] = 0x69; /* my favorite silence pattern */
 	/* 0x69 = 01101001
 	 * This pattern "on repeat" makes a low energy 352.8 kHz tone
 	 * and a high energy 1.0584 MHz tone which should be filtered
@@ -154,6 +149,15 @@ extern void dsd2pcm_reset(dsd2pcm_ctx* ptr)
 	 */
 }
 
+/*
+ * The input is processed in blocks: the carried history and the new
+ * bytes are staged into two linear buffers, once in msb-first and
+ * once in lsb-first bit order (the symmetric filter reads the older
+ * half of its window through the mirrored tables, which expect the
+ * bits reversed).  This keeps the hot loop free of the ring buffer
+ * masking and in-place bit reversal the per-byte version needed, and
+ * lets the two halves accumulate independently.
+ */
 extern void dsd2pcm_translate(
 	dsd2pcm_ctx* ptr,
 	size_t samples,
@@ -161,28 +165,39 @@ extern void dsd2pcm_translate(
 	int lsbf,
 	float *dst, ptrdiff_t dst_stride)
 {
-	unsigned ffp;
-	unsigned i;
-	unsigned bite1, bite2;
-	unsigned char* p;
-	double acc;
-	ffp = ptr->fifopos;
+	unsigned char raw[HISTORY + BLOCKSIZE];
+	unsigned char rev[HISTORY + BLOCKSIZE];
+	size_t n, i;
+	unsigned t, bite;
+	float acc1, acc2;
+
 	lsbf = lsbf ? 1 : 0;
-	while (samples-- > 0) {
-		bite1 = *src & 0xFFu;
-		if (lsbf) bite1 = bitreverse[bite1];
-		ptr->fifo[ffp] = bite1; src += src_stride;
-		p = ptr->fifo + ((ffp-CTABLES) & FIFOMASK);
-		*p = bitreverse[*p & 0xFF];
-		acc = 0;
-		for (i=0; i<CTABLES; ++i) {
-			bite1 = ptr->fifo[(ffp              -i) & FIFOMASK] & 0xFF;
-			bite2 = ptr->fifo[(ffp-(CTABLES*2-1)+i) & FIFOMASK] & 0xFF;
-			acc += ctables[i][bite1] + ctables[i][bite2];
+	while (samples > 0) {
+		n = samples < BLOCKSIZE ? samples : BLOCKSIZE;
+
+		memcpy(raw, ptr->history, HISTORY);
+		for (i = 0; i < n; ++i) {
+			bite = *src & 0xFFu;
+			if (lsbf) bite = bitreverse[bite];
+			raw[HISTORY + i] = bite;
+			src += src_stride;
 		}
-		*dst = (float)acc; dst += dst_stride;
-		ffp = (ffp + 1) & FIFOMASK;
+		for (i = 0; i < HISTORY + n; ++i)
+			rev[i] = bitreverse[raw[i]];
+
+		for (i = 0; i < n; ++i) {
+			acc1 = 0;
+			acc2 = 0;
+			for (t = 0; t < CTABLES; ++t) {
+				acc1 += ctables[t][raw[HISTORY + i - t]];
+				acc2 += ctables[t][rev[i + t]];
+			}
+			*dst = acc1 + acc2;
+			dst += dst_stride;
+		}
+
+		memcpy(ptr->history, raw + n, HISTORY);
+		samples -= n;
 	}
-	ptr->fifopos = ffp;
 }
 
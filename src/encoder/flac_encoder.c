@@ -24,6 +24,7 @@
 #include "pcm_buffer.h"
 #include "fifo_buffer.h"
 #include "growing_fifo.h"
+#include "page.h"
 
 #include <assert.h>
 #include <string.h>
@@ -36,6 +37,12 @@ struct flac_encoder {
 	struct audio_format audio_format;
 	unsigned compression;
 
+	/**
+	 * The configured apodization function(s), or NULL for the
+	 * libFLAC default.
+	 */
+	char *apodization;
+
 	FLAC__StreamEncoder *fse;
 
 	struct pcm_buffer expand_buffer;
@@ -63,6 +70,9 @@ flac_encoder_configure(struct flac_encoder *encoder,
 	encoder->compression = config_get_block_unsigned(param,
 						"compression", 5);
 
+	encoder->apodization = g_strdup(config_get_block_string(param,
+						"apodization", NULL));
+
 	return true;
 }
 
@@ -91,6 +101,7 @@ flac_encoder_finish(struct encoder *_encoder)
 
 	/* the real libFLAC cleanup was already performed by
 	   flac_encoder_close(), so no real work here */
+	g_free(encoder->apodization);
 	g_free(encoder);
 }
 
@@ -107,6 +118,14 @@ flac_encoder_setup(struct flac_encoder *encoder, unsigned bits_per_sample,
 			    encoder->compression);
 		return false;
 	}
+	if (encoder->apodization != NULL &&
+	    !FLAC__stream_encoder_set_apodization(encoder->fse,
+						  encoder->apodization)) {
+		g_set_error(error, flac_encoder_quark(), 0,
+			    "error setting flac apodization to '%s'",
+			    encoder->apodization);
+		return false;
+	}
 #endif
 	if ( !FLAC__stream_encoder_set_channels(encoder->fse,
 					encoder->audio_format.channels)) {
@@ -342,6 +361,22 @@ flac_encoder_read(struct encoder *_encoder, void *dest, size_t length)
 	return length;
 }
 
+static struct page *
+flac_encoder_read_page(struct encoder *_encoder)
+{
+	struct flac_encoder *encoder = (struct flac_encoder *)_encoder;
+
+	size_t length;
+	const char *src = fifo_buffer_read(encoder->output_buffer, &length);
+	if (src == NULL)
+		return NULL;
+
+	struct page *page = page_new(length);
+	memcpy(page->data, src, length);
+	fifo_buffer_consume(encoder->output_buffer, length);
+	return page;
+}
+
 static const char *
 flac_encoder_get_mime_type(G_GNUC_UNUSED struct encoder *_encoder)
 {
@@ -357,6 +392,7 @@ const struct encoder_plugin flac_encoder_plugin = {
 	.flush = flac_encoder_flush,
 	.write = flac_encoder_write,
 	.read = flac_encoder_read,
+	.read_page = flac_encoder_read_page,
 	.get_mime_type = flac_encoder_get_mime_type,
 };
 
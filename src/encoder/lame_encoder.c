@@ -21,6 +21,7 @@
 #include "encoder_api.h"
 #include "encoder_plugin.h"
 #include "audio_format.h"
+#include "page.h"
 
 #include <lame/lame.h>
 #include <assert.h>
@@ -282,6 +283,21 @@ lame_encoder_read(struct encoder *_encoder, void *dest, size_t length)
 	return length;
 }
 
+static struct page *
+lame_encoder_read_page(struct encoder *_encoder)
+{
+	struct lame_encoder *encoder = (struct lame_encoder *)_encoder;
+
+	if (encoder->buffer_length == 0)
+		return NULL;
+
+	struct page *page = page_new_copy(encoder->buffer,
+					  encoder->buffer_length);
+	encoder->buffer_length = 0;
+
+	return page;
+}
+
 static const char *
 lame_encoder_get_mime_type(G_GNUC_UNUSED struct encoder *_encoder)
 {
@@ -296,5 +312,6 @@ const struct encoder_plugin lame_encoder_plugin = {
 	.close = lame_encoder_close,
 	.write = lame_encoder_write,
 	.read = lame_encoder_read,
+	.read_page = lame_encoder_read_page,
 	.get_mime_type = lame_encoder_get_mime_type,
 };
@@ -0,0 +1,538 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "encoder_api.h"
+#include "encoder_plugin.h"
+#include "tag.h"
+#include "audio_format.h"
+#include "page.h"
+
+#include <opus/opus.h>
+#include <ogg/ogg.h>
+
+#include <assert.h>
+#include <string.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "opus_encoder"
+
+/**
+ * The maximum size of an Opus packet (recommended by the libopus
+ * documentation).
+ */
+#define OPUS_MAX_PACKET 4000
+
+struct opus_encoder {
+	/** the base class */
+	struct encoder encoder;
+
+	/* configuration */
+
+	opus_int32 bitrate;
+	int complexity;
+	bool dtx;
+
+	/** the frame duration [ms]; small frames reduce the
+	    streaming latency at the cost of some compression
+	    efficiency */
+	unsigned frame_time;
+
+	/* runtime information */
+
+	struct audio_format audio_format;
+
+	/** the size of one input frame in bytes */
+	size_t frame_size;
+
+	/** staging buffer for one input frame */
+	unsigned char *buffer;
+	size_t buffer_position;
+
+	OpusEncoder *enc;
+
+	unsigned char packet_buffer[OPUS_MAX_PACKET];
+
+	ogg_stream_state os;
+
+	ogg_int64_t granulepos;
+	ogg_int64_t packetno;
+
+	opus_int32 lookahead;
+
+	bool flush;
+};
+
+extern const struct encoder_plugin opus_encoder_plugin;
+
+static inline GQuark
+opus_encoder_quark(void)
+{
+	return g_quark_from_static_string("opus_encoder");
+}
+
+static bool
+opus_encoder_configure(struct opus_encoder *encoder,
+		       const struct config_param *param, GError **error)
+{
+	const char *value;
+	char *endptr;
+
+	value = config_get_block_string(param, "bitrate", "auto");
+	if (strcmp(value, "auto") == 0)
+		encoder->bitrate = OPUS_AUTO;
+	else if (strcmp(value, "max") == 0)
+		encoder->bitrate = OPUS_BITRATE_MAX;
+	else {
+		encoder->bitrate = g_ascii_strtoll(value, &endptr, 10);
+		if (*endptr != '\0' ||
+		    encoder->bitrate < 500 || encoder->bitrate > 512000) {
+			g_set_error(error, opus_encoder_quark(), 0,
+				    "invalid bitrate at line %i",
+				    param->line);
+			return false;
+		}
+	}
+
+	encoder->complexity = config_get_block_unsigned(param, "complexity",
+							10);
+	if (encoder->complexity > 10) {
+		g_set_error(error, opus_encoder_quark(), 0,
+			    "invalid complexity at line %i", param->line);
+		return false;
+	}
+
+	encoder->dtx = config_get_block_bool(param, "dtx", false);
+
+	encoder->frame_time = config_get_block_unsigned(param, "frame_time",
+							20);
+	switch (encoder->frame_time) {
+	case 5:
+	case 10:
+	case 20:
+	case 40:
+	case 60:
+		break;
+
+	default:
+		g_set_error(error, opus_encoder_quark(), 0,
+			    "frame_time at line %i must be "
+			    "5, 10, 20, 40 or 60 [ms]",
+			    param->line);
+		return false;
+	}
+
+	return true;
+}
+
+static struct encoder *
+opus_encoder_init(const struct config_param *param, GError **error)
+{
+	struct opus_encoder *encoder;
+
+	encoder = g_new(struct opus_encoder, 1);
+	encoder_struct_init(&encoder->encoder, &opus_encoder_plugin);
+
+	/* load configuration from "param" */
+	if (!opus_encoder_configure(encoder, param, error)) {
+		/* configuration has failed, roll back and return error */
+		g_free(encoder);
+		return NULL;
+	}
+
+	return &encoder->encoder;
+}
+
+static void
+opus_encoder_finish(struct encoder *_encoder)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+
+	/* the real libopus/libogg cleanup was already performed by
+	   opus_encoder_close(), so no real work here */
+	g_free(encoder);
+}
+
+static void
+opus_encoder_write_le32(unsigned char *dest, uint32_t value)
+{
+	dest[0] = value;
+	dest[1] = value >> 8;
+	dest[2] = value >> 16;
+	dest[3] = value >> 24;
+}
+
+/**
+ * Sends the "OpusHead" and "OpusTags" header packets to the
+ * ogg_stream_state, optionally with tags from the given #tag object.
+ */
+static void
+opus_encoder_send_header(struct opus_encoder *encoder, const struct tag *tag)
+{
+	unsigned char head[19];
+	ogg_packet packet;
+
+	memcpy(head, "OpusHead", 8);
+	head[8] = 1;
+	head[9] = encoder->audio_format.channels;
+	head[10] = encoder->lookahead;
+	head[11] = encoder->lookahead >> 8;
+	opus_encoder_write_le32(head + 12,
+				encoder->audio_format.sample_rate);
+	head[16] = 0;
+	head[17] = 0;
+	head[18] = 0;
+
+	packet.packet = head;
+	packet.bytes = sizeof(head);
+	packet.b_o_s = true;
+	packet.e_o_s = false;
+	packet.granulepos = 0;
+	packet.packetno = encoder->packetno++;
+	ogg_stream_packetin(&encoder->os, &packet);
+
+	/* generate the "OpusTags" packet */
+
+	GString *tags = g_string_new("OpusTags");
+
+	const char *vendor = opus_get_version_string();
+	size_t vendor_length = strlen(vendor);
+	unsigned char length[4];
+
+	opus_encoder_write_le32(length, vendor_length);
+	g_string_append_len(tags, (const char *)length, sizeof(length));
+	g_string_append_len(tags, vendor, vendor_length);
+
+	unsigned num_items = tag != NULL ? tag->num_items : 0;
+	opus_encoder_write_le32(length, num_items);
+	g_string_append_len(tags, (const char *)length, sizeof(length));
+
+	for (unsigned i = 0; i < num_items; i++) {
+		const struct tag_item *item = tag->items[i];
+		char *name = g_ascii_strup(tag_item_names[item->type], -1);
+		char *comment = g_strconcat(name, "=", item->value, NULL);
+
+		opus_encoder_write_le32(length, strlen(comment));
+		g_string_append_len(tags, (const char *)length,
+				    sizeof(length));
+		g_string_append(tags, comment);
+
+		g_free(comment);
+		g_free(name);
+	}
+
+	packet.packet = (unsigned char *)tags->str;
+	packet.bytes = tags->len;
+	packet.b_o_s = false;
+	packet.e_o_s = false;
+	packet.granulepos = 0;
+	packet.packetno = encoder->packetno++;
+	ogg_stream_packetin(&encoder->os, &packet);
+
+	g_string_free(tags, true);
+}
+
+static bool
+opus_encoder_open(struct encoder *_encoder,
+		  struct audio_format *audio_format,
+		  GError **error)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+	int error_code;
+
+	/* libopus supports only a few sample rates */
+	switch (audio_format->sample_rate) {
+	case 8000:
+	case 12000:
+	case 16000:
+	case 24000:
+		break;
+
+	default:
+		audio_format->sample_rate = 48000;
+		break;
+	}
+
+	if (audio_format->channels > 2)
+		audio_format->channels = 2;
+
+	audio_format->format = SAMPLE_FORMAT_S16;
+
+	encoder->audio_format = *audio_format;
+
+	encoder->enc = opus_encoder_create(audio_format->sample_rate,
+					   audio_format->channels,
+					   OPUS_APPLICATION_AUDIO,
+					   &error_code);
+	if (encoder->enc == NULL) {
+		g_set_error(error, opus_encoder_quark(), error_code,
+			    "opus_encoder_create() has failed: %s",
+			    opus_strerror(error_code));
+		return false;
+	}
+
+	opus_encoder_ctl(encoder->enc, OPUS_SET_BITRATE(encoder->bitrate));
+	opus_encoder_ctl(encoder->enc,
+			 OPUS_SET_COMPLEXITY(encoder->complexity));
+	opus_encoder_ctl(encoder->enc, OPUS_SET_DTX(encoder->dtx));
+	opus_encoder_ctl(encoder->enc,
+			 OPUS_GET_LOOKAHEAD(&encoder->lookahead));
+
+	encoder->frame_size = encoder->frame_time *
+		audio_format->sample_rate / 1000 *
+		audio_format_frame_size(audio_format);
+	encoder->buffer = g_malloc(encoder->frame_size);
+	encoder->buffer_position = 0;
+
+	encoder->granulepos = 0;
+	encoder->packetno = 0;
+
+	ogg_stream_init(&encoder->os, g_random_int());
+	opus_encoder_send_header(encoder, NULL);
+
+	/* set "flush" to true, so the caller gets the full headers on
+	   the first read() */
+	encoder->flush = true;
+
+	return true;
+}
+
+static void
+opus_encoder_close(struct encoder *_encoder)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+
+	ogg_stream_clear(&encoder->os);
+	g_free(encoder->buffer);
+	opus_encoder_destroy(encoder->enc);
+}
+
+/**
+ * Encodes the staging buffer into one Opus packet and sends it to the
+ * ogg_stream_state.
+ *
+ * @param e_o_s end-of-stream flag for the Ogg packet
+ */
+static bool
+opus_encoder_do_encode(struct opus_encoder *encoder, bool e_o_s,
+		       GError **error)
+{
+	assert(encoder->buffer_position == encoder->frame_size);
+
+	opus_int32 result =
+		opus_encode(encoder->enc,
+			    (const opus_int16 *)encoder->buffer,
+			    encoder->frame_size /
+			    audio_format_frame_size(&encoder->audio_format),
+			    encoder->packet_buffer,
+			    sizeof(encoder->packet_buffer));
+	if (result < 0) {
+		g_set_error(error, opus_encoder_quark(), 0,
+			    "opus_encode() has failed: %s",
+			    opus_strerror(result));
+		return false;
+	}
+
+	/* the granule position is counted in 48 kHz samples,
+	   regardless of the input sample rate */
+	encoder->granulepos += encoder->frame_size /
+		audio_format_frame_size(&encoder->audio_format) *
+		48000u / encoder->audio_format.sample_rate;
+
+	ogg_packet packet;
+	packet.packet = encoder->packet_buffer;
+	packet.bytes = result;
+	packet.b_o_s = false;
+	packet.e_o_s = e_o_s;
+	packet.granulepos = encoder->granulepos;
+	packet.packetno = encoder->packetno++;
+	ogg_stream_packetin(&encoder->os, &packet);
+
+	encoder->buffer_position = 0;
+
+	return true;
+}
+
+static bool
+opus_encoder_flush(struct encoder *_encoder, G_GNUC_UNUSED GError **error)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+
+	encoder->flush = true;
+	return true;
+}
+
+/**
+ * Pads the staging buffer with silence and encodes it, ending the
+ * current Ogg stream.
+ */
+static bool
+opus_encoder_end_stream(struct opus_encoder *encoder, GError **error)
+{
+	memset(encoder->buffer + encoder->buffer_position, 0,
+	       encoder->frame_size - encoder->buffer_position);
+	encoder->buffer_position = encoder->frame_size;
+
+	return opus_encoder_do_encode(encoder, true, error);
+}
+
+static bool
+opus_encoder_pre_tag(struct encoder *_encoder, GError **error)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+
+	if (!opus_encoder_end_stream(encoder, error))
+		return false;
+
+	encoder->flush = true;
+	return true;
+}
+
+static bool
+opus_encoder_tag(struct encoder *_encoder, const struct tag *tag,
+		 G_GNUC_UNUSED GError **error)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+
+	/* begin a new stream, with the tag in its "OpusTags"
+	   header */
+
+	ogg_stream_reset_serialno(&encoder->os, g_random_int());
+	encoder->granulepos = 0;
+	encoder->packetno = 0;
+
+	opus_encoder_send_header(encoder, tag);
+
+	encoder->flush = true;
+
+	return true;
+}
+
+static bool
+opus_encoder_write(struct encoder *_encoder,
+		   const void *_data, size_t length,
+		   GError **error)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+	const unsigned char *data = _data;
+
+	while (length > 0) {
+		size_t nbytes = encoder->frame_size -
+			encoder->buffer_position;
+		if (nbytes > length)
+			nbytes = length;
+
+		memcpy(encoder->buffer + encoder->buffer_position,
+		       data, nbytes);
+		data += nbytes;
+		length -= nbytes;
+		encoder->buffer_position += nbytes;
+
+		if (encoder->buffer_position == encoder->frame_size &&
+		    !opus_encoder_do_encode(encoder, false, error))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Obtains the next Ogg page from the stream, flushing it if that was
+ * requested.
+ *
+ * @return true if a page was returned
+ */
+static bool
+opus_encoder_pageout(struct opus_encoder *encoder, ogg_page *page)
+{
+	int ret = ogg_stream_pageout(&encoder->os, page);
+	if (ret == 0 && encoder->flush) {
+		encoder->flush = false;
+		ret = ogg_stream_flush(&encoder->os, page);
+	}
+
+	return ret != 0;
+}
+
+static size_t
+opus_encoder_read(struct encoder *_encoder, void *_dest, size_t length)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+	ogg_page page;
+	unsigned char *dest = _dest;
+
+	if (!opus_encoder_pageout(encoder, &page))
+		return 0;
+
+	assert(page.header_len > 0 || page.body_len > 0);
+
+	size_t nbytes = (size_t)page.header_len + (size_t)page.body_len;
+	if (nbytes > length)
+		nbytes = length;
+
+	if ((size_t)page.header_len >= nbytes) {
+		memcpy(dest, page.header, nbytes);
+	} else {
+		memcpy(dest, page.header, page.header_len);
+		memcpy(dest + page.header_len, page.body,
+		       nbytes - page.header_len);
+	}
+
+	return nbytes;
+}
+
+static struct page *
+opus_encoder_read_page(struct encoder *_encoder)
+{
+	struct opus_encoder *encoder = (struct opus_encoder *)_encoder;
+	ogg_page page;
+
+	if (!opus_encoder_pageout(encoder, &page))
+		return NULL;
+
+	assert(page.header_len > 0 || page.body_len > 0);
+
+	struct page *p = page_new((size_t)page.header_len +
+				  (size_t)page.body_len);
+	memcpy(p->data, page.header, page.header_len);
+	memcpy(p->data + page.header_len, page.body, page.body_len);
+
+	return p;
+}
+
+static const char *
+opus_encoder_get_mime_type(G_GNUC_UNUSED struct encoder *_encoder)
+{
+	return "audio/ogg";
+}
+
+const struct encoder_plugin opus_encoder_plugin = {
+	.name = "opus",
+	.init = opus_encoder_init,
+	.finish = opus_encoder_finish,
+	.open = opus_encoder_open,
+	.close = opus_encoder_close,
+	.flush = opus_encoder_flush,
+	.pre_tag = opus_encoder_pre_tag,
+	.tag = opus_encoder_tag,
+	.write = opus_encoder_write,
+	.read = opus_encoder_read,
+	.read_page = opus_encoder_read_page,
+	.get_mime_type = opus_encoder_get_mime_type,
+};
@@ -22,6 +22,7 @@
 #include "encoder_plugin.h"
 #include "tag.h"
 #include "audio_format.h"
+#include "page.h"
 #include "mpd_error.h"
 
 #include <vorbis/vorbisenc.h>
@@ -362,23 +363,33 @@ vorbis_encoder_write(struct encoder *_encoder,
 	return true;
 }
 
+/**
+ * Obtains the next Ogg page from the stream, flushing it if that was
+ * requested.
+ *
+ * @return true if a page was returned
+ */
+static bool
+vorbis_encoder_pageout(struct vorbis_encoder *encoder, ogg_page *page)
+{
+	int ret = ogg_stream_pageout(&encoder->os, page);
+	if (ret == 0 && encoder->flush) {
+		encoder->flush = false;
+		ret = ogg_stream_flush(&encoder->os, page);
+	}
+
+	return ret != 0;
+}
+
 static size_t
 vorbis_encoder_read(struct encoder *_encoder, void *_dest, size_t length)
 {
 	struct vorbis_encoder *encoder = (struct vorbis_encoder *)_encoder;
 	ogg_page page;
-	int ret;
 	unsigned char *dest = _dest;
 	size_t nbytes;
 
-	ret = ogg_stream_pageout(&encoder->os, &page);
-	if (ret == 0 && encoder->flush) {
-		encoder->flush = false;
-		ret = ogg_stream_flush(&encoder->os, &page);
-
-	}
-
-	if (ret == 0)
+	if (!vorbis_encoder_pageout(encoder, &page))
 		return 0;
 
 	assert(page.header_len > 0 || page.body_len > 0);
@@ -395,6 +406,25 @@ vorbis_encoder_read(struct encoder *_encoder, void *_dest, size_t length)
 	return nbytes;
 }
 
+static struct page *
+vorbis_encoder_read_page(struct encoder *_encoder)
+{
+	struct vorbis_encoder *encoder = (struct vorbis_encoder *)_encoder;
+	ogg_page page;
+
+	if (!vorbis_encoder_pageout(encoder, &page))
+		return NULL;
+
+	assert(page.header_len > 0 || page.body_len > 0);
+
+	struct page *p = page_new((size_t)page.header_len +
+				  (size_t)page.body_len);
+	memcpy(p->data, page.header, page.header_len);
+	memcpy(p->data + page.header_len, page.body, page.body_len);
+
+	return p;
+}
+
 static const char *
 vorbis_encoder_get_mime_type(G_GNUC_UNUSED struct encoder *_encoder)
 {
@@ -412,5 +442,6 @@ const struct encoder_plugin vorbis_encoder_plugin = {
 	.tag = vorbis_encoder_tag,
 	.write = vorbis_encoder_write,
 	.read = vorbis_encoder_read,
+	.read_page = vorbis_encoder_read_page,
 	.get_mime_type = vorbis_encoder_get_mime_type,
 };
@@ -25,6 +25,7 @@
 
 extern const struct encoder_plugin null_encoder_plugin;
 extern const struct encoder_plugin vorbis_encoder_plugin;
+extern const struct encoder_plugin opus_encoder_plugin;
 extern const struct encoder_plugin lame_encoder_plugin;
 extern const struct encoder_plugin twolame_encoder_plugin;
 extern const struct encoder_plugin wave_encoder_plugin;
@@ -35,6 +36,9 @@ static const struct encoder_plugin *encoder_plugins[] = {
 #ifdef ENABLE_VORBIS_ENCODER
 	&vorbis_encoder_plugin,
 #endif
+#ifdef ENABLE_OPUS_ENCODER
+	&opus_encoder_plugin,
+#endif
 #ifdef ENABLE_LAME_ENCODER
 	&lame_encoder_plugin,
 #endif
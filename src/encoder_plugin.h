@@ -28,6 +28,7 @@
 struct encoder_plugin;
 struct audio_format;
 struct config_param;
+struct page;
 struct tag;
 
 struct encoder {
@@ -61,6 +62,8 @@ struct encoder_plugin {
 
 	size_t (*read)(struct encoder *encoder, void *dest, size_t length);
 
+	struct page *(*read_page)(struct encoder *encoder);
+
 	const char *(*get_mime_type)(struct encoder *encoder);
 };
 
@@ -218,6 +221,33 @@ encoder_read(struct encoder *encoder, void *dest, size_t length)
 	return encoder->plugin->read(encoder, dest, length);
 }
 
+/**
+ * Does this encoder support encoder_read_page()?
+ */
+static inline bool
+encoder_can_read_page(const struct encoder *encoder)
+{
+	return encoder->plugin->read_page != NULL;
+}
+
+/**
+ * Reads encoded data from the encoder as a reference counted #page
+ * object, produced directly by the encoder without an intermediate
+ * copy.  Each page is a complete unit of the encoded stream (e.g. an
+ * Ogg page).  The caller must release the page with page_unref().
+ *
+ * This method is optional; check with encoder_can_read_page(), and
+ * fall back to encoder_read() if it is not implemented.
+ *
+ * @param encoder the encoder
+ * @return a page, or NULL if no encoded data is available
+ */
+static inline struct page *
+encoder_read_page(struct encoder *encoder)
+{
+	return encoder->plugin->read_page(encoder);
+}
+
 /**
  * Get mime type of encoded content.
  *
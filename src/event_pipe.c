@@ -35,16 +35,48 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#include <stdint.h>
+#endif
+
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "event_pipe"
 
+#ifdef HAVE_EVENTFD
+static int event_fd = -1;
+#else
 static int event_pipe[2];
+#endif
+
 static GIOChannel *event_channel;
 static guint event_pipe_source_id;
-static GMutex *event_pipe_mutex;
-static bool pipe_events[PIPE_EVENT_MAX];
+
+/**
+ * A bit mask of pending events (1 << #pipe_event), accessed only with
+ * atomic operations, so event_pipe_emit() is lock-free and safe in
+ * any thread (and in signal handlers).
+ */
+static volatile gint pipe_events_pending;
+
 static event_pipe_callback_t event_pipe_callbacks[PIPE_EVENT_MAX];
 
+/**
+ * Wakes up the main loop.
+ *
+ * @return -1 on error
+ */
+static ssize_t
+event_pipe_wakeup(void)
+{
+#ifdef HAVE_EVENTFD
+	static const uint64_t value = 1;
+	return write(event_fd, &value, sizeof(value));
+#else
+	return write(event_pipe[1], "", 1);
+#endif
+}
+
 /**
  * Invoke the callback for a certain event.
  */
@@ -62,6 +94,14 @@ main_notify_event(G_GNUC_UNUSED GIOChannel *source,
 		  G_GNUC_UNUSED GIOCondition condition,
 		  G_GNUC_UNUSED gpointer data)
 {
+	/* drain the wakeup before reading the mask: an event emitted
+	   after this point triggers another wakeup and thus another
+	   dispatch */
+
+#ifdef HAVE_EVENTFD
+	uint64_t value;
+	(void)read(event_fd, &value, sizeof(value));
+#else
 	char buffer[256];
 	gsize bytes_read;
 	GError *error = NULL;
@@ -70,15 +110,20 @@ main_notify_event(G_GNUC_UNUSED GIOChannel *source,
 						   &bytes_read, &error);
 	if (status == G_IO_STATUS_ERROR)
 		MPD_ERROR("error reading from pipe: %s", error->message);
+#endif
+
+	/* atomically fetch and clear the mask; all bits accumulated
+	   since the last dispatch are handled in this one */
 
-	bool events[PIPE_EVENT_MAX];
-	g_mutex_lock(event_pipe_mutex);
-	memcpy(events, pipe_events, sizeof(events));
-	memset(pipe_events, 0, sizeof(pipe_events));
-	g_mutex_unlock(event_pipe_mutex);
+	gint events;
+	do {
+		events = g_atomic_int_get(&pipe_events_pending);
+	} while (events != 0 &&
+		 !g_atomic_int_compare_and_exchange(&pipe_events_pending,
+						    events, 0));
 
 	for (unsigned i = 0; i < PIPE_EVENT_MAX; ++i)
-		if (events[i])
+		if (events & (1 << i))
 			/* invoke the event handler */
 			event_pipe_invoke(i);
 
@@ -88,9 +133,15 @@ main_notify_event(G_GNUC_UNUSED GIOChannel *source,
 void event_pipe_init(void)
 {
 	GIOChannel *channel;
-	int ret;
 
-	ret = pipe_cloexec_nonblock(event_pipe);
+#ifdef HAVE_EVENTFD
+	event_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+	if (event_fd < 0)
+		MPD_ERROR("Couldn't create eventfd: %s", strerror(errno));
+
+	channel = g_io_channel_unix_new(event_fd);
+#else
+	int ret = pipe_cloexec_nonblock(event_pipe);
 	if (ret < 0)
 		MPD_ERROR("Couldn't open pipe: %s", strerror(errno));
 
@@ -99,6 +150,8 @@ void event_pipe_init(void)
 #else
 	channel = g_io_channel_win32_new_fd(event_pipe[0]);
 #endif
+#endif
+
 	g_io_channel_set_encoding(channel, NULL, NULL);
 	g_io_channel_set_buffered(channel, false);
 
@@ -106,22 +159,22 @@ void event_pipe_init(void)
 					      main_notify_event, NULL);
 
 	event_channel = channel;
-
-	event_pipe_mutex = g_mutex_new();
 }
 
 void event_pipe_deinit(void)
 {
-	g_mutex_free(event_pipe_mutex);
-
 	g_source_remove(event_pipe_source_id);
 	g_io_channel_unref(event_channel);
 
+#ifdef HAVE_EVENTFD
+	close(event_fd);
+#else
 #ifndef WIN32
 	/* By some strange reason this call hangs on Win32 */
 	close(event_pipe[0]);
 #endif
 	close(event_pipe[1]);
+#endif
 }
 
 void
@@ -133,31 +186,46 @@ event_pipe_register(enum pipe_event event, event_pipe_callback_t callback)
 	event_pipe_callbacks[event] = callback;
 }
 
-void event_pipe_emit(enum pipe_event event)
+/**
+ * Sets the event's bit in the pending mask.
+ *
+ * @return true if the mask was previously empty and the main loop
+ * must be woken up
+ */
+static bool
+event_pipe_set(enum pipe_event event)
 {
-	ssize_t w;
-
 	assert((unsigned)event < PIPE_EVENT_MAX);
 
-	g_mutex_lock(event_pipe_mutex);
-	if (pipe_events[event]) {
-		/* already set: don't write */
-		g_mutex_unlock(event_pipe_mutex);
-		return;
-	}
+	gint old_mask, new_mask;
+
+	do {
+		old_mask = g_atomic_int_get(&pipe_events_pending);
+		new_mask = old_mask | (1 << event);
+		if (new_mask == old_mask)
+			/* already set; a wakeup is in flight */
+			return false;
+	} while (!g_atomic_int_compare_and_exchange(&pipe_events_pending,
+						    old_mask, new_mask));
+
+	/* if other bits were already pending, their wakeup has not
+	   been dispatched yet and will pick up this event, too -
+	   emits are coalesced into a single dispatch */
+	return old_mask == 0;
+}
 
-	pipe_events[event] = true;
-	g_mutex_unlock(event_pipe_mutex);
+void event_pipe_emit(enum pipe_event event)
+{
+	if (!event_pipe_set(event))
+		return;
 
-	w = write(event_pipe[1], "", 1);
+	ssize_t w = event_pipe_wakeup();
 	if (w < 0 && errno != EAGAIN && errno != EINTR)
 		MPD_ERROR("error writing to pipe: %s", strerror(errno));
 }
 
 void event_pipe_emit_fast(enum pipe_event event)
 {
-	assert((unsigned)event < PIPE_EVENT_MAX);
-
-	pipe_events[event] = true;
-	(void)write(event_pipe[1], "", 1);
+	if (event_pipe_set(event))
+		(void)event_pipe_wakeup();
 }
@@ -47,6 +47,9 @@ enum pipe_event {
 	/** shutdown requested */
 	PIPE_EVENT_SHUTDOWN,
 
+	/** the asynchronous database load has finished */
+	PIPE_EVENT_DATABASE,
+
 	PIPE_EVENT_MAX
 };
 
@@ -26,17 +26,88 @@
 #include "exclude.h"
 #include "path.h"
 
+#include <glib.h>
+
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
 
-GSList *
+struct exclude_list {
+	/**
+	 * Patterns without any wildcard: exact file names, as a hash
+	 * set.  NULL if there are none.
+	 */
+	GHashTable *literals;
+
+	/**
+	 * "*.ext" patterns, keyed by the suffix after the last dot.
+	 * NULL if there are none.
+	 */
+	GHashTable *suffixes;
+
+	/**
+	 * "literal*" patterns, as a list of prefix strings.
+	 */
+	GSList *prefixes;
+
+	/**
+	 * Everything else falls back to wildcard matching.
+	 */
+	GSList *patterns;
+};
+
+/**
+ * Compiles one pattern into the class which matches it most cheaply.
+ */
+static void
+exclude_list_add(struct exclude_list *list, const char *p)
+{
+	size_t length = strlen(p);
+	size_t literal_length = strcspn(p, "*?");
+
+	if (literal_length == length) {
+		/* no wildcard at all: an exact name */
+		if (list->literals == NULL)
+			list->literals =
+				g_hash_table_new_full(g_str_hash, g_str_equal,
+						      g_free, NULL);
+		g_hash_table_insert(list->literals, g_strdup(p),
+				    GINT_TO_POINTER(1));
+		return;
+	}
+
+	if (p[0] == '*' && p[1] == '.' &&
+	    strcspn(p + 2, "*?") == length - 2 &&
+	    strchr(p + 2, '.') == NULL) {
+		/* "*.ext": keyed by the suffix after the last dot */
+		if (list->suffixes == NULL)
+			list->suffixes =
+				g_hash_table_new_full(g_str_hash, g_str_equal,
+						      g_free, NULL);
+		g_hash_table_insert(list->suffixes, g_strdup(p + 2),
+				    GINT_TO_POINTER(1));
+		return;
+	}
+
+	if (literal_length == length - 1 && p[length - 1] == '*') {
+		/* "literal*": a prefix; real-world ignore files have
+		   few of these, a plain list is good enough */
+		list->prefixes = g_slist_prepend(list->prefixes,
+						 g_strndup(p, length - 1));
+		return;
+	}
+
+	list->patterns = g_slist_prepend(list->patterns,
+					 g_pattern_spec_new(p));
+}
+
+struct exclude_list *
 exclude_list_load(const char *path_fs)
 {
 	FILE *file;
 	char line[1024];
-	GSList *list = NULL;
+	struct exclude_list *list = NULL;
 
 	assert(path_fs != NULL);
 
@@ -58,8 +129,12 @@ exclude_list_load(const char *path_fs)
 			*p = 0;
 
 		p = g_strstrip(line);
-		if (*p != 0)
-			list = g_slist_prepend(list, g_pattern_spec_new(p));
+		if (*p != 0) {
+			if (list == NULL)
+				list = g_new0(struct exclude_list, 1);
+
+			exclude_list_add(list, p);
+		}
 	}
 
 	fclose(file);
@@ -68,28 +143,61 @@ exclude_list_load(const char *path_fs)
 }
 
 void
-exclude_list_free(GSList *list)
+exclude_list_free(struct exclude_list *list)
 {
-	while (list != NULL) {
-		GPatternSpec *pattern = list->data;
+	if (list == NULL)
+		return;
+
+	if (list->literals != NULL)
+		g_hash_table_destroy(list->literals);
+	if (list->suffixes != NULL)
+		g_hash_table_destroy(list->suffixes);
+
+	while (list->prefixes != NULL) {
+		g_free(list->prefixes->data);
+		list->prefixes = g_slist_remove(list->prefixes,
+						list->prefixes->data);
+	}
+
+	while (list->patterns != NULL) {
+		GPatternSpec *pattern = list->patterns->data;
 		g_pattern_spec_free(pattern);
-		list = g_slist_remove(list, list->data);
+		list->patterns = g_slist_remove(list->patterns,
+						list->patterns->data);
 	}
+
+	g_free(list);
 }
 
 bool
-exclude_list_check(GSList *list, const char *name_fs)
+exclude_list_check(const struct exclude_list *list, const char *name_fs)
 {
 	assert(name_fs != NULL);
 
 	/* XXX include full path name in check */
 
-	for (; list != NULL; list = list->next) {
-		GPatternSpec *pattern = list->data;
+	if (list == NULL)
+		return false;
+
+	if (list->literals != NULL &&
+	    g_hash_table_lookup(list->literals, name_fs) != NULL)
+		return true;
 
-		if (g_pattern_match_string(pattern, name_fs))
+	if (list->suffixes != NULL) {
+		const char *dot = strrchr(name_fs, '.');
+
+		if (dot != NULL &&
+		    g_hash_table_lookup(list->suffixes, dot + 1) != NULL)
 			return true;
 	}
 
+	for (const GSList *i = list->prefixes; i != NULL; i = i->next)
+		if (g_str_has_prefix(name_fs, i->data))
+			return true;
+
+	for (const GSList *i = list->patterns; i != NULL; i = i->next)
+		if (g_pattern_match_string(i->data, name_fs))
+			return true;
+
 	return false;
 }
@@ -25,27 +25,36 @@
 #ifndef MPD_EXCLUDE_H
 #define MPD_EXCLUDE_H
 
-#include <glib.h>
-
 #include <stdbool.h>
 
+/**
+ * A compiled .mpdignore file.  Patterns are sorted into classes at
+ * load time - exact names and "*.ext" suffixes go into hash sets,
+ * "literal*" prefixes into a plain list - so that a check usually
+ * costs two hash lookups instead of a wildcard match per pattern.
+ */
+struct exclude_list;
+
 /**
  * Loads and parses a .mpdignore file.
+ *
+ * @return the compiled list, or NULL if the file does not exist or
+ * contains no patterns
  */
-GSList *
+struct exclude_list *
 exclude_list_load(const char *path_fs);
 
 /**
- * Frees a list returned by exclude_list_load().
+ * Frees a list returned by exclude_list_load().  NULL is allowed.
  */
 void
-exclude_list_free(GSList *list);
+exclude_list_free(struct exclude_list *list);
 
 /**
  * Checks whether one of the patterns in the .mpdignore file matches
- * the specified file name.
+ * the specified file name.  NULL is allowed and never matches.
  */
 bool
-exclude_list_check(GSList *list, const char *name_fs);
+exclude_list_check(const struct exclude_list *list, const char *name_fs);
 
 #endif
@@ -184,6 +184,39 @@ chain_filter_filter(struct filter *_filter,
 	return src;
 }
 
+static bool
+chain_filter_supports_multi(const struct filter *_filter)
+{
+	const struct filter_chain *chain =
+		(const struct filter_chain *)_filter;
+
+	/* a batch can only be passed down when every stage supports
+	   it; a stage without the method would invalidate its
+	   previous result with each call */
+	for (GSList *i = chain->children; i != NULL; i = g_slist_next(i))
+		if (!filter_supports_multi(i->data))
+			return false;
+
+	return true;
+}
+
+static bool
+chain_filter_filter_multi(struct filter *_filter,
+			  struct filter_span *spans, unsigned num_spans,
+			  GError **error_r)
+{
+	struct filter_chain *chain = (struct filter_chain *)_filter;
+
+	/* push the whole batch through one stage at a time, for
+	   better code locality than filtering span by span */
+	for (GSList *i = chain->children; i != NULL; i = g_slist_next(i))
+		if (!filter_filter_multi(i->data, spans, num_spans,
+					 error_r))
+			return false;
+
+	return true;
+}
+
 const struct filter_plugin chain_filter_plugin = {
 	.name = "chain",
 	.init = chain_filter_init,
@@ -191,6 +224,8 @@ const struct filter_plugin chain_filter_plugin = {
 	.open = chain_filter_open,
 	.close = chain_filter_close,
 	.filter = chain_filter_filter,
+	.supports_multi = chain_filter_supports_multi,
+	.filter_multi = chain_filter_filter_multi,
 };
 
 struct filter *
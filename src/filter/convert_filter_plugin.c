@@ -52,6 +52,16 @@ struct convert_filter {
 	struct audio_format out_audio_format;
 
 	struct pcm_convert_state state;
+
+	/**
+	 * Collects the results of a batch conversion, see
+	 * convert_filter_filter_multi().  Unlike a #pcm_buffer, it
+	 * grows with g_realloc(), preserving the spans already
+	 * converted (the output size of a resampling conversion is
+	 * not exactly predictable up front).
+	 */
+	void *multi_buffer;
+	size_t multi_capacity;
 };
 
 static struct filter *
@@ -81,6 +91,9 @@ convert_filter_open(struct filter *_filter, struct audio_format *audio_format,
 	filter->in_audio_format = filter->out_audio_format = *audio_format;
 	pcm_convert_init(&filter->state);
 
+	filter->multi_buffer = NULL;
+	filter->multi_capacity = 0;
+
 	return &filter->in_audio_format;
 }
 
@@ -91,6 +104,10 @@ convert_filter_close(struct filter *_filter)
 
 	pcm_convert_deinit(&filter->state);
 
+	g_free(filter->multi_buffer);
+	filter->multi_buffer = NULL;
+	filter->multi_capacity = 0;
+
 	poison_undefined(&filter->in_audio_format,
 			 sizeof(filter->in_audio_format));
 	poison_undefined(&filter->out_audio_format,
@@ -121,6 +138,59 @@ convert_filter_filter(struct filter *_filter, const void *src, size_t src_size,
 	return dest;
 }
 
+static bool
+convert_filter_filter_multi(struct filter *_filter,
+			    struct filter_span *spans, unsigned num_spans,
+			    GError **error_r)
+{
+	struct convert_filter *filter = (struct convert_filter *)_filter;
+	size_t fill = 0;
+	unsigned i;
+
+	if (audio_format_equals(&filter->in_audio_format,
+				&filter->out_audio_format))
+		/* optimized special case: no-op */
+		return true;
+
+	/* convert each span and append it to the batch buffer; the
+	   spans cannot point into pcm_convert()'s buffers directly,
+	   because each call invalidates the previous result */
+
+	for (i = 0; i < num_spans; ++i) {
+		size_t dest_size;
+		const void *dest =
+			pcm_convert(&filter->state, &filter->in_audio_format,
+				    spans[i].data, spans[i].size,
+				    &filter->out_audio_format, &dest_size,
+				    error_r);
+		if (dest == NULL)
+			return false;
+
+		if (fill + dest_size > filter->multi_capacity) {
+			filter->multi_capacity = ((fill + dest_size) * 3) / 2;
+			filter->multi_buffer =
+				g_realloc(filter->multi_buffer,
+					  filter->multi_capacity);
+		}
+
+		memcpy((char *)filter->multi_buffer + fill, dest, dest_size);
+		spans[i].size = dest_size;
+		fill += dest_size;
+	}
+
+	/* fill in the pointers only now, because g_realloc() may
+	   have moved the buffer; the offsets are simply the prefix
+	   sums of the converted sizes */
+
+	fill = 0;
+	for (i = 0; i < num_spans; ++i) {
+		spans[i].data = (char *)filter->multi_buffer + fill;
+		fill += spans[i].size;
+	}
+
+	return true;
+}
+
 const struct filter_plugin convert_filter_plugin = {
 	.name = "convert",
 	.init = convert_filter_init,
@@ -128,6 +198,7 @@ const struct filter_plugin convert_filter_plugin = {
 	.open = convert_filter_open,
 	.close = convert_filter_close,
 	.filter = convert_filter_filter,
+	.filter_multi = convert_filter_filter_multi,
 };
 
 void
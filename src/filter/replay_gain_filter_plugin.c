@@ -19,6 +19,7 @@
 
 #include "config.h"
 #include "filter/replay_gain_filter_plugin.h"
+#include "filter/volume_filter_plugin.h"
 #include "filter_plugin.h"
 #include "filter_internal.h"
 #include "filter_registry.h"
@@ -44,6 +45,15 @@ struct replay_gain_filter {
 	 */
 	struct mixer *mixer;
 
+	/**
+	 * If set, then the gain is not applied here, but pushed into
+	 * this volume filter (an instance of volume_filter_plugin),
+	 * which multiplies it into its own pcm_volume() pass.  This
+	 * fuses the two gain stages into a single pass over the
+	 * samples.
+	 */
+	struct filter *volume_filter;
+
 	/**
 	 * The base volume level for scale=1.0, between 1 and 100
 	 * (including).
@@ -52,6 +62,15 @@ struct replay_gain_filter {
 
 	enum replay_gain_mode mode;
 
+	/**
+	 * The value of #replay_gain_generation when #mode was last
+	 * derived from the settings.  As long as it is unchanged, no
+	 * setting has been touched, and the cached #volume is valid;
+	 * this replaces polling replay_gain_get_real_mode() on every
+	 * chunk.
+	 */
+	unsigned generation;
+
 	struct replay_gain_info info;
 
 	/**
@@ -94,6 +113,11 @@ replay_gain_filter_update(struct replay_gain_filter *filter)
 	} else
 		filter->volume = PCM_VOLUME_1;
 
+	if (filter->volume_filter != NULL)
+		/* delegate the gain to the volume filter */
+		volume_filter_set_external_gain(filter->volume_filter,
+						filter->volume);
+
 	if (filter->mixer != NULL) {
 		/* update the hardware mixer volume */
 
@@ -118,8 +142,10 @@ replay_gain_filter_init(G_GNUC_UNUSED const struct config_param *param,
 
 	filter_init(&filter->filter, &replay_gain_filter_plugin);
 	filter->mixer = NULL;
+	filter->volume_filter = NULL;
 
 	filter->mode = replay_gain_get_real_mode();
+	filter->generation = replay_gain_get_generation();
 	replay_gain_info_init(&filter->info);
 	filter->volume = PCM_VOLUME_1;
 
@@ -166,19 +192,34 @@ replay_gain_filter_filter(struct filter *_filter,
 		(struct replay_gain_filter *)_filter;
 	bool success;
 	void *dest;
-	enum replay_gain_mode rg_mode;
 
-	/* check if the mode has been changed since the last call */
-	rg_mode = replay_gain_get_real_mode();
+	/* re-derive the mode and the scale only when a setting has
+	   actually changed; the common case is one generation load
+	   and compare per chunk */
+	const unsigned generation = replay_gain_get_generation();
+	if (filter->generation != generation) {
+		filter->generation = generation;
+
+		const enum replay_gain_mode rg_mode =
+			replay_gain_get_real_mode();
+		if (filter->mode != rg_mode) {
+			g_debug("replay gain mode has changed %d->%d\n",
+				filter->mode, rg_mode);
+			filter->mode = rg_mode;
+		}
 
-	if (filter->mode != rg_mode) {
-		g_debug("replay gain mode has changed %d->%d\n", filter->mode, rg_mode);
-		filter->mode = rg_mode;
+		/* the preamp settings may have changed, too: always
+		   recompute the scale on a new generation */
 		replay_gain_filter_update(filter);
 	}
 
 	*dest_size_r = src_size;
 
+	if (filter->volume_filter != NULL)
+		/* the linked volume filter applies our gain in its
+		   own pcm_volume() pass */
+		return src;
+
 	if (filter->volume == PCM_VOLUME_1)
 		/* optimized special case: 100% volume = no-op */
 		return src;
@@ -230,6 +271,29 @@ replay_gain_filter_set_mixer(struct filter *_filter, struct mixer *mixer,
 	replay_gain_filter_update(filter);
 }
 
+void
+replay_gain_filter_set_volume_filter(struct filter *_filter,
+				     struct filter *volume_filter)
+{
+	struct replay_gain_filter *filter =
+		(struct replay_gain_filter *)_filter;
+
+	if (volume_filter == filter->volume_filter)
+		return;
+
+	if (filter->volume_filter != NULL)
+		/* neutralize the old target; the gain will be applied
+		   here again */
+		volume_filter_set_external_gain(filter->volume_filter,
+						PCM_VOLUME_1);
+
+	filter->volume_filter = volume_filter;
+
+	if (volume_filter != NULL)
+		volume_filter_set_external_gain(volume_filter,
+						filter->volume);
+}
+
 void
 replay_gain_filter_set_info(struct filter *_filter,
 			    const struct replay_gain_info *info)
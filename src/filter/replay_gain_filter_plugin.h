@@ -37,6 +37,17 @@ void
 replay_gain_filter_set_mixer(struct filter *_filter, struct mixer *mixer,
 			     unsigned base);
 
+/**
+ * Links a software volume filter (volume_filter_plugin) with this
+ * filter.  While linked, the replay gain is not applied here;
+ * instead, it is pushed into the volume filter, which multiplies both
+ * gains in a single pcm_volume() pass.  Pass NULL to unlink; the
+ * previous target is reset to a neutral gain.
+ */
+void
+replay_gain_filter_set_volume_filter(struct filter *_filter,
+				     struct filter *volume_filter);
+
 /**
  * Sets a new #replay_gain_info at the beginning of a new song.
  *
@@ -39,6 +39,14 @@ struct volume_filter {
 	 */
 	unsigned volume;
 
+	/**
+	 * An additional gain pushed in by another gain stage (the
+	 * replay gain filter), to be multiplied into the same
+	 * pcm_volume() pass.  #PCM_VOLUME_1 is neutral; unlike
+	 * #volume, it may exceed #PCM_VOLUME_1.
+	 */
+	unsigned external_gain;
+
 	struct audio_format audio_format;
 
 	struct pcm_buffer buffer;
@@ -58,6 +66,7 @@ volume_filter_init(G_GNUC_UNUSED const struct config_param *param,
 
 	filter_init(&filter->filter, &volume_filter_plugin);
 	filter->volume = PCM_VOLUME_1;
+	filter->external_gain = PCM_VOLUME_1;
 
 	return &filter->filter;
 }
@@ -95,18 +104,22 @@ volume_filter_filter(struct filter *_filter, const void *src, size_t src_size,
 		     size_t *dest_size_r, GError **error_r)
 {
 	struct volume_filter *filter = (struct volume_filter *)_filter;
+	/* one multiply pass applies both our own volume and the gain
+	   delegated by the replay gain filter */
+	unsigned volume = (filter->volume * filter->external_gain)
+		/ PCM_VOLUME_1;
 	bool success;
 	void *dest;
 
 	*dest_size_r = src_size;
 
-	if (filter->volume >= PCM_VOLUME_1)
+	if (volume == PCM_VOLUME_1)
 		/* optimized special case: 100% volume = no-op */
 		return src;
 
 	dest = pcm_buffer_get(&filter->buffer, src_size);
 
-	if (filter->volume <= 0) {
+	if (volume <= 0) {
 		/* optimized special case: 0% volume = memset(0) */
 		/* XXX is this valid for all sample formats? What
 		   about floating point? */
@@ -117,7 +130,7 @@ volume_filter_filter(struct filter *_filter, const void *src, size_t src_size,
 	memcpy(dest, src, src_size);
 
 	success = pcm_volume(dest, src_size, filter->audio_format.format,
-			     filter->volume);
+			     volume);
 	if (!success) {
 		g_set_error(error_r, volume_quark(), 0,
 			    "pcm_volume() has failed");
@@ -127,6 +140,57 @@ volume_filter_filter(struct filter *_filter, const void *src, size_t src_size,
 	return dest;
 }
 
+static bool
+volume_filter_filter_multi(struct filter *_filter,
+			   struct filter_span *spans, unsigned num_spans,
+			   GError **error_r)
+{
+	struct volume_filter *filter = (struct volume_filter *)_filter;
+	unsigned volume = (filter->volume * filter->external_gain)
+		/ PCM_VOLUME_1;
+	size_t total = 0;
+	char *dest, *p;
+	unsigned i;
+
+	if (volume == PCM_VOLUME_1)
+		/* optimized special case: 100% volume = no-op */
+		return true;
+
+	/* concatenate all spans into one buffer, so one pcm_volume()
+	   call can process the whole batch */
+
+	for (i = 0; i < num_spans; ++i)
+		total += spans[i].size;
+
+	dest = pcm_buffer_get(&filter->buffer, total);
+
+	if (volume <= 0) {
+		/* optimized special case: 0% volume = memset(0) */
+		memset(dest, 0, total);
+	} else {
+		p = dest;
+		for (i = 0; i < num_spans; ++i) {
+			memcpy(p, spans[i].data, spans[i].size);
+			p += spans[i].size;
+		}
+
+		if (!pcm_volume(dest, total, filter->audio_format.format,
+				volume)) {
+			g_set_error(error_r, volume_quark(), 0,
+				    "pcm_volume() has failed");
+			return false;
+		}
+	}
+
+	p = dest;
+	for (i = 0; i < num_spans; ++i) {
+		spans[i].data = p;
+		p += spans[i].size;
+	}
+
+	return true;
+}
+
 const struct filter_plugin volume_filter_plugin = {
 	.name = "volume",
 	.init = volume_filter_init,
@@ -134,6 +198,7 @@ const struct filter_plugin volume_filter_plugin = {
 	.open = volume_filter_open,
 	.close = volume_filter_close,
 	.filter = volume_filter_filter,
+	.filter_multi = volume_filter_filter_multi,
 };
 
 unsigned
@@ -159,3 +224,13 @@ volume_filter_set(struct filter *_filter, unsigned volume)
 	filter->volume = volume;
 }
 
+void
+volume_filter_set_external_gain(struct filter *_filter, unsigned gain)
+{
+	struct volume_filter *filter = (struct volume_filter *)_filter;
+
+	assert(filter->filter.plugin == &volume_filter_plugin);
+
+	filter->external_gain = gain;
+}
+
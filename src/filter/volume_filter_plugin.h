@@ -28,4 +28,14 @@ volume_filter_get(const struct filter *filter);
 void
 volume_filter_set(struct filter *filter, unsigned volume);
 
+/**
+ * Sets an additional gain factor which is multiplied into the same
+ * pcm_volume() pass as the regular volume.  This is used by the
+ * replay gain filter to delegate its gain, avoiding a second pass
+ * over the samples.  #PCM_VOLUME_1 is neutral; the value may exceed
+ * #PCM_VOLUME_1.
+ */
+void
+volume_filter_set_external_gain(struct filter *filter, unsigned gain);
+
 #endif
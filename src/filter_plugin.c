@@ -22,6 +22,7 @@
 #include "filter_internal.h"
 #include "filter_registry.h"
 #include "conf.h"
+#include "perf.h"
 
 #ifndef NDEBUG
 #include "audio_format.h"
@@ -112,5 +113,43 @@ filter_filter(struct filter *filter, const void *src, size_t src_size,
 	assert(dest_size_r != NULL);
 	assert(error_r == NULL || *error_r == NULL);
 
-	return filter->plugin->filter(filter, src, src_size, dest_size_r, error_r);
+	const uint64_t start = perf_begin();
+	const void *result = filter->plugin->filter(filter, src, src_size,
+						    dest_size_r, error_r);
+	perf_end(PERF_FILTER, start);
+
+	return result;
+}
+
+bool
+filter_supports_multi(const struct filter *filter)
+{
+	assert(filter != NULL);
+
+	if (filter->plugin->filter_multi == NULL)
+		return false;
+
+	if (filter->plugin->supports_multi != NULL)
+		return filter->plugin->supports_multi(filter);
+
+	return true;
+}
+
+bool
+filter_filter_multi(struct filter *filter,
+		    struct filter_span *spans, unsigned num_spans,
+		    GError **error_r)
+{
+	assert(filter != NULL);
+	assert(filter_supports_multi(filter));
+	assert(spans != NULL);
+	assert(num_spans > 0);
+	assert(error_r == NULL || *error_r == NULL);
+
+	const uint64_t start = perf_begin();
+	bool success = filter->plugin->filter_multi(filter, spans, num_spans,
+						    error_r);
+	perf_end(PERF_FILTER, start);
+
+	return success;
 }
@@ -34,6 +34,15 @@
 struct config_param;
 struct filter;
 
+/**
+ * A reference to a block of PCM data, used for passing a batch of
+ * buffers through a filter in one call, see filter_filter_multi().
+ */
+struct filter_span {
+	const void *data;
+	size_t size;
+};
+
 struct filter_plugin {
 	const char *name;
 
@@ -72,6 +81,24 @@ struct filter_plugin {
 			      const void *src, size_t src_size,
 			      size_t *dest_buffer_r,
 			      GError **error_r);
+
+	/**
+	 * Optional method: can filter_multi() be used on this filter
+	 * right now?  When this method is NULL, the presence of
+	 * #filter_multi alone decides.  The "chain" plugin uses it to
+	 * check all of its children.
+	 */
+	bool (*supports_multi)(const struct filter *filter);
+
+	/**
+	 * Optional method: filters a batch of PCM blocks in one call.
+	 * Each span is replaced in-place with its filtered result;
+	 * unlike #filter, all results stay valid together, until the
+	 * next call to this filter.
+	 */
+	bool (*filter_multi)(struct filter *filter,
+			     struct filter_span *spans, unsigned num_spans,
+			     GError **error_r);
 };
 
 /**
@@ -147,4 +174,30 @@ filter_filter(struct filter *filter, const void *src, size_t src_size,
 	      size_t *dest_size_r,
 	      GError **error_r);
 
+/**
+ * Does this filter support filter_filter_multi()?
+ */
+bool
+filter_supports_multi(const struct filter *filter);
+
+/**
+ * Filters a batch of PCM blocks in one call.  Each span is replaced
+ * in-place with its filtered result.  Unlike filter_filter(), all
+ * results remain valid together until the next filter call, which
+ * allows the caller to queue them up before consuming them.
+ *
+ * May only be called when filter_supports_multi() returns true.
+ *
+ * @param filter the filter object
+ * @param spans the input buffers; replaced with the output buffers
+ * @param num_spans the number of spans
+ * @param error location to store the error occurring, or NULL to
+ * ignore errors.
+ * @return true on success, false on error
+ */
+bool
+filter_filter_multi(struct filter *filter,
+		    struct filter_span *spans, unsigned num_spans,
+		    GError **error_r);
+
 #endif
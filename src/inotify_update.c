@@ -44,6 +44,16 @@ enum {
 #endif
 };
 
+enum {
+	/**
+	 * When this many consecutive events hit the same directory
+	 * (e.g. rsync writing many files), stop enqueueing single
+	 * files and enqueue the whole directory instead; that
+	 * collapses all queued files below it into one update job.
+	 */
+	INOTIFY_STORM_THRESHOLD = 16,
+};
+
 struct watch_directory {
 	struct watch_directory *parent;
 
@@ -243,8 +253,11 @@ watch_directory_depth(const struct watch_directory *d)
 
 static void
 mpd_inotify_callback(int wd, unsigned mask,
-		     G_GNUC_UNUSED const char *name, G_GNUC_UNUSED void *ctx)
+		     const char *name, G_GNUC_UNUSED void *ctx)
 {
+	static int storm_wd = -1;
+	static unsigned storm_count;
+
 	struct watch_directory *directory;
 	char *uri_fs;
 
@@ -288,9 +301,31 @@ mpd_inotify_callback(int wd, unsigned mask,
 	     (mask & (IN_CREATE|IN_ISDIR)) == (IN_CREATE|IN_ISDIR))) {
 		/* a file was changed, or a directory was
 		   moved/deleted: queue a database update */
-		char *uri_utf8 = uri_fs != NULL
-			? fs_charset_to_utf8(uri_fs)
+
+		if (wd == storm_wd)
+			++storm_count;
+		else {
+			storm_wd = wd;
+			storm_count = 0;
+		}
+
+		/* when the event names a single file, update just
+		   that file instead of walking the whole directory -
+		   unless a storm of events hits this directory */
+		char *target_fs;
+		if ((mask & IN_ISDIR) == 0 && name != NULL &&
+		    !skip_path(name) &&
+		    storm_count < INOTIFY_STORM_THRESHOLD)
+			target_fs = uri_fs != NULL
+				? g_strconcat(uri_fs, "/", name, NULL)
+				: g_strdup(name);
+		else
+			target_fs = g_strdup(uri_fs);
+
+		char *uri_utf8 = target_fs != NULL
+			? fs_charset_to_utf8(target_fs)
 			: g_strdup("");
+		g_free(target_fs);
 
 		if (uri_utf8 != NULL)
 			/* this function will take care of freeing
@@ -26,6 +26,7 @@
 #include "input_internal.h"
 #include "input_plugin.h"
 #include "refcount.h"
+#include "conf.h"
 
 #include <stdio.h>
 #include <stdint.h>
@@ -38,6 +39,23 @@
 #include <cdio/paranoia.h>
 #include <cdio/cd_types.h>
 
+/**
+ * The default number of sectors buffered ahead of the decoder.
+ */
+#define CDIO_DEFAULT_READAHEAD 32
+
+/**
+ * The paranoia mode flags, set by input_cdio_init().
+ */
+static int cdio_paranoia_mode_flags =
+	PARANOIA_MODE_FULL^PARANOIA_MODE_NEVERSKIP;
+
+/**
+ * The size of the readahead ring in sectors, set by
+ * input_cdio_init().
+ */
+static unsigned cdio_readahead_sectors = CDIO_DEFAULT_READAHEAD;
+
 struct input_cdio_paranoia {
 	struct input_stream base;
 
@@ -50,8 +68,44 @@ struct input_cdio_paranoia {
 
 	int trackno;
 
-	char buffer[CDIO_CD_FRAMESIZE_RAW];
-	int buffer_lsn;
+	/**
+	 * The readahead thread; it owns the paranoia object after
+	 * input_cdio_open() has returned, absorbing drive hiccups so
+	 * the reader always copies from RAM.
+	 */
+	GThread *thread;
+
+	/**
+	 * A ring of #ring_size sectors, holding a contiguous window
+	 * of the track starting at #window_start; sector N lives in
+	 * slot N %% #ring_size.  Protected by base.mutex.
+	 */
+	char *ring;
+	unsigned ring_size;
+
+	/**
+	 * The first buffered sector (relative to #lsn_from), and the
+	 * number of valid sectors following it.
+	 */
+	int window_start;
+	unsigned valid;
+
+	/**
+	 * Tells the readahead thread to reposition the paranoia
+	 * object at #window_start, discarding all buffered sectors.
+	 */
+	bool seek_pending;
+
+	/**
+	 * Tells the readahead thread to exit.
+	 */
+	bool close_requested;
+
+	/**
+	 * An error which occurred in the readahead thread, to be
+	 * delivered by the read method.
+	 */
+	GError *postponed_error;
 };
 
 static inline GQuark
@@ -60,11 +114,126 @@ cdio_quark(void)
 	return g_quark_from_static_string("cdio");
 }
 
+static bool
+input_cdio_init(const struct config_param *param, GError **error_r)
+{
+	const char *mode = config_get_block_string(param, "paranoia_mode",
+						   "full");
+	if (strcmp(mode, "off") == 0 || strcmp(mode, "disable") == 0)
+		cdio_paranoia_mode_flags = PARANOIA_MODE_DISABLE;
+	else if (strcmp(mode, "overlap") == 0)
+		cdio_paranoia_mode_flags = PARANOIA_MODE_OVERLAP;
+	else if (strcmp(mode, "full") == 0)
+		cdio_paranoia_mode_flags =
+			PARANOIA_MODE_FULL^PARANOIA_MODE_NEVERSKIP;
+	else {
+		g_set_error(error_r, cdio_quark(), 0,
+			    "Unrecognized paranoia_mode: %s", mode);
+		return false;
+	}
+
+	cdio_readahead_sectors =
+		config_get_block_unsigned(param, "readahead_sectors",
+					  CDIO_DEFAULT_READAHEAD);
+	if (cdio_readahead_sectors < 4)
+		cdio_readahead_sectors = 4;
+
+	return true;
+}
+
+static gpointer
+input_cdio_thread(gpointer data)
+{
+	struct input_cdio_paranoia *i = data;
+
+	g_mutex_lock(i->base.mutex);
+
+	while (!i->close_requested) {
+		if (i->seek_pending) {
+			/* reposition; all buffered sectors are
+			   stale */
+			lsn_t target = i->lsn_from + i->window_start;
+			i->seek_pending = false;
+			i->valid = 0;
+
+			g_mutex_unlock(i->base.mutex);
+			cdio_paranoia_seek(i->para, target, SEEK_SET);
+			g_mutex_lock(i->base.mutex);
+			continue;
+		}
+
+		if (i->valid >= i->ring_size ||
+		    i->lsn_from + i->window_start + (int)i->valid > i->lsn_to) {
+			/* the ring is full, or the end of the track
+			   has been buffered: wait for the reader */
+			g_cond_wait(i->base.cond, i->base.mutex);
+			continue;
+		}
+
+		/* drops only remove sectors from the front of the
+		   window (advancing window_start while shrinking
+		   valid), so the append position is stable even while
+		   the mutex is released */
+		unsigned slot = (i->window_start + i->valid) % i->ring_size;
+
+		g_mutex_unlock(i->base.mutex);
+
+		int16_t *rbuf = cdio_paranoia_read(i->para, NULL);
+
+		char *s_err = cdda_errors(i->drv);
+		if (s_err) {
+			g_warning("paranoia_read: %s", s_err);
+			free(s_err);
+		}
+		char *s_mess = cdda_messages(i->drv);
+		if (s_mess) {
+			free(s_mess);
+		}
+
+		g_mutex_lock(i->base.mutex);
+
+		if (rbuf == NULL) {
+			i->postponed_error =
+				g_error_new(cdio_quark(), 0,
+					    "paranoia read error. Stopping.");
+			g_cond_broadcast(i->base.cond);
+			break;
+		}
+
+		if (i->seek_pending || i->close_requested)
+			/* this sector belongs to the old position:
+			   discard it */
+			continue;
+
+		memcpy(i->ring + slot * CDIO_CD_FRAMESIZE_RAW,
+		       rbuf, CDIO_CD_FRAMESIZE_RAW);
+		++i->valid;
+		g_cond_broadcast(i->base.cond);
+	}
+
+	g_mutex_unlock(i->base.mutex);
+	return NULL;
+}
+
 static void
 input_cdio_close(struct input_stream *is)
 {
 	struct input_cdio_paranoia *i = (struct input_cdio_paranoia *)is;
 
+	if (i->thread != NULL) {
+		g_mutex_lock(i->base.mutex);
+		i->close_requested = true;
+		g_cond_broadcast(i->base.cond);
+		g_mutex_unlock(i->base.mutex);
+
+		g_thread_join(i->thread);
+	}
+
+	g_free(i->ring);
+
+	if (i->postponed_error != NULL)
+		g_error_free(i->postponed_error);
+
 	if (i->para)
 		cdio_paranoia_free(i->para);
 	if (i->drv)
@@ -152,14 +321,10 @@ input_cdio_open(const char *uri,
 	if (!parse_cdio_uri(&parsed_uri, uri, error_r))
 		return NULL;
 
-	i = g_new(struct input_cdio_paranoia, 1);
+	i = g_new0(struct input_cdio_paranoia, 1);
 	input_stream_init(&i->base, &input_plugin_cdio_paranoia, uri,
 			  mutex, cond);
 
-	/* initialize everything (should be already) */
-	i->drv = NULL;
-	i->cdio = NULL;
-	i->para = NULL;
 	i->trackno = parsed_uri.track;
 
 	/* get list of CD's supporting CD-DA */
@@ -228,11 +393,20 @@ input_cdio_open(const char *uri,
 
 	i->para = cdio_paranoia_init(i->drv);
 
-	/* Set reading mode for full paranoia, but allow skipping sectors. */
-	paranoia_modeset(i->para, PARANOIA_MODE_FULL^PARANOIA_MODE_NEVERSKIP);
+	paranoia_modeset(i->para, cdio_paranoia_mode_flags);
 
-	/* seek to beginning of the track */
-	cdio_paranoia_seek(i->para, i->lsn_from, SEEK_SET);
+	i->ring_size = cdio_readahead_sectors;
+	i->ring = g_malloc(i->ring_size * CDIO_CD_FRAMESIZE_RAW);
+
+	/* the readahead thread performs the initial seek to the
+	   beginning of the track */
+	i->seek_pending = true;
+
+	i->thread = g_thread_create(input_cdio_thread, i, true, error_r);
+	if (i->thread == NULL) {
+		input_cdio_close(&i->base);
+		return NULL;
+	}
 
 	i->base.ready = true;
 	i->base.seekable = true;
@@ -279,7 +453,15 @@ input_cdio_seek(struct input_stream *is,
 	cis->lsn_relofs = offset / CDIO_CD_FRAMESIZE_RAW;
 	cis->base.offset = offset;
 
-	cdio_paranoia_seek(cis->para, cis->lsn_from + cis->lsn_relofs, SEEK_SET);
+	if (cis->lsn_relofs < cis->window_start ||
+	    cis->lsn_relofs >= cis->window_start + (int)cis->valid) {
+		/* outside of the buffered window: restart the
+		   readahead thread at the new position */
+		cis->window_start = cis->lsn_relofs;
+		cis->valid = 0;
+		cis->seek_pending = true;
+		g_cond_broadcast(cis->base.cond);
+	}
 
 	return true;
 }
@@ -292,43 +474,43 @@ input_cdio_read(struct input_stream *is, void *ptr, size_t length,
 	size_t nbytes = 0;
 	int diff;
 	size_t len, maxwrite;
-	int16_t *rbuf;
-	char *s_err, *s_mess;
 	char *wptr = (char *) ptr;
 
 	while (length > 0) {
-
-
 		/* end of track ? */
 		if (cis->lsn_from + cis->lsn_relofs > cis->lsn_to)
 			break;
 
-		//current sector was changed ?
-		if (cis->lsn_relofs != cis->buffer_lsn) {
-			rbuf = cdio_paranoia_read(cis->para, NULL);
-
-			s_err = cdda_errors(cis->drv);
-			if (s_err) {
-				g_warning("paranoia_read: %s", s_err );
-				free(s_err);
-			}
-			s_mess = cdda_messages(cis->drv);
-			if (s_mess) {
-				free(s_mess);
-			}
-			if (!rbuf) {
-				g_set_error(error_r, cdio_quark(), 0,
-					"paranoia read error. Stopping.");
-				return 0;
-			}
-			//store current buffer
-			memcpy(cis->buffer, rbuf, CDIO_CD_FRAMESIZE_RAW);
-			cis->buffer_lsn = cis->lsn_relofs;
-		} else {
-			//use cached sector
-			rbuf = (int16_t*) cis->buffer;
+		/* release the ring slots of sectors the reader has
+		   moved past, making room for the readahead thread */
+		bool dropped = false;
+		while (cis->valid > 0 &&
+		       cis->window_start < cis->lsn_relofs) {
+			++cis->window_start;
+			--cis->valid;
+			dropped = true;
 		}
 
+		if (dropped)
+			g_cond_broadcast(cis->base.cond);
+
+		/* wait for the readahead thread to deliver the
+		   current sector */
+		while (cis->valid == 0 && cis->postponed_error == NULL)
+			g_cond_wait(cis->base.cond, cis->base.mutex);
+
+		if (cis->postponed_error != NULL) {
+			g_propagate_error(error_r, cis->postponed_error);
+			cis->postponed_error = NULL;
+			return 0;
+		}
+
+		assert(cis->window_start == cis->lsn_relofs);
+
+		const char *rbuf = cis->ring +
+			(cis->lsn_relofs % cis->ring_size) *
+			CDIO_CD_FRAMESIZE_RAW;
+
 		//correct offset
 		diff = cis->base.offset - cis->lsn_relofs * CDIO_CD_FRAMESIZE_RAW;
 
@@ -338,7 +520,7 @@ input_cdio_read(struct input_stream *is, void *ptr, size_t length,
 		len = (length < maxwrite? length : maxwrite);
 
 		//skip diff bytes from this lsn
-		memcpy(wptr, ((char*)rbuf) + diff, len);
+		memcpy(wptr, rbuf + diff, len);
 		//update pointer
 		wptr += len;
 		nbytes += len;
@@ -363,6 +545,7 @@ input_cdio_eof(struct input_stream *is)
 
 const struct input_plugin input_plugin_cdio_paranoia = {
 	.name = "cdio_paranoia",
+	.init = input_cdio_init,
 	.open = input_cdio_open,
 	.close = input_cdio_close,
 	.seek = input_cdio_seek,
@@ -19,24 +19,34 @@
 
 #include "config.h"
 #include "input/curl_input_plugin.h"
+#include "input/file_input_plugin.h"
 #include "input_internal.h"
 #include "input_plugin.h"
 #include "conf.h"
 #include "tag.h"
 #include "icy_metadata.h"
 #include "io_thread.h"
+#include "resolver_async.h"
 #include "glib_compat.h"
 
 #include <assert.h>
 
 #if defined(WIN32)
 	#include <winsock2.h>
+	#include <ws2tcpip.h>
 #else
 	#include <sys/select.h>
+	#include <sys/socket.h>
+	#include <netdb.h>
 #endif
 
 #include <string.h>
 #include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
 
 #include <curl/curl.h>
 #include <glib.h>
@@ -44,6 +54,14 @@
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "input_curl"
 
+#if LIBCURL_VERSION_NUM >= 0x071503
+/* CURLOPT_RESOLVE was added in libcurl 7.21.3; with it, the host can
+   be looked up in a worker thread pool before the request is handed
+   to libcurl, so its blocking getaddrinfo() call never stalls the
+   I/O thread (which serves all streams) */
+#define CURL_INPUT_PRERESOLVE
+#endif
+
 /**
  * Do not buffer more than this number of bytes.  It should be a
  * reasonable limit that doesn't make low-end machines suffer too
@@ -56,6 +74,14 @@ static const size_t CURL_MAX_BUFFERED = 512 * 1024;
  */
 static const size_t CURL_RESUME_AT = 384 * 1024;
 
+/**
+ * Keep a copy of this number of bytes at the end of a seekable
+ * resource.  Decoders like FLAC probe the end of the file for seek
+ * tables; once those bytes have been downloaded, such probes can be
+ * served from memory instead of re-issuing a ranged request.
+ */
+static const goffset CURL_TAIL_CACHE = 256 * 1024;
+
 /**
  * Buffers created by input_curl_writefunction().
  */
@@ -81,6 +107,24 @@ struct input_curl {
 	/** the curl handles */
 	CURL *easy;
 
+#ifdef CURL_INPUT_PRERESOLVE
+	/** the pending asynchronous DNS lookup, or NULL */
+	struct resolver_async *resolve;
+
+	/** the bare host name from the URL, for the CURLOPT_RESOLVE
+	    entry; NULL if the URL is not eligible for
+	    pre-resolution */
+	char *resolve_host;
+
+	/** the port from the URL (or the default port 80) */
+	unsigned resolve_port;
+
+	/** the "HOST:PORT:ADDRESS" list passed to CURLOPT_RESOLVE;
+	    kept alive for follow-up requests (seeking), and freed
+	    only with the stream */
+	struct curl_slist *resolve_list;
+#endif
+
 	/** the GMainLoop source used to poll all CURL file
 	    descriptors */
 	GSource *source;
@@ -107,6 +151,42 @@ struct input_curl {
 	/** error message provided by libcurl */
 	char error[CURL_ERROR_SIZE];
 
+	/**
+	 * A copy of the last #CURL_TAIL_CACHE bytes of the resource,
+	 * or NULL if the tail has not been touched (yet).  See
+	 * #tail_valid_start.
+	 */
+	char *tail;
+
+	/** the file offset of tail[0] */
+	goffset tail_offset;
+
+	/**
+	 * The lowest file offset which has been captured contiguously
+	 * up to the end of the resource, or -1 if no complete tail
+	 * span has been downloaded yet.
+	 */
+	goffset tail_valid_start;
+
+	/** the file offset at which the current request started */
+	goffset request_start;
+
+	/** the file offset of the next byte which
+	    input_curl_writefunction() will receive */
+	goffset receive_offset;
+
+	/**
+	 * The file to which the response body is copied, or NULL if
+	 * this stream is not being captured for the disk cache.
+	 */
+	FILE *cache_file;
+
+	/** the temporary path of #cache_file */
+	char *cache_tmp;
+
+	/** the final path, after the download has completed */
+	char *cache_path;
+
 	/** parser for icy-metadata */
 	struct icy_metadata icy_metadata;
 
@@ -127,6 +207,15 @@ static struct curl_slist *http_200_aliases;
 static const char *proxy, *proxy_user, *proxy_password;
 static unsigned proxy_port;
 
+/**
+ * The directory of the on-disk stream cache, or NULL if the cache is
+ * disabled.
+ */
+static char *cache_dir;
+
+/** the upper limit for the total size of the cache directory */
+static guint64 cache_max_size;
+
 static struct {
 	CURLM *multi;
 
@@ -171,6 +260,168 @@ curl_quark(void)
 	return g_quark_from_static_string("curl");
 }
 
+/*
+ * disk cache
+ *
+ */
+
+/**
+ * Generates the cache file path for a URL.
+ */
+static char *
+input_curl_cache_path(const char *url)
+{
+	char *key = g_compute_checksum_for_string(G_CHECKSUM_MD5, url, -1);
+	char *path = g_build_filename(cache_dir, key, NULL);
+	g_free(key);
+	return path;
+}
+
+struct cache_entry {
+	char *path;
+	time_t mtime;
+	guint64 size;
+};
+
+static gint
+cache_entry_compare(gconstpointer a, gconstpointer b)
+{
+	const struct cache_entry *ea = a, *eb = b;
+
+	/* oldest first */
+	return ea->mtime < eb->mtime ? -1 : (ea->mtime > eb->mtime ? 1 : 0);
+}
+
+/**
+ * Deletes the oldest cache files until the directory is below the
+ * configured size limit.
+ */
+static void
+input_curl_cache_prune(void)
+{
+	GDir *dir = g_dir_open(cache_dir, 0, NULL);
+	if (dir == NULL)
+		return;
+
+	GSList *entries = NULL;
+	guint64 total = 0;
+	const char *name;
+
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		char *path = g_build_filename(cache_dir, name, NULL);
+		struct stat st;
+
+		if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+			struct cache_entry *entry =
+				g_new(struct cache_entry, 1);
+			entry->path = path;
+			entry->mtime = st.st_mtime;
+			entry->size = st.st_size;
+			entries = g_slist_prepend(entries, entry);
+			total += entry->size;
+		} else
+			g_free(path);
+	}
+
+	g_dir_close(dir);
+
+	entries = g_slist_sort(entries, cache_entry_compare);
+
+	for (GSList *i = entries; i != NULL; i = g_slist_next(i)) {
+		struct cache_entry *entry = i->data;
+
+		if (total > cache_max_size) {
+			g_unlink(entry->path);
+			total -= entry->size;
+		}
+
+		g_free(entry->path);
+		g_free(entry);
+	}
+
+	g_slist_free(entries);
+}
+
+/**
+ * Starts capturing the response body to a temporary file in the
+ * cache directory.
+ */
+static void
+input_curl_cache_open(struct input_curl *c)
+{
+	assert(c->cache_file == NULL);
+
+	if (cache_dir == NULL)
+		return;
+
+	c->cache_path = input_curl_cache_path(c->url);
+	c->cache_tmp = g_strconcat(c->cache_path, ".XXXXXX", NULL);
+
+	int fd = g_mkstemp(c->cache_tmp);
+	if (fd >= 0)
+		c->cache_file = fdopen(fd, "wb");
+
+	if (c->cache_file == NULL) {
+		if (fd >= 0)
+			close(fd);
+
+		g_free(c->cache_tmp);
+		c->cache_tmp = NULL;
+		g_free(c->cache_path);
+		c->cache_path = NULL;
+	}
+}
+
+/**
+ * Stops capturing this stream, discarding the partial file.  Must
+ * not race with input_curl_writefunction(), i.e. the caller runs in
+ * the I/O thread, holds the mutex or has freed the "easy" handle.
+ */
+static void
+input_curl_cache_abandon(struct input_curl *c)
+{
+	if (c->cache_file == NULL)
+		return;
+
+	fclose(c->cache_file);
+	c->cache_file = NULL;
+
+	g_unlink(c->cache_tmp);
+
+	g_free(c->cache_tmp);
+	c->cache_tmp = NULL;
+	g_free(c->cache_path);
+	c->cache_path = NULL;
+}
+
+/**
+ * The download has completed successfully: move the temporary file
+ * to its final name, making it visible for future requests.
+ *
+ * Runs in the I/O thread.
+ */
+static void
+input_curl_cache_commit(struct input_curl *c)
+{
+	assert(io_thread_inside());
+
+	if (c->cache_file == NULL)
+		return;
+
+	bool success = fclose(c->cache_file) == 0;
+	c->cache_file = NULL;
+
+	if (success && g_rename(c->cache_tmp, c->cache_path) == 0)
+		input_curl_cache_prune();
+	else
+		g_unlink(c->cache_tmp);
+
+	g_free(c->cache_tmp);
+	c->cache_tmp = NULL;
+	g_free(c->cache_path);
+	c->cache_path = NULL;
+}
+
 /**
  * Find a request by its CURL "easy" handle.
  *
@@ -373,6 +624,13 @@ input_curl_easy_free(struct input_curl *c)
 	assert(io_thread_inside());
 	assert(c != NULL);
 
+#ifdef CURL_INPUT_PRERESOLVE
+	if (c->resolve != NULL) {
+		resolver_async_cancel(c->resolve);
+		c->resolve = NULL;
+	}
+#endif
+
 	if (c->easy == NULL)
 		return;
 
@@ -454,6 +712,13 @@ input_curl_request_done(struct input_curl *c, CURLcode result, long status)
 	assert(c->easy == NULL);
 	assert(c->postponed_error == NULL);
 
+	if (result == CURLE_OK && status >= 200 && status < 300)
+		/* the whole response body has been received; publish
+		   it in the disk cache */
+		input_curl_cache_commit(c);
+	else
+		input_curl_cache_abandon(c);
+
 	g_mutex_lock(c->base.mutex);
 
 	if (result != CURLE_OK) {
@@ -464,6 +729,15 @@ input_curl_request_done(struct input_curl *c, CURLcode result, long status)
 		c->postponed_error = g_error_new(curl_quark(), 0,
 						 "got HTTP status %ld",
 						 status);
+	} else if (c->tail != NULL &&
+		   c->receive_offset == c->base.size) {
+		/* this request has run to the end of the resource;
+		   the tail cache is now contiguous from wherever the
+		   request started */
+		goffset valid = MAX(c->request_start, c->tail_offset);
+
+		if (c->tail_valid_start < 0 || valid < c->tail_valid_start)
+			c->tail_valid_start = valid;
 	}
 
 	c->base.ready = true;
@@ -668,6 +942,27 @@ input_curl_init(const struct config_param *param,
 						   "");
 	}
 
+	GError *error = NULL;
+	cache_dir = config_dup_block_path(param, "cache_dir", &error);
+	if (cache_dir == NULL && error != NULL) {
+		g_propagate_error(error_r, error);
+		return false;
+	}
+
+	if (cache_dir != NULL) {
+		if (g_mkdir_with_parents(cache_dir, 0755) < 0) {
+			g_set_error(error_r, curl_quark(), errno,
+				    "Failed to create \"%s\": %s",
+				    cache_dir, g_strerror(errno));
+			return false;
+		}
+
+		/* "cache_size" is measured in megabytes */
+		cache_max_size = (guint64)
+			config_get_block_unsigned(param, "cache_size", 512)
+			* 1024 * 1024;
+	}
+
 	curl.multi = curl_multi_init();
 	if (curl.multi == NULL) {
 		g_set_error(error_r, curl_quark(), 0,
@@ -675,6 +970,18 @@ input_curl_init(const struct config_param *param,
 		return false;
 	}
 
+#if LIBCURL_VERSION_NUM >= 0x071003
+	/* the multi handle's connection cache is our connection pool:
+	   it keeps idle connections (keyed by scheme/host/port) alive
+	   after a stream is closed, so ranged seeks and track
+	   transitions within the same host skip the TCP/TLS
+	   handshake */
+	unsigned max_connections =
+		config_get_block_unsigned(param, "max_connections", 16);
+	curl_multi_setopt(curl.multi, CURLMOPT_MAXCONNECTS,
+			  (long)max_connections);
+#endif
+
 	curl.source = g_source_new(&curl_source_funcs, sizeof(*curl.source));
 	curl.source_id = g_source_attach(curl.source, io_thread_context());
 
@@ -756,8 +1063,18 @@ input_curl_free(struct input_curl *c)
 	g_free(c->meta_name);
 
 	input_curl_easy_free_indirect(c);
+	input_curl_cache_abandon(c);
 	input_curl_flush_buffers(c);
 
+#ifdef CURL_INPUT_PRERESOLVE
+	/* the CURLOPT_RESOLVE list must outlive the easy handle */
+	if (c->resolve_list != NULL)
+		curl_slist_free_all(c->resolve_list);
+	g_free(c->resolve_host);
+#endif
+
+	g_free(c->tail);
+
 	g_queue_free(c->buffers);
 
 	if (c->postponed_error != NULL)
@@ -1043,6 +1360,13 @@ input_curl_headerfunction(void *ptr, size_t size, size_t nmemb, void *stream)
 			/* a stream with icy-metadata is not
 			   seekable */
 			c->base.seekable = false;
+
+			/* ... and has metadata interleaved with the
+			   audio data, which must not end up in the
+			   disk cache */
+			g_mutex_lock(c->base.mutex);
+			input_curl_cache_abandon(c);
+			g_mutex_unlock(c->base.mutex);
 		}
 	}
 
@@ -1070,6 +1394,36 @@ input_curl_writefunction(void *ptr, size_t size, size_t nmemb, void *stream)
 	}
 #endif
 
+	if (c->cache_file != NULL &&
+	    fwrite(ptr, 1, size, c->cache_file) != size)
+		/* disk full? stop capturing, but go on streaming */
+		input_curl_cache_abandon(c);
+
+	if (c->tail == NULL && c->base.size > 0 && c->base.seekable &&
+	    !icy_defined(&c->icy_metadata)) {
+		goffset tail_size = MIN(CURL_TAIL_CACHE, c->base.size);
+
+		c->tail = g_malloc(tail_size);
+		c->tail_offset = c->base.size - tail_size;
+	}
+
+	if (c->tail != NULL) {
+		/* copy the part of this chunk which overlaps the
+		   tail region of the resource */
+		goffset begin = c->receive_offset;
+		goffset end = begin + (goffset)size;
+
+		if (end > c->tail_offset) {
+			goffset from = MAX(begin, c->tail_offset);
+
+			memcpy(c->tail + (from - c->tail_offset),
+			       (const char *)ptr + (from - begin),
+			       end - from);
+		}
+	}
+
+	c->receive_offset += size;
+
 	buffer = g_malloc(sizeof(*buffer) - sizeof(buffer->data) + size);
 	buffer->size = size;
 	buffer->consumed = 0;
@@ -1114,6 +1468,19 @@ input_curl_easy_init(struct input_curl *c, GError **error_r)
 	curl_easy_setopt(c->easy, CURLOPT_NOSIGNAL, 1l);
 	curl_easy_setopt(c->easy, CURLOPT_CONNECTTIMEOUT, 10l);
 
+	/* keep resolved addresses around for a while; together with
+	   the multi handle's connection cache, this eliminates both
+	   the lookup and the handshake when the next track comes from
+	   the same host */
+	curl_easy_setopt(c->easy, CURLOPT_DNS_CACHE_TIMEOUT, 300l);
+
+#ifdef CURL_INPUT_PRERESOLVE
+	if (c->resolve_list != NULL)
+		/* the address is already known from the first
+		   request; don't resolve it again */
+		curl_easy_setopt(c->easy, CURLOPT_RESOLVE, c->resolve_list);
+#endif
+
 	if (proxy != NULL)
 		curl_easy_setopt(c->easy, CURLOPT_PROXY, proxy);
 
@@ -1211,6 +1578,11 @@ input_curl_seek(struct input_stream *is, goffset offset, int whence,
 	g_mutex_unlock(c->base.mutex);
 
 	input_curl_easy_free_indirect(c);
+
+	/* reconnecting with a "Range" header would punch a hole into
+	   the captured copy; give up on caching this stream */
+	input_curl_cache_abandon(c);
+
 	input_curl_flush_buffers(c);
 
 	is->offset = offset;
@@ -1218,6 +1590,33 @@ input_curl_seek(struct input_stream *is, goffset offset, int whence,
 		/* seek to EOF: simulate empty result; avoid
 		   triggering a "416 Requested Range Not Satisfiable"
 		   response */
+		g_mutex_lock(c->base.mutex);
+		return true;
+	}
+
+	if (c->tail != NULL && c->tail_valid_start >= 0 &&
+	    offset >= c->tail_valid_start) {
+		/* the tail cache covers everything from here to the
+		   end of the resource; serve it from memory, without
+		   a network round trip */
+		size_t length = is->size - offset;
+		struct buffer *buffer =
+			g_malloc(sizeof(*buffer) - sizeof(buffer->data)
+				 + length);
+
+		buffer->size = length;
+		buffer->consumed = 0;
+		memcpy(buffer->data, c->tail + (offset - c->tail_offset),
+		       length);
+
+		g_mutex_lock(c->base.mutex);
+		g_queue_push_tail(c->buffers, buffer);
+
+#if LIBCURL_VERSION_NUM >= 0x071200
+		/* there is no "easy" handle to resume */
+		c->paused = false;
+#endif
+
 		return true;
 	}
 
@@ -1232,6 +1631,8 @@ input_curl_seek(struct input_stream *is, goffset offset, int whence,
 		curl_easy_setopt(c->easy, CURLOPT_RANGE, c->range);
 	}
 
+	c->request_start = c->receive_offset = is->offset;
+
 	c->base.ready = false;
 
 	if (!input_curl_easy_add_indirect(c, error_r))
@@ -1251,6 +1652,145 @@ input_curl_seek(struct input_stream *is, goffset offset, int whence,
 	return true;
 }
 
+#ifdef CURL_INPUT_PRERESOLVE
+
+/**
+ * Extracts the host name and port from a "http://" URL, for
+ * pre-resolving it.  Returns false if they cannot be determined
+ * (e.g. IPv6 address literal); libcurl will resolve the host itself
+ * then.
+ */
+static bool
+input_curl_parse_host(const char *url, char **host_r, unsigned *port_r)
+{
+	const char *p = url + 7, *end, *colon;
+	unsigned port = 80;
+
+	end = p + strcspn(p, "/");
+
+	/* skip the userinfo part, if there is one */
+	for (const char *q = p; q != end; ++q)
+		if (*q == '@')
+			p = q + 1;
+
+	if (p == end || *p == '[')
+		return false;
+
+	colon = memchr(p, ':', end - p);
+	if (colon != NULL) {
+		char *endptr;
+		unsigned long value = strtoul(colon + 1, &endptr, 10);
+
+		if (endptr != end || value == 0 || value > 0xffff)
+			return false;
+
+		port = value;
+		end = colon;
+
+		if (p == end)
+			return false;
+	}
+
+	*host_r = g_strndup(p, end - p);
+	*port_r = port;
+	return true;
+}
+
+/**
+ * Aborts the stream before the request was submitted; used when the
+ * DNS lookup fails.  Runs in the I/O thread.
+ */
+static void
+input_curl_abort_postponed(struct input_curl *c, GError *error)
+{
+	assert(io_thread_inside());
+	assert(c->postponed_error == NULL);
+
+	input_curl_easy_free(c);
+
+	g_mutex_lock(c->base.mutex);
+	c->postponed_error = error;
+	c->base.ready = true;
+	g_cond_broadcast(c->base.cond);
+	g_mutex_unlock(c->base.mutex);
+}
+
+/** runs in the I/O thread */
+static void
+input_curl_resolved(struct addrinfo *ai, void *ctx)
+{
+	struct input_curl *c = ctx;
+
+	assert(io_thread_inside());
+	assert(c->resolve != NULL);
+
+	c->resolve = NULL;
+
+	/* pass the (first) address to libcurl, so it does not have
+	   to block on getaddrinfo() itself */
+	char address[NI_MAXHOST];
+	if (getnameinfo(ai->ai_addr, ai->ai_addrlen,
+			address, sizeof(address), NULL, 0,
+			NI_NUMERICHOST) == 0) {
+		char *entry = g_strdup_printf("%s:%u:%s", c->resolve_host,
+					      c->resolve_port, address);
+		c->resolve_list = curl_slist_append(NULL, entry);
+		g_free(entry);
+
+		curl_easy_setopt(c->easy, CURLOPT_RESOLVE, c->resolve_list);
+	}
+
+	freeaddrinfo(ai);
+
+	GError *error = NULL;
+	if (!input_curl_easy_add(c, &error))
+		input_curl_abort_postponed(c, error);
+}
+
+/** runs in the I/O thread */
+static void
+input_curl_resolve_error(GError *error, void *ctx)
+{
+	struct input_curl *c = ctx;
+
+	assert(io_thread_inside());
+	assert(c->resolve != NULL);
+
+	c->resolve = NULL;
+
+	input_curl_abort_postponed(c, error);
+}
+
+static const struct resolver_async_handler input_curl_resolver_handler = {
+	.success = input_curl_resolved,
+	.error = input_curl_resolve_error,
+};
+
+#endif /* CURL_INPUT_PRERESOLVE */
+
+/**
+ * Submits the first request: either directly, or after an
+ * asynchronous DNS lookup of the URL's host.
+ */
+static bool
+input_curl_start(struct input_curl *c, GError **error_r)
+{
+#ifdef CURL_INPUT_PRERESOLVE
+	if (proxy == NULL &&
+	    input_curl_parse_host(c->url, &c->resolve_host,
+				  &c->resolve_port)) {
+		c->resolve = resolver_async_start(c->resolve_host,
+						  c->resolve_port,
+						  0, SOCK_STREAM,
+						  &input_curl_resolver_handler,
+						  c);
+		return true;
+	}
+#endif
+
+	return input_curl_easy_add_indirect(c, error_r);
+}
+
 static struct input_stream *
 input_curl_open(const char *url, GMutex *mutex, GCond *cond,
 		GError **error_r)
@@ -1263,6 +1803,24 @@ input_curl_open(const char *url, GMutex *mutex, GCond *cond,
 	if (strncmp(url, "http://", 7) != 0)
 		return NULL;
 
+	if (cache_dir != NULL) {
+		/* check the disk cache first; a complete copy is
+		   served locally, without a network round trip */
+		char *path = input_curl_cache_path(url);
+
+		if (g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+			struct input_stream *is =
+				input_plugin_file.open(path, mutex, cond,
+						       NULL);
+			if (is != NULL) {
+				g_free(path);
+				return is;
+			}
+		}
+
+		g_free(path);
+	}
+
 	c = g_new0(struct input_curl, 1);
 	input_stream_init(&c->base, &input_plugin_curl, url,
 			  mutex, cond);
@@ -1275,6 +1833,13 @@ input_curl_open(const char *url, GMutex *mutex, GCond *cond,
 
 	c->postponed_error = NULL;
 
+	c->tail = NULL;
+	c->tail_valid_start = -1;
+	c->request_start = 0;
+	c->receive_offset = 0;
+
+	input_curl_cache_open(c);
+
 #if LIBCURL_VERSION_NUM >= 0x071200
 	c->paused = false;
 #endif
@@ -1284,7 +1849,7 @@ input_curl_open(const char *url, GMutex *mutex, GCond *cond,
 		return NULL;
 	}
 
-	if (!input_curl_easy_add_indirect(c, error_r)) {
+	if (!input_curl_start(c, error_r)) {
 		input_curl_free(c);
 		return NULL;
 	}
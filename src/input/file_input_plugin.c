@@ -21,6 +21,7 @@
 #include "input/file_input_plugin.h"
 #include "input_internal.h"
 #include "input_plugin.h"
+#include "conf.h"
 #include "fd_util.h"
 #include "open.h"
 
@@ -33,10 +34,65 @@
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "input_file"
 
+/**
+ * Size of the readahead ring buffer in bytes; 0 disables the
+ * readahead thread, and read() is called synchronously by the
+ * decoder.
+ */
+static size_t input_file_readahead;
+
 struct file_input_stream {
 	struct input_stream base;
 
 	int fd;
+
+	/**
+	 * The readahead thread, or NULL if readahead is disabled.
+	 * All of the following attributes are unused when this is
+	 * NULL.
+	 */
+	GThread *thread;
+
+	/**
+	 * Signalled to wake up the readahead thread after buffered
+	 * data has been consumed, a seek has been requested or the
+	 * stream is about to be closed.  The thread in turn signals
+	 * base.cond, like the other asynchronous input plugins.
+	 */
+	GCond *wake_cond;
+
+	/**
+	 * The ring buffer, #input_file_readahead bytes.  The range
+	 * [#position,#position+#length) (modulo the buffer size)
+	 * contains data which has been read from the file, but not
+	 * yet consumed.
+	 */
+	char *buffer;
+
+	/** start offset of the buffered data within #buffer */
+	size_t position;
+
+	/** number of buffered bytes */
+	size_t length;
+
+	/**
+	 * An absolute file offset the readahead thread shall seek
+	 * to, or -1 if no seek is pending.  Protected by base.mutex;
+	 * base.cond is signalled when the seek has been finished.
+	 */
+	goffset seek_offset;
+
+	/** has the readahead thread seen end-of-file? */
+	bool eof;
+
+	/** tells the readahead thread to exit */
+	bool quit;
+
+	/**
+	 * An error that occurred in the readahead thread, to be
+	 * consumed (and freed) by the next read or seek call.
+	 */
+	GError *postponed_error;
 };
 
 static inline GQuark
@@ -45,6 +101,101 @@ file_quark(void)
 	return g_quark_from_static_string("file");
 }
 
+static bool
+input_file_init(const struct config_param *param,
+		G_GNUC_UNUSED GError **error_r)
+{
+	input_file_readahead =
+		config_get_block_unsigned(param, "readahead", 0);
+
+	/* a tiny ring would make the decoder ping-pong with the
+	   readahead thread for every read; enforce a sane minimum */
+	if (input_file_readahead > 0 && input_file_readahead < 16384)
+		input_file_readahead = 16384;
+
+	return true;
+}
+
+/**
+ * The readahead thread: fills the ring buffer with data from the
+ * file, so the decoder thread never blocks on cold file I/O.
+ */
+static gpointer
+input_file_thread(gpointer data)
+{
+	struct file_input_stream *fis = data;
+	struct input_stream *is = &fis->base;
+
+	g_mutex_lock(is->mutex);
+
+	while (!fis->quit) {
+		if (fis->seek_offset >= 0) {
+			/* seek requested by the decoder thread */
+			goffset offset = fis->seek_offset;
+
+			if (lseek(fis->fd, (off_t)offset, SEEK_SET) < 0)
+				fis->postponed_error =
+					g_error_new(file_quark(), errno,
+						    "Failed to seek: %s",
+						    g_strerror(errno));
+			else
+				is->offset = offset;
+
+			fis->position = 0;
+			fis->length = 0;
+			fis->eof = false;
+			fis->seek_offset = -1;
+			g_cond_signal(is->cond);
+			continue;
+		}
+
+		if (fis->eof || fis->postponed_error != NULL ||
+		    fis->length == input_file_readahead) {
+			/* nothing to do; wait until the decoder has
+			   consumed something */
+			g_cond_wait(fis->wake_cond, is->mutex);
+			continue;
+		}
+
+		/* the free space at the end of the ring belongs to
+		   this thread; the decoder only touches the buffered
+		   range, so read() can run unlocked */
+		size_t tail = (fis->position + fis->length)
+			% input_file_readahead;
+		size_t nbytes = input_file_readahead - fis->length;
+		if (nbytes > input_file_readahead - tail)
+			nbytes = input_file_readahead - tail;
+
+		g_mutex_unlock(is->mutex);
+		ssize_t result = read(fis->fd, fis->buffer + tail, nbytes);
+		g_mutex_lock(is->mutex);
+
+		if (fis->quit)
+			break;
+
+		if (fis->seek_offset >= 0)
+			/* a seek arrived while we were reading; the
+			   data belongs to the old position, discard
+			   it */
+			continue;
+
+		if (result < 0)
+			fis->postponed_error =
+				g_error_new(file_quark(), errno,
+					    "Failed to read: %s",
+					    g_strerror(errno));
+		else if (result == 0)
+			fis->eof = true;
+		else
+			fis->length += (size_t)result;
+
+		g_cond_signal(is->cond);
+	}
+
+	g_mutex_unlock(is->mutex);
+	return NULL;
+}
+
 static struct input_stream *
 input_file_open(const char *filename,
 		GMutex *mutex, GCond *cond,
@@ -95,16 +246,105 @@ input_file_open(const char *filename,
 	fis->base.ready = true;
 
 	fis->fd = fd;
+	fis->thread = NULL;
+
+	if (input_file_readahead > 0) {
+		fis->wake_cond = g_cond_new();
+		fis->buffer = g_malloc(input_file_readahead);
+		fis->position = 0;
+		fis->length = 0;
+		fis->seek_offset = -1;
+		fis->eof = false;
+		fis->quit = false;
+		fis->postponed_error = NULL;
+
+		GError *error = NULL;
+		fis->thread = g_thread_create(input_file_thread, fis,
+					      true, &error);
+		if (fis->thread == NULL) {
+			/* fall back to synchronous reads */
+			g_warning("Failed to spawn readahead thread: %s",
+				  error->message);
+			g_error_free(error);
+
+			g_cond_free(fis->wake_cond);
+			g_free(fis->buffer);
+		}
+	}
 
 	return &fis->base;
 }
 
+static bool
+input_file_buffered_seek(struct file_input_stream *fis,
+			 goffset offset, int whence, GError **error_r)
+{
+	struct input_stream *is = &fis->base;
+
+	switch (whence) {
+	case SEEK_SET:
+		break;
+
+	case SEEK_CUR:
+		offset += is->offset;
+		break;
+
+	case SEEK_END:
+		offset += is->size;
+		break;
+
+	default:
+		g_set_error(error_r, file_quark(), EINVAL,
+			    "Failed to seek: %s", g_strerror(EINVAL));
+		return false;
+	}
+
+	if (offset < 0) {
+		g_set_error(error_r, file_quark(), EINVAL,
+			    "Failed to seek: %s", g_strerror(EINVAL));
+		return false;
+	}
+
+	if (offset >= is->offset &&
+	    offset - is->offset <= (goffset)fis->length) {
+		/* the seek target is already buffered; just skip
+		   over it */
+		size_t skip = offset - is->offset;
+
+		fis->position = (fis->position + skip)
+			% input_file_readahead;
+		fis->length -= skip;
+		is->offset = offset;
+
+		g_cond_signal(fis->wake_cond);
+		return true;
+	}
+
+	fis->seek_offset = offset;
+	g_cond_signal(fis->wake_cond);
+
+	while (fis->seek_offset >= 0)
+		g_cond_wait(is->cond, is->mutex);
+
+	if (fis->postponed_error != NULL) {
+		g_propagate_error(error_r, fis->postponed_error);
+		fis->postponed_error = NULL;
+		return false;
+	}
+
+	return true;
+}
+
 static bool
 input_file_seek(struct input_stream *is, goffset offset, int whence,
 		GError **error_r)
 {
 	struct file_input_stream *fis = (struct file_input_stream *)is;
 
+	if (fis->thread != NULL)
+		return input_file_buffered_seek(fis, offset, whence,
+						error_r);
+
 	offset = (goffset)lseek(fis->fd, (off_t)offset, whence);
 	if (offset < 0) {
 		g_set_error(error_r, file_quark(), errno,
@@ -116,6 +356,42 @@ input_file_seek(struct input_stream *is, goffset offset, int whence,
 	return true;
 }
 
+static size_t
+input_file_buffered_read(struct file_input_stream *fis,
+			 void *ptr, size_t size, GError **error_r)
+{
+	struct input_stream *is = &fis->base;
+	size_t nbytes;
+
+	while (fis->length == 0) {
+		if (fis->postponed_error != NULL) {
+			g_propagate_error(error_r, fis->postponed_error);
+			fis->postponed_error = NULL;
+			return 0;
+		}
+
+		if (fis->eof)
+			return 0;
+
+		g_cond_wait(is->cond, is->mutex);
+	}
+
+	nbytes = fis->length;
+	if (nbytes > size)
+		nbytes = size;
+	if (nbytes > input_file_readahead - fis->position)
+		/* don't wrap around in one copy */
+		nbytes = input_file_readahead - fis->position;
+
+	memcpy(ptr, fis->buffer + fis->position, nbytes);
+	fis->position = (fis->position + nbytes) % input_file_readahead;
+	fis->length -= nbytes;
+	is->offset += nbytes;
+
+	g_cond_signal(fis->wake_cond);
+	return nbytes;
+}
+
 static size_t
 input_file_read(struct input_stream *is, void *ptr, size_t size,
 		GError **error_r)
@@ -123,6 +399,9 @@ input_file_read(struct input_stream *is, void *ptr, size_t size,
 	struct file_input_stream *fis = (struct file_input_stream *)is;
 	ssize_t nbytes;
 
+	if (fis->thread != NULL)
+		return input_file_buffered_read(fis, ptr, size, error_r);
+
 	nbytes = read(fis->fd, ptr, size);
 	if (nbytes < 0) {
 		g_set_error(error_r, file_quark(), errno,
@@ -139,11 +418,35 @@ input_file_close(struct input_stream *is)
 {
 	struct file_input_stream *fis = (struct file_input_stream *)is;
 
+	if (fis->thread != NULL) {
+		g_mutex_lock(is->mutex);
+		fis->quit = true;
+		g_cond_signal(fis->wake_cond);
+		g_mutex_unlock(is->mutex);
+
+		g_thread_join(fis->thread);
+
+		g_cond_free(fis->wake_cond);
+		g_free(fis->buffer);
+
+		if (fis->postponed_error != NULL)
+			g_error_free(fis->postponed_error);
+	}
+
 	close(fis->fd);
 	input_stream_deinit(&fis->base);
 	g_free(fis);
 }
 
+static bool
+input_file_available(struct input_stream *is)
+{
+	struct file_input_stream *fis = (struct file_input_stream *)is;
+
+	return fis->thread == NULL || fis->length > 0 || fis->eof ||
+		fis->postponed_error != NULL;
+}
+
 static bool
 input_file_eof(struct input_stream *is)
 {
@@ -152,8 +455,10 @@ input_file_eof(struct input_stream *is)
 
 const struct input_plugin input_plugin_file = {
 	.name = "file",
+	.init = input_file_init,
 	.open = input_file_open,
 	.close = input_file_close,
+	.available = input_file_available,
 	.read = input_file_read,
 	.eof = input_file_eof,
 	.seek = input_file_seek,
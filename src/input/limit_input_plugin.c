@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "input/limit_input_plugin.h"
+#include "input_internal.h"
+#include "input_plugin.h"
+
+#include <glib.h>
+
+#include <assert.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "input_limit"
+
+/**
+ * The default read budget.  Large enough for all sane metadata
+ * (including embedded cover art), but small compared to the audio
+ * data of a typical song.
+ */
+#define LIMIT_DEFAULT_BUDGET (1024 * 1024)
+
+struct input_limit {
+	struct input_stream base;
+
+	struct input_stream *input;
+
+	/**
+	 * The number of bytes which may still be read.  Seeks do not
+	 * count against this budget.
+	 */
+	size_t remaining;
+};
+
+/**
+ * Copy public attributes from the underlying input stream to the
+ * "limit" input stream.  This function is called when a method of the
+ * underlying stream has returned, which may have modified these
+ * attributes.
+ */
+static void
+copy_attributes(struct input_limit *l)
+{
+	struct input_stream *dest = &l->base;
+	const struct input_stream *src = l->input;
+
+	assert(dest != src);
+
+	dest->ready = src->ready;
+	dest->seekable = src->seekable;
+	dest->size = src->size;
+	dest->offset = src->offset;
+
+	if (dest->mime == NULL && src->mime != NULL)
+		dest->mime = g_strdup(src->mime);
+}
+
+static void
+input_limit_close(struct input_stream *is)
+{
+	struct input_limit *l = (struct input_limit *)is;
+
+	/* the underlying stream is owned by the caller of
+	   input_limit_open() and is not closed here */
+
+	input_stream_deinit(&l->base);
+	g_free(l);
+}
+
+static bool
+input_limit_check(struct input_stream *is, GError **error_r)
+{
+	struct input_limit *l = (struct input_limit *)is;
+
+	return input_stream_check(l->input, error_r);
+}
+
+static void
+input_limit_update(struct input_stream *is)
+{
+	struct input_limit *l = (struct input_limit *)is;
+
+	input_stream_update(l->input);
+	copy_attributes(l);
+}
+
+static struct tag *
+input_limit_tag(struct input_stream *is)
+{
+	struct input_limit *l = (struct input_limit *)is;
+
+	return input_stream_tag(l->input);
+}
+
+static bool
+input_limit_available(struct input_stream *is)
+{
+	struct input_limit *l = (struct input_limit *)is;
+
+	return input_stream_available(l->input);
+}
+
+static size_t
+input_limit_read(struct input_stream *is, void *ptr, size_t size,
+		 GError **error_r)
+{
+	struct input_limit *l = (struct input_limit *)is;
+
+	if (l->remaining == 0)
+		/* budget exhausted: pretend the stream has ended, so
+		   the scan fails gracefully */
+		return 0;
+
+	if (size > l->remaining)
+		size = l->remaining;
+
+	size_t nbytes = input_stream_read(l->input, ptr, size, error_r);
+	l->remaining -= nbytes;
+
+	copy_attributes(l);
+
+	return nbytes;
+}
+
+static bool
+input_limit_eof(struct input_stream *is)
+{
+	struct input_limit *l = (struct input_limit *)is;
+
+	return l->remaining == 0 || input_stream_eof(l->input);
+}
+
+static bool
+input_limit_seek(struct input_stream *is, goffset offset, int whence,
+		 GError **error_r)
+{
+	struct input_limit *l = (struct input_limit *)is;
+
+	bool success = input_stream_seek(l->input, offset, whence, error_r);
+	copy_attributes(l);
+
+	return success;
+}
+
+static const struct input_plugin limit_input_plugin = {
+	.close = input_limit_close,
+	.check = input_limit_check,
+	.update = input_limit_update,
+	.tag = input_limit_tag,
+	.available = input_limit_available,
+	.read = input_limit_read,
+	.eof = input_limit_eof,
+	.seek = input_limit_seek,
+};
+
+struct input_stream *
+input_limit_open(struct input_stream *is, size_t budget)
+{
+	struct input_limit *l;
+
+	assert(is != NULL);
+
+	if (budget == 0)
+		budget = LIMIT_DEFAULT_BUDGET;
+
+	l = g_new(struct input_limit, 1);
+	input_stream_init(&l->base, &limit_input_plugin, is->uri,
+			  is->mutex, is->cond);
+	l->input = is;
+	l->remaining = budget;
+
+	copy_attributes(l);
+
+	return &l->base;
+}
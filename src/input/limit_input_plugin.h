@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A wrapper for an input_stream object which limits the number of
+ * bytes which can be read from it.  It is used to bound the I/O of
+ * tag scanning: seeks are passed through unharmed, but once the read
+ * budget is exhausted, further reads pretend the stream has ended.
+ */
+
+#ifndef MPD_INPUT_LIMIT_H
+#define MPD_INPUT_LIMIT_H
+
+#include "check.h"
+
+#include <stddef.h>
+
+struct input_stream;
+
+/**
+ * Wraps the specified input stream.  Unlike other input streams,
+ * closing the wrapper does not close the underlying stream, which
+ * remains owned by the caller.
+ *
+ * @param budget the maximum number of bytes which can be read through
+ * the wrapper; 0 means apply a conservative default
+ */
+struct input_stream *
+input_limit_open(struct input_stream *is, size_t budget);
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A variant of the "file" input plugin which maps local files with
+ * mmap() and exposes the mapping through the peek/consume methods,
+ * so decoders can consume data straight from the page cache, without
+ * copying it into intermediate buffers.
+ *
+ * The plugin is disabled by default, because a mapped file pins
+ * address space for its whole size; enable it with an "input" block
+ * in mpd.conf.  Files it does not handle (non-regular, empty, too
+ * large for the address space) fall through to the "file" plugin.
+ */
+
+#include "config.h" /* must be first for large file support */
+#include "input/mmap_input_plugin.h"
+#include "input_internal.h"
+#include "input_plugin.h"
+#include "fd_util.h"
+#include "open.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <glib.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "input_mmap"
+
+#ifdef HAVE_SYS_MMAN_H
+
+/**
+ * Only use this plugin if it has been configured explicitly (with an
+ * "input" block).
+ */
+static bool input_mmap_enabled;
+
+struct mmap_input_stream {
+	struct input_stream base;
+
+	/** the mapped file */
+	void *map;
+
+	/** the size of the mapping (and of the file) */
+	size_t map_size;
+};
+
+static inline GQuark
+mmap_quark(void)
+{
+	return g_quark_from_static_string("mmap");
+}
+
+static bool
+input_mmap_init(const struct config_param *param,
+		G_GNUC_UNUSED GError **error_r)
+{
+	input_mmap_enabled = param != NULL;
+	return true;
+}
+
+static struct input_stream *
+input_mmap_open(const char *filename,
+		GMutex *mutex, GCond *cond,
+		GError **error_r)
+{
+	int fd, ret;
+	struct stat st;
+	void *map;
+	struct mmap_input_stream *mis;
+
+	if (!input_mmap_enabled || !g_path_is_absolute(filename))
+		return NULL;
+
+	fd = open_cloexec(filename, O_RDONLY|O_BINARY, 0);
+	if (fd < 0)
+		/* let the "file" plugin generate the error message */
+		return NULL;
+
+	ret = fstat(fd, &st);
+	if (ret < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+	    (uintmax_t)st.st_size > SIZE_MAX / 2) {
+		/* not mappable; fall through to the "file" plugin */
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	/* the mapping keeps the file alive */
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		g_set_error(error_r, mmap_quark(), errno,
+			    "Failed to map \"%s\": %s",
+			    filename, g_strerror(errno));
+		return NULL;
+	}
+
+#ifdef POSIX_MADV_SEQUENTIAL
+	posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+
+	mis = g_new(struct mmap_input_stream, 1);
+	input_stream_init(&mis->base, &input_plugin_mmap, filename,
+			  mutex, cond);
+
+	mis->base.size = st.st_size;
+	mis->base.seekable = true;
+	mis->base.ready = true;
+
+	mis->map = map;
+	mis->map_size = (size_t)st.st_size;
+
+	return &mis->base;
+}
+
+static bool
+input_mmap_seek(struct input_stream *is, goffset offset, int whence,
+		GError **error_r)
+{
+	switch (whence) {
+	case SEEK_SET:
+		break;
+
+	case SEEK_CUR:
+		offset += is->offset;
+		break;
+
+	case SEEK_END:
+		offset += is->size;
+		break;
+
+	default:
+		g_set_error(error_r, mmap_quark(), EINVAL,
+			    "Failed to seek: %s", g_strerror(EINVAL));
+		return false;
+	}
+
+	if (offset < 0) {
+		g_set_error(error_r, mmap_quark(), EINVAL,
+			    "Failed to seek: %s", g_strerror(EINVAL));
+		return false;
+	}
+
+	is->offset = offset;
+	return true;
+}
+
+static size_t
+input_mmap_read(struct input_stream *is, void *ptr, size_t size,
+		G_GNUC_UNUSED GError **error_r)
+{
+	struct mmap_input_stream *mis = (struct mmap_input_stream *)is;
+
+	if (is->offset >= (goffset)mis->map_size)
+		return 0;
+
+	size_t remaining = mis->map_size - (size_t)is->offset;
+	if (size > remaining)
+		size = remaining;
+
+	memcpy(ptr, (const char *)mis->map + is->offset, size);
+	is->offset += size;
+	return size;
+}
+
+static const void *
+input_mmap_peek(struct input_stream *is, size_t *length_r)
+{
+	struct mmap_input_stream *mis = (struct mmap_input_stream *)is;
+
+	if (is->offset >= (goffset)mis->map_size)
+		return NULL;
+
+	*length_r = mis->map_size - (size_t)is->offset;
+	return (const char *)mis->map + is->offset;
+}
+
+static void
+input_mmap_consume(struct input_stream *is, size_t nbytes)
+{
+	assert(is->offset + (goffset)nbytes <=
+	       (goffset)((struct mmap_input_stream *)is)->map_size);
+
+	is->offset += nbytes;
+}
+
+static void
+input_mmap_close(struct input_stream *is)
+{
+	struct mmap_input_stream *mis = (struct mmap_input_stream *)is;
+
+	munmap(mis->map, mis->map_size);
+	input_stream_deinit(&mis->base);
+	g_free(mis);
+}
+
+static bool
+input_mmap_eof(struct input_stream *is)
+{
+	return is->offset >= is->size;
+}
+
+const struct input_plugin input_plugin_mmap = {
+	.name = "mmap",
+	.init = input_mmap_init,
+	.open = input_mmap_open,
+	.close = input_mmap_close,
+	.read = input_mmap_read,
+	.peek = input_mmap_peek,
+	.consume = input_mmap_consume,
+	.eof = input_mmap_eof,
+	.seek = input_mmap_seek,
+};
+
+#endif /* HAVE_SYS_MMAN_H */
@@ -31,12 +31,85 @@
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "input_mms"
 
+/**
+ * The size of each mmsx_read() call in the receiver thread.
+ */
+#define MMS_BUFFER_SIZE 16384
+
+/**
+ * Do not buffer more than this number of bytes.  It should be a
+ * reasonable limit that doesn't make low-end machines suffer too
+ * much, but doesn't cause stuttering on high-latency lines.
+ */
+#define MMS_MAX_BUFFERED (512 * 1024)
+
+/**
+ * Resume receiving when the buffer has been drained to this number of
+ * bytes.
+ */
+#define MMS_RESUME_AT (384 * 1024)
+
+struct input_mms_buffer {
+	size_t size;
+
+	/** the number of bytes already consumed from this buffer */
+	size_t consumed;
+
+	unsigned char data[sizeof(long)];
+};
+
 struct input_mms {
 	struct input_stream base;
 
+	/**
+	 * The stream handle.  Created by the receiver thread, and
+	 * used only there; the main thread only closes it after the
+	 * thread has been joined.
+	 */
 	mmsx_t *mms;
 
+	/**
+	 * The thread which connects and receives; libmms does
+	 * blocking network I/O, and running it here keeps the decoder
+	 * from stalling on every read.
+	 */
+	GThread *thread;
+
+	/**
+	 * A queue of #input_mms_buffer objects, protected by
+	 * base.mutex.
+	 */
+	GQueue *buffers;
+
+	/**
+	 * The sum of all unconsumed bytes in #buffers.
+	 */
+	size_t total_buffered;
+
+	/**
+	 * Set when the buffer has reached #MMS_MAX_BUFFERED; the
+	 * receiver thread sleeps until the reader has drained the
+	 * buffer below #MMS_RESUME_AT.
+	 */
+	bool paused;
+
+	/**
+	 * Set by input_mms_close(); tells the receiver thread to
+	 * exit.
+	 */
+	bool close_requested;
+
+	/**
+	 * Set by the receiver thread when the stream has ended (or
+	 * failed).
+	 */
 	bool eof;
+
+	/**
+	 * An error which occurred in the receiver thread, to be
+	 * delivered by input_mms_check().
+	 */
+	GError *postponed_error;
 };
 
 static inline GQuark
@@ -45,6 +118,77 @@ mms_quark(void)
 	return g_quark_from_static_string("mms");
 }
 
+static gpointer
+input_mms_thread(gpointer data)
+{
+	struct input_mms *m = data;
+
+	/* the connect is a blocking library call; do it here so
+	   input_mms_open() returns quickly */
+
+	mmsx_t *mms = mmsx_connect(NULL, NULL, m->base.uri, 128 * 1024);
+
+	g_mutex_lock(m->base.mutex);
+
+	if (mms == NULL) {
+		m->postponed_error = g_error_new(mms_quark(), 0,
+						 "mmsx_connect() failed");
+		m->eof = true;
+		m->base.ready = true;
+		g_cond_broadcast(m->base.cond);
+		g_mutex_unlock(m->base.mutex);
+		return NULL;
+	}
+
+	m->mms = mms;
+	m->base.ready = true;
+	g_cond_broadcast(m->base.cond);
+
+	while (!m->close_requested) {
+		if (m->total_buffered >= MMS_MAX_BUFFERED) {
+			/* the high watermark is reached: sleep until
+			   the reader has caught up */
+			m->paused = true;
+			while (m->paused && !m->close_requested)
+				g_cond_wait(m->base.cond, m->base.mutex);
+			continue;
+		}
+
+		g_mutex_unlock(m->base.mutex);
+
+		struct input_mms_buffer *b =
+			g_malloc(sizeof(*b) - sizeof(b->data) +
+				 MMS_BUFFER_SIZE);
+		int nbytes = mmsx_read(NULL, mms, (char *)b->data,
+				       MMS_BUFFER_SIZE);
+
+		g_mutex_lock(m->base.mutex);
+
+		if (nbytes <= 0) {
+			g_free(b);
+
+			if (nbytes < 0 && !m->close_requested)
+				m->postponed_error =
+					g_error_new(mms_quark(), errno,
+						    "mmsx_read() failed: %s",
+						    g_strerror(errno));
+
+			m->eof = true;
+			g_cond_broadcast(m->base.cond);
+			break;
+		}
+
+		b->size = nbytes;
+		b->consumed = 0;
+		g_queue_push_tail(m->buffers, b);
+		m->total_buffered += nbytes;
+		g_cond_broadcast(m->base.cond);
+	}
+
+	g_mutex_unlock(m->base.mutex);
+	return NULL;
+}
+
 static struct input_stream *
 input_mms_open(const char *url,
 	       GMutex *mutex, GCond *cond,
@@ -58,50 +202,87 @@ input_mms_open(const char *url,
 	    !g_str_has_prefix(url, "mmsu://"))
 		return NULL;
 
-	m = g_new(struct input_mms, 1);
+	m = g_new0(struct input_mms, 1);
 	input_stream_init(&m->base, &input_plugin_mms, url,
 			  mutex, cond);
 
-	m->mms = mmsx_connect(NULL, NULL, url, 128 * 1024);
-	if (m->mms == NULL) {
-		g_free(m);
-		g_set_error(error_r, mms_quark(), 0, "mmsx_connect() failed");
-		return NULL;
-	}
-
-	m->eof = false;
+	m->buffers = g_queue_new();
 
 	/* XX is this correct?  at least this selects the ffmpeg
 	   decoder, which seems to work fine*/
 	m->base.mime = g_strdup("audio/x-ms-wma");
 
-	m->base.ready = true;
+	m->thread = g_thread_create(input_mms_thread, m, true, error_r);
+	if (m->thread == NULL) {
+		g_queue_free(m->buffers);
+		input_stream_deinit(&m->base);
+		g_free(m);
+		return NULL;
+	}
 
 	return &m->base;
 }
 
+static bool
+input_mms_check(struct input_stream *is, GError **error_r)
+{
+	struct input_mms *m = (struct input_mms *)is;
+
+	bool success = m->postponed_error == NULL;
+	if (!success) {
+		g_propagate_error(error_r, m->postponed_error);
+		m->postponed_error = NULL;
+	}
+
+	return success;
+}
+
 static size_t
 input_mms_read(struct input_stream *is, void *ptr, size_t size,
 	       GError **error_r)
 {
 	struct input_mms *m = (struct input_mms *)is;
-	int ret;
-
-	ret = mmsx_read(NULL, m->mms, ptr, size);
-	if (ret <= 0) {
-		if (ret < 0) {
-			g_set_error(error_r, mms_quark(), errno,
-				    "mmsx_read() failed: %s",
-				    g_strerror(errno));
-		}
 
-		m->eof = true;
-		return false;
+	while (g_queue_is_empty(m->buffers) && !m->eof)
+		g_cond_wait(m->base.cond, m->base.mutex);
+
+	if (m->postponed_error != NULL) {
+		g_propagate_error(error_r, m->postponed_error);
+		m->postponed_error = NULL;
+		return 0;
+	}
+
+	size_t nbytes = 0;
+	while (nbytes < size) {
+		struct input_mms_buffer *b = g_queue_peek_head(m->buffers);
+		if (b == NULL)
+			break;
+
+		size_t remaining = b->size - b->consumed;
+		size_t n = MIN(remaining, size - nbytes);
+
+		memcpy((unsigned char *)ptr + nbytes,
+		       b->data + b->consumed, n);
+		nbytes += n;
+		b->consumed += n;
+
+		if (b->consumed >= b->size) {
+			g_queue_pop_head(m->buffers);
+			g_free(b);
+		}
 	}
 
-	is->offset += ret;
+	m->total_buffered -= nbytes;
+	is->offset += nbytes;
 
-	return (size_t)ret;
+	if (m->paused && m->total_buffered < MMS_RESUME_AT) {
+		/* the low watermark is reached: wake up the receiver
+		   thread */
+		m->paused = false;
+		g_cond_broadcast(m->base.cond);
+	}
+
+	return nbytes;
 }
 
 static void
@@ -109,7 +290,25 @@ input_mms_close(struct input_stream *is)
 {
 	struct input_mms *m = (struct input_mms *)is;
 
-	mmsx_close(m->mms);
+	g_mutex_lock(m->base.mutex);
+	m->close_requested = true;
+	m->paused = false;
+	g_cond_broadcast(m->base.cond);
+	g_mutex_unlock(m->base.mutex);
+
+	g_thread_join(m->thread);
+
+	if (m->mms != NULL)
+		mmsx_close(m->mms);
+
+	struct input_mms_buffer *b;
+	while ((b = g_queue_pop_head(m->buffers)) != NULL)
+		g_free(b);
+	g_queue_free(m->buffers);
+
+	if (m->postponed_error != NULL)
+		g_error_free(m->postponed_error);
+
 	input_stream_deinit(&m->base);
 	g_free(m);
 }
@@ -119,7 +318,7 @@ input_mms_eof(struct input_stream *is)
 {
 	struct input_mms *m = (struct input_mms *)is;
 
-	return m->eof;
+	return m->eof && g_queue_is_empty(m->buffers);
 }
 
 static bool
@@ -134,6 +333,7 @@ const struct input_plugin input_plugin_mms = {
 	.name = "mms",
 	.open = input_mms_open,
 	.close = input_mms_close,
+	.check = input_mms_check,
 	.read = input_mms_read,
 	.eof = input_mms_eof,
 	.seek = input_mms_seek,
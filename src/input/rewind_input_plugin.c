@@ -21,16 +21,109 @@
 #include "input/rewind_input_plugin.h"
 #include "input_internal.h"
 #include "input_plugin.h"
+#include "conf.h"
 #include "tag.h"
+#include "uri.h"
 
 #include <glib.h>
 
 #include <assert.h>
+#include <string.h>
 #include <stdio.h>
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "input_rewind"
 
+/**
+ * The size of one buffer page.  Pages are allocated on demand, so a
+ * stream which gets probed with only a few kilobytes does not pay for
+ * the whole rewind window.
+ */
+#define REWIND_PAGE_SIZE (16 * 1024)
+
+/**
+ * The maximum number of free pages kept for reuse.  Each decoded
+ * stream allocates and releases the same few pages, so recycling them
+ * avoids hammering the allocator.
+ */
+#define REWIND_PAGE_POOL_MAX 16
+
+/**
+ * The configured size of the rewind window in bytes (rounded up to
+ * whole pages).  Set by input_rewind_global_init().
+ */
+static size_t rewind_buffer_capacity;
+
+/**
+ * The number of pages needed for a full rewind window.
+ */
+static unsigned rewind_buffer_pages;
+
+static GStaticMutex rewind_page_pool_mutex = G_STATIC_MUTEX_INIT;
+static GSList *rewind_page_pool;
+static unsigned rewind_page_pool_size;
+
+static char *
+rewind_page_alloc(void)
+{
+	char *page;
+
+	g_static_mutex_lock(&rewind_page_pool_mutex);
+
+	if (rewind_page_pool != NULL) {
+		page = rewind_page_pool->data;
+		rewind_page_pool = g_slist_delete_link(rewind_page_pool,
+						       rewind_page_pool);
+		--rewind_page_pool_size;
+	} else
+		page = NULL;
+
+	g_static_mutex_unlock(&rewind_page_pool_mutex);
+
+	return page != NULL ? page : g_malloc(REWIND_PAGE_SIZE);
+}
+
+static void
+rewind_page_release(char *page)
+{
+	g_static_mutex_lock(&rewind_page_pool_mutex);
+
+	if (rewind_page_pool_size < REWIND_PAGE_POOL_MAX) {
+		rewind_page_pool = g_slist_prepend(rewind_page_pool, page);
+		++rewind_page_pool_size;
+		page = NULL;
+	}
+
+	g_static_mutex_unlock(&rewind_page_pool_mutex);
+
+	g_free(page);
+}
+
+void
+input_rewind_global_init(void)
+{
+	size_t configured =
+		config_get_positive(CONF_REWIND_BUFFER_SIZE, 64) * 1024;
+
+	/* round up to a whole number of pages */
+	rewind_buffer_pages = (configured + REWIND_PAGE_SIZE - 1)
+		/ REWIND_PAGE_SIZE;
+	rewind_buffer_capacity = rewind_buffer_pages * REWIND_PAGE_SIZE;
+}
+
+void
+input_rewind_global_finish(void)
+{
+	g_static_mutex_lock(&rewind_page_pool_mutex);
+
+	g_slist_foreach(rewind_page_pool, (GFunc)g_free, NULL);
+	g_slist_free(rewind_page_pool);
+	rewind_page_pool = NULL;
+	rewind_page_pool_size = 0;
+
+	g_static_mutex_unlock(&rewind_page_pool_mutex);
+}
+
 struct input_rewind {
 	struct input_stream base;
 
@@ -48,14 +141,16 @@ struct input_rewind {
 	size_t tail;
 
 	/**
-	 * The size of this buffer is the maximum number of bytes
+	 * The buffer pages, allocated on demand.  Each slot is either
+	 * NULL or a page of #REWIND_PAGE_SIZE bytes.  Together they
+	 * hold the first #rewind_buffer_capacity bytes of the stream,
 	 * which can be rewinded cheaply without passing the "seek"
-	 * call to CURL.
+	 * call to the underlying stream.
 	 *
 	 * The origin of this buffer is always the beginning of the
 	 * stream (offset 0).
 	 */
-	char buffer[64 * 1024];
+	char **pages;
 };
 
 /**
@@ -68,6 +163,73 @@ reading_from_buffer(const struct input_rewind *r)
 	return r->tail > 0 && r->base.offset < r->input->offset;
 }
 
+/**
+ * Release all buffer pages back to the pool.  Called when buffering
+ * is disabled because the stream has grown beyond the rewind window,
+ * and when the stream is closed.
+ */
+static void
+rewind_buffer_clear(struct input_rewind *r)
+{
+	for (unsigned i = 0; i < rewind_buffer_pages; ++i)
+		if (r->pages[i] != NULL) {
+			rewind_page_release(r->pages[i]);
+			r->pages[i] = NULL;
+		}
+}
+
+/**
+ * Append data read from the underlying stream to the buffer.  The
+ * caller has verified that it fits into the rewind window.
+ */
+static void
+rewind_buffer_append(struct input_rewind *r, const char *data, size_t size)
+{
+	assert(r->tail + size <= rewind_buffer_capacity);
+
+	while (size > 0) {
+		unsigned i = r->tail / REWIND_PAGE_SIZE;
+		size_t page_offset = r->tail % REWIND_PAGE_SIZE;
+		size_t nbytes = REWIND_PAGE_SIZE - page_offset;
+		if (nbytes > size)
+			nbytes = size;
+
+		if (r->pages[i] == NULL)
+			r->pages[i] = rewind_page_alloc();
+
+		memcpy(r->pages[i] + page_offset, data, nbytes);
+
+		r->tail += nbytes;
+		data += nbytes;
+		size -= nbytes;
+	}
+}
+
+/**
+ * Copy buffered data from the current read position.  The caller has
+ * clamped the size to the number of buffered bytes.
+ */
+static void
+rewind_buffer_copy(struct input_rewind *r, char *dest, size_t size)
+{
+	assert(r->head + size <= r->tail);
+
+	while (size > 0) {
+		unsigned i = r->head / REWIND_PAGE_SIZE;
+		size_t page_offset = r->head % REWIND_PAGE_SIZE;
+		size_t nbytes = REWIND_PAGE_SIZE - page_offset;
+		if (nbytes > size)
+			nbytes = size;
+
+		assert(r->pages[i] != NULL);
+		memcpy(dest, r->pages[i] + page_offset, nbytes);
+
+		r->head += nbytes;
+		dest += nbytes;
+		size -= nbytes;
+	}
+}
+
 /**
  * Copy public attributes from the underlying input stream to the
  * "rewind" input stream.  This function is called when a method of
@@ -103,6 +265,9 @@ input_rewind_close(struct input_stream *is)
 
 	input_stream_close(r->input);
 
+	rewind_buffer_clear(r);
+	g_free(r->pages);
+
 	input_stream_deinit(&r->base);
 	g_free(r);
 }
@@ -155,8 +320,7 @@ input_rewind_read(struct input_stream *is, void *ptr, size_t size,
 		if (size > r->tail - r->head)
 			size = r->tail - r->head;
 
-		memcpy(ptr, r->buffer + r->head, size);
-		r->head += size;
+		rewind_buffer_copy(r, ptr, size);
 		is->offset += size;
 
 		return size;
@@ -165,14 +329,14 @@ input_rewind_read(struct input_stream *is, void *ptr, size_t size,
 
 		size_t nbytes = input_stream_read(r->input, ptr, size, error_r);
 
-		if (r->input->offset > (goffset)sizeof(r->buffer))
+		if (r->input->offset > (goffset)rewind_buffer_capacity) {
 			/* disable buffering */
 			r->tail = 0;
-		else if (r->tail == (size_t)is->offset) {
+			rewind_buffer_clear(r);
+		} else if (r->tail == (size_t)is->offset) {
 			/* append to buffer */
 
-			memcpy(r->buffer + r->tail, ptr, nbytes);
-			r->tail += nbytes;
+			rewind_buffer_append(r, ptr, nbytes);
 
 			assert(r->tail == (size_t)r->input->offset);
 		}
@@ -218,6 +382,7 @@ input_rewind_seek(struct input_stream *is, goffset offset, int whence,
 		/* disable the buffer, because r->input has left the
 		   buffered range now */
 		r->tail = 0;
+		rewind_buffer_clear(r);
 
 		return success;
 	}
@@ -242,14 +407,19 @@ input_rewind_open(struct input_stream *is)
 	assert(is != NULL);
 	assert(is->offset == 0);
 
-	if (is->seekable)
-		/* seekable resources don't need this plugin */
+	if (is->seekable && !uri_has_scheme(is->uri))
+		/* local resources can seek cheaply and don't need
+		   this plugin; remote streams are wrapped even when
+		   they claim to be seekable, because their "seek"
+		   means a new network connection */
 		return is;
 
 	c = g_new(struct input_rewind, 1);
 	input_stream_init(&c->base, &rewind_input_plugin, is->uri,
 			  is->mutex, is->cond);
+	c->head = 0;
 	c->tail = 0;
+	c->pages = g_new0(char *, rewind_buffer_pages);
 	c->input = is;
 
 	return &c->base;
@@ -31,6 +31,19 @@
 
 struct input_stream;
 
+/**
+ * Reads the rewind buffer configuration.  Must be called before the
+ * first input_rewind_open() call.
+ */
+void
+input_rewind_global_init(void);
+
+/**
+ * Frees the page pool.
+ */
+void
+input_rewind_global_finish(void);
+
 struct input_stream *
 input_rewind_open(struct input_stream *is);
 
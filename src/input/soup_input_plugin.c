@@ -95,11 +95,24 @@ input_soup_init(const struct config_param *param, GError **error_r)
 		}
 	}
 
+	/* the session keeps idle connections alive; sizing it
+	   generously turns it into a connection pool which avoids the
+	   TCP handshake when consecutive tracks come from the same
+	   host */
+	unsigned max_connections =
+		config_get_block_unsigned(param, "max_connections", 16);
+
 	soup_session =
 		soup_session_async_new_with_options(SOUP_SESSION_PROXY_URI,
 						    soup_proxy,
 						    SOUP_SESSION_ASYNC_CONTEXT,
 						    io_thread_context(),
+						    SOUP_SESSION_MAX_CONNS,
+						    (int)max_connections,
+						    SOUP_SESSION_MAX_CONNS_PER_HOST,
+						    4,
+						    SOUP_SESSION_IDLE_TIMEOUT,
+						    60,
 						    NULL);
 
 	return true;
@@ -21,6 +21,7 @@
 #include "input_init.h"
 #include "input_plugin.h"
 #include "input_registry.h"
+#include "input/rewind_input_plugin.h"
 #include "conf.h"
 #include "glib_compat.h"
 
@@ -66,6 +67,8 @@ input_stream_global_init(GError **error_r)
 {
 	GError *error = NULL;
 
+	input_rewind_global_init();
+
 	for (unsigned i = 0; input_plugins[i] != NULL; ++i) {
 		const struct input_plugin *plugin = input_plugins[i];
 
@@ -103,4 +106,6 @@ void input_stream_global_finish(void)
 		if (input_plugins_enabled[i] &&
 		    input_plugins[i]->finish != NULL)
 			input_plugins[i]->finish();
+
+	input_rewind_global_finish();
 }
@@ -81,6 +81,29 @@ struct input_plugin {
 
 	size_t (*read)(struct input_stream *is, void *ptr, size_t size,
 		       GError **error_r);
+
+	/**
+	 * Returns a pointer to data at the current offset, without
+	 * copying it.  The returned window remains valid until the
+	 * next read/seek/consume call or until the stream is closed.
+	 * Call consume() to advance the offset.  Optional method for
+	 * plugins whose data is already memory-mapped or buffered.
+	 *
+	 * @param length_r location to store the number of available
+	 * bytes
+	 * @return a pointer to the data, or NULL if no data is
+	 * available (e.g. end of stream)
+	 */
+	const void *(*peek)(struct input_stream *is, size_t *length_r);
+
+	/**
+	 * Advances the stream offset over data returned by peek().
+	 * Must be implemented if peek() is implemented.  The "nbytes"
+	 * parameter must not be larger than the length returned by
+	 * the last peek() call.
+	 */
+	void (*consume)(struct input_stream *is, size_t nbytes);
+
 	bool (*eof)(struct input_stream *is);
 	bool (*seek)(struct input_stream *is, goffset offset, int whence,
 		     GError **error_r);
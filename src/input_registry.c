@@ -21,6 +21,10 @@
 #include "input_registry.h"
 #include "input/file_input_plugin.h"
 
+#ifdef HAVE_SYS_MMAN_H
+#include "input/mmap_input_plugin.h"
+#endif
+
 #ifdef ENABLE_ARCHIVE
 #include "input/archive_input_plugin.h"
 #endif
@@ -52,6 +56,11 @@
 #include <glib.h>
 
 const struct input_plugin *const input_plugins[] = {
+#ifdef HAVE_SYS_MMAN_H
+	/* must come before the "file" plugin, so it can take over
+	   local files when it is enabled */
+	&input_plugin_mmap,
+#endif
 	&input_plugin_file,
 #ifdef ENABLE_ARCHIVE
 	&input_plugin_archive,
@@ -219,6 +219,65 @@ input_stream_lock_read(struct input_stream *is, void *ptr, size_t size,
 	return nbytes;
 }
 
+const void *
+input_stream_peek(struct input_stream *is, size_t *length_r)
+{
+	assert(is != NULL);
+	assert(is->plugin != NULL);
+	assert(length_r != NULL);
+
+	if (is->plugin->peek == NULL)
+		return NULL;
+
+	return is->plugin->peek(is, length_r);
+}
+
+const void *
+input_stream_lock_peek(struct input_stream *is, size_t *length_r)
+{
+	assert(is != NULL);
+	assert(is->plugin != NULL);
+
+	if (is->plugin->peek == NULL)
+		return NULL;
+
+	if (is->mutex == NULL)
+		/* no locking */
+		return input_stream_peek(is, length_r);
+
+	g_mutex_lock(is->mutex);
+	const void *data = input_stream_peek(is, length_r);
+	g_mutex_unlock(is->mutex);
+	return data;
+}
+
+void
+input_stream_consume(struct input_stream *is, size_t nbytes)
+{
+	assert(is != NULL);
+	assert(is->plugin != NULL);
+	assert(is->plugin->consume != NULL);
+
+	is->plugin->consume(is, nbytes);
+}
+
+void
+input_stream_lock_consume(struct input_stream *is, size_t nbytes)
+{
+	assert(is != NULL);
+	assert(is->plugin != NULL);
+
+	if (is->mutex == NULL) {
+		/* no locking */
+		input_stream_consume(is, nbytes);
+		return;
+	}
+
+	g_mutex_lock(is->mutex);
+	input_stream_consume(is, nbytes);
+	g_mutex_unlock(is->mutex);
+}
+
 void input_stream_close(struct input_stream *is)
 {
 	is->plugin->close(is);
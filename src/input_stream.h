@@ -268,4 +268,48 @@ size_t
 input_stream_lock_read(struct input_stream *is, void *ptr, size_t size,
 		       GError **error_r);
 
+/**
+ * Returns a pointer to data at the current offset, without copying
+ * it.  The returned window remains valid until the next
+ * read/seek/consume call or until the stream is closed; call
+ * input_stream_consume() to advance the offset.
+ *
+ * The caller must lock the mutex.
+ *
+ * @param is the input_stream object
+ * @param length_r location to store the number of available bytes
+ * @return a pointer to the data, or NULL if no data is available or
+ * the plugin does not support peeking
+ */
+gcc_nonnull(1, 2)
+const void *
+input_stream_peek(struct input_stream *is, size_t *length_r);
+
+/**
+ * Wrapper for input_stream_peek() which locks and unlocks the mutex;
+ * the caller must not be holding it already.
+ */
+gcc_nonnull(1, 2)
+const void *
+input_stream_lock_peek(struct input_stream *is, size_t *length_r);
+
+/**
+ * Advances the stream offset over data returned by
+ * input_stream_peek().  The "nbytes" parameter must not be larger
+ * than the length returned by the last input_stream_peek() call.
+ *
+ * The caller must lock the mutex.
+ */
+gcc_nonnull(1)
+void
+input_stream_consume(struct input_stream *is, size_t nbytes);
+
+/**
+ * Wrapper for input_stream_consume() which locks and unlocks the
+ * mutex; the caller must not be holding it already.
+ */
+gcc_nonnull(1)
+void
+input_stream_lock_consume(struct input_stream *is, size_t nbytes);
+
 #endif
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "listall_cache.h"
+#include "client_internal.h"
+#include "database.h"
+
+#include <string.h>
+
+struct listall_builder {
+	/** completed pages, each with its "size" field set */
+	GPtrArray *pages;
+
+	/** the page currently being filled, or NULL */
+	struct client_buffer *current;
+
+	/** the number of bytes used in #current */
+	size_t current_used;
+};
+
+/**
+ * The cached response; "pages" is NULL while the cache is empty.
+ * Only touched from the main thread, like the other db_print caches.
+ */
+static struct {
+	GPtrArray *pages;
+
+	/** the database version the pages were serialized from */
+	unsigned version;
+} listall_cache;
+
+static void
+listall_pages_free(GPtrArray *pages)
+{
+	for (unsigned i = 0; i < pages->len; ++i)
+		client_buffer_unref(g_ptr_array_index(pages, i));
+	g_ptr_array_free(pages, true);
+}
+
+static void
+listall_cache_drop(void)
+{
+	if (listall_cache.pages == NULL)
+		return;
+
+	listall_pages_free(listall_cache.pages);
+	listall_cache.pages = NULL;
+}
+
+static void
+listall_cache_stream(struct client *client, GPtrArray *pages)
+{
+	for (unsigned i = 0; i < pages->len; ++i) {
+		struct client_buffer *page = g_ptr_array_index(pages, i);
+
+		if (client->compress != NULL)
+			/* the compressed stream cannot share pages;
+			   feed the bytes through the compressor */
+			client_write_raw(client, page->data, page->size);
+		else
+			client_write_page(client, page);
+	}
+}
+
+bool
+listall_cache_print(struct client *client)
+{
+	if (listall_cache.pages == NULL)
+		return false;
+
+	if (listall_cache.version != db_get_version()) {
+		listall_cache_drop();
+		return false;
+	}
+
+	listall_cache_stream(client, listall_cache.pages);
+	return true;
+}
+
+struct listall_builder *
+listall_cache_begin(void)
+{
+	struct listall_builder *builder = g_new(struct listall_builder, 1);
+	builder->pages = g_ptr_array_new();
+	builder->current = NULL;
+	builder->current_used = 0;
+	return builder;
+}
+
+void
+listall_cache_write(struct listall_builder *builder,
+		    const char *data, size_t length)
+{
+	while (length > 0) {
+		if (builder->current == NULL) {
+			builder->current =
+				client_buffer_new(CLIENT_SEND_BUF_SIZE);
+			builder->current_used = 0;
+		}
+
+		size_t copylen = CLIENT_SEND_BUF_SIZE - builder->current_used;
+		if (copylen > length)
+			copylen = length;
+
+		memcpy(builder->current->data + builder->current_used,
+		       data, copylen);
+		builder->current_used += copylen;
+		data += copylen;
+		length -= copylen;
+
+		if (builder->current_used == CLIENT_SEND_BUF_SIZE) {
+			builder->current->size = CLIENT_SEND_BUF_SIZE;
+			g_ptr_array_add(builder->pages, builder->current);
+			builder->current = NULL;
+		}
+	}
+}
+
+void
+listall_cache_commit_print(struct listall_builder *builder,
+			   struct client *client)
+{
+	if (builder->current != NULL) {
+		builder->current->size = builder->current_used;
+		g_ptr_array_add(builder->pages, builder->current);
+		builder->current = NULL;
+	}
+
+	listall_cache_drop();
+	listall_cache.pages = builder->pages;
+	listall_cache.version = db_get_version();
+	g_free(builder);
+
+	listall_cache_stream(client, listall_cache.pages);
+}
+
+void
+listall_cache_abort(struct listall_builder *builder)
+{
+	if (builder->current != NULL)
+		client_buffer_unref(builder->current);
+
+	listall_pages_free(builder->pages);
+	g_free(builder);
+}
+
+void
+listall_cache_deinit(void)
+{
+	listall_cache_drop();
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A cache of the complete "listall" response, pre-serialized into
+ * refcounted output pages: the output is identical between database
+ * changes, yet was regenerated by a full tree walk on every call.
+ * The cache is keyed on the database version, rebuilt lazily by the
+ * first "listall" after a change, and streamed to clients by queuing
+ * page references instead of copying the text.
+ */
+
+#ifndef MPD_LISTALL_CACHE_H
+#define MPD_LISTALL_CACHE_H
+
+#include "check.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct client;
+struct listall_builder;
+
+/**
+ * Streams the cached response to the client.
+ *
+ * @return false if the cache is missing or stale; the caller should
+ * rebuild it with listall_cache_begin()
+ */
+bool
+listall_cache_print(struct client *client);
+
+/**
+ * Starts rebuilding the cache; feed the serialized response with
+ * listall_cache_write().
+ */
+struct listall_builder *
+listall_cache_begin(void);
+
+/**
+ * Appends raw response bytes to the builder.
+ */
+void
+listall_cache_write(struct listall_builder *builder,
+		    const char *data, size_t length);
+
+/**
+ * Installs the completed pages as the new cache and streams them to
+ * the client.  Frees the builder.
+ */
+void
+listall_cache_commit_print(struct listall_builder *builder,
+			   struct client *client);
+
+/**
+ * Discards an unfinished rebuild, e.g. after a database walk error.
+ */
+void
+listall_cache_abort(struct listall_builder *builder);
+
+/**
+ * Releases the cached pages on shutdown.
+ */
+void
+listall_cache_deinit(void);
+
+#endif
@@ -99,6 +99,8 @@ listen_global_init(GError **error_r)
 	GError *error = NULL;
 
 	listen_socket = server_socket_new(listen_callback, NULL);
+	server_socket_set_backlog(listen_socket,
+				  config_get_positive(CONF_LISTEN_BACKLOG, 5));
 
 	if (listen_systemd_activation(&error))
 		return true;
@@ -21,6 +21,7 @@
 #include "locate.h"
 #include "path.h"
 #include "tag.h"
+#include "tag_pool.h"
 #include "song.h"
 
 #include <glib.h>
@@ -115,6 +116,8 @@ locate_item_list_casefold(const struct locate_item_list *list)
 		new_list->items[i].needle =
 			g_utf8_casefold(list->items[i].needle, -1);
 		new_list->items[i].tag = list->items[i].tag;
+		new_list->items[i].trigrams =
+			tag_pool_trigrams(new_list->items[i].needle);
 	}
 
 	return new_list;
@@ -128,9 +131,10 @@ locate_item_free(struct locate_item *item)
 }
 
 static bool
-locate_tag_search(const struct song *song, enum tag_type type, const char *str)
+locate_tag_search(const struct song *song, const struct locate_item *item)
 {
-	char *duplicate;
+	enum tag_type type = item->tag;
+	const char *str = item->needle;
 	bool ret = false;
 	bool visited_types[TAG_NUM_OF_ITEM_TYPES];
 
@@ -154,16 +158,21 @@ locate_tag_search(const struct song *song, enum tag_type type, const char *str)
 	memset(visited_types, 0, sizeof(visited_types));
 
 	for (unsigned i = 0; i < song->tag->num_items && !ret; i++) {
-		visited_types[song->tag->items[i]->type] = true;
-		if (type != LOCATE_TAG_ANY_TYPE &&
-		    song->tag->items[i]->type != type) {
+		const struct tag_item *ti = song->tag->items[i];
+
+		visited_types[ti->type] = true;
+		if (type != LOCATE_TAG_ANY_TYPE && ti->type != type)
+			continue;
+
+		/* cheap rejection first: a value which does not
+		   contain all trigrams of the needle cannot contain
+		   the needle */
+		if ((tag_item_trigrams(ti) & item->trigrams) !=
+		    item->trigrams)
 			continue;
-		}
 
-		duplicate = g_utf8_casefold(song->tag->items[i]->value, -1);
-		if (*str && strstr(duplicate, str))
+		if (*str && strstr(tag_item_casefold(ti), str))
 			ret = true;
-		g_free(duplicate);
 	}
 
 	/** If the search critieron was not visited during the sweep
@@ -183,8 +192,7 @@ locate_song_search(const struct song *song,
 		   const struct locate_item_list *criteria)
 {
 	for (unsigned i = 0; i < criteria->length; i++)
-		if (!locate_tag_search(song, criteria->items[i].tag,
-				       criteria->items[i].needle))
+		if (!locate_tag_search(song, &criteria->items[i]))
 			return false;
 
 	return true;
@@ -35,6 +35,14 @@ struct locate_item {
 	int8_t tag;
 	/* what we are looking for */
 	char *needle;
+
+	/**
+	 * The trigram bitmask of the needle; only computed (by
+	 * locate_item_list_casefold()) for casefolded lists, where
+	 * it is used to reject candidate tag values without a
+	 * substring search.
+	 */
+	uint64_t trigrams;
 };
 
 /**
@@ -57,6 +57,61 @@ static bool stdout_mode = true;
 static int out_fd;
 static const char *out_filename;
 
+/**
+ * A formatted log line waiting in the ring for the logger thread.
+ */
+struct async_log_entry {
+	GLogLevelFlags level;
+
+	char *message;
+};
+
+/**
+ * State of one ring slot: claiming a sequence number reserves the
+ * slot, publishing makes it visible to the logger thread.
+ */
+enum {
+	LOG_SLOT_EMPTY = 0,
+	LOG_SLOT_BUSY,
+	LOG_SLOT_READY,
+};
+
+/**
+ * The asynchronous log ring.  Callers format their message, claim a
+ * slot with one atomic increment and publish it without ever
+ * blocking; if the logger thread has fallen a whole ring behind, the
+ * message is dropped and counted instead.  Disabled (slots==NULL)
+ * unless "log_buffer_size" is configured.
+ */
+static struct {
+	struct async_log_entry **slots;
+	gint *states;
+
+	/** number of slots; a power of two */
+	unsigned size;
+
+	/** the next sequence number to be claimed by a writer */
+	volatile gint write_pos;
+
+	/** the next sequence number to be drained; logger thread only */
+	unsigned read_pos;
+
+	/** number of messages dropped because the ring was full */
+	volatile gint dropped;
+
+	volatile gint quit;
+
+	GThread *thread;
+
+	/** used only by the logger thread to sleep; writers signal
+	    the condition without taking the mutex */
+	GMutex *mutex;
+	GCond *cond;
+} log_ring;
+
+/** the configured ring size; 0 means synchronous logging */
+static unsigned log_buffer_size;
+
 static void redirect_logs(int fd)
 {
 	assert(fd >= 0);
@@ -89,6 +144,19 @@ chomp_length(const char *p)
 	return (int)length;
 }
 
+static inline bool
+log_async_enabled(void)
+{
+	return log_ring.slots != NULL;
+}
+
+/**
+ * Queues a formatted log line for the logger thread without blocking.
+ * Takes ownership of the line.
+ */
+static void
+log_async_push(GLogLevelFlags level, char *line);
+
 static void
 file_log_func(const gchar *log_domain,
 	      GLogLevelFlags log_level,
@@ -111,10 +179,18 @@ file_log_func(const gchar *log_domain,
 	if (log_domain == NULL)
 		log_domain = "";
 
-	fprintf(stderr, "%s%s%s%.*s\n",
-		stdout_mode ? "" : log_date(),
-		log_domain, *log_domain == 0 ? "" : ": ",
-		chomp_length(message), message);
+	if (log_async_enabled())
+		log_async_push(log_level,
+			       g_strdup_printf("%s%s%s%.*s\n",
+					       stdout_mode ? "" : log_date(),
+					       log_domain,
+					       *log_domain == 0 ? "" : ": ",
+					       chomp_length(message), message));
+	else
+		fprintf(stderr, "%s%s%s%.*s\n",
+			stdout_mode ? "" : log_date(),
+			log_domain, *log_domain == 0 ? "" : ": ",
+			chomp_length(message), message);
 
 	g_free(converted);
 }
@@ -195,6 +271,15 @@ syslog_log_func(const gchar *log_domain,
 	if (log_domain == NULL)
 		log_domain = "";
 
+	if (log_async_enabled()) {
+		log_async_push(log_level,
+			       g_strdup_printf("%s%s%.*s",
+					       log_domain,
+					       *log_domain == 0 ? "" : ": ",
+					       chomp_length(message), message));
+		return;
+	}
+
 	syslog(glib_to_syslog_level(log_level), "%s%s%.*s",
 	       log_domain, *log_domain == 0 ? "" : ": ",
 	       chomp_length(message), message);
@@ -211,6 +296,182 @@ log_init_syslog(void)
 
 #endif
 
+static void
+log_async_push(GLogLevelFlags level, char *line)
+{
+	unsigned seq, idx;
+
+	seq = (unsigned)g_atomic_int_exchange_and_add(&log_ring.write_pos, 1);
+	idx = seq & (log_ring.size - 1);
+
+	if (!g_atomic_int_compare_and_exchange(&log_ring.states[idx],
+					       LOG_SLOT_EMPTY,
+					       LOG_SLOT_BUSY)) {
+		/* the logger thread is a whole ring behind: drop the
+		   message instead of waiting */
+		g_atomic_int_add(&log_ring.dropped, 1);
+		g_free(line);
+		return;
+	}
+
+	struct async_log_entry *entry = g_slice_new(struct async_log_entry);
+	entry->level = level;
+	entry->message = line;
+
+	log_ring.slots[idx] = entry;
+	g_atomic_int_set(&log_ring.states[idx], LOG_SLOT_READY);
+
+	/* wake up the logger thread; no mutex here, writers must not
+	   block */
+	g_cond_signal(log_ring.cond);
+}
+
+/**
+ * Writes one drained entry to the configured destination.  Runs in
+ * the logger thread.
+ */
+static void
+log_async_write(const struct async_log_entry *entry)
+{
+#ifdef HAVE_SYSLOG
+	if (out_filename == NULL && !stdout_mode) {
+		syslog(glib_to_syslog_level(entry->level),
+		       "%s", entry->message);
+		return;
+	}
+#endif
+
+	G_GNUC_UNUSED ssize_t nbytes =
+		write(STDERR_FILENO, entry->message, strlen(entry->message));
+}
+
+static gpointer
+log_async_task(G_GNUC_UNUSED gpointer arg)
+{
+	g_mutex_lock(log_ring.mutex);
+
+	while (true) {
+		const unsigned idx = log_ring.read_pos & (log_ring.size - 1);
+		const gint state = g_atomic_int_get(&log_ring.states[idx]);
+
+		if (state == LOG_SLOT_READY) {
+			struct async_log_entry *entry = log_ring.slots[idx];
+			log_ring.slots[idx] = NULL;
+			g_atomic_int_set(&log_ring.states[idx],
+					 LOG_SLOT_EMPTY);
+			++log_ring.read_pos;
+
+			g_mutex_unlock(log_ring.mutex);
+			log_async_write(entry);
+			g_free(entry->message);
+			g_slice_free(struct async_log_entry, entry);
+			g_mutex_lock(log_ring.mutex);
+			continue;
+		}
+
+		if (state == LOG_SLOT_EMPTY &&
+		    (gint)((unsigned)g_atomic_int_get(&log_ring.write_pos) -
+			   log_ring.read_pos) > 0) {
+			/* this sequence number was claimed, but its
+			   message was dropped (or is still being
+			   published and will be picked up one lap
+			   late): move on */
+			++log_ring.read_pos;
+			continue;
+		}
+
+		const gint dropped = g_atomic_int_get(&log_ring.dropped);
+		if (dropped > 0) {
+			g_atomic_int_add(&log_ring.dropped, -dropped);
+
+			g_mutex_unlock(log_ring.mutex);
+			char *line = g_strdup_printf("%slog: %d messages "
+						     "lost, ring was full\n",
+						     log_date(), dropped);
+			struct async_log_entry entry = {
+				.level = G_LOG_LEVEL_WARNING,
+				.message = line,
+			};
+			log_async_write(&entry);
+			g_free(line);
+			g_mutex_lock(log_ring.mutex);
+			continue;
+		}
+
+		if (state == LOG_SLOT_EMPTY &&
+		    g_atomic_int_get(&log_ring.quit))
+			break;
+
+		/* the ring looks empty (or a writer is just about to
+		   publish): sleep, with a timeout in case a signal
+		   from a writer is missed */
+		GTimeVal tv;
+		g_get_current_time(&tv);
+		g_time_val_add(&tv, 100000);
+		g_cond_timed_wait(log_ring.cond, log_ring.mutex, &tv);
+	}
+
+	g_mutex_unlock(log_ring.mutex);
+	return NULL;
+}
+
+static void
+log_async_start(void)
+{
+	assert(log_ring.slots == NULL);
+
+	if (log_buffer_size == 0)
+		return;
+
+	unsigned size = 1;
+	while (size < log_buffer_size)
+		size <<= 1;
+
+	log_ring.states = g_new0(gint, size);
+	log_ring.size = size;
+	log_ring.write_pos = 0;
+	log_ring.read_pos = 0;
+	log_ring.dropped = 0;
+	log_ring.quit = 0;
+	log_ring.mutex = g_mutex_new();
+	log_ring.cond = g_cond_new();
+
+	/* this assignment enables the asynchronous path in the log
+	   handlers */
+	log_ring.slots = g_new0(struct async_log_entry *, size);
+
+	log_ring.thread = g_thread_create(log_async_task, NULL, true, NULL);
+	if (log_ring.thread == NULL)
+		MPD_ERROR("Failed to spawn logger thread");
+}
+
+static void
+log_async_stop(void)
+{
+	if (log_ring.thread == NULL)
+		return;
+
+	g_atomic_int_set(&log_ring.quit, 1);
+	g_cond_signal(log_ring.cond);
+	g_thread_join(log_ring.thread);
+	log_ring.thread = NULL;
+
+	/* back to synchronous logging */
+	struct async_log_entry **slots = log_ring.slots;
+	log_ring.slots = NULL;
+
+	for (unsigned i = 0; i < log_ring.size; ++i)
+		if (slots[i] != NULL) {
+			g_free(slots[i]->message);
+			g_slice_free(struct async_log_entry, slots[i]);
+		}
+
+	g_free(slots);
+	g_free(log_ring.states);
+	g_cond_free(log_ring.cond);
+	g_mutex_free(log_ring.mutex);
+}
+
 static inline GLogLevelFlags
 parse_log_level(const char *value, unsigned line)
 {
@@ -248,6 +509,8 @@ log_init(bool verbose, bool use_stdout, GError **error_r)
 	else if ((param = config_get_param(CONF_LOG_LEVEL)) != NULL)
 		log_threshold = parse_log_level(param->value, param->line);
 
+	log_buffer_size = config_get_unsigned(CONF_LOG_BUFFER_SIZE, 0);
+
 	if (use_stdout) {
 		log_init_stdout();
 		return true;
@@ -303,6 +566,10 @@ void setup_log_output(bool use_stdout)
 
 		stdout_mode = false;
 		log_charset = NULL;
+
+		/* this is called after daemonization, so the logger
+		   thread survives the fork() */
+		log_async_start();
 	}
 }
 
@@ -333,6 +600,8 @@ void close_log_files(void)
 	if (stdout_mode)
 		return;
 
+	log_async_stop();
+
 #ifdef HAVE_SYSLOG
 	if (out_filename == NULL)
 		closelog();
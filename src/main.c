@@ -28,6 +28,9 @@
 #include "playlist.h"
 #include "stored_playlist.h"
 #include "database.h"
+#include "db_changes.h"
+#include "song_print.h"
+#include "listall_cache.h"
 #include "update.h"
 #include "player_thread.h"
 #include "listen.h"
@@ -44,6 +47,7 @@
 #include "volume.h"
 #include "log.h"
 #include "permission.h"
+#include "pcm_buffer.h"
 #include "pcm_resample.h"
 #include "replay_gain_config.h"
 #include "decoder_list.h"
@@ -147,6 +151,11 @@ glue_mapper_init(GError **error_r)
 	return true;
 }
 
+/**
+ * Is an asynchronous database load (db_load_async()) still running?
+ */
+static bool db_load_deferred;
+
 /**
  * Returns the database.  If this function returns false, this has not
  * succeeded, and the caller should create the database after the
@@ -155,25 +164,56 @@ glue_mapper_init(GError **error_r)
 static bool
 glue_db_init_and_load(void)
 {
+	const struct config_param *param = config_get_param(CONF_DATABASE);
 	const struct config_param *path = config_get_param(CONF_DB_FILE);
 
 	GError *error = NULL;
 	bool ret;
 
+	if (param != NULL && path != NULL)
+		g_message("Found both " CONF_DATABASE " and " CONF_DB_FILE
+			  " settings - ignoring the latter");
+
 	if (!mapper_has_music_directory()) {
-		if (path != NULL)
+		if (param != NULL)
+			g_message("Found " CONF_DATABASE " setting without "
+				  CONF_MUSIC_DIR " - disabling database");
+		else if (path != NULL)
 			g_message("Found " CONF_DB_FILE " setting without "
 				  CONF_MUSIC_DIR " - disabling database");
 		db_init(NULL, NULL);
 		return true;
 	}
 
-	if (path == NULL)
-		MPD_ERROR(CONF_DB_FILE " setting missing");
+	struct config_param *allocated = NULL;
+	if (param == NULL) {
+		if (path == NULL)
+			MPD_ERROR(CONF_DB_FILE " setting missing");
+
+		/* legacy setup: turn the "db_file" setting into an
+		   equivalent "database" block */
+		allocated = config_new_param("database", path->line);
+		config_add_block_param(allocated, "path",
+				       path->value, path->line);
+		param = allocated;
+	}
 
-	if (!db_init(path, &error))
+	ret = db_init(param, &error);
+	if (allocated != NULL)
+		config_param_free(allocated);
+	if (!ret)
 		MPD_ERROR("%s", error->message);
 
+	if (config_get_bool(CONF_DB_LOAD_ASYNC, false)) {
+		/* load the database in a worker thread, so the daemon
+		   can accept client connections right away;
+		   #PIPE_EVENT_DATABASE fires when the load has
+		   finished */
+		db_load_deferred = true;
+		db_load_async();
+		return true;
+	}
+
 	ret = db_load(&error);
 	if (!ret)
 		MPD_ERROR("%s", error->message);
@@ -219,6 +259,38 @@ glue_state_file_init(GError **error_r)
 	return true;
 }
 
+/**
+ * Invoked in the main thread when the asynchronous database load has
+ * finished; performs the initialization steps which had to wait for
+ * the database.
+ */
+static void
+database_loaded_event(void)
+{
+	GError *error = NULL;
+
+	assert(db_load_deferred);
+	db_load_deferred = false;
+
+	if (!db_load_async_finish(&error))
+		MPD_ERROR("%s", error->message);
+
+	idle_add(IDLE_DATABASE);
+
+	if (!glue_state_file_init(&error)) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+	}
+
+	if (!db_exists()) {
+		/* the database failed to load: recreate the
+		   database */
+		unsigned job = update_enqueue(NULL, true);
+		if (job == 0)
+			g_warning("directory update failed");
+	}
+}
+
 /**
  * Windows-only initialization of the Winsock2 library.
  */
@@ -268,7 +340,18 @@ initialize_decoder_and_player(void)
 
 	buffer_size *= 1024;
 
-	buffered_chunks = buffer_size / CHUNK_SIZE;
+	param = config_get_param(CONF_AUDIO_CHUNK_SIZE);
+	if (param != NULL) {
+		long tmp = strtol(param->value, &test, 10);
+		if (*test != '\0' || tmp < 1024 || tmp > 32768)
+			MPD_ERROR("chunk size \"%s\" is not between 1024 and "
+				  "32768, line %i\n",
+				  param->value, param->line);
+
+		music_chunk_size = tmp;
+	}
+
+	buffered_chunks = buffer_size / music_chunk_size;
 
 	if (buffered_chunks >= 1 << 15)
 		MPD_ERROR("buffer size \"%li\" is too big\n", (long)buffer_size);
@@ -288,6 +371,9 @@ initialize_decoder_and_player(void)
 	if (buffered_before_play > buffered_chunks)
 		buffered_before_play = buffered_chunks;
 
+	pcm_buffer_set_high_water(config_get_unsigned(CONF_PCM_BUFFER_HIGH_WATER,
+						      256) * 1024);
+
 	global_player_control = pc_new(buffered_chunks, buffered_before_play);
 }
 
@@ -386,6 +472,7 @@ int mpd_main(int argc, char *argv[])
 	event_pipe_init();
 	event_pipe_register(PIPE_EVENT_IDLE, idle_event_emitted);
 	event_pipe_register(PIPE_EVENT_SHUTDOWN, shutdown_event_emitted);
+	event_pipe_register(PIPE_EVENT_DATABASE, database_loaded_event);
 
 	path_global_init();
 
@@ -411,6 +498,8 @@ int mpd_main(int argc, char *argv[])
 	decoder_plugin_init_all();
 	update_global_init();
 
+	db_changes_init();
+	song_print_cache_init();
 	create_db = !glue_db_init_and_load();
 
 	glue_sticker_init();
@@ -455,7 +544,7 @@ int mpd_main(int argc, char *argv[])
 			MPD_ERROR("directory update failed");
 	}
 
-	if (!glue_state_file_init(&error)) {
+	if (!db_load_deferred && !glue_state_file_init(&error)) {
 		g_warning("%s", error->message);
 		g_error_free(error);
 		return EXIT_FAILURE;
@@ -463,7 +552,7 @@ int mpd_main(int argc, char *argv[])
 
 	success = config_get_bool(CONF_AUTO_UPDATE, false);
 #ifdef ENABLE_INOTIFY
-	if (success && mapper_has_music_directory())
+	if (success && mapper_has_music_directory() && db_is_simple())
 		mpd_inotify_init(config_get_unsigned(CONF_AUTO_UPDATE_DEPTH,
 						     G_MAXUINT));
 #else
@@ -502,12 +591,17 @@ int mpd_main(int argc, char *argv[])
 	client_manager_deinit();
 	listen_global_finish();
 	playlist_global_finish();
+	spl_global_finish();
 
 	start = clock();
 	db_finish();
 	g_debug("db_finish took %f seconds",
 		((float)(clock()-start))/CLOCKS_PER_SEC);
 
+	db_changes_finish();
+	song_print_cache_finish();
+	listall_cache_deinit();
+
 #ifdef ENABLE_SQLITE
 	sticker_global_finish();
 #endif
@@ -41,6 +41,11 @@ static size_t music_dir_length;
 
 static char *playlist_dir;
 
+/**
+ * Protects the lazily filled #directory path_fs_cache attributes.
+ */
+static GStaticMutex mapper_cache_mutex = G_STATIC_MUTEX_INIT;
+
 /**
  * Duplicate a string, chop all trailing slashes.
  */
@@ -154,21 +159,60 @@ map_uri_fs(const char *uri)
 	return path_fs;
 }
 
-char *
-map_directory_fs(const struct directory *directory)
+/**
+ * Returns the filesystem path of the directory, filling the
+ * directory's cache on the first call, so the charset conversion of
+ * the (shared) prefix happens only once per directory.  The returned
+ * string is owned by the directory object and must not be freed; it
+ * lives as long as the directory.
+ */
+static const char *
+map_directory_prefix(const struct directory *directory)
 {
+	/* the cache fill is the only mutation of the otherwise
+	   immutable directory path */
+	struct directory *d = (struct directory *)directory;
+	const char *path_fs;
+
 	assert(music_dir != NULL);
 
 	if (directory_is_root(directory))
-		return g_strdup(music_dir);
+		return music_dir;
+
+	g_static_mutex_lock(&mapper_cache_mutex);
+
+	if (d->path_fs_cache == NULL) {
+		char *uri_fs = utf8_to_fs_charset(directory_get_path(d));
+		if (uri_fs != NULL) {
+			d->path_fs_cache = g_build_filename(music_dir,
+							    uri_fs, NULL);
+			g_free(uri_fs);
+		}
+	}
+
+	path_fs = d->path_fs_cache;
+	g_static_mutex_unlock(&mapper_cache_mutex);
 
-	return map_uri_fs(directory_get_path(directory));
+	return path_fs;
+}
+
+char *
+map_directory_fs(const struct directory *directory)
+{
+	const char *path_fs;
+
+	assert(music_dir != NULL);
+
+	path_fs = map_directory_prefix(directory);
+	return path_fs != NULL ? g_strdup(path_fs) : NULL;
 }
 
 char *
 map_directory_child_fs(const struct directory *directory, const char *name)
 {
-	char *name_fs, *parent_fs, *path;
+	const char *parent_fs, *name_fs;
+	char *name_fs_allocated = NULL, *path;
+	size_t parent_length, name_length;
 
 	assert(music_dir != NULL);
 
@@ -177,19 +221,31 @@ map_directory_child_fs(const struct directory *directory, const char *name)
 	    strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
 		return NULL;
 
-	parent_fs = map_directory_fs(directory);
+	parent_fs = map_directory_prefix(directory);
 	if (parent_fs == NULL)
 		return NULL;
 
-	name_fs = utf8_to_fs_charset(name);
-	if (name_fs == NULL) {
-		g_free(parent_fs);
-		return NULL;
+	if (fs_charset_is_utf8())
+		/* no conversion needed - the base name can be used
+		   as-is, without a temporary allocation */
+		name_fs = name;
+	else {
+		name_fs = name_fs_allocated = utf8_to_fs_charset(name);
+		if (name_fs == NULL)
+			return NULL;
 	}
 
-	path = g_build_filename(parent_fs, name_fs, NULL);
-	g_free(parent_fs);
-	g_free(name_fs);
+	/* assemble the result in one exact-size allocation, instead
+	   of taking the g_build_filename() detour */
+	parent_length = strlen(parent_fs);
+	name_length = strlen(name_fs);
+
+	path = g_malloc(parent_length + 1 + name_length + 1);
+	memcpy(path, parent_fs, parent_length);
+	path[parent_length] = G_DIR_SEPARATOR;
+	memcpy(path + parent_length + 1, name_fs, name_length + 1);
+
+	g_free(name_fs_allocated);
 
 	return path;
 }
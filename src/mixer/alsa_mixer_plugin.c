@@ -206,10 +206,16 @@ static GSourceFuncs alsa_mixer_source_funcs = {
  */
 
 static int
-alsa_mixer_elem_callback(G_GNUC_UNUSED snd_mixer_elem_t *elem, unsigned mask)
+alsa_mixer_elem_callback(snd_mixer_elem_t *elem, unsigned mask)
 {
-	if (mask & SND_CTL_EVENT_MASK_VALUE)
+	if (mask & SND_CTL_EVENT_MASK_VALUE) {
+		struct alsa_mixer *am =
+			snd_mixer_elem_get_callback_private(elem);
+		if (am != NULL)
+			mixer_invalidate_volume(&am->base);
+
 		event_pipe_emit(PIPE_EVENT_MIXER);
+	}
 
 	return 0;
 }
@@ -302,6 +308,7 @@ alsa_mixer_setup(struct alsa_mixer *am, GError **error_r)
 						  &am->volume_min,
 						  &am->volume_max);
 
+	snd_mixer_elem_set_callback_private(am->elem, am);
 	snd_mixer_elem_set_callback(am->elem, alsa_mixer_elem_callback);
 
 	am->source = (struct alsa_mixer_source *)
@@ -428,4 +435,5 @@ const struct mixer_plugin alsa_mixer_plugin = {
 	.get_volume = alsa_mixer_get_volume,
 	.set_volume = alsa_mixer_set_volume,
 	.global = true,
+	.cached_volume = true,
 };
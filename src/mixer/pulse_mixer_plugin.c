@@ -66,6 +66,7 @@ pulse_mixer_offline(struct pulse_mixer *pm)
 
 	pm->online = false;
 
+	mixer_invalidate_volume(&pm->base);
 	event_pipe_emit(PIPE_EVENT_MIXER);
 }
 
@@ -90,6 +91,7 @@ pulse_mixer_volume_cb(G_GNUC_UNUSED pa_context *context, const pa_sink_input_inf
 	pm->online = true;
 	pm->volume = i->volume;
 
+	mixer_invalidate_volume(&pm->base);
 	event_pipe_emit(PIPE_EVENT_MIXER);
 }
 
@@ -233,4 +235,5 @@ const struct mixer_plugin pulse_mixer_plugin = {
 	.finish = pulse_mixer_finish,
 	.get_volume = pulse_mixer_get_volume,
 	.set_volume = pulse_mixer_set_volume,
+	.cached_volume = true,
 };
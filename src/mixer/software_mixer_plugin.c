@@ -96,6 +96,7 @@ const struct mixer_plugin software_mixer_plugin = {
 	.get_volume = software_mixer_get_volume,
 	.set_volume = software_mixer_set_volume,
 	.global = true,
+	.cached_volume = true,
 };
 
 struct filter *
@@ -30,4 +30,11 @@ mixer_init(struct mixer *mixer, const struct mixer_plugin *plugin)
 	mixer->mutex = g_mutex_new();
 	mixer->open = false;
 	mixer->failed = false;
+	mixer->volume_cache = -1;
+}
+
+void
+mixer_invalidate_volume(struct mixer *mixer)
+{
+	g_atomic_int_set(&mixer->volume_cache, -1);
 }
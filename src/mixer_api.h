@@ -44,9 +44,26 @@ struct mixer {
 	 * automatically?
 	 */
 	bool failed;
+
+	/**
+	 * The cached volume (0..100), or -1 if the cache is empty.
+	 * Only used if the plugin has set the cached_volume flag.
+	 * Accessed with atomic operations, because invalidation may
+	 * happen from a library callback while the mutex is held.
+	 */
+	gint volume_cache;
 };
 
 void
 mixer_init(struct mixer *mixer, const struct mixer_plugin *plugin);
 
+/**
+ * Invalidates the cached volume after the device volume has changed.
+ * Plugins with the cached_volume flag call this from their change
+ * notification path.  Lock-free; may be called from any thread and
+ * from within libraries' callbacks.
+ */
+void
+mixer_invalidate_volume(struct mixer *mixer);
+
 #endif
@@ -94,6 +94,7 @@ mixer_close_internal(struct mixer *mixer)
 		mixer->plugin->close(mixer);
 
 	mixer->open = false;
+	g_atomic_int_set(&mixer->volume_cache, -1);
 }
 
 void
@@ -147,10 +148,18 @@ mixer_get_volume(struct mixer *mixer, GError **error_r)
 	if (mixer->open) {
 		GError *error = NULL;
 
-		volume = mixer->plugin->get_volume(mixer, &error);
-		if (volume < 0 && error != NULL) {
-			g_propagate_error(error_r, error);
-			mixer_failed(mixer);
+		volume = mixer->plugin->cached_volume
+			? g_atomic_int_get(&mixer->volume_cache)
+			: -1;
+		if (volume < 0) {
+			volume = mixer->plugin->get_volume(mixer, &error);
+			if (volume < 0 && error != NULL) {
+				g_propagate_error(error_r, error);
+				mixer_failed(mixer);
+			} else if (volume >= 0 &&
+				   mixer->plugin->cached_volume)
+				g_atomic_int_set(&mixer->volume_cache,
+						 volume);
 		}
 	} else
 		volume = -1;
@@ -176,6 +185,8 @@ mixer_set_volume(struct mixer *mixer, unsigned volume, GError **error_r)
 
 	if (mixer->open) {
 		success = mixer->plugin->set_volume(mixer, volume, error_r);
+		if (success && mixer->plugin->cached_volume)
+			g_atomic_int_set(&mixer->volume_cache, (gint)volume);
 	} else
 		success = false;
 
@@ -94,6 +94,15 @@ struct mixer_plugin {
 	 * disabled as long as its audio output is closed.
 	 */
 	bool global;
+
+	/**
+	 * If true, then the plugin reports volume changes (e.g. by
+	 * calling mixer_invalidate_volume() from an event callback),
+	 * and mixer_get_volume() may return the cached value instead
+	 * of querying the device.  If false, every read goes to the
+	 * device.
+	 */
+	bool cached_volume;
 };
 
 #endif
@@ -49,7 +49,7 @@ fill_int(unsigned char *buffer, uint32_t value)
  * Store time in the NTP format in the buffer
  */
 static void
-fill_time_buffer_with_time(unsigned char *buffer, struct timeval *tout)
+fill_time_buffer_with_time(unsigned char *buffer, const struct timeval *tout)
 {
 	unsigned long secs_to_baseline = 964697997;
 	double fraction;
@@ -78,7 +78,9 @@ fill_time_buffer(unsigned char *buffer)
 static void
 ntp_server_datagram(int fd, const void *data, size_t num_bytes,
 		    const struct sockaddr *source_address,
-		    size_t source_address_length, G_GNUC_UNUSED void *ctx)
+		    size_t source_address_length,
+		    const struct timeval *received,
+		    G_GNUC_UNUSED void *ctx)
 {
 	unsigned char buf[32];
 	int iter;
@@ -87,7 +89,12 @@ ntp_server_datagram(int fd, const void *data, size_t num_bytes,
 		num_bytes = sizeof(buf);
 	memcpy(buf, data, num_bytes);
 
-	fill_time_buffer(buf + 16);
+	/* the "receive" timestamp: prefer the kernel's, which is not
+	   skewed by our scheduling latency */
+	if (received != NULL)
+		fill_time_buffer_with_time(buf + 16, received);
+	else
+		fill_time_buffer(buf + 16);
 	// set to response
 	buf[1] = 0xd3;
 	// copy request
@@ -35,6 +35,11 @@ static const char default_device[] = "default";
 
 enum {
 	MPD_ALSA_BUFFER_TIME_US = 500000,
+
+	/** after this many consecutive underrun-free device
+	    configurations, an adaptively grown buffer is shrunk
+	    again */
+	MPD_ALSA_ADAPTIVE_SHRINK_RUNS = 8,
 };
 
 #define MPD_ALSA_RETRY_NR 5
@@ -58,6 +63,26 @@ struct alsa_data {
 	/** libasound's period_time setting (in microseconds) */
 	unsigned int period_time;
 
+	/** adapt the buffer size to observed underruns? */
+	bool adaptive_buffer;
+
+	/** upper bound for the adapted buffer_time (in
+	    microseconds) */
+	unsigned int buffer_time_max;
+
+	/** the buffer_time currently in use; starts at the
+	    configured value and moves within
+	    [buffer_time, buffer_time_max] */
+	unsigned int buffer_time_cur;
+
+	/** the value of base.underruns when the device was last
+	    (re)configured */
+	unsigned last_underruns;
+
+	/** the number of consecutive (re)configurations without a new
+	    underrun */
+	unsigned clean_opens;
+
 	/** the mode flags passed to snd_pcm_open */
 	int mode;
 
@@ -79,6 +104,11 @@ struct alsa_data {
 	 */
 	snd_pcm_uframes_t period_frames;
 
+	/**
+	 * The size of the ALSA ring buffer, in number of frames.
+	 */
+	snd_pcm_uframes_t buffer_frames;
+
 	/**
 	 * The number of frames written in the current period.
 	 */
@@ -129,6 +159,15 @@ alsa_configure(struct alsa_data *ad, const struct config_param *param)
 			MPD_ALSA_BUFFER_TIME_US);
 	ad->period_time = config_get_block_unsigned(param, "period_time", 0);
 
+	ad->adaptive_buffer = config_get_block_bool(param, "adaptive_buffer",
+						    false);
+	ad->buffer_time_max =
+		config_get_block_unsigned(param, "buffer_time_max",
+					  ad->buffer_time * 4);
+	ad->buffer_time_cur = ad->buffer_time;
+	ad->last_underruns = 0;
+	ad->clean_opens = 0;
+
 #ifdef SND_PCM_NO_AUTO_RESAMPLE
 	if (!config_get_block_bool(param, "auto_resample", true))
 		ad->mode |= SND_PCM_NO_AUTO_RESAMPLE;
@@ -342,6 +381,47 @@ alsa_output_setup_format(snd_pcm_t *pcm, snd_pcm_hw_params_t *hwparams,
 	return -EINVAL;
 }
 
+/**
+ * Picks the buffer_time for the next device configuration: after new
+ * underruns, the buffer grows by half; after enough consecutive clean
+ * runs, it shrinks again carefully.  The value stays within
+ * [buffer_time, buffer_time_max].
+ */
+static void
+alsa_adapt_buffer_time(struct alsa_data *ad)
+{
+	if (!ad->adaptive_buffer || ad->buffer_time == 0)
+		return;
+
+	const unsigned misses = ad->base.underruns - ad->last_underruns;
+	ad->last_underruns = ad->base.underruns;
+
+	if (misses > 0) {
+		ad->clean_opens = 0;
+
+		unsigned grown = ad->buffer_time_cur + ad->buffer_time_cur / 2;
+		if (grown > ad->buffer_time_max)
+			grown = ad->buffer_time_max;
+
+		if (grown != ad->buffer_time_cur) {
+			g_debug("%u underruns on \"%s\": growing buffer_time to %u",
+				misses, alsa_device(ad), grown);
+			ad->buffer_time_cur = grown;
+		}
+	} else if (++ad->clean_opens >= MPD_ALSA_ADAPTIVE_SHRINK_RUNS &&
+		   ad->buffer_time_cur > ad->buffer_time) {
+		ad->clean_opens = 0;
+
+		unsigned shrunk = ad->buffer_time_cur - ad->buffer_time_cur / 4;
+		if (shrunk < ad->buffer_time)
+			shrunk = ad->buffer_time;
+
+		g_debug("no underruns on \"%s\": shrinking buffer_time to %u",
+			alsa_device(ad), shrunk);
+		ad->buffer_time_cur = shrunk;
+	}
+}
+
 /**
  * Set up the snd_pcm_t object which was opened by the caller.  Set up
  * the configured settings and the audio format.
@@ -363,6 +443,8 @@ alsa_setup(struct alsa_data *ad, struct audio_format *audio_format,
 	unsigned int buffer_time;
 
 	period_time_ro = period_time = ad->period_time;
+
+	alsa_adapt_buffer_time(ad);
 configure_hw:
 	/* configure HW params */
 	snd_pcm_hw_params_alloca(&hwparams);
@@ -443,8 +525,8 @@ configure_hw:
 		(unsigned)period_size_min, (unsigned)period_size_max,
 		period_time_min, period_time_max);
 
-	if (ad->buffer_time > 0) {
-		buffer_time = ad->buffer_time;
+	if (ad->buffer_time_cur > 0) {
+		buffer_time = ad->buffer_time_cur;
 		cmd = "snd_pcm_hw_params_set_buffer_time_near";
 		err = snd_pcm_hw_params_set_buffer_time_near(ad->pcm, hwparams,
 							     &buffer_time, NULL);
@@ -532,6 +614,7 @@ configure_hw:
 		alsa_period_size = 1;
 
 	ad->period_frames = alsa_period_size;
+	ad->buffer_frames = alsa_buffer_size;
 	ad->period_position = 0;
 
 	return true;
@@ -570,11 +653,40 @@ alsa_open(struct audio_output *ao, struct audio_format *audio_format, GError **e
 	return true;
 }
 
+static bool
+alsa_reopen(struct audio_output *ao, struct audio_format *audio_format,
+	    GError **error)
+{
+	struct alsa_data *ad = (struct alsa_data *)ao;
+	int err;
+
+	/* the stream has been drained by the caller; releasing the
+	   hardware parameters takes the handle back to the OPEN
+	   state, from which it can be configured for the new format
+	   without closing the device */
+	err = snd_pcm_hw_free(ad->pcm);
+	if (err < 0) {
+		g_set_error(error, alsa_output_quark(), err,
+			    "Failed to release ALSA device \"%s\": %s",
+			    alsa_device(ad), snd_strerror(-err));
+		return false;
+	}
+
+	if (!alsa_setup(ad, audio_format, error))
+		return false;
+
+	ad->frame_size = audio_format_frame_size(audio_format);
+	ad->period_position = 0;
+
+	return true;
+}
+
 static int
 alsa_recover(struct alsa_data *ad, int err)
 {
 	if (err == -EPIPE) {
 		g_debug("Underrun on ALSA device \"%s\"\n", alsa_device(ad));
+		ao_underrun(&ad->base);
 	} else if (err == -ESTRPIPE) {
 		g_debug("ALSA device \"%s\" was suspended\n", alsa_device(ad));
 	}
@@ -659,6 +771,81 @@ alsa_close(struct audio_output *ao)
 	snd_pcm_close(ad->pcm);
 }
 
+/**
+ * Copies the chunk directly into the memory mapped DMA buffer,
+ * bypassing libasound's writei() emulation.  When the chunk spans a
+ * period boundary, the transfer is cut at the last boundary, so
+ * commits advance the hardware pointer in whole periods where
+ * possible.
+ *
+ * @return the number of frames written, or a negative errno value
+ * which can be passed to alsa_recover()
+ */
+static snd_pcm_sframes_t
+alsa_write_mmap(struct alsa_data *ad, const void *chunk,
+		snd_pcm_uframes_t frames)
+{
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset, contiguous, end;
+	snd_pcm_sframes_t avail, committed;
+	int err;
+
+	avail = snd_pcm_avail_update(ad->pcm);
+	if (avail < 0)
+		return avail;
+
+	if (avail == 0) {
+		/* the buffer is full: wait until at least one period
+		   has been played (see avail_min) */
+		err = snd_pcm_wait(ad->pcm, -1);
+		if (err < 0)
+			return err;
+
+		avail = snd_pcm_avail_update(ad->pcm);
+		if (avail <= 0)
+			return avail < 0 ? avail : -EPIPE;
+	}
+
+	if (frames > (snd_pcm_uframes_t)avail)
+		frames = avail;
+
+	end = ad->period_position + frames;
+	if (end > ad->period_frames)
+		/* cut at the last period boundary */
+		frames = end - end % ad->period_frames -
+			ad->period_position;
+
+	contiguous = frames;
+	err = snd_pcm_mmap_begin(ad->pcm, &areas, &offset, &contiguous);
+	if (err < 0)
+		return err;
+
+	/* with interleaved access, all channels share one area, and
+	   "first"/"step" are byte-aligned */
+	memcpy((char *)areas[0].addr +
+	       (areas[0].first + offset * areas[0].step) / 8,
+	       chunk, contiguous * ad->frame_size);
+
+	committed = snd_pcm_mmap_commit(ad->pcm, offset, contiguous);
+	if (committed < 0)
+		return committed;
+
+	/* the start_threshold does not apply to
+	   snd_pcm_mmap_commit(): start the device manually once
+	   enough data has been buffered */
+	if (snd_pcm_state(ad->pcm) == SND_PCM_STATE_PREPARED) {
+		avail = snd_pcm_avail_update(ad->pcm);
+		if (avail >= 0 &&
+		    (snd_pcm_uframes_t)avail <= ad->period_frames) {
+			err = snd_pcm_start(ad->pcm);
+			if (err < 0)
+				return err;
+		}
+	}
+
+	return committed;
+}
+
 static size_t
 alsa_play(struct audio_output *ao, const void *chunk, size_t size,
 	  GError **error)
@@ -668,7 +855,9 @@ alsa_play(struct audio_output *ao, const void *chunk, size_t size,
 	size /= ad->frame_size;
 
 	while (true) {
-		snd_pcm_sframes_t ret = ad->writei(ad->pcm, chunk, size);
+		snd_pcm_sframes_t ret = ad->use_mmap
+			? alsa_write_mmap(ad, chunk, size)
+			: ad->writei(ad->pcm, chunk, size);
 		if (ret > 0) {
 			ad->period_position = (ad->period_position + ret)
 				% ad->period_frames;
@@ -690,6 +879,7 @@ const struct audio_output_plugin alsa_output_plugin = {
 	.init = alsa_init,
 	.finish = alsa_finish,
 	.open = alsa_open,
+	.reopen = alsa_reopen,
 	.play = alsa_play,
 	.drain = alsa_drain,
 	.cancel = alsa_cancel,
@@ -287,10 +287,26 @@ fifo_output_play(struct audio_output *ao, const void *chunk, size_t size,
 
 		if (bytes < 0) {
 			switch (errno) {
-			case EAGAIN:
-				/* The pipe is full, so empty it */
-				fifo_output_cancel(&fd->base);
+			case EAGAIN: {
+				/* The FIFO is full; drop only as much
+				   of the oldest data as needed to
+				   make room, using our own read end,
+				   instead of flushing everything the
+				   reader has not yet consumed */
+				char buf[4096];
+				ssize_t nbytes = read(fd->input, buf,
+						      sizeof(buf));
+				if (nbytes < 0 && errno != EINTR &&
+				    errno != EAGAIN) {
+					g_warning("Flush of FIFO \"%s\" failed: %s",
+						  fd->path,
+						  g_strerror(errno));
+					return 0;
+				}
+
 				continue;
+			}
+
 			case EINTR:
 				continue;
 			}
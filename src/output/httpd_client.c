@@ -30,6 +30,21 @@
 #include <assert.h>
 #include <string.h>
 
+#ifndef G_OS_WIN32
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+
+/** the number of pages gathered into one writev() call */
+#define HTTPD_CLIENT_MAX_IOV 32
+#endif
+
+/** the maximum number of bytes in a client's page queue; when it
+    overflows, the oldest pages are dropped */
+#define HTTPD_CLIENT_MAX_QUEUE (256 * 1024)
+
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "httpd_output"
 
@@ -44,6 +59,14 @@ struct httpd_client {
 	 */
 	GIOChannel *channel;
 
+	/**
+	 * Is TCP_CORK currently enabled on the socket?  It is set
+	 * while a burst of several pages is written, so the kernel
+	 * does not transmit partial frames in the middle of the
+	 * burst.
+	 */
+	bool tcp_cork;
+
 	/**
 	 * The GLib main loop source id for reading from the socket,
 	 * and to detect errors.
@@ -78,10 +101,24 @@ struct httpd_client {
 	} state;
 
 	/**
-	 * A queue of #page objects to be sent to the client.
+	 * A queue of #httpd_client_page objects to be sent to the
+	 * client.
 	 */
 	GQueue *pages;
 
+	/**
+	 * The total size of all pages in the #pages queue, in bytes.
+	 */
+	size_t queue_size;
+
+	/**
+	 * True while the client is lagging behind and incoming pages
+	 * are being discarded.  It is cleared by the next page which
+	 * starts at an encoder flush boundary, where the stream can
+	 * be resumed cleanly.
+	 */
+	bool dropping;
+
 	/**
 	 * The #page which is currently being sent to the client.
 	 */
@@ -138,12 +175,43 @@ struct httpd_client {
 	guint metadata_fill;
 };
 
+/**
+ * An entry in the client's page queue.
+ */
+struct httpd_client_page {
+	struct page *page;
+
+	/**
+	 * Does this page start at an encoder flush boundary?  Only
+	 * such pages are suitable for resuming a stream which has
+	 * been interrupted by dropped pages.
+	 */
+	bool sync;
+};
+
+static void
+httpd_client_free_page(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+	struct httpd_client_page *node = data;
+
+	page_unref(node->page);
+	g_free(node);
+}
+
+/**
+ * Remove and discard the first page of the queue.
+ */
 static void
-httpd_client_unref_page(gpointer data, G_GNUC_UNUSED gpointer user_data)
+httpd_client_drop_page(struct httpd_client *client)
 {
-	struct page *page = data;
+	struct httpd_client_page *node = g_queue_pop_head(client->pages);
+
+	assert(node != NULL);
+	assert(client->queue_size >= node->page->size);
 
-	page_unref(page);
+	client->queue_size -= node->page->size;
+	page_unref(node->page);
+	g_free(node);
 }
 
 void
@@ -158,7 +226,7 @@ httpd_client_free(struct httpd_client *client)
 		if (client->current_page != NULL)
 			page_unref(client->current_page);
 
-		g_queue_foreach(client->pages, httpd_client_unref_page, NULL);
+		g_queue_foreach(client->pages, httpd_client_free_page, NULL);
 		g_queue_free(client->pages);
 	} else
 		fifo_buffer_free(client->input);
@@ -195,9 +263,9 @@ httpd_client_begin_response(struct httpd_client *client)
 	client->state = RESPONSE;
 	client->write_source_id = 0;
 	client->pages = g_queue_new();
+	client->queue_size = 0;
+	client->dropping = false;
 	client->current_page = NULL;
-
-	httpd_output_send_header(client->httpd, client);
 }
 
 /**
@@ -350,7 +418,6 @@ httpd_client_send_response(struct httpd_client *client)
 	case G_IO_STATUS_EOF:
 		/* client has disconnected */
 
-		httpd_client_close(client);
 		return false;
 
 	case G_IO_STATUS_ERROR:
@@ -359,12 +426,10 @@ httpd_client_send_response(struct httpd_client *client)
 		g_warning("failed to write to client: %s", error->message);
 		g_error_free(error);
 
-		httpd_client_close(client);
 		return false;
 	}
 
 	/* unreachable */
-	httpd_client_close(client);
 	return false;
 }
 
@@ -397,7 +462,14 @@ httpd_client_received(struct httpd_client *client)
 
 			fifo_buffer_free(client->input);
 
-			return httpd_client_send_response(client);
+			if (!httpd_client_send_response(client))
+				return false;
+
+			/* send the stream header only after the HTTP
+			   response, so the stream data cannot overtake
+			   it */
+			httpd_output_send_header(client->httpd, client);
+			return true;
 		}
 	}
 
@@ -490,6 +562,7 @@ httpd_client_new(struct httpd_output *httpd, int fd, bool metadata_supported)
 	client->httpd = httpd;
 
 	client->channel = g_io_channel_new_socket(fd);
+	client->tcp_cork = false;
 
 	/* GLib is responsible for closing the file descriptor */
 	g_io_channel_set_close_on_unref(client->channel, true);
@@ -517,35 +590,15 @@ httpd_client_new(struct httpd_output *httpd, int fd, bool metadata_supported)
 	return client;
 }
 
-static void
-httpd_client_add_page_size(gpointer data, gpointer user_data)
-{
-	struct page *page = data;
-	size_t *size = user_data;
-
-	*size += page->size;
-}
-
-size_t
-httpd_client_queue_size(const struct httpd_client *client)
-{
-	size_t size = 0;
-
-	if (client->state != RESPONSE)
-		return 0;
-
-	g_queue_foreach(client->pages, httpd_client_add_page_size, &size);
-	return size;
-}
-
 void
 httpd_client_cancel(struct httpd_client *client)
 {
 	if (client->state != RESPONSE)
 		return;
 
-	g_queue_foreach(client->pages, httpd_client_unref_page, NULL);
+	g_queue_foreach(client->pages, httpd_client_free_page, NULL);
 	g_queue_clear(client->pages);
+	client->queue_size = 0;
 
 	if (client->write_source_id != 0 && client->current_page == NULL) {
 		g_source_remove(client->write_source_id);
@@ -568,185 +621,444 @@ write_page_to_channel(GIOChannel *channel,
 					bytes_written_r, error);
 }
 
-static GIOStatus
-write_n_bytes_to_channel(GIOChannel *channel, const struct page *page,
-			 size_t position, gint n,
-			 gsize *bytes_written_r, GError **error)
+/**
+ * Enable or disable TCP_CORK on the socket.  No-op on systems which
+ * do not have it.
+ */
+static void
+httpd_client_set_cork(struct httpd_client *client, bool cork)
 {
-	GIOStatus status;
-
-	assert(channel != NULL);
-	assert(page != NULL);
-	assert(position < page->size);
+#if !defined(G_OS_WIN32) && defined(TCP_CORK)
+	const int value = cork;
 
-	if (n == -1) {
-		status =  write_page_to_channel (channel, page, position,
-						 bytes_written_r, error);
-	} else {
-		status = g_io_channel_write_chars(channel,
-						  (const gchar*)page->data + position,
-						  n, bytes_written_r, error);
-	}
+	if (cork == client->tcp_cork)
+		return;
 
-	return status;
+	client->tcp_cork = cork;
+	setsockopt(g_io_channel_unix_get_fd(client->channel),
+		   IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+#else
+	(void)client;
+	(void)cork;
+#endif
 }
 
-static gint
-bytes_left_till_metadata (struct httpd_client *client)
-{
-	assert(client != NULL);
+/**
+ * The result of one write attempt; see httpd_client_try_write().
+ */
+enum httpd_client_write_result {
+	/** the socket did not accept everything; wait for G_IO_OUT
+	    and try again */
+	HTTPD_CLIENT_MORE,
 
-	if (client->metadata_requested &&
-	    client->current_page->size - client->current_position
-	    > client->metaint - client->metadata_fill)
-		return client->metaint - client->metadata_fill;
+	/** everything has been written */
+	HTTPD_CLIENT_DRAINED,
 
-	return -1;
-}
+	/** a fatal error has occurred; the caller shall close the
+	    client */
+	HTTPD_CLIENT_CLOSED,
+};
 
-static gboolean
-httpd_client_out_event(GIOChannel *source,
-		       G_GNUC_UNUSED GIOCondition condition, gpointer data)
+/**
+ * Write one icy metadata block.  Returns #HTTPD_CLIENT_DRAINED when
+ * the block has been sent completely.
+ */
+static enum httpd_client_write_result
+httpd_client_write_metadata_block(struct httpd_client *client)
 {
-	struct httpd_client *client = data;
-	struct httpd_output *httpd = client->httpd;
 	GError *error = NULL;
 	GIOStatus status;
 	gsize bytes_written;
-	gint bytes_to_write;
 
-	g_mutex_lock(httpd->mutex);
+	if (!client->metadata_sent)
+		status = write_page_to_channel(client->channel,
+					       client->metadata,
+					       client->metadata_current_position,
+					       &bytes_written, &error);
+	else {
+		/* no new metadata pending: the empty metadata block
+		   is a single zero byte */
+		static const gchar empty_meta = 0;
+
+		status = g_io_channel_write_chars(client->channel,
+						  &empty_meta,
+						  sizeof(empty_meta),
+						  &bytes_written, &error);
+	}
 
-	assert(condition == G_IO_OUT);
-	assert(client->state == RESPONSE);
+	switch (status) {
+	case G_IO_STATUS_NORMAL:
+		break;
 
-	if (client->write_source_id == 0) {
-		/* another thread has removed the event source while
-		   this thread was waiting for httpd->mutex */
-		g_mutex_unlock(httpd->mutex);
-		return false;
-	}
+	case G_IO_STATUS_AGAIN:
+		return HTTPD_CLIENT_MORE;
+
+	case G_IO_STATUS_EOF:
+		/* client has disconnected */
+		return HTTPD_CLIENT_CLOSED;
 
-	if (client->current_page == NULL) {
-		client->current_page = g_queue_pop_head(client->pages);
-		client->current_position = 0;
+	case G_IO_STATUS_ERROR:
+		/* I/O error */
+		g_warning("failed to write to client: %s", error->message);
+		g_error_free(error);
+		return HTTPD_CLIENT_CLOSED;
 	}
 
-	bytes_to_write = bytes_left_till_metadata(client);
+	if (!client->metadata_sent) {
+		client->metadata_current_position += bytes_written;
+		if (client->metadata_current_position < client->metadata->size)
+			return HTTPD_CLIENT_MORE;
 
-	if (bytes_to_write == 0) {
-		gint metadata_to_write;
+		client->metadata_current_position = 0;
+		client->metadata_sent = true;
+	} else if (bytes_written == 0)
+		return HTTPD_CLIENT_MORE;
 
-		metadata_to_write = client->metadata_current_position;
+	client->metadata_fill = 0;
+	return HTTPD_CLIENT_DRAINED;
+}
 
-		if (!client->metadata_sent) {
-			status = write_page_to_channel(source,
-						       client->metadata,
-						       metadata_to_write,
-						       &bytes_written, &error);
+/**
+ * Remove the given number of bytes from the head of the page queue,
+ * popping and unreferencing all pages which have been sent
+ * completely.
+ */
+/**
+ * Move the head of the page queue into #current_page.  Returns false
+ * if the queue is empty.
+ */
+static bool
+httpd_client_next_page(struct httpd_client *client)
+{
+	struct httpd_client_page *node = g_queue_pop_head(client->pages);
 
-			client->metadata_current_position += bytes_written;
+	assert(client->current_page == NULL);
 
-			if (client->metadata->size
-			    - client->metadata_current_position == 0) {
-				client->metadata_fill = 0;
-				client->metadata_current_position = 0;
-				client->metadata_sent = true;
-			}
-		} else {
-			struct page *empty_meta;
-			guchar empty_data = 0;
+	if (node == NULL)
+		return false;
 
-			empty_meta = page_new_copy(&empty_data, 1);
+	assert(client->queue_size >= node->page->size);
 
-			status = write_page_to_channel(source,
-						       empty_meta,
-						       metadata_to_write,
-						       &bytes_written, &error);
+	client->current_page = node->page;
+	client->current_position = 0;
+	client->queue_size -= node->page->size;
+	g_free(node);
+	return true;
+}
 
-			client->metadata_current_position += bytes_written;
+static void
+httpd_client_consume(struct httpd_client *client, size_t nbytes)
+{
+	while (client->current_page != NULL) {
+		size_t remaining = client->current_page->size -
+			client->current_position;
 
-			if (empty_meta->size
-			    - client->metadata_current_position == 0) {
-				client->metadata_fill = 0;
-				client->metadata_current_position = 0;
-			}
+		if (nbytes < remaining) {
+			client->current_position += nbytes;
+			break;
 		}
 
-		bytes_written = 0;
-	} else {
-		status = write_n_bytes_to_channel(source, client->current_page,
-						  client->current_position, bytes_to_write,
-						  &bytes_written, &error);
+		nbytes -= remaining;
+		page_unref(client->current_page);
+		client->current_page = NULL;
+
+		if (!httpd_client_next_page(client))
+			break;
+	}
+}
+
+#ifndef G_OS_WIN32
+
+/**
+ * Write stream data from the page queue, at most #limit bytes (the
+ * distance to the next icy metadata block).  Returns
+ * #HTTPD_CLIENT_DRAINED when everything that was attempted has been
+ * written; the caller loops until the queue is empty.
+ */
+static enum httpd_client_write_result
+httpd_client_write_data(struct httpd_client *client, size_t limit)
+{
+	/* gather the current page and as many queued pages as
+	   possible into one writev() call, instead of sending each
+	   page with a separate system call */
+
+	struct iovec iov[HTTPD_CLIENT_MAX_IOV];
+	unsigned n;
+	size_t total;
+
+	assert(client->current_page != NULL);
+	assert(client->current_position < client->current_page->size);
+	assert(limit > 0);
+
+	iov[0].iov_base = client->current_page->data + client->current_position;
+	iov[0].iov_len = client->current_page->size - client->current_position;
+	if (iov[0].iov_len > limit)
+		iov[0].iov_len = limit;
+	total = iov[0].iov_len;
+	n = 1;
+
+	for (GList *i = g_queue_peek_head_link(client->pages);
+	     i != NULL && n < HTTPD_CLIENT_MAX_IOV && total < limit;
+	     i = g_list_next(i)) {
+		const struct httpd_client_page *node = i->data;
+		struct page *page = node->page;
+
+		iov[n].iov_base = page->data;
+		iov[n].iov_len = page->size;
+		if (iov[n].iov_len > limit - total)
+			iov[n].iov_len = limit - total;
+		total += iov[n].iov_len;
+		++n;
+	}
+
+	if (n > 1)
+		/* tell the kernel to hold back partial frames until
+		   the whole burst has been submitted */
+		httpd_client_set_cork(client, true);
+
+	ssize_t nbytes = writev(g_io_channel_unix_get_fd(client->channel),
+				iov, n);
+	if (nbytes < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return HTTPD_CLIENT_MORE;
+
+		g_warning("failed to write to client: %s", g_strerror(errno));
+		return HTTPD_CLIENT_CLOSED;
 	}
 
+	if (client->metadata_requested)
+		client->metadata_fill += nbytes;
+
+	httpd_client_consume(client, nbytes);
+
+	return (size_t)nbytes < total
+		? HTTPD_CLIENT_MORE
+		: HTTPD_CLIENT_DRAINED;
+}
+
+#else /* G_OS_WIN32 */
+
+static enum httpd_client_write_result
+httpd_client_write_data(struct httpd_client *client, size_t limit)
+{
+	GError *error = NULL;
+	GIOStatus status;
+	gsize bytes_written;
+
+	assert(client->current_page != NULL);
+	assert(client->current_position < client->current_page->size);
+
+	size_t nbytes = client->current_page->size - client->current_position;
+	if (nbytes > limit)
+		nbytes = limit;
+
+	status = g_io_channel_write_chars(client->channel,
+					  (const gchar *)client->current_page->data +
+					  client->current_position,
+					  nbytes, &bytes_written, &error);
 	switch (status) {
 	case G_IO_STATUS_NORMAL:
-		client->current_position += bytes_written;
-		assert(client->current_position <= client->current_page->size);
+		break;
 
-		if (client->metadata_requested)
-			client->metadata_fill += bytes_written;
+	case G_IO_STATUS_AGAIN:
+		return HTTPD_CLIENT_MORE;
 
-		if (client->current_position >= client->current_page->size) {
-			page_unref(client->current_page);
-			client->current_page = NULL;
+	case G_IO_STATUS_EOF:
+		/* client has disconnected */
+		return HTTPD_CLIENT_CLOSED;
 
-			if (g_queue_is_empty(client->pages)) {
-				/* all pages are sent: remove the
-				   event source */
-				client->write_source_id = 0;
+	case G_IO_STATUS_ERROR:
+		/* I/O error */
+		g_warning("failed to write to client: %s", error->message);
+		g_error_free(error);
+		return HTTPD_CLIENT_CLOSED;
+	}
 
-				g_mutex_unlock(httpd->mutex);
-				return false;
+	if (client->metadata_requested)
+		client->metadata_fill += bytes_written;
+
+	httpd_client_consume(client, bytes_written);
+
+	return bytes_written < nbytes
+		? HTTPD_CLIENT_MORE
+		: HTTPD_CLIENT_DRAINED;
+}
+
+#endif /* G_OS_WIN32 */
+
+/**
+ * Send the queued pages to the client, as much as the socket accepts
+ * right now.  Caller must lock the mutex.
+ */
+static enum httpd_client_write_result
+httpd_client_try_write(struct httpd_client *client)
+{
+	enum httpd_client_write_result result;
+
+	assert(client->state == RESPONSE);
+
+	if (client->current_page == NULL &&
+	    !httpd_client_next_page(client))
+		return HTTPD_CLIENT_DRAINED;
+
+	do {
+		size_t limit = (size_t)-1;
+
+		if (client->metadata_requested) {
+			if (client->metadata_fill >= client->metaint) {
+				/* insert an icy metadata block after
+				   every #metaint stream bytes */
+				result = httpd_client_write_metadata_block(client);
+				if (result != HTTPD_CLIENT_DRAINED)
+					return result;
+
+				continue;
 			}
+
+			limit = client->metaint - client->metadata_fill;
 		}
 
-		g_mutex_unlock(httpd->mutex);
-		return true;
+		result = httpd_client_write_data(client, limit);
+		if (result != HTTPD_CLIENT_DRAINED)
+			return result;
+	} while (client->current_page != NULL);
 
-	case G_IO_STATUS_AGAIN:
-		g_mutex_unlock(httpd->mutex);
-		return true;
+	/* the queue is empty: flush the last partial frame */
+	httpd_client_set_cork(client, false);
 
-	case G_IO_STATUS_EOF:
-		/* client has disconnected */
+	return HTTPD_CLIENT_DRAINED;
+}
 
-		httpd_client_close(client);
+static gboolean
+httpd_client_out_event(G_GNUC_UNUSED GIOChannel *source,
+		       G_GNUC_UNUSED GIOCondition condition, gpointer data)
+{
+	struct httpd_client *client = data;
+	struct httpd_output *httpd = client->httpd;
+
+	g_mutex_lock(httpd->mutex);
+
+	assert(condition == G_IO_OUT);
+	assert(client->state == RESPONSE);
+
+	if (client->write_source_id == 0) {
+		/* another thread has removed the event source while
+		   this thread was waiting for httpd->mutex */
 		g_mutex_unlock(httpd->mutex);
 		return false;
+	}
 
-	case G_IO_STATUS_ERROR:
-		/* I/O error */
+	switch (httpd_client_try_write(client)) {
+	case HTTPD_CLIENT_MORE:
+		g_mutex_unlock(httpd->mutex);
+		return true;
 
-		g_warning("failed to write to client: %s", error->message);
-		g_error_free(error);
+	case HTTPD_CLIENT_DRAINED:
+		/* all pages are sent: remove the event source */
+		client->write_source_id = 0;
 
-		httpd_client_close(client);
 		g_mutex_unlock(httpd->mutex);
 		return false;
+
+	case HTTPD_CLIENT_CLOSED:
+		break;
 	}
 
-	/* unreachable */
 	httpd_client_close(client);
 	g_mutex_unlock(httpd->mutex);
 	return false;
 }
 
+/**
+ * The client's queue has overflowed: drop the oldest pages until the
+ * queue is half empty and the remainder begins at an encoder flush
+ * boundary.  If the queue contains no such boundary, the client stays
+ * in "dropping" mode, and incoming pages are discarded until one
+ * arrives.
+ */
+static void
+httpd_client_drop_pages(struct httpd_client *client)
+{
+	const struct httpd_client_page *node;
+
+	while ((node = g_queue_peek_head(client->pages)) != NULL &&
+	       (client->queue_size > HTTPD_CLIENT_MAX_QUEUE / 2 ||
+		!node->sync))
+		httpd_client_drop_page(client);
+
+	if (g_queue_is_empty(client->pages))
+		client->dropping = true;
+}
+
 void
-httpd_client_send(struct httpd_client *client, struct page *page)
+httpd_client_send(struct httpd_client *client, struct page *page,
+		  bool sync)
 {
+	struct httpd_client_page *node;
+
 	if (client->state != RESPONSE)
 		/* the client is still writing the HTTP request */
 		return;
 
+	if (!client->dropping &&
+	    client->queue_size > HTTPD_CLIENT_MAX_QUEUE) {
+		/* the client does not read fast enough: drop the
+		   oldest pages, instead of stalling the shared
+		   encoder or discarding the whole queue */
+		g_debug("client is too slow, dropping pages");
+		httpd_client_drop_pages(client);
+	}
+
+	if (client->dropping) {
+		if (!sync)
+			/* still lagging; wait for the next clean
+			   boundary */
+			return;
+
+		/* this page starts at an encoder flush boundary:
+		   resume the stream here */
+		client->dropping = false;
+	}
+
 	page_ref(page);
-	g_queue_push_tail(client->pages, page);
 
-	if (client->write_source_id == 0)
+	node = g_new(struct httpd_client_page, 1);
+	node->page = page;
+	node->sync = sync;
+
+	g_queue_push_tail(client->pages, node);
+	client->queue_size += page->size;
+
+	if (client->write_source_id != 0)
+		/* the socket is full; the pending G_IO_OUT event will
+		   pick up the new page */
+		return;
+
+	/* write it straight away; in the common case, this empties
+	   the queue, and no event source is needed at all */
+	switch (httpd_client_try_write(client)) {
+	case HTTPD_CLIENT_MORE:
 		client->write_source_id =
 			g_io_add_watch(client->channel, G_IO_OUT,
 				       httpd_client_out_event, client);
+		break;
+
+	case HTTPD_CLIENT_DRAINED:
+		break;
+
+	case HTTPD_CLIENT_CLOSED:
+		/* we must not delete the client object here, because
+		   our caller may still be using it; discard the queue
+		   and let the read event source close the client */
+		httpd_client_cancel(client);
+
+		if (client->current_page != NULL) {
+			page_unref(client->current_page);
+			client->current_page = NULL;
+		}
+
+		break;
+	}
 }
 
 void
@@ -44,12 +44,6 @@ httpd_client_new(struct httpd_output *httpd, int fd, bool metadata_supported);
 void
 httpd_client_free(struct httpd_client *client);
 
-/**
- * Returns the total size of this client's page queue.
- */
-size_t
-httpd_client_queue_size(const struct httpd_client *client);
-
 /**
  * Clears the page queue.
  */
@@ -57,10 +51,15 @@ void
 httpd_client_cancel(struct httpd_client *client);
 
 /**
- * Appends a page to the client's queue.
+ * Appends a page to the client's queue.  When the queue overflows,
+ * the oldest pages are dropped, and the client resynchronizes at the
+ * next "sync" page.
+ *
+ * @param sync true if the page starts at an encoder flush boundary
  */
 void
-httpd_client_send(struct httpd_client *client, struct page *page);
+httpd_client_send(struct httpd_client *client, struct page *page,
+		  bool sync);
 
 /**
  * Sends the passed metadata.
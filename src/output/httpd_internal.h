@@ -48,6 +48,20 @@ struct httpd_output {
 	 */
 	struct encoder *encoder;
 
+	/**
+	 * True if the configured encoder is the "wave" plugin, which
+	 * emits the PCM input unmodified after a one-time RIFF
+	 * header.
+	 */
+	bool encoder_is_wave;
+
+	/**
+	 * True while the stream is a plain PCM copy of the input:
+	 * play() then wraps each chunk in a page itself and never
+	 * touches the encoder (see httpd_output_encoder_open()).
+	 */
+	bool passthrough;
+
 	/**
 	 * Number of bytes which were fed into the encoder, without
 	 * ever receiving new output.  This is used to estimate
@@ -56,6 +70,14 @@ struct httpd_output {
 	 */
 	size_t unflushed_input;
 
+	/**
+	 * True if the last httpd_output_read_page() call has drained
+	 * the encoder's pending output completely.  The next page
+	 * then starts at a clean boundary (e.g. a new Ogg page or
+	 * MP3 frame), where lagging clients may resynchronize.
+	 */
+	bool encoder_drained;
+
 	/**
 	 * The MIME type produced by the #encoder.
 	 */
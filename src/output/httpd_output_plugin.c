@@ -24,6 +24,7 @@
 #include "output_api.h"
 #include "encoder_plugin.h"
 #include "encoder_list.h"
+#include "shared_encoder.h"
 #include "resolver.h"
 #include "page.h"
 #include "icy_server.h"
@@ -31,6 +32,7 @@
 #include "server_socket.h"
 
 #include <assert.h>
+#include <string.h>
 
 #include <sys/types.h>
 #include <unistd.h>
@@ -113,6 +115,8 @@ httpd_output_init(const struct config_param *param,
 		return NULL;
 	}
 
+	httpd->encoder_is_wave = strcmp(encoder_name, "wave") == 0;
+
 	httpd->clients_max = config_get_block_unsigned(param,"max_clients", 0);
 
 	/* set up bind_to_address */
@@ -138,7 +142,10 @@ httpd_output_init(const struct config_param *param,
 
 	/* initialize encoder */
 
-	httpd->encoder = encoder_init(encoder_plugin, param, error);
+	/* the codec runs in a separate thread, and outputs with
+	   identical quality settings share one codec instance; this
+	   output's thread only does network I/O */
+	httpd->encoder = shared_encoder_new(encoder_plugin, param, error);
 	if (httpd->encoder == NULL) {
 		ao_base_finish(&httpd->base);
 		g_free(httpd);
@@ -260,6 +267,22 @@ httpd_output_read_page(struct httpd_output *httpd)
 		httpd->unflushed_input = 0;
 	}
 
+	if (encoder_can_read_page(httpd->encoder)) {
+		/* get a page produced directly by the encoder,
+		   without copying through httpd->buffer */
+		struct page *page = encoder_read_page(httpd->encoder);
+		if (page != NULL) {
+			httpd->unflushed_input = 0;
+
+			/* each page is a complete unit of the encoded
+			   stream, and thus a resynchronization
+			   point */
+			httpd->encoder_drained = true;
+		}
+
+		return page;
+	}
+
 	do {
 		nbytes = encoder_read(httpd->encoder, httpd->buffer + size,
 				      sizeof(httpd->buffer) - size);
@@ -274,6 +297,11 @@ httpd_output_read_page(struct httpd_output *httpd)
 	if (size == 0)
 		return NULL;
 
+	/* if our buffer was filled completely, the page probably
+	   ends in the middle of an encoder frame, and the next page
+	   is no resynchronization point */
+	httpd->encoder_drained = size < sizeof(httpd->buffer);
+
 	return page_new_copy(httpd->buffer, size);
 }
 
@@ -291,10 +319,20 @@ httpd_output_encoder_open(struct httpd_output *httpd,
 	/* we have to remember the encoder header, i.e. the first
 	   bytes of encoder output after opening it, because it has to
 	   be sent to every new client */
+	httpd->encoder_drained = true;
 	httpd->header = httpd_output_read_page(httpd);
 
 	httpd->unflushed_input = 0;
 
+	/* after the RIFF header (captured above, and sent to each
+	   client on connect), the "wave" encoder emits the PCM input
+	   unmodified; when no byte swapping or 24 bit repacking is
+	   needed, bypass the encoder on the hot path and wrap the
+	   chunks in pages directly, saving two copies per chunk */
+	httpd->passthrough = httpd->encoder_is_wave &&
+		G_BYTE_ORDER == G_LITTLE_ENDIAN &&
+		audio_format->format != SAMPLE_FORMAT_S24_P32;
+
 	return true;
 }
 
@@ -389,7 +427,9 @@ httpd_output_send_header(struct httpd_output *httpd,
 			 struct httpd_client *client)
 {
 	if (httpd->header != NULL)
-		httpd_client_send(client, httpd->header);
+		/* the header starts a new stream, and is always a
+		   clean boundary */
+		httpd_client_send(client, httpd->header, true);
 }
 
 static unsigned
@@ -402,36 +442,41 @@ httpd_output_delay(struct audio_output *ao)
 		: 0;
 }
 
-static void
-httpd_client_check_queue(gpointer data, G_GNUC_UNUSED gpointer user_data)
-{
-	struct httpd_client *client = data;
+/**
+ * The parameters for httpd_client_send_page().
+ */
+struct httpd_broadcast {
+	struct page *page;
 
-	if (httpd_client_queue_size(client) > 256 * 1024) {
-		g_debug("client is too slow, flushing its queue");
-		httpd_client_cancel(client);
-	}
-}
+	/** does the page start at an encoder flush boundary? */
+	bool sync;
+};
 
 static void
 httpd_client_send_page(gpointer data, gpointer user_data)
 {
 	struct httpd_client *client = data;
-	struct page *page = user_data;
+	const struct httpd_broadcast *broadcast = user_data;
 
-	httpd_client_send(client, page);
+	httpd_client_send(client, broadcast->page, broadcast->sync);
 }
 
 /**
  * Broadcasts a page struct to all clients.
  */
 static void
-httpd_output_broadcast_page(struct httpd_output *httpd, struct page *page)
+httpd_output_broadcast_page(struct httpd_output *httpd, struct page *page,
+			    bool sync)
 {
+	struct httpd_broadcast broadcast = {
+		.page = page,
+		.sync = sync,
+	};
+
 	assert(page != NULL);
 
 	g_mutex_lock(httpd->mutex);
-	g_list_foreach(httpd->clients, httpd_client_send_page, page);
+	g_list_foreach(httpd->clients, httpd_client_send_page, &broadcast);
 	g_mutex_unlock(httpd->mutex);
 }
 
@@ -443,12 +488,14 @@ httpd_output_encoder_to_clients(struct httpd_output *httpd)
 {
 	struct page *page;
 
-	g_mutex_lock(httpd->mutex);
-	g_list_foreach(httpd->clients, httpd_client_check_queue, NULL);
-	g_mutex_unlock(httpd->mutex);
+	while (true) {
+		bool sync = httpd->encoder_drained;
+
+		page = httpd_output_read_page(httpd);
+		if (page == NULL)
+			break;
 
-	while ((page = httpd_output_read_page(httpd)) != NULL) {
-		httpd_output_broadcast_page(httpd, page);
+		httpd_output_broadcast_page(httpd, page, sync);
 		page_unref(page);
 	}
 }
@@ -482,11 +529,20 @@ httpd_output_play(struct audio_output *ao, const void *chunk, size_t size,
 	g_mutex_unlock(httpd->mutex);
 
 	if (has_clients) {
-		bool success;
-
-		success = httpd_output_encode_and_play(httpd, chunk, size,
-						       error);
-		if (!success)
+		if (httpd->passthrough) {
+			/* the chunk buffer is only valid during this
+			   call, so one copy into a (pooled,
+			   refcounted) page remains */
+			struct page *page = page_new(size);
+			memcpy(page->data, chunk, size);
+
+			/* each chunk is a whole number of PCM frames,
+			   so every page boundary is a
+			   resynchronization point */
+			httpd_output_broadcast_page(httpd, page, true);
+			page_unref(page);
+		} else if (!httpd_output_encode_and_play(httpd, chunk, size,
+							 error))
 			return 0;
 	}
 
@@ -555,7 +611,7 @@ httpd_output_tag(struct audio_output *ao, const struct tag *tag)
 			if (httpd->header != NULL)
 				page_unref(httpd->header);
 			httpd->header = page;
-			httpd_output_broadcast_page(httpd, page);
+			httpd_output_broadcast_page(httpd, page, true);
 		}
 	} else {
 		/* use Icy-Metadata */
@@ -20,6 +20,8 @@
 #include "config.h"
 #include "jack_output_plugin.h"
 #include "output_api.h"
+#include "pcm_buffer.h"
+#include "pcm_dispatch.h"
 
 #include <assert.h>
 
@@ -63,8 +65,19 @@ struct jack_data {
 	char *destination_ports[MAX_PORTS];
 	unsigned num_destination_ports;
 
+	/**
+	 * The configured "ringbuffer_size", or 0 if the size shall be
+	 * negotiated against the JACK period size.
+	 */
 	size_t ringbuffer_size;
 
+	/**
+	 * The size which the ring buffers were actually allocated
+	 * with.  When a reopen requires more, they are reallocated
+	 * (with the client deactivated).
+	 */
+	size_t ringbuffer_allocated;
+
 	/* the current audio format */
 	struct audio_format audio_format;
 
@@ -73,13 +86,36 @@ struct jack_data {
 	jack_client_t *client;
 	jack_ringbuffer_t *ringbuffer[MAX_PORTS];
 
+	/**
+	 * The buffer used to de-interleave and convert samples before
+	 * they are written to the ring buffers.
+	 */
+	struct pcm_buffer conv_buffer;
+
 	bool shutdown;
 
+	/**
+	 * Has jack_activate() been called?  While this is set, the
+	 * "process" callback is running, and the ring buffers must
+	 * not be reallocated.  The client stays activated across
+	 * close()/open(), so an audio format change does not need a
+	 * port reconnect which would audibly drop audio.
+	 */
+	bool activated;
+
 	/**
 	 * While this flag is set, the "process" callback generates
 	 * silence.
 	 */
 	bool pause;
+
+	/**
+	 * A request to the "process" callback to discard the ring
+	 * buffer contents (accessed with atomic operations).  Used by
+	 * cancel(), because only the reader may remove data from a
+	 * jack_ringbuffer_t.
+	 */
+	gint drop;
 };
 
 /**
@@ -120,13 +156,23 @@ mpd_jack_process(jack_nframes_t nframes, void *arg)
 	if (nframes <= 0)
 		return 0;
 
+	if (g_atomic_int_get(&jd->drop)) {
+		/* cancel(): discard everything which is still in the
+		   ring buffers */
+
+		for (unsigned i = 0; i < jd->num_source_ports; ++i)
+			jack_ringbuffer_read_advance(jd->ringbuffer[i],
+						     jack_ringbuffer_read_space(jd->ringbuffer[i]));
+
+		g_atomic_int_set(&jd->drop, 0);
+	}
+
 	if (jd->pause) {
 		/* empty the ring buffers */
 
-		const jack_nframes_t available = mpd_jack_available(jd);
-		for (unsigned i = 0; i < jd->audio_format.channels; ++i)
+		for (unsigned i = 0; i < jd->num_source_ports; ++i)
 			jack_ringbuffer_read_advance(jd->ringbuffer[i],
-						     available * jack_sample_size);
+						     jack_ringbuffer_read_space(jd->ringbuffer[i]));
 
 		/* generate silence while MPD is paused */
 
@@ -154,10 +200,15 @@ mpd_jack_process(jack_nframes_t nframes, void *arg)
 			out[f] = 0.0;
 	}
 
-	/* generate silence for the unused source ports */
+	/* generate silence for the unused source ports, and drain
+	   their ring buffers, so no stale samples are left for a
+	   future format with more channels */
 
 	for (unsigned i = jd->audio_format.channels;
 	     i < jd->num_source_ports; ++i) {
+		jack_ringbuffer_read_advance(jd->ringbuffer[i],
+					     jack_ringbuffer_read_space(jd->ringbuffer[i]));
+
 		out = jack_port_get_buffer(jd->ports[i], nframes);
 
 		for (jack_nframes_t f = 0; f < nframes; ++f)
@@ -213,6 +264,7 @@ mpd_jack_disconnect(struct jack_data *jd)
 	assert(jd->client != NULL);
 
 	jack_deactivate(jd->client);
+	jd->activated = false;
 	jack_client_close(jd->client);
 	jd->client = NULL;
 }
@@ -294,11 +346,20 @@ parse_port_list(int line, const char *source, char **dest, GError **error_r)
 	return n;
 }
 
+static void
+mpd_jack_dispatch_init(void);
+
 static struct audio_output *
 mpd_jack_init(const struct config_param *param, GError **error_r)
 {
 	struct jack_data *jd = g_new(struct jack_data, 1);
 
+	static gsize dispatch_initialized = 0;
+	if (g_once_init_enter(&dispatch_initialized)) {
+		mpd_jack_dispatch_init();
+		g_once_init_leave(&dispatch_initialized, 1);
+	}
+
 	if (!ao_base_init(&jd->base, &jack_output_plugin, param, error_r)) {
 		g_free(jd);
 		return NULL;
@@ -359,8 +420,11 @@ mpd_jack_init(const struct config_param *param, GError **error_r)
 			  jd->num_source_ports, jd->num_destination_ports,
 			  param->line);
 
+	/* 0 means: negotiate the size against the JACK period */
 	jd->ringbuffer_size =
-		config_get_block_unsigned(param, "ringbuffer_size", 32768);
+		config_get_block_unsigned(param, "ringbuffer_size", 0);
+
+	pcm_buffer_init(&jd->conv_buffer);
 
 	jack_set_error_function(mpd_jack_error);
 
@@ -382,6 +446,8 @@ mpd_jack_finish(struct audio_output *ao)
 	for (unsigned i = 0; i < jd->num_destination_ports; ++i)
 		g_free(jd->destination_ports[i]);
 
+	pcm_buffer_deinit(&jd->conv_buffer);
+
 	ao_base_finish(&jd->base);
 	g_free(jd);
 }
@@ -394,6 +460,10 @@ mpd_jack_enable(struct audio_output *ao, GError **error_r)
 	for (unsigned i = 0; i < jd->num_source_ports; ++i)
 		jd->ringbuffer[i] = NULL;
 
+	jd->ringbuffer_allocated = 0;
+	jd->activated = false;
+	jd->drop = 0;
+
 	return mpd_jack_connect(jd, error_r);
 }
 
@@ -427,9 +497,27 @@ mpd_jack_stop(struct jack_data *jd)
 	if (jd->shutdown)
 		/* the connection has failed; close it */
 		mpd_jack_disconnect(jd);
-	else
+	else {
 		/* the connection is alive: just stop playback */
 		jack_deactivate(jd->client);
+		jd->activated = false;
+	}
+}
+
+/**
+ * Determine the ring buffer size: the configured "ringbuffer_size",
+ * or - by default - room for four JACK periods per channel, so the
+ * output thread can stay ahead of the process callback without adding
+ * excessive latency.  jack_ringbuffer_create() rounds up to a power
+ * of two internally.
+ */
+static size_t
+mpd_jack_ringbuffer_size(const struct jack_data *jd)
+{
+	if (jd->ringbuffer_size > 0)
+		return jd->ringbuffer_size;
+
+	return jack_get_buffer_size(jd->client) * jack_sample_size * 4;
 }
 
 static bool
@@ -440,22 +528,31 @@ mpd_jack_start(struct jack_data *jd, GError **error_r)
 	unsigned num_destination_ports;
 
 	assert(jd->client != NULL);
+	assert(!jd->activated);
 	assert(jd->audio_format.channels <= jd->num_source_ports);
 
-	/* allocate the ring buffers on the first open(); these
-	   persist until MPD exits.  It's too unsafe to delete them
-	   because we can never know when mpd_jack_process() gets
-	   called */
+	/* the client is not activated, so mpd_jack_process() is not
+	   running: it is safe to (re)allocate the ring buffers */
+
+	const size_t required = mpd_jack_ringbuffer_size(jd);
 	for (unsigned i = 0; i < jd->num_source_ports; ++i) {
+		if (jd->ringbuffer[i] != NULL &&
+		    jd->ringbuffer_allocated < required) {
+			jack_ringbuffer_free(jd->ringbuffer[i]);
+			jd->ringbuffer[i] = NULL;
+		}
+
 		if (jd->ringbuffer[i] == NULL)
-			jd->ringbuffer[i] =
-				jack_ringbuffer_create(jd->ringbuffer_size);
+			jd->ringbuffer[i] = jack_ringbuffer_create(required);
 
 		/* clear the ring buffer to be sure that data from
 		   previous playbacks are gone */
 		jack_ringbuffer_reset(jd->ringbuffer[i]);
 	}
 
+	if (jd->ringbuffer_allocated < required)
+		jd->ringbuffer_allocated = required;
+
 	if ( jack_activate(jd->client) ) {
 		g_set_error(error_r, jack_output_quark(), 0,
 			    "cannot activate client");
@@ -572,15 +669,37 @@ mpd_jack_open(struct audio_output *ao, struct audio_format *audio_format,
 
 	jd->pause = false;
 
+	if (jd->client != NULL && jd->shutdown)
+		/* the connection has failed while the device was
+		   closed; clean it up before reconnecting */
+		mpd_jack_disconnect(jd);
+
 	if (jd->client == NULL && !mpd_jack_connect(jd, error_r))
 		return false;
 
 	set_audioformat(jd, audio_format);
 	jd->audio_format = *audio_format;
 
+	if (jd->activated) {
+		/* the client is still activated from the previous
+		   open(): the ring buffers contain format agnostic
+		   float samples and the ports are still connected,
+		   so playback just continues, without a reconnect
+		   which would audibly drop audio */
+
+		if (mpd_jack_ringbuffer_size(jd) <= jd->ringbuffer_allocated)
+			return true;
+
+		/* the ring buffers are too small for the new period
+		   size; stop the client so they can be reallocated */
+		jack_deactivate(jd->client);
+		jd->activated = false;
+	}
+
 	if (!mpd_jack_start(jd, error_r))
 		return false;
 
+	jd->activated = true;
 	return true;
 }
 
@@ -589,7 +708,45 @@ mpd_jack_close(G_GNUC_UNUSED struct audio_output *ao)
 {
 	struct jack_data *jd = (struct jack_data *)ao;
 
-	mpd_jack_stop(jd);
+	if (jd->shutdown) {
+		mpd_jack_stop(jd);
+		return;
+	}
+
+	/* keep the client activated and the ports connected: the
+	   process callback plays the remaining ring buffer contents,
+	   followed by silence, and the next open() takes over
+	   seamlessly */
+}
+
+static void
+mpd_jack_cancel(struct audio_output *ao)
+{
+	struct jack_data *jd = (struct jack_data *)ao;
+
+	if (!jd->activated || jd->shutdown)
+		return;
+
+	/* only the reader may remove data from a jack_ringbuffer_t;
+	   ask the process callback to do it, and wait, so data
+	   written after this call is not discarded as well */
+
+	g_atomic_int_set(&jd->drop, 1);
+
+	while (g_atomic_int_get(&jd->drop) != 0 && !jd->shutdown)
+		g_usleep(1000);
+}
+
+static void
+mpd_jack_drain(struct audio_output *ao)
+{
+	struct jack_data *jd = (struct jack_data *)ao;
+
+	if (!jd->activated)
+		return;
+
+	while (mpd_jack_available(jd) > 0 && !jd->shutdown)
+		g_usleep(1000);
 }
 
 static inline jack_default_audio_sample_t
@@ -598,62 +755,192 @@ sample_16_to_jack(int16_t sample)
 	return sample / (jack_default_audio_sample_t)(1 << (16 - 1));
 }
 
+static inline jack_default_audio_sample_t
+sample_24_to_jack(int32_t sample)
+{
+	return sample / (jack_default_audio_sample_t)(1 << (24 - 1));
+}
+
+/**
+ * De-interleave and convert one channel into the conversion buffer
+ * (any channel count).
+ */
 static void
-mpd_jack_write_samples_16(struct jack_data *jd, const int16_t *src,
-			  unsigned num_samples)
+mpd_jack_deinterleave_16(jack_default_audio_sample_t *dest,
+			 const int16_t *src,
+			 unsigned num_frames, unsigned channels)
 {
-	jack_default_audio_sample_t sample;
-	unsigned i;
+	for (unsigned c = 0; c < channels; ++c) {
+		jack_default_audio_sample_t *d = dest + c * num_frames;
+		const int16_t *s = src + c;
 
-	while (num_samples-- > 0) {
-		for (i = 0; i < jd->audio_format.channels; ++i) {
-			sample = sample_16_to_jack(*src++);
-			jack_ringbuffer_write(jd->ringbuffer[i], (void*)&sample,
-					      sizeof(sample));
+		for (unsigned f = 0; f < num_frames; ++f) {
+			d[f] = sample_16_to_jack(*s);
+			s += channels;
 		}
 	}
 }
 
-static inline jack_default_audio_sample_t
-sample_24_to_jack(int32_t sample)
+static void
+mpd_jack_deinterleave_24(jack_default_audio_sample_t *dest,
+			 const int32_t *src,
+			 unsigned num_frames, unsigned channels)
 {
-	return sample / (jack_default_audio_sample_t)(1 << (24 - 1));
+	for (unsigned c = 0; c < channels; ++c) {
+		jack_default_audio_sample_t *d = dest + c * num_frames;
+		const int32_t *s = src + c;
+
+		for (unsigned f = 0; f < num_frames; ++f) {
+			d[f] = sample_24_to_jack(*s);
+			s += channels;
+		}
+	}
 }
 
+/* the common stereo case gets runtime-dispatched kernels, like the
+   ones in the pcm library (see pcm_dispatch.h) */
+
+typedef void (*jack_deinterleave_16_func)(jack_default_audio_sample_t *dest,
+					  const int16_t *src,
+					  unsigned num_frames);
+typedef void (*jack_deinterleave_24_func)(jack_default_audio_sample_t *dest,
+					  const int32_t *src,
+					  unsigned num_frames);
+
 static void
-mpd_jack_write_samples_24(struct jack_data *jd, const int32_t *src,
-			  unsigned num_samples)
+mpd_jack_deinterleave_16_stereo(jack_default_audio_sample_t *dest,
+				const int16_t *src, unsigned num_frames)
 {
-	jack_default_audio_sample_t sample;
-	unsigned i;
+	mpd_jack_deinterleave_16(dest, src, num_frames, 2);
+}
 
-	while (num_samples-- > 0) {
-		for (i = 0; i < jd->audio_format.channels; ++i) {
-			sample = sample_24_to_jack(*src++);
-			jack_ringbuffer_write(jd->ringbuffer[i], (void*)&sample,
-					      sizeof(sample));
-		}
+static void
+mpd_jack_deinterleave_24_stereo(jack_default_audio_sample_t *dest,
+				const int32_t *src, unsigned num_frames)
+{
+	mpd_jack_deinterleave_24(dest, src, num_frames, 2);
+}
+
+#ifdef PCM_DISPATCH_X86
+
+__attribute__((target("sse2")))
+static void
+mpd_jack_deinterleave_16_stereo_sse2(jack_default_audio_sample_t *dest,
+				     const int16_t *src, unsigned num_frames)
+{
+	float *const left = dest, *const right = dest + num_frames;
+	const __m128 factor = _mm_set1_ps(1.0f / (1 << (16 - 1)));
+	const __m128i zero = _mm_setzero_si128();
+	unsigned f = 0;
+
+	for (; f + 4 <= num_frames; f += 4) {
+		/* load 4 frames = 8 interleaved samples */
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + 2 * f));
+
+		/* sign-extend to 32 bits by shifting down from the
+		   upper half-lanes */
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(zero, s), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(zero, s), 16);
+
+		__m128 flo = _mm_mul_ps(_mm_cvtepi32_ps(lo), factor);
+		__m128 fhi = _mm_mul_ps(_mm_cvtepi32_ps(hi), factor);
+
+		/* split [L0 R0 L1 R1] / [L2 R2 L3 R3] into planes */
+		_mm_storeu_ps(left + f,
+			      _mm_shuffle_ps(flo, fhi, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(right + f,
+			      _mm_shuffle_ps(flo, fhi, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+
+	for (; f < num_frames; ++f) {
+		left[f] = sample_16_to_jack(src[2 * f]);
+		right[f] = sample_16_to_jack(src[2 * f + 1]);
 	}
 }
 
+__attribute__((target("sse2")))
+static void
+mpd_jack_deinterleave_24_stereo_sse2(jack_default_audio_sample_t *dest,
+				     const int32_t *src, unsigned num_frames)
+{
+	float *const left = dest, *const right = dest + num_frames;
+	const __m128 factor = _mm_set1_ps(1.0f / (1 << (24 - 1)));
+	unsigned f = 0;
+
+	for (; f + 4 <= num_frames; f += 4) {
+		__m128 flo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + 2 * f))),
+					factor);
+		__m128 fhi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + 2 * f + 4))),
+					factor);
+
+		_mm_storeu_ps(left + f,
+			      _mm_shuffle_ps(flo, fhi, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(right + f,
+			      _mm_shuffle_ps(flo, fhi, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+
+	for (; f < num_frames; ++f) {
+		left[f] = sample_24_to_jack(src[2 * f]);
+		right[f] = sample_24_to_jack(src[2 * f + 1]);
+	}
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+static jack_deinterleave_16_func jack_deinterleave_16_stereo_hook =
+	mpd_jack_deinterleave_16_stereo;
+static jack_deinterleave_24_func jack_deinterleave_24_stereo_hook =
+	mpd_jack_deinterleave_24_stereo;
+
+static void
+mpd_jack_dispatch_init(void)
+{
+#ifdef PCM_DISPATCH_X86
+	if (__builtin_cpu_supports("sse2")) {
+		jack_deinterleave_16_stereo_hook =
+			mpd_jack_deinterleave_16_stereo_sse2;
+		jack_deinterleave_24_stereo_hook =
+			mpd_jack_deinterleave_24_stereo_sse2;
+	}
+#endif
+}
+
 static void
 mpd_jack_write_samples(struct jack_data *jd, const void *src,
-		       unsigned num_samples)
+		       unsigned num_frames)
 {
+	const unsigned channels = jd->audio_format.channels;
+	jack_default_audio_sample_t *dest =
+		pcm_buffer_get(&jd->conv_buffer,
+			       num_frames * channels * jack_sample_size);
+
 	switch (jd->audio_format.format) {
 	case SAMPLE_FORMAT_S16:
-		mpd_jack_write_samples_16(jd, (const int16_t*)src,
-					  num_samples);
+		if (channels == 2)
+			jack_deinterleave_16_stereo_hook(dest, src, num_frames);
+		else
+			mpd_jack_deinterleave_16(dest, src, num_frames,
+						 channels);
 		break;
 
 	case SAMPLE_FORMAT_S24_P32:
-		mpd_jack_write_samples_24(jd, (const int32_t*)src,
-					  num_samples);
+		if (channels == 2)
+			jack_deinterleave_24_stereo_hook(dest, src, num_frames);
+		else
+			mpd_jack_deinterleave_24(dest, src, num_frames,
+						 channels);
 		break;
 
 	default:
 		assert(false);
 	}
+
+	/* one bulk write per channel instead of one per sample */
+
+	for (unsigned i = 0; i < channels; ++i)
+		jack_ringbuffer_write(jd->ringbuffer[i],
+				      (const char *)(dest + i * num_frames),
+				      num_frames * jack_sample_size);
 }
 
 static size_t
@@ -727,6 +1014,8 @@ const struct audio_output_plugin jack_output_plugin = {
 	.disable = mpd_jack_disable,
 	.open = mpd_jack_open,
 	.play = mpd_jack_play,
+	.drain = mpd_jack_drain,
 	.pause = mpd_jack_pause,
+	.cancel = mpd_jack_cancel,
 	.close = mpd_jack_close,
 };
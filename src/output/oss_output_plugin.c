@@ -22,6 +22,7 @@
 #include "output_api.h"
 #include "mixer_list.h"
 #include "fd_util.h"
+#include "fifo_buffer.h"
 
 #include <glib.h>
 
@@ -62,6 +63,27 @@ struct oss_data {
 	 * the device after cancel().
 	 */
 	struct audio_format audio_format;
+
+	/**
+	 * The size of one frame in the current audio format.  The
+	 * number of bytes consumed by play() must be a multiple of
+	 * this.
+	 */
+	size_t frame_size;
+
+	/**
+	 * The kernel's fragment size (SNDCTL_DSP_GETBLKSIZE).
+	 * Writes are issued in whole fragments whenever possible, to
+	 * reduce the number of system calls.
+	 */
+	size_t fragment_size;
+
+	/**
+	 * The staging buffer: it accumulates partial fragments from
+	 * several music chunks, until a whole fragment can be written
+	 * to the device.  NULL while the plugin is closed.
+	 */
+	struct fifo_buffer *buffer;
 };
 
 /**
@@ -80,6 +102,7 @@ oss_data_new(void)
 
 	ret->device = NULL;
 	ret->fd = -1;
+	ret->buffer = NULL;
 
 	return ret;
 }
@@ -642,6 +665,16 @@ oss_output_open(struct audio_output *ao, struct audio_format *audio_format,
 	}
 
 	od->audio_format = *audio_format;
+	od->frame_size = audio_format_frame_size(audio_format);
+
+	int blksize = 0;
+	if (ioctl(od->fd, SNDCTL_DSP_GETBLKSIZE, &blksize) < 0 || blksize <= 0)
+		/* fall back to a reasonable default */
+		blksize = 4096;
+	od->fragment_size = blksize;
+
+	od->buffer = fifo_buffer_new(od->fragment_size * 2);
+
 	return true;
 }
 
@@ -651,6 +684,9 @@ oss_output_close(struct audio_output *ao)
 	struct oss_data *od = (struct oss_data *)ao;
 
 	oss_close(od);
+
+	fifo_buffer_free(od->buffer);
+	od->buffer = NULL;
 }
 
 static void
@@ -658,34 +694,106 @@ oss_output_cancel(struct audio_output *ao)
 {
 	struct oss_data *od = (struct oss_data *)ao;
 
+	if (od->buffer != NULL)
+		fifo_buffer_clear(od->buffer);
+
 	if (od->fd >= 0) {
 		ioctl(od->fd, SNDCTL_DSP_RESET, 0);
 		oss_close(od);
 	}
 }
 
+/**
+ * Writes the staging buffer to the device.  Unless @full is set, only
+ * whole kernel fragments are written; the remainder stays in the
+ * buffer, waiting for the next chunk.  A partial write() simply
+ * continues from the unwritten offset, without re-entering the device
+ * setup path.
+ */
+static bool
+oss_output_flush(struct oss_data *od, bool full, GError **error_r)
+{
+	size_t length;
+	const char *data = fifo_buffer_read(od->buffer, &length);
+	if (data == NULL)
+		return true;
+
+	if (!full)
+		length -= length % od->fragment_size;
+
+	while (length > 0) {
+		ssize_t nbytes = write(od->fd, data, length);
+		if (nbytes < 0) {
+			if (errno == EINTR)
+				continue;
+
+			g_set_error(error_r, oss_output_quark(), errno,
+				    "Write error on %s: %s",
+				    od->device, g_strerror(errno));
+			return false;
+		}
+
+		fifo_buffer_consume(od->buffer, nbytes);
+		data += nbytes;
+		length -= nbytes;
+	}
+
+	return true;
+}
+
+static void
+oss_output_drain(struct audio_output *ao)
+{
+	struct oss_data *od = (struct oss_data *)ao;
+	GError *error = NULL;
+
+	if (od->fd < 0)
+		return;
+
+	/* write the partial fragment which is still in the staging
+	   buffer */
+	if (!oss_output_flush(od, true, &error)) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+	}
+}
+
 static size_t
 oss_output_play(struct audio_output *ao, const void *chunk, size_t size,
 		GError **error)
 {
 	struct oss_data *od = (struct oss_data *)ao;
-	ssize_t ret;
 
 	/* reopen the device since it was closed by dropBufferedAudio */
 	if (od->fd < 0 && !oss_reopen(od, error))
 		return 0;
 
 	while (true) {
-		ret = write(od->fd, chunk, size);
-		if (ret > 0)
-			return (size_t)ret;
+		size_t max_length;
+		void *p = fifo_buffer_write(od->buffer, &max_length);
+
+		size_t nbytes = size;
+		if (nbytes > max_length)
+			/* the return value must be a multiple of the
+			   frame size */
+			nbytes = max_length - max_length % od->frame_size;
+
+		if (nbytes == 0) {
+			/* staging buffer full: write a fragment to
+			   make room */
+			if (!oss_output_flush(od, false, error))
+				return 0;
+			continue;
+		}
 
-		if (ret < 0 && errno != EINTR) {
-			g_set_error(error, oss_output_quark(), errno,
-				    "Write error on %s: %s",
-				    od->device, g_strerror(errno));
+		memcpy(p, chunk, nbytes);
+		fifo_buffer_append(od->buffer, nbytes);
+
+		/* write out all whole fragments */
+		if (!oss_output_flush(od, false, error))
 			return 0;
-		}
+
+		return nbytes;
 	}
 }
 
@@ -697,6 +805,7 @@ const struct audio_output_plugin oss_output_plugin = {
 	.open = oss_output_open,
 	.close = oss_output_close,
 	.play = oss_output_play,
+	.drain = oss_output_drain,
 	.cancel = oss_output_cancel,
 
 	.mixer_plugin = &oss_mixer_plugin,
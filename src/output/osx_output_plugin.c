@@ -37,12 +37,41 @@ struct osx_output {
 	const char *device_name;
 
 	AudioUnit au;
-	GMutex *mutex;
-	GCond *condition;
+
+	/**
+	 * A lock-free ring buffer feeding the AudioUnit render
+	 * callback.  The render callback runs in a real-time thread
+	 * and must never take a lock (a blocked output thread would
+	 * cause a priority inversion and thus glitches); it only
+	 * advances #head, while osx_output_play() only advances
+	 * #tail.  One byte is left unused, to distinguish "full" from
+	 * "empty".  The indexes are accessed with atomic operations,
+	 * whose implied barriers also order them against the buffer
+	 * contents.
+	 */
 	char *buffer;
 	size_t buffer_size;
-	size_t pos;
-	size_t len;
+
+	/** the read position; owned by the render callback */
+	gint head;
+
+	/** the write position; owned by the output thread */
+	gint tail;
+
+	/**
+	 * Requests the render callback to drop all buffered data;
+	 * the lock-free implementation of the "cancel" method.
+	 */
+	gint discard;
+
+	/**
+	 * The output thread waits here while the ring is full.  The
+	 * render callback signals it without holding the mutex, to
+	 * stay wait-free; a lost wakeup merely delays the output
+	 * thread until the next render cycle.
+	 */
+	GMutex *mutex;
+	GCond *condition;
 };
 
 /**
@@ -95,8 +124,9 @@ osx_output_init(const struct config_param *param, GError **error_r)
 	oo->mutex = g_mutex_new();
 	oo->condition = g_cond_new();
 
-	oo->pos = 0;
-	oo->len = 0;
+	oo->head = 0;
+	oo->tail = 0;
+	oo->discard = false;
 	oo->buffer = NULL;
 	oo->buffer_size = 0;
 
@@ -214,37 +244,50 @@ osx_render(void *vdata,
 	struct osx_output *od = (struct osx_output *) vdata;
 	AudioBuffer *buffer = &buffer_list->mBuffers[0];
 	size_t buffer_size = buffer->mDataByteSize;
+	size_t head = (size_t)g_atomic_int_get(&od->head);
+	size_t tail = (size_t)g_atomic_int_get(&od->tail);
+	size_t available;
 	size_t bytes_to_copy;
 	size_t trailer_length;
 	size_t dest_pos = 0;
 
-	g_mutex_lock(od->mutex);
+	if (g_atomic_int_get(&od->discard)) {
+		/* execute a pending "cancel": drop everything that
+		   was buffered */
+		head = tail;
+		g_atomic_int_set(&od->head, (gint)head);
+		g_atomic_int_set(&od->discard, false);
+	}
 
-	bytes_to_copy = MIN(od->len, buffer_size);
-	od->len -= bytes_to_copy;
+	available = (tail - head + od->buffer_size) % od->buffer_size;
+	bytes_to_copy = MIN(available, buffer_size);
 
-	trailer_length = od->buffer_size - od->pos;
+	trailer_length = od->buffer_size - head;
 	if (bytes_to_copy > trailer_length) {
 		memcpy((unsigned char*)buffer->mData + dest_pos,
-		       od->buffer + od->pos, trailer_length);
-		od->pos = 0;
+		       od->buffer + head, trailer_length);
+		head = 0;
 		dest_pos += trailer_length;
 		bytes_to_copy -= trailer_length;
 	}
 
 	memcpy((unsigned char*)buffer->mData + dest_pos,
-	       od->buffer + od->pos, bytes_to_copy);
-	od->pos += bytes_to_copy;
+	       od->buffer + head, bytes_to_copy);
+	head += bytes_to_copy;
+	dest_pos += bytes_to_copy;
+
+	if (head >= od->buffer_size)
+		head = 0;
 
-	if (od->pos >= od->buffer_size)
-		od->pos = 0;
+	g_atomic_int_set(&od->head, (gint)head);
 
+	/* wake up the output thread if it is waiting for free space;
+	   deliberately without the mutex, see above */
 	g_cond_signal(od->condition);
-	g_mutex_unlock(od->mutex);
 
-	if (bytes_to_copy < buffer_size)
-		memset((unsigned char*)buffer->mData + bytes_to_copy, 0,
-		       buffer_size - bytes_to_copy);
+	if (dest_pos < buffer_size)
+		memset((unsigned char*)buffer->mData + dest_pos, 0,
+		       buffer_size - dest_pos);
 
 	return 0;
 }
@@ -313,9 +356,9 @@ osx_output_cancel(struct audio_output *ao)
 {
 	struct osx_output *od = (struct osx_output *)ao;
 
-	g_mutex_lock(od->mutex);
-	od->len = 0;
-	g_mutex_unlock(od->mutex);
+	/* the ring indexes are owned by their respective threads; ask
+	   the render callback to drop the buffered data itself */
+	g_atomic_int_set(&od->discard, true);
 }
 
 static void
@@ -390,8 +433,9 @@ osx_output_open(struct audio_output *ao, struct audio_format *audio_format, GErr
 		audio_format_frame_size(audio_format);
 	od->buffer = g_realloc(od->buffer, od->buffer_size);
 
-	od->pos = 0;
-	od->len = 0;
+	od->head = 0;
+	od->tail = 0;
+	od->discard = false;
 
 	status = AudioOutputUnitStart(od->au);
 	if (status != 0) {
@@ -410,31 +454,46 @@ osx_output_play(struct audio_output *ao, const void *chunk, size_t size,
 		G_GNUC_UNUSED GError **error)
 {
 	struct osx_output *od = (struct osx_output *)ao;
-	size_t start, nbytes;
-
-	g_mutex_lock(od->mutex);
-
-	while (od->len >= od->buffer_size)
-		/* wait for some free space in the buffer */
-		g_cond_wait(od->condition, od->mutex);
+	size_t head, tail, free_space, nbytes;
+
+	while (g_atomic_int_get(&od->discard)) {
+		/* wait for the render callback to execute the pending
+		   "cancel"; it will do so within one render cycle */
+		g_mutex_lock(od->mutex);
+		if (g_atomic_int_get(&od->discard))
+			g_cond_wait(od->condition, od->mutex);
+		g_mutex_unlock(od->mutex);
+	}
 
-	start = od->pos + od->len;
-	if (start >= od->buffer_size)
-		start -= od->buffer_size;
+	tail = (size_t)g_atomic_int_get(&od->tail);
 
-	nbytes = start < od->pos
-		? od->pos - start
-		: od->buffer_size - start;
+	while (true) {
+		head = (size_t)g_atomic_int_get(&od->head);
+		free_space = (head + od->buffer_size - tail - 1)
+			% od->buffer_size;
+		if (free_space > 0)
+			break;
 
-	assert(nbytes > 0);
+		/* wait for the render callback to free some space */
+		g_mutex_lock(od->mutex);
+		g_cond_wait(od->condition, od->mutex);
+		g_mutex_unlock(od->mutex);
+	}
 
+	/* copy only the contiguous range after the write position;
+	   the rest is submitted in the next call */
+	nbytes = od->buffer_size - tail;
+	if (nbytes > free_space)
+		nbytes = free_space;
 	if (nbytes > size)
 		nbytes = size;
 
-	memcpy(od->buffer + start, chunk, nbytes);
-	od->len += nbytes;
+	assert(nbytes > 0);
+
+	memcpy(od->buffer + tail, chunk, nbytes);
 
-	g_mutex_unlock(od->mutex);
+	tail = (tail + nbytes) % od->buffer_size;
+	g_atomic_int_set(&od->tail, (gint)tail);
 
 	return nbytes;
 }
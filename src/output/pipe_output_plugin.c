@@ -20,15 +20,58 @@
 #include "config.h"
 #include "pipe_output_plugin.h"
 #include "output_api.h"
+#include "timer.h"
+
+#include <glib.h>
 
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "pipe"
+
+/**
+ * The size of the buffer in front of the pipe.  When the child
+ * process stops reading, the oldest data is dropped once this buffer
+ * is full.
+ */
+#define PIPE_BUFFER_SIZE 65536
 
 struct pipe_output {
 	struct audio_output base;
 
 	char *cmd;
 	FILE *fh;
+
+	/** the pipe file descriptor, switched to non-blocking mode */
+	int fd;
+
+	/**
+	 * Paces play() to real time; the child process used to do
+	 * that implicitly with blocking writes, but those would wedge
+	 * the output thread whenever the child got stuck.
+	 */
+	struct timer *timer;
+
+	/**
+	 * A bounded ring buffer in front of the non-blocking pipe.
+	 * When the child process does not keep up, the oldest data is
+	 * dropped, so a stuck consumer can never affect playback
+	 * timing.
+	 */
+	char buffer[PIPE_BUFFER_SIZE];
+
+	/** the read position in #buffer */
+	size_t head;
+
+	/** the number of bytes queued in #buffer */
+	size_t fill;
+
+	/** has a drop warning been logged for this child? */
+	bool warned;
 };
 
 /**
@@ -73,7 +116,7 @@ pipe_output_finish(struct audio_output *ao)
 
 static bool
 pipe_output_open(struct audio_output *ao,
-		 G_GNUC_UNUSED struct audio_format *audio_format,
+		 struct audio_format *audio_format,
 		 G_GNUC_UNUSED GError **error)
 {
 	struct pipe_output *pd = (struct pipe_output *)ao;
@@ -86,6 +129,56 @@ pipe_output_open(struct audio_output *ao,
 		return false;
 	}
 
+	/* from now on, this plugin writes to the pipe with plain
+	   non-blocking write(); the FILE object is only kept for
+	   pclose() */
+
+	pd->fd = fileno(pd->fh);
+	fcntl(pd->fd, F_SETFL, fcntl(pd->fd, F_GETFL) | O_NONBLOCK);
+
+	pd->timer = timer_new(audio_format);
+	pd->head = 0;
+	pd->fill = 0;
+	pd->warned = false;
+
+	return true;
+}
+
+/**
+ * Writes as much buffered data as the pipe accepts, without ever
+ * blocking.
+ *
+ * @return true on success (including "pipe full"), false if the child
+ * process is gone
+ */
+static bool
+pipe_output_flush(struct pipe_output *pd, GError **error_r)
+{
+	while (pd->fill > 0) {
+		size_t nbytes = MIN(pd->fill,
+				    sizeof(pd->buffer) - pd->head);
+		ssize_t ret = write(pd->fd, pd->buffer + pd->head, nbytes);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				/* the pipe is full; the data stays
+				   buffered, and the oldest of it may
+				   be dropped later */
+				return true;
+
+			if (errno == EINTR)
+				continue;
+
+			/* EPIPE et al.: the child has died */
+			g_set_error(error_r, pipe_output_quark(), errno,
+				    "Write error on pipe: %s",
+				    g_strerror(errno));
+			return false;
+		}
+
+		pd->head = (pd->head + (size_t)ret) % sizeof(pd->buffer);
+		pd->fill -= (size_t)ret;
+	}
+
 	return true;
 }
 
@@ -94,21 +187,82 @@ pipe_output_close(struct audio_output *ao)
 {
 	struct pipe_output *pd = (struct pipe_output *)ao;
 
+	/* one last attempt to hand over buffered data, but never
+	   block on a stuck child */
+	pipe_output_flush(pd, NULL);
+
+	timer_free(pd->timer);
 	pclose(pd->fh);
 }
 
+static unsigned
+pipe_output_delay(struct audio_output *ao)
+{
+	struct pipe_output *pd = (struct pipe_output *)ao;
+
+	return pd->timer->started
+		? timer_delay(pd->timer)
+		: 0;
+}
+
 static size_t
 pipe_output_play(struct audio_output *ao, const void *chunk, size_t size, GError **error)
 {
 	struct pipe_output *pd = (struct pipe_output *)ao;
-	size_t ret;
 
-	ret = fwrite(chunk, 1, size, pd->fh);
-	if (ret == 0)
-		g_set_error(error, pipe_output_quark(), errno,
-			    "Write error on pipe: %s", g_strerror(errno));
+	if (!pd->timer->started)
+		timer_start(pd->timer);
+	timer_add(pd->timer, size);
+
+	if (size > sizeof(pd->buffer)) {
+		/* keep only the newest data */
+		chunk = (const char *)chunk + size - sizeof(pd->buffer);
+		size = sizeof(pd->buffer);
+	}
+
+	/* append to the ring buffer, dropping the oldest data if the
+	   child process has fallen behind */
+
+	size_t free_space = sizeof(pd->buffer) - pd->fill;
+	if (size > free_space) {
+		size_t discard = size - free_space;
+
+		if (!pd->warned) {
+			pd->warned = true;
+			g_warning("\"%s\" is not reading fast enough; "
+				  "discarding data", pd->cmd);
+		}
+
+		pd->head = (pd->head + discard) % sizeof(pd->buffer);
+		pd->fill -= discard;
+	}
+
+	size_t tail = (pd->head + pd->fill) % sizeof(pd->buffer);
+	size_t trailer_length = sizeof(pd->buffer) - tail;
+	if (size > trailer_length) {
+		memcpy(pd->buffer + tail, chunk, trailer_length);
+		memcpy(pd->buffer, (const char *)chunk + trailer_length,
+		       size - trailer_length);
+	} else
+		memcpy(pd->buffer + tail, chunk, size);
+
+	pd->fill += size;
+
+	if (!pipe_output_flush(pd, error))
+		return 0;
+
+	return size;
+}
+
+static void
+pipe_output_cancel(struct audio_output *ao)
+{
+	struct pipe_output *pd = (struct pipe_output *)ao;
+
+	timer_reset(pd->timer);
 
-	return ret;
+	pd->head = 0;
+	pd->fill = 0;
 }
 
 const struct audio_output_plugin pipe_output_plugin = {
@@ -117,5 +271,7 @@ const struct audio_output_plugin pipe_output_plugin = {
 	.finish = pipe_output_finish,
 	.open = pipe_output_open,
 	.close = pipe_output_close,
+	.delay = pipe_output_delay,
 	.play = pipe_output_play,
+	.cancel = pipe_output_cancel,
 };
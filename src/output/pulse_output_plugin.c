@@ -35,6 +35,7 @@
 
 #include <assert.h>
 #include <stddef.h>
+#include <string.h>
 
 #define MPD_PULSE_NAME "Music Player Daemon"
 
@@ -52,6 +53,12 @@ struct pulse_output {
 	const char *server;
 	const char *sink;
 
+	/**
+	 * The configured latency target [ms], or 0 to use the
+	 * server's default buffer size.
+	 */
+	unsigned latency;
+
 	struct pulse_mixer *mixer;
 
 	struct pa_threaded_mainloop *mainloop;
@@ -360,6 +367,7 @@ pulse_output_init(const struct config_param *param, GError **error_r)
 	po->name = config_get_block_string(param, "name", "mpd_pulse");
 	po->server = config_get_block_string(param, "server", NULL);
 	po->sink = config_get_block_string(param, "sink", NULL);
+	po->latency = config_get_block_unsigned(param, "latency", 0);
 
 	po->mixer = NULL;
 	po->mainloop = NULL;
@@ -631,8 +639,28 @@ pulse_output_open(struct audio_output *ao, struct audio_format *audio_format,
 
 	/* .. and connect it (asynchronously) */
 
+	pa_buffer_attr attr, *attr_p = NULL;
+	pa_stream_flags_t flags = (pa_stream_flags_t)0;
+
+	if (po->latency > 0) {
+		/* negotiate a small server-side buffer instead of the
+		   default (usually a quarter second or more), to keep
+		   pause/seek/volume reaction snappy */
+		attr.maxlength = (uint32_t)-1;
+		attr.tlength = pa_usec_to_bytes((pa_usec_t)po->latency * 1000,
+						&ss);
+		attr.prebuf = (uint32_t)-1;
+		attr.minreq = (uint32_t)-1;
+		attr.fragsize = (uint32_t)-1;
+		attr_p = &attr;
+
+#if PA_CHECK_VERSION(0,9,11)
+		flags = PA_STREAM_ADJUST_LATENCY;
+#endif
+	}
+
 	error = pa_stream_connect_playback(po->stream, po->sink,
-					   NULL, 0, NULL, NULL);
+					   attr_p, flags, NULL, NULL);
 	if (error < 0) {
 		pulse_output_delete_stream(po);
 
@@ -860,6 +888,24 @@ pulse_output_play(struct audio_output *ao, const void *chunk, size_t size,
 
 	po->writable -= size;
 
+#if PA_CHECK_VERSION(0,9,16)
+	/* write into libpulse's buffer directly, instead of having
+	   pa_stream_write() allocate another buffer and copy */
+
+	void *data;
+	size_t nbytes = size;
+	if (pa_stream_begin_write(po->stream, &data, &nbytes) == 0 &&
+	    data != NULL) {
+		if (nbytes < size) {
+			po->writable += size - nbytes;
+			size = nbytes;
+		}
+
+		memcpy(data, chunk, size);
+		chunk = data;
+	}
+#endif
+
 	error = pa_stream_write(po->stream, chunk, size, NULL,
 				0, PA_SEEK_RELATIVE);
 	pa_threaded_mainloop_unlock(po->mainloop);
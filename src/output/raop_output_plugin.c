@@ -18,6 +18,12 @@
  */
 
 #include "config.h"
+
+#ifdef HAVE_SENDMMSG
+/* sendmmsg() is a GNU extension */
+#define _GNU_SOURCE 1
+#endif
+
 #include "raop_output_plugin.h"
 #include "output_api.h"
 #include "mixer_list.h"
@@ -41,6 +47,11 @@
 #include <netdb.h>
 #endif
 
+#ifdef HAVE_TIMERFD_CREATE
+#include <sys/timerfd.h>
+#include <stdint.h>
+#endif
+
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "raop"
 
@@ -126,9 +137,30 @@ struct raop_session_data {
 	unsigned char buffer[RAOP_BUFFER_SIZE];
 	size_t bufferSize;
 
-	unsigned char data[RAOP_MAX_PACKET_SIZE];
-	int wblk_wsize;
-	int wblk_remsize;
+	/**
+	 * A double buffer for encrypted packets: while data[pending_data]
+	 * waits for its send deadline, the next packet is encoded and
+	 * encrypted into the other half.
+	 */
+	unsigned char data[2][RAOP_MAX_PACKET_SIZE];
+
+	/** the half of #data which the next packet is prepared in */
+	unsigned next_data;
+
+	/** the index of the prepared, but not yet sent packet */
+	unsigned pending_data;
+
+	/** the size of the pending packet; 0 if there is none */
+	size_t pending_size;
+
+	/** the wall-clock deadline for sending the pending packet */
+	struct timeval pending_deadline;
+
+	/**
+	 * A timerfd for absolute-deadline packet pacing, or -1 if
+	 * unavailable (then g_usleep() is used).
+	 */
+	int timer_fd;
 
 	GMutex *data_mutex;
 	GMutex *list_mutex;
@@ -167,6 +199,9 @@ raop_session_free(struct raop_session_data *session)
 	if (raop_session->ctrl.fd >= 0)
 		close_socket(raop_session->ctrl.fd);
 
+	if (session->timer_fd >= 0)
+		close(session->timer_fd);
+
 	g_free(session);
 }
 
@@ -207,6 +242,17 @@ raop_session_new(GError **error_r)
 	memset(session->buffer, 0, RAOP_BUFFER_SIZE);
 	session->bufferSize = 0;
 
+	session->next_data = 0;
+	session->pending_data = 0;
+	session->pending_size = 0;
+
+	session->timer_fd = -1;
+#ifdef HAVE_TIMERFD_CREATE
+	/* CLOCK_REALTIME, because the deadlines are derived from
+	   gettimeofday() */
+	session->timer_fd = timerfd_create(CLOCK_REALTIME, 0);
+#endif
+
 	return session;
 }
 
@@ -680,50 +726,160 @@ difference (struct timeval *t1, struct timeval *t2)
 	return ret;
 }
 
+/**
+ * Waits until the given wall-clock deadline.  An absolute timerfd is
+ * preferred, because it is not skewed by the time spent between
+ * calculating the delay and going to sleep; g_usleep() is the
+ * fallback.
+ */
+static void
+raop_wait_until(const struct timeval *deadline)
+{
+	struct timeval current_time;
+
+	gettimeofday(&current_time, NULL);
+	int diff = difference(deadline, &current_time);
+	if (diff <= 0)
+		return;
+
+#ifdef HAVE_TIMERFD_CREATE
+	if (raop_session->timer_fd >= 0) {
+		const struct itimerspec its = {
+			.it_value = {
+				.tv_sec = deadline->tv_sec,
+				.tv_nsec = deadline->tv_usec * 1000,
+			},
+		};
+		uint64_t expirations;
+
+		if (timerfd_settime(raop_session->timer_fd,
+				    TFD_TIMER_ABSTIME, &its, NULL) == 0 &&
+		    read(raop_session->timer_fd, &expirations,
+			 sizeof(expirations)) == (ssize_t)sizeof(expirations))
+			return;
+	}
+#endif
+
+	g_usleep(diff);
+}
+
+static bool
+raop_send_packet(int fd, const void *packet, size_t size,
+		 const struct sockaddr_in *address, GError **error_r)
+{
+	ssize_t nbytes = sendto(fd, packet, size, 0,
+				(const struct sockaddr *)address,
+				sizeof(*address));
+	if (nbytes < 0) {
+		g_set_error(error_r, raop_output_quark(), errno,
+			    "write error: %s",
+			    g_strerror(errno));
+		return false;
+	}
+
+	if (nbytes == 0) {
+		g_set_error_literal(error_r, raop_output_quark(), 0,
+				    "disconnected on the other end");
+		return false;
+	}
+
+	return true;
+}
+
 /*
  * With airtunes version 2, we don't get responses back when we send audio
  * data.  The only requests we get from the airtunes device are timing
  * requests.
+ *
+ * Sends the pending (already encrypted) packet to all speakers once
+ * its deadline has arrived.  Caller must lock the data_mutex.
  */
 static bool
-send_audio_data(int fd, GError **error_r)
+raop_flush_pending(int fd, GError **error_r)
 {
-	int i = 0;
-	struct timeval current_time, rtp_time;
-	struct raop_data *rd = raop_session->raop_list;
+	struct raop_session_data *session = raop_session;
+
+	if (session->pending_size == 0)
+		return true;
+
+	unsigned char *packet = session->data[session->pending_data];
+	size_t size = session->pending_size;
+	session->pending_size = 0;
+
+	raop_wait_until(&session->pending_deadline);
+	gettimeofday(&session->play_state.last_send, NULL);
+
+#ifdef HAVE_SENDMMSG
+	/* batch the steady-state copies into one sendmmsg() call;
+	   the very first packet for a speaker carries a different
+	   marker byte and is sent individually below */
+
+	unsigned num_started = 0;
+	for (const struct raop_data *rd = session->raop_list;
+	     rd != NULL; rd = rd->next)
+		if (rd->started)
+			++num_started;
+
+	if (num_started > 0) {
+		struct mmsghdr msgs[num_started];
+		struct iovec iov = {
+			.iov_base = packet,
+			.iov_len = size,
+		};
 
-	get_time_for_rtp(&raop_session->play_state, &rtp_time);
-	gettimeofday(&current_time, NULL);
-	int diff = difference(&rtp_time, &current_time);
-	if (diff > 0)
-		g_usleep(diff);
-
-	gettimeofday(&raop_session->play_state.last_send, NULL);
-	while (rd) {
-		if (rd->started) {
-			raop_session->data[1] = 0x60;
-		} else {
-			rd->started = true;
-			raop_session->data[1] = 0xe0;
+		packet[1] = 0x60;
+		memset(msgs, 0, sizeof(msgs));
+
+		unsigned i = 0;
+		for (struct raop_data *rd = session->raop_list;
+		     rd != NULL; rd = rd->next) {
+			if (!rd->started)
+				continue;
+
+			msgs[i].msg_hdr.msg_name = &rd->data_addr;
+			msgs[i].msg_hdr.msg_namelen = sizeof(rd->data_addr);
+			msgs[i].msg_hdr.msg_iov = &iov;
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			++i;
 		}
-		i = sendto(fd, (const void *)(raop_session->data + raop_session->wblk_wsize),
-			   raop_session->wblk_remsize, 0, (struct sockaddr *) &rd->data_addr,
-			   sizeof(rd->data_addr));
-		if (i < 0) {
-			g_set_error(error_r, raop_output_quark(), errno,
-				    "write error: %s",
-				    g_strerror(errno));
-			return false;
+
+		unsigned sent = 0;
+		while (sent < num_started) {
+			int n = sendmmsg(fd, msgs + sent, num_started - sent,
+					 0);
+			if (n < 0) {
+				g_set_error(error_r, raop_output_quark(),
+					    errno, "write error: %s",
+					    g_strerror(errno));
+				return false;
+			}
+
+			sent += n;
 		}
-		if (i == 0) {
-			g_set_error_literal(error_r, raop_output_quark(), 0,
-					    "disconnected on the other end");
+	}
+
+	for (struct raop_data *rd = session->raop_list;
+	     rd != NULL; rd = rd->next) {
+		if (rd->started)
+			continue;
+
+		rd->started = true;
+		packet[1] = 0xe0;
+		if (!raop_send_packet(fd, packet, size, &rd->data_addr,
+				      error_r))
 			return false;
-		}
-		rd = rd->next;
 	}
-	raop_session->wblk_wsize += i;
-	raop_session->wblk_remsize -= i;
+#else
+	for (struct raop_data *rd = session->raop_list;
+	     rd != NULL; rd = rd->next) {
+		packet[1] = rd->started ? 0x60 : 0xe0;
+		rd->started = true;
+
+		if (!raop_send_packet(fd, packet, size, &rd->data_addr,
+				      error_r))
+			return false;
+	}
+#endif
 
 	return true;
 }
@@ -818,6 +974,11 @@ raop_output_cancel(struct audio_output *ao)
 	rd->started = 0;
 	if (rd->is_master) {
 		raop_session->play_state.playing = false;
+
+		/* the pending packet belongs to the flushed stream */
+		g_mutex_lock(raop_session->data_mutex);
+		raop_session->pending_size = 0;
+		g_mutex_unlock(raop_session->data_mutex);
 	}
 	if (rd->paused) {
 		return;
@@ -841,6 +1002,19 @@ raop_output_pause(struct audio_output *ao)
 	struct raop_data *rd = (struct raop_data *)ao;
 
 	rd->paused = true;
+
+	if (rd->is_master) {
+		/* don't lose the last encrypted packet */
+		GError *error = NULL;
+
+		g_mutex_lock(raop_session->data_mutex);
+		if (!raop_flush_pending(raop_session->data_fd, &error)) {
+			g_warning("%s", error->message);
+			g_error_free(error);
+		}
+		g_mutex_unlock(raop_session->data_mutex);
+	}
+
 	return true;
 }
 
@@ -887,6 +1061,14 @@ raop_output_close(struct audio_output *ao)
 	//teardown
 	struct raop_data *rd = (struct raop_data *)ao;
 
+	if (rd->is_master) {
+		/* drop the pending packet; the stream is being torn
+		   down anyway */
+		g_mutex_lock(raop_session->data_mutex);
+		raop_session->pending_size = 0;
+		g_mutex_unlock(raop_session->data_mutex);
+	}
+
 	raop_output_remove(rd);
 
 	g_mutex_lock(rd->control_mutex);
@@ -1012,25 +1194,36 @@ raop_output_play(struct audio_output *ao, const void *chunk, size_t size,
 		chunk = ((const char *)chunk) + copyBytes;
 		size -= copyBytes;
 
-		if (!wrap_pcm(raop_session->data + RAOP_HEADER_SIZE, NUMSAMPLES, &count, raop_session->buffer, RAOP_BUFFER_SIZE)) {
+		unsigned char *packet =
+			raop_session->data[raop_session->next_data];
+
+		if (!wrap_pcm(packet + RAOP_HEADER_SIZE, NUMSAMPLES, &count, raop_session->buffer, RAOP_BUFFER_SIZE)) {
 			g_warning("unable to encode %d bytes properly\n", RAOP_BUFFER_SIZE);
 		}
 
-		memcpy(raop_session->data, header, RAOP_HEADER_SIZE);
-		raop_session->data[2] = raop_session->play_state.seq_num >> 8;
-		raop_session->data[3] = raop_session->play_state.seq_num & 0xff;
+		memcpy(packet, header, RAOP_HEADER_SIZE);
+		packet[2] = raop_session->play_state.seq_num >> 8;
+		packet[3] = raop_session->play_state.seq_num & 0xff;
 		raop_session->play_state.seq_num ++;
 
-		fill_int(raop_session->data + 4, raop_session->play_state.rtptime);
+		fill_int(packet + 4, raop_session->play_state.rtptime);
 		raop_session->play_state.rtptime += NUMSAMPLES;
 
-		raop_encrypt(&raop_session->encrypt, raop_session->data + RAOP_HEADER_SIZE, count);
-		raop_session->wblk_remsize = count + RAOP_HEADER_SIZE;
-		raop_session->wblk_wsize = 0;
+		raop_encrypt(&raop_session->encrypt, packet + RAOP_HEADER_SIZE, count);
 
-		if (!send_audio_data(raop_session->data_fd, error_r))
+		/* the previous packet has an older send deadline:
+		   flush it only now that the next one is already
+		   encrypted, pipelining the encryption with the
+		   pacing wait */
+		if (!raop_flush_pending(raop_session->data_fd, error_r))
 			goto erexit;
 
+		raop_session->pending_data = raop_session->next_data;
+		raop_session->next_data ^= 1;
+		raop_session->pending_size = count + RAOP_HEADER_SIZE;
+		get_time_for_rtp(&raop_session->play_state,
+				 &raop_session->pending_deadline);
+
 		raop_session->bufferSize = 0;
 	}
 	if (size > 0) {
@@ -22,13 +22,16 @@
 #include "output_api.h"
 #include "encoder_plugin.h"
 #include "encoder_list.h"
+#include "threaded_encoder.h"
 #include "fd_util.h"
 #include "open.h"
 
 #include <assert.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 
 #undef G_LOG_DOMAIN
@@ -52,6 +55,67 @@ struct recorder_output {
 	 */
 	int fd;
 
+	/**
+	 * The fdatasync interval [seconds], or 0 to leave syncing to
+	 * the kernel.
+	 */
+	unsigned sync_interval;
+
+	/**
+	 * Preallocate the file in extents of this size [bytes], or 0
+	 * to disable preallocation.
+	 */
+	size_t prealloc_size;
+
+	/**
+	 * The writer thread, or NULL if g_thread_create() failed;
+	 * without it, the output thread writes synchronously.
+	 */
+	GThread *thread;
+
+	GMutex *mutex;
+	GCond *cond;
+
+	/**
+	 * The ring buffer between the output thread and the writer
+	 * thread.  The output thread appends encoded data, and never
+	 * blocks on the file: when the ring is full (because the file
+	 * server is stalled), data is discarded instead.
+	 */
+	char *ring;
+	size_t ring_size;
+
+	/** the read position in #ring; owned by the writer thread */
+	size_t head;
+
+	/** the number of bytes queued in #ring */
+	size_t fill;
+
+	/** tells the writer thread to drain the ring and exit */
+	bool stop;
+
+	/** has an overflow warning been logged for this file? */
+	bool overflow;
+
+	/**
+	 * A write error from the writer thread, to be reported by the
+	 * next play() call.
+	 */
+	GError *write_error;
+
+	/* the following attributes are used by the thread which
+	   writes the file (i.e. the writer thread, or the output
+	   thread in the synchronous fall back): */
+
+	/** the number of bytes written to the file so far */
+	off_t file_offset;
+
+	/** how far the file has been preallocated */
+	off_t alloc_end;
+
+	/** measures the time since the last fdatasync */
+	GTimer *sync_timer;
+
 	/**
 	 * The buffer for encoder_read().
 	 */
@@ -97,12 +161,52 @@ recorder_output_init(const struct config_param *param, GError **error_r)
 		goto failure;
 	}
 
+	recorder->ring_size = config_get_block_unsigned(param, "buffer_size",
+							262144);
+	if (recorder->ring_size < sizeof(recorder->buffer)) {
+		g_set_error(error_r, recorder_output_quark(), 0,
+			    "buffer_size is too small");
+		goto failure;
+	}
+
+	recorder->sync_interval = config_get_block_unsigned(param,
+							    "sync_interval", 0);
+	recorder->prealloc_size = config_get_block_unsigned(param,
+							    "preallocate", 0);
+
+#ifndef HAVE_FDATASYNC
+	if (recorder->sync_interval > 0) {
+		g_warning("'sync_interval' is not available on this platform");
+		recorder->sync_interval = 0;
+	}
+#endif
+
+#ifndef HAVE_POSIX_FALLOCATE
+	if (recorder->prealloc_size > 0) {
+		g_warning("'preallocate' is not available on this platform");
+		recorder->prealloc_size = 0;
+	}
+#endif
+
 	/* initialize encoder */
 
 	recorder->encoder = encoder_init(encoder_plugin, param, error_r);
 	if (recorder->encoder == NULL)
 		goto failure;
 
+	if (config_get_block_bool(param, "threaded", false))
+		/* run the codec in a separate thread, so a slow
+		   encoder (e.g. FLAC at high compression levels on a
+		   weak CPU) does not stall the output thread */
+		recorder->encoder = threaded_encoder_new(recorder->encoder);
+
+	recorder->mutex = g_mutex_new();
+	recorder->cond = g_cond_new();
+	recorder->thread = NULL;
+	recorder->ring = NULL;
+	recorder->write_error = NULL;
+	recorder->sync_timer = NULL;
+
 	return &recorder->base;
 
 failure:
@@ -117,38 +221,49 @@ recorder_output_finish(struct audio_output *ao)
 	struct recorder_output *recorder = (struct recorder_output *)ao;
 
 	encoder_finish(recorder->encoder);
+	g_cond_free(recorder->cond);
+	g_mutex_free(recorder->mutex);
 	ao_base_finish(&recorder->base);
 	g_free(recorder);
 }
 
 /**
- * Writes pending data from the encoder to the output file.
+ * Writes data to the file, preallocating and syncing as configured.
+ * Runs in the writer thread, or in the output thread if the writer
+ * thread could not be spawned.
  */
 static bool
-recorder_output_encoder_to_file(struct recorder_output *recorder,
-			      GError **error_r)
+recorder_output_write_file(struct recorder_output *recorder,
+			   const void *data, size_t length,
+			   GError **error_r)
 {
-	size_t size = 0, position, nbytes;
+	const char *p = data;
+	size_t position = 0;
+	ssize_t nbytes;
 
 	assert(recorder->fd >= 0);
 
-	/* read from the encoder */
-
-	size = encoder_read(recorder->encoder, recorder->buffer,
-			    sizeof(recorder->buffer));
-	if (size == 0)
-		return true;
-
-	/* write everything into the file */
+#ifdef HAVE_POSIX_FALLOCATE
+	if (recorder->prealloc_size > 0 &&
+	    recorder->file_offset + (off_t)length > recorder->alloc_end) {
+		/* grow the file in large extents, to avoid
+		   fragmentation and incremental metadata updates; the
+		   preallocated tail is trimmed when the file is
+		   closed */
+		if (posix_fallocate(recorder->fd, recorder->alloc_end,
+				    recorder->prealloc_size) == 0)
+			recorder->alloc_end += recorder->prealloc_size;
+		else
+			/* not supported by this file system; don't
+			   try again */
+			recorder->prealloc_size = 0;
+	}
+#endif
 
-	position = 0;
-	while (true) {
-		nbytes = write(recorder->fd, recorder->buffer + position,
-			       size - position);
+	while (position < length) {
+		nbytes = write(recorder->fd, p + position, length - position);
 		if (nbytes > 0) {
 			position += (size_t)nbytes;
-			if (position >= size)
-				return true;
 		} else if (nbytes == 0) {
 			/* shouldn't happen for files */
 			g_set_error(error_r, recorder_output_quark(), 0,
@@ -161,6 +276,144 @@ recorder_output_encoder_to_file(struct recorder_output *recorder,
 			return false;
 		}
 	}
+
+	recorder->file_offset += (off_t)length;
+
+#ifdef HAVE_FDATASYNC
+	if (recorder->sync_interval > 0 &&
+	    g_timer_elapsed(recorder->sync_timer, NULL) >=
+	    (double)recorder->sync_interval) {
+		fdatasync(recorder->fd);
+		g_timer_start(recorder->sync_timer);
+	}
+#endif
+
+	return true;
+}
+
+static gpointer
+recorder_writer_task(gpointer data)
+{
+	struct recorder_output *recorder = data;
+	bool failed = false;
+
+	g_mutex_lock(recorder->mutex);
+
+	while (true) {
+		if (recorder->fill == 0) {
+			if (recorder->stop)
+				break;
+
+			g_cond_wait(recorder->cond, recorder->mutex);
+			continue;
+		}
+
+		size_t head = recorder->head;
+		size_t nbytes = MIN(recorder->fill,
+				    recorder->ring_size - head);
+
+		g_mutex_unlock(recorder->mutex);
+
+		GError *error = NULL;
+		if (!failed &&
+		    !recorder_output_write_file(recorder,
+						recorder->ring + head,
+						nbytes, &error))
+			/* after a write error, keep consuming the
+			   ring, but discard the data */
+			failed = true;
+
+		g_mutex_lock(recorder->mutex);
+
+		if (error != NULL) {
+			if (recorder->write_error == NULL)
+				recorder->write_error = error;
+			else
+				g_error_free(error);
+		}
+
+		recorder->head = (head + nbytes) % recorder->ring_size;
+		recorder->fill -= nbytes;
+	}
+
+	g_mutex_unlock(recorder->mutex);
+	return NULL;
+}
+
+/**
+ * Passes data to the writer thread, or writes it synchronously if
+ * there is no writer thread.  Never blocks on the file: when the ring
+ * is full, data is discarded, because stalling the audio path would
+ * be worse than a damaged recording.
+ */
+static bool
+recorder_output_write(struct recorder_output *recorder,
+		      const void *data, size_t length, GError **error_r)
+{
+	if (recorder->thread == NULL)
+		return recorder_output_write_file(recorder, data, length,
+						  error_r);
+
+	g_mutex_lock(recorder->mutex);
+
+	if (recorder->write_error != NULL) {
+		g_propagate_error(error_r, recorder->write_error);
+		recorder->write_error = NULL;
+		g_mutex_unlock(recorder->mutex);
+		return false;
+	}
+
+	size_t free_space = recorder->ring_size - recorder->fill;
+	if (length > free_space) {
+		if (!recorder->overflow) {
+			recorder->overflow = true;
+			g_warning("The write buffer for '%s' is full; "
+				  "discarding data", recorder->path);
+		}
+
+		length = free_space;
+	} else
+		recorder->overflow = false;
+
+	size_t tail = (recorder->head + recorder->fill) % recorder->ring_size;
+	size_t trailer_length = recorder->ring_size - tail;
+	if (length > trailer_length) {
+		memcpy(recorder->ring + tail, data, trailer_length);
+		memcpy(recorder->ring, (const char *)data + trailer_length,
+		       length - trailer_length);
+	} else
+		memcpy(recorder->ring + tail, data, length);
+
+	recorder->fill += length;
+
+	g_cond_signal(recorder->cond);
+	g_mutex_unlock(recorder->mutex);
+
+	return true;
+}
+
+/**
+ * Writes pending data from the encoder to the output file.
+ */
+static bool
+recorder_output_encoder_to_file(struct recorder_output *recorder,
+			      GError **error_r)
+{
+	size_t size;
+
+	assert(recorder->fd >= 0);
+
+	/* read from the encoder */
+
+	size = encoder_read(recorder->encoder, recorder->buffer,
+			    sizeof(recorder->buffer));
+	if (size == 0)
+		return true;
+
+	/* hand it over to the writer thread */
+
+	return recorder_output_write(recorder, recorder->buffer, size,
+				     error_r);
 }
 
 static bool
@@ -192,6 +445,26 @@ recorder_output_open(struct audio_output *ao,
 		return false;
 	}
 
+	recorder->file_offset = 0;
+	recorder->alloc_end = 0;
+	recorder->overflow = false;
+
+	if (recorder->sync_interval > 0)
+		recorder->sync_timer = g_timer_new();
+
+	/* start the writer thread */
+
+	recorder->ring = g_malloc(recorder->ring_size);
+	recorder->head = 0;
+	recorder->fill = 0;
+	recorder->stop = false;
+
+	recorder->thread = g_thread_create(recorder_writer_task, recorder,
+					   true, NULL);
+	if (recorder->thread == NULL)
+		g_warning("Failed to spawn writer thread; "
+			  "writing synchronously");
+
 	return true;
 }
 
@@ -205,9 +478,40 @@ recorder_output_close(struct audio_output *ao)
 	if (encoder_flush(recorder->encoder, NULL))
 		recorder_output_encoder_to_file(recorder, NULL);
 
+	encoder_close(recorder->encoder);
+
+	/* drain the ring and stop the writer thread */
+
+	if (recorder->thread != NULL) {
+		g_mutex_lock(recorder->mutex);
+		recorder->stop = true;
+		g_cond_signal(recorder->cond);
+		g_mutex_unlock(recorder->mutex);
+
+		g_thread_join(recorder->thread);
+		recorder->thread = NULL;
+	}
+
+	g_free(recorder->ring);
+	recorder->ring = NULL;
+
+	if (recorder->write_error != NULL) {
+		g_warning("%s", recorder->write_error->message);
+		g_error_free(recorder->write_error);
+		recorder->write_error = NULL;
+	}
+
+	if (recorder->sync_timer != NULL) {
+		g_timer_destroy(recorder->sync_timer);
+		recorder->sync_timer = NULL;
+	}
+
 	/* now really close everything */
 
-	encoder_close(recorder->encoder);
+	if (recorder->alloc_end > recorder->file_offset &&
+	    ftruncate(recorder->fd, recorder->file_offset) < 0)
+		g_warning("Failed to truncate '%s': %s",
+			  recorder->path, g_strerror(errno));
 
 	close(recorder->fd);
 }
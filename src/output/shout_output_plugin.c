@@ -22,6 +22,7 @@
 #include "output_api.h"
 #include "encoder_plugin.h"
 #include "encoder_list.h"
+#include "shared_encoder.h"
 #include "mpd_error.h"
 
 #include <shout/shout.h>
@@ -219,7 +220,10 @@ my_shout_init_driver(const struct config_param *param,
 		goto failure;
 	}
 
-	sd->encoder = encoder_init(encoder_plugin, param, error);
+	/* the codec runs in a separate thread, and outputs with
+	   identical quality settings share one codec instance; this
+	   output's thread only does network I/O */
+	sd->encoder = shared_encoder_new(encoder_plugin, param, error);
 	if (sd->encoder == NULL)
 		goto failure;
 
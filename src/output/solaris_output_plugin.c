@@ -21,12 +21,14 @@
 #include "solaris_output_plugin.h"
 #include "output_api.h"
 #include "fd_util.h"
+#include "fifo_buffer.h"
 
 #include <glib.h>
 
 #include <sys/stropts.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -53,6 +55,14 @@ struct audio_info {
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "solaris_output"
 
+/**
+ * The write size: the staging buffer accumulates music chunks until
+ * this many bytes can be submitted in one write(), to reduce the
+ * number of system calls.  The Solaris audio API does not expose the
+ * kernel's fragment size.
+ */
+#define SOLARIS_WRITE_SIZE 4096
+
 struct solaris_output {
 	struct audio_output base;
 
@@ -60,6 +70,19 @@ struct solaris_output {
 	const char *device;
 
 	int fd;
+
+	/**
+	 * The size of one frame in the current audio format.  The
+	 * number of bytes consumed by play() must be a multiple of
+	 * this.
+	 */
+	size_t frame_size;
+
+	/**
+	 * The staging buffer: it accumulates partial writes from
+	 * several music chunks.  NULL while the plugin is closed.
+	 */
+	struct fifo_buffer *buffer;
 };
 
 /**
@@ -91,6 +114,7 @@ solaris_output_init(const struct config_param *param, GError **error_r)
 	}
 
 	so->device = config_get_block_string(param, "device", "/dev/audio");
+	so->buffer = NULL;
 
 	return &so->base;
 }
@@ -155,6 +179,9 @@ solaris_output_open(struct audio_output *ao, struct audio_format *audio_format,
 		return false;
 	}
 
+	so->frame_size = audio_format_frame_size(audio_format);
+	so->buffer = fifo_buffer_new(SOLARIS_WRITE_SIZE * 2);
+
 	return true;
 }
 
@@ -164,6 +191,59 @@ solaris_output_close(struct audio_output *ao)
 	struct solaris_output *so = (struct solaris_output *)ao;
 
 	close(so->fd);
+
+	fifo_buffer_free(so->buffer);
+	so->buffer = NULL;
+}
+
+/**
+ * Writes the staging buffer to the device.  Unless @full is set, only
+ * multiples of #SOLARIS_WRITE_SIZE are written; the remainder stays
+ * in the buffer, waiting for the next chunk.  A partial write()
+ * simply continues from the unwritten offset.
+ */
+static bool
+solaris_output_flush(struct solaris_output *so, bool full, GError **error_r)
+{
+	size_t length;
+	const char *data = fifo_buffer_read(so->buffer, &length);
+	if (data == NULL)
+		return true;
+
+	if (!full)
+		length -= length % SOLARIS_WRITE_SIZE;
+
+	while (length > 0) {
+		ssize_t nbytes = write(so->fd, data, length);
+		if (nbytes < 0) {
+			if (errno == EINTR)
+				continue;
+
+			g_set_error(error_r, solaris_output_quark(), errno,
+				    "Write failed: %s", g_strerror(errno));
+			return false;
+		}
+
+		fifo_buffer_consume(so->buffer, nbytes);
+		data += nbytes;
+		length -= nbytes;
+	}
+
+	return true;
+}
+
+static void
+solaris_output_drain(struct audio_output *ao)
+{
+	struct solaris_output *so = (struct solaris_output *)ao;
+	GError *error = NULL;
+
+	/* write the partial block which is still in the staging
+	   buffer */
+	if (!solaris_output_flush(so, true, &error)) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+	}
 }
 
 static size_t
@@ -171,16 +251,34 @@ solaris_output_play(struct audio_output *ao, const void *chunk, size_t size,
 		    GError **error)
 {
 	struct solaris_output *so = (struct solaris_output *)ao;
-	ssize_t nbytes;
 
-	nbytes = write(so->fd, chunk, size);
-	if (nbytes <= 0) {
-		g_set_error(error, solaris_output_quark(), errno,
-			    "Write failed: %s", g_strerror(errno));
-		return 0;
-	}
+	while (true) {
+		size_t max_length;
+		void *p = fifo_buffer_write(so->buffer, &max_length);
+
+		size_t nbytes = size;
+		if (nbytes > max_length)
+			/* the return value must be a multiple of the
+			   frame size */
+			nbytes = max_length - max_length % so->frame_size;
+
+		if (nbytes == 0) {
+			/* staging buffer full: write a block to make
+			   room */
+			if (!solaris_output_flush(so, false, error))
+				return 0;
+			continue;
+		}
+
+		memcpy(p, chunk, nbytes);
+		fifo_buffer_append(so->buffer, nbytes);
 
-	return nbytes;
+		/* write out all whole blocks */
+		if (!solaris_output_flush(so, false, error))
+			return 0;
+
+		return nbytes;
+	}
 }
 
 static void
@@ -188,6 +286,8 @@ solaris_output_cancel(struct audio_output *ao)
 {
 	struct solaris_output *so = (struct solaris_output *)ao;
 
+	fifo_buffer_clear(so->buffer);
+
 	ioctl(so->fd, I_FLUSH);
 }
 
@@ -199,5 +299,6 @@ const struct audio_output_plugin solaris_output_plugin = {
 	.open = solaris_output_open,
 	.close = solaris_output_close,
 	.play = solaris_output_play,
+	.drain = solaris_output_drain,
 	.cancel = solaris_output_cancel,
 };
@@ -28,6 +28,7 @@
 #include "player_control.h"
 #include "mpd_error.h"
 #include "notify.h"
+#include "pcm_buffer.h"
 
 #ifndef NDEBUG
 #include "chunk.h"
@@ -60,6 +61,189 @@ static struct music_pipe *g_mp;
  */
 static float audio_output_all_elapsed_time = -1.0;
 
+/**
+ * A cache for converted chunk data, shared by all outputs: when
+ * several outputs apply the same trivial filter chain (just the
+ * "convert" filter) to the same chunk with the same target format,
+ * the first one stores its result here, and the others reuse it
+ * instead of converting the identical data again.
+ *
+ * Entries are keyed by the chunk pointer and the target format.  They
+ * are invalidated before the chunk is returned to the #music_buffer,
+ * because chunk structs are recycled.  The reference count pins an
+ * entry's buffer while an output is still playing from it.
+ */
+#define CONVERT_CACHE_SIZE 8
+
+struct convert_cache_entry {
+	/** the source chunk; NULL if this entry is invalid */
+	const struct music_chunk *chunk;
+
+	/** the target audio format */
+	struct audio_format format;
+
+	/** pins #buffer while greater than zero */
+	unsigned ref;
+
+	/** the sequence number of the last use, for eviction */
+	unsigned sequence;
+
+	struct pcm_buffer buffer;
+
+	/** the converted data (points into #buffer) */
+	const void *data;
+	size_t length;
+};
+
+static struct {
+	GMutex *mutex;
+
+	/** caching pays off only with more than one output */
+	bool enabled;
+
+	unsigned sequence;
+
+	struct convert_cache_entry entries[CONVERT_CACHE_SIZE];
+} convert_cache;
+
+bool
+audio_output_all_convert_cache_enabled(void)
+{
+	return convert_cache.enabled;
+}
+
+const void *
+audio_output_all_convert_cache_get(const struct music_chunk *chunk,
+				   const struct audio_format *format,
+				   size_t *length_r)
+{
+	if (!convert_cache.enabled)
+		return NULL;
+
+	const void *data = NULL;
+
+	g_mutex_lock(convert_cache.mutex);
+
+	for (unsigned i = 0; i < CONVERT_CACHE_SIZE; ++i) {
+		struct convert_cache_entry *entry = &convert_cache.entries[i];
+
+		if (entry->chunk == chunk &&
+		    audio_format_equals(&entry->format, format)) {
+			++entry->ref;
+			entry->sequence = ++convert_cache.sequence;
+			data = entry->data;
+			*length_r = entry->length;
+			break;
+		}
+	}
+
+	g_mutex_unlock(convert_cache.mutex);
+
+	return data;
+}
+
+void
+audio_output_all_convert_cache_put(const struct music_chunk *chunk,
+				   const struct audio_format *format,
+				   const void *data, size_t length)
+{
+	if (!convert_cache.enabled || length == 0)
+		return;
+
+	g_mutex_lock(convert_cache.mutex);
+
+	struct convert_cache_entry *victim = NULL;
+	for (unsigned i = 0; i < CONVERT_CACHE_SIZE; ++i) {
+		struct convert_cache_entry *entry = &convert_cache.entries[i];
+
+		if (entry->chunk == chunk &&
+		    audio_format_equals(&entry->format, format)) {
+			/* another output has stored this conversion
+			   meanwhile */
+			victim = NULL;
+			break;
+		}
+
+		if (entry->ref > 0)
+			/* the buffer is pinned by a reader */
+			continue;
+
+		if (victim == NULL ||
+		    (victim->chunk != NULL &&
+		     (entry->chunk == NULL ||
+		      entry->sequence < victim->sequence)))
+			victim = entry;
+	}
+
+	if (victim != NULL) {
+		void *dest = pcm_buffer_get(&victim->buffer, length);
+		memcpy(dest, data, length);
+
+		victim->chunk = chunk;
+		victim->format = *format;
+		victim->sequence = ++convert_cache.sequence;
+		victim->data = dest;
+		victim->length = length;
+	}
+
+	g_mutex_unlock(convert_cache.mutex);
+}
+
+void
+audio_output_all_convert_cache_release(const void *data)
+{
+	g_mutex_lock(convert_cache.mutex);
+
+	for (unsigned i = 0; i < CONVERT_CACHE_SIZE; ++i) {
+		struct convert_cache_entry *entry = &convert_cache.entries[i];
+
+		if (entry->data == data) {
+			assert(entry->ref > 0);
+			--entry->ref;
+			break;
+		}
+	}
+
+	g_mutex_unlock(convert_cache.mutex);
+}
+
+/**
+ * Invalidates all cache entries for this chunk.  Must be called
+ * before the chunk is returned to the #music_buffer.
+ */
+static void
+convert_cache_invalidate(const struct music_chunk *chunk)
+{
+	if (!convert_cache.enabled)
+		return;
+
+	g_mutex_lock(convert_cache.mutex);
+
+	for (unsigned i = 0; i < CONVERT_CACHE_SIZE; ++i)
+		if (convert_cache.entries[i].chunk == chunk)
+			convert_cache.entries[i].chunk = NULL;
+
+	g_mutex_unlock(convert_cache.mutex);
+}
+
+/**
+ * Invalidates the whole cache.  Must be called whenever the pipe is
+ * cleared.
+ */
+static void
+convert_cache_flush(void)
+{
+	if (!convert_cache.enabled)
+		return;
+
+	g_mutex_lock(convert_cache.mutex);
+
+	for (unsigned i = 0; i < CONVERT_CACHE_SIZE; ++i)
+		convert_cache.entries[i].chunk = NULL;
+
+	g_mutex_unlock(convert_cache.mutex);
+}
+
 unsigned int audio_output_count(void)
 {
 	return num_audio_outputs;
@@ -75,6 +259,16 @@ audio_output_get(unsigned i)
 	return audio_outputs[i];
 }
 
+bool
+audio_output_all_uses_replay_gain(void)
+{
+	for (unsigned i = 0; i < num_audio_outputs; ++i)
+		if (audio_output_get(i)->replay_gain_filter != NULL)
+			return true;
+
+	return false;
+}
+
 struct audio_output *
 audio_output_find(const char *name)
 {
@@ -114,6 +308,11 @@ audio_output_all_init(struct player_control *pc)
 	num_audio_outputs = audio_output_config_count();
 	audio_outputs = g_new(struct audio_output *, num_audio_outputs);
 
+	convert_cache.mutex = g_mutex_new();
+	convert_cache.enabled = num_audio_outputs > 1;
+	for (i = 0; i < CONVERT_CACHE_SIZE; ++i)
+		pcm_buffer_init(&convert_cache.entries[i].buffer);
+
 	for (i = 0; i < num_audio_outputs; i++)
 	{
 		unsigned int j;
@@ -149,6 +348,10 @@ audio_output_all_finish(void)
 {
 	unsigned int i;
 
+	for (i = 0; i < CONVERT_CACHE_SIZE; ++i)
+		pcm_buffer_deinit(&convert_cache.entries[i].buffer);
+	g_mutex_free(convert_cache.mutex);
+
 	for (i = 0; i < num_audio_outputs; i++) {
 		audio_output_disable(audio_outputs[i]);
 		audio_output_finish(audio_outputs[i]);
@@ -164,21 +367,50 @@ audio_output_all_finish(void)
 void
 audio_output_all_enable_disable(void)
 {
+	bool pending[num_audio_outputs];
+
+	/* send the ENABLE/DISABLE commands to all outputs first, then
+	   wait; this way, the output threads carry them out
+	   concurrently, and one slow backend does not delay the
+	   others */
+
 	for (unsigned i = 0; i < num_audio_outputs; i++) {
 		struct audio_output *ao = audio_outputs[i];
 		bool enabled;
 
+		pending[i] = false;
+
 		g_mutex_lock(ao->mutex);
 		enabled = ao->really_enabled;
 		g_mutex_unlock(ao->mutex);
 
-		if (ao->enabled != enabled) {
-			if (ao->enabled)
-				audio_output_enable(ao);
-			else
-				audio_output_disable(ao);
-		}
+		if (ao->enabled != enabled)
+			pending[i] = ao->enabled
+				? audio_output_enable_async(ao)
+				: audio_output_disable_async(ao);
+	}
+
+	for (unsigned i = 0; i < num_audio_outputs; i++)
+		if (pending[i])
+			audio_output_wait_command(audio_outputs[i]);
+}
+
+bool
+audio_output_all_supports_sample_format(enum sample_format sample_format)
+{
+	for (unsigned i = 0; i < num_audio_outputs; ++i) {
+		const struct audio_output *ao = audio_outputs[i];
+
+		if (!ao->enabled)
+			continue;
+
+		const struct audio_format *f = &ao->config_audio_format;
+		if (f->format != SAMPLE_FORMAT_UNDEFINED &&
+		    (enum sample_format)f->format != sample_format)
+			return false;
 	}
+
+	return true;
 }
 
 /**
@@ -256,15 +488,29 @@ audio_output_all_reset_reopen(void)
 static bool
 audio_output_all_update(void)
 {
+	bool pending[num_audio_outputs];
 	unsigned int i;
 	bool ret = false;
 
 	if (!audio_format_defined(&input_audio_format))
 		return false;
 
+	/* two phases: first submit the open commands to all outputs,
+	   then collect the results; the devices open concurrently on
+	   their output threads, and the total wait is bounded by the
+	   slowest output instead of the sum of all of them */
+
+	for (i = 0; i < num_audio_outputs; ++i)
+		pending[i] = audio_output_update_async(audio_outputs[i],
+						       &input_audio_format,
+						       g_mp);
+
 	for (i = 0; i < num_audio_outputs; ++i)
-		ret = audio_output_update(audio_outputs[i],
-					  &input_audio_format, g_mp) || ret;
+		if (pending[i])
+			ret = audio_output_update_finish(audio_outputs[i]) ||
+				ret;
+		else
+			ret = audio_outputs[i]->open || ret;
 
 	return ret;
 }
@@ -311,7 +557,9 @@ audio_output_all_open(const struct audio_format *audio_format,
 	assert(g_mp == NULL || music_pipe_check_format(g_mp, audio_format));
 
 	if (g_mp == NULL)
-		g_mp = music_pipe_new();
+		/* push and shift happen in the player thread only;
+		   the chunk chain is followed by the output threads */
+		g_mp = music_pipe_new(music_buffer_size(buffer), true);
 	else
 		/* if the pipe hasn't been cleared, the the audio
 		   format must not have changed */
@@ -458,6 +706,7 @@ audio_output_all_check(void)
 					g_mutex_unlock(audio_outputs[i]->mutex);
 
 		/* return the chunk to the buffer */
+		convert_cache_invalidate(shifted);
 		music_buffer_return(g_music_buffer, shifted);
 	}
 
@@ -516,6 +765,8 @@ audio_output_all_cancel(void)
 
 	/* clear the music pipe and return all chunks to the buffer */
 
+	convert_cache_flush();
+
 	if (g_mp != NULL)
 		music_pipe_clear(g_mp, g_music_buffer);
 
@@ -537,6 +788,8 @@ audio_output_all_close(void)
 	for (i = 0; i < num_audio_outputs; ++i)
 		audio_output_close(audio_outputs[i]);
 
+	convert_cache_flush();
+
 	if (g_mp != NULL) {
 		assert(g_music_buffer != NULL);
 
@@ -560,6 +813,8 @@ audio_output_all_release(void)
 	for (i = 0; i < num_audio_outputs; ++i)
 		audio_output_release(audio_outputs[i]);
 
+	convert_cache_flush();
+
 	if (g_mp != NULL) {
 		assert(g_music_buffer != NULL);
 
@@ -26,6 +26,8 @@
 #ifndef OUTPUT_ALL_H
 #define OUTPUT_ALL_H
 
+#include "audio_format.h"
+
 #include <stdbool.h>
 #include <stddef.h>
 
@@ -66,6 +68,15 @@ audio_output_get(unsigned i);
 struct audio_output *
 audio_output_find(const char *name);
 
+/**
+ * Does at least one output apply replay gain itself (i.e. has a
+ * "replay_gain_handler" other than "none")?  While this is the case,
+ * cross-faded chunks must be delivered unmixed, because the two songs
+ * may carry different gains.
+ */
+bool
+audio_output_all_uses_replay_gain(void);
+
 /**
  * Checks the "enabled" flag of all audio outputs, and if one has
  * changed, commit the change.
@@ -110,6 +121,58 @@ audio_output_all_release(void);
 bool
 audio_output_all_play(struct music_chunk *chunk);
 
+/**
+ * Is the shared conversion cache in use?  (It is enabled only with
+ * more than one configured output.)  The output threads prefer
+ * per-chunk filtering over batch filtering while it is, so conversion
+ * results can be shared.
+ */
+bool
+audio_output_all_convert_cache_enabled(void);
+
+/**
+ * Looks up a previously converted version of this chunk in the shared
+ * conversion cache, and pins it with a reference.  Called by the
+ * output threads before running a trivial (conversion-only) filter
+ * chain.
+ *
+ * @param format the target audio format
+ * @param length_r the length of the cached data in bytes
+ * @return the converted data, or NULL if there is no cache entry; the
+ * caller must release it with audio_output_all_convert_cache_release()
+ */
+const void *
+audio_output_all_convert_cache_get(const struct music_chunk *chunk,
+				   const struct audio_format *format,
+				   size_t *length_r);
+
+/**
+ * Stores a conversion result in the shared cache (copying the data).
+ * No-op when only one output is configured or the cache is full of
+ * pinned entries.
+ */
+void
+audio_output_all_convert_cache_put(const struct music_chunk *chunk,
+				   const struct audio_format *format,
+				   const void *data, size_t length);
+
+/**
+ * Releases a reference obtained by
+ * audio_output_all_convert_cache_get().
+ */
+void
+audio_output_all_convert_cache_release(const void *data);
+
+/**
+ * Checks whether samples of the given format would reach all enabled
+ * outputs without a conversion, i.e. no output has configured a
+ * different sample format.  Decoders with a choice of output
+ * encodings use this to pick one which the pipeline can carry
+ * end-to-end.
+ */
+bool
+audio_output_all_supports_sample_format(enum sample_format sample_format);
+
 /**
  * Checks if the output devices have drained their music pipe, and
  * returns the consumed music chunks to the #music_buffer.
@@ -91,8 +91,8 @@ ao_lock_command(struct audio_output *ao, enum audio_output_command cmd)
 	g_mutex_unlock(ao->mutex);
 }
 
-void
-audio_output_enable(struct audio_output *ao)
+bool
+audio_output_enable_async(struct audio_output *ao)
 {
 	if (ao->thread == NULL) {
 		if (ao->plugin->enable == NULL) {
@@ -100,17 +100,21 @@ audio_output_enable(struct audio_output *ao)
 			   device doesn't even have a enable() method;
 			   just assign the variable and we're done */
 			ao->really_enabled = true;
-			return;
+			return false;
 		}
 
 		audio_output_thread_start(ao);
 	}
 
-	ao_lock_command(ao, AO_COMMAND_ENABLE);
+	g_mutex_lock(ao->mutex);
+	ao_command_async(ao, AO_COMMAND_ENABLE);
+	g_mutex_unlock(ao->mutex);
+
+	return true;
 }
 
-void
-audio_output_disable(struct audio_output *ao)
+bool
+audio_output_disable_async(struct audio_output *ao)
 {
 	if (ao->thread == NULL) {
 		if (ao->plugin->disable == NULL)
@@ -120,22 +124,52 @@ audio_output_disable(struct audio_output *ao)
 			   be enabled */
 			assert(!ao->really_enabled);
 
-		return;
+		return false;
 	}
 
-	ao_lock_command(ao, AO_COMMAND_DISABLE);
+	g_mutex_lock(ao->mutex);
+	ao_command_async(ao, AO_COMMAND_DISABLE);
+	g_mutex_unlock(ao->mutex);
+
+	return true;
+}
+
+void
+audio_output_wait_command(struct audio_output *ao)
+{
+	g_mutex_lock(ao->mutex);
+	ao_command_wait(ao);
+	g_mutex_unlock(ao->mutex);
+}
+
+void
+audio_output_enable(struct audio_output *ao)
+{
+	if (audio_output_enable_async(ao))
+		audio_output_wait_command(ao);
+}
+
+void
+audio_output_disable(struct audio_output *ao)
+{
+	if (audio_output_disable_async(ao))
+		audio_output_wait_command(ao);
 }
 
 /**
- * Object must be locked (and unlocked) by the caller.
+ * Like the old synchronous open, but sends the OPEN/REOPEN command
+ * without waiting for completion; this allows several output threads
+ * to open their devices concurrently.  Object must be locked (and
+ * unlocked) by the caller.
+ *
+ * @return true if a command was sent, and the caller must invoke
+ * audio_output_update_finish()
  */
 static bool
-audio_output_open(struct audio_output *ao,
-		  const struct audio_format *audio_format,
-		  const struct music_pipe *mp)
+audio_output_open_async(struct audio_output *ao,
+			const struct audio_format *audio_format,
+			const struct music_pipe *mp)
 {
-	bool open;
-
 	assert(ao != NULL);
 	assert(ao->allow_play);
 	assert(audio_format_valid(audio_format));
@@ -165,7 +199,7 @@ audio_output_open(struct audio_output *ao,
 			ao_command(ao, AO_COMMAND_CANCEL);
 		}
 
-		return true;
+		return false;
 	}
 
 	ao->in_audio_format = *audio_format;
@@ -176,20 +210,8 @@ audio_output_open(struct audio_output *ao,
 	if (ao->thread == NULL)
 		audio_output_thread_start(ao);
 
-	ao_command(ao, ao->open ? AO_COMMAND_REOPEN : AO_COMMAND_OPEN);
-	open = ao->open;
-
-	if (open && ao->mixer != NULL) {
-		GError *error = NULL;
-
-		if (!mixer_open(ao->mixer, &error)) {
-			g_warning("Failed to open mixer for '%s': %s",
-				  ao->name, error->message);
-			g_error_free(error);
-		}
-	}
-
-	return open;
+	ao_command_async(ao, ao->open ? AO_COMMAND_REOPEN : AO_COMMAND_OPEN);
+	return true;
 }
 
 /**
@@ -216,31 +238,61 @@ audio_output_close_locked(struct audio_output *ao)
 }
 
 bool
-audio_output_update(struct audio_output *ao,
-		    const struct audio_format *audio_format,
-		    const struct music_pipe *mp)
+audio_output_update_async(struct audio_output *ao,
+			  const struct audio_format *audio_format,
+			  const struct music_pipe *mp)
 {
+	bool pending = false;
+
 	assert(mp != NULL);
 
 	g_mutex_lock(ao->mutex);
 
 	if (ao->enabled && ao->really_enabled) {
 		if (ao->fail_timer == NULL ||
-		    g_timer_elapsed(ao->fail_timer, NULL) > REOPEN_AFTER) {
-			bool success = audio_output_open(ao, audio_format, mp);
-			g_mutex_unlock(ao->mutex);
-			return success;
-		}
+		    g_timer_elapsed(ao->fail_timer, NULL) > REOPEN_AFTER)
+			pending = audio_output_open_async(ao, audio_format,
+							  mp);
 	} else if (audio_output_is_open(ao))
 		audio_output_close_locked(ao);
 
 	g_mutex_unlock(ao->mutex);
-	return false;
+	return pending;
+}
+
+bool
+audio_output_update_finish(struct audio_output *ao)
+{
+	bool open;
+
+	g_mutex_lock(ao->mutex);
+	ao_command_wait(ao);
+	open = ao->open;
+	g_mutex_unlock(ao->mutex);
+
+	if (open && ao->mixer != NULL) {
+		GError *error = NULL;
+
+		if (!mixer_open(ao->mixer, &error)) {
+			g_warning("Failed to open mixer for '%s': %s",
+				  ao->name, error->message);
+			g_error_free(error);
+		}
+	}
+
+	return open;
 }
 
 void
 audio_output_play(struct audio_output *ao)
 {
+	if (!g_atomic_int_get(&ao->sleeping))
+		/* the output thread is busy draining the pipe and
+		   will pick up the new chunk on its own; the thread
+		   re-checks the pipe before going to sleep, so this
+		   cannot lose a wakeup */
+		return;
+
 	g_mutex_lock(ao->mutex);
 
 	assert(ao->allow_play);
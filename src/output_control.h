@@ -43,6 +43,15 @@ audio_output_quark(void)
 void
 audio_output_enable(struct audio_output *ao);
 
+/**
+ * Like audio_output_enable(), but does not wait for completion.
+ *
+ * @return true if a command was sent, and the caller must invoke
+ * audio_output_wait_command()
+ */
+bool
+audio_output_enable_async(struct audio_output *ao);
+
 /**
  * Disables the device.
  */
@@ -50,14 +59,43 @@ void
 audio_output_disable(struct audio_output *ao);
 
 /**
- * Opens or closes the device, depending on the "enabled" flag.
+ * Like audio_output_disable(), but does not wait for completion.
+ *
+ * @return true if a command was sent, and the caller must invoke
+ * audio_output_wait_command()
+ */
+bool
+audio_output_disable_async(struct audio_output *ao);
+
+/**
+ * Waits until the output thread has completed the command sent by one
+ * of the _async() functions.
+ */
+void
+audio_output_wait_command(struct audio_output *ao);
+
+/**
+ * Opens or closes the device, depending on the "enabled" flag, but
+ * does not wait for completion; this allows several output threads to
+ * open their devices concurrently, so one slow backend does not delay
+ * the others.
+ *
+ * @return true if an open command was sent, and the caller must
+ * invoke audio_output_update_finish()
+ */
+bool
+audio_output_update_async(struct audio_output *ao,
+			  const struct audio_format *audio_format,
+			  const struct music_pipe *mp);
+
+/**
+ * Waits for the command sent by audio_output_update_async() and opens
+ * the mixer if the device is now open.
  *
  * @return true if the device is open
  */
 bool
-audio_output_update(struct audio_output *ao,
-		    const struct audio_format *audio_format,
-		    const struct music_pipe *mp);
+audio_output_update_finish(struct audio_output *ao);
 
 void
 audio_output_play(struct audio_output *ao);
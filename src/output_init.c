@@ -37,6 +37,7 @@
 #include <glib.h>
 
 #include <assert.h>
+#include <string.h>
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "output"
@@ -119,6 +120,12 @@ audio_output_load_mixer(struct audio_output *ao,
 
 		filter_chain_append(filter_chain,
 				    software_mixer_get_filter(mixer));
+
+		/* the volume filter modifies the data */
+		ao->conversion_only = false;
+
+		ao->fused_volume_filter = software_mixer_get_filter(mixer);
+
 		return mixer;
 	}
 
@@ -175,6 +182,10 @@ ao_base_init(struct audio_output *ao,
 	ao->pause = false;
 	ao->allow_play = true;
 	ao->fail_timer = NULL;
+	ao->underruns = 0;
+	ao->sleeping = 0;
+	ao->play_timer = NULL;
+	memset(&ao->stats, 0, sizeof(ao->stats));
 
 	pcm_buffer_init(&ao->cross_fade_buffer);
 
@@ -183,6 +194,10 @@ ao_base_init(struct audio_output *ao,
 	ao->filter = filter_chain_new();
 	assert(ao->filter != NULL);
 
+	ao->conversion_only = true;
+	ao->convert_cache_lease = NULL;
+	ao->fused_volume_filter = NULL;
+
 	/* create the normalization filter (if configured) */
 
 	if (config_get_bool(CONF_VOLUME_NORMALIZATION, false)) {
@@ -192,12 +207,15 @@ ao_base_init(struct audio_output *ao,
 
 		filter_chain_append(ao->filter,
 				    autoconvert_filter_new(normalize_filter));
+
+		ao->conversion_only = false;
 	}
 
-	filter_chain_parse(ao->filter,
-	                   config_get_block_string(param, AUDIO_FILTERS, ""),
-	                   &error
-	);
+	const char *filters = config_get_block_string(param, AUDIO_FILTERS, "");
+	if (*filters != 0)
+		ao->conversion_only = false;
+
+	filter_chain_parse(ao->filter, filters, &error);
 
 	// It's not really fatal - Part of the filter chain has been set up already
 	// and even an empty one will work (if only with unexpected behaviour)
@@ -283,6 +301,19 @@ audio_output_setup(struct audio_output *ao, const struct config_param *param,
 		return false;
 	}
 
+	/* fuse software replay gain into the software mixer's volume
+	   filter?  Both are plain linear gains, and one pcm_volume()
+	   pass can apply their product */
+
+	if (ao->fused_volume_filter != NULL &&
+	    (ao->replay_gain_filter == NULL ||
+	     strcmp(replay_gain_handler, "software") != 0))
+		ao->fused_volume_filter = NULL;
+
+	if (ao->fused_volume_filter != NULL)
+		replay_gain_filter_set_volume_filter(ao->replay_gain_filter,
+						     ao->fused_volume_filter);
+
 	return true;
 }
 
@@ -25,6 +25,7 @@
 
 #include <glib.h>
 
+#include <stdint.h>
 #include <time.h>
 
 struct config_param;
@@ -121,6 +122,14 @@ struct audio_output {
 	 */
 	GTimer *fail_timer;
 
+	/**
+	 * The number of buffer underruns (or comparable device
+	 * misses) observed on this output.  Incremented by the plugin
+	 * via ao_underrun() in the output thread; saved to the state
+	 * file, so buffer auto-tuning can learn across restarts.
+	 */
+	unsigned underruns;
+
 	/**
 	 * The configured audio format.
 	 */
@@ -176,6 +185,16 @@ struct audio_output {
 	 */
 	unsigned other_replay_gain_serial;
 
+	/**
+	 * The software mixer's volume filter, if the replay gain may
+	 * be fused into it (replay_gain_handler "software" and a
+	 * software mixer); NULL otherwise.  The output thread links
+	 * and unlinks it with #replay_gain_filter per chunk, because
+	 * the fused single-pass path cannot be used while
+	 * cross-fading.
+	 */
+	struct filter *fused_volume_filter;
+
 	/**
 	 * The convert_filter_plugin instance of this audio output.
 	 * It is the last item in the filter chain, and is responsible
@@ -184,6 +203,19 @@ struct audio_output {
 	 */
 	struct filter *convert_filter;
 
+	/**
+	 * Is #filter a trivial chain consisting of nothing but the
+	 * #convert_filter?  Only then may this output use the shared
+	 * conversion cache in output_all.c.
+	 */
+	bool conversion_only;
+
+	/**
+	 * The conversion cache entry currently pinned by this output,
+	 * or NULL.  Only the output thread touches this.
+	 */
+	const void *convert_cache_lease;
+
 	/**
 	 * The thread handle, or NULL if the output thread isn't
 	 * running.
@@ -230,6 +262,56 @@ struct audio_output {
 	 * Has the output finished playing #chunk?
 	 */
 	bool chunk_finished;
+
+	/**
+	 * Is the output thread asleep in g_cond_wait()?  Accessed
+	 * with atomic operations (without #mutex), so
+	 * audio_output_play() can skip the mutex and the wakeup
+	 * entirely while the thread is busy draining the pipe.
+	 */
+	gint sleeping;
+
+	/**
+	 * Estimates the deadline by which the device will have
+	 * consumed all data submitted so far, based on the nominal
+	 * sample rate.  Only used by the output thread; NULL while
+	 * the device is closed.
+	 */
+	struct timer *play_timer;
+
+	/**
+	 * Performance counters.  The output thread increments them
+	 * while holding the #mutex; the "outputstats" command reads
+	 * them.
+	 */
+	struct {
+		/**
+		 * The number of times the output thread has been
+		 * woken up from its idle sleep.
+		 */
+		uint64_t wakeups;
+
+		/**
+		 * The number of times the play deadline was missed,
+		 * i.e. the device had (nominally) consumed all
+		 * submitted data before the next batch of chunks
+		 * arrived.  This is an estimate: the device's real
+		 * buffer fill is not visible here.
+		 */
+		uint64_t underruns;
+
+		/**
+		 * The number of chunk batches played.  Each wakeup
+		 * drains all chunks which are available at that
+		 * time.
+		 */
+		uint64_t batches;
+
+		/**
+		 * The total number of chunks played.
+		 */
+		uint64_t chunks;
+	} stats;
 };
 
 /**
@@ -250,6 +332,16 @@ audio_output_command_is_finished(const struct audio_output *ao)
 	return ao->command == AO_COMMAND_NONE;
 }
 
+/**
+ * Records one buffer underrun on this output.  To be called by the
+ * plugin from the output thread.
+ */
+static inline void
+ao_underrun(struct audio_output *ao)
+{
+	++ao->underruns;
+}
+
 struct audio_output *
 audio_output_new(const struct config_param *param,
 		 struct player_control *pc,
@@ -60,6 +60,13 @@ ao_plugin_open(struct audio_output *ao, struct audio_format *audio_format,
 	return ao->plugin->open(ao, audio_format, error);
 }
 
+bool
+ao_plugin_reopen(struct audio_output *ao, struct audio_format *audio_format,
+		 GError **error)
+{
+	return ao->plugin->reopen(ao, audio_format, error);
+}
+
 void
 ao_plugin_close(struct audio_output *ao)
 {
@@ -92,6 +92,21 @@ struct audio_output_plugin {
 	bool (*open)(struct audio_output *data, struct audio_format *audio_format,
 		     GError **error);
 
+	/**
+	 * Renegotiate the device for a new audio format without
+	 * closing it.  The old stream has been drained when this is
+	 * called.  This method is optional; if it is not implemented
+	 * or fails, the device is closed and reopened instead.
+	 *
+	 * @param audio_format the new audio format in which data is
+	 * going to be delivered; may be modified by the plugin
+	 * @param error location to store the error occurring, or NULL
+	 * to ignore errors
+	 */
+	bool (*reopen)(struct audio_output *data,
+		       struct audio_format *audio_format,
+		       GError **error);
+
 	/**
 	 * Close the device.
 	 */
@@ -184,6 +199,10 @@ bool
 ao_plugin_open(struct audio_output *ao, struct audio_format *audio_format,
 	       GError **error);
 
+bool
+ao_plugin_reopen(struct audio_output *ao, struct audio_format *audio_format,
+		 GError **error);
+
 void
 ao_plugin_close(struct audio_output *ao);
 
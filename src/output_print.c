@@ -43,3 +43,28 @@ printAudioDevices(struct client *client)
 			      i, ao->name, ao->enabled);
 	}
 }
+
+void
+printAudioOutputStats(struct client *client)
+{
+	unsigned n = audio_output_count();
+
+	for (unsigned i = 0; i < n; ++i) {
+		struct audio_output *ao = audio_output_get(i);
+
+		g_mutex_lock(ao->mutex);
+		client_printf(client,
+			      "outputid: %i\n"
+			      "outputname: %s\n"
+			      "wakeups: %"G_GUINT64_FORMAT"\n"
+			      "underruns: %"G_GUINT64_FORMAT"\n"
+			      "batches: %"G_GUINT64_FORMAT"\n"
+			      "chunks: %"G_GUINT64_FORMAT"\n",
+			      i, ao->name,
+			      ao->stats.wakeups,
+			      ao->stats.underruns,
+			      ao->stats.batches,
+			      ao->stats.chunks);
+		g_mutex_unlock(ao->mutex);
+	}
+}
@@ -30,4 +30,7 @@ struct client;
 void
 printAudioDevices(struct client *client);
 
+void
+printAudioOutputStats(struct client *client);
+
 #endif
@@ -34,6 +34,7 @@
 #include <string.h>
 
 #define AUDIO_DEVICE_STATE "audio_device_state:"
+#define AUDIO_DEVICE_UNDERRUNS "audio_device_underruns:"
 
 unsigned audio_output_state_version;
 
@@ -49,7 +50,36 @@ audio_output_state_save(FILE *fp)
 
 		fprintf(fp, AUDIO_DEVICE_STATE "%d:%s\n",
 			ao->enabled, ao->name);
+
+		if (ao->underruns > 0)
+			/* underrun telemetry, so buffer auto-tuning
+			   does not start from scratch after a
+			   restart */
+			fprintf(fp, AUDIO_DEVICE_UNDERRUNS "%u:%s\n",
+				ao->underruns, ao->name);
+	}
+}
+
+/**
+ * Parses an #AUDIO_DEVICE_UNDERRUNS line; the prefix has already been
+ * matched by the caller.
+ */
+static bool
+audio_output_underruns_read(const char *line)
+{
+	char *endptr;
+	long value = strtol(line, &endptr, 10);
+	if (*endptr != ':' || value < 0)
+		return false;
+
+	struct audio_output *ao = audio_output_find(endptr + 1);
+	if (ao == NULL) {
+		g_debug("Ignoring underrun count for '%s'", endptr + 1);
+		return true;
 	}
+
+	ao->underruns = (unsigned)value;
+	return true;
 }
 
 bool
@@ -60,6 +90,10 @@ audio_output_state_read(const char *line)
 	const char *name;
 	struct audio_output *ao;
 
+	if (g_str_has_prefix(line, AUDIO_DEVICE_UNDERRUNS))
+		return audio_output_underruns_read(line +
+						   sizeof(AUDIO_DEVICE_UNDERRUNS) - 1);
+
 	if (!g_str_has_prefix(line, AUDIO_DEVICE_STATE))
 		return false;
 
@@ -21,6 +21,7 @@
 #include "output_thread.h"
 #include "output_api.h"
 #include "output_internal.h"
+#include "output_all.h"
 #include "chunk.h"
 #include "pipe.h"
 #include "player_control.h"
@@ -30,6 +31,8 @@
 #include "filter/replay_gain_filter_plugin.h"
 #include "mpd_error.h"
 #include "notify.h"
+#include "perf.h"
+#include "timer.h"
 
 #include <glib.h>
 
@@ -192,6 +195,9 @@ ao_open(struct audio_output *ao)
 
 	convert_filter_set(ao->convert_filter, &ao->out_audio_format);
 
+	assert(ao->play_timer == NULL);
+	ao->play_timer = timer_new(&ao->out_audio_format);
+
 	ao->open = true;
 
 	g_debug("opened plugin=%s name=\"%s\" "
@@ -216,6 +222,9 @@ ao_close(struct audio_output *ao, bool drain)
 	ao->chunk = NULL;
 	ao->open = false;
 
+	timer_free(ao->play_timer);
+	ao->play_timer = NULL;
+
 	g_mutex_unlock(ao->mutex);
 
 	if (drain)
@@ -252,6 +261,9 @@ ao_reopen_filter(struct audio_output *ao)
 
 		ao->chunk = NULL;
 		ao->open = false;
+
+		timer_free(ao->play_timer);
+		ao->play_timer = NULL;
 		ao->fail_timer = g_timer_new();
 
 		g_mutex_unlock(ao->mutex);
@@ -264,11 +276,52 @@ ao_reopen_filter(struct audio_output *ao)
 	convert_filter_set(ao->convert_filter, &ao->out_audio_format);
 }
 
+/**
+ * Renegotiates the open device for the new input audio format without
+ * closing it: drains the old stream, so the switch happens on a chunk
+ * boundary, and asks the plugin to apply the new hardware parameters.
+ *
+ * @return true on success, false if the caller must fall back to
+ * close/open
+ */
+static bool
+ao_reopen_in_place(struct audio_output *ao)
+{
+	struct audio_format audio_format = ao->in_audio_format;
+	audio_format_mask_apply(&audio_format, &ao->config_audio_format);
+
+	GError *error = NULL;
+
+	g_mutex_unlock(ao->mutex);
+	ao_plugin_drain(ao);
+	bool success = ao_plugin_reopen(ao, &audio_format, &error);
+	g_mutex_lock(ao->mutex);
+
+	if (!success) {
+		g_warning("Failed to reconfigure \"%s\" [%s]: %s",
+			  ao->name, ao->plugin->name, error->message);
+		g_error_free(error);
+		return false;
+	}
+
+	ao->out_audio_format = audio_format;
+	return true;
+}
+
 static void
 ao_reopen(struct audio_output *ao)
 {
 	if (!audio_format_fully_defined(&ao->config_audio_format)) {
 		if (ao->open) {
+			if (ao->plugin->reopen != NULL &&
+			    ao_reopen_in_place(ao)) {
+				/* the device has accepted the new
+				   format; just reconfigure the filter
+				   chain and keep playing */
+				ao_reopen_filter(ao);
+				return;
+			}
+
 			const struct music_pipe *mp = ao->pipe;
 			ao_close(ao, true);
 			ao->pipe = mp;
@@ -361,6 +414,16 @@ ao_filter_chunk(struct audio_output *ao, const struct music_chunk *chunk,
 {
 	GError *error = NULL;
 
+	if (ao->fused_volume_filter != NULL)
+		/* cross-faded chunks carry two different gains, so
+		   the fused single-pass path cannot be used for them;
+		   otherwise, let the volume filter apply the replay
+		   gain in its own pcm_volume() pass */
+		replay_gain_filter_set_volume_filter(ao->replay_gain_filter,
+						     chunk->other == NULL
+						     ? ao->fused_volume_filter
+						     : NULL);
+
 	size_t length;
 	const char *data = ao_chunk_data(ao, chunk, ao->replay_gain_filter,
 					 &ao->replay_gain_serial, &length);
@@ -414,6 +477,26 @@ ao_filter_chunk(struct audio_output *ao, const struct music_chunk *chunk,
 
 	/* apply filter chain */
 
+	const bool cacheable = ao->conversion_only &&
+		chunk->other == NULL && data == chunk->data;
+	if (cacheable) {
+		/* the chunk reaches our trivial filter chain
+		   unmodified; maybe another output has already
+		   converted it to the same target format */
+		size_t cached_length;
+		const void *cached =
+			audio_output_all_convert_cache_get(chunk,
+							   &ao->out_audio_format,
+							   &cached_length);
+		if (cached != NULL) {
+			assert(ao->convert_cache_lease == NULL);
+			ao->convert_cache_lease = cached;
+
+			*length_r = cached_length;
+			return cached;
+		}
+	}
+
 	data = filter_filter(ao->filter, data, length, &length, &error);
 	if (data == NULL) {
 		g_warning("\"%s\" [%s] failed to filter: %s",
@@ -422,34 +505,38 @@ ao_filter_chunk(struct audio_output *ao, const struct music_chunk *chunk,
 		return NULL;
 	}
 
+	if (cacheable && data != chunk->data)
+		/* share the conversion result with the other
+		   outputs */
+		audio_output_all_convert_cache_put(chunk,
+						   &ao->out_audio_format,
+						   data, length);
+
 	*length_r = length;
 	return data;
 }
 
-static bool
-ao_play_chunk(struct audio_output *ao, const struct music_chunk *chunk)
+/**
+ * Releases the conversion cache entry pinned by ao_filter_chunk(), if
+ * any.
+ */
+static void
+ao_release_convert_cache(struct audio_output *ao)
 {
-	GError *error = NULL;
-
-	assert(ao != NULL);
-	assert(ao->filter != NULL);
-
-	if (chunk->tag != NULL) {
-		g_mutex_unlock(ao->mutex);
-		ao_plugin_send_tag(ao, chunk->tag);
-		g_mutex_lock(ao->mutex);
+	if (ao->convert_cache_lease != NULL) {
+		audio_output_all_convert_cache_release(ao->convert_cache_lease);
+		ao->convert_cache_lease = NULL;
 	}
+}
 
-	size_t size;
-	const char *data = ao_filter_chunk(ao, chunk, &size);
-	if (data == NULL) {
-		ao_close(ao, false);
-
-		/* don't automatically reopen this device for 10
-		   seconds */
-		ao->fail_timer = g_timer_new();
-		return false;
-	}
+/**
+ * Submits a block of filtered data to the device, until it is fully
+ * played or a command arrives.  On failure, the device is closed.
+ */
+static bool
+ao_play_data(struct audio_output *ao, const char *data, size_t size)
+{
+	GError *error = NULL;
 
 	while (size > 0 && ao->command == AO_COMMAND_NONE) {
 		size_t nbytes;
@@ -458,7 +545,9 @@ ao_play_chunk(struct audio_output *ao, const struct music_chunk *chunk)
 			break;
 
 		g_mutex_unlock(ao->mutex);
+		const uint64_t start = perf_begin();
 		nbytes = ao_plugin_play(ao, data, size, &error);
+		perf_end(PERF_OUTPUT_PLAY, start);
 		g_mutex_lock(ao->mutex);
 		if (nbytes == 0) {
 			/* play()==0 means failure */
@@ -472,13 +561,14 @@ ao_play_chunk(struct audio_output *ao, const struct music_chunk *chunk)
 			   10 seconds */
 			assert(ao->fail_timer == NULL);
 			ao->fail_timer = g_timer_new();
-
 			return false;
 		}
 
 		assert(nbytes <= size);
 		assert(nbytes % audio_format_frame_size(&ao->out_audio_format) == 0);
 
+		timer_add(ao->play_timer, nbytes);
+
 		data += nbytes;
 		size -= nbytes;
 	}
@@ -486,6 +576,164 @@ ao_play_chunk(struct audio_output *ao, const struct music_chunk *chunk)
 	return true;
 }
 
+static bool
+ao_play_chunk(struct audio_output *ao, const struct music_chunk *chunk)
+{
+	assert(ao != NULL);
+	assert(ao->filter != NULL);
+
+	if (chunk->tag != NULL) {
+		g_mutex_unlock(ao->mutex);
+		ao_plugin_send_tag(ao, chunk->tag);
+		g_mutex_lock(ao->mutex);
+	}
+
+#ifdef ENABLE_PERF_COUNTERS
+	if (chunk->stamp_ns != 0)
+		perf_histogram_add(PERF_LATENCY_DECODER_FILTER,
+				   perf_begin() - chunk->stamp_ns);
+#endif
+
+	size_t size;
+	const char *data = ao_filter_chunk(ao, chunk, &size);
+	if (data == NULL) {
+		ao_close(ao, false);
+
+		/* don't automatically reopen this device for 10
+		   seconds */
+		ao->fail_timer = g_timer_new();
+		return false;
+	}
+
+	bool success = ao_play_data(ao, data, size);
+	ao_release_convert_cache(ao);
+
+#ifdef ENABLE_PERF_COUNTERS
+	if (success && chunk->stamp_ns != 0)
+		perf_histogram_add(PERF_LATENCY_DECODER_OUTPUT,
+				   perf_begin() - chunk->stamp_ns);
+#endif
+
+	return success;
+}
+
+/**
+ * How many chunks to push through the filter chain in one
+ * filter_filter_multi() batch.
+ */
+#define AO_FILTER_BATCH 8
+
+/**
+ * Collects consecutive chunks which can be filtered as one batch,
+ * applying the replay gain filter to each.  Cross-faded and empty
+ * chunks close the batch; they take the per-chunk path.
+ *
+ * @return the number of collected spans; *failed_r is set instead
+ * when a filter has failed
+ */
+static unsigned
+ao_collect_batch(struct audio_output *ao, const struct music_chunk *chunk,
+		 const struct music_chunk **chunks, struct filter_span *spans,
+		 bool *failed_r)
+{
+	unsigned n = 0;
+
+	if (ao->fused_volume_filter != NULL)
+		/* none of the collected chunks is cross-faded, so the
+		   fused single-pass gain path may be (re-)engaged */
+		replay_gain_filter_set_volume_filter(ao->replay_gain_filter,
+						     ao->fused_volume_filter);
+
+	while (chunk != NULL && n < AO_FILTER_BATCH &&
+	       chunk->other == NULL && chunk->length > 0) {
+		size_t length;
+		const char *data = ao_chunk_data(ao, chunk,
+						 ao->replay_gain_filter,
+						 &ao->replay_gain_serial,
+						 &length);
+		if (data == NULL) {
+			*failed_r = true;
+			return 0;
+		}
+
+		chunks[n] = chunk;
+		spans[n].data = data;
+		spans[n].size = length;
+		++n;
+
+		if (data != chunk->data)
+			/* the replay gain filter has returned its own
+			   buffer, which its next call would
+			   invalidate; close the batch here */
+			break;
+
+		chunk = chunk->next;
+	}
+
+	return n;
+}
+
+/**
+ * Filters a batch of chunks in one filter_filter_multi() call and
+ * plays the results.  On failure, the device is closed.
+ */
+static bool
+ao_play_batch(struct audio_output *ao, const struct music_chunk **chunks,
+	      struct filter_span *spans, unsigned n)
+{
+	GError *error = NULL;
+
+#ifdef ENABLE_PERF_COUNTERS
+	for (unsigned i = 0; i < n; ++i)
+		if (chunks[i]->stamp_ns != 0)
+			perf_histogram_add(PERF_LATENCY_DECODER_FILTER,
+					   perf_begin() - chunks[i]->stamp_ns);
+#endif
+
+	if (!filter_filter_multi(ao->filter, spans, n, &error)) {
+		g_warning("\"%s\" [%s] failed to filter: %s",
+			  ao->name, ao->plugin->name, error->message);
+		g_error_free(error);
+
+		ao_close(ao, false);
+
+		/* don't automatically reopen this device for 10
+		   seconds */
+		ao->fail_timer = g_timer_new();
+		return false;
+	}
+
+	for (unsigned i = 0; i < n && ao->command == AO_COMMAND_NONE; ++i) {
+		ao->chunk = chunks[i];
+
+		if (chunks[i]->tag != NULL) {
+			g_mutex_unlock(ao->mutex);
+			ao_plugin_send_tag(ao, chunks[i]->tag);
+			g_mutex_lock(ao->mutex);
+		}
+
+		if (!ao_play_data(ao, spans[i].data, spans[i].size))
+			return false;
+
+#ifdef ENABLE_PERF_COUNTERS
+		if (chunks[i]->stamp_ns != 0)
+			perf_histogram_add(PERF_LATENCY_DECODER_OUTPUT,
+					   perf_begin() -
+					   chunks[i]->stamp_ns);
+#endif
+
+		++ao->stats.chunks;
+	}
+
+	/* the whole batch counts as consumed, including chunks cut
+	   short by a command: they have been filtered already, and
+	   filtering them a second time would corrupt stateful stages
+	   (the resampler) */
+	ao->chunk = chunks[n - 1];
+
+	return true;
+}
+
 static const struct music_chunk *
 ao_next_chunk(struct audio_output *ao)
 {
@@ -519,9 +767,58 @@ ao_play(struct audio_output *ao)
 
 	ao->chunk_finished = false;
 
+	if (!ao->play_timer->started)
+		timer_start(ao->play_timer);
+	else if (timer_delay(ao->play_timer) == 0) {
+		/* the deadline has passed: the device has (nominally)
+		   consumed everything submitted so far, and this
+		   batch is too late; re-base the timer, so one stall
+		   is counted only once */
+		++ao->stats.underruns;
+		timer_start(ao->play_timer);
+	}
+
+	/* batch filtering is preferable when the pipe has depth, but
+	   not while the shared conversion cache is active: the batch
+	   path bypasses it */
+	const bool use_batch = filter_supports_multi(ao->filter) &&
+		!audio_output_all_convert_cache_enabled();
+
 	while (chunk != NULL && ao->command == AO_COMMAND_NONE) {
 		assert(!ao->chunk_finished);
 
+		if (use_batch) {
+			const struct music_chunk *chunks[AO_FILTER_BATCH];
+			struct filter_span spans[AO_FILTER_BATCH];
+			bool failed = false;
+
+			unsigned n = ao_collect_batch(ao, chunk,
+						      chunks, spans, &failed);
+			if (failed) {
+				ao_close(ao, false);
+
+				/* don't automatically reopen this
+				   device for 10 seconds */
+				ao->fail_timer = g_timer_new();
+				break;
+			}
+
+			if (n >= 2) {
+				if (!ao_play_batch(ao, chunks, spans, n)) {
+					assert(ao->chunk == NULL);
+					break;
+				}
+
+				assert(ao->chunk == chunks[n - 1]);
+				chunk = ao->chunk->next;
+				continue;
+			}
+
+			/* a single chunk is not worth a batch; fall
+			   through to the per-chunk path (which can
+			   also use the conversion cache) */
+		}
+
 		ao->chunk = chunk;
 
 		success = ao_play_chunk(ao, chunk);
@@ -531,9 +828,11 @@ ao_play(struct audio_output *ao)
 		}
 
 		assert(ao->chunk == chunk);
+		++ao->stats.chunks;
 		chunk = chunk->next;
 	}
 
+	++ao->stats.batches;
 	ao->chunk_finished = true;
 
 	g_mutex_unlock(ao->mutex);
@@ -569,6 +868,11 @@ static void ao_pause(struct audio_output *ao)
 	} while (ao->command == AO_COMMAND_NONE);
 
 	ao->pause = false;
+
+	if (ao->open)
+		/* no data was submitted while paused; don't count the
+		   gap as a missed deadline */
+		timer_reset(ao->play_timer);
 }
 
 static gpointer audio_output_task(gpointer arg)
@@ -635,6 +939,8 @@ static gpointer audio_output_task(gpointer arg)
 				g_mutex_unlock(ao->mutex);
 				ao_plugin_drain(ao);
 				g_mutex_lock(ao->mutex);
+
+				timer_reset(ao->play_timer);
 			}
 
 			ao_command_finished(ao);
@@ -647,6 +953,8 @@ static gpointer audio_output_task(gpointer arg)
 				g_mutex_unlock(ao->mutex);
 				ao_plugin_cancel(ao);
 				g_mutex_lock(ao->mutex);
+
+				timer_reset(ao->play_timer);
 			}
 
 			ao_command_finished(ao);
@@ -664,8 +972,21 @@ static gpointer audio_output_task(gpointer arg)
 			   chunks in the pipe */
 			continue;
 
-		if (ao->command == AO_COMMAND_NONE)
-			g_cond_wait(ao->cond, ao->mutex);
+		if (ao->command == AO_COMMAND_NONE) {
+			g_atomic_int_set(&ao->sleeping, 1);
+
+			/* re-check for chunks which arrived between
+			   ao_play() and the flag store above; their
+			   producer may have seen the flag still unset
+			   and skipped the wakeup */
+			if (!(ao->open && ao->allow_play &&
+			      ao_next_chunk(ao) != NULL)) {
+				g_cond_wait(ao->cond, ao->mutex);
+				++ao->stats.wakeups;
+			}
+
+			g_atomic_int_set(&ao->sleeping, 0);
+		}
 	}
 }
 
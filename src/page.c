@@ -26,16 +26,52 @@
 #include <string.h>
 
 /**
- * Allocates a new #page object, without filling the data element.
+ * The maximum number of freed pages kept for reuse.
  */
-static struct page *
+#define PAGE_POOL_SIZE 16
+
+/**
+ * Pages larger than this are not pooled, to bound the memory held by
+ * the pool.
+ */
+#define PAGE_POOL_MAX_CAPACITY 65536
+
+static struct page *page_pool[PAGE_POOL_SIZE];
+static unsigned page_pool_n;
+G_LOCK_DEFINE_STATIC(page_pool);
+
+struct page *
 page_new(size_t size)
 {
-	struct page *page = g_malloc(sizeof(*page) + size -
-				     sizeof(page->data));
+	struct page *page = NULL;
 
 	assert(size > 0);
 
+	/* prefer a recycled allocation from the pool; pick the
+	   smallest one which is large enough */
+
+	G_LOCK(page_pool);
+
+	unsigned best = page_pool_n;
+	for (unsigned i = 0; i < page_pool_n; ++i)
+		if (page_pool[i]->capacity >= size &&
+		    (best == page_pool_n ||
+		     page_pool[i]->capacity < page_pool[best]->capacity))
+			best = i;
+
+	if (best < page_pool_n) {
+		page = page_pool[best];
+		page_pool[best] = page_pool[--page_pool_n];
+	}
+
+	G_UNLOCK(page_pool);
+
+	if (page == NULL) {
+		page = g_malloc(sizeof(*page) + size -
+				sizeof(page->data));
+		page->capacity = size;
+	}
+
 	page->ref = 1;
 	page->size = size;
 	return page;
@@ -74,7 +110,19 @@ page_free(struct page *page)
 {
 	assert(page->ref == 0);
 
-	g_free(page);
+	if (page->capacity <= PAGE_POOL_MAX_CAPACITY) {
+		G_LOCK(page_pool);
+
+		if (page_pool_n < PAGE_POOL_SIZE) {
+			page_pool[page_pool_n++] = page;
+			page = NULL;
+		}
+
+		G_UNLOCK(page_pool);
+	}
+
+	if (page != NULL)
+		g_free(page);
 }
 
 bool
@@ -47,12 +47,27 @@ struct page {
 	 */
 	size_t size;
 
+	/**
+	 * The allocated size of #data.  This may be larger than #size
+	 * when the page was reused from the internal pool.
+	 */
+	size_t capacity;
+
 	/**
 	 * Dynamic array containing the buffer data.
 	 */
 	unsigned char data[sizeof(long)];
 };
 
+/**
+ * Creates a new #page object, without initializing the data element.
+ * It is initialized with a reference count of 1.  Freed pages are
+ * kept in a bounded internal pool, so producers on a hot path usually
+ * get a recycled allocation.
+ */
+struct page *
+page_new(size_t size);
+
 /**
  * Creates a new #page object, and copies data from the specified
  * buffer.  It is initialized with a reference count of 1.
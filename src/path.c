@@ -36,13 +36,135 @@
 #define G_LOG_DOMAIN "path"
 
 static char *fs_charset;
+static bool fs_charset_utf8;
+
+/**
+ * The number of recent conversion results to remember.  A database
+ * update converts the same directory and file names over and over;
+ * the cache spares it one iconv round trip (and its allocations) per
+ * repeat.
+ */
+#define CONV_CACHE_SIZE 128
+
+struct conv_cache_item {
+	char *from, *to;
+
+	/** position in conv_cache.lru */
+	GList *position;
+};
+
+struct conv_cache {
+	/** maps the source string to a #conv_cache_item */
+	GHashTable *map;
+
+	/** most recently used first */
+	GQueue lru;
+};
+
+static GMutex *conv_cache_mutex;
+static struct conv_cache to_utf8_cache, to_fs_cache;
+
+static void
+conv_cache_item_free(gpointer data)
+{
+	struct conv_cache_item *item = data;
+
+	g_free(item->from);
+	g_free(item->to);
+	g_slice_free(struct conv_cache_item, item);
+}
+
+static void
+conv_cache_init(struct conv_cache *cache)
+{
+	cache->map = g_hash_table_new_full(g_str_hash, g_str_equal,
+					   NULL, conv_cache_item_free);
+	g_queue_init(&cache->lru);
+}
+
+static void
+conv_cache_deinit(struct conv_cache *cache)
+{
+	g_hash_table_destroy(cache->map);
+	cache->map = NULL;
+	g_queue_clear(&cache->lru);
+}
+
+/**
+ * Looks up a cached conversion result.  Returns a newly allocated
+ * copy, or NULL if the source string is not cached.
+ */
+static char *
+conv_cache_get(struct conv_cache *cache, const char *from)
+{
+	if (cache->map == NULL)
+		/* never initialized - this process doesn't use the
+		   cache */
+		return NULL;
+
+	g_mutex_lock(conv_cache_mutex);
+
+	struct conv_cache_item *item = g_hash_table_lookup(cache->map, from);
+	char *result = NULL;
+	if (item != NULL) {
+		g_queue_unlink(&cache->lru, item->position);
+		g_queue_push_head_link(&cache->lru, item->position);
+		result = g_strdup(item->to);
+	}
+
+	g_mutex_unlock(conv_cache_mutex);
+	return result;
+}
+
+static void
+conv_cache_put(struct conv_cache *cache, const char *from, const char *to)
+{
+	if (cache->map == NULL)
+		return;
+
+	g_mutex_lock(conv_cache_mutex);
+
+	if (g_hash_table_lookup(cache->map, from) == NULL) {
+		struct conv_cache_item *item =
+			g_slice_new(struct conv_cache_item);
+		item->from = g_strdup(from);
+		item->to = g_strdup(to);
+		g_queue_push_head(&cache->lru, item);
+		item->position = cache->lru.head;
+		g_hash_table_insert(cache->map, item->from, item);
+
+		if (cache->lru.length > CONV_CACHE_SIZE) {
+			struct conv_cache_item *victim =
+				g_queue_pop_tail(&cache->lru);
+			g_hash_table_remove(cache->map, victim->from);
+		}
+	}
+
+	g_mutex_unlock(conv_cache_mutex);
+}
 
 char *
 fs_charset_to_utf8(const char *path_fs)
 {
-	return g_convert(path_fs, -1,
-			 "utf-8", fs_charset,
-			 NULL, NULL, NULL);
+	if (fs_charset_utf8)
+		/* the caller expects a newly allocated string, so
+		   the identity "fast path" boils down to validating
+		   and duplicating, without an iconv round trip */
+		return g_utf8_validate(path_fs, -1, NULL)
+			? g_strdup(path_fs)
+			: NULL;
+
+	char *p = conv_cache_get(&to_utf8_cache, path_fs);
+	if (p != NULL)
+		return p;
+
+	p = g_convert(path_fs, -1,
+		      "utf-8", fs_charset,
+		      NULL, NULL, NULL);
+	if (p != NULL)
+		conv_cache_put(&to_utf8_cache, path_fs, p);
+
+	return p;
 }
 
 char *
@@ -50,12 +172,21 @@ utf8_to_fs_charset(const char *path_utf8)
 {
 	gchar *p;
 
+	if (fs_charset_utf8)
+		return g_strdup(path_utf8);
+
+	p = conv_cache_get(&to_fs_cache, path_utf8);
+	if (p != NULL)
+		return p;
+
 	p = g_convert(path_utf8, -1,
 		      fs_charset, "utf-8",
 		      NULL, NULL, NULL);
 	if (p == NULL)
 		/* fall back to UTF-8 */
 		p = g_strdup(path_utf8);
+	else
+		conv_cache_put(&to_fs_cache, path_utf8, p);
 
 	return p;
 }
@@ -75,10 +206,18 @@ path_set_fs_charset(const char *charset)
 
 	g_free(fs_charset);
 	fs_charset = g_strdup(charset);
+	fs_charset_utf8 = g_ascii_strcasecmp(charset, "utf-8") == 0 ||
+		g_ascii_strcasecmp(charset, "utf8") == 0;
 
 	g_debug("path_set_fs_charset: fs charset is: %s", fs_charset);
 }
 
+bool
+fs_charset_is_utf8(void)
+{
+	return fs_charset_utf8;
+}
+
 const char *path_get_fs_charset(void)
 {
 	return fs_charset;
@@ -114,9 +253,23 @@ void path_global_init(void)
 		g_message("setting filesystem charset to ISO-8859-1");
 		path_set_fs_charset("ISO-8859-1");
 	}
+
+	if (!fs_charset_utf8) {
+		/* with a UTF-8 file system, conversion is a plain
+		   copy, and caching would only add overhead */
+		conv_cache_mutex = g_mutex_new();
+		conv_cache_init(&to_utf8_cache);
+		conv_cache_init(&to_fs_cache);
+	}
 }
 
 void path_global_finish(void)
 {
+	if (to_utf8_cache.map != NULL) {
+		conv_cache_deinit(&to_utf8_cache);
+		conv_cache_deinit(&to_fs_cache);
+		g_mutex_free(conv_cache_mutex);
+	}
+
 	g_free(fs_charset);
 }
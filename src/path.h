@@ -21,6 +21,7 @@
 #define MPD_PATH_H
 
 #include <limits.h>
+#include <stdbool.h>
 
 #if !defined(MPD_PATH_MAX)
 #  if defined(MAXPATHLEN)
@@ -52,4 +53,12 @@ utf8_to_fs_charset(const char *path_utf8);
 
 const char *path_get_fs_charset(void);
 
+/**
+ * Is the configured filesystem charset UTF-8?  If so, the conversion
+ * functions merely copy their input, and callers may skip them for
+ * strings which are known to be well-formed.
+ */
+bool
+fs_charset_is_utf8(void);
+
 #endif
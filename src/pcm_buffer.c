@@ -31,6 +31,40 @@ align_8k(size_t size)
 	return ((size - 1) | 0x1fff) + 1;
 }
 
+/**
+ * Allocations above this size are shrunk back when demand drops; see
+ * pcm_buffer_set_high_water().  Written once at startup, read-only
+ * afterwards.
+ */
+static size_t pcm_buffer_high_water = 256 * 1024;
+
+/**
+ * Re-check the allocation every this many pcm_buffer_get() calls;
+ * bounds how long an over-sized buffer survives a drop in demand.
+ */
+#define PCM_BUFFER_TRIM_INTERVAL 512
+
+void
+pcm_buffer_set_high_water(size_t size)
+{
+	pcm_buffer_high_water = size > 0 ? size : (size_t)-1;
+}
+
+void
+pcm_buffer_trim(struct pcm_buffer *buffer)
+{
+	assert(buffer != NULL);
+
+	if (buffer->size > pcm_buffer_high_water) {
+		g_free(buffer->buffer);
+		buffer->buffer = NULL;
+		buffer->size = 0;
+	}
+
+	buffer->peak = 0;
+	buffer->uses = 0;
+}
+
 void *
 pcm_buffer_get(struct pcm_buffer *buffer, size_t size)
 {
@@ -41,6 +75,27 @@ pcm_buffer_get(struct pcm_buffer *buffer, size_t size)
 		   be an error condition */
 		size = 1;
 
+	if (size > buffer->peak)
+		buffer->peak = size;
+
+	if (++buffer->uses >= PCM_BUFFER_TRIM_INTERVAL) {
+		const size_t wanted = align_8k(buffer->peak);
+
+		if (buffer->size > pcm_buffer_high_water &&
+		    wanted < buffer->size) {
+			/* demand has dropped (e.g. after a format
+			   change): give the excess back; the old
+			   contents are invalidated by this call
+			   anyway */
+			g_free(buffer->buffer);
+			buffer->buffer = g_malloc(wanted);
+			buffer->size = wanted;
+		}
+
+		buffer->peak = size;
+		buffer->uses = 0;
+	}
+
 	if (buffer->size < size) {
 		/* free the old buffer */
 		g_free(buffer->buffer);
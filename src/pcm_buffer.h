@@ -35,6 +35,12 @@ struct pcm_buffer {
 	void *buffer;
 
 	size_t size;
+
+	/** the largest size requested since the last trim check */
+	size_t peak;
+
+	/** number of pcm_buffer_get() calls since the last trim check */
+	unsigned uses;
 };
 
 /**
@@ -47,6 +53,8 @@ pcm_buffer_init(struct pcm_buffer *buffer)
 
 	buffer->buffer = NULL;
 	buffer->size = 0;
+	buffer->peak = 0;
+	buffer->uses = 0;
 }
 
 /**
@@ -74,4 +82,22 @@ G_GNUC_MALLOC
 void *
 pcm_buffer_get(struct pcm_buffer *buffer, size_t size);
 
+/**
+ * Configures the high-water mark for all pcm_buffer objects: an
+ * allocation above this size is shrunk back once demand drops.  0
+ * disables trimming.  Called once at startup, before any conversion
+ * runs.
+ */
+void
+pcm_buffer_set_high_water(size_t size);
+
+/**
+ * Returns the allocation to the heap if it exceeds the high-water
+ * mark.  Call this when the buffer is known to be idle for a while,
+ * e.g. at a song boundary; the next pcm_buffer_get() re-allocates on
+ * demand.
+ */
+void
+pcm_buffer_trim(struct pcm_buffer *buffer);
+
 #endif
@@ -20,6 +20,7 @@
 #include "config.h"
 #include "pcm_byteswap.h"
 #include "pcm_buffer.h"
+#include "pcm_dispatch.h"
 
 #include <glib.h>
 
@@ -28,6 +29,132 @@
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "pcm"
 
+static void
+pcm_byteswap_16_scalar(int16_t *dest, const int16_t *src,
+		       const int16_t *src_end)
+{
+	while (src < src_end) {
+		const int16_t x = *src++;
+		*dest++ = GUINT16_SWAP_LE_BE(x);
+	}
+}
+
+static void
+pcm_byteswap_32_scalar(int32_t *dest, const int32_t *src,
+		       const int32_t *src_end)
+{
+	while (src < src_end) {
+		const int32_t x = *src++;
+		*dest++ = GUINT32_SWAP_LE_BE(x);
+	}
+}
+
+#ifdef PCM_DISPATCH_X86
+
+__attribute__((target("ssse3")))
+static void
+pcm_byteswap_16_ssse3(int16_t *dest, const int16_t *src,
+		      const int16_t *src_end)
+{
+	const __m128i shuf = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+					   9, 8, 11, 10, 13, 12, 15, 14);
+
+	while (src + 8 <= src_end) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+		_mm_storeu_si128((__m128i *)dest, _mm_shuffle_epi8(v, shuf));
+		src += 8;
+		dest += 8;
+	}
+
+	pcm_byteswap_16_scalar(dest, src, src_end);
+}
+
+__attribute__((target("ssse3")))
+static void
+pcm_byteswap_32_ssse3(int32_t *dest, const int32_t *src,
+		      const int32_t *src_end)
+{
+	const __m128i shuf = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+					   11, 10, 9, 8, 15, 14, 13, 12);
+
+	while (src + 4 <= src_end) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+		_mm_storeu_si128((__m128i *)dest, _mm_shuffle_epi8(v, shuf));
+		src += 4;
+		dest += 4;
+	}
+
+	pcm_byteswap_32_scalar(dest, src, src_end);
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+#ifdef __ARM_NEON__
+
+static void
+pcm_byteswap_16_neon(int16_t *dest, const int16_t *src,
+		     const int16_t *src_end)
+{
+	while (src + 8 <= src_end) {
+		uint8x16_t v = vld1q_u8((const uint8_t *)src);
+		vst1q_u8((uint8_t *)dest, vrev16q_u8(v));
+		src += 8;
+		dest += 8;
+	}
+
+	pcm_byteswap_16_scalar(dest, src, src_end);
+}
+
+static void
+pcm_byteswap_32_neon(int32_t *dest, const int32_t *src,
+		     const int32_t *src_end)
+{
+	while (src + 4 <= src_end) {
+		uint8x16_t v = vld1q_u8((const uint8_t *)src);
+		vst1q_u8((uint8_t *)dest, vrev32q_u8(v));
+		src += 4;
+		dest += 4;
+	}
+
+	pcm_byteswap_32_scalar(dest, src, src_end);
+}
+
+#endif /* __ARM_NEON__ */
+
+typedef void (*pcm_byteswap_16_func)(int16_t *dest, const int16_t *src,
+				     const int16_t *src_end);
+typedef void (*pcm_byteswap_32_func)(int32_t *dest, const int32_t *src,
+				     const int32_t *src_end);
+
+#ifdef __ARM_NEON__
+static pcm_byteswap_16_func pcm_byteswap_16_hook = pcm_byteswap_16_neon;
+static pcm_byteswap_32_func pcm_byteswap_32_hook = pcm_byteswap_32_neon;
+#else
+static pcm_byteswap_16_func pcm_byteswap_16_hook = pcm_byteswap_16_scalar;
+static pcm_byteswap_32_func pcm_byteswap_32_hook = pcm_byteswap_32_scalar;
+#endif
+
+static void
+pcm_byteswap_dispatch_init(void)
+{
+#ifdef PCM_DISPATCH_X86
+	if (__builtin_cpu_supports("ssse3")) {
+		pcm_byteswap_16_hook = pcm_byteswap_16_ssse3;
+		pcm_byteswap_32_hook = pcm_byteswap_32_ssse3;
+	}
+#endif
+}
+
+static void
+pcm_byteswap_dispatch(void)
+{
+	static gsize initialized = 0;
+	if (g_once_init_enter(&initialized)) {
+		pcm_byteswap_dispatch_init();
+		g_once_init_leave(&initialized, 1);
+	}
+}
+
 const int16_t *pcm_byteswap_16(struct pcm_buffer *buffer,
 			       const int16_t *src, size_t len)
 {
@@ -35,12 +162,8 @@ const int16_t *pcm_byteswap_16(struct pcm_buffer *buffer,
 
 	assert(buf != NULL);
 
-	const int16_t *src_end = src + len / sizeof(*src);
-	int16_t *dest = buf;
-	while (src < src_end) {
-		const int16_t x = *src++;
-		*dest++ = GUINT16_SWAP_LE_BE(x);
-	}
+	pcm_byteswap_dispatch();
+	pcm_byteswap_16_hook(buf, src, src + len / sizeof(*src));
 
 	return buf;
 }
@@ -52,12 +175,8 @@ const int32_t *pcm_byteswap_32(struct pcm_buffer *buffer,
 
 	assert(buf != NULL);
 
-	const int32_t *src_end = src + len / sizeof(*src);
-	int32_t *dest = buf;
-	while (src < src_end) {
-		const int32_t x = *src++;
-		*dest++ = GUINT32_SWAP_LE_BE(x);
-	}
+	pcm_byteswap_dispatch();
+	pcm_byteswap_32_hook(buf, src, src + len / sizeof(*src));
 
 	return buf;
 }
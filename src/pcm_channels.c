@@ -21,9 +21,68 @@
 #include "pcm_channels.h"
 #include "pcm_buffer.h"
 #include "pcm_utils.h"
+#include "pcm_dispatch.h"
+#include "conf.h"
+
+#include <glib.h>
 
 #include <assert.h>
 
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "pcm"
+
+/**
+ * Downmix coefficients for the 5.1 to stereo case, in Q12 fixed
+ * point.  The front channels are always mixed at unity gain.
+ */
+struct pcm_mixdown {
+	int32_t center, lfe, surround;
+};
+
+/**
+ * ITU-R BS.775 recommends -3 dB for the center and surround
+ * channels; the LFE is omitted by default, because small speakers
+ * cannot reproduce it, and it easily clips the front channels.
+ * Overridden by the "downmix_coefficients" configuration option.
+ */
+static struct pcm_mixdown pcm_mixdown = {
+	.center = 2896, /* 0.707 * 4096 */
+	.lfe = 0,
+	.surround = 2896,
+};
+
+static int32_t
+pcm_mixdown_coefficient(const char *s)
+{
+	double value = g_ascii_strtod(s, NULL);
+
+	if (value < 0 || value > 1) {
+		g_warning("downmix coefficient \"%s\" out of range (0..1)", s);
+		value = value < 0 ? 0 : 1;
+	}
+
+	return value * 4096;
+}
+
+static void
+pcm_mixdown_init(void)
+{
+	const char *s = config_get_string(CONF_DOWNMIX_COEFFICIENTS, NULL);
+	if (s == NULL)
+		return;
+
+	gchar **values = g_strsplit(s, ",", 0);
+	if (g_strv_length(values) == 3) {
+		pcm_mixdown.center = pcm_mixdown_coefficient(values[0]);
+		pcm_mixdown.lfe = pcm_mixdown_coefficient(values[1]);
+		pcm_mixdown.surround = pcm_mixdown_coefficient(values[2]);
+	} else
+		g_warning("Invalid " CONF_DOWNMIX_COEFFICIENTS
+			  ": expected \"CENTER,LFE,SURROUND\"");
+
+	g_strfreev(values);
+}
+
 static void
 pcm_convert_channels_16_1_to_2(int16_t *restrict dest,
 			       const int16_t *restrict src,
@@ -73,6 +132,167 @@ pcm_convert_channels_16_n_to_2(int16_t *restrict dest,
 	}
 }
 
+/**
+ * Coefficient-based 5.1 to stereo downmix (channel order FL FR FC
+ * LFE BL BR): the front channels are taken at unity gain, center,
+ * LFE and the matching surround channel are added with the
+ * #pcm_mixdown weights.
+ */
+static void
+pcm_convert_channels_16_6_to_2(int16_t *restrict dest,
+			       const int16_t *restrict src,
+			       const int16_t *restrict src_end)
+{
+	while (src < src_end) {
+		int32_t c = src[2] * pcm_mixdown.center +
+			src[3] * pcm_mixdown.lfe;
+
+		*dest++ = pcm_range((((int32_t)src[0] << 12) + c +
+				     src[4] * pcm_mixdown.surround) >> 12, 16);
+		*dest++ = pcm_range((((int32_t)src[1] << 12) + c +
+				     src[5] * pcm_mixdown.surround) >> 12, 16);
+
+		src += 6;
+	}
+}
+
+/* runtime-dispatched kernels for the hot conversions (see
+   pcm_dispatch.h) */
+
+typedef void (*pcm_channels_16_func)(int16_t *restrict dest,
+				     const int16_t *restrict src,
+				     const int16_t *restrict src_end);
+
+#ifdef PCM_DISPATCH_X86
+
+__attribute__((target("sse2")))
+static void
+pcm_convert_channels_16_1_to_2_sse2(int16_t *restrict dest,
+				    const int16_t *restrict src,
+				    const int16_t *restrict src_end)
+{
+	while (src + 8 <= src_end) {
+		__m128i s = _mm_loadu_si128((const __m128i *)src);
+
+		_mm_storeu_si128((__m128i *)dest,
+				 _mm_unpacklo_epi16(s, s));
+		_mm_storeu_si128((__m128i *)(dest + 8),
+				 _mm_unpackhi_epi16(s, s));
+
+		src += 8;
+		dest += 16;
+	}
+
+	pcm_convert_channels_16_1_to_2(dest, src, src_end);
+}
+
+__attribute__((target("sse2")))
+static void
+pcm_convert_channels_16_2_to_1_sse2(int16_t *restrict dest,
+				    const int16_t *restrict src,
+				    const int16_t *restrict src_end)
+{
+	const __m128i ones = _mm_set1_epi16(1);
+
+	while (src + 16 <= src_end) {
+		__m128i a = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)src),
+					   ones);
+		__m128i b = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(src + 8)),
+					   ones);
+
+		/* add the sign bit before shifting, so the result
+		   rounds towards zero like the scalar "/ 2" */
+		a = _mm_srai_epi32(_mm_add_epi32(a, _mm_srli_epi32(a, 31)), 1);
+		b = _mm_srai_epi32(_mm_add_epi32(b, _mm_srli_epi32(b, 31)), 1);
+
+		_mm_storeu_si128((__m128i *)dest, _mm_packs_epi32(a, b));
+
+		src += 16;
+		dest += 8;
+	}
+
+	pcm_convert_channels_16_2_to_1(dest, src, src_end);
+}
+
+__attribute__((target("sse2")))
+static void
+pcm_convert_channels_16_6_to_2_sse2(int16_t *restrict dest,
+				    const int16_t *restrict src,
+				    const int16_t *restrict src_end)
+{
+	/* pmaddwd computes L and R as pair sums; the horizontal adds
+	   collapse them, and packs_epi32 provides the clamping */
+
+	const __m128i k1 = _mm_setr_epi16(4096, 0,
+					  pcm_mixdown.center,
+					  pcm_mixdown.lfe,
+					  pcm_mixdown.surround, 0, 0, 0);
+	const __m128i k2 = _mm_setr_epi16(0, 4096,
+					  pcm_mixdown.center,
+					  pcm_mixdown.lfe,
+					  0, pcm_mixdown.surround, 0, 0);
+
+	/* the 16 byte load covers two samples of the following
+	   frame; stop early so the last frame is handled by the
+	   scalar loop and nothing is read past the buffer */
+	while (src + 8 <= src_end) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+		__m128i l = _mm_madd_epi16(v, k1);
+		__m128i r = _mm_madd_epi16(v, k2);
+
+		l = _mm_add_epi32(l, _mm_shuffle_epi32(l, _MM_SHUFFLE(1, 0, 3, 2)));
+		l = _mm_add_epi32(l, _mm_shuffle_epi32(l, _MM_SHUFFLE(2, 3, 0, 1)));
+		r = _mm_add_epi32(r, _mm_shuffle_epi32(r, _MM_SHUFFLE(1, 0, 3, 2)));
+		r = _mm_add_epi32(r, _mm_shuffle_epi32(r, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		__m128i lr = _mm_srai_epi32(_mm_unpacklo_epi32(l, r), 12);
+		lr = _mm_packs_epi32(lr, lr);
+
+		*(int32_t *)dest = _mm_cvtsi128_si32(lr);
+
+		src += 6;
+		dest += 2;
+	}
+
+	pcm_convert_channels_16_6_to_2(dest, src, src_end);
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+static pcm_channels_16_func pcm_channels_16_1_to_2_hook =
+	pcm_convert_channels_16_1_to_2;
+static pcm_channels_16_func pcm_channels_16_2_to_1_hook =
+	pcm_convert_channels_16_2_to_1;
+static pcm_channels_16_func pcm_channels_16_6_to_2_hook =
+	pcm_convert_channels_16_6_to_2;
+
+static void
+pcm_channels_dispatch_init(void)
+{
+#ifdef PCM_DISPATCH_X86
+	if (__builtin_cpu_supports("sse2")) {
+		pcm_channels_16_1_to_2_hook =
+			pcm_convert_channels_16_1_to_2_sse2;
+		pcm_channels_16_2_to_1_hook =
+			pcm_convert_channels_16_2_to_1_sse2;
+		pcm_channels_16_6_to_2_hook =
+			pcm_convert_channels_16_6_to_2_sse2;
+	}
+#endif
+}
+
+static void
+pcm_channels_init(void)
+{
+	static gsize initialized = 0;
+
+	if (g_once_init_enter(&initialized)) {
+		pcm_mixdown_init();
+		pcm_channels_dispatch_init();
+		g_once_init_leave(&initialized, 1);
+	}
+}
+
 const int16_t *
 pcm_convert_channels_16(struct pcm_buffer *buffer,
 			unsigned dest_channels,
@@ -87,10 +307,14 @@ pcm_convert_channels_16(struct pcm_buffer *buffer,
 	int16_t *dest = pcm_buffer_get(buffer, dest_size);
 	const int16_t *src_end = pcm_end_pointer(src, src_size);
 
+	pcm_channels_init();
+
 	if (src_channels == 1 && dest_channels == 2)
-		pcm_convert_channels_16_1_to_2(dest, src, src_end);
+		pcm_channels_16_1_to_2_hook(dest, src, src_end);
 	else if (src_channels == 2 && dest_channels == 1)
-		pcm_convert_channels_16_2_to_1(dest, src, src_end);
+		pcm_channels_16_2_to_1_hook(dest, src, src_end);
+	else if (src_channels == 6 && dest_channels == 2)
+		pcm_channels_16_6_to_2_hook(dest, src, src_end);
 	else if (dest_channels == 2)
 		pcm_convert_channels_16_n_to_2(dest, src_channels, src,
 					       src_end);
@@ -149,6 +373,30 @@ pcm_convert_channels_24_n_to_2(int32_t *restrict dest,
 	}
 }
 
+/**
+ * Coefficient-based 5.1 to stereo downmix; see
+ * pcm_convert_channels_16_6_to_2().
+ */
+static void
+pcm_convert_channels_24_6_to_2(int32_t *restrict dest,
+			       const int32_t *restrict src,
+			       const int32_t *restrict src_end)
+{
+	while (src < src_end) {
+		int64_t c = (int64_t)src[2] * pcm_mixdown.center +
+			(int64_t)src[3] * pcm_mixdown.lfe;
+
+		*dest++ = pcm_range((int32_t)((((int64_t)src[0] << 12) + c +
+					       (int64_t)src[4] * pcm_mixdown.surround) >> 12),
+				    24);
+		*dest++ = pcm_range((int32_t)((((int64_t)src[1] << 12) + c +
+					       (int64_t)src[5] * pcm_mixdown.surround) >> 12),
+				    24);
+
+		src += 6;
+	}
+}
+
 const int32_t *
 pcm_convert_channels_24(struct pcm_buffer *buffer,
 			unsigned dest_channels,
@@ -163,10 +411,14 @@ pcm_convert_channels_24(struct pcm_buffer *buffer,
 	int32_t *dest = pcm_buffer_get(buffer, dest_size);
 	const int32_t *src_end = pcm_end_pointer(src, src_size);
 
+	pcm_channels_init();
+
 	if (src_channels == 1 && dest_channels == 2)
 		pcm_convert_channels_24_1_to_2(dest, src, src_end);
 	else if (src_channels == 2 && dest_channels == 1)
 		pcm_convert_channels_24_2_to_1(dest, src, src_end);
+	else if (src_channels == 6 && dest_channels == 2)
+		pcm_convert_channels_24_6_to_2(dest, src, src_end);
 	else if (dest_channels == 2)
 		pcm_convert_channels_24_n_to_2(dest, src_channels, src,
 					       src_end);
@@ -218,6 +470,30 @@ pcm_convert_channels_32_n_to_2(int32_t *dest,
 	}
 }
 
+/**
+ * Coefficient-based 5.1 to stereo downmix; see
+ * pcm_convert_channels_16_6_to_2().
+ */
+static void
+pcm_convert_channels_32_6_to_2(int32_t *restrict dest,
+			       const int32_t *restrict src,
+			       const int32_t *restrict src_end)
+{
+	while (src < src_end) {
+		int64_t c = (int64_t)src[2] * pcm_mixdown.center +
+			(int64_t)src[3] * pcm_mixdown.lfe;
+
+		*dest++ = pcm_range_64((((int64_t)src[0] << 12) + c +
+					(int64_t)src[4] * pcm_mixdown.surround) >> 12,
+				       32);
+		*dest++ = pcm_range_64((((int64_t)src[1] << 12) + c +
+					(int64_t)src[5] * pcm_mixdown.surround) >> 12,
+				       32);
+
+		src += 6;
+	}
+}
+
 const int32_t *
 pcm_convert_channels_32(struct pcm_buffer *buffer,
 			unsigned dest_channels,
@@ -232,10 +508,14 @@ pcm_convert_channels_32(struct pcm_buffer *buffer,
 	int32_t *dest = pcm_buffer_get(buffer, dest_size);
 	const int32_t *src_end = pcm_end_pointer(src, src_size);
 
+	pcm_channels_init();
+
 	if (src_channels == 1 && dest_channels == 2)
 		pcm_convert_channels_32_1_to_2(dest, src, src_end);
 	else if (src_channels == 2 && dest_channels == 1)
 		pcm_convert_channels_32_2_to_1(dest, src, src_end);
+	else if (src_channels == 6 && dest_channels == 2)
+		pcm_convert_channels_32_6_to_2(dest, src, src_end);
 	else if (dest_channels == 2)
 		pcm_convert_channels_32_n_to_2(dest, src_channels, src,
 					       src_end);
@@ -24,6 +24,7 @@
 #include "pcm_byteswap.h"
 #include "pcm_pack.h"
 #include "audio_format.h"
+#include "perf.h"
 #include "glib_compat.h"
 
 #include <assert.h>
@@ -64,6 +65,13 @@ pcm_convert_reset(struct pcm_convert_state *state)
 {
 	pcm_dsd_reset(&state->dsd);
 	pcm_resample_reset(&state->resample);
+
+	/* the converter is idle at a song/format boundary: give
+	   over-sized stage buffers back to the heap */
+	pcm_buffer_trim(&state->format_buffer);
+	pcm_buffer_trim(&state->pack_buffer);
+	pcm_buffer_trim(&state->channels_buffer);
+	pcm_buffer_trim(&state->byteswap_buffer);
 }
 
 static const void *
@@ -384,13 +392,13 @@ pcm_convert_float(struct pcm_convert_state *state,
 	return buffer;
 }
 
-const void *
-pcm_convert(struct pcm_convert_state *state,
-	    const struct audio_format *src_format,
-	    const void *src, size_t src_size,
-	    const struct audio_format *dest_format,
-	    size_t *dest_size_r,
-	    GError **error_r)
+static const void *
+pcm_convert_internal(struct pcm_convert_state *state,
+		     const struct audio_format *src_format,
+		     const void *src, size_t src_size,
+		     const struct audio_format *dest_format,
+		     size_t *dest_size_r,
+		     GError **error_r)
 {
 	if (src_format->reverse_endian) {
 		/* convert to host byte order, because all of our
@@ -468,3 +476,20 @@ pcm_convert(struct pcm_convert_state *state,
 		return NULL;
 	}
 }
+
+const void *
+pcm_convert(struct pcm_convert_state *state,
+	    const struct audio_format *src_format,
+	    const void *src, size_t src_size,
+	    const struct audio_format *dest_format,
+	    size_t *dest_size_r,
+	    GError **error_r)
+{
+	const uint64_t start = perf_begin();
+	const void *result =
+		pcm_convert_internal(state, src_format, src, src_size,
+				     dest_format, dest_size_r, error_r);
+	perf_end(PERF_PCM_CONVERT, start);
+
+	return result;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_PCM_DISPATCH_H
+#define MPD_PCM_DISPATCH_H
+
+/**
+ * Helpers for the runtime-dispatched SIMD kernels in the pcm library.
+ *
+ * On x86, kernels are compiled with the "target" function attribute
+ * and selected at startup with __builtin_cpu_supports(), so a generic
+ * build can still use them on capable CPUs.  This needs gcc 4.9 (or a
+ * clang claiming compatibility).
+ *
+ * On ARM, -mfpu=neon makes NEON a hard requirement for the whole
+ * binary, so NEON kernels are selected at compile time instead.
+ */
+
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__) && \
+	(__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define PCM_DISPATCH_X86
+#include <immintrin.h>
+#endif
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#endif
@@ -19,8 +19,11 @@
 
 #include "config.h"
 #include "pcm_dither.h"
+#include "pcm_dispatch.h"
 #include "pcm_prng.h"
 
+#include <glib.h>
+
 static int16_t
 pcm_dither_sample_24_to_16(int32_t sample, struct pcm_dither *dither)
 {
@@ -70,9 +73,10 @@ pcm_dither_sample_24_to_16(int32_t sample, struct pcm_dither *dither)
 	return (int16_t)(output >> scale_bits);
 }
 
-void
-pcm_dither_24_to_16(struct pcm_dither *dither,
-		    int16_t *dest, const int32_t *src, const int32_t *src_end)
+static void
+pcm_dither_24_to_16_scalar(struct pcm_dither *dither,
+			   int16_t *dest, const int32_t *src,
+			   const int32_t *src_end)
 {
 	while (src < src_end)
 		*dest++ = pcm_dither_sample_24_to_16(*src++, dither);
@@ -84,10 +88,454 @@ pcm_dither_sample_32_to_16(int32_t sample, struct pcm_dither *dither)
 	return pcm_dither_sample_24_to_16(sample >> 8, dither);
 }
 
+static void
+pcm_dither_32_to_16_scalar(struct pcm_dither *dither,
+			   int16_t *dest, const int32_t *src,
+			   const int32_t *src_end)
+{
+	while (src < src_end)
+		*dest++ = pcm_dither_sample_32_to_16(*src++, dither);
+}
+
+/**
+ * Read one packed 24 bit sample (3 bytes, host byte order) and
+ * sign-extend it.
+ */
+static inline int32_t
+pcm_dither_unpack_sample_24(const uint8_t *src)
+{
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+	int32_t sample = src[0] | (src[1] << 8) | (src[2] << 16);
+#else
+	int32_t sample = (src[0] << 16) | (src[1] << 8) | src[2];
+#endif
+
+	return (sample ^ 0x800000) - 0x800000;
+}
+
+static void
+pcm_dither_24_packed_to_16_scalar(struct pcm_dither *dither, int16_t *dest,
+				  const uint8_t *src, const uint8_t *src_end)
+{
+	while (src < src_end) {
+		int32_t sample = pcm_dither_unpack_sample_24(src);
+		*dest++ = pcm_dither_sample_24_to_16(sample, dither);
+		src += 3;
+	}
+}
+
+static void
+pcm_dither_float_to_16_scalar(struct pcm_dither *dither, int16_t *dest,
+			      const float *src, const float *src_end)
+{
+	const float factor = 1 << 23;
+
+	while (src < src_end) {
+		/* scale to 24 bits; pcm_dither_sample_24_to_16()
+		   clips out-of-range samples */
+		int32_t sample = *src++ * factor;
+		*dest++ = pcm_dither_sample_24_to_16(sample, dither);
+	}
+}
+
+#ifdef PCM_DISPATCH_X86
+
+/**
+ * Vectorized variant of the 24/32 to 16 bit conversion.  It applies
+ * plain TPDF dither from a per-lane linear congruential generator;
+ * the serial error feedback of the scalar version cannot be carried
+ * across packed lanes and is omitted, which the remainder handled by
+ * the scalar loop does not resume either.
+ *
+ * pmulld needs SSE4.1; older CPUs keep using the scalar code.
+ */
+__attribute__((target("sse4.1")))
+static inline __m128i
+pcm_dither_to_16_vector_sse41(__m128i v, __m128i *rnd_r)
+{
+	enum {
+		scale_bits = 8,
+		round = 1 << (scale_bits - 1),
+		mask = (1 << scale_bits) - 1
+	};
+
+	const __m128i mul = _mm_set1_epi32(0x0019660dL);
+	const __m128i add = _mm_set1_epi32(0x3c6ef35fL);
+	const __m128i vmask = _mm_set1_epi32(mask);
+
+	__m128i prev = *rnd_r;
+	__m128i rnd = _mm_add_epi32(_mm_mullo_epi32(prev, mul), add);
+	__m128i noise = _mm_sub_epi32(_mm_and_si128(rnd, vmask),
+				      _mm_and_si128(prev, vmask));
+	*rnd_r = rnd;
+
+	v = _mm_add_epi32(_mm_add_epi32(v, _mm_set1_epi32(round)), noise);
+	return _mm_srai_epi32(v, scale_bits);
+}
+
+__attribute__((target("sse4.1")))
+static void
+pcm_dither_to_16_sse41(struct pcm_dither *dither,
+		       int16_t *dest, const int32_t *src,
+		       const int32_t *src_end, int pre_shift)
+{
+	/* give each lane its own PRNG sequence position */
+	uint32_t r0 = pcm_prng(dither->random);
+	uint32_t r1 = pcm_prng(r0), r2 = pcm_prng(r1), r3 = pcm_prng(r2);
+	__m128i rnd = _mm_set_epi32(r3, r2, r1, r0);
+
+	while (src + 8 <= src_end) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 4));
+
+		if (pre_shift > 0) {
+			a = _mm_srai_epi32(a, pre_shift);
+			b = _mm_srai_epi32(b, pre_shift);
+		}
+
+		a = pcm_dither_to_16_vector_sse41(a, &rnd);
+		b = pcm_dither_to_16_vector_sse41(b, &rnd);
+
+		/* packssdw saturates to the 16 bit range */
+		_mm_storeu_si128((__m128i *)dest, _mm_packs_epi32(a, b));
+
+		src += 8;
+		dest += 8;
+	}
+
+	dither->random = _mm_cvtsi128_si32(rnd);
+
+	if (pre_shift > 0)
+		pcm_dither_32_to_16_scalar(dither, dest, src, src_end);
+	else
+		pcm_dither_24_to_16_scalar(dither, dest, src, src_end);
+}
+
+__attribute__((target("sse4.1")))
+static void
+pcm_dither_24_to_16_sse41(struct pcm_dither *dither,
+			  int16_t *dest, const int32_t *src,
+			  const int32_t *src_end)
+{
+	pcm_dither_to_16_sse41(dither, dest, src, src_end, 0);
+}
+
+__attribute__((target("sse4.1")))
+static void
+pcm_dither_32_to_16_sse41(struct pcm_dither *dither,
+			  int16_t *dest, const int32_t *src,
+			  const int32_t *src_end)
+{
+	pcm_dither_to_16_sse41(dither, dest, src, src_end, 8);
+}
+
+/**
+ * Fused conversion from packed 24 bit samples (3 bytes per sample,
+ * host byte order) to dithered 16 bit samples, saving the
+ * intermediate S24_P32 pass over the buffer.  See
+ * pcm_dither_to_16_sse41() for the dithering caveats.
+ */
+__attribute__((target("sse4.1")))
+static void
+pcm_dither_24_packed_to_16_sse41(struct pcm_dither *dither, int16_t *dest,
+				 const uint8_t *src, const uint8_t *src_end)
+{
+	/* moves each 3 byte group into the upper bytes of a 32 bit
+	   lane; the arithmetic shift then extends the sign */
+	const __m128i shuf = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+					   -1, 6, 7, 8, -1, 9, 10, 11);
+
+	uint32_t r0 = pcm_prng(dither->random);
+	uint32_t r1 = pcm_prng(r0), r2 = pcm_prng(r1), r3 = pcm_prng(r2);
+	__m128i rnd = _mm_set_epi32(r3, r2, r1, r0);
+
+	/* each iteration consumes 24 bytes, but the second load reads
+	   up to byte 27; stop early so it cannot touch bytes past the
+	   end of the source buffer */
+	while (src + 28 <= src_end) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 12));
+
+		a = _mm_srai_epi32(_mm_shuffle_epi8(a, shuf), 8);
+		b = _mm_srai_epi32(_mm_shuffle_epi8(b, shuf), 8);
+
+		a = pcm_dither_to_16_vector_sse41(a, &rnd);
+		b = pcm_dither_to_16_vector_sse41(b, &rnd);
+
+		_mm_storeu_si128((__m128i *)dest, _mm_packs_epi32(a, b));
+
+		src += 24;
+		dest += 8;
+	}
+
+	dither->random = _mm_cvtsi128_si32(rnd);
+
+	pcm_dither_24_packed_to_16_scalar(dither, dest, src, src_end);
+}
+
+/**
+ * Fused conversion from 32 bit float samples to dithered 16 bit
+ * samples.  See pcm_dither_to_16_sse41() for the dithering caveats.
+ */
+__attribute__((target("sse4.1")))
+static void
+pcm_dither_float_to_16_sse41(struct pcm_dither *dither, int16_t *dest,
+			     const float *src, const float *src_end)
+{
+	const __m128 factor = _mm_set1_ps(1 << 23);
+
+	uint32_t r0 = pcm_prng(dither->random);
+	uint32_t r1 = pcm_prng(r0), r2 = pcm_prng(r1), r3 = pcm_prng(r2);
+	__m128i rnd = _mm_set_epi32(r3, r2, r1, r0);
+
+	while (src + 8 <= src_end) {
+		/* cvtps saturates on overflow, packssdw saturates to
+		   the 16 bit range below */
+		__m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src),
+						       factor));
+		__m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + 4),
+						       factor));
+
+		a = pcm_dither_to_16_vector_sse41(a, &rnd);
+		b = pcm_dither_to_16_vector_sse41(b, &rnd);
+
+		_mm_storeu_si128((__m128i *)dest, _mm_packs_epi32(a, b));
+
+		src += 8;
+		dest += 8;
+	}
+
+	dither->random = _mm_cvtsi128_si32(rnd);
+
+	pcm_dither_float_to_16_scalar(dither, dest, src, src_end);
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+#ifdef __ARM_NEON__
+
+/**
+ * See pcm_dither_to_16_sse41() for the dithering caveats; this is the
+ * same algorithm with NEON intrinsics.
+ */
+static inline void
+pcm_dither_to_16_neon(struct pcm_dither *dither,
+		      int16_t *dest, const int32_t *src,
+		      const int32_t *src_end, int pre_shift)
+{
+	enum {
+		scale_bits = 8,
+		round = 1 << (scale_bits - 1),
+		mask = (1 << scale_bits) - 1
+	};
+
+	const int32x4_t mul = vdupq_n_s32(0x0019660dL);
+	const int32x4_t add = vdupq_n_s32(0x3c6ef35fL);
+	const int32x4_t vround = vdupq_n_s32(round);
+	const int32x4_t vmask = vdupq_n_s32(mask);
+	const int32x4_t shift = vdupq_n_s32(-pre_shift);
+
+	uint32_t seed[4];
+	seed[0] = pcm_prng(dither->random);
+	seed[1] = pcm_prng(seed[0]);
+	seed[2] = pcm_prng(seed[1]);
+	seed[3] = pcm_prng(seed[2]);
+	int32x4_t rnd = vreinterpretq_s32_u32(vld1q_u32(seed));
+
+	while (src + 8 <= src_end) {
+		int32x4_t a = vshlq_s32(vld1q_s32(src), shift);
+		int32x4_t b = vshlq_s32(vld1q_s32(src + 4), shift);
+
+		int32x4_t prev = rnd;
+		rnd = vaddq_s32(vmulq_s32(rnd, mul), add);
+		int32x4_t noise = vsubq_s32(vandq_s32(rnd, vmask),
+					    vandq_s32(prev, vmask));
+		a = vaddq_s32(vaddq_s32(a, vround), noise);
+
+		prev = rnd;
+		rnd = vaddq_s32(vmulq_s32(rnd, mul), add);
+		noise = vsubq_s32(vandq_s32(rnd, vmask),
+				  vandq_s32(prev, vmask));
+		b = vaddq_s32(vaddq_s32(b, vround), noise);
+
+		a = vshrq_n_s32(a, scale_bits);
+		b = vshrq_n_s32(b, scale_bits);
+
+		vst1q_s16(dest, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+
+		src += 8;
+		dest += 8;
+	}
+
+	dither->random = vgetq_lane_s32(rnd, 0);
+
+	if (pre_shift > 0)
+		pcm_dither_32_to_16_scalar(dither, dest, src, src_end);
+	else
+		pcm_dither_24_to_16_scalar(dither, dest, src, src_end);
+}
+
+static void
+pcm_dither_24_to_16_neon(struct pcm_dither *dither,
+			 int16_t *dest, const int32_t *src,
+			 const int32_t *src_end)
+{
+	pcm_dither_to_16_neon(dither, dest, src, src_end, 0);
+}
+
+static void
+pcm_dither_32_to_16_neon(struct pcm_dither *dither,
+			 int16_t *dest, const int32_t *src,
+			 const int32_t *src_end)
+{
+	pcm_dither_to_16_neon(dither, dest, src, src_end, 8);
+}
+
+/**
+ * Fused conversion from 32 bit float samples to dithered 16 bit
+ * samples; see pcm_dither_to_16_neon().
+ */
+static void
+pcm_dither_float_to_16_neon(struct pcm_dither *dither,
+			    int16_t *dest, const float *src,
+			    const float *src_end)
+{
+	enum {
+		scale_bits = 8,
+		round = 1 << (scale_bits - 1),
+		mask = (1 << scale_bits) - 1
+	};
+
+	const float32x4_t factor = vdupq_n_f32(1 << 23);
+	const int32x4_t mul = vdupq_n_s32(0x0019660dL);
+	const int32x4_t add = vdupq_n_s32(0x3c6ef35fL);
+	const int32x4_t vround = vdupq_n_s32(round);
+	const int32x4_t vmask = vdupq_n_s32(mask);
+
+	uint32_t seed[4];
+	seed[0] = pcm_prng(dither->random);
+	seed[1] = pcm_prng(seed[0]);
+	seed[2] = pcm_prng(seed[1]);
+	seed[3] = pcm_prng(seed[2]);
+	int32x4_t rnd = vreinterpretq_s32_u32(vld1q_u32(seed));
+
+	while (src + 8 <= src_end) {
+		int32x4_t a = vcvtq_s32_f32(vmulq_f32(vld1q_f32(src),
+						      factor));
+		int32x4_t b = vcvtq_s32_f32(vmulq_f32(vld1q_f32(src + 4),
+						      factor));
+
+		int32x4_t prev = rnd;
+		rnd = vaddq_s32(vmulq_s32(rnd, mul), add);
+		int32x4_t noise = vsubq_s32(vandq_s32(rnd, vmask),
+					    vandq_s32(prev, vmask));
+		a = vaddq_s32(vaddq_s32(a, vround), noise);
+
+		prev = rnd;
+		rnd = vaddq_s32(vmulq_s32(rnd, mul), add);
+		noise = vsubq_s32(vandq_s32(rnd, vmask),
+				  vandq_s32(prev, vmask));
+		b = vaddq_s32(vaddq_s32(b, vround), noise);
+
+		a = vshrq_n_s32(a, scale_bits);
+		b = vshrq_n_s32(b, scale_bits);
+
+		vst1q_s16(dest, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+
+		src += 8;
+		dest += 8;
+	}
+
+	dither->random = vgetq_lane_s32(rnd, 0);
+
+	pcm_dither_float_to_16_scalar(dither, dest, src, src_end);
+}
+
+#endif /* __ARM_NEON__ */
+
+typedef void (*pcm_dither_func)(struct pcm_dither *dither,
+				int16_t *dest, const int32_t *src,
+				const int32_t *src_end);
+
+typedef void (*pcm_dither_packed_func)(struct pcm_dither *dither,
+				       int16_t *dest, const uint8_t *src,
+				       const uint8_t *src_end);
+
+typedef void (*pcm_dither_float_func)(struct pcm_dither *dither,
+				      int16_t *dest, const float *src,
+				      const float *src_end);
+
+#ifdef __ARM_NEON__
+static pcm_dither_func pcm_dither_24_to_16_hook = pcm_dither_24_to_16_neon;
+static pcm_dither_func pcm_dither_32_to_16_hook = pcm_dither_32_to_16_neon;
+#else
+static pcm_dither_func pcm_dither_24_to_16_hook = pcm_dither_24_to_16_scalar;
+static pcm_dither_func pcm_dither_32_to_16_hook = pcm_dither_32_to_16_scalar;
+#endif
+
+static pcm_dither_packed_func pcm_dither_24_packed_to_16_hook =
+	pcm_dither_24_packed_to_16_scalar;
+
+#ifdef __ARM_NEON__
+static pcm_dither_float_func pcm_dither_float_to_16_hook =
+	pcm_dither_float_to_16_neon;
+#else
+static pcm_dither_float_func pcm_dither_float_to_16_hook =
+	pcm_dither_float_to_16_scalar;
+#endif
+
+static void
+pcm_dither_dispatch_init(void)
+{
+#ifdef PCM_DISPATCH_X86
+	if (__builtin_cpu_supports("sse4.1")) {
+		pcm_dither_24_to_16_hook = pcm_dither_24_to_16_sse41;
+		pcm_dither_32_to_16_hook = pcm_dither_32_to_16_sse41;
+		pcm_dither_24_packed_to_16_hook =
+			pcm_dither_24_packed_to_16_sse41;
+		pcm_dither_float_to_16_hook = pcm_dither_float_to_16_sse41;
+	}
+#endif
+}
+
+static void
+pcm_dither_dispatch(void)
+{
+	static gsize initialized = 0;
+	if (g_once_init_enter(&initialized)) {
+		pcm_dither_dispatch_init();
+		g_once_init_leave(&initialized, 1);
+	}
+}
+
+void
+pcm_dither_24_to_16(struct pcm_dither *dither,
+		    int16_t *dest, const int32_t *src, const int32_t *src_end)
+{
+	pcm_dither_dispatch();
+	pcm_dither_24_to_16_hook(dither, dest, src, src_end);
+}
+
 void
 pcm_dither_32_to_16(struct pcm_dither *dither,
 		    int16_t *dest, const int32_t *src, const int32_t *src_end)
 {
-	while (src < src_end)
-		*dest++ = pcm_dither_sample_32_to_16(*src++, dither);
+	pcm_dither_dispatch();
+	pcm_dither_32_to_16_hook(dither, dest, src, src_end);
+}
+
+void
+pcm_dither_24_packed_to_16(struct pcm_dither *dither, int16_t *dest,
+			   const uint8_t *src, const uint8_t *src_end)
+{
+	pcm_dither_dispatch();
+	pcm_dither_24_packed_to_16_hook(dither, dest, src, src_end);
+}
+
+void
+pcm_dither_float_to_16(struct pcm_dither *dither, int16_t *dest,
+		       const float *src, const float *src_end)
+{
+	pcm_dither_dispatch();
+	pcm_dither_float_to_16_hook(dither, dest, src, src_end);
 }
@@ -42,4 +42,22 @@ void
 pcm_dither_32_to_16(struct pcm_dither *dither,
 		    int16_t *dest, const int32_t *src, const int32_t *src_end);
 
+/**
+ * Like pcm_dither_24_to_16(), but reads packed 24 bit samples (3
+ * bytes per sample, host byte order), fusing the unpack and the
+ * dither into a single pass over the buffer.
+ */
+void
+pcm_dither_24_packed_to_16(struct pcm_dither *dither, int16_t *dest,
+			   const uint8_t *src, const uint8_t *src_end);
+
+/**
+ * Converts 32 bit floating point samples (-1.0f..1.0f) to dithered 16
+ * bit samples, fusing the scaling and the dither into a single pass
+ * over the buffer.
+ */
+void
+pcm_dither_float_to_16(struct pcm_dither *dither, int16_t *dest,
+		       const float *src, const float *src_end);
+
 #endif
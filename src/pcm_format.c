@@ -47,15 +47,10 @@ pcm_convert_32_to_16(struct pcm_dither *dither,
 }
 
 static void
-pcm_convert_float_to_16(int16_t *out, const float *in, const float *in_end)
+pcm_convert_float_to_16(struct pcm_dither *dither,
+			int16_t *out, const float *in, const float *in_end)
 {
-	const unsigned OUT_BITS = 16;
-	const float factor = 1 << (OUT_BITS - 1);
-
-	while (in < in_end) {
-		int sample = *in++ * factor;
-		*out++ = pcm_clamp_16(sample);
-	}
+	pcm_dither_float_to_16(dither, out, in, in_end);
 }
 
 static int16_t *
@@ -84,15 +79,12 @@ static int16_t *
 pcm_allocate_24_to_16(struct pcm_buffer *buffer, struct pcm_dither *dither,
 		      const uint8_t *src, size_t src_size, size_t *dest_size_r)
 {
-	/* convert to S24_P32 first */
-	size_t tmp_size;
-	int32_t *tmp = pcm_allocate_24_to_24p32(buffer, src, src_size,
-						&tmp_size);
-
-	/* convert to 16 bit in-place */
-	int16_t *dest = (int16_t *)tmp;
-	*dest_size_r = tmp_size / sizeof(*tmp) * sizeof(*dest);
-	pcm_convert_24_to_16(dither, dest, tmp, pcm_end_pointer(tmp, tmp_size));
+	/* unpack and dither in one fused pass over the buffer */
+	int16_t *dest;
+	*dest_size_r = src_size / 3 * sizeof(*dest);
+	dest = pcm_buffer_get(buffer, *dest_size_r);
+	pcm_dither_24_packed_to_16(dither, dest, src,
+				   pcm_end_pointer(src, src_size));
 	return dest;
 }
 
@@ -125,7 +117,7 @@ pcm_allocate_32_to_16(struct pcm_buffer *buffer, struct pcm_dither *dither,
 }
 
 static int16_t *
-pcm_allocate_float_to_16(struct pcm_buffer *buffer,
+pcm_allocate_float_to_16(struct pcm_buffer *buffer, struct pcm_dither *dither,
 			 const float *src, size_t src_size,
 			 size_t *dest_size_r)
 {
@@ -133,7 +125,7 @@ pcm_allocate_float_to_16(struct pcm_buffer *buffer,
 	*dest_size_r = src_size / 2;
 	assert(*dest_size_r == src_size / sizeof(*src) * sizeof(*dest));
 	dest = pcm_buffer_get(buffer, *dest_size_r);
-	pcm_convert_float_to_16(dest, src,
+	pcm_convert_float_to_16(dither, dest, src,
 				pcm_end_pointer(src, src_size));
 	return dest;
 }
@@ -172,8 +164,8 @@ pcm_convert_to_16(struct pcm_buffer *buffer, struct pcm_dither *dither,
 					     dest_size_r);
 
 	case SAMPLE_FORMAT_FLOAT:
-		return pcm_allocate_float_to_16(buffer, src, src_size,
-						dest_size_r);
+		return pcm_allocate_float_to_16(buffer, dither,
+						src, src_size, dest_size_r);
 	}
 
 	return NULL;
@@ -350,12 +342,11 @@ pcm_allocate_24_to_32(struct pcm_buffer *buffer,
 		      const uint8_t *src,
 		      size_t src_size, size_t *dest_size_r)
 {
-	/* convert to S24_P32 first */
-	int32_t *dest = pcm_allocate_24_to_24p32(buffer, src, src_size,
-						 dest_size_r);
-
-	/* convert to 32 bit in-place */
-	pcm_convert_24_to_32(dest, dest, pcm_end_pointer(dest, *dest_size_r));
+	/* unpack and shift in one fused pass over the buffer */
+	int32_t *dest;
+	*dest_size_r = src_size / 3 * sizeof(*dest);
+	dest = pcm_buffer_get(buffer, *dest_size_r);
+	pcm_unpack_24_to_32(dest, src, pcm_end_pointer(src, src_size));
 	return dest;
 }
 
@@ -21,6 +21,7 @@
 #include "pcm_mix.h"
 #include "pcm_volume.h"
 #include "pcm_utils.h"
+#include "pcm_dispatch.h"
 #include "audio_format.h"
 
 #include <glib.h>
@@ -112,6 +113,267 @@ pcm_add_vol_float(float *buffer1, const float *buffer2,
 	}
 }
 
+#ifdef PCM_DISPATCH_X86
+
+/**
+ * Like the volume kernels, the vector mixers skip the dithering: the
+ * packed lanes have no room for the error feedback, and the scalar
+ * tail loop covers at most 15 samples.
+ */
+__attribute__((target("sse2")))
+static void
+pcm_add_vol_16_sse2(int16_t *buffer1, const int16_t *buffer2,
+		    unsigned num_samples, int volume1, int volume2)
+{
+	/* pmaddwd on interleaved lanes computes
+	   sample1 * volume1 + sample2 * volume2 in one instruction */
+	const __m128i mul = _mm_set1_epi32(((volume2 & 0xffff) << 16) |
+					   (volume1 & 0xffff));
+	const __m128i round = _mm_set1_epi32(PCM_VOLUME_1 / 2);
+
+	while (num_samples >= 8) {
+		__m128i s1 = _mm_loadu_si128((const __m128i *)buffer1);
+		__m128i s2 = _mm_loadu_si128((const __m128i *)buffer2);
+		__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(s1, s2), mul);
+		__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(s1, s2), mul);
+
+		lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 10);
+		hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 10);
+
+		_mm_storeu_si128((__m128i *)buffer1, _mm_packs_epi32(lo, hi));
+		buffer1 += 8;
+		buffer2 += 8;
+		num_samples -= 8;
+	}
+
+	pcm_add_vol_16(buffer1, buffer2, num_samples, volume1, volume2);
+}
+
+__attribute__((target("avx2")))
+static void
+pcm_add_vol_16_avx2(int16_t *buffer1, const int16_t *buffer2,
+		    unsigned num_samples, int volume1, int volume2)
+{
+	const __m256i mul = _mm256_set1_epi32(((volume2 & 0xffff) << 16) |
+					      (volume1 & 0xffff));
+	const __m256i round = _mm256_set1_epi32(PCM_VOLUME_1 / 2);
+
+	while (num_samples >= 16) {
+		__m256i s1 = _mm256_loadu_si256((const __m256i *)buffer1);
+		__m256i s2 = _mm256_loadu_si256((const __m256i *)buffer2);
+		__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(s1, s2),
+					       mul);
+		__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(s1, s2),
+					       mul);
+
+		lo = _mm256_srai_epi32(_mm256_add_epi32(lo, round), 10);
+		hi = _mm256_srai_epi32(_mm256_add_epi32(hi, round), 10);
+
+		/* unpacklo/hi are per 128 bit lane; packing again
+		   restores the sample order */
+		_mm256_storeu_si256((__m256i *)buffer1,
+				    _mm256_packs_epi32(lo, hi));
+		buffer1 += 16;
+		buffer2 += 16;
+		num_samples -= 16;
+	}
+
+	pcm_add_vol_16(buffer1, buffer2, num_samples, volume1, volume2);
+}
+
+/**
+ * Both products fit into the 53 bit double mantissa (34 bits for 24
+ * bit samples, 42 bits for 32 bit samples), so the double pipeline is
+ * exact and much faster than the scalar 64 bit division.
+ */
+__attribute__((target("sse2")))
+static void
+pcm_add_vol_24_sse2(int32_t *buffer1, const int32_t *buffer2,
+		    unsigned num_samples, unsigned volume1, unsigned volume2)
+{
+	const __m128d f1 = _mm_set1_pd((double)volume1 / (double)PCM_VOLUME_1);
+	const __m128d f2 = _mm_set1_pd((double)volume2 / (double)PCM_VOLUME_1);
+	const __m128d min = _mm_set1_pd(-(double)(1 << 23));
+	const __m128d max = _mm_set1_pd((double)((1 << 23) - 1));
+
+	while (num_samples >= 4) {
+		__m128i s1 = _mm_loadu_si128((const __m128i *)buffer1);
+		__m128i s2 = _mm_loadu_si128((const __m128i *)buffer2);
+
+		__m128d lo = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(s1), f1),
+					_mm_mul_pd(_mm_cvtepi32_pd(s2), f2));
+		__m128d hi =
+			_mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(s1, 8)),
+					      f1),
+				   _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(s2, 8)),
+					      f2));
+
+		lo = _mm_max_pd(_mm_min_pd(lo, max), min);
+		hi = _mm_max_pd(_mm_min_pd(hi, max), min);
+
+		_mm_storeu_si128((__m128i *)buffer1,
+				 _mm_unpacklo_epi64(_mm_cvtpd_epi32(lo),
+						    _mm_cvtpd_epi32(hi)));
+		buffer1 += 4;
+		buffer2 += 4;
+		num_samples -= 4;
+	}
+
+	pcm_add_vol_24(buffer1, buffer2, num_samples, volume1, volume2);
+}
+
+__attribute__((target("sse2")))
+static void
+pcm_add_vol_32_sse2(int32_t *buffer1, const int32_t *buffer2,
+		    unsigned num_samples, unsigned volume1, unsigned volume2)
+{
+	const __m128d f1 = _mm_set1_pd((double)volume1 / (double)PCM_VOLUME_1);
+	const __m128d f2 = _mm_set1_pd((double)volume2 / (double)PCM_VOLUME_1);
+	const __m128d min = _mm_set1_pd(-2147483648.0);
+	const __m128d max = _mm_set1_pd(2147483647.0);
+
+	while (num_samples >= 4) {
+		__m128i s1 = _mm_loadu_si128((const __m128i *)buffer1);
+		__m128i s2 = _mm_loadu_si128((const __m128i *)buffer2);
+
+		__m128d lo = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(s1), f1),
+					_mm_mul_pd(_mm_cvtepi32_pd(s2), f2));
+		__m128d hi =
+			_mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(s1, 8)),
+					      f1),
+				   _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(s2, 8)),
+					      f2));
+
+		lo = _mm_max_pd(_mm_min_pd(lo, max), min);
+		hi = _mm_max_pd(_mm_min_pd(hi, max), min);
+
+		_mm_storeu_si128((__m128i *)buffer1,
+				 _mm_unpacklo_epi64(_mm_cvtpd_epi32(lo),
+						    _mm_cvtpd_epi32(hi)));
+		buffer1 += 4;
+		buffer2 += 4;
+		num_samples -= 4;
+	}
+
+	pcm_add_vol_32(buffer1, buffer2, num_samples, volume1, volume2);
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+#ifdef __ARM_NEON__
+
+static void
+pcm_add_vol_16_neon(int16_t *buffer1, const int16_t *buffer2,
+		    unsigned num_samples, int volume1, int volume2)
+{
+	const int16x4_t v1 = vdup_n_s16(volume1);
+	const int16x4_t v2 = vdup_n_s16(volume2);
+	const int32x4_t round = vdupq_n_s32(PCM_VOLUME_1 / 2);
+
+	while (num_samples >= 8) {
+		int16x8_t s1 = vld1q_s16(buffer1);
+		int16x8_t s2 = vld1q_s16(buffer2);
+		int32x4_t lo = vmlal_s16(round, vget_low_s16(s1), v1);
+		int32x4_t hi = vmlal_s16(round, vget_high_s16(s1), v1);
+		lo = vmlal_s16(lo, vget_low_s16(s2), v2);
+		hi = vmlal_s16(hi, vget_high_s16(s2), v2);
+
+		lo = vshrq_n_s32(lo, 10);
+		hi = vshrq_n_s32(hi, 10);
+
+		vst1q_s16(buffer1, vcombine_s16(vqmovn_s32(lo),
+						vqmovn_s32(hi)));
+		buffer1 += 8;
+		buffer2 += 8;
+		num_samples -= 8;
+	}
+
+	pcm_add_vol_16(buffer1, buffer2, num_samples, volume1, volume2);
+}
+
+static void
+pcm_add_vol_24_neon(int32_t *buffer1, const int32_t *buffer2,
+		    unsigned num_samples, unsigned volume1, unsigned volume2)
+{
+	const int32x2_t v1 = vdup_n_s32(volume1);
+	const int32x2_t v2 = vdup_n_s32(volume2);
+	const int64x2_t round = vdupq_n_s64(PCM_VOLUME_1 / 2);
+	const int32x4_t min = vdupq_n_s32(-(1 << 23));
+	const int32x4_t max = vdupq_n_s32((1 << 23) - 1);
+
+	while (num_samples >= 4) {
+		int32x4_t s1 = vld1q_s32(buffer1);
+		int32x4_t s2 = vld1q_s32(buffer2);
+		int64x2_t lo = vmlal_s32(vmlal_s32(round,
+						   vget_low_s32(s1), v1),
+					 vget_low_s32(s2), v2);
+		int64x2_t hi = vmlal_s32(vmlal_s32(round,
+						   vget_high_s32(s1), v1),
+					 vget_high_s32(s2), v2);
+
+		lo = vshrq_n_s64(lo, 10);
+		hi = vshrq_n_s64(hi, 10);
+
+		int32x4_t result = vcombine_s32(vmovn_s64(lo), vmovn_s64(hi));
+		result = vmaxq_s32(vminq_s32(result, max), min);
+		vst1q_s32(buffer1, result);
+		buffer1 += 4;
+		buffer2 += 4;
+		num_samples -= 4;
+	}
+
+	pcm_add_vol_24(buffer1, buffer2, num_samples, volume1, volume2);
+}
+
+static void
+pcm_add_vol_32_neon(int32_t *buffer1, const int32_t *buffer2,
+		    unsigned num_samples, unsigned volume1, unsigned volume2)
+{
+	const int32x2_t v1 = vdup_n_s32(volume1);
+	const int32x2_t v2 = vdup_n_s32(volume2);
+	const int64x2_t round = vdupq_n_s64(PCM_VOLUME_1 / 2);
+
+	while (num_samples >= 4) {
+		int32x4_t s1 = vld1q_s32(buffer1);
+		int32x4_t s2 = vld1q_s32(buffer2);
+		int64x2_t lo = vmlal_s32(vmlal_s32(round,
+						   vget_low_s32(s1), v1),
+					 vget_low_s32(s2), v2);
+		int64x2_t hi = vmlal_s32(vmlal_s32(round,
+						   vget_high_s32(s1), v1),
+					 vget_high_s32(s2), v2);
+
+		lo = vshrq_n_s64(lo, 10);
+		hi = vshrq_n_s64(hi, 10);
+
+		/* vqmovn saturates to the 32 bit range */
+		vst1q_s32(buffer1, vcombine_s32(vqmovn_s64(lo),
+						vqmovn_s64(hi)));
+		buffer1 += 4;
+		buffer2 += 4;
+		num_samples -= 4;
+	}
+
+	pcm_add_vol_32(buffer1, buffer2, num_samples, volume1, volume2);
+}
+
+#endif /* __ARM_NEON__ */
+
+typedef void (*pcm_add_vol_16_func)(int16_t *, const int16_t *,
+				    unsigned, int, int);
+typedef void (*pcm_add_vol_32_func)(int32_t *, const int32_t *,
+				    unsigned, unsigned, unsigned);
+
+#ifdef __ARM_NEON__
+static pcm_add_vol_16_func pcm_add_vol_16_hook = pcm_add_vol_16_neon;
+static pcm_add_vol_32_func pcm_add_vol_24_hook = pcm_add_vol_24_neon;
+static pcm_add_vol_32_func pcm_add_vol_32_hook = pcm_add_vol_32_neon;
+#else
+static pcm_add_vol_16_func pcm_add_vol_16_hook = pcm_add_vol_16;
+static pcm_add_vol_32_func pcm_add_vol_24_hook = pcm_add_vol_24;
+static pcm_add_vol_32_func pcm_add_vol_32_hook = pcm_add_vol_32;
+#endif
+
 static bool
 pcm_add_vol(void *buffer1, const void *buffer2, size_t size,
 	    int vol1, int vol2,
@@ -131,18 +393,21 @@ pcm_add_vol(void *buffer1, const void *buffer2, size_t size,
 		return true;
 
 	case SAMPLE_FORMAT_S16:
-		pcm_add_vol_16((int16_t *)buffer1, (const int16_t *)buffer2,
-			       size / 2, vol1, vol2);
+		pcm_add_vol_16_hook((int16_t *)buffer1,
+				    (const int16_t *)buffer2,
+				    size / 2, vol1, vol2);
 		return true;
 
 	case SAMPLE_FORMAT_S24_P32:
-		pcm_add_vol_24((int32_t *)buffer1, (const int32_t *)buffer2,
-			       size / 4, vol1, vol2);
+		pcm_add_vol_24_hook((int32_t *)buffer1,
+				    (const int32_t *)buffer2,
+				    size / 4, vol1, vol2);
 		return true;
 
 	case SAMPLE_FORMAT_S32:
-		pcm_add_vol_32((int32_t *)buffer1, (const int32_t *)buffer2,
-			       size / 4, vol1, vol2);
+		pcm_add_vol_32_hook((int32_t *)buffer1,
+				    (const int32_t *)buffer2,
+				    size / 4, vol1, vol2);
 		return true;
 
 	case SAMPLE_FORMAT_FLOAT:
@@ -224,6 +489,57 @@ pcm_add_float(float *buffer1, const float *buffer2, unsigned num_samples)
 	}
 }
 
+#ifdef PCM_DISPATCH_X86
+
+__attribute__((target("sse2")))
+static void
+pcm_add_16_sse2(int16_t *buffer1, const int16_t *buffer2,
+		unsigned num_samples)
+{
+	/* paddsw saturates, which is exactly what pcm_range() does in
+	   the scalar loop */
+	while (num_samples >= 8) {
+		__m128i s1 = _mm_loadu_si128((const __m128i *)buffer1);
+		__m128i s2 = _mm_loadu_si128((const __m128i *)buffer2);
+
+		_mm_storeu_si128((__m128i *)buffer1, _mm_adds_epi16(s1, s2));
+		buffer1 += 8;
+		buffer2 += 8;
+		num_samples -= 8;
+	}
+
+	pcm_add_16(buffer1, buffer2, num_samples);
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+#ifdef __ARM_NEON__
+
+static void
+pcm_add_16_neon(int16_t *buffer1, const int16_t *buffer2,
+		unsigned num_samples)
+{
+	while (num_samples >= 8) {
+		vst1q_s16(buffer1, vqaddq_s16(vld1q_s16(buffer1),
+					      vld1q_s16(buffer2)));
+		buffer1 += 8;
+		buffer2 += 8;
+		num_samples -= 8;
+	}
+
+	pcm_add_16(buffer1, buffer2, num_samples);
+}
+
+#endif /* __ARM_NEON__ */
+
+typedef void (*pcm_add_16_func)(int16_t *, const int16_t *, unsigned);
+
+#ifdef __ARM_NEON__
+static pcm_add_16_func pcm_add_16_hook = pcm_add_16_neon;
+#else
+static pcm_add_16_func pcm_add_16_hook = pcm_add_16;
+#endif
+
 static bool
 pcm_add(void *buffer1, const void *buffer2, size_t size,
 	enum sample_format format)
@@ -241,7 +557,8 @@ pcm_add(void *buffer1, const void *buffer2, size_t size,
 		return true;
 
 	case SAMPLE_FORMAT_S16:
-		pcm_add_16((int16_t *)buffer1, (const int16_t *)buffer2, size / 2);
+		pcm_add_16_hook((int16_t *)buffer1, (const int16_t *)buffer2,
+				size / 2);
 		return true;
 
 	case SAMPLE_FORMAT_S24_P32:
@@ -262,23 +579,60 @@ pcm_add(void *buffer1, const void *buffer2, size_t size,
 	return false;
 }
 
+/**
+ * The sin^2 constant-power fade envelope, precomputed for each of the
+ * PCM_VOLUME_1 steps the integer mixers quantize to anyway.  This
+ * saves a libm sin() call per chunk during crossfades.
+ */
+static int pcm_mix_envelope[PCM_VOLUME_1 + 1];
+
+static void
+pcm_mix_init(void)
+{
+	for (unsigned i = 0; i <= PCM_VOLUME_1; ++i) {
+		float s = sin(M_PI_2 * i / PCM_VOLUME_1);
+		s *= s;
+
+		int vol = s * PCM_VOLUME_1 + 0.5;
+		pcm_mix_envelope[i] = vol > PCM_VOLUME_1
+			? PCM_VOLUME_1
+			: (vol < 0 ? 0 : vol);
+	}
+
+#ifdef PCM_DISPATCH_X86
+	if (__builtin_cpu_supports("sse2")) {
+		pcm_add_vol_16_hook = pcm_add_vol_16_sse2;
+		pcm_add_vol_24_hook = pcm_add_vol_24_sse2;
+		pcm_add_vol_32_hook = pcm_add_vol_32_sse2;
+		pcm_add_16_hook = pcm_add_16_sse2;
+	}
+
+	if (__builtin_cpu_supports("avx2"))
+		pcm_add_vol_16_hook = pcm_add_vol_16_avx2;
+#endif
+}
+
 bool
 pcm_mix(void *buffer1, const void *buffer2, size_t size,
 	enum sample_format format, float portion1)
 {
 	int vol1;
-	float s;
+
+	static gsize initialized = 0;
+	if (g_once_init_enter(&initialized)) {
+		pcm_mix_init();
+		g_once_init_leave(&initialized, 1);
+	}
 
 	/* portion1 is between 0.0 and 1.0 for crossfading, MixRamp uses NaN
 	 * to signal mixing rather than fading */
 	if (isnan(portion1))
 		return pcm_add(buffer1, buffer2, size, format);
 
-	s = sin(M_PI_2 * portion1);
-	s *= s;
+	int i = portion1 * PCM_VOLUME_1 + 0.5;
+	i = i > PCM_VOLUME_1 ? PCM_VOLUME_1 : (i < 0 ? 0 : i);
 
-	vol1 = s * PCM_VOLUME_1 + 0.5;
-	vol1 = vol1 > PCM_VOLUME_1 ? PCM_VOLUME_1 : (vol1 < 0 ? 0 : vol1);
+	vol1 = pcm_mix_envelope[i];
 
 	return pcm_add_vol(buffer1, buffer2, size, vol1, PCM_VOLUME_1 - vol1, format);
 }
@@ -18,6 +18,7 @@
  */
 
 #include "pcm_pack.h"
+#include "pcm_dispatch.h"
 
 #include <glib.h>
 
@@ -34,23 +35,24 @@ pack_sample(uint8_t *dest, const int32_t *src0, bool reverse_endian)
 	*dest++ = *src++;
 }
 
-void
-pcm_pack_24(uint8_t *dest, const int32_t *src, const int32_t *src_end,
-	    bool reverse_endian)
+/* duplicate loops to help the compiler's optimizer (constant
+   parameter to the pack_sample() inline function) */
+
+static void
+pcm_pack_24_host(uint8_t *dest, const int32_t *src, const int32_t *src_end)
 {
-	/* duplicate loop to help the compiler's optimizer (constant
-	   parameter to the pack_sample() inline function) */
+	while (src < src_end) {
+		pack_sample(dest, src++, false);
+		dest += 3;
+	}
+}
 
-	if (G_LIKELY(!reverse_endian)) {
-		while (src < src_end) {
-			pack_sample(dest, src++, false);
-			dest += 3;
-		}
-	} else {
-		while (src < src_end) {
-			pack_sample(dest, src++, true);
-			dest += 3;
-		}
+static void
+pcm_pack_24_swapped(uint8_t *dest, const int32_t *src, const int32_t *src_end)
+{
+	while (src < src_end) {
+		pack_sample(dest, src++, true);
+		dest += 3;
 	}
 }
 
@@ -72,22 +74,254 @@ unpack_sample(int32_t *dest0, const uint8_t *src, bool reverse_endian)
 		*dest++ = *src & 0x80 ? 0xff : 0x00;
 }
 
+static void
+pcm_unpack_24_host(int32_t *dest, const uint8_t *src, const uint8_t *src_end)
+{
+	while (src < src_end) {
+		unpack_sample(dest++, src, false);
+		src += 3;
+	}
+}
+
+static void
+pcm_unpack_24_swapped(int32_t *dest, const uint8_t *src,
+		      const uint8_t *src_end)
+{
+	while (src < src_end) {
+		unpack_sample(dest++, src, true);
+		src += 3;
+	}
+}
+
+static void
+pcm_unpack_24_to_32_scalar(int32_t *dest, const uint8_t *src,
+			   const uint8_t *src_end)
+{
+	while (src < src_end) {
+		int32_t sample;
+
+		unpack_sample(&sample, src, false);
+		*dest++ = sample << 8;
+		src += 3;
+	}
+}
+
+#ifdef PCM_DISPATCH_X86
+
+/* x86 is little-endian, so the SIMD kernels only implement the host
+   byte order layout: the least significant three bytes of each 32 bit
+   sample */
+
+__attribute__((target("ssse3")))
+static void
+pcm_pack_24_ssse3(uint8_t *dest, const int32_t *src, const int32_t *src_end)
+{
+	const __m128i shuf = _mm_setr_epi8(0, 1, 2, 4, 5, 6,
+					   8, 9, 10, 12, 13, 14,
+					   -1, -1, -1, -1);
+
+	/* each store writes 16 bytes, although only 12 are wanted;
+	   requiring 8 remaining source samples (= 24 destination
+	   bytes) keeps the overhang inside the destination buffer */
+	while (src + 8 <= src_end) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+		_mm_storeu_si128((__m128i *)dest, _mm_shuffle_epi8(v, shuf));
+		src += 4;
+		dest += 12;
+	}
+
+	pcm_pack_24_host(dest, src, src_end);
+}
+
+/**
+ * Moves each 3 byte group into the upper bytes of a 32 bit lane; the
+ * caller scales the lanes back down with an arithmetic (sign
+ * extending) or logical (zero padding) right shift.
+ */
+__attribute__((target("ssse3")))
+static inline __m128i
+pcm_unpack_24_shuffle(__m128i v)
+{
+	const __m128i shuf = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+					   -1, 6, 7, 8, -1, 9, 10, 11);
+
+	return _mm_shuffle_epi8(v, shuf);
+}
+
+__attribute__((target("ssse3")))
+static void
+pcm_unpack_24_ssse3(int32_t *dest, const uint8_t *src, const uint8_t *src_end)
+{
+	/* each load reads 16 bytes, although only 12 are consumed;
+	   stop early so it cannot touch bytes past the end of the
+	   source buffer */
+	while (src + 16 <= src_end) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+		v = _mm_srai_epi32(pcm_unpack_24_shuffle(v), 8);
+		_mm_storeu_si128((__m128i *)dest, v);
+		src += 12;
+		dest += 4;
+	}
+
+	pcm_unpack_24_host(dest, src, src_end);
+}
+
+__attribute__((target("ssse3")))
+static void
+pcm_unpack_24_to_32_ssse3(int32_t *dest, const uint8_t *src,
+			  const uint8_t *src_end)
+{
+	/* same as pcm_unpack_24_ssse3(), except that the samples stay
+	   in the upper 24 bits, which is exactly the "<< 8" the 32
+	   bit conversion would apply afterwards */
+	while (src + 16 <= src_end) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+		_mm_storeu_si128((__m128i *)dest, pcm_unpack_24_shuffle(v));
+		src += 12;
+		dest += 4;
+	}
+
+	pcm_unpack_24_to_32_scalar(dest, src, src_end);
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+#if defined(__ARM_NEON__) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+
+/* the de-interleaving loads below assume the little-endian layout;
+   big-endian NEON targets fall back to the scalar loops */
+
+static void
+pcm_pack_24_neon(uint8_t *dest, const int32_t *src, const int32_t *src_end)
+{
+	while (src + 8 <= src_end) {
+		uint8x8x4_t v = vld4_u8((const uint8_t *)src);
+		uint8x8x3_t p;
+
+		p.val[0] = v.val[0];
+		p.val[1] = v.val[1];
+		p.val[2] = v.val[2];
+		vst3_u8(dest, p);
+
+		src += 8;
+		dest += 24;
+	}
+
+	pcm_pack_24_host(dest, src, src_end);
+}
+
+static void
+pcm_unpack_24_neon(int32_t *dest, const uint8_t *src, const uint8_t *src_end)
+{
+	while (src + 24 <= src_end) {
+		uint8x8x3_t p = vld3_u8(src);
+		uint8x8x4_t v;
+
+		v.val[0] = p.val[0];
+		v.val[1] = p.val[1];
+		v.val[2] = p.val[2];
+		/* the fourth byte is the extended sign bit */
+		v.val[3] = vreinterpret_u8_s8(vshr_n_s8(vreinterpret_s8_u8(p.val[2]),
+							7));
+		vst4_u8((uint8_t *)dest, v);
+
+		src += 24;
+		dest += 8;
+	}
+
+	pcm_unpack_24_host(dest, src, src_end);
+}
+
+static void
+pcm_unpack_24_to_32_neon(int32_t *dest, const uint8_t *src,
+			 const uint8_t *src_end)
+{
+	while (src + 24 <= src_end) {
+		uint8x8x3_t p = vld3_u8(src);
+		uint8x8x4_t v;
+
+		/* shift the samples into the upper 24 bits by
+		   inserting a zero byte below them */
+		v.val[0] = vdup_n_u8(0);
+		v.val[1] = p.val[0];
+		v.val[2] = p.val[1];
+		v.val[3] = p.val[2];
+		vst4_u8((uint8_t *)dest, v);
+
+		src += 24;
+		dest += 8;
+	}
+
+	pcm_unpack_24_to_32_scalar(dest, src, src_end);
+}
+
+#define PCM_PACK_NEON
+
+#endif /* __ARM_NEON__ */
+
+typedef void (*pcm_pack_24_func)(uint8_t *dest, const int32_t *src,
+				 const int32_t *src_end);
+typedef void (*pcm_unpack_24_func)(int32_t *dest, const uint8_t *src,
+				   const uint8_t *src_end);
+
+#ifdef PCM_PACK_NEON
+static pcm_pack_24_func pcm_pack_24_hook = pcm_pack_24_neon;
+static pcm_unpack_24_func pcm_unpack_24_hook = pcm_unpack_24_neon;
+static pcm_unpack_24_func pcm_unpack_24_to_32_hook = pcm_unpack_24_to_32_neon;
+#else
+static pcm_pack_24_func pcm_pack_24_hook = pcm_pack_24_host;
+static pcm_unpack_24_func pcm_unpack_24_hook = pcm_unpack_24_host;
+static pcm_unpack_24_func pcm_unpack_24_to_32_hook =
+	pcm_unpack_24_to_32_scalar;
+#endif
+
+static void
+pcm_pack_dispatch_init(void)
+{
+#ifdef PCM_DISPATCH_X86
+	if (__builtin_cpu_supports("ssse3")) {
+		pcm_pack_24_hook = pcm_pack_24_ssse3;
+		pcm_unpack_24_hook = pcm_unpack_24_ssse3;
+		pcm_unpack_24_to_32_hook = pcm_unpack_24_to_32_ssse3;
+	}
+#endif
+}
+
+static void
+pcm_pack_dispatch(void)
+{
+	static gsize initialized = 0;
+	if (g_once_init_enter(&initialized)) {
+		pcm_pack_dispatch_init();
+		g_once_init_leave(&initialized, 1);
+	}
+}
+
+void
+pcm_pack_24(uint8_t *dest, const int32_t *src, const int32_t *src_end,
+	    bool reverse_endian)
+{
+	if (G_LIKELY(!reverse_endian)) {
+		pcm_pack_dispatch();
+		pcm_pack_24_hook(dest, src, src_end);
+	} else
+		pcm_pack_24_swapped(dest, src, src_end);
+}
+
 void
 pcm_unpack_24(int32_t *dest, const uint8_t *src, const uint8_t *src_end,
 	      bool reverse_endian)
 {
-	/* duplicate loop to help the compiler's optimizer (constant
-	   parameter to the unpack_sample() inline function) */
-
 	if (G_LIKELY(!reverse_endian)) {
-		while (src < src_end) {
-			unpack_sample(dest++, src, false);
-			src += 3;
-		}
-	} else {
-		while (src < src_end) {
-			unpack_sample(dest++, src, true);
-			src += 3;
-		}
-	}
+		pcm_pack_dispatch();
+		pcm_unpack_24_hook(dest, src, src_end);
+	} else
+		pcm_unpack_24_swapped(dest, src, src_end);
+}
+
+void
+pcm_unpack_24_to_32(int32_t *dest, const uint8_t *src, const uint8_t *src_end)
+{
+	pcm_pack_dispatch();
+	pcm_unpack_24_to_32_hook(dest, src, src_end);
 }
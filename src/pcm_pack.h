@@ -56,4 +56,15 @@ void
 pcm_unpack_24(int32_t *dest, const uint8_t *src, const uint8_t *src_end,
 	      bool reverse_endian);
 
+/**
+ * Converts packed 24 bit samples (3 bytes per sample, host byte
+ * order) directly to 32 bit samples, without an intermediate S24_P32
+ * pass over the buffer.
+ *
+ * @param dest the destination buffer
+ * @param src the source buffer (array of triples)
+ */
+void
+pcm_unpack_24_to_32(int32_t *dest, const uint8_t *src, const uint8_t *src_end);
+
 #endif
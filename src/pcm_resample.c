@@ -19,71 +19,105 @@
 
 #include "config.h"
 #include "pcm_resample_internal.h"
-
-#ifdef HAVE_LIBSAMPLERATE
 #include "conf.h"
-#endif
 
 #include <string.h>
 
-#ifdef HAVE_LIBSAMPLERATE
-static bool lsr_enabled;
-#endif
+enum pcm_resample_backend {
+	/** the nearest-neighbour "internal" resampler */
+	PCM_RESAMPLE_FALLBACK,
 
-#ifdef HAVE_LIBSAMPLERATE
-static bool
-pcm_resample_lsr_enabled(void)
-{
-	return lsr_enabled;
-}
-#endif
+	/** the integrated windowed-sinc "polyphase" resampler */
+	PCM_RESAMPLE_POLY,
+
+	/** libsamplerate */
+	PCM_RESAMPLE_LSR,
+};
+
+static enum pcm_resample_backend backend = PCM_RESAMPLE_FALLBACK;
 
 bool
 pcm_resample_global_init(GError **error_r)
 {
-#ifdef HAVE_LIBSAMPLERATE
 	const char *converter =
 		config_get_string(CONF_SAMPLERATE_CONVERTER, "");
 
-	lsr_enabled = strcmp(converter, "internal") != 0;
-	if (lsr_enabled)
-		return pcm_resample_lsr_global_init(converter, error_r);
-	else
+	if (strcmp(converter, "internal") == 0) {
+		backend = PCM_RESAMPLE_FALLBACK;
+		return true;
+	}
+
+	if (strcmp(converter, "polyphase") == 0) {
+		backend = PCM_RESAMPLE_POLY;
 		return true;
+	}
+
+#ifdef HAVE_LIBSAMPLERATE
+	backend = PCM_RESAMPLE_LSR;
+	return pcm_resample_lsr_global_init(converter, error_r);
 #else
 	(void)error_r;
+
+	backend = PCM_RESAMPLE_FALLBACK;
 	return true;
 #endif
 }
 
 void pcm_resample_init(struct pcm_resample_state *state)
 {
+	switch (backend) {
 #ifdef HAVE_LIBSAMPLERATE
-	if (pcm_resample_lsr_enabled())
+	case PCM_RESAMPLE_LSR:
 		pcm_resample_lsr_init(state);
-	else
+		break;
 #endif
+
+	case PCM_RESAMPLE_POLY:
+		pcm_resample_poly_init(state);
+		break;
+
+	default:
 		pcm_resample_fallback_init(state);
+		break;
+	}
 }
 
 void pcm_resample_deinit(struct pcm_resample_state *state)
 {
+	switch (backend) {
 #ifdef HAVE_LIBSAMPLERATE
-	if (pcm_resample_lsr_enabled())
+	case PCM_RESAMPLE_LSR:
 		pcm_resample_lsr_deinit(state);
-	else
+		break;
 #endif
+
+	case PCM_RESAMPLE_POLY:
+		pcm_resample_poly_deinit(state);
+		break;
+
+	default:
 		pcm_resample_fallback_deinit(state);
+		break;
+	}
 }
 
 void
 pcm_resample_reset(struct pcm_resample_state *state)
 {
+	switch (backend) {
 #ifdef HAVE_LIBSAMPLERATE
-	pcm_resample_lsr_reset(state);
-#else
-	(void)state;
+	case PCM_RESAMPLE_LSR:
+		pcm_resample_lsr_reset(state);
+		break;
 #endif
+
+	case PCM_RESAMPLE_POLY:
+		pcm_resample_poly_reset(state);
+		break;
+
+	default:
+		break;
+	}
 }
 
 const float *
@@ -94,24 +128,33 @@ pcm_resample_float(struct pcm_resample_state *state,
 		   unsigned dest_rate, size_t *dest_size_r,
 		   GError **error_r)
 {
+	switch (backend) {
 #ifdef HAVE_LIBSAMPLERATE
-	if (pcm_resample_lsr_enabled())
+	case PCM_RESAMPLE_LSR:
 		return pcm_resample_lsr_float(state, channels,
 					      src_rate, src_buffer, src_size,
 					      dest_rate, dest_size_r,
 					      error_r);
-#else
-	(void)error_r;
 #endif
 
-	/* sizeof(float)==sizeof(int32_t); the fallback resampler does
-	   not do any math on the sample values, so this hack is
-	   possible: */
-	return (const float *)
-		pcm_resample_fallback_32(state, channels,
-					 src_rate, (const int32_t *)src_buffer,
-					 src_size,
-					 dest_rate, dest_size_r);
+	case PCM_RESAMPLE_POLY:
+		return pcm_resample_poly_float(state, channels,
+					       src_rate, src_buffer, src_size,
+					       dest_rate, dest_size_r);
+
+	default:
+		(void)error_r;
+
+		/* sizeof(float)==sizeof(int32_t); the fallback
+		   resampler does not do any math on the sample
+		   values, so this hack is possible: */
+		return (const float *)
+			pcm_resample_fallback_32(state, channels,
+						 src_rate,
+						 (const int32_t *)src_buffer,
+						 src_size,
+						 dest_rate, dest_size_r);
+	}
 }
 
 const int16_t *
@@ -121,19 +164,27 @@ pcm_resample_16(struct pcm_resample_state *state,
 		unsigned dest_rate, size_t *dest_size_r,
 		GError **error_r)
 {
+	switch (backend) {
 #ifdef HAVE_LIBSAMPLERATE
-	if (pcm_resample_lsr_enabled())
+	case PCM_RESAMPLE_LSR:
 		return pcm_resample_lsr_16(state, channels,
 					   src_rate, src_buffer, src_size,
 					   dest_rate, dest_size_r,
 					   error_r);
-#else
-	(void)error_r;
 #endif
 
-	return pcm_resample_fallback_16(state, channels,
-					src_rate, src_buffer, src_size,
-					dest_rate, dest_size_r);
+	case PCM_RESAMPLE_POLY:
+		return pcm_resample_poly_16(state, channels,
+					    src_rate, src_buffer, src_size,
+					    dest_rate, dest_size_r);
+
+	default:
+		(void)error_r;
+
+		return pcm_resample_fallback_16(state, channels,
+						src_rate, src_buffer, src_size,
+						dest_rate, dest_size_r);
+	}
 }
 
 const int32_t *
@@ -143,17 +194,25 @@ pcm_resample_32(struct pcm_resample_state *state,
 		unsigned dest_rate, size_t *dest_size_r,
 		GError **error_r)
 {
+	switch (backend) {
 #ifdef HAVE_LIBSAMPLERATE
-	if (pcm_resample_lsr_enabled())
+	case PCM_RESAMPLE_LSR:
 		return pcm_resample_lsr_32(state, channels,
 					   src_rate, src_buffer, src_size,
 					   dest_rate, dest_size_r,
 					   error_r);
-#else
-	(void)error_r;
 #endif
 
-	return pcm_resample_fallback_32(state, channels,
-					src_rate, src_buffer, src_size,
-					dest_rate, dest_size_r);
+	case PCM_RESAMPLE_POLY:
+		return pcm_resample_poly_32(state, channels,
+					    src_rate, src_buffer, src_size,
+					    dest_rate, dest_size_r);
+
+	default:
+		(void)error_r;
+
+		return pcm_resample_fallback_32(state, channels,
+						src_rate, src_buffer, src_size,
+						dest_rate, dest_size_r);
+	}
 }
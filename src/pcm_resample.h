@@ -31,6 +31,13 @@
 #include <samplerate.h>
 #endif
 
+/**
+ * The filter length of the "polyphase" resampler.  Between two
+ * chunks, up to one filter length of input frames per channel is
+ * carried over in the history buffer.
+ */
+#define PCM_RESAMPLE_POLY_TAPS 16
+
 /**
  * This object is statically allocated (within another struct), and
  * holds buffer allocations and the state for the resampler.
@@ -51,6 +58,42 @@ struct pcm_resample_state {
 	int error;
 #endif
 
+	/**
+	 * State of the "polyphase" resampler (see
+	 * pcm_resample_poly.c).
+	 */
+	struct {
+		/**
+		 * The windowed-sinc coefficient table, rebuilt
+		 * whenever the stream parameters change.
+		 */
+		float *table;
+
+		/**
+		 * Scratch buffer for the de-interleaved input planes.
+		 */
+		struct pcm_buffer planes;
+
+		/**
+		 * The tail of the previous chunk's planes (at most
+		 * one filter length per channel; 8 = MAX_CHANNELS).
+		 */
+		float history[PCM_RESAMPLE_POLY_TAPS * 8];
+		unsigned history_frames;
+
+		/**
+		 * The fractional input read position, in 32.32 fixed
+		 * point, relative to the start of the history.
+		 */
+		uint64_t position;
+
+		struct {
+			unsigned src_rate;
+			unsigned dest_rate;
+			unsigned channels;
+		} prev;
+	} poly;
+
 	struct pcm_buffer buffer;
 };
 
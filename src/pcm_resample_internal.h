@@ -71,6 +71,39 @@ pcm_resample_lsr_32(struct pcm_resample_state *state,
 
 #endif
 
+void
+pcm_resample_poly_init(struct pcm_resample_state *state);
+
+void
+pcm_resample_poly_deinit(struct pcm_resample_state *state);
+
+void
+pcm_resample_poly_reset(struct pcm_resample_state *state);
+
+const float *
+pcm_resample_poly_float(struct pcm_resample_state *state,
+			unsigned channels,
+			unsigned src_rate,
+			const float *src_buffer, size_t src_size,
+			unsigned dest_rate,
+			size_t *dest_size_r);
+
+const int16_t *
+pcm_resample_poly_16(struct pcm_resample_state *state,
+		     unsigned channels,
+		     unsigned src_rate,
+		     const int16_t *src_buffer, size_t src_size,
+		     unsigned dest_rate,
+		     size_t *dest_size_r);
+
+const int32_t *
+pcm_resample_poly_32(struct pcm_resample_state *state,
+		     unsigned channels,
+		     unsigned src_rate,
+		     const int32_t *src_buffer, size_t src_size,
+		     unsigned dest_rate,
+		     size_t *dest_size_r);
+
 void
 pcm_resample_fallback_init(struct pcm_resample_state *state);
 
@@ -0,0 +1,461 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * The "polyphase" resampler: a windowed-sinc interpolator with a
+ * phase-interpolated coefficient table and SIMD dot product kernels.
+ * It is much better than the nearest-neighbour "internal" resampler,
+ * and much cheaper than the libsamplerate sinc converters, at the
+ * price of a shorter filter (#POLY_TAPS taps).
+ *
+ * The input is de-interleaved into one float plane per channel, with
+ * the tail of the previous chunk prepended, so each output sample is
+ * a contiguous dot product which vectorizes trivially.
+ */
+
+#include "config.h"
+#include "pcm_resample_internal.h"
+#include "pcm_dispatch.h"
+#include "pcm_utils.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "pcm"
+
+#define POLY_TAPS PCM_RESAMPLE_POLY_TAPS
+
+/**
+ * The number of pre-computed filter phases.  The fractional position
+ * between two phases is covered by linearly interpolating the
+ * adjacent phases, so the table error is negligible even with this
+ * moderate count; the table stays small enough for the L1 cache.
+ */
+#define POLY_PHASES 64
+
+/**
+ * The input index of the "current" sample relative to the first
+ * filter tap (the filter's group delay, in frames).
+ */
+#define POLY_CENTER (POLY_TAPS / 2 - 1)
+
+static float
+poly_dot_scalar(const float *taps, const float *in)
+{
+	float sum = 0;
+
+	for (unsigned k = 0; k < POLY_TAPS; ++k)
+		sum += taps[k] * in[k];
+
+	return sum;
+}
+
+#ifdef PCM_DISPATCH_X86
+
+__attribute__((target("sse")))
+static float
+poly_dot_sse(const float *taps, const float *in)
+{
+	__m128 sum = _mm_mul_ps(_mm_loadu_ps(taps), _mm_loadu_ps(in));
+	sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(taps + 4),
+					 _mm_loadu_ps(in + 4)));
+	sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(taps + 8),
+					 _mm_loadu_ps(in + 8)));
+	sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(taps + 12),
+					 _mm_loadu_ps(in + 12)));
+
+	/* horizontal sum */
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+#ifdef __ARM_NEON__
+
+static float
+poly_dot_neon(const float *taps, const float *in)
+{
+	float32x4_t sum = vmulq_f32(vld1q_f32(taps), vld1q_f32(in));
+	sum = vmlaq_f32(sum, vld1q_f32(taps + 4), vld1q_f32(in + 4));
+	sum = vmlaq_f32(sum, vld1q_f32(taps + 8), vld1q_f32(in + 8));
+	sum = vmlaq_f32(sum, vld1q_f32(taps + 12), vld1q_f32(in + 12));
+
+	float32x2_t s = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+	s = vpadd_f32(s, s);
+	return vget_lane_f32(s, 0);
+}
+
+#endif /* __ARM_NEON__ */
+
+typedef float (*poly_dot_func)(const float *taps, const float *in);
+
+#ifdef __ARM_NEON__
+static poly_dot_func poly_dot_hook = poly_dot_neon;
+#else
+static poly_dot_func poly_dot_hook = poly_dot_scalar;
+#endif
+
+static void
+poly_dispatch_init(void)
+{
+#ifdef PCM_DISPATCH_X86
+	if (__builtin_cpu_supports("sse"))
+		poly_dot_hook = poly_dot_sse;
+#endif
+}
+
+static void
+poly_dispatch(void)
+{
+	static gsize initialized = 0;
+	if (g_once_init_enter(&initialized)) {
+		poly_dispatch_init();
+		g_once_init_leave(&initialized, 1);
+	}
+}
+
+/**
+ * Generates the coefficient table: POLY_PHASES+1 phases of a
+ * Blackman-windowed sinc filter, each normalized to unity DC gain.
+ * The extra phase at the end is the fraction 1.0 variant, which makes
+ * the linear interpolation between adjacent phases wrap-free.
+ */
+static float *
+poly_table_new(unsigned src_rate, unsigned dest_rate)
+{
+	float *table = g_new(float, (POLY_PHASES + 1) * POLY_TAPS);
+
+	/* cut off slightly below the lower of the two Nyquist
+	   frequencies, leaving room for the transition band */
+	double cutoff = 0.91;
+	if (dest_rate < src_rate)
+		cutoff *= (double)dest_rate / src_rate;
+
+	for (unsigned p = 0; p <= POLY_PHASES; ++p) {
+		float *taps = table + p * POLY_TAPS;
+		double f = (double)p / POLY_PHASES;
+		double sum = 0;
+
+		for (unsigned k = 0; k < POLY_TAPS; ++k) {
+			double x = (double)k - POLY_CENTER - f;
+			double w = 0.42
+				+ 0.5 * cos(2 * M_PI * x / POLY_TAPS)
+				+ 0.08 * cos(4 * M_PI * x / POLY_TAPS);
+			double h = x == 0.0
+				? cutoff
+				: sin(M_PI * cutoff * x) / (M_PI * x);
+
+			taps[k] = h * w;
+			sum += taps[k];
+		}
+
+		for (unsigned k = 0; k < POLY_TAPS; ++k)
+			taps[k] /= sum;
+	}
+
+	return table;
+}
+
+/**
+ * The input position advance per output frame, in 32.32 fixed point.
+ */
+static inline uint64_t
+poly_step(unsigned src_rate, unsigned dest_rate)
+{
+	return ((uint64_t)src_rate << 32) / dest_rate;
+}
+
+/**
+ * Splits an input position into the integer frame index, the filter
+ * phase and the blend weight between this phase and the next one.
+ */
+static inline unsigned
+poly_phase(uint64_t pos, const float *table,
+	   const float **taps_r, float *blend_r)
+{
+	uint64_t frac = (uint32_t)pos * (uint64_t)POLY_PHASES;
+
+	*taps_r = table + (frac >> 32) * POLY_TAPS;
+	*blend_r = (uint32_t)frac * (1.0f / 4294967296.0f);
+	return pos >> 32;
+}
+
+void
+pcm_resample_poly_init(struct pcm_resample_state *state)
+{
+	memset(&state->poly, 0, sizeof(state->poly));
+
+	pcm_buffer_init(&state->poly.planes);
+	pcm_buffer_init(&state->buffer);
+}
+
+void
+pcm_resample_poly_deinit(struct pcm_resample_state *state)
+{
+	g_free(state->poly.table);
+
+	pcm_buffer_deinit(&state->poly.planes);
+	pcm_buffer_deinit(&state->buffer);
+}
+
+void
+pcm_resample_poly_reset(struct pcm_resample_state *state)
+{
+	/* drop the carried history: blending across a seek would
+	   smear the discontinuity over the filter length */
+	state->poly.history_frames = 0;
+	state->poly.position = 0;
+}
+
+/**
+ * Common part of the per-format entry points: rebuild the coefficient
+ * table if the stream parameters have changed, obtain the plane
+ * buffer and prepend the carried history.
+ *
+ * @param total_r the number of frames per plane
+ * @param n_out_r the number of output frames which can be produced
+ * @return the plane buffer (one contiguous plane per channel)
+ */
+static float *
+poly_prepare(struct pcm_resample_state *state, unsigned channels,
+	     unsigned src_rate, unsigned dest_rate, unsigned src_frames,
+	     unsigned *total_r, unsigned *n_out_r)
+{
+	poly_dispatch();
+
+	if (channels != state->poly.prev.channels ||
+	    src_rate != state->poly.prev.src_rate ||
+	    dest_rate != state->poly.prev.dest_rate) {
+		g_free(state->poly.table);
+		state->poly.table = poly_table_new(src_rate, dest_rate);
+		state->poly.history_frames = 0;
+		state->poly.position = 0;
+
+		state->poly.prev.channels = channels;
+		state->poly.prev.src_rate = src_rate;
+		state->poly.prev.dest_rate = dest_rate;
+	}
+
+	unsigned history_frames = state->poly.history_frames;
+	unsigned total = history_frames + src_frames;
+	float *planes = pcm_buffer_get(&state->poly.planes,
+				       total * channels * sizeof(*planes));
+
+	for (unsigned c = 0; c < channels; ++c)
+		memcpy(planes + c * total,
+		       state->poly.history + c * history_frames,
+		       history_frames * sizeof(*planes));
+
+	unsigned n_out = 0;
+	if (total >= POLY_TAPS) {
+		uint64_t limit = (uint64_t)(total - POLY_TAPS + 1) << 32;
+		if (state->poly.position < limit) {
+			uint64_t step = poly_step(src_rate, dest_rate);
+			n_out = (limit - state->poly.position + step - 1)
+				/ step;
+		}
+	}
+
+	*total_r = total;
+	*n_out_r = n_out;
+	return planes;
+}
+
+/**
+ * Saves the plane tail which the next chunk's first output frames
+ * will still need, and rebases the position on it.
+ */
+static void
+poly_trim(struct pcm_resample_state *state, const float *planes,
+	  unsigned channels, unsigned total, uint64_t pos)
+{
+	unsigned keep_from = pos >> 32;
+	if (keep_from > total)
+		keep_from = total;
+
+	unsigned history_frames = total - keep_from;
+	assert(history_frames <= POLY_TAPS);
+
+	for (unsigned c = 0; c < channels; ++c)
+		memcpy(state->poly.history + c * history_frames,
+		       planes + c * total + keep_from,
+		       history_frames * sizeof(*planes));
+
+	state->poly.history_frames = history_frames;
+	state->poly.position = pos - ((uint64_t)keep_from << 32);
+}
+
+const int16_t *
+pcm_resample_poly_16(struct pcm_resample_state *state,
+		     unsigned channels,
+		     unsigned src_rate,
+		     const int16_t *src_buffer, size_t src_size,
+		     unsigned dest_rate,
+		     size_t *dest_size_r)
+{
+	unsigned src_frames = src_size / channels / sizeof(*src_buffer);
+	unsigned total, n_out;
+	float *planes = poly_prepare(state, channels, src_rate, dest_rate,
+				     src_frames, &total, &n_out);
+
+	assert((src_size % (sizeof(*src_buffer) * channels)) == 0);
+
+	for (unsigned c = 0; c < channels; ++c) {
+		float *p = planes + c * total + state->poly.history_frames;
+		const int16_t *s = src_buffer + c;
+
+		for (unsigned i = 0; i < src_frames; ++i, s += channels)
+			p[i] = *s * (1.0f / (1 << 15));
+	}
+
+	size_t dest_size = n_out * channels * sizeof(int16_t);
+	int16_t *dest_buffer = pcm_buffer_get(&state->buffer, dest_size);
+	int16_t *dest = dest_buffer;
+
+	uint64_t pos = state->poly.position;
+	const uint64_t step = poly_step(src_rate, dest_rate);
+	for (unsigned i = 0; i < n_out; ++i, pos += step) {
+		const float *taps;
+		float blend;
+		unsigned idx = poly_phase(pos, state->poly.table,
+					  &taps, &blend);
+
+		for (unsigned c = 0; c < channels; ++c) {
+			const float *in = planes + c * total + idx;
+			float a = poly_dot_hook(taps, in);
+			float b = poly_dot_hook(taps + POLY_TAPS, in);
+			float x = (a + (b - a) * blend) * (1 << 15);
+
+			*dest++ = pcm_range(lrintf(x), 16);
+		}
+	}
+
+	poly_trim(state, planes, channels, total, pos);
+
+	*dest_size_r = dest_size;
+	return dest_buffer;
+}
+
+const int32_t *
+pcm_resample_poly_32(struct pcm_resample_state *state,
+		     unsigned channels,
+		     unsigned src_rate,
+		     const int32_t *src_buffer, size_t src_size,
+		     unsigned dest_rate,
+		     size_t *dest_size_r)
+{
+	unsigned src_frames = src_size / channels / sizeof(*src_buffer);
+	unsigned total, n_out;
+	float *planes = poly_prepare(state, channels, src_rate, dest_rate,
+				     src_frames, &total, &n_out);
+
+	assert((src_size % (sizeof(*src_buffer) * channels)) == 0);
+
+	for (unsigned c = 0; c < channels; ++c) {
+		float *p = planes + c * total + state->poly.history_frames;
+		const int32_t *s = src_buffer + c;
+
+		for (unsigned i = 0; i < src_frames; ++i, s += channels)
+			p[i] = *s * (1.0f / 2147483648.0f);
+	}
+
+	size_t dest_size = n_out * channels * sizeof(int32_t);
+	int32_t *dest_buffer = pcm_buffer_get(&state->buffer, dest_size);
+	int32_t *dest = dest_buffer;
+
+	uint64_t pos = state->poly.position;
+	const uint64_t step = poly_step(src_rate, dest_rate);
+	for (unsigned i = 0; i < n_out; ++i, pos += step) {
+		const float *taps;
+		float blend;
+		unsigned idx = poly_phase(pos, state->poly.table,
+					  &taps, &blend);
+
+		for (unsigned c = 0; c < channels; ++c) {
+			const float *in = planes + c * total + idx;
+			float a = poly_dot_hook(taps, in);
+			float b = poly_dot_hook(taps + POLY_TAPS, in);
+			float x = (a + (b - a) * blend) * 2147483648.0f;
+
+			*dest++ = pcm_range_64(llrintf(x), 32);
+		}
+	}
+
+	poly_trim(state, planes, channels, total, pos);
+
+	*dest_size_r = dest_size;
+	return dest_buffer;
+}
+
+const float *
+pcm_resample_poly_float(struct pcm_resample_state *state,
+			unsigned channels,
+			unsigned src_rate,
+			const float *src_buffer, size_t src_size,
+			unsigned dest_rate,
+			size_t *dest_size_r)
+{
+	unsigned src_frames = src_size / channels / sizeof(*src_buffer);
+	unsigned total, n_out;
+	float *planes = poly_prepare(state, channels, src_rate, dest_rate,
+				     src_frames, &total, &n_out);
+
+	assert((src_size % (sizeof(*src_buffer) * channels)) == 0);
+
+	for (unsigned c = 0; c < channels; ++c) {
+		float *p = planes + c * total + state->poly.history_frames;
+		const float *s = src_buffer + c;
+
+		for (unsigned i = 0; i < src_frames; ++i, s += channels)
+			p[i] = *s;
+	}
+
+	size_t dest_size = n_out * channels * sizeof(float);
+	float *dest_buffer = pcm_buffer_get(&state->buffer, dest_size);
+	float *dest = dest_buffer;
+
+	uint64_t pos = state->poly.position;
+	const uint64_t step = poly_step(src_rate, dest_rate);
+	for (unsigned i = 0; i < n_out; ++i, pos += step) {
+		const float *taps;
+		float blend;
+		unsigned idx = poly_phase(pos, state->poly.table,
+					  &taps, &blend);
+
+		for (unsigned c = 0; c < channels; ++c) {
+			const float *in = planes + c * total + idx;
+			float a = poly_dot_hook(taps, in);
+			float b = poly_dot_hook(taps + POLY_TAPS, in);
+
+			*dest++ = a + (b - a) * blend;
+		}
+	}
+
+	poly_trim(state, planes, channels, total, pos);
+
+	*dest_size_r = dest_size;
+	return dest_buffer;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "pcm_silence.h"
+
+#include <stdint.h>
+
+/**
+ * Compares the mean square of a sample block with the squared
+ * threshold, avoiding the square root of a real RMS computation.
+ */
+static bool
+pcm_mean_square_silent(uint64_t sum, size_t n, unsigned threshold)
+{
+	return n == 0 ||
+		sum / n <= (uint64_t)threshold * (uint64_t)threshold;
+}
+
+bool
+pcm_silence_detect(const void *data, size_t size,
+		   enum sample_format format, unsigned threshold)
+{
+	uint64_t sum = 0;
+
+	switch (format) {
+	case SAMPLE_FORMAT_S8: {
+		const int8_t *p = data, *end = p + size;
+		for (; p < end; ++p) {
+			int32_t sample = (int32_t)*p << 8;
+			sum += (uint64_t)((int64_t)sample * sample);
+		}
+
+		return pcm_mean_square_silent(sum, size, threshold);
+	}
+
+	case SAMPLE_FORMAT_S16: {
+		const int16_t *p = data;
+		const size_t n = size / sizeof(*p);
+		for (size_t i = 0; i < n; ++i) {
+			int32_t sample = p[i];
+			sum += (uint64_t)((int64_t)sample * sample);
+		}
+
+		return pcm_mean_square_silent(sum, n, threshold);
+	}
+
+	case SAMPLE_FORMAT_S24_P32: {
+		const int32_t *p = data;
+		const size_t n = size / sizeof(*p);
+		for (size_t i = 0; i < n; ++i) {
+			int32_t sample = p[i] >> 8;
+			sum += (uint64_t)((int64_t)sample * sample);
+		}
+
+		return pcm_mean_square_silent(sum, n, threshold);
+	}
+
+	case SAMPLE_FORMAT_S32: {
+		const int32_t *p = data;
+		const size_t n = size / sizeof(*p);
+		for (size_t i = 0; i < n; ++i) {
+			int32_t sample = p[i] >> 16;
+			sum += (uint64_t)((int64_t)sample * sample);
+		}
+
+		return pcm_mean_square_silent(sum, n, threshold);
+	}
+
+	case SAMPLE_FORMAT_FLOAT: {
+		const float *p = data;
+		const size_t n = size / sizeof(*p);
+		double fsum = 0.0;
+		for (size_t i = 0; i < n; ++i) {
+			double sample = (double)p[i] * 32768.0;
+			fsum += sample * sample;
+		}
+
+		return n == 0 ||
+			fsum / n <= (double)threshold * (double)threshold;
+	}
+
+	default:
+		/* silence detection is not implemented for this
+		   sample format (e.g. DSD) */
+		return false;
+	}
+}
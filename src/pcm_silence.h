@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_PCM_SILENCE_H
+#define MPD_PCM_SILENCE_H
+
+#include "audio_format.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Checks whether a block of PCM samples is silent: computes the root
+ * mean square over all samples, scaled to the 16 bit range, and
+ * compares it with the given threshold.
+ *
+ * @param data the PCM buffer
+ * @param size the size of the buffer in bytes
+ * @param format the sample format of the buffer
+ * @param threshold the highest RMS value (on the 16 bit sample scale)
+ * which still counts as silence
+ * @return true if the block is silent; false if it is not, or if the
+ * sample format is not supported
+ */
+bool
+pcm_silence_detect(const void *data, size_t size,
+		   enum sample_format format, unsigned threshold);
+
+#endif
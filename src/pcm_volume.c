@@ -20,6 +20,7 @@
 #include "config.h"
 #include "pcm_volume.h"
 #include "pcm_utils.h"
+#include "pcm_dispatch.h"
 #include "audio_format.h"
 
 #include <glib.h>
@@ -47,6 +48,26 @@ pcm_volume_change_8(int8_t *buffer, const int8_t *end, int volume)
 static void
 pcm_volume_change_16(int16_t *buffer, const int16_t *end, int volume)
 {
+	if (volume <= PCM_VOLUME_1) {
+		/* fast path for the common case "at or below 100%":
+		   the result cannot clip, so the range check is
+		   unnecessary, and the rounding division can become
+		   an arithmetic shift.  The factor is rescaled to
+		   16.16 once; each sample costs one multiply and one
+		   shift */
+		const int32_t factor = volume << 6;
+
+		while (buffer < end) {
+			int32_t sample = *buffer;
+
+			*buffer++ = (sample * factor +
+				     (pcm_volume_dither() << 6) +
+				     (1 << 15)) >> 16;
+		}
+
+		return;
+	}
+
 	while (buffer < end) {
 		int32_t sample = *buffer;
 
@@ -92,6 +113,23 @@ pcm_volume_sample_24(int32_t sample, int32_t volume, G_GNUC_UNUSED int32_t dithe
 static void
 pcm_volume_change_24(int32_t *buffer, const int32_t *end, int volume)
 {
+#ifndef __i386__
+	if (volume <= PCM_VOLUME_1) {
+		/* at or below 100%, the result cannot leave the 24
+		   bit range, so the range check is unnecessary, and
+		   an arithmetic shift replaces the rounding
+		   division */
+		while (buffer < end) {
+			int64_t sample = *buffer;
+
+			*buffer++ = (sample * volume + pcm_volume_dither() +
+				     PCM_VOLUME_1 / 2) >> 10;
+		}
+
+		return;
+	}
+#endif
+
 	while (buffer < end) {
 #ifdef __i386__
 		/* assembly version for i386 */
@@ -114,6 +152,20 @@ pcm_volume_change_24(int32_t *buffer, const int32_t *end, int volume)
 static void
 pcm_volume_change_32(int32_t *buffer, const int32_t *end, int volume)
 {
+#ifndef __i386__
+	if (volume <= PCM_VOLUME_1) {
+		/* see pcm_volume_change_24() */
+		while (buffer < end) {
+			int64_t sample = *buffer;
+
+			*buffer++ = (sample * volume + pcm_volume_dither() +
+				     PCM_VOLUME_1 / 2) >> 10;
+		}
+
+		return;
+	}
+#endif
+
 	while (buffer < end) {
 #ifdef __i386__
 		/* assembly version for i386 */
@@ -132,6 +184,232 @@ pcm_volume_change_32(int32_t *buffer, const int32_t *end, int volume)
 	}
 }
 
+#ifdef PCM_DISPATCH_X86
+
+/**
+ * Like the i386 assembly version, the vector kernels do not apply
+ * dithering: there is no headroom for the error feedback in the
+ * packed lanes, and the scalar remainder loop covers at most 15
+ * samples.
+ */
+__attribute__((target("sse2")))
+static void
+pcm_volume_change_16_sse2(int16_t *buffer, const int16_t *end, int volume)
+{
+	/* pmaddwd pairs each sample with the rounding constant:
+	   result = sample * volume + (PCM_VOLUME_1 / 2) * 1 */
+	const __m128i mul = _mm_set1_epi32((1 << 16) | (volume & 0xffff));
+	const __m128i round = _mm_set1_epi16(PCM_VOLUME_1 / 2);
+
+	while (buffer + 8 <= end) {
+		__m128i s = _mm_loadu_si128((const __m128i *)buffer);
+		__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(s, round), mul);
+		__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(s, round), mul);
+
+		lo = _mm_srai_epi32(lo, 10);
+		hi = _mm_srai_epi32(hi, 10);
+
+		_mm_storeu_si128((__m128i *)buffer, _mm_packs_epi32(lo, hi));
+		buffer += 8;
+	}
+
+	pcm_volume_change_16(buffer, end, volume);
+}
+
+__attribute__((target("avx2")))
+static void
+pcm_volume_change_16_avx2(int16_t *buffer, const int16_t *end, int volume)
+{
+	const __m256i mul = _mm256_set1_epi32((1 << 16) | (volume & 0xffff));
+	const __m256i round = _mm256_set1_epi16(PCM_VOLUME_1 / 2);
+
+	while (buffer + 16 <= end) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)buffer);
+		__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(s, round),
+					       mul);
+		__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(s, round),
+					       mul);
+
+		lo = _mm256_srai_epi32(lo, 10);
+		hi = _mm256_srai_epi32(hi, 10);
+
+		/* unpacklo/hi operate per 128 bit lane, so packing them
+		   again restores the original sample order */
+		_mm256_storeu_si256((__m256i *)buffer,
+				    _mm256_packs_epi32(lo, hi));
+		buffer += 16;
+	}
+
+	pcm_volume_change_16(buffer, end, volume);
+}
+
+/**
+ * 24 bit samples fit into the 24 bit mantissa of a single precision
+ * float, so the float pipeline is exact here, and clamping can happen
+ * in the float domain where SSE2 has min/max instructions.
+ */
+__attribute__((target("sse2")))
+static void
+pcm_volume_change_24_sse2(int32_t *buffer, const int32_t *end, int volume)
+{
+	const __m128 factor = _mm_set1_ps((float)volume /
+					  (float)PCM_VOLUME_1);
+	const __m128 min = _mm_set1_ps(-(float)(1 << 23));
+	const __m128 max = _mm_set1_ps((float)((1 << 23) - 1));
+
+	while (buffer + 4 <= end) {
+		__m128i s = _mm_loadu_si128((const __m128i *)buffer);
+		__m128 f = _mm_mul_ps(_mm_cvtepi32_ps(s), factor);
+
+		f = _mm_max_ps(_mm_min_ps(f, max), min);
+		_mm_storeu_si128((__m128i *)buffer, _mm_cvtps_epi32(f));
+		buffer += 4;
+	}
+
+	pcm_volume_change_24(buffer, end, volume);
+}
+
+/**
+ * 32 bit samples need the full double precision mantissa; two lanes
+ * per multiply is still a lot faster than the scalar 64 bit division.
+ */
+__attribute__((target("sse2")))
+static void
+pcm_volume_change_32_sse2(int32_t *buffer, const int32_t *end, int volume)
+{
+	const __m128d factor = _mm_set1_pd((double)volume /
+					   (double)PCM_VOLUME_1);
+	const __m128d min = _mm_set1_pd(-2147483648.0);
+	const __m128d max = _mm_set1_pd(2147483647.0);
+
+	while (buffer + 4 <= end) {
+		__m128i s = _mm_loadu_si128((const __m128i *)buffer);
+		__m128d lo = _mm_mul_pd(_mm_cvtepi32_pd(s), factor);
+		__m128d hi = _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(s, 8)),
+					factor);
+
+		lo = _mm_max_pd(_mm_min_pd(lo, max), min);
+		hi = _mm_max_pd(_mm_min_pd(hi, max), min);
+
+		_mm_storeu_si128((__m128i *)buffer,
+				 _mm_unpacklo_epi64(_mm_cvtpd_epi32(lo),
+						    _mm_cvtpd_epi32(hi)));
+		buffer += 4;
+	}
+
+	pcm_volume_change_32(buffer, end, volume);
+}
+
+#endif /* PCM_DISPATCH_X86 */
+
+#ifdef __ARM_NEON__
+
+static void
+pcm_volume_change_16_neon(int16_t *buffer, const int16_t *end, int volume)
+{
+	const int16x4_t v = vdup_n_s16(volume);
+	const int32x4_t round = vdupq_n_s32(PCM_VOLUME_1 / 2);
+
+	while (buffer + 8 <= end) {
+		int16x8_t s = vld1q_s16(buffer);
+		int32x4_t lo = vmlal_s16(round, vget_low_s16(s), v);
+		int32x4_t hi = vmlal_s16(round, vget_high_s16(s), v);
+
+		lo = vshrq_n_s32(lo, 10);
+		hi = vshrq_n_s32(hi, 10);
+
+		vst1q_s16(buffer, vcombine_s16(vqmovn_s32(lo),
+					       vqmovn_s32(hi)));
+		buffer += 8;
+	}
+
+	pcm_volume_change_16(buffer, end, volume);
+}
+
+static void
+pcm_volume_change_24_neon(int32_t *buffer, const int32_t *end, int volume)
+{
+	const int32x2_t v = vdup_n_s32(volume);
+	const int64x2_t round = vdupq_n_s64(PCM_VOLUME_1 / 2);
+	const int32x4_t min = vdupq_n_s32(-(1 << 23));
+	const int32x4_t max = vdupq_n_s32((1 << 23) - 1);
+
+	while (buffer + 4 <= end) {
+		int32x4_t s = vld1q_s32(buffer);
+		int64x2_t lo = vaddq_s64(vmull_s32(vget_low_s32(s), v),
+					 round);
+		int64x2_t hi = vaddq_s64(vmull_s32(vget_high_s32(s), v),
+					 round);
+
+		lo = vshrq_n_s64(lo, 10);
+		hi = vshrq_n_s64(hi, 10);
+
+		int32x4_t result = vcombine_s32(vmovn_s64(lo), vmovn_s64(hi));
+		result = vmaxq_s32(vminq_s32(result, max), min);
+		vst1q_s32(buffer, result);
+		buffer += 4;
+	}
+
+	pcm_volume_change_24(buffer, end, volume);
+}
+
+static void
+pcm_volume_change_32_neon(int32_t *buffer, const int32_t *end, int volume)
+{
+	const int32x2_t v = vdup_n_s32(volume);
+	const int64x2_t round = vdupq_n_s64(PCM_VOLUME_1 / 2);
+
+	while (buffer + 4 <= end) {
+		int32x4_t s = vld1q_s32(buffer);
+		int64x2_t lo = vaddq_s64(vmull_s32(vget_low_s32(s), v),
+					 round);
+		int64x2_t hi = vaddq_s64(vmull_s32(vget_high_s32(s), v),
+					 round);
+
+		lo = vshrq_n_s64(lo, 10);
+		hi = vshrq_n_s64(hi, 10);
+
+		/* vqmovn saturates to the 32 bit range */
+		vst1q_s32(buffer, vcombine_s32(vqmovn_s64(lo),
+					       vqmovn_s64(hi)));
+		buffer += 4;
+	}
+
+	pcm_volume_change_32(buffer, end, volume);
+}
+
+#endif /* __ARM_NEON__ */
+
+typedef void (*pcm_volume_16_func)(int16_t *, const int16_t *, int);
+typedef void (*pcm_volume_32_func)(int32_t *, const int32_t *, int);
+
+/* with -mfpu=neon, the whole binary requires NEON anyway, so no
+   runtime check is needed on ARM */
+#ifdef __ARM_NEON__
+static pcm_volume_16_func pcm_volume_16_hook = pcm_volume_change_16_neon;
+static pcm_volume_32_func pcm_volume_24_hook = pcm_volume_change_24_neon;
+static pcm_volume_32_func pcm_volume_32_hook = pcm_volume_change_32_neon;
+#else
+static pcm_volume_16_func pcm_volume_16_hook = pcm_volume_change_16;
+static pcm_volume_32_func pcm_volume_24_hook = pcm_volume_change_24;
+static pcm_volume_32_func pcm_volume_32_hook = pcm_volume_change_32;
+#endif
+
+static void
+pcm_volume_dispatch_init(void)
+{
+#ifdef PCM_DISPATCH_X86
+	if (__builtin_cpu_supports("sse2")) {
+		pcm_volume_16_hook = pcm_volume_change_16_sse2;
+		pcm_volume_24_hook = pcm_volume_change_24_sse2;
+		pcm_volume_32_hook = pcm_volume_change_32_sse2;
+	}
+
+	if (__builtin_cpu_supports("avx2"))
+		pcm_volume_16_hook = pcm_volume_change_16_avx2;
+#endif
+}
+
 static void
 pcm_volume_change_float(float *buffer, const float *end, float volume)
 {
@@ -155,6 +433,12 @@ pcm_volume(void *buffer, size_t length,
 		return true;
 	}
 
+	static gsize dispatch_initialized = 0;
+	if (g_once_init_enter(&dispatch_initialized)) {
+		pcm_volume_dispatch_init();
+		g_once_init_leave(&dispatch_initialized, 1);
+	}
+
 	const void *end = pcm_end_pointer(buffer, length);
 	switch (format) {
 	case SAMPLE_FORMAT_UNDEFINED:
@@ -169,15 +453,20 @@ pcm_volume(void *buffer, size_t length,
 		return true;
 
 	case SAMPLE_FORMAT_S16:
-		pcm_volume_change_16(buffer, end, volume);
+		if (volume <= G_MAXINT16)
+			pcm_volume_16_hook(buffer, end, volume);
+		else
+			/* the 16 bit kernels keep the volume in a
+			   16 bit multiplier lane */
+			pcm_volume_change_16(buffer, end, volume);
 		return true;
 
 	case SAMPLE_FORMAT_S24_P32:
-		pcm_volume_change_24(buffer, end, volume);
+		pcm_volume_24_hook(buffer, end, volume);
 		return true;
 
 	case SAMPLE_FORMAT_S32:
-		pcm_volume_change_32(buffer, end, volume);
+		pcm_volume_32_hook(buffer, end, volume);
 		return true;
 
 	case SAMPLE_FORMAT_FLOAT:
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "perf.h"
+#include "client.h"
+
+#ifdef ENABLE_PERF_COUNTERS
+
+struct perf_counter_data perf_counters[PERF_COUNTER_MAX];
+
+struct perf_histogram_data perf_histograms[PERF_LATENCY_MAX];
+
+static const char *const perf_latency_names[PERF_LATENCY_MAX] = {
+	[PERF_LATENCY_DECODER_FILTER] = "decoder_to_filter",
+	[PERF_LATENCY_DECODER_OUTPUT] = "decoder_to_output",
+};
+
+static const char *const perf_counter_names[PERF_COUNTER_MAX] = {
+	[PERF_DECODER_DATA] = "decoder_data",
+	[PERF_PCM_CONVERT] = "pcm_convert",
+	[PERF_FILTER] = "filter",
+	[PERF_OUTPUT_PLAY] = "output_play",
+	[PERF_COMMAND] = "command",
+	[PERF_TIMER_JITTER] = "timer_jitter",
+};
+
+void
+perf_print(struct client *client)
+{
+	for (unsigned i = 0; i < PERF_COUNTER_MAX; ++i) {
+		/* copy first: the counters are updated concurrently
+		   by other threads */
+		const uint64_t calls = perf_counters[i].calls;
+		const uint64_t time_ns = perf_counters[i].time_ns;
+
+		client_printf(client,
+			      "counter: %s\n"
+			      "calls: %"G_GUINT64_FORMAT"\n"
+			      "time_ms: %"G_GUINT64_FORMAT"\n"
+			      "avg_us: %"G_GUINT64_FORMAT"\n",
+			      perf_counter_names[i],
+			      calls,
+			      time_ns / 1000000,
+			      calls > 0 ? time_ns / calls / 1000 : 0);
+	}
+
+	for (unsigned i = 0; i < PERF_LATENCY_MAX; ++i) {
+		client_printf(client, "latency: %s\n",
+			      perf_latency_names[i]);
+
+		uint64_t upper_ms = 1;
+		for (unsigned b = 0; b < PERF_HISTOGRAM_BUCKETS; ++b) {
+			/* copy first, see above */
+			const uint64_t count =
+				perf_histograms[i].buckets[b];
+
+			/* skip empty buckets, to keep the response
+			   small */
+			if (count > 0) {
+				if (b < PERF_HISTOGRAM_BUCKETS - 1)
+					client_printf(client,
+						      "lt_%"G_GUINT64_FORMAT"ms: "
+						      "%"G_GUINT64_FORMAT"\n",
+						      upper_ms, count);
+				else
+					client_printf(client,
+						      "ge_%"G_GUINT64_FORMAT"ms: "
+						      "%"G_GUINT64_FORMAT"\n",
+						      upper_ms / 2, count);
+			}
+
+			upper_ms *= 2;
+		}
+	}
+}
+
+#endif /* ENABLE_PERF_COUNTERS */
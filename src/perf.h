@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Lightweight hot-path instrumentation, enabled with
+ * --enable-perf-counters.  Call perf_begin() before and perf_end()
+ * after the section to be measured; the accumulated call counts and
+ * wall-clock time per section are reported by the "perfstats"
+ * protocol command.  When disabled (the default), both calls compile
+ * to nothing.
+ */
+
+#ifndef MPD_PERF_H
+#define MPD_PERF_H
+
+#include "check.h"
+
+#include <glib.h>
+
+#include <stdint.h>
+
+enum perf_counter {
+	/** decoder_data(): decoder thread, includes the PCM
+	    conversion and waiting for a free music chunk */
+	PERF_DECODER_DATA,
+
+	/** pcm_convert(): both the decoder thread and the output
+	    threads' convert filter end up here */
+	PERF_PCM_CONVERT,
+
+	/** filter_filter() and filter_filter_multi() */
+	PERF_FILTER,
+
+	/** the output plugins' play() method */
+	PERF_OUTPUT_PLAY,
+
+	/** client command handlers (main thread) */
+	PERF_COMMAND,
+
+	/** timer_sync() wakeup error: "calls" counts wakeups, and
+	    the accumulated time is how late they fired */
+	PERF_TIMER_JITTER,
+
+	PERF_COUNTER_MAX
+};
+
+enum perf_latency {
+	/** from decoder_flush_chunk() to the begin of the filter
+	    stage in the output thread */
+	PERF_LATENCY_DECODER_FILTER,
+
+	/** from decoder_flush_chunk() until the output plugin has
+	    accepted the whole chunk */
+	PERF_LATENCY_DECODER_OUTPUT,
+
+	PERF_LATENCY_MAX
+};
+
+#ifdef ENABLE_PERF_COUNTERS
+
+#include <time.h>
+
+struct perf_counter_data {
+	uint64_t calls;
+
+	/** accumulated wall-clock time [ns] */
+	uint64_t time_ns;
+};
+
+extern struct perf_counter_data perf_counters[PERF_COUNTER_MAX];
+
+/**
+ * Returns the current monotonic clock in nanoseconds.
+ */
+static inline uint64_t
+perf_begin(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Accounts the time since perf_begin() to the given counter.
+ *
+ * The counters are updated without synchronization: concurrent
+ * updates from several threads may lose an increment now and then,
+ * which is acceptable for diagnostics, and keeps atomic operations
+ * out of the hot paths.
+ */
+static inline void
+perf_end(enum perf_counter counter, uint64_t start)
+{
+	++perf_counters[counter].calls;
+	perf_counters[counter].time_ns += perf_begin() - start;
+}
+
+/**
+ * The number of histogram buckets.  Bucket i counts latencies below
+ * 2^i milliseconds (and at least 2^(i-1) ms for i>0); the last bucket
+ * collects everything above.
+ */
+#define PERF_HISTOGRAM_BUCKETS 16
+
+struct perf_histogram_data {
+	uint64_t buckets[PERF_HISTOGRAM_BUCKETS];
+};
+
+extern struct perf_histogram_data perf_histograms[PERF_LATENCY_MAX];
+
+/**
+ * Accounts one latency sample to the given histogram.  Like the
+ * counters, histograms are updated without synchronization.
+ */
+static inline void
+perf_histogram_add(enum perf_latency latency, uint64_t elapsed_ns)
+{
+	unsigned bucket = 0;
+	uint64_t upper_ns = 1000000;
+
+	while (bucket < PERF_HISTOGRAM_BUCKETS - 1 &&
+	       elapsed_ns >= upper_ns) {
+		upper_ns *= 2;
+		++bucket;
+	}
+
+	++perf_histograms[latency].buckets[bucket];
+}
+
+struct client;
+
+/**
+ * Sends all counters and histograms to the client, for the
+ * "perfstats" command.
+ */
+void
+perf_print(struct client *client);
+
+#else /* !ENABLE_PERF_COUNTERS */
+
+static inline uint64_t
+perf_begin(void)
+{
+	return 0;
+}
+
+static inline void
+perf_end(G_GNUC_UNUSED enum perf_counter counter,
+	 G_GNUC_UNUSED uint64_t start)
+{
+}
+
+static inline void
+perf_histogram_add(G_GNUC_UNUSED enum perf_latency latency,
+		   G_GNUC_UNUSED uint64_t elapsed_ns)
+{
+}
+
+#endif /* !ENABLE_PERF_COUNTERS */
+
+#endif
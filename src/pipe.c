@@ -26,35 +26,77 @@
 
 #include <assert.h>
 
+/**
+ * The pipe is a single-producer single-consumer ring of chunk
+ * pointers: the decoder thread stores into the slot at #write_pos,
+ * the player thread loads from the slot at #read_pos, and the only
+ * shared state is the two monotonically increasing position counters
+ * (a slot is the position modulo the ring size).  No mutex is locked
+ * on the chunk handoff hot path.
+ *
+ * The positions are allowed to wrap around at UINT_MAX; since the
+ * ring size is a power of two, the slot index and the size difference
+ * stay correct across the wrap.
+ */
 struct music_pipe {
-	/** the first chunk */
-	struct music_chunk *head;
+	/** the ring of chunk pointers */
+	struct music_chunk **chunks;
 
-	/** a pointer to the tail of the chunk */
-	struct music_chunk **tail_r;
+	/** number of slots minus one; slot = position & mask */
+	unsigned mask;
 
-	/** the current number of chunks */
-	unsigned size;
+	/** the position of the next music_pipe_shift(); modified only
+	    by the consumer */
+	gint read_pos;
 
-	/** a mutex which protects #head and #tail_r */
-	GMutex *mutex;
+	/** the position of the next music_pipe_push(); modified only
+	    by the producer */
+	gint write_pos;
+
+	/** maintain the music_chunk.next pointers?  See
+	    music_pipe_new() for the constraints */
+	bool chain;
 
 #ifndef NDEBUG
+	GStaticMutex debug_mutex;
+
 	struct audio_format audio_format;
 #endif
 };
 
+static inline guint
+music_pipe_read_pos(const struct music_pipe *mp)
+{
+	return (guint)g_atomic_int_get((gint *)&mp->read_pos);
+}
+
+static inline guint
+music_pipe_write_pos(const struct music_pipe *mp)
+{
+	return (guint)g_atomic_int_get((gint *)&mp->write_pos);
+}
+
 struct music_pipe *
-music_pipe_new(void)
+music_pipe_new(unsigned max_chunks, bool chain)
 {
 	struct music_pipe *mp = g_new(struct music_pipe, 1);
 
-	mp->head = NULL;
-	mp->tail_r = &mp->head;
-	mp->size = 0;
-	mp->mutex = g_mutex_new();
+	assert(max_chunks > 0);
+
+	/* round up to a power of two, so the monotonic positions can
+	   be mapped to slots with a simple bit mask */
+	unsigned capacity = 1;
+	while (capacity < max_chunks)
+		capacity <<= 1;
+
+	mp->chunks = g_new(struct music_chunk *, capacity);
+	mp->mask = capacity - 1;
+	mp->read_pos = 0;
+	mp->write_pos = 0;
+	mp->chain = chain;
 
 #ifndef NDEBUG
+	g_static_mutex_init(&mp->debug_mutex);
 	audio_format_clear(&mp->audio_format);
 #endif
 
@@ -64,10 +106,13 @@ music_pipe_new(void)
 void
 music_pipe_free(struct music_pipe *mp)
 {
-	assert(mp->head == NULL);
-	assert(mp->tail_r == &mp->head);
+	assert(mp->read_pos == mp->write_pos);
+
+#ifndef NDEBUG
+	g_static_mutex_free(&mp->debug_mutex);
+#endif
 
-	g_mutex_free(mp->mutex);
+	g_free(mp->chunks);
 	g_free(mp);
 }
 
@@ -88,17 +133,12 @@ bool
 music_pipe_contains(const struct music_pipe *mp,
 		    const struct music_chunk *chunk)
 {
-	g_mutex_lock(mp->mutex);
+	const guint read_pos = music_pipe_read_pos(mp);
+	const guint write_pos = music_pipe_write_pos(mp);
 
-	for (const struct music_chunk *i = mp->head;
-	     i != NULL; i = i->next) {
-		if (i == chunk) {
-			g_mutex_unlock(mp->mutex);
+	for (guint i = read_pos; i != write_pos; ++i)
+		if (mp->chunks[i & mp->mask] == chunk)
 			return true;
-		}
-	}
-
-	g_mutex_unlock(mp->mutex);
 
 	return false;
 }
@@ -108,43 +148,38 @@ music_pipe_contains(const struct music_pipe *mp,
 const struct music_chunk *
 music_pipe_peek(const struct music_pipe *mp)
 {
-	return mp->head;
+	const guint read_pos = music_pipe_read_pos(mp);
+
+	if (read_pos == music_pipe_write_pos(mp))
+		return NULL;
+
+	return mp->chunks[read_pos & mp->mask];
 }
 
 struct music_chunk *
 music_pipe_shift(struct music_pipe *mp)
 {
-	struct music_chunk *chunk;
-
-	g_mutex_lock(mp->mutex);
-
-	chunk = mp->head;
-	if (chunk != NULL) {
-		assert(!music_chunk_is_empty(chunk));
+	const guint read_pos = (guint)mp->read_pos;
 
-		mp->head = chunk->next;
-		--mp->size;
+	if (read_pos == music_pipe_write_pos(mp))
+		return NULL;
 
-		if (mp->head == NULL) {
-			assert(mp->size == 0);
-			assert(mp->tail_r == &chunk->next);
+	struct music_chunk *chunk = mp->chunks[read_pos & mp->mask];
+	assert(!music_chunk_is_empty(chunk));
 
-			mp->tail_r = &mp->head;
-		} else {
-			assert(mp->size > 0);
-			assert(mp->tail_r != &chunk->next);
-		}
+	/* the atomic store publishes the new position to the
+	   producer; the slot may be overwritten afterwards */
+	g_atomic_int_set(&mp->read_pos, (gint)(read_pos + 1));
 
 #ifndef NDEBUG
-		/* poison the "next" reference */
-		chunk->next = (void*)0x01010101;
+	/* poison the "next" reference */
+	chunk->next = (void*)0x01010101;
 
-		if (mp->size == 0)
-			audio_format_clear(&mp->audio_format);
+	g_static_mutex_lock(&mp->debug_mutex);
+	if (mp->read_pos == mp->write_pos)
+		audio_format_clear(&mp->audio_format);
+	g_static_mutex_unlock(&mp->debug_mutex);
 #endif
-	}
-
-	g_mutex_unlock(mp->mutex);
 
 	return chunk;
 }
@@ -161,34 +196,42 @@ music_pipe_clear(struct music_pipe *mp, struct music_buffer *buffer)
 void
 music_pipe_push(struct music_pipe *mp, struct music_chunk *chunk)
 {
+	const guint write_pos = (guint)mp->write_pos;
+
 	assert(!music_chunk_is_empty(chunk));
 	assert(chunk->length == 0 || audio_format_valid(&chunk->audio_format));
+	assert(write_pos - music_pipe_read_pos(mp) <= mp->mask);
 
-	g_mutex_lock(mp->mutex);
+#ifndef NDEBUG
+	g_static_mutex_lock(&mp->debug_mutex);
 
-	assert(mp->size > 0 || !audio_format_defined(&mp->audio_format));
+	assert(music_pipe_size(mp) > 0 ||
+	       !audio_format_defined(&mp->audio_format));
 	assert(!audio_format_defined(&mp->audio_format) ||
 	       music_chunk_check_format(chunk, &mp->audio_format));
 
-#ifndef NDEBUG
 	if (!audio_format_defined(&mp->audio_format) && chunk->length > 0)
 		mp->audio_format = chunk->audio_format;
+
+	g_static_mutex_unlock(&mp->debug_mutex);
 #endif
 
 	chunk->next = NULL;
-	*mp->tail_r = chunk;
-	mp->tail_r = &chunk->next;
 
-	++mp->size;
+	if (mp->chain && write_pos != music_pipe_read_pos(mp))
+		/* chain the predecessor to the new tail; see
+		   music_pipe_new() for why this is safe only with
+		   both ends on the same thread */
+		mp->chunks[(write_pos - 1) & mp->mask]->next = chunk;
+
+	mp->chunks[write_pos & mp->mask] = chunk;
 
-	g_mutex_unlock(mp->mutex);
+	/* the atomic store publishes the slot to the consumer */
+	g_atomic_int_set(&mp->write_pos, (gint)(write_pos + 1));
 }
 
 unsigned
 music_pipe_size(const struct music_pipe *mp)
 {
-	g_mutex_lock(mp->mutex);
-	unsigned size = mp->size;
-	g_mutex_unlock(mp->mutex);
-	return size;
+	return music_pipe_write_pos(mp) - music_pipe_read_pos(mp);
 }
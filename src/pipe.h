@@ -33,15 +33,25 @@ struct music_buffer;
 /**
  * A queue of #music_chunk objects.  One party appends chunks at the
  * tail, and the other consumes them from the head.
+ *
+ * The pipe is a lock-free single-producer single-consumer ring:
+ * music_pipe_push() may be called by one thread while another thread
+ * calls music_pipe_shift(), without any further synchronization.
  */
 struct music_pipe;
 
 /**
  * Creates a new #music_pipe object.  It is empty.
+ *
+ * @param max_chunks the maximum number of chunks this pipe will ever
+ * hold; usually the size of the #music_buffer the chunks come from
+ * @param chain maintain the music_chunk.next pointers, so a third
+ * party can follow the chunk chain (see ao_next_chunk()); this is
+ * safe only when push and shift are called from the same thread
  */
 G_GNUC_MALLOC
 struct music_pipe *
-music_pipe_new(void);
+music_pipe_new(unsigned max_chunks, bool chain);
 
 /**
  * Frees the object.  It must be empty now.
@@ -223,6 +223,7 @@ pc_get_status(struct player_control *pc, struct player_status *status)
 		status->audio_format = pc->audio_format;
 		status->total_time = pc->total_time;
 		status->elapsed_time = pc->elapsed_time;
+		status->buffered_chunks = pc->buffered_chunks;
 	}
 
 	player_unlock(pc);
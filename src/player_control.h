@@ -80,6 +80,10 @@ struct player_status {
 	struct audio_format audio_format;
 	float total_time;
 	float elapsed_time;
+
+	/** the current number of decoded chunks in the player's
+	    buffer */
+	unsigned buffered_chunks;
 };
 
 struct player_control {
@@ -104,6 +108,11 @@ struct player_control {
 	enum player_command command;
 	enum player_state state;
 	enum player_error error;
+
+	/** the current buffer fill level; updated by
+	    #PLAYER_COMMAND_REFRESH */
+	unsigned buffered_chunks;
+
 	uint16_t bit_rate;
 	struct audio_format audio_format;
 	float total_time;
@@ -27,6 +27,8 @@
 #include "path.h"
 #include "event_pipe.h"
 #include "crossfade.h"
+#include "pcm_mix.h"
+#include "replay_gain_config.h"
 #include "song.h"
 #include "tag.h"
 #include "pipe.h"
@@ -52,6 +54,13 @@ struct player {
 
 	struct decoder_control *dc;
 
+	/**
+	 * The standby decoder: it pre-opens and pre-decodes the head
+	 * of the queued song while #dc is still busy with the current
+	 * song, and is swapped with #dc at the song border.
+	 */
+	struct decoder_control *next_dc;
+
 	struct music_pipe *pipe;
 
 	/**
@@ -123,8 +132,29 @@ struct player {
 	 * precisely.
 	 */
 	float elapsed_time;
+
+	/**
+	 * The pipe fill level below which the decoder is woken up to
+	 * refill the buffer.  It starts at a fraction of the buffer
+	 * size and is raised whenever the player runs dry while the
+	 * decoder is still busy (e.g. on slow network storage), which
+	 * makes the refill scheduling adapt to the decoder's
+	 * throughput; it decays back towards the default at song
+	 * borders.
+	 */
+	unsigned decoder_watermark;
 };
 
+/**
+ * The default value for player.decoder_watermark.
+ */
+static unsigned
+player_default_watermark(const struct player_control *pc)
+{
+	return (pc->buffered_before_play +
+		pc->buffer_chunks * 3) / 4;
+}
+
 static struct music_buffer *player_buffer;
 
 static void
@@ -167,6 +197,41 @@ player_dc_start(struct player *player, struct music_pipe *pipe)
 		 player_buffer, pipe);
 }
 
+/**
+ * Let the standby decoder pre-open the queued song and pre-decode its
+ * head, while the current song is still being decoded or played.
+ *
+ * Player lock is not held.
+ */
+static void
+player_next_dc_start(struct player *player)
+{
+	struct player_control *pc = player->pc;
+	struct decoder_control *dc = player->dc;
+	struct decoder_control *next_dc = player->next_dc;
+
+	assert(pc->next_song != NULL);
+	assert(next_dc->pipe == NULL);
+
+	/* the "previous song" replay gain and MixRamp values live in
+	   the decoder which handled the current song; copy them over,
+	   so the hand-over in the standby decoder thread works */
+	next_dc->replay_gain_db = dc->replay_gain_db;
+	dc_mixramp_end(next_dc, g_strdup(dc->mixramp_end));
+
+	/* decode only the head of the song: the rest of the shared
+	   music_buffer must remain available to the current song */
+	dc_limit(next_dc, pc->buffered_before_play > 0
+		 ? pc->buffered_before_play
+		 /* buffering is disabled - a few chunks are still
+		    enough to cover the open latency */
+		 : 16);
+
+	dc_start(next_dc, pc->next_song,
+		 pc->next_song->start_ms, pc->next_song->end_ms,
+		 player_buffer, music_pipe_new(pc->buffer_chunks, false));
+}
+
 /**
  * Is the decoder still busy on the same song as the player?
  *
@@ -217,6 +282,27 @@ player_dc_stop(struct player *player)
 	}
 }
 
+/**
+ * Stop the standby decoder and clear (and free) its music pipe.  It
+ * is a no-op if the standby decoder has not been started.
+ *
+ * Player lock is not held.
+ */
+static void
+player_next_dc_stop(struct player *player)
+{
+	struct decoder_control *next_dc = player->next_dc;
+
+	if (next_dc->pipe == NULL)
+		return;
+
+	dc_stop(next_dc);
+
+	music_pipe_clear(next_dc->pipe, player_buffer);
+	music_pipe_free(next_dc->pipe);
+	next_dc->pipe = NULL;
+}
+
 /**
  * After the decoder has been started asynchronously, wait for the
  * "START" command to finish.  The decoder may not be initialized yet,
@@ -423,7 +509,7 @@ player_send_silence(struct player *player)
 		audio_format_frame_size(&player->play_audio_format);
 	/* this formula ensures that we don't send
 	   partial frames */
-	unsigned num_frames = sizeof(chunk->data) / frame_size;
+	unsigned num_frames = music_chunk_size / frame_size;
 
 	chunk->times = -1.0; /* undefined time stamp */
 	chunk->length = num_frames * frame_size;
@@ -450,6 +536,10 @@ static bool player_seek_decoder(struct player *player)
 
 	assert(pc->next_song != NULL);
 
+	/* the standby decoder may be pre-decoding the formerly queued
+	   song, which pc->next_song does not refer to any more */
+	player_next_dc_stop(player);
+
 	if (decoder_current_song(dc) != song) {
 		/* the decoder is already decoding the "next" song -
 		   stop it and start the previous song again */
@@ -596,6 +686,14 @@ static void player_process_command(struct player *player)
 			player_lock(pc);
 		}
 
+		if (player->next_dc->pipe != NULL) {
+			/* discard the standby decoder's pre-decode of
+			   the song which is not queued any more */
+			player_unlock(pc);
+			player_next_dc_stop(player);
+			player_lock(pc);
+		}
+
 		pc->next_song = NULL;
 		player->queued = false;
 		player_command_finished_locked(pc);
@@ -612,21 +710,29 @@ static void player_process_command(struct player *player)
 		if (pc->elapsed_time < 0.0)
 			pc->elapsed_time = player->elapsed_time;
 
+		pc->buffered_chunks = music_pipe_size(player->pipe);
+
 		player_command_finished_locked(pc);
 		break;
 	}
 }
 
 static void
-update_song_tag(struct song *song, const struct tag *new_tag)
+update_song_tag(struct player_control *pc, struct song *song,
+		struct tag *new_tag)
 {
 	if (song_is_file(song))
 		/* don't update tags of local files, only remote
 		   streams may change tags dynamically */
 		return;
 
+	/* the swap must be protected with the player lock, because
+	   "addtagid"/"cleartagid" edit the tag of the very same
+	   remote songs from the main thread */
+	player_lock(pc);
 	struct tag *old_tag = song->tag;
-	song->tag = tag_dup(new_tag);
+	song->tag = tag_ref(new_tag);
+	player_unlock(pc);
 
 	if (old_tag != NULL)
 		tag_free(old_tag);
@@ -655,7 +761,7 @@ play_chunk(struct player_control *pc,
 	assert(music_chunk_check_format(chunk, format));
 
 	if (chunk->tag != NULL)
-		update_song_tag(song, chunk->tag);
+		update_song_tag(pc, song, chunk->tag);
 
 	if (chunk->length == 0) {
 		music_buffer_return(player_buffer, chunk);
@@ -745,6 +851,42 @@ play_next_chunk(struct player *player)
 				other_chunk = NULL;
 			}
 
+			if (other_chunk != NULL &&
+			    (replay_gain_mode == REPLAY_GAIN_OFF ||
+			     !audio_output_all_uses_replay_gain())) {
+				/* no output applies replay gain, so
+				   the pair can be mixed right here -
+				   once, in the player thread -
+				   instead of deferring it to every
+				   output thread, where the mixing
+				   would compete with the device
+				   deadlines */
+				size_t mix_length = chunk->length;
+				if (mix_length > other_chunk->length)
+					/* the trailer of the longer
+					   "other" chunk is used
+					   as-is, like in the deferred
+					   path */
+					mix_length = other_chunk->length;
+
+				if (pcm_mix(other_chunk->data, chunk->data,
+					    mix_length,
+					    player->play_audio_format.format,
+					    1.0 - chunk->mix_ratio)) {
+					/* ship the merged chunk; move
+					   the old song's tag over
+					   before recycling its
+					   chunk */
+					other_chunk->tag = chunk->tag;
+					chunk->tag = NULL;
+					music_buffer_return(player_buffer,
+							    chunk);
+
+					chunk = other_chunk;
+					other_chunk = NULL;
+				}
+			}
+
 			chunk->other = other_chunk;
 		} else {
 			/* there are not enough decoded chunks yet */
@@ -801,15 +943,17 @@ play_next_chunk(struct player *player)
 		return false;
 	}
 
-	/* this formula should prevent that the decoder gets woken up
+	/* the watermark should prevent that the decoder gets woken up
 	   with each chunk; it is more efficient to make it decode a
-	   larger block at a time */
-	decoder_lock(dc);
-	if (!decoder_is_idle(dc) &&
-	    music_pipe_size(dc->pipe) <= (pc->buffered_before_play +
-					 music_buffer_size(player_buffer) * 3) / 4)
-		decoder_signal(dc);
-	decoder_unlock(dc);
+	   larger block at a time; the lock-free size check keeps the
+	   decoder_control lock off this path while the buffer is
+	   filled well enough */
+	if (music_pipe_size(dc->pipe) <= player->decoder_watermark) {
+		decoder_lock(dc);
+		if (!decoder_is_idle(dc))
+			decoder_signal(dc);
+		decoder_unlock(dc);
+	}
 
 	return true;
 }
@@ -835,6 +979,14 @@ player_song_border(struct player *player)
 	music_pipe_free(player->pipe);
 	player->pipe = player->dc->pipe;
 
+	/* let the watermark decay back towards the default, in case
+	   the starvation which raised it was specific to the previous
+	   song */
+	unsigned default_watermark = player_default_watermark(player->pc);
+	if (player->decoder_watermark > default_watermark)
+		player->decoder_watermark -=
+			(player->decoder_watermark - default_watermark) / 2;
+
 	audio_output_all_song_border();
 
 	if (!player_wait_for_decoder(player))
@@ -848,11 +1000,13 @@ player_song_border(struct player *player)
  * basically a state machine, which multiplexes data between the
  * decoder thread and the output threads.
  */
-static void do_play(struct player_control *pc, struct decoder_control *dc)
+static void do_play(struct player_control *pc, struct decoder_control *dc,
+		    struct decoder_control *next_dc)
 {
 	struct player player = {
 		.pc = pc,
 		.dc = dc,
+		.next_dc = next_dc,
 		.buffering = true,
 		.decoder_starting = false,
 		.paused = false,
@@ -864,11 +1018,12 @@ static void do_play(struct player_control *pc, struct decoder_control *dc)
 		.cross_fade_chunks = 0,
 		.cross_fade_tag = NULL,
 		.elapsed_time = 0.0,
+		.decoder_watermark = player_default_watermark(pc),
 	};
 
 	player_unlock(pc);
 
-	player.pipe = music_pipe_new();
+	player.pipe = music_pipe_new(pc->buffer_chunks, false);
 
 	player_dc_start(&player, player.pipe);
 	if (!player_wait_for_decoder(&player)) {
@@ -945,14 +1100,53 @@ static void do_play(struct player_control *pc, struct decoder_control *dc)
 		*/
 #endif
 
+		if (player.queued && !player.buffering &&
+		    player.next_dc->pipe == NULL &&
+		    dc->pipe == player.pipe &&
+		    !decoder_lock_is_idle(dc) &&
+		    decoder_lock_is_idle(player.next_dc)) {
+			/* the current song is still being decoded;
+			   let the standby decoder pre-open the queued
+			   song meanwhile, so a slow-to-open source
+			   (network stream, archive) does not cause an
+			   audible gap at the song border */
+			player_next_dc_start(&player);
+		}
+
 		if (decoder_lock_is_idle(dc) && player.queued &&
 		    dc->pipe == player.pipe) {
 			/* the decoder has finished the current song;
-			   make it decode the next song */
+			   move on to the next song */
 
 			assert(dc->pipe == NULL || dc->pipe == player.pipe);
 
-			player_dc_start(&player, music_pipe_new());
+			if (player.next_dc->pipe != NULL &&
+			    player.next_dc->song == pc->next_song) {
+				/* the standby decoder has already
+				   opened the queued song - swap the
+				   two decoder instances */
+				player.dc = player.next_dc;
+				player.next_dc = dc;
+				dc = player.dc;
+
+				/* the retired decoder is idle; forget
+				   its stale pipe pointer (the player
+				   owns and frees that pipe) */
+				player.next_dc->pipe = NULL;
+
+				/* lift the pre-decode quota */
+				dc_limit(dc, 0);
+			} else {
+				/* the standby decoder was not
+				   started, or it holds an obsolete
+				   song; decode the queued song on the
+				   current instance */
+				player_next_dc_stop(&player);
+
+				player_dc_start(&player,
+						music_pipe_new(pc->buffer_chunks,
+							       false));
+			}
 		}
 
 		if (player_dc_at_next_song(&player) &&
@@ -1019,6 +1213,14 @@ static void do_play(struct player_control *pc, struct decoder_control *dc)
 			/* the decoder is too busy and hasn't provided
 			   new PCM data in time: send silence (if the
 			   output pipe is empty) */
+
+			/* raise the watermark, so the decoder will be
+			   woken up earlier from now on */
+			if (player.decoder_watermark < pc->buffer_chunks - 1)
+				player.decoder_watermark +=
+					(pc->buffer_chunks -
+					 player.decoder_watermark) / 2;
+
 			if (!player_send_silence(&player))
 				break;
 		}
@@ -1027,6 +1229,7 @@ static void do_play(struct player_control *pc, struct decoder_control *dc)
 	}
 
 	player_dc_stop(&player);
+	player_next_dc_stop(&player);
 
 	music_pipe_clear(player.pipe, player_buffer);
 	music_pipe_free(player.pipe);
@@ -1058,6 +1261,11 @@ player_task(gpointer arg)
 	struct decoder_control *dc = dc_new(pc->cond);
 	decoder_thread_start(dc);
 
+	/* the standby decoder pre-decodes the queued song while the
+	   first instance is still busy with the current song */
+	struct decoder_control *next_dc = dc_new(pc->cond);
+	decoder_thread_start(next_dc);
+
 	player_buffer = music_buffer_new(pc->buffer_chunks);
 
 	player_lock(pc);
@@ -1068,7 +1276,7 @@ player_task(gpointer arg)
 		case PLAYER_COMMAND_QUEUE:
 			assert(pc->next_song != NULL);
 
-			do_play(pc, dc);
+			do_play(pc, dc, next_dc);
 			break;
 
 		case PLAYER_COMMAND_STOP:
@@ -1113,6 +1321,8 @@ player_task(gpointer arg)
 
 			dc_quit(dc);
 			dc_free(dc);
+			dc_quit(next_dc);
+			dc_free(next_dc);
 			audio_output_all_close();
 			music_buffer_free(player_buffer);
 
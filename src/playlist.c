@@ -27,6 +27,7 @@
 #include "conf.h"
 #include "stored_playlist.h"
 #include "idle.h"
+#include "replay_gain_config.h"
 
 #include <glib.h>
 
@@ -63,6 +64,9 @@ playlist_init(struct playlist *playlist)
 
 	playlist->queued = -1;
 	playlist->current = -1;
+
+	playlist->bulk_mode = 0;
+	playlist->bulk_modified = false;
 }
 
 void
@@ -160,6 +164,12 @@ playlist_update_queued_song(struct playlist *playlist,
 
 		queue_shuffle_order(&playlist->queue);
 
+		/* playback continues into the new cycle right away;
+		   draw the whole new order now so that the current
+		   song keeps a stable order number */
+		queue_order_realize(&playlist->queue,
+				    queue_length(&playlist->queue) - 1);
+
 		/* make sure that the playlist->current still points to
 		   the current song, after the song order has been
 		   shuffled */
@@ -168,9 +178,14 @@ playlist_update_queued_song(struct playlist *playlist,
 						current_position);
 	}
 
-	if (next_order >= 0)
+	if (next_order >= 0) {
+		/* the upcoming song becomes visible ("nextsong") and
+		   may be queued in the player now; its order entry
+		   must be drawn at this point */
+		queue_order_realize(&playlist->queue, next_order);
+
 		next_song = queue_get_order(&playlist->queue, next_order);
-	else
+	} else
 		next_song = NULL;
 
 	if (prev != NULL && next_song != prev) {
@@ -197,6 +212,9 @@ playlist_play_order(struct playlist *playlist, struct player_control *pc,
 	playlist->playing = true;
 	playlist->queued = -1;
 
+	/* draw the lazily shuffled order entries up to this one */
+	queue_order_realize(&playlist->queue, orderNum);
+
 	song = queue_get_order(&playlist->queue, orderNum);
 
 	uri = song_get_uri(song);
@@ -386,7 +404,8 @@ playlist_set_random(struct playlist *playlist, struct player_control *pc,
 			unsigned current_order =
 				queue_position_to_order(&playlist->queue,
 							current_position);
-			queue_swap_order(&playlist->queue, 0, current_order);
+			queue_order_move_first(&playlist->queue,
+					       current_order);
 			playlist->current = 0;
 		} else
 			playlist->current = -1;
@@ -395,6 +414,9 @@ playlist_set_random(struct playlist *playlist, struct player_control *pc,
 
 	playlist_update_queued_song(playlist, pc, queued);
 
+	/* the "auto" replay gain mode depends on the "random" flag */
+	replay_gain_changed();
+
 	idle_add(IDLE_OPTIONS);
 }
 
@@ -22,6 +22,7 @@
 
 #include "queue.h"
 #include "playlist_error.h"
+#include "tag.h"
 
 #include <stdbool.h>
 
@@ -68,6 +69,18 @@ struct playlist {
 	 * This variable is only valid if #playing is true.
 	 */
 	int queued;
+
+	/**
+	 * The nesting depth of "bulk" edit mode.  While positive,
+	 * version increments and "playlist" idle events are
+	 * suppressed until the outermost playlist_bulk_end(); used to
+	 * apply a homogeneous command list or a multi-song add as one
+	 * edit.
+	 */
+	unsigned bulk_mode;
+
+	/** has the playlist been modified during bulk mode? */
+	bool bulk_modified;
 };
 
 /** the global playlist object */
@@ -97,6 +110,18 @@ playlist_get_queue(const struct playlist *playlist)
 	return &playlist->queue;
 }
 
+/**
+ * Enter "bulk" edit mode: defer the version increment and the
+ * "playlist" idle event until playlist_bulk_end(), so a batch of
+ * edits is announced as a single change.  Calls may be nested; only
+ * the outermost playlist_bulk_end() publishes the change.
+ */
+void
+playlist_bulk_begin(struct playlist *playlist);
+
+void
+playlist_bulk_end(struct playlist *playlist, struct player_control *pc);
+
 void
 playlist_clear(struct playlist *playlist, struct player_control *pc);
 
@@ -188,6 +213,26 @@ enum playlist_result
 playlist_set_priority_id(struct playlist *playlist, struct player_control *pc,
 			 unsigned song_id, uint8_t priority);
 
+/**
+ * Adds a tag item to the song with the specified id, in place,
+ * without removing and re-adding the item.  Only songs not in the
+ * database may be edited.
+ */
+enum playlist_result
+playlist_add_song_tag_id(struct playlist *playlist, struct player_control *pc,
+			 unsigned song_id,
+			 enum tag_type type, const char *value);
+
+/**
+ * Removes all items of the given tag type from the song with the
+ * specified id; #TAG_NUM_OF_ITEM_TYPES clears the whole tag.  Only
+ * songs not in the database may be edited.
+ */
+enum playlist_result
+playlist_clear_song_tag_id(struct playlist *playlist,
+			   struct player_control *pc, unsigned song_id,
+			   enum tag_type type);
+
 bool
 playlist_get_repeat(const struct playlist *playlist);
 
@@ -23,12 +23,14 @@
 #include "tag.h"
 #include "song.h"
 #include "cue/cue_parser.h"
+#include "cue/cue_cache.h"
 #include "input_stream.h"
 #include "text_input_stream.h"
 
 #include <glib.h>
 #include <assert.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "cue"
@@ -39,8 +41,35 @@ struct cue_playlist {
 	struct input_stream *is;
 	struct text_input_stream *tis;
 	struct cue_parser *parser;
+
+	/**
+	 * The cache key for this sheet; NULL if it is not cacheable
+	 * (remote or stat failure) or has been committed already.
+	 */
+	char *cache_uri;
+	time_t cache_mtime;
+
+	/**
+	 * Copies of all songs produced so far, to be stored in the
+	 * cache when the whole sheet has been parsed; NULL if not
+	 * recording.
+	 */
+	GPtrArray *recorded;
+
+	/**
+	 * The cached song list being replayed; NULL if the sheet is
+	 * being parsed.
+	 */
+	const GPtrArray *replay;
+	unsigned replay_position;
 };
 
+static void
+cue_playlist_finish(void)
+{
+	cue_cache_deinit();
+}
+
 static struct playlist_provider *
 cue_playlist_open_stream(struct input_stream *is)
 {
@@ -48,10 +77,29 @@ cue_playlist_open_stream(struct input_stream *is)
 	playlist_provider_init(&playlist->base, &cue_playlist_plugin);
 
 	playlist->is = is;
+	playlist->tis = NULL;
+	playlist->parser = NULL;
+	playlist->cache_uri = NULL;
+	playlist->recorded = NULL;
+	playlist->replay = NULL;
+	playlist->replay_position = 0;
+
+	struct stat st;
+	if (is->uri != NULL && g_path_is_absolute(is->uri) &&
+	    stat(is->uri, &st) == 0) {
+		playlist->replay = cue_cache_get(is->uri, st.st_mtime);
+		if (playlist->replay != NULL)
+			/* cache hit: no need to parse the file */
+			return &playlist->base;
+
+		playlist->cache_uri = g_strdup(is->uri);
+		playlist->cache_mtime = st.st_mtime;
+		playlist->recorded = g_ptr_array_new();
+	}
+
 	playlist->tis = text_input_stream_new(is);
 	playlist->parser = cue_parser_new();
 
-
 	return &playlist->base;
 }
 
@@ -60,16 +108,26 @@ cue_playlist_close(struct playlist_provider *_playlist)
 {
 	struct cue_playlist *playlist = (struct cue_playlist *)_playlist;
 
-	cue_parser_free(playlist->parser);
-	text_input_stream_free(playlist->tis);
+	if (playlist->recorded != NULL) {
+		/* the consumer stopped before the end of the sheet;
+		   discard the incomplete recording */
+		for (unsigned i = 0; i < playlist->recorded->len; ++i)
+			song_free(g_ptr_array_index(playlist->recorded, i));
+		g_ptr_array_free(playlist->recorded, true);
+	}
+
+	g_free(playlist->cache_uri);
+
+	if (playlist->parser != NULL)
+		cue_parser_free(playlist->parser);
+	if (playlist->tis != NULL)
+		text_input_stream_free(playlist->tis);
 	g_free(playlist);
 }
 
 static struct song *
-cue_playlist_read(struct playlist_provider *_playlist)
+cue_playlist_parse(struct cue_playlist *playlist)
 {
-	struct cue_playlist *playlist = (struct cue_playlist *)_playlist;
-
 	struct song *song = cue_parser_get(playlist->parser);
 	if (song != NULL)
 		return song;
@@ -86,6 +144,43 @@ cue_playlist_read(struct playlist_provider *_playlist)
 	return cue_parser_get(playlist->parser);
 }
 
+static struct song *
+cue_playlist_read(struct playlist_provider *_playlist)
+{
+	struct cue_playlist *playlist = (struct cue_playlist *)_playlist;
+
+	if (playlist->replay != NULL) {
+		if (playlist->replay_position >= playlist->replay->len)
+			return NULL;
+
+		/* share the cached instance instead of copying it;
+		   the consumer's song_free() only drops the
+		   reference */
+		return song_ref(g_ptr_array_index(playlist->replay,
+						  playlist->replay_position++));
+	}
+
+	struct song *song = cue_playlist_parse(playlist);
+
+	if (playlist->recorded != NULL) {
+		if (song != NULL)
+			g_ptr_array_add(playlist->recorded,
+					song_dup_detached(song));
+		else {
+			/* the whole sheet has been parsed: commit it
+			   to the cache */
+			cue_cache_put(playlist->cache_uri,
+				      playlist->cache_mtime,
+				      playlist->recorded);
+			playlist->recorded = NULL;
+			g_free(playlist->cache_uri);
+			playlist->cache_uri = NULL;
+		}
+	}
+
+	return song;
+}
+
 static const char *const cue_playlist_suffixes[] = {
 	"cue",
 	NULL
@@ -99,6 +194,7 @@ static const char *const cue_playlist_mime_types[] = {
 const struct playlist_plugin cue_playlist_plugin = {
 	.name = "cue",
 
+	.finish = cue_playlist_finish,
 	.open_stream = cue_playlist_open_stream,
 	.close = cue_playlist_close,
 	.read = cue_playlist_read,
@@ -33,10 +33,12 @@
 #include "tag_id3.h"
 #include "song.h"
 #include "cue/cue_parser.h"
+#include "cue/cue_cache.h"
 
 #include <glib.h>
 #include <assert.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "cue"
@@ -62,8 +64,35 @@ struct embcue_playlist {
 	char *next;
 
 	struct cue_parser *parser;
+
+	/**
+	 * The cache key for this sheet; NULL if it is not cacheable
+	 * or has been committed already.
+	 */
+	char *cache_uri;
+	time_t cache_mtime;
+
+	/**
+	 * Copies of all songs produced so far, to be stored in the
+	 * cache when the whole sheet has been parsed; NULL if not
+	 * recording.
+	 */
+	GPtrArray *recorded;
+
+	/**
+	 * The cached song list being replayed; NULL if the sheet is
+	 * being parsed.
+	 */
+	const GPtrArray *replay;
+	unsigned replay_position;
 };
 
+static void
+embcue_playlist_finish(void)
+{
+	cue_cache_deinit();
+}
+
 static void
 embcue_tag_pair(const char *name, const char *value, void *ctx)
 {
@@ -90,6 +119,24 @@ embcue_playlist_open_uri(const char *uri,
 	struct embcue_playlist *playlist = g_new(struct embcue_playlist, 1);
 	playlist_provider_init(&playlist->base, &embcue_playlist_plugin);
 	playlist->cuesheet = NULL;
+	playlist->filename = NULL;
+	playlist->parser = NULL;
+	playlist->cache_uri = NULL;
+	playlist->recorded = NULL;
+	playlist->replay = NULL;
+	playlist->replay_position = 0;
+
+	struct stat st;
+	if (stat(uri, &st) == 0) {
+		playlist->replay = cue_cache_get(uri, st.st_mtime);
+		if (playlist->replay != NULL)
+			/* cache hit: no need to scan the file's tags
+			   and parse the sheet again */
+			return &playlist->base;
+
+		playlist->cache_uri = g_strdup(uri);
+		playlist->cache_mtime = st.st_mtime;
+	}
 
 	tag_file_scan(uri, &embcue_tag_handler, playlist);
 	if (playlist->cuesheet == NULL) {
@@ -100,6 +147,7 @@ embcue_playlist_open_uri(const char *uri,
 
 	if (playlist->cuesheet == NULL) {
 		/* no "CUESHEET" tag found */
+		g_free(playlist->cache_uri);
 		g_free(playlist);
 		return NULL;
 	}
@@ -109,6 +157,9 @@ embcue_playlist_open_uri(const char *uri,
 	playlist->next = playlist->cuesheet;
 	playlist->parser = cue_parser_new();
 
+	if (playlist->cache_uri != NULL)
+		playlist->recorded = g_ptr_array_new();
+
 	return &playlist->base;
 }
 
@@ -117,17 +168,26 @@ embcue_playlist_close(struct playlist_provider *_playlist)
 {
 	struct embcue_playlist *playlist = (struct embcue_playlist *)_playlist;
 
-	cue_parser_free(playlist->parser);
+	if (playlist->recorded != NULL) {
+		/* the consumer stopped before the end of the sheet;
+		   discard the incomplete recording */
+		for (unsigned i = 0; i < playlist->recorded->len; ++i)
+			song_free(g_ptr_array_index(playlist->recorded, i));
+		g_ptr_array_free(playlist->recorded, true);
+	}
+
+	g_free(playlist->cache_uri);
+
+	if (playlist->parser != NULL)
+		cue_parser_free(playlist->parser);
 	g_free(playlist->cuesheet);
 	g_free(playlist->filename);
 	g_free(playlist);
 }
 
 static struct song *
-embcue_playlist_read(struct playlist_provider *_playlist)
+embcue_playlist_parse(struct embcue_playlist *playlist)
 {
-	struct embcue_playlist *playlist = (struct embcue_playlist *)_playlist;
-
 	struct song *song = cue_parser_get(playlist->parser);
 	if (song != NULL)
 		return song;
@@ -157,6 +217,43 @@ embcue_playlist_read(struct playlist_provider *_playlist)
 	return song;
 }
 
+static struct song *
+embcue_playlist_read(struct playlist_provider *_playlist)
+{
+	struct embcue_playlist *playlist = (struct embcue_playlist *)_playlist;
+
+	if (playlist->replay != NULL) {
+		if (playlist->replay_position >= playlist->replay->len)
+			return NULL;
+
+		/* share the cached instance instead of copying it;
+		   the consumer's song_free() only drops the
+		   reference */
+		return song_ref(g_ptr_array_index(playlist->replay,
+						  playlist->replay_position++));
+	}
+
+	struct song *song = embcue_playlist_parse(playlist);
+
+	if (playlist->recorded != NULL) {
+		if (song != NULL)
+			g_ptr_array_add(playlist->recorded,
+					song_dup_detached(song));
+		else {
+			/* the whole sheet has been parsed: commit it
+			   to the cache */
+			cue_cache_put(playlist->cache_uri,
+				      playlist->cache_mtime,
+				      playlist->recorded);
+			playlist->recorded = NULL;
+			g_free(playlist->cache_uri);
+			playlist->cache_uri = NULL;
+		}
+	}
+
+	return song;
+}
+
 static const char *const embcue_playlist_suffixes[] = {
 	/* a few codecs that are known to be supported; there are
 	   probably many more */
@@ -172,6 +269,7 @@ static const char *const embcue_playlist_suffixes[] = {
 const struct playlist_plugin embcue_playlist_plugin = {
 	.name = "cue",
 
+	.finish = embcue_playlist_finish,
 	.open_uri = embcue_playlist_open_uri,
 	.close = embcue_playlist_close,
 	.read = embcue_playlist_read,
@@ -55,8 +55,12 @@ playlist_stop(struct playlist *playlist, struct player_control *pc)
 
 		queue_shuffle_order(&playlist->queue);
 
-		/* make sure that "current" stays valid, and the next
-		   "play" command plays the same song again */
+		/* draw the whole new order, so that "current" stays
+		   valid and the next "play" command plays the same
+		   song again */
+		queue_order_realize(&playlist->queue,
+				    queue_length(&playlist->queue) - 1);
+
 		playlist->current =
 			queue_position_to_order(&playlist->queue,
 						current_position);
@@ -220,9 +224,15 @@ playlist_seek_song(struct playlist *playlist, struct player_control *pc,
 
 	queued = playlist_get_queued_song(playlist);
 
-	if (playlist->queue.random)
+	if (playlist->queue.random) {
 		i = queue_position_to_order(&playlist->queue, song);
-	else
+
+		/* pin the entry before storing the order number:
+		   otherwise lazy realization may later swap it away,
+		   and "current" would name a different song than the
+		   one being played */
+		queue_order_realize(&playlist->queue, i);
+	} else
 		i = song;
 
 	pc_clear_error(pc);
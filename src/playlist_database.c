@@ -33,7 +33,7 @@ playlist_database_quark(void)
 }
 
 void
-playlist_vector_save(FILE *fp, const struct list_head *pv)
+playlist_vector_save(FILE *fp, const struct playlist_vector *pv)
 {
 	struct playlist_metadata *pm;
 	playlist_vector_for_each(pm, pv)
@@ -44,7 +44,7 @@ playlist_vector_save(FILE *fp, const struct list_head *pv)
 }
 
 bool
-playlist_metadata_load(FILE *fp, struct list_head *pv, const char *name,
+playlist_metadata_load(FILE *fp, struct playlist_vector *pv, const char *name,
 		       GString *buffer, GError **error_r)
 {
 	struct playlist_metadata pm = {
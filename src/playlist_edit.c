@@ -29,17 +29,50 @@
 #include "database.h"
 #include "uri.h"
 #include "song.h"
+#include "tag.h"
 #include "idle.h"
 
 #include <stdlib.h>
 
 static void playlist_increment_version(struct playlist *playlist)
 {
+	if (playlist->bulk_mode) {
+		/* postponed until playlist_bulk_end() */
+		playlist->bulk_modified = true;
+		return;
+	}
+
 	queue_increment_version(&playlist->queue);
 
 	idle_add(IDLE_PLAYLIST);
 }
 
+void
+playlist_bulk_begin(struct playlist *playlist)
+{
+	if (playlist->bulk_mode++ == 0)
+		playlist->bulk_modified = false;
+}
+
+void
+playlist_bulk_end(struct playlist *playlist, struct player_control *pc)
+{
+	assert(playlist->bulk_mode > 0);
+
+	if (--playlist->bulk_mode > 0)
+		/* still nested inside another bulk edit */
+		return;
+
+	if (playlist->bulk_modified) {
+		playlist_increment_version(playlist);
+
+		/* re-evaluate the queued song, which the deferred
+		   edits may have changed */
+		playlist_update_queued_song(playlist, pc,
+					    playlist_get_queued_song(playlist));
+	}
+}
+
 void
 playlist_clear(struct playlist *playlist, struct player_control *pc)
 {
@@ -246,6 +279,123 @@ playlist_set_priority_id(struct playlist *playlist, struct player_control *pc,
 
 }
 
+/**
+ * Looks up the queue item and verifies that its tag may be edited:
+ * only songs owned by the queue qualify, because database songs are
+ * shared with the #db_mutex world.
+ *
+ * @return the song, or NULL with an error code in *result_r
+ */
+static struct song *
+playlist_get_editable_song(struct playlist *playlist, unsigned song_id,
+			   int *position_r, enum playlist_result *result_r)
+{
+	int position = queue_id_to_position(&playlist->queue, song_id);
+	if (position < 0) {
+		*result_r = PLAYLIST_RESULT_NO_SUCH_SONG;
+		return NULL;
+	}
+
+	struct song *song = queue_get(&playlist->queue, position);
+	if (song_in_database(song)) {
+		*result_r = PLAYLIST_RESULT_DENIED;
+		return NULL;
+	}
+
+	*position_r = position;
+	return song;
+}
+
+/**
+ * Marks only this queue item as modified, so "plchanges" transfers
+ * just the one song.
+ */
+static void
+playlist_song_tag_modified(struct playlist *playlist, int position)
+{
+	queue_modify(&playlist->queue,
+		     queue_position_to_order(&playlist->queue, position));
+	idle_add(IDLE_PLAYLIST);
+}
+
+enum playlist_result
+playlist_add_song_tag_id(struct playlist *playlist, struct player_control *pc,
+			 unsigned song_id,
+			 enum tag_type type, const char *value)
+{
+	int position;
+	enum playlist_result result;
+	struct song *song = playlist_get_editable_song(playlist, song_id,
+						       &position, &result);
+	if (song == NULL)
+		return result;
+
+	/* reading and swapping song->tag must be protected with the
+	   player lock, because the player thread performs the same
+	   swap in update_song_tag() when a chunk carries a stream
+	   tag; the old object is merely unreferenced, so other
+	   holders keep their copy alive */
+	player_lock(pc);
+
+	struct tag *tag = song->tag != NULL
+		? tag_dup(song->tag)
+		: tag_new();
+	tag_add_item(tag, type, value);
+
+	struct tag *old_tag = song->tag;
+	song->tag = tag;
+
+	player_unlock(pc);
+
+	if (old_tag != NULL)
+		tag_free(old_tag);
+
+	playlist_song_tag_modified(playlist, position);
+	return PLAYLIST_RESULT_SUCCESS;
+}
+
+enum playlist_result
+playlist_clear_song_tag_id(struct playlist *playlist,
+			   struct player_control *pc, unsigned song_id,
+			   enum tag_type type)
+{
+	int position;
+	enum playlist_result result;
+	struct song *song = playlist_get_editable_song(playlist, song_id,
+						       &position, &result);
+	if (song == NULL)
+		return result;
+
+	/* see playlist_add_song_tag_id() for the locking rationale */
+	player_lock(pc);
+
+	struct tag *old_tag = song->tag;
+	if (old_tag == NULL) {
+		/* nothing to clear */
+		player_unlock(pc);
+		return PLAYLIST_RESULT_SUCCESS;
+	}
+
+	struct tag *tag;
+	if (type == TAG_NUM_OF_ITEM_TYPES) {
+		/* clear all tag items, but preserve the duration */
+		tag = tag_new();
+		tag->time = old_tag->time;
+	} else {
+		tag = tag_dup(old_tag);
+		tag_clear_items_by_type(tag, type);
+	}
+
+	song->tag = tag;
+
+	player_unlock(pc);
+
+	tag_free(old_tag);
+
+	playlist_song_tag_modified(playlist, position);
+	return PLAYLIST_RESULT_SUCCESS;
+}
+
 static void
 playlist_delete_internal(struct playlist *playlist, struct player_control *pc,
 			 unsigned song, const struct song **queued_p)
@@ -335,9 +485,53 @@ playlist_delete_range(struct playlist *playlist, struct player_control *pc,
 
 	queued = playlist_get_queued_song(playlist);
 
-	do {
-		playlist_delete_internal(playlist, pc, --end, &queued);
-	} while (end != start);
+	int current_position = playlist->current >= 0
+		? (int)queue_order_to_position(&playlist->queue,
+					       playlist->current)
+		: -1;
+
+	if (playlist->playing && current_position >= (int)start &&
+	    current_position < (int)end) {
+		/* the current song is deleted: fall back to the
+		   one-by-one path, which handles the player state
+		   transitions */
+		do {
+			playlist_delete_internal(playlist, pc, --end,
+						 &queued);
+		} while (end != start);
+	} else {
+		/* the current song is unaffected: notify the player
+		   of deleted non-database songs, then compact the
+		   queue in a single pass */
+
+		for (unsigned i = start; i < end; ++i) {
+			const struct song *song =
+				queue_get(&playlist->queue, i);
+			if (!song_in_database(song))
+				pc_song_deleted(pc, song);
+		}
+
+		/* count the deleted songs before "current", to
+		   adjust its order number afterwards */
+
+		unsigned deleted_before = 0;
+		for (int i = 0; i < playlist->current; ++i) {
+			unsigned position =
+				queue_order_to_position(&playlist->queue, i);
+			if (position >= start && position < end)
+				++deleted_before;
+		}
+
+		queue_delete_range(&playlist->queue, start, end);
+
+		if (current_position >= (int)start &&
+		    current_position < (int)end)
+			/* there's a "current song" but we're not
+			   playing currently - clear "current" */
+			playlist->current = -1;
+		else if (playlist->current >= 0)
+			playlist->current -= deleted_before;
+	}
 
 	playlist_increment_version(playlist);
 	playlist_update_queued_song(playlist, pc, queued);
@@ -118,15 +118,18 @@ playlist_print_changes_position(struct client *client,
 
 bool
 spl_print(struct client *client, const char *name_utf8, bool detail,
-	  GError **error_r)
+	  unsigned start, unsigned end, GError **error_r)
 {
-	GPtrArray *list;
+	const GPtrArray *list;
 
-	list = spl_load(name_utf8, error_r);
+	list = spl_load_cached(name_utf8, error_r);
 	if (list == NULL)
 		return false;
 
-	for (unsigned i = 0; i < list->len; ++i) {
+	if (end > list->len)
+		end = list->len;
+
+	for (unsigned i = start; i < end; ++i) {
 		const char *temp = g_ptr_array_index(list, i);
 		bool wrote = false;
 
@@ -143,22 +146,28 @@ spl_print(struct client *client, const char *name_utf8, bool detail,
 		}
 	}
 
-	spl_free(list);
 	return true;
 }
 
 static void
 playlist_provider_print(struct client *client, const char *uri,
-			struct playlist_provider *playlist, bool detail)
+			struct playlist_provider *playlist, bool detail,
+			unsigned start, unsigned end)
 {
 	struct song *song;
 	char *base_uri = uri != NULL ? g_path_get_dirname(uri) : NULL;
+	unsigned i = 0;
 
-	while ((song = playlist_plugin_read(playlist)) != NULL) {
+	while (i < end && (song = playlist_plugin_read(playlist)) != NULL) {
 		song = playlist_check_translate_song(song, base_uri, false);
 		if (song == NULL)
 			continue;
 
+		if (i++ < start)
+			/* skip songs before the requested range, but
+			   don't read more than necessary after it */
+			continue;
+
 		if (detail)
 			song_print_info(client, song);
 		else
@@ -169,7 +178,8 @@ playlist_provider_print(struct client *client, const char *uri,
 }
 
 bool
-playlist_file_print(struct client *client, const char *uri, bool detail)
+playlist_file_print(struct client *client, const char *uri, bool detail,
+		    unsigned start, unsigned end)
 {
 	GMutex *mutex = g_mutex_new();
 	GCond *cond = g_cond_new();
@@ -183,7 +193,7 @@ playlist_file_print(struct client *client, const char *uri, bool detail)
 		return false;
 	}
 
-	playlist_provider_print(client, uri, playlist, detail);
+	playlist_provider_print(client, uri, playlist, detail, start, end);
 	playlist_plugin_close(playlist);
 
 	if (is != NULL)
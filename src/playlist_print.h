@@ -97,11 +97,13 @@ playlist_print_changes_position(struct client *client,
  * @param client the client which requested the playlist
  * @param name_utf8 the name of the stored playlist in UTF-8 encoding
  * @param detail true if all details should be printed
+ * @param start the index of the first song to print
+ * @param end the index of the song after the last song to print
  * @return true on success, false if the playlist does not exist
  */
 bool
 spl_print(struct client *client, const char *name_utf8, bool detail,
-	  GError **error_r);
+	  unsigned start, unsigned end, GError **error_r);
 
 /**
  * Send the playlist file to the client.
@@ -109,9 +111,12 @@ spl_print(struct client *client, const char *name_utf8, bool detail,
  * @param client the client which requested the playlist
  * @param uri the URI of the playlist file in UTF-8 encoding
  * @param detail true if all details should be printed
+ * @param start the index of the first song to print
+ * @param end the index of the song after the last song to print
  * @return true on success, false if the playlist does not exist
  */
 bool
-playlist_file_print(struct client *client, const char *uri, bool detail);
+playlist_file_print(struct client *client, const char *uri, bool detail,
+		    unsigned start, unsigned end);
 
 #endif
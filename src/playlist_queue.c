@@ -26,6 +26,15 @@
 #include "song.h"
 #include "input_stream.h"
 
+/**
+ * The number of songs appended between two version bumps.  Huge
+ * playlists are loaded in bounded batches: each batch is published
+ * with one version increment, so clients can follow the progress and
+ * the queued song is re-evaluated along the way, instead of one giant
+ * invisible edit at the very end.
+ */
+#define PLAYLIST_LOAD_BATCH 1024
+
 enum playlist_result
 playlist_load_into_queue(const char *uri, struct playlist_provider *source,
 			 unsigned start_index, unsigned end_index,
@@ -34,31 +43,63 @@ playlist_load_into_queue(const char *uri, struct playlist_provider *source,
 {
 	enum playlist_result result;
 	struct song *song;
+	struct song *batch[PLAYLIST_LOAD_BATCH];
 	char *base_uri = uri != NULL ? g_path_get_dirname(uri) : NULL;
 
-	for (unsigned i = 0;
-	     i < end_index && (song = playlist_plugin_read(source)) != NULL;
-	     ++i) {
-		if (i < start_index) {
-			/* skip songs before the start index */
-			if (!song_in_database(song))
-				song_free(song);
-			continue;
+	/* one version bump and one idle event per batch; songs are
+	   read and translated in bounded batches, so the peak memory
+	   usage does not depend on the playlist size */
+	playlist_bulk_begin(dest);
+
+	unsigned i = 0;
+	bool eof = false;
+
+	while (!eof && i < end_index) {
+		/* read the next batch from the playlist plugin */
+
+		unsigned n = 0;
+		while (i < end_index && n < G_N_ELEMENTS(batch)) {
+			song = playlist_plugin_read(source);
+			if (song == NULL) {
+				eof = true;
+				break;
+			}
+
+			if (i++ < start_index) {
+				/* skip songs before the start index */
+				if (!song_in_database(song))
+					song_free(song);
+				continue;
+			}
+
+			batch[n++] = song;
 		}
 
-		song = playlist_check_translate_song(song, base_uri, secure);
-		if (song == NULL)
-			continue;
+		/* translate the batch, resolving all database songs
+		   with a single database lock */
 
-		result = playlist_append_song(dest, pc, song, NULL);
-		if (result != PLAYLIST_RESULT_SUCCESS) {
-			if (!song_in_database(song))
-				song_free(song);
-			g_free(base_uri);
-			return result;
+		n = playlist_check_translate_songs(batch, n, base_uri,
+						   secure);
+
+		for (unsigned k = 0; k < n; ++k) {
+			result = playlist_append_song(dest, pc, batch[k],
+						      NULL);
+			if (result != PLAYLIST_RESULT_SUCCESS) {
+				for (; k < n; ++k)
+					if (!song_in_database(batch[k]))
+						song_free(batch[k]);
+				playlist_bulk_end(dest, pc);
+				g_free(base_uri);
+				return result;
+			}
 		}
+
+		/* publish this batch */
+		playlist_bulk_end(dest, pc);
+		playlist_bulk_begin(dest);
 	}
 
+	playlist_bulk_end(dest, pc);
 	g_free(base_uri);
 
 	return PLAYLIST_RESULT_SUCCESS;
@@ -125,8 +125,34 @@ playlist_load_spl(struct playlist *playlist, struct player_control *pc,
 	if (list->len < end_index)
 		end_index = list->len;
 
+	/* resolve all database entries up front, with a single
+	   database lock for the whole playlist */
+
+	unsigned count = end_index > start_index
+		? end_index - start_index : 0;
+	const char **uris = g_new(const char *, count);
+	for (unsigned i = 0; i < count; ++i) {
+		const char *temp = g_ptr_array_index(list, i + start_index);
+		uris[i] = !uri_has_scheme(temp) ? temp : NULL;
+	}
+
+	struct song **resolved = g_new(struct song *, count);
+	db_get_songs(uris, count, resolved);
+	g_free(uris);
+
+	/* one version bump and one idle event for the whole
+	   playlist */
+	playlist_bulk_begin(playlist);
+
 	for (unsigned i = start_index; i < end_index; ++i) {
 		const char *temp = g_ptr_array_index(list, i);
+
+		if (resolved[i - start_index] != NULL &&
+		    playlist_append_song(playlist, pc,
+					 resolved[i - start_index],
+					 NULL) == PLAYLIST_RESULT_SUCCESS)
+			continue;
+
 		if ((playlist_append_uri(playlist, pc, temp, NULL)) != PLAYLIST_RESULT_SUCCESS) {
 			/* for windows compatibility, convert slashes */
 			char *temp2 = g_strdup(temp);
@@ -143,6 +169,9 @@ playlist_load_spl(struct playlist *playlist, struct player_control *pc,
 		}
 	}
 
+	playlist_bulk_end(playlist, pc);
+
+	g_free(resolved);
 	spl_free(list);
 	return true;
 }
@@ -83,26 +83,46 @@ apply_song_metadata(struct song *dest, const struct song *src)
 	return tmp;
 }
 
-struct song *
-playlist_check_translate_song(struct song *song, const char *base_uri,
-			      bool secure)
-{
-	struct song *dest;
+enum playlist_translate_result {
+	/** the song is ready; if it is the original object, no
+	    metadata merge is necessary */
+	PLAYLIST_TRANSLATE_DONE,
+
+	/** the song was rejected and has been freed */
+	PLAYLIST_TRANSLATE_REJECT,
+
+	/** the song must be looked up in the database */
+	PLAYLIST_TRANSLATE_DATABASE,
+};
 
-	if (song_in_database(song))
+/**
+ * Classifies a playlist entry without touching the database.
+ *
+ * @param dest_r on #PLAYLIST_TRANSLATE_DONE, the translated song
+ * @param uri_r on #PLAYLIST_TRANSLATE_DATABASE, the database URI to
+ * look up (to be freed by the caller)
+ */
+static enum playlist_translate_result
+playlist_classify_song(struct song *song, const char *base_uri, bool secure,
+		       struct song **dest_r, char **uri_r)
+{
+	if (song_in_database(song)) {
 		/* already ok */
-		return song;
+		*dest_r = song;
+		return PLAYLIST_TRANSLATE_DONE;
+	}
 
 	char *uri = song->uri;
 
 	if (uri_has_scheme(uri)) {
-		if (uri_supported_scheme(uri))
+		if (uri_supported_scheme(uri)) {
 			/* valid remote song */
-			return song;
-		else {
+			*dest_r = song;
+			return PLAYLIST_TRANSLATE_DONE;
+		} else {
 			/* unsupported remote song */
 			song_free(song);
-			return NULL;
+			return PLAYLIST_TRANSLATE_REJECT;
 		}
 	}
 
@@ -124,7 +144,7 @@ playlist_check_translate_song(struct song *song, const char *base_uri,
 			/* local files must be relative to the music
 			   directory when "secure" is enabled */
 			song_free(song);
-			return NULL;
+			return PLAYLIST_TRANSLATE_REJECT;
 		}
 
 		base_uri = NULL;
@@ -136,22 +156,51 @@ playlist_check_translate_song(struct song *song, const char *base_uri,
 		uri = g_strdup(uri);
 
 	if (uri_has_scheme(uri)) {
-		dest = song_remote_new(uri);
+		*dest_r = song_remote_new(uri);
 		g_free(uri);
+		return PLAYLIST_TRANSLATE_DONE;
 	} else if (g_path_is_absolute(uri) && secure) {
-		dest = song_file_load(uri, NULL);
+		struct song *dest = song_file_load(uri, NULL);
+		g_free(uri);
 		if (dest == NULL) {
 			song_free(song);
-			return NULL;
+			return PLAYLIST_TRANSLATE_REJECT;
 		}
+
+		*dest_r = dest;
+		return PLAYLIST_TRANSLATE_DONE;
 	} else {
+		*uri_r = uri;
+		return PLAYLIST_TRANSLATE_DATABASE;
+	}
+}
+
+struct song *
+playlist_check_translate_song(struct song *song, const char *base_uri,
+			      bool secure)
+{
+	struct song *dest = NULL;
+	char *uri = NULL;
+
+	switch (playlist_classify_song(song, base_uri, secure, &dest, &uri)) {
+	case PLAYLIST_TRANSLATE_REJECT:
+		return NULL;
+
+	case PLAYLIST_TRANSLATE_DONE:
+		if (dest == song)
+			return song;
+		break;
+
+	case PLAYLIST_TRANSLATE_DATABASE:
 		dest = db_get_song(uri);
 		g_free(uri);
 		if (dest == NULL) {
 			/* not found in database */
 			song_free(song);
-			return dest;
+			return NULL;
 		}
+
+		break;
 	}
 
 	dest = apply_song_metadata(dest, song);
@@ -159,3 +208,58 @@ playlist_check_translate_song(struct song *song, const char *base_uri,
 
 	return dest;
 }
+
+unsigned
+playlist_check_translate_songs(struct song **songs, unsigned n,
+			       const char *base_uri, bool secure)
+{
+	struct song **dests = g_new0(struct song *, n);
+	char **uris = g_new0(char *, n);
+
+	for (unsigned i = 0; i < n; ++i)
+		playlist_classify_song(songs[i], base_uri, secure,
+				       &dests[i], &uris[i]);
+
+	/* resolve all database URIs together; db_get_songs() locks
+	   the database only once for the whole batch */
+
+	struct song **resolved = g_new(struct song *, n);
+	db_get_songs((const char *const*)uris, n, resolved);
+
+	unsigned result = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		struct song *song = songs[i], *dest;
+
+		if (uris[i] != NULL) {
+			g_free(uris[i]);
+
+			dest = resolved[i];
+			if (dest == NULL) {
+				/* not found in database */
+				song_free(song);
+				continue;
+			}
+		} else {
+			dest = dests[i];
+			if (dest == NULL)
+				/* rejected (and already freed) */
+				continue;
+
+			if (dest == song) {
+				/* already ok */
+				songs[result++] = song;
+				continue;
+			}
+		}
+
+		dest = apply_song_metadata(dest, song);
+		song_free(song);
+		songs[result++] = dest;
+	}
+
+	g_free(resolved);
+	g_free(uris);
+	g_free(dests);
+
+	return result;
+}
@@ -34,4 +34,16 @@ struct song *
 playlist_check_translate_song(struct song *song, const char *base_uri,
 			      bool secure);
 
+/**
+ * Like playlist_check_translate_song(), but for a whole batch of
+ * songs: all database lookups are performed with a single database
+ * lock.  Translated songs are compacted at the beginning of the
+ * array; rejected ones are freed.
+ *
+ * @return the number of remaining songs
+ */
+unsigned
+playlist_check_translate_songs(struct song **songs, unsigned n,
+			       const char *base_uri, bool secure);
+
 #endif
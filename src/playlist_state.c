@@ -110,8 +110,11 @@ playlist_state_load(FILE *fp, GString *buffer, struct playlist *playlist)
 		return;
 	}
 
+	struct queue_loader loader;
+	queue_loader_init(&loader);
+
 	while (!g_str_has_prefix(line, PLAYLIST_STATE_FILE_PLAYLIST_END)) {
-		queue_load_song(fp, buffer, line, &playlist->queue);
+		queue_load_song(fp, buffer, line, &playlist->queue, &loader);
 
 		line = read_text_line(fp, buffer);
 		if (line == NULL) {
@@ -121,6 +124,8 @@ playlist_state_load(FILE *fp, GString *buffer, struct playlist *playlist)
 		}
 	}
 
+	queue_loader_finish(&loader);
+
 	queue_increment_version(&playlist->queue);
 }
 
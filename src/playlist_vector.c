@@ -47,42 +47,56 @@ playlist_metadata_free(struct playlist_metadata *pm)
 }
 
 void
-playlist_vector_deinit(struct list_head *pv)
+playlist_vector_init(struct playlist_vector *pv)
+{
+	INIT_LIST_HEAD(&pv->head);
+	pv->index = NULL;
+}
+
+void
+playlist_vector_deinit(struct playlist_vector *pv)
 {
 	assert(pv != NULL);
 
+	if (pv->index != NULL) {
+		g_hash_table_destroy(pv->index);
+		pv->index = NULL;
+	}
+
 	struct playlist_metadata *pm, *n;
 	playlist_vector_for_each_safe(pm, n, pv)
 		playlist_metadata_free(pm);
 }
 
 struct playlist_metadata *
-playlist_vector_find(struct list_head *pv, const char *name)
+playlist_vector_find(struct playlist_vector *pv, const char *name)
 {
-	assert(holding_db_lock());
+	assert(holding_db_read_lock());
 	assert(pv != NULL);
 	assert(name != NULL);
 
-	struct playlist_metadata *pm;
-	playlist_vector_for_each(pm, pv)
-		if (strcmp(pm->name, name) == 0)
-			return pm;
-
-	return NULL;
+	return pv->index != NULL
+		? g_hash_table_lookup(pv->index, name)
+		: NULL;
 }
 
 void
-playlist_vector_add(struct list_head *pv,
+playlist_vector_add(struct playlist_vector *pv,
 		    const char *name, time_t mtime)
 {
 	assert(holding_db_lock());
 
 	struct playlist_metadata *pm = playlist_metadata_new(name, mtime);
-	list_add_tail(&pm->siblings, pv);
+	list_add_tail(&pm->siblings, &pv->head);
+
+	if (pv->index == NULL)
+		pv->index = g_hash_table_new(g_str_hash, g_str_equal);
+
+	g_hash_table_insert(pv->index, pm->name, pm);
 }
 
 bool
-playlist_vector_update_or_add(struct list_head *pv,
+playlist_vector_update_or_add(struct playlist_vector *pv,
 			      const char *name, time_t mtime)
 {
 	assert(holding_db_lock());
@@ -100,7 +114,7 @@ playlist_vector_update_or_add(struct list_head *pv,
 }
 
 bool
-playlist_vector_remove(struct list_head *pv, const char *name)
+playlist_vector_remove(struct playlist_vector *pv, const char *name)
 {
 	assert(holding_db_lock());
 
@@ -108,6 +122,7 @@ playlist_vector_remove(struct list_head *pv, const char *name)
 	if (pm == NULL)
 		return false;
 
+	g_hash_table_remove(pv->index, pm->name);
 	list_del(&pm->siblings);
 	playlist_metadata_free(pm);
 	return true;
@@ -22,15 +22,30 @@
 
 #include "util/list.h"
 
+#include <glib.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <sys/time.h>
 
-#define playlist_vector_for_each(pos, head) \
-	list_for_each_entry(pos, head, siblings)
+#define playlist_vector_for_each(pos, pv) \
+	list_for_each_entry(pos, &(pv)->head, siblings)
 
-#define playlist_vector_for_each_safe(pos, n, head) \
-	list_for_each_entry_safe(pos, n, head, siblings)
+#define playlist_vector_for_each_safe(pos, n, pv) \
+	list_for_each_entry_safe(pos, n, &(pv)->head, siblings)
+
+/**
+ * The playlist files in one directory.
+ */
+struct playlist_vector {
+	struct list_head head;
+
+	/**
+	 * An index of the entries by name, kept in sync with the
+	 * list.  NULL until the first entry is added.  The keys point
+	 * into the entry's "name" buffer.
+	 */
+	GHashTable *index;
+};
 
 /**
  * A directory entry pointing to a playlist file.
@@ -47,19 +62,22 @@ struct playlist_metadata {
 };
 
 void
-playlist_vector_deinit(struct list_head *pv);
+playlist_vector_init(struct playlist_vector *pv);
+
+void
+playlist_vector_deinit(struct playlist_vector *pv);
 
 /**
  * Caller must lock the #db_mutex.
  */
 struct playlist_metadata *
-playlist_vector_find(struct list_head *pv, const char *name);
+playlist_vector_find(struct playlist_vector *pv, const char *name);
 
 /**
  * Caller must lock the #db_mutex.
  */
 void
-playlist_vector_add(struct list_head *pv,
+playlist_vector_add(struct playlist_vector *pv,
 		    const char *name, time_t mtime);
 
 /**
@@ -68,13 +86,13 @@ playlist_vector_add(struct list_head *pv,
  * @return true if the vector or one of its items was modified
  */
 bool
-playlist_vector_update_or_add(struct list_head *pv,
+playlist_vector_update_or_add(struct playlist_vector *pv,
 			      const char *name, time_t mtime);
 
 /**
  * Caller must lock the #db_mutex.
  */
 bool
-playlist_vector_remove(struct list_head *pv, const char *name);
+playlist_vector_remove(struct playlist_vector *pv, const char *name);
 
 #endif /* SONGVEC_H */
@@ -20,6 +20,7 @@
 #include "config.h"
 #include "result.h"
 #include "client.h"
+#include "client_binary.h"
 
 #include <assert.h>
 
@@ -29,6 +30,10 @@ int command_list_num;
 void
 command_success(struct client *client)
 {
+	/* close a binary frame before the text line, so the client
+	   knows where the records end */
+	client_binary_end(client);
+
 	client_puts(client, "OK\n");
 }
 
@@ -39,6 +44,8 @@ command_error_v(struct client *client, enum ack error,
 	assert(client != NULL);
 	assert(current_command != NULL);
 
+	client_binary_end(client);
+
 	client_printf(client, "ACK [%i@%i] {%s} ",
 		      (int)error, command_list_num, current_command);
 	client_vprintf(client, fmt, args);
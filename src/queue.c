@@ -41,6 +41,144 @@ queue_generate_id(const struct queue *queue)
 	return cur;
 }
 
+static int
+queue_change_cmp(const void *av, const void *bv)
+{
+	const struct queue_change *a = av, *b = bv;
+
+	if (a->version != b->version)
+		return a->version < b->version ? -1 : 1;
+
+	return 0;
+}
+
+/**
+ * Rebuild the modification log with one entry per song, ordered by
+ * version.
+ */
+static void
+queue_compact_changes(struct queue *queue)
+{
+	if (queue->max_changes < queue->length) {
+		do {
+			queue->max_changes = queue->max_changes == 0
+				? 64 : queue->max_changes * 2;
+		} while (queue->max_changes < queue->length);
+
+		queue->changes = g_realloc(queue->changes,
+					   queue->max_changes *
+					   sizeof(queue->changes[0]));
+	}
+
+	for (unsigned i = 0; i < queue->length; i++)
+		queue->changes[i] = (struct queue_change){
+			.id = queue->items[i].id,
+			.version = queue->items[i].version,
+		};
+
+	queue->num_changes = queue->length;
+
+	qsort(queue->changes, queue->num_changes,
+	      sizeof(queue->changes[0]), queue_change_cmp);
+}
+
+/**
+ * Appends an entry to the modification log.  The log stays ordered by
+ * version because the version number never decreases between resets.
+ */
+static void
+queue_log_change(struct queue *queue, unsigned id)
+{
+	/* coalesce repeated modifications of the same song at the
+	   same version */
+	if (queue->num_changes > 0) {
+		const struct queue_change *last =
+			&queue->changes[queue->num_changes - 1];
+		if (last->id == id && last->version == queue->version)
+			return;
+	}
+
+	if (queue->num_changes >= queue->max_changes) {
+		if (queue->num_changes >= 2 * queue->length)
+			queue_compact_changes(queue);
+
+		if (queue->num_changes >= queue->max_changes) {
+			queue->max_changes = queue->max_changes == 0
+				? 64 : queue->max_changes * 2;
+			queue->changes = g_realloc(queue->changes,
+						   queue->max_changes *
+						   sizeof(queue->changes[0]));
+		}
+	}
+
+	queue->changes[queue->num_changes++] = (struct queue_change){
+		.id = id,
+		.version = queue->version,
+	};
+}
+
+static int
+queue_position_cmp(const void *av, const void *bv)
+{
+	const unsigned *a = av, *b = bv;
+
+	return *a < *b ? -1 : (*a > *b ? 1 : 0);
+}
+
+int
+queue_collect_changes(const struct queue *queue, uint32_t version,
+		      unsigned **positions_r)
+{
+	if (version == 0 || version > queue->version)
+		/* all songs are considered "newer": the full scan is
+		   just as fast */
+		return -1;
+
+	if (queue->num_changes > 0 && queue->changes[0].version == 0)
+		/* version numbers have wrapped around; the log
+		   ordering is unreliable */
+		return -1;
+
+	/* binary search for the first entry at or after the
+	   requested version */
+
+	unsigned a = 0, b = queue->num_changes;
+	while (a < b) {
+		unsigned i = (a + b) / 2;
+
+		if (queue->changes[i].version >= version)
+			b = i;
+		else
+			a = i + 1;
+	}
+
+	unsigned n = 0;
+	unsigned *positions = g_new(unsigned, queue->num_changes - a + 1);
+
+	for (unsigned i = a; i < queue->num_changes; i++) {
+		int position = queue_id_to_position(queue,
+						    queue->changes[i].id);
+
+		/* ids may be stale or reused; re-check against the
+		   song which currently owns the id */
+		if (position >= 0 &&
+		    queue_song_newer(queue, position, version))
+			positions[n++] = position;
+	}
+
+	/* sort by position and remove the duplicates */
+
+	qsort(positions, n, sizeof(positions[0]), queue_position_cmp);
+
+	unsigned m = 0;
+	for (unsigned i = 0; i < n; i++)
+		if (m == 0 || positions[m - 1] != positions[i])
+			positions[m++] = positions[i];
+
+	*positions_r = positions;
+	return m;
+}
+
 int
 queue_next_order(const struct queue *queue, unsigned order)
 {
@@ -70,6 +208,10 @@ queue_increment_version(struct queue *queue)
 			queue->items[i].version = 0;
 
 		queue->version = 1;
+
+		/* the item versions have been reset; rebuild the
+		   modification log to match */
+		queue_compact_changes(queue);
 	}
 }
 
@@ -82,6 +224,7 @@ queue_modify(struct queue *queue, unsigned order)
 
 	position = queue->order[order];
 	queue->items[position].version = queue->version;
+	queue_log_change(queue, queue->items[position].id);
 
 	queue_increment_version(queue);
 }
@@ -92,6 +235,8 @@ queue_modify_all(struct queue *queue)
 	for (unsigned i = 0; i < queue->length; i++)
 		queue->items[i].version = queue->version;
 
+	queue_compact_changes(queue);
+
 	queue_increment_version(queue);
 }
 
@@ -114,6 +259,8 @@ queue_append(struct queue *queue, struct song *song)
 
 	++queue->length;
 
+	queue_log_change(queue, id);
+
 	return id;
 }
 
@@ -133,6 +280,9 @@ queue_swap(struct queue *queue, unsigned position1, unsigned position2)
 
 	queue->id_to_position[id1] = position2;
 	queue->id_to_position[id2] = position1;
+
+	queue_log_change(queue, id1);
+	queue_log_change(queue, id2);
 }
 
 static void
@@ -143,6 +293,8 @@ queue_move_song_to(struct queue *queue, unsigned from, unsigned to)
 	queue->items[to] = queue->items[from];
 	queue->items[to].version = queue->version;
 	queue->id_to_position[from_id] = to;
+
+	queue_log_change(queue, from_id);
 }
 
 void
@@ -165,6 +317,7 @@ queue_move(struct queue *queue, unsigned from, unsigned to)
 	queue->id_to_position[item.id] = to;
 	queue->items[to] = item;
 	queue->items[to].version = queue->version;
+	queue_log_change(queue, item.id);
 
 	/* now deal with order */
 
@@ -205,6 +358,7 @@ queue_move_range(struct queue *queue, unsigned start, unsigned end, unsigned to)
 		queue->id_to_position[items[i-start].id] = to + i - start;
 		queue->items[to + i - start] = items[i-start];
 		queue->items[to + i - start].version = queue->version;
+		queue_log_change(queue, items[i-start].id);
 	}
 
 	if (queue->random) {
@@ -262,6 +416,12 @@ queue_delete(struct queue *queue, unsigned position)
 	id = queue_position_to_id(queue, position);
 	order = queue_position_to_order(queue, position);
 
+	if (queue->items[position].priority != 0)
+		--queue->priority_count;
+
+	if (order < queue->order_shuffled)
+		--queue->order_shuffled;
+
 	--queue->length;
 
 	/* release the song id */
@@ -285,6 +445,55 @@ queue_delete(struct queue *queue, unsigned position)
 			--queue->order[i];
 }
 
+void
+queue_delete_range(struct queue *queue, unsigned start, unsigned end)
+{
+	assert(start < end);
+	assert(end <= queue->length);
+
+	const unsigned n = end - start;
+
+	/* release the deleted songs and their ids */
+
+	for (unsigned i = start; i < end; i++) {
+		struct queue_item *item = &queue->items[i];
+
+		if (!song_in_database(item->song))
+			song_free(item->song);
+
+		if (item->priority != 0)
+			--queue->priority_count;
+
+		queue->id_to_position[item->id] = -1;
+	}
+
+	/* compact the order array in one pass, preserving the
+	   relative order of the remaining songs */
+
+	const unsigned old_shuffled = queue->order_shuffled;
+	unsigned o = 0;
+	for (unsigned i = 0; i < queue->length; i++) {
+		unsigned position = queue->order[i];
+
+		if (position >= start && position < end) {
+			if (i < old_shuffled)
+				--queue->order_shuffled;
+			continue;
+		}
+
+		queue->order[o++] = position >= end ? position - n : position;
+	}
+
+	queue->length -= n;
+	assert(o == queue->length);
+	assert(queue->order_shuffled <= queue->length);
+
+	/* compact the songs array in one pass */
+
+	for (unsigned i = start; i < queue->length; i++)
+		queue_move_song_to(queue, i + n, i);
+}
+
 void
 queue_clear(struct queue *queue)
 {
@@ -298,6 +507,9 @@ queue_clear(struct queue *queue)
 	}
 
 	queue->length = 0;
+	queue->num_changes = 0;
+	queue->order_shuffled = 0;
+	queue->priority_count = 0;
 }
 
 void
@@ -320,6 +532,13 @@ queue_init(struct queue *queue, unsigned max_length)
 	for (unsigned i = 0; i < max_length * QUEUE_HASH_MULT; ++i)
 		queue->id_to_position[i] = -1;
 
+	queue->changes = NULL;
+	queue->num_changes = 0;
+	queue->max_changes = 0;
+
+	queue->order_shuffled = 0;
+	queue->priority_count = 0;
+
 	queue->rand = g_rand_new();
 }
 
@@ -331,6 +550,7 @@ queue_finish(struct queue *queue)
 	g_free(queue->items);
 	g_free(queue->order);
 	g_free(queue->id_to_position);
+	g_free(queue->changes);
 
 	g_rand_free(queue->rand);
 }
@@ -350,6 +570,32 @@ queue_get_order_priority(const struct queue *queue, unsigned order)
 	return queue_get_order_item_const(queue, order)->priority;
 }
 
+/**
+ * Finds the first entry in the given order range whose priority is
+ * equal to or below the specified one, with a binary search.  Valid
+ * only while the range is sorted by descending priority, which is the
+ * invariant of the unplayed suffix of the order array in random mode.
+ */
+G_GNUC_PURE
+static unsigned
+queue_priority_lower_bound(const struct queue *queue,
+			   unsigned start, unsigned end, uint8_t priority)
+{
+	assert(start <= end);
+	assert(end <= queue->length);
+
+	while (start < end) {
+		const unsigned mid = (start + end) / 2;
+
+		if (queue_get_order_priority(queue, mid) <= priority)
+			end = mid;
+		else
+			start = mid + 1;
+	}
+
+	return start;
+}
+
 static gint
 queue_item_compare_order_priority(gconstpointer av, gconstpointer bv,
 				  gpointer user_data)
@@ -444,7 +690,58 @@ queue_shuffle_order_range_with_priority(struct queue *queue,
 void
 queue_shuffle_order(struct queue *queue)
 {
-	queue_shuffle_order_range_with_priority(queue, 0, queue->length);
+	assert(queue->random);
+
+	if (queue->priority_count > 0) {
+		/* priorities require the eager shuffle: the order
+		   must be grouped by priority up front */
+		queue_shuffle_order_range_with_priority(queue, 0,
+							queue->length);
+		queue->order_shuffled = queue->length;
+	} else
+		/* lazy: the order array is already a valid
+		   permutation; resetting the finalized prefix is
+		   enough, each entry is drawn freshly from the whole
+		   remainder when playback approaches it */
+		queue->order_shuffled = 0;
+}
+
+void
+queue_order_move_first(struct queue *queue, unsigned order)
+{
+	assert(queue->random);
+	assert(order < queue->length);
+
+	if (queue->priority_count > 0)
+		/* keep the descending-priority grouping of the
+		   remaining entries intact */
+		queue_move_order(queue, order, 0);
+	else
+		queue_swap_order(queue, 0, order);
+
+	/* mark the first entry as drawn, so lazy realization will
+	   not move it again */
+	if (queue->order_shuffled < 1)
+		queue->order_shuffled = 1;
+}
+
+void
+queue_order_realize(struct queue *queue, unsigned order)
+{
+	assert(order < queue->length);
+
+	if (!queue->random)
+		return;
+
+	/* continue the incremental Fisher-Yates shuffle up to the
+	   requested entry */
+
+	while (queue->order_shuffled <= order) {
+		unsigned i = queue->order_shuffled++;
+		queue_swap_order(queue, i,
+				 g_rand_int_range(queue->rand, i,
+						  queue->length));
+	}
 }
 
 static void
@@ -457,6 +754,27 @@ queue_shuffle_order_first(struct queue *queue, unsigned start, unsigned end)
 void
 queue_shuffle_order_last(struct queue *queue, unsigned start, unsigned end)
 {
+	if (queue->priority_count > 0) {
+		/* don't break the descending-priority grouping of the
+		   unplayed suffix: insert the new entry at a random
+		   slot within its own priority group */
+
+		const uint8_t priority =
+			queue_get_order_priority(queue, end - 1);
+		const unsigned group_start =
+			queue_priority_lower_bound(queue, start, end - 1,
+						   priority);
+		const unsigned group_end = priority > 0
+			? queue_priority_lower_bound(queue, group_start,
+						     end - 1, priority - 1)
+			: end - 1;
+
+		queue_move_order(queue, end - 1,
+				 g_rand_int_range(queue->rand, group_start,
+						  group_end + 1));
+		return;
+	}
+
 	queue_swap_order(queue, end - 1,
 			 g_rand_int_range(queue->rand, start, end));
 }
@@ -473,47 +791,6 @@ queue_shuffle_range(struct queue *queue, unsigned start, unsigned end)
 	}
 }
 
-/**
- * Find the first item that has this specified priority or higher.
- */
-G_GNUC_PURE
-static unsigned
-queue_find_priority_order(const struct queue *queue, unsigned start_order,
-			  uint8_t priority, unsigned exclude_order)
-{
-	assert(queue != NULL);
-	assert(queue->random);
-	assert(start_order <= queue->length);
-
-	for (unsigned order = start_order; order < queue->length; ++order) {
-		const unsigned position = queue_order_to_position(queue, order);
-		const struct queue_item *item = &queue->items[position];
-		if (item->priority <= priority && order != exclude_order)
-			return order;
-	}
-
-	return queue->length;
-}
-
-G_GNUC_PURE
-static unsigned
-queue_count_same_priority(const struct queue *queue, unsigned start_order,
-			  uint8_t priority)
-{
-	assert(queue != NULL);
-	assert(queue->random);
-	assert(start_order <= queue->length);
-
-	for (unsigned order = start_order; order < queue->length; ++order) {
-		const unsigned position = queue_order_to_position(queue, order);
-		const struct queue_item *item = &queue->items[position];
-		if (item->priority != priority)
-			return order - start_order;
-	}
-
-	return queue->length - start_order;
-}
-
 bool
 queue_set_priority(struct queue *queue, unsigned position, uint8_t priority,
 		   int after_order)
@@ -526,18 +803,31 @@ queue_set_priority(struct queue *queue, unsigned position, uint8_t priority,
 	if (old_priority == priority)
 		return false;
 
+	if (old_priority == 0)
+		++queue->priority_count;
+	else if (priority == 0)
+		--queue->priority_count;
+
 	item->version = queue->version;
-	item->priority = priority;
+	queue_log_change(queue, item->id);
 
-	if (!queue->random)
+	if (!queue->random) {
 		/* don't reorder if not in random mode */
+		item->priority = priority;
 		return true;
+	}
+
+	/* the priority insertion logic below requires a fully
+	   determined order */
+	queue_order_realize(queue, queue->length - 1);
 
 	unsigned order = queue_position_to_order(queue, position);
 	if (after_order >= 0) {
-		if (order == (unsigned)after_order)
+		if (order == (unsigned)after_order) {
 			/* don't reorder the current song */
+			item->priority = priority;
 			return true;
+		}
 
 		if (order < (unsigned)after_order) {
 			/* the specified song has been played already
@@ -549,30 +839,45 @@ queue_set_priority(struct queue *queue, unsigned position, uint8_t priority,
 			const struct queue_item *after_item =
 				&queue->items[after_position];
 			if (old_priority > after_item->priority ||
-			    priority <= after_item->priority)
+			    priority <= after_item->priority) {
 				/* priority hasn't become bigger */
+				item->priority = priority;
 				return true;
+			}
 		}
 	}
 
 	/* move the item to the beginning of the priority group (or
-	   create a new priority group) */
+	   create a new priority group); the unplayed suffix of the
+	   order array is grouped by descending priority, so a binary
+	   search finds the slot.  The item still carries its old
+	   priority, which keeps the range monotonic during the
+	   search. */
+
+	unsigned before_order =
+		queue_priority_lower_bound(queue, after_order + 1,
+					   queue->length, priority);
+	if (before_order == order)
+		/* the item itself must not terminate the search; the
+		   following entry satisfies the condition, too,
+		   because the range is sorted */
+		++before_order;
 
-	const unsigned before_order =
-		queue_find_priority_order(queue, after_order + 1, priority,
-					  order);
 	const unsigned new_order = before_order > order
 		? before_order - 1
 		: before_order;
+
+	item->priority = priority;
 	queue_move_order(queue, order, new_order);
 
 	/* shuffle the song within that priority group */
 
-	const unsigned priority_count =
-		queue_count_same_priority(queue, new_order, priority);
-	assert(priority_count >= 1);
-	queue_shuffle_order_first(queue, new_order,
-				  new_order + priority_count);
+	const unsigned group_end = priority > 0
+		? queue_priority_lower_bound(queue, new_order,
+					     queue->length, priority - 1)
+		: queue->length;
+	assert(group_end > new_order);
+	queue_shuffle_order_first(queue, new_order, group_end);
 
 	return true;
 }
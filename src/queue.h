@@ -34,6 +34,16 @@ enum {
 	QUEUE_HASH_MULT = 4,
 };
 
+/**
+ * One entry of the modification log: the song with the given id was
+ * modified at the given version.
+ */
+struct queue_change {
+	unsigned id;
+
+	uint32_t version;
+};
+
 /**
  * One element of the queue: basically a song plus some queue specific
  * information attached.
@@ -84,6 +94,18 @@ struct queue {
 	/** map song ids to positions */
 	int *id_to_position;
 
+	/** a version-ordered log of modifications, which allows
+	    answering "plchanges" in O(changes) instead of scanning
+	    the whole queue; it is compacted to one entry per song
+	    when it outgrows the queue */
+	struct queue_change *changes;
+
+	/** number of entries in #changes */
+	unsigned num_changes;
+
+	/** number of entries allocated for #changes */
+	unsigned max_changes;
+
 	/** repeat playback when the end of the queue has been
 	    reached? */
 	bool repeat;
@@ -97,6 +119,25 @@ struct queue {
 	/** play back songs in random order? */
 	bool random;
 
+	/**
+	 * The number of finalized entries at the beginning of the
+	 * order array while random mode is enabled.  The remaining
+	 * suffix is still a valid permutation, but its entries are
+	 * only drawn (an incremental Fisher-Yates prefix) when
+	 * playback approaches them, see queue_order_realize(); this
+	 * makes enabling random mode O(1).
+	 */
+	unsigned order_shuffled;
+
+	/**
+	 * The number of items with a non-zero priority.  While zero
+	 * (the common case), queue_shuffle_order() can take the lazy
+	 * path; priorities require the eager full shuffle, because
+	 * the next song must be chosen from the highest priority
+	 * group.
+	 */
+	unsigned priority_count;
+
 	/** random number generator for shuffle and random mode */
 	GRand *rand;
 };
@@ -319,6 +360,14 @@ queue_move_range(struct queue *queue, unsigned start, unsigned end, unsigned to)
 void
 queue_delete(struct queue *queue, unsigned position);
 
+/**
+ * Removes a range of songs from the playlist in a single compaction
+ * pass, which is much cheaper than calling queue_delete() for each
+ * position.
+ */
+void
+queue_delete_range(struct queue *queue, unsigned start, unsigned end);
+
 /**
  * Removes all songs from the playlist.
  */
@@ -345,11 +394,29 @@ queue_shuffle_order_range_with_priority(struct queue *queue,
 
 /**
  * Shuffles the virtual order of songs, but does not move them
- * physically.  This is used in random mode.
+ * physically.  This is used in random mode.  Without priorities, this
+ * only resets the finalized prefix and is O(1); the entries are drawn
+ * lazily by queue_order_realize().
  */
 void
 queue_shuffle_order(struct queue *queue);
 
+/**
+ * Makes sure the order entries up to and including the specified one
+ * have been drawn.  Must be called before an order entry is used to
+ * start or queue playback; a no-op when random mode is disabled.
+ */
+void
+queue_order_realize(struct queue *queue, unsigned order);
+
+/**
+ * Moves the specified order entry to the front and pins it there, so
+ * the current song is played first and lazy realization will not move
+ * it again.
+ */
+void
+queue_order_move_first(struct queue *queue, unsigned order);
+
 /**
  * Shuffles the virtual order of the last song in the specified
  * (order) range.  This is used in random mode after a song has been
@@ -365,6 +432,18 @@ queue_shuffle_order_last(struct queue *queue, unsigned start, unsigned end);
 void
 queue_shuffle_range(struct queue *queue, unsigned start, unsigned end);
 
+/**
+ * Collects the positions of all songs which are newer than the
+ * specified version, using the modification log.  On success, the
+ * positions are stored in ascending order in *positions_r (to be
+ * freed with g_free()) and their number is returned.  Returns -1 if
+ * the log cannot answer the query; the caller must then fall back to
+ * scanning the whole queue.
+ */
+int
+queue_collect_changes(const struct queue *queue, uint32_t version,
+		      unsigned **positions_r);
+
 bool
 queue_set_priority(struct queue *queue, unsigned position,
 		   uint8_t priority, int after_order);
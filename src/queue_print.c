@@ -39,12 +39,13 @@ queue_print_song_info(struct client *client, const struct queue *queue,
 		      unsigned position)
 {
 	song_print_info(client, queue_get(queue, position));
-	client_printf(client, "Pos: %u\nId: %u\n",
-		      position, queue_position_to_id(queue, position));
+	client_write_pair_uint(client, "Pos", position);
+	client_write_pair_uint(client, "Id",
+			       queue_position_to_id(queue, position));
 
 	uint8_t priority = queue_get_priority_at_position(queue, position);
 	if (priority != 0)
-		client_printf(client, "Prio: %u\n", priority);
+		client_write_pair_uint(client, "Prio", priority);
 }
 
 void
@@ -75,6 +76,17 @@ void
 queue_print_changes_info(struct client *client, const struct queue *queue,
 			 uint32_t version)
 {
+	unsigned *positions;
+	int n = queue_collect_changes(queue, version, &positions);
+	if (n >= 0) {
+		for (int i = 0; i < n; ++i)
+			queue_print_song_info(client, queue, positions[i]);
+		g_free(positions);
+		return;
+	}
+
+	/* the modification log cannot answer this query; scan the
+	   whole queue */
 	for (unsigned i = 0; i < queue_length(queue); i++) {
 		if (queue_song_newer(queue, i, version))
 			queue_print_song_info(client, queue, i);
@@ -85,6 +97,17 @@ void
 queue_print_changes_position(struct client *client, const struct queue *queue,
 			     uint32_t version)
 {
+	unsigned *positions;
+	int n = queue_collect_changes(queue, version, &positions);
+	if (n >= 0) {
+		for (int i = 0; i < n; ++i)
+			client_printf(client, "cpos: %i\nId: %i\n",
+				      positions[i],
+				      queue_position_to_id(queue, positions[i]));
+		g_free(positions);
+		return;
+	}
+
 	for (unsigned i = 0; i < queue_length(queue); i++)
 		if (queue_song_newer(queue, i, version))
 			client_printf(client, "cpos: %i\nId: %i\n",
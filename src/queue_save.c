@@ -23,9 +23,12 @@
 #include "song.h"
 #include "uri.h"
 #include "database.h"
+#include "db_lock.h"
+#include "directory.h"
 #include "song_save.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 static void
 queue_save_database_song(FILE *fp, int idx, const struct song *song)
@@ -58,17 +61,67 @@ queue_save(FILE *fp, const struct queue *queue)
 		queue_save_song(fp, i, queue_get(queue, i));
 }
 
+void
+queue_loader_init(struct queue_loader *loader)
+{
+	loader->dir_uri = NULL;
+	loader->directory = NULL;
+}
+
+void
+queue_loader_finish(struct queue_loader *loader)
+{
+	g_free(loader->dir_uri);
+}
+
 static struct song *
-get_song(const char *uri)
+queue_loader_get_song(struct queue_loader *loader, const char *uri)
 {
-	return uri_has_scheme(uri)
-		? song_remote_new(uri)
-		: db_get_song(uri);
+	struct song *song = NULL;
+
+	if (uri_has_scheme(uri))
+		return song_remote_new(uri);
+
+	char *duplicated = g_strdup(uri);
+	char *base = strrchr(duplicated, '/');
+	const char *dir_uri, *name;
+
+	if (base != NULL) {
+		*base++ = 0;
+		dir_uri = duplicated;
+		name = base;
+	} else {
+		dir_uri = "";
+		name = duplicated;
+	}
+
+	if (loader->directory != NULL &&
+	    strcmp(loader->dir_uri, dir_uri) == 0) {
+		/* same directory as the previous song: probe its song
+		   map directly, without walking the whole path */
+		db_read_lock();
+		song = directory_get_song(loader->directory, name);
+		db_read_unlock();
+	}
+
+	if (song == NULL) {
+		song = db_get_song(uri);
+		if (song != NULL) {
+			/* remember the parent directory for the next
+			   song */
+			g_free(loader->dir_uri);
+			loader->dir_uri = g_strdup(dir_uri);
+			loader->directory = song->parent;
+		}
+	}
+
+	g_free(duplicated);
+	return song;
 }
 
 void
 queue_load_song(FILE *fp, GString *buffer, const char *line,
-		struct queue *queue)
+		struct queue *queue, struct queue_loader *loader)
 {
 	struct song *song;
 
@@ -97,7 +150,7 @@ queue_load_song(FILE *fp, GString *buffer, const char *line,
 
 		line = endptr + 1;
 
-		song = get_song(line);
+		song = queue_loader_get_song(loader, line);
 		if (song == NULL)
 			return;
 	}
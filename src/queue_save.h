@@ -29,6 +29,31 @@
 #include <stdio.h>
 
 struct queue;
+struct directory;
+
+/**
+ * State for resolving a sequence of saved queue songs against the
+ * database.  It caches the parent directory of the previously
+ * resolved song, so consecutive songs from the same directory (the
+ * common case: albums are added in one piece) cost only one hash
+ * table probe each, instead of a full path walk.
+ *
+ * Since it caches a #directory pointer, it must not be used while a
+ * database update may run.
+ */
+struct queue_loader {
+	/** the uri of #directory; NULL if nothing is cached yet */
+	char *dir_uri;
+
+	/** the parent directory of the previously resolved song */
+	struct directory *directory;
+};
+
+void
+queue_loader_init(struct queue_loader *loader);
+
+void
+queue_loader_finish(struct queue_loader *loader);
 
 void
 queue_save(FILE *fp, const struct queue *queue);
@@ -38,6 +63,6 @@ queue_save(FILE *fp, const struct queue *queue);
  */
 void
 queue_load_song(FILE *fp, GString *buffer, const char *line,
-		struct queue *queue);
+		struct queue *queue, struct queue_loader *loader);
 
 #endif
@@ -27,40 +27,30 @@
 #include <string.h>
 #include <stdlib.h>
 
-struct rg_ape_ctx {
-	struct replay_gain_info *info;
-	bool found;
-};
-
 static bool
-replay_gain_ape_callback(unsigned long flags, const char *key,
-			 const char *_value, size_t value_length, void *_ctx)
+replay_gain_ape_import_item(const struct ape_item *item,
+			    struct replay_gain_info *info)
 {
-	struct rg_ape_ctx *ctx = _ctx;
-
 	/* we only care about utf-8 text tags */
-	if ((flags & (0x3 << 1)) != 0)
-		return true;
+	if ((item->flags & (0x3 << 1)) != 0)
+		return false;
 
 	char value[16];
-	if (value_length >= sizeof(value))
-		return true;
-	memcpy(value, _value, value_length);
-	value[value_length] = 0;
+	if (item->value_length >= sizeof(value))
+		return false;
+	memcpy(value, item->value, item->value_length);
+	value[item->value_length] = 0;
 
-	if (g_ascii_strcasecmp(key, "replaygain_track_gain") == 0) {
-		ctx->info->tuples[REPLAY_GAIN_TRACK].gain = atof(value);
-		ctx->found = true;
-	} else if (g_ascii_strcasecmp(key, "replaygain_album_gain") == 0) {
-		ctx->info->tuples[REPLAY_GAIN_ALBUM].gain = atof(value);
-		ctx->found = true;
-	} else if (g_ascii_strcasecmp(key, "replaygain_track_peak") == 0) {
-		ctx->info->tuples[REPLAY_GAIN_TRACK].peak = atof(value);
-		ctx->found = true;
-	} else if (g_ascii_strcasecmp(key, "replaygain_album_peak") == 0) {
-		ctx->info->tuples[REPLAY_GAIN_ALBUM].peak = atof(value);
-		ctx->found = true;
-	}
+	if (g_ascii_strcasecmp(item->key, "replaygain_track_gain") == 0)
+		info->tuples[REPLAY_GAIN_TRACK].gain = atof(value);
+	else if (g_ascii_strcasecmp(item->key, "replaygain_album_gain") == 0)
+		info->tuples[REPLAY_GAIN_ALBUM].gain = atof(value);
+	else if (g_ascii_strcasecmp(item->key, "replaygain_track_peak") == 0)
+		info->tuples[REPLAY_GAIN_TRACK].peak = atof(value);
+	else if (g_ascii_strcasecmp(item->key, "replaygain_album_peak") == 0)
+		info->tuples[REPLAY_GAIN_ALBUM].peak = atof(value);
+	else
+		return false;
 
 	return true;
 }
@@ -68,11 +58,15 @@ replay_gain_ape_callback(unsigned long flags, const char *key,
 bool
 replay_gain_ape_read(const char *path_fs, struct replay_gain_info *info)
 {
-	struct rg_ape_ctx ctx = {
-		.info = info,
-		.found = false,
-	};
+	struct ape_tag *tag = ape_tag_get(path_fs);
+	if (tag == NULL)
+		return false;
+
+	bool found = false;
+	for (unsigned i = 0; i < ape_tag_count(tag); ++i)
+		if (replay_gain_ape_import_item(ape_tag_item(tag, i), info))
+			found = true;
 
-	return tag_ape_scan(path_fs, replay_gain_ape_callback, &ctx) &&
-		ctx.found;
+	ape_tag_unref(tag);
+	return found;
 }
@@ -38,6 +38,8 @@ static const char *const replay_gain_mode_names[] = {
 
 enum replay_gain_mode replay_gain_mode = REPLAY_GAIN_OFF;
 
+volatile gint replay_gain_generation;
+
 const bool DEFAULT_REPLAYGAIN_LIMIT = true;
 
 float replay_gain_preamp = 1.0;
@@ -82,6 +84,7 @@ replay_gain_set_mode_string(const char *p)
 	else
 		return false;
 
+	replay_gain_changed();
 	idle_add(IDLE_OPTIONS);
 
 	return true;
@@ -135,6 +138,8 @@ void replay_gain_global_init(void)
 	}
 
 	replay_gain_limit = config_get_bool(CONF_REPLAYGAIN_LIMIT, DEFAULT_REPLAYGAIN_LIMIT);
+
+	replay_gain_changed();
 }
 
 enum replay_gain_mode replay_gain_get_real_mode(void)
@@ -23,6 +23,8 @@
 #include "check.h"
 #include "replay_gain_info.h"
 
+#include <glib.h>
+
 #include <stdbool.h>
 
 extern enum replay_gain_mode replay_gain_mode;
@@ -30,6 +32,33 @@ extern float replay_gain_preamp;
 extern float replay_gain_missing_preamp;
 extern bool replay_gain_limit;
 
+/**
+ * A counter which is bumped by replay_gain_changed() whenever a
+ * setting affecting the effective gain changes.  Consumers cache the
+ * values they derive from the settings, and recompute them only when
+ * the generation has changed, instead of polling the settings on
+ * every chunk.
+ */
+extern volatile gint replay_gain_generation;
+
+/**
+ * Notifies the consumers that the replay gain settings (or the
+ * "random" flag, which the "auto" mode depends on) have changed.
+ * Called from the main thread; the consumers run in the output
+ * threads, thus the atomic access.
+ */
+static inline void
+replay_gain_changed(void)
+{
+	g_atomic_int_inc(&replay_gain_generation);
+}
+
+static inline unsigned
+replay_gain_get_generation(void)
+{
+	return (unsigned)g_atomic_int_get(&replay_gain_generation);
+}
+
 void replay_gain_global_init(void);
 
 /**
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "resolver_async.h"
+#include "resolver.h"
+#include "io_thread.h"
+
+#include <assert.h>
+#include <stdbool.h>
+
+#ifndef G_OS_WIN32
+#include <sys/socket.h>
+#include <netdb.h>
+#else /* G_OS_WIN32 */
+#include <ws2tcpip.h>
+#include <winsock.h>
+#endif /* G_OS_WIN32 */
+
+/**
+ * Upper bound for concurrent lookups; the threads are shared with
+ * other non-exclusive GThreadPool users and exit when idle.
+ */
+#define RESOLVER_ASYNC_MAX_THREADS 4
+
+struct resolver_async {
+	char *host_port;
+	unsigned default_port;
+	int flags, socktype;
+
+	const struct resolver_async_handler *handler;
+	void *handler_ctx;
+
+	/**
+	 * Was the operation canceled?  Protected with
+	 * #resolver_async_mutex.  The worker (or the delivery idle
+	 * callback) frees the object without invoking the handler.
+	 */
+	bool canceled;
+
+	/**
+	 * The result, filled by the worker before scheduling the
+	 * delivery in the I/O thread.
+	 */
+	struct addrinfo *ai;
+	GError *error;
+};
+
+static GStaticMutex resolver_async_mutex = G_STATIC_MUTEX_INIT;
+
+/**
+ * The shared worker pool, created on demand (protected with
+ * #resolver_async_mutex).  It lives until the process exits; idle
+ * threads are returned to GLib's shared pool.
+ */
+static GThreadPool *resolver_async_pool;
+
+static void
+resolver_async_free(struct resolver_async *r)
+{
+	if (r->ai != NULL)
+		freeaddrinfo(r->ai);
+	if (r->error != NULL)
+		g_error_free(r->error);
+	g_free(r->host_port);
+	g_free(r);
+}
+
+/**
+ * Delivers the result to the handler.  Runs in the I/O thread.
+ */
+static gboolean
+resolver_async_deliver(gpointer data)
+{
+	struct resolver_async *r = data;
+
+	g_static_mutex_lock(&resolver_async_mutex);
+	bool canceled = r->canceled;
+	g_static_mutex_unlock(&resolver_async_mutex);
+
+	if (canceled) {
+		resolver_async_free(r);
+		return false;
+	}
+
+	if (r->ai != NULL) {
+		struct addrinfo *ai = r->ai;
+		r->ai = NULL;
+		r->handler->success(ai, r->handler_ctx);
+	} else {
+		GError *error = r->error;
+		r->error = NULL;
+		r->handler->error(error, r->handler_ctx);
+	}
+
+	resolver_async_free(r);
+	return false;
+}
+
+/**
+ * Runs in a worker thread of the pool.
+ */
+static void
+resolver_async_worker(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+	struct resolver_async *r = data;
+
+	g_static_mutex_lock(&resolver_async_mutex);
+	bool canceled = r->canceled;
+	g_static_mutex_unlock(&resolver_async_mutex);
+
+	if (canceled) {
+		/* canceled before the lookup has started: don't
+		   bother asking the DNS server */
+		resolver_async_free(r);
+		return;
+	}
+
+	r->ai = resolve_host_port(r->host_port, r->default_port,
+				  r->flags, r->socktype, &r->error);
+
+	g_static_mutex_lock(&resolver_async_mutex);
+	canceled = r->canceled;
+	g_static_mutex_unlock(&resolver_async_mutex);
+
+	if (canceled) {
+		resolver_async_free(r);
+		return;
+	}
+
+	io_thread_idle_add(resolver_async_deliver, r);
+}
+
+struct resolver_async *
+resolver_async_start(const char *host_port, unsigned default_port,
+		     int flags, int socktype,
+		     const struct resolver_async_handler *handler,
+		     void *ctx)
+{
+	struct resolver_async *r;
+
+	assert(host_port != NULL);
+	assert(handler != NULL);
+	assert(handler->success != NULL);
+	assert(handler->error != NULL);
+
+	r = g_new0(struct resolver_async, 1);
+	r->host_port = g_strdup(host_port);
+	r->default_port = default_port;
+	r->flags = flags;
+	r->socktype = socktype;
+	r->handler = handler;
+	r->handler_ctx = ctx;
+
+	g_static_mutex_lock(&resolver_async_mutex);
+
+	if (resolver_async_pool == NULL)
+		resolver_async_pool =
+			g_thread_pool_new(resolver_async_worker, NULL,
+					  RESOLVER_ASYNC_MAX_THREADS,
+					  FALSE, NULL);
+
+	g_static_mutex_unlock(&resolver_async_mutex);
+
+	g_thread_pool_push(resolver_async_pool, r, NULL);
+
+	return r;
+}
+
+void
+resolver_async_cancel(struct resolver_async *r)
+{
+	assert(r != NULL);
+	assert(io_thread_inside());
+
+	g_static_mutex_lock(&resolver_async_mutex);
+	assert(!r->canceled);
+	r->canceled = true;
+	g_static_mutex_unlock(&resolver_async_mutex);
+
+	/* the worker (or the delivery callback, if the result is
+	   already on its way) sees the flag and frees the object */
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_RESOLVER_ASYNC_H
+#define MPD_RESOLVER_ASYNC_H
+
+#include <glib.h>
+
+struct addrinfo;
+
+struct resolver_async_handler {
+	/**
+	 * The lookup has finished successfully.  The method is
+	 * responsible for freeing the list with freeaddrinfo().
+	 *
+	 * Invoked in the I/O thread.
+	 */
+	void (*success)(struct addrinfo *ai, void *ctx);
+
+	/**
+	 * An error has occurred.  The method is responsible for
+	 * freeing the GError.
+	 *
+	 * Invoked in the I/O thread.
+	 */
+	void (*error)(GError *error, void *ctx);
+};
+
+struct resolver_async;
+
+/**
+ * Resolves a "host", "host:port" or "[host]:port" specification
+ * asynchronously: the getaddrinfo() call runs in a worker thread
+ * pool, and the result is delivered to the handler in the I/O
+ * thread, so a stalled DNS server never blocks the calling thread.
+ *
+ * The returned handle is owned by the library; it frees itself after
+ * a handler method has been invoked, or after cancellation.
+ *
+ * @param default_port a default port number that will be used if
+ * none is given in the string; pass 0 to go without a default
+ * @return a handle which may be used to cancel the operation
+ */
+struct resolver_async *
+resolver_async_start(const char *host_port, unsigned default_port,
+		     int flags, int socktype,
+		     const struct resolver_async_handler *handler,
+		     void *ctx);
+
+/**
+ * Cancels the operation: no handler method will be invoked, and the
+ * handle is freed as soon as the worker has finished.  Since
+ * getaddrinfo() cannot be interrupted, a lookup which is already
+ * running completes in the background, but its result is discarded.
+ *
+ * Must be called from the I/O thread (where results are delivered),
+ * and must not be called after a handler method has been invoked.
+ */
+void
+resolver_async_cancel(struct resolver_async *r);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "search_cache.h"
+#include "client_internal.h"
+#include "locate.h"
+#include "database.h"
+#include "db_lock.h"
+#include "song_print.h"
+
+#include <string.h>
+
+enum {
+	/** result sets larger than this are not worth caching: the
+	    refinement scan would not be much cheaper than a full
+	    walk, and the pointer array would pin several megabytes
+	    per client */
+	SEARCH_CACHE_MAX_SONGS = 65536,
+};
+
+struct search_cache {
+	/** the scope (URI) argument of the cached search */
+	char *name;
+
+	/** the casefolded criteria of the cached search */
+	struct locate_item_list *criteria;
+
+	/** the matching songs, in walk order */
+	GPtrArray *songs;
+
+	/** the database version when the set was collected; a
+	    mismatch invalidates the song pointers */
+	unsigned version;
+
+	/** the value of #search_cache_removals when the set was
+	    collected */
+	unsigned removals;
+};
+
+/**
+ * The number of songs removed from the database so far.  The update
+ * thread frees songs while an update is still running, long before
+ * the database version is incremented; this counter is bumped from
+ * the main thread for every removal, so caches collected before a
+ * removal are recognized as stale immediately.
+ */
+static unsigned search_cache_removals;
+
+void
+search_cache_song_removed(void)
+{
+	++search_cache_removals;
+}
+
+static void
+search_cache_drop(struct client *client)
+{
+	struct search_cache *cache = client->search_cache;
+
+	if (cache == NULL)
+		return;
+
+	g_free(cache->name);
+	locate_item_list_free(cache->criteria);
+	g_ptr_array_free(cache->songs, true);
+	g_free(cache);
+	client->search_cache = NULL;
+}
+
+/**
+ * Is every cached criterion contained in a refined one?  If so, any
+ * song matching the refined query also matches the cached one, i.e.
+ * the cached result set is a superset of the new one.
+ */
+static bool
+locate_item_list_refines(const struct locate_item_list *cached,
+			 const struct locate_item_list *refined)
+{
+	for (unsigned i = 0; i < cached->length; ++i) {
+		const struct locate_item *c = &cached->items[i];
+		bool covered = false;
+
+		for (unsigned j = 0; j < refined->length; ++j) {
+			const struct locate_item *r = &refined->items[j];
+
+			if (r->tag != c->tag)
+				continue;
+
+			/* the needle trigrams must be a subset;
+			   cheap pre-check before the substring
+			   search */
+			if ((c->trigrams & r->trigrams) != c->trigrams)
+				continue;
+
+			if (strstr(r->needle, c->needle) != NULL) {
+				covered = true;
+				break;
+			}
+		}
+
+		if (!covered)
+			return false;
+	}
+
+	return true;
+}
+
+bool
+search_cache_refine(struct client *client, const char *name,
+		    const struct locate_item_list *criteria)
+{
+	struct search_cache *cache = client->search_cache;
+
+	if (cache == NULL)
+		return false;
+
+	db_read_lock();
+
+	if (cache->version != db_get_version() ||
+	    cache->removals != search_cache_removals) {
+		/* the update thread may have freed cached songs;
+		   drop the stale pointers without touching them */
+		db_read_unlock();
+		search_cache_drop(client);
+		return false;
+	}
+
+	if (strcmp(cache->name, name) != 0 ||
+	    !locate_item_list_refines(cache->criteria, criteria)) {
+		db_read_unlock();
+		return false;
+	}
+
+	GPtrArray *refined = g_ptr_array_new();
+
+	for (unsigned i = 0; i < cache->songs->len; ++i) {
+		struct song *song = g_ptr_array_index(cache->songs, i);
+
+		if (locate_song_search(song, criteria)) {
+			song_print_info(client, song);
+			g_ptr_array_add(refined, song);
+		}
+	}
+
+	db_read_unlock();
+
+	/* keep the refined subset for the next keystroke */
+	g_ptr_array_free(cache->songs, true);
+	cache->songs = refined;
+
+	locate_item_list_free(cache->criteria);
+	cache->criteria = locate_item_list_casefold(criteria);
+
+	return true;
+}
+
+void
+search_cache_store(struct client *client, const char *name,
+		   const struct locate_item_list *criteria,
+		   GPtrArray *songs)
+{
+	search_cache_drop(client);
+
+	if (songs->len > SEARCH_CACHE_MAX_SONGS) {
+		g_ptr_array_free(songs, true);
+		return;
+	}
+
+	struct search_cache *cache = g_new(struct search_cache, 1);
+	cache->name = g_strdup(name);
+	/* the criteria are already casefolded; this merely
+	   duplicates the list */
+	cache->criteria = locate_item_list_casefold(criteria);
+	cache->songs = songs;
+	cache->version = db_get_version();
+	cache->removals = search_cache_removals;
+
+	client->search_cache = cache;
+}
+
+void
+search_cache_free(struct client *client)
+{
+	search_cache_drop(client);
+}
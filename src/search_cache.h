@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A per-client cache of the last "search" result set, for
+ * incremental (typed) search: when the next query is a refinement of
+ * the previous one - same scope, and every old criterion is
+ * contained in a new one - it is evaluated against the cached songs
+ * instead of walking the whole database, making each keystroke
+ * O(previous results) instead of O(library).
+ *
+ * The cache stores bare song pointers and is discarded whenever the
+ * database version changes or a song is removed from the database, so
+ * it never dereferences songs freed by the update thread.
+ */
+
+#ifndef MPD_SEARCH_CACHE_H
+#define MPD_SEARCH_CACHE_H
+
+#include "check.h"
+
+#include <glib.h>
+#include <stdbool.h>
+
+struct client;
+struct locate_item_list;
+
+/**
+ * Attempts to answer a search from the cached previous result set.
+ * On success, the matching songs have been printed to the client and
+ * the cache has been replaced by the refined subset.
+ *
+ * @param name the scope (URI) argument of the search
+ * @param criteria the casefolded search criteria
+ * @return true if the query was served from the cache
+ */
+bool
+search_cache_refine(struct client *client, const char *name,
+		    const struct locate_item_list *criteria);
+
+/**
+ * Stores a complete result set, replacing the previous one.  Takes
+ * ownership of the songs array; the name and criteria are copied.
+ */
+void
+search_cache_store(struct client *client, const char *name,
+		   const struct locate_item_list *criteria,
+		   GPtrArray *songs);
+
+/**
+ * Releases the cache when the client is freed.
+ */
+void
+search_cache_free(struct client *client);
+
+/**
+ * Must be called in the main thread before a song is removed from the
+ * database.  The update thread frees removed songs while an update is
+ * still in progress, before the database version is incremented; this
+ * invalidates all cached result sets so none of them keeps a dangling
+ * pointer.
+ */
+void
+search_cache_song_removed(void);
+
+#endif
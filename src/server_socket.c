@@ -54,6 +54,17 @@
 
 #define DEFAULT_PORT	6600
 
+/** the default listen(2) backlog, see server_socket_set_backlog() */
+#define DEFAULT_BACKLOG 5
+
+/**
+ * The maximum number of connections accepted in one main loop
+ * dispatch.  Accepting in a loop reduces the number of loop
+ * iterations during a connection storm, but the cap keeps such a
+ * storm from starving the already-connected clients.
+ */
+#define ACCEPT_BATCH_SIZE 16
+
 struct one_socket {
 	struct one_socket *next;
 	struct server_socket *parent;
@@ -75,6 +86,9 @@ struct server_socket {
 
 	struct one_socket *sockets, **sockets_tail_r;
 	unsigned next_serial;
+
+	/** the listen(2) backlog for all sockets */
+	int backlog;
 };
 
 static GQuark
@@ -92,9 +106,19 @@ server_socket_new(server_socket_callback_t callback, void *callback_ctx)
 	ss->sockets = NULL;
 	ss->sockets_tail_r = &ss->sockets;
 	ss->next_serial = 1;
+	ss->backlog = DEFAULT_BACKLOG;
 	return ss;
 }
 
+void
+server_socket_set_backlog(struct server_socket *ss, unsigned backlog)
+{
+	assert(ss->sockets == NULL || ss->sockets->fd < 0);
+	assert(backlog > 0);
+
+	ss->backlog = backlog;
+}
+
 void
 server_socket_free(struct server_socket *ss)
 {
@@ -157,19 +181,26 @@ server_socket_in_event(G_GNUC_UNUSED GIOChannel *source,
 {
 	struct one_socket *s = data;
 
-	struct sockaddr_storage address;
-	size_t address_length = sizeof(address);
-	int fd = accept_cloexec_nonblock(s->fd, (struct sockaddr*)&address,
-					 &address_length);
-	if (fd >= 0) {
+	for (unsigned i = 0; i < ACCEPT_BATCH_SIZE; ++i) {
+		struct sockaddr_storage address;
+		size_t address_length = sizeof(address);
+		int fd = accept_cloexec_nonblock(s->fd,
+						 (struct sockaddr*)&address,
+						 &address_length);
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK &&
+			    errno != EINTR)
+				g_warning("accept() failed: %s",
+					  g_strerror(errno));
+			break;
+		}
+
 		if (socket_keepalive(fd))
 			g_warning("Could not set TCP keepalive option: %s",
 				  g_strerror(errno));
 		s->parent->callback(fd, (const struct sockaddr*)&address,
 				    address_length, get_remote_uid(fd),
 				    s->parent->callback_ctx);
-	} else {
-		g_warning("accept() failed: %s", g_strerror(errno));
 	}
 
 	return true;
@@ -210,7 +241,8 @@ server_socket_open(struct server_socket *ss, GError **error_r)
 		GError *error = NULL;
 		int fd = socket_bind_listen(s->address.sa_family,
 					    SOCK_STREAM, 0,
-					    &s->address, s->address_length, 5,
+					    &s->address, s->address_length,
+					    ss->backlog,
 					    &error);
 		if (fd < 0) {
 			if (good != NULL && good->serial == s->serial) {
@@ -37,6 +37,13 @@ server_socket_new(server_socket_callback_t callback, void *callback_ctx);
 void
 server_socket_free(struct server_socket *ss);
 
+/**
+ * Configures the listen(2) backlog for all sockets.  Call this before
+ * server_socket_open().
+ */
+void
+server_socket_set_backlog(struct server_socket *ss, unsigned backlog);
+
 bool
 server_socket_open(struct server_socket *ss, GError **error_r);
 
@@ -0,0 +1,503 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "shared_encoder.h"
+#include "threaded_encoder.h"
+#include "encoder_plugin.h"
+#include "audio_format.h"
+#include "fifo_buffer.h"
+#include "growing_fifo.h"
+#include "conf.h"
+
+#include <assert.h>
+#include <string.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "shared_encoder"
+
+/** when a consumer stops reading and its buffer exceeds this size,
+    the buffer is discarded; only that consumer's stream hiccups */
+#define SHARED_ENCODER_MAX_BUFFER (512 * 1024)
+
+struct shared_encoder_client;
+
+/**
+ * The shared codec instance.  It is owned jointly by all attached
+ * clients, and freed when the last one detaches.
+ */
+struct shared_encoder {
+	/**
+	 * Identifies the plugin and its quality settings; clients
+	 * with equal keys share one object.
+	 */
+	char *key;
+
+	/**
+	 * The codec, wrapped in a threaded encoder.
+	 */
+	struct encoder *next;
+
+	/**
+	 * Protects the following attributes and the #next encoder.
+	 */
+	GMutex *mutex;
+
+	/**
+	 * All attached #shared_encoder_client objects.
+	 */
+	GSList *clients;
+
+	/**
+	 * The number of clients which are currently open.
+	 */
+	unsigned num_open;
+
+	/**
+	 * The client whose write() calls are passed to the codec.
+	 * The other open clients deliver the same PCM data, and their
+	 * write() calls are discarded.
+	 */
+	struct shared_encoder_client *driver;
+
+	/**
+	 * The input audio format requested by the first open, before
+	 * the codec modified it.  All other opens must match it.
+	 */
+	struct audio_format in_audio_format;
+
+	/**
+	 * The audio format as modified by the codec's open method.
+	 */
+	struct audio_format audio_format;
+};
+
+/**
+ * One output's handle to a #shared_encoder.
+ */
+struct shared_encoder_client {
+	struct encoder base;
+
+	struct shared_encoder *shared;
+
+	/**
+	 * This client's portion of the encoded stream.  Protected by
+	 * shared_encoder.mutex.
+	 */
+	struct fifo_buffer *output;
+
+	bool open;
+};
+
+/**
+ * The registry of all #shared_encoder objects.
+ */
+static GStaticMutex shared_encoders_mutex = G_STATIC_MUTEX_INIT;
+static GSList *shared_encoders;
+
+static inline GQuark
+shared_encoder_quark(void)
+{
+	return g_quark_from_static_string("shared_encoder");
+}
+
+/**
+ * Moves all pending output of the codec into the buffers of all open
+ * clients.  Caller must hold the mutex.
+ */
+static void
+shared_encoder_pump(struct shared_encoder *se)
+{
+	char buffer[4096];
+	size_t nbytes;
+
+	while ((nbytes = encoder_read(se->next, buffer,
+				      sizeof(buffer))) > 0) {
+		for (GSList *i = se->clients; i != NULL; i = g_slist_next(i)) {
+			struct shared_encoder_client *client = i->data;
+
+			if (!client->open)
+				continue;
+
+			if (fifo_buffer_available(client->output) >
+			    SHARED_ENCODER_MAX_BUFFER)
+				/* this consumer has stopped reading;
+				   drop its buffer instead of growing
+				   without bounds */
+				fifo_buffer_clear(client->output);
+
+			growing_fifo_append(&client->output, buffer, nbytes);
+		}
+	}
+}
+
+static struct encoder *
+shared_encoder_init(G_GNUC_UNUSED const struct config_param *param,
+		    G_GNUC_UNUSED GError **error)
+{
+	/* this pseudo plugin is not available through the
+	   configuration; use shared_encoder_new() instead */
+	assert(false);
+	return NULL;
+}
+
+static void
+shared_encoder_client_finish(struct encoder *_encoder)
+{
+	struct shared_encoder_client *client =
+		(struct shared_encoder_client *)_encoder;
+	struct shared_encoder *se = client->shared;
+
+	assert(!client->open);
+
+	g_static_mutex_lock(&shared_encoders_mutex);
+
+	g_mutex_lock(se->mutex);
+	se->clients = g_slist_remove(se->clients, client);
+	bool empty = se->clients == NULL;
+	g_mutex_unlock(se->mutex);
+
+	if (empty) {
+		/* the last client has detached: destroy the shared
+		   object */
+		shared_encoders = g_slist_remove(shared_encoders, se);
+
+		encoder_finish(se->next);
+		g_mutex_free(se->mutex);
+		g_free(se->key);
+		g_free(se);
+	}
+
+	g_static_mutex_unlock(&shared_encoders_mutex);
+
+	fifo_buffer_free(client->output);
+	g_free(client);
+}
+
+static bool
+shared_encoder_client_open(struct encoder *_encoder,
+			   struct audio_format *audio_format,
+			   GError **error)
+{
+	struct shared_encoder_client *client =
+		(struct shared_encoder_client *)_encoder;
+	struct shared_encoder *se = client->shared;
+	bool success = true;
+
+	assert(!client->open);
+
+	g_mutex_lock(se->mutex);
+
+	if (se->num_open == 0) {
+		/* the first open: open the codec */
+
+		se->in_audio_format = *audio_format;
+
+		success = encoder_open(se->next, audio_format, error);
+		if (success)
+			se->audio_format = *audio_format;
+	} else if (!audio_format_equals(audio_format,
+					&se->in_audio_format)) {
+		g_set_error(error, shared_encoder_quark(), 0,
+			    "audio format mismatch on shared encoder \"%s\"",
+			    se->key);
+		success = false;
+	} else
+		/* apply the same modifications the codec made for
+		   the first open */
+		*audio_format = se->audio_format;
+
+	if (success) {
+		++se->num_open;
+		client->open = true;
+
+		if (se->driver == NULL)
+			se->driver = client;
+	}
+
+	g_mutex_unlock(se->mutex);
+	return success;
+}
+
+static void
+shared_encoder_client_close(struct encoder *_encoder)
+{
+	struct shared_encoder_client *client =
+		(struct shared_encoder_client *)_encoder;
+	struct shared_encoder *se = client->shared;
+
+	assert(client->open);
+
+	g_mutex_lock(se->mutex);
+
+	client->open = false;
+	--se->num_open;
+
+	if (se->driver == client) {
+		/* promote another open client to driver */
+
+		se->driver = NULL;
+
+		for (GSList *i = se->clients; i != NULL;
+		     i = g_slist_next(i)) {
+			struct shared_encoder_client *other = i->data;
+
+			if (other->open) {
+				se->driver = other;
+				break;
+			}
+		}
+	}
+
+	fifo_buffer_clear(client->output);
+
+	if (se->num_open == 0)
+		encoder_close(se->next);
+
+	g_mutex_unlock(se->mutex);
+}
+
+static bool
+shared_encoder_client_flush(struct encoder *_encoder, GError **error)
+{
+	struct shared_encoder_client *client =
+		(struct shared_encoder_client *)_encoder;
+	struct shared_encoder *se = client->shared;
+	bool success = true;
+
+	g_mutex_lock(se->mutex);
+
+	if (se->driver == client) {
+		success = encoder_flush(se->next, error);
+		if (success)
+			shared_encoder_pump(se);
+	}
+
+	g_mutex_unlock(se->mutex);
+	return success;
+}
+
+static bool
+shared_encoder_client_pre_tag(struct encoder *_encoder, GError **error)
+{
+	struct shared_encoder_client *client =
+		(struct shared_encoder_client *)_encoder;
+	struct shared_encoder *se = client->shared;
+	bool success = true;
+
+	g_mutex_lock(se->mutex);
+
+	if (se->driver == client) {
+		success = encoder_pre_tag(se->next, error);
+		if (success)
+			shared_encoder_pump(se);
+	}
+
+	g_mutex_unlock(se->mutex);
+	return success;
+}
+
+static bool
+shared_encoder_client_tag(struct encoder *_encoder, const struct tag *tag,
+			  GError **error)
+{
+	struct shared_encoder_client *client =
+		(struct shared_encoder_client *)_encoder;
+	struct shared_encoder *se = client->shared;
+	bool success = true;
+
+	g_mutex_lock(se->mutex);
+
+	if (se->driver == client) {
+		success = encoder_tag(se->next, tag, error);
+		if (success)
+			shared_encoder_pump(se);
+	}
+
+	g_mutex_unlock(se->mutex);
+	return success;
+}
+
+static bool
+shared_encoder_client_write(struct encoder *_encoder,
+			    const void *data, size_t length,
+			    GError **error)
+{
+	struct shared_encoder_client *client =
+		(struct shared_encoder_client *)_encoder;
+	struct shared_encoder *se = client->shared;
+	bool success = true;
+
+	g_mutex_lock(se->mutex);
+
+	if (se->driver == client)
+		success = encoder_write(se->next, data, length, error);
+
+	/* the write() calls of the other clients are discarded: they
+	   deliver the same PCM data as the driver */
+
+	g_mutex_unlock(se->mutex);
+	return success;
+}
+
+static size_t
+shared_encoder_client_read(struct encoder *_encoder, void *dest,
+			   size_t length)
+{
+	struct shared_encoder_client *client =
+		(struct shared_encoder_client *)_encoder;
+	struct shared_encoder *se = client->shared;
+	const char *p;
+	size_t available;
+
+	g_mutex_lock(se->mutex);
+
+	/* collect new codec output for all clients first */
+	shared_encoder_pump(se);
+
+	p = fifo_buffer_read(client->output, &available);
+	if (p == NULL) {
+		g_mutex_unlock(se->mutex);
+		return 0;
+	}
+
+	if (length > available)
+		length = available;
+
+	memcpy(dest, p, length);
+	fifo_buffer_consume(client->output, length);
+
+	g_mutex_unlock(se->mutex);
+	return length;
+}
+
+static const char *
+shared_encoder_client_get_mime_type(struct encoder *_encoder)
+{
+	struct shared_encoder_client *client =
+		(struct shared_encoder_client *)_encoder;
+
+	return encoder_get_mime_type(client->shared->next);
+}
+
+static const struct encoder_plugin shared_encoder_plugin = {
+	.name = "shared",
+	.init = shared_encoder_init,
+	.finish = shared_encoder_client_finish,
+	.open = shared_encoder_client_open,
+	.close = shared_encoder_client_close,
+	.flush = shared_encoder_client_flush,
+	.pre_tag = shared_encoder_client_pre_tag,
+	.tag = shared_encoder_client_tag,
+	.write = shared_encoder_client_write,
+	.read = shared_encoder_client_read,
+	.get_mime_type = shared_encoder_client_get_mime_type,
+};
+
+/**
+ * A variant without the tag methods, for sharing codecs which do not
+ * implement them; see threaded_encoder.c for the rationale.
+ */
+static const struct encoder_plugin shared_encoder_notag_plugin = {
+	.name = "shared",
+	.init = shared_encoder_init,
+	.finish = shared_encoder_client_finish,
+	.open = shared_encoder_client_open,
+	.close = shared_encoder_client_close,
+	.flush = shared_encoder_client_flush,
+	.write = shared_encoder_client_write,
+	.read = shared_encoder_client_read,
+	.get_mime_type = shared_encoder_client_get_mime_type,
+};
+
+/**
+ * Builds the registry key from the plugin name and the block options
+ * which affect the encoded stream.
+ */
+static char *
+shared_encoder_key(const struct encoder_plugin *plugin,
+		   const struct config_param *param)
+{
+	return g_strjoin("\x1e", plugin->name,
+			 config_get_block_string(param, "quality", ""),
+			 config_get_block_string(param, "bitrate", ""),
+			 config_get_block_string(param, "compression", ""),
+			 config_get_block_string(param, "format", ""),
+			 NULL);
+}
+
+struct encoder *
+shared_encoder_new(const struct encoder_plugin *plugin,
+		   const struct config_param *param,
+		   GError **error)
+{
+	struct shared_encoder *se = NULL;
+	struct shared_encoder_client *client;
+	char *key = shared_encoder_key(plugin, param);
+
+	g_static_mutex_lock(&shared_encoders_mutex);
+
+	for (GSList *i = shared_encoders; i != NULL; i = g_slist_next(i)) {
+		struct shared_encoder *other = i->data;
+
+		if (strcmp(other->key, key) == 0) {
+			se = other;
+			break;
+		}
+	}
+
+	if (se == NULL) {
+		struct encoder *next = encoder_init(plugin, param, error);
+		if (next == NULL) {
+			g_static_mutex_unlock(&shared_encoders_mutex);
+			g_free(key);
+			return NULL;
+		}
+
+		se = g_new(struct shared_encoder, 1);
+		se->key = key;
+		se->next = threaded_encoder_new(next);
+		se->mutex = g_mutex_new();
+		se->clients = NULL;
+		se->num_open = 0;
+		se->driver = NULL;
+
+		shared_encoders = g_slist_prepend(shared_encoders, se);
+	} else {
+		g_debug("sharing encoder \"%s\"", plugin->name);
+		g_free(key);
+	}
+
+	client = g_new(struct shared_encoder_client, 1);
+	encoder_struct_init(&client->base,
+			    plugin->tag != NULL
+			    ? &shared_encoder_plugin
+			    : &shared_encoder_notag_plugin);
+	client->shared = se;
+	client->output = growing_fifo_new();
+	client->open = false;
+
+	g_mutex_lock(se->mutex);
+	se->clients = g_slist_prepend(se->clients, client);
+	g_mutex_unlock(se->mutex);
+
+	g_static_mutex_unlock(&shared_encoders_mutex);
+
+	return &client->base;
+}
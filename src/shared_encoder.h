@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_SHARED_ENCODER_H
+#define MPD_SHARED_ENCODER_H
+
+#include <glib.h>
+
+struct encoder_plugin;
+struct config_param;
+
+/**
+ * Creates an encoder which may share one codec instance with other
+ * outputs.  When several outputs request the same plugin with the
+ * same quality settings (the "quality", "bitrate", "compression" and
+ * "format" block options), the PCM data is encoded only once, and
+ * the encoded stream is fanned out to all of them; one of the open
+ * consumers "drives" the codec, and the write() calls of the others
+ * are discarded, because they carry the same PCM data.
+ *
+ * The underlying codec runs in a dedicated thread (see
+ * threaded_encoder_new()).
+ *
+ * The returned object is used like any other encoder, and is
+ * destructed with encoder_finish().
+ */
+struct encoder *
+shared_encoder_new(const struct encoder_plugin *plugin,
+		   const struct config_param *param,
+		   GError **error);
+
+#endif
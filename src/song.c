@@ -22,6 +22,8 @@
 #include "uri.h"
 #include "directory.h"
 #include "tag.h"
+#include "replay_gain_info.h"
+#include "db_arena.h"
 
 #include <glib.h>
 
@@ -30,20 +32,39 @@
 static struct song *
 song_alloc(const char *uri, struct directory *parent)
 {
-	size_t uri_length;
+	size_t uri_length, size;
+	bool pooled;
 	struct song *song;
 
 	assert(uri);
 	uri_length = strlen(uri);
 	assert(uri_length);
-	song = g_malloc(sizeof(*song) - sizeof(song->uri) + uri_length + 1);
+	size = sizeof(*song) - sizeof(song->uri) + uri_length + 1;
+
+	/* during the database load, songs are packed into the arena,
+	   next to their tags; remote songs always live on the heap */
+	pooled = parent != NULL && db_arena_is_active();
+	song = pooled ? db_arena_alloc(size) : g_malloc(size);
 
 	song->tag = NULL;
+	song->replay_gain = NULL;
+	song->mixramp_start = song->mixramp_end = NULL;
 	memcpy(song->uri, uri, uri_length + 1);
 	song->parent = parent;
 	song->mtime = 0;
 	song->start_ms = song->end_ms = 0;
+	refcount_init(&song->ref);
+	song->pooled = pooled;
+
+	return song;
+}
+
+struct song *
+song_ref(struct song *song)
+{
+	assert(song != NULL);
 
+	refcount_inc(&song->ref);
 	return song;
 }
 
@@ -61,24 +82,54 @@ song_file_new(const char *path, struct directory *parent)
 	return song_alloc(path, parent);
 }
 
+struct song *
+song_dup_detached(const struct song *src)
+{
+	struct song *song = song_alloc(src->uri, NULL);
+	song->tag = src->tag != NULL ? tag_dup(src->tag) : NULL;
+	song->replay_gain = src->replay_gain != NULL
+		? g_memdup(src->replay_gain, sizeof(*src->replay_gain))
+		: NULL;
+	song->mixramp_start = g_strdup(src->mixramp_start);
+	song->mixramp_end = g_strdup(src->mixramp_end);
+	song->mtime = src->mtime;
+	song->start_ms = src->start_ms;
+	song->end_ms = src->end_ms;
+	return song;
+}
+
 struct song *
 song_replace_uri(struct song *old_song, const char *uri)
 {
 	struct song *new_song = song_alloc(uri, old_song->parent);
 	new_song->tag = old_song->tag;
+	new_song->replay_gain = old_song->replay_gain;
+	new_song->mixramp_start = old_song->mixramp_start;
+	new_song->mixramp_end = old_song->mixramp_end;
 	new_song->mtime = old_song->mtime;
 	new_song->start_ms = old_song->start_ms;
 	new_song->end_ms = old_song->end_ms;
-	g_free(old_song);
+	if (!old_song->pooled)
+		g_free(old_song);
 	return new_song;
 }
 
 void
 song_free(struct song *song)
 {
+	if (!refcount_dec(&song->ref))
+		/* there are still other references */
+		return;
+
 	if (song->tag)
 		tag_free(song->tag);
-	g_free(song);
+	g_free(song->replay_gain);
+	g_free(song->mixramp_start);
+	g_free(song->mixramp_end);
+	if (!song->pooled)
+		g_free(song);
+	/* else: the arena memory is released in one sweep by
+	   db_arena_free() */
 }
 
 char *
@@ -21,6 +21,7 @@
 #define MPD_SONG_H
 
 #include "util/list.h"
+#include "refcount.h"
 
 #include <stddef.h>
 #include <stdbool.h>
@@ -29,6 +30,8 @@
 #define SONG_FILE	"file: "
 #define SONG_TIME	"Time: "
 
+struct replay_gain_info;
+
 struct song {
 	/**
 	 * Pointers to the siblings of this directory within the
@@ -41,6 +44,23 @@ struct song {
 	struct list_head siblings;
 
 	struct tag *tag;
+
+	/**
+	 * The replay gain data found by the last update scan, or NULL
+	 * if the file has none.  Keeping it in the database saves a
+	 * file parse at every track start.
+	 */
+	struct replay_gain_info *replay_gain;
+
+	/**
+	 * MixRamp overlap data ("mixramp_start"/"mixramp_end" tags)
+	 * found by the last update scan, or NULL.  Having them in the
+	 * database lets the player calculate precise crossfade
+	 * overlaps even when the decoder plugin does not parse
+	 * MixRamp tags itself.
+	 */
+	char *mixramp_start, *mixramp_end;
+
 	struct directory *parent;
 	time_t mtime;
 
@@ -55,6 +75,23 @@ struct song {
 	 */
 	unsigned end_ms;
 
+	/**
+	 * The (atomic) reference counter; see song_ref() and
+	 * song_free().  It allows the queue, playlist plugins and
+	 * caches to share one instance instead of duplicating it per
+	 * insertion.  Songs in the database are owned by it and have
+	 * exactly one reference for their whole life.
+	 */
+	struct refcount ref;
+
+	/**
+	 * Was this object allocated from the database arena (see
+	 * db_arena_begin())?  If so, song_free() releases the tag,
+	 * but does not free the memory - that is done in one sweep by
+	 * db_arena_free().
+	 */
+	bool pooled;
+
 	char uri[sizeof(int)];
 };
 
@@ -74,6 +111,13 @@ song_file_new(const char *path, struct directory *parent);
 struct song *
 song_file_load(const char *path, struct directory *parent);
 
+/**
+ * Creates a duplicate of the given song, not associated with any
+ * database directory.  The tag is copied, too.
+ */
+struct song *
+song_dup_detached(const struct song *src);
+
 /**
  * Replaces the URI of a song object.  The given song object is
  * destroyed, and a newly allocated one is returned.  It does not
@@ -83,6 +127,18 @@ song_file_load(const char *path, struct directory *parent);
 struct song *
 song_replace_uri(struct song *song, const char *uri);
 
+/**
+ * Adds a reference to the song, so it can be stored in several
+ * containers at the same time without copying.  Returns the song for
+ * convenience.
+ */
+struct song *
+song_ref(struct song *song);
+
+/**
+ * Drops one reference; the song is destroyed when the last reference
+ * is gone.
+ */
 void
 song_free(struct song *song);
 
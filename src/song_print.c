@@ -21,17 +21,95 @@
 #include "song_print.h"
 #include "song.h"
 #include "directory.h"
+#include "tag.h"
 #include "tag_print.h"
 #include "client.h"
+#include "client_binary.h"
 #include "uri.h"
 #include "mapper.h"
 
+/**
+ * The maximum number of cached response blocks.  When the limit is
+ * reached, the whole cache is flushed; it refills quickly from the
+ * songs the clients actually ask for.
+ */
+#define SONG_PRINT_CACHE_MAX 16384
+
+/**
+ * Maps the song pointer to its serialized "playlistinfo" block.
+ * Shared by all clients: two clients fetching the same queue
+ * serialize each song only once.  Entries are dropped by
+ * song_print_cache_remove() when the update thread modifies or
+ * deletes a song.
+ */
+static GHashTable *song_print_cache;
+static GMutex *song_print_cache_mutex;
+
 void
-song_print_uri(struct client *client, struct song *song)
+song_print_cache_init(void)
+{
+	song_print_cache_mutex = g_mutex_new();
+	song_print_cache = g_hash_table_new_full(g_direct_hash,
+						 g_direct_equal,
+						 NULL, g_free);
+}
+
+void
+song_print_cache_finish(void)
+{
+	g_hash_table_destroy(song_print_cache);
+	song_print_cache = NULL;
+	g_mutex_free(song_print_cache_mutex);
+}
+
+void
+song_print_cache_remove(const struct song *song)
+{
+	if (song_print_cache == NULL)
+		return;
+
+	g_mutex_lock(song_print_cache_mutex);
+	g_hash_table_remove(song_print_cache, song);
+	g_mutex_unlock(song_print_cache_mutex);
+}
+
+/**
+ * Returns a copy of the cached block (the original may be freed by
+ * the update thread at any time), or NULL if the song is not cached.
+ */
+static char *
+song_print_cache_get(const struct song *song)
+{
+	g_mutex_lock(song_print_cache_mutex);
+	char *block = g_strdup(g_hash_table_lookup(song_print_cache, song));
+	g_mutex_unlock(song_print_cache_mutex);
+
+	return block;
+}
+
+static void
+song_print_cache_put(const struct song *song, const char *block)
+{
+	g_mutex_lock(song_print_cache_mutex);
+
+	if (g_hash_table_size(song_print_cache) >= SONG_PRINT_CACHE_MAX)
+		g_hash_table_remove_all(song_print_cache);
+
+	g_hash_table_insert(song_print_cache, (gpointer)song,
+			    g_strdup(block));
+
+	g_mutex_unlock(song_print_cache_mutex);
+}
+
+static void
+song_append_uri(GString *buffer, struct song *song)
 {
 	if (song_in_database(song) && !directory_is_root(song->parent)) {
-		client_printf(client, "%s%s/%s\n", SONG_FILE,
-			      directory_get_path(song->parent), song->uri);
+		g_string_append(buffer, SONG_FILE);
+		g_string_append(buffer, directory_get_path(song->parent));
+		g_string_append_c(buffer, '/');
+		g_string_append(buffer, song->uri);
+		g_string_append_c(buffer, '\n');
 	} else {
 		char *allocated;
 		const char *uri;
@@ -40,28 +118,29 @@ song_print_uri(struct client *client, struct song *song)
 		if (uri == NULL)
 			uri = song->uri;
 
-		client_printf(client, "%s%s\n", SONG_FILE,
-			      map_to_relative_path(uri));
+		g_string_append(buffer, SONG_FILE);
+		g_string_append(buffer, map_to_relative_path(uri));
+		g_string_append_c(buffer, '\n');
 
 		g_free(allocated);
 	}
 }
 
-void
-song_print_info(struct client *client, struct song *song)
+static void
+song_append_info(GString *buffer, struct song *song)
 {
-	song_print_uri(client, song);
+	song_append_uri(buffer, song);
 
 	if (song->end_ms > 0)
-		client_printf(client, "Range: %u.%03u-%u.%03u\n",
-			      song->start_ms / 1000,
-			      song->start_ms % 1000,
-			      song->end_ms / 1000,
-			      song->end_ms % 1000);
+		g_string_append_printf(buffer, "Range: %u.%03u-%u.%03u\n",
+				       song->start_ms / 1000,
+				       song->start_ms % 1000,
+				       song->end_ms / 1000,
+				       song->end_ms % 1000);
 	else if (song->start_ms > 0)
-		client_printf(client, "Range: %u.%03u-\n",
-			      song->start_ms / 1000,
-			      song->start_ms % 1000);
+		g_string_append_printf(buffer, "Range: %u.%03u-\n",
+				       song->start_ms / 1000,
+				       song->start_ms % 1000);
 
 	if (song->mtime > 0) {
 #ifndef G_OS_WIN32
@@ -85,11 +164,169 @@ song_print_info(struct client *client, struct song *song)
 				 "%FT%TZ",
 #endif
 				 tm2);
-			client_printf(client, "Last-Modified: %s\n",
-				      timestamp);
+			g_string_append_printf(buffer, "Last-Modified: %s\n",
+					       timestamp);
+		}
+	}
+
+	if (song->tag != NULL) {
+		const struct tag *tag = song->tag;
+
+		if (tag->time >= 0)
+			g_string_append_printf(buffer, SONG_TIME "%i\n",
+					       tag->time);
+
+		for (unsigned i = 0; i < tag->num_items; i++)
+			g_string_append_printf(buffer, "%s: %s\n",
+					       tag_item_names[tag->items[i]->type],
+					       tag->items[i]->value);
+	}
+}
+
+/**
+ * Emits the "file" pair of a song as a binary record; the counterpart
+ * of song_append_uri() for clients in binary framing mode.
+ */
+static void
+song_binary_uri(struct client *client, struct song *song)
+{
+	if (song_in_database(song) && !directory_is_root(song->parent)) {
+		char *uri = g_strconcat(directory_get_path(song->parent),
+					"/", song->uri, NULL);
+		client_binary_pair(client, "file", uri);
+		g_free(uri);
+	} else {
+		char *allocated;
+		const char *uri;
+
+		uri = allocated = uri_remove_auth(song->uri);
+		if (uri == NULL)
+			uri = song->uri;
+
+		client_binary_pair(client, "file",
+				   map_to_relative_path(uri));
+
+		g_free(allocated);
+	}
+}
+
+/**
+ * The counterpart of song_append_info() for clients in binary framing
+ * mode.  Bypasses the text block cache, which only stores the "name:
+ * value" serialization.
+ */
+static void
+song_binary_info(struct client *client, struct song *song)
+{
+	char buffer[64];
+
+	song_binary_uri(client, song);
+
+	if (song->end_ms > 0) {
+		g_snprintf(buffer, sizeof(buffer), "%u.%03u-%u.%03u",
+			   song->start_ms / 1000, song->start_ms % 1000,
+			   song->end_ms / 1000, song->end_ms % 1000);
+		client_binary_pair(client, "Range", buffer);
+	} else if (song->start_ms > 0) {
+		g_snprintf(buffer, sizeof(buffer), "%u.%03u-",
+			   song->start_ms / 1000, song->start_ms % 1000);
+		client_binary_pair(client, "Range", buffer);
+	}
+
+	if (song->mtime > 0) {
+#ifndef G_OS_WIN32
+		struct tm tm;
+#endif
+		const struct tm *tm2;
+
+#ifdef G_OS_WIN32
+		tm2 = gmtime(&song->mtime);
+#else
+		tm2 = gmtime_r(&song->mtime, &tm);
+#endif
+
+		if (tm2 != NULL &&
+		    strftime(buffer, sizeof(buffer),
+#ifdef G_OS_WIN32
+			     "%Y-%m-%dT%H:%M:%SZ",
+#else
+			     "%FT%TZ",
+#endif
+			     tm2) > 0)
+			client_binary_pair(client, "Last-Modified", buffer);
+	}
+
+	if (song->tag != NULL) {
+		const struct tag *tag = song->tag;
+
+		if (tag->time >= 0) {
+			g_snprintf(buffer, sizeof(buffer), "%i", tag->time);
+			client_binary_pair(client, "Time", buffer);
+		}
+
+		for (unsigned i = 0; i < tag->num_items; i++)
+			client_binary_pair(client,
+					   tag_item_names[tag->items[i]->type],
+					   tag->items[i]->value);
+	}
+}
+
+void
+song_print_uri(struct client *client, struct song *song)
+{
+	if (client_binary_enabled(client)) {
+		song_binary_uri(client, song);
+		return;
+	}
+
+	if (song_in_database(song) && !directory_is_root(song->parent)) {
+		client_puts(client, SONG_FILE);
+		client_puts(client, directory_get_path(song->parent));
+		client_puts(client, "/");
+		client_puts(client, song->uri);
+		client_puts(client, "\n");
+	} else {
+		char *allocated;
+		const char *uri;
+
+		uri = allocated = uri_remove_auth(song->uri);
+		if (uri == NULL)
+			uri = song->uri;
+
+		client_puts(client, SONG_FILE);
+		client_puts(client, map_to_relative_path(uri));
+		client_puts(client, "\n");
+
+		g_free(allocated);
+	}
+}
+
+void
+song_print_info(struct client *client, struct song *song)
+{
+	if (client_binary_enabled(client)) {
+		song_binary_info(client, song);
+		return;
+	}
+
+	if (song_print_cache != NULL && song_in_database(song)) {
+		/* database songs are long-lived and shared by all
+		   clients; serve them from the shared cache */
+		char *block = song_print_cache_get(song);
+		if (block == NULL) {
+			GString *buffer = g_string_new(NULL);
+			song_append_info(buffer, song);
+			song_print_cache_put(song, buffer->str);
+			block = g_string_free(buffer, false);
 		}
+
+		client_puts(client, block);
+		g_free(block);
+		return;
 	}
 
-	if (song->tag)
-		tag_print(client, song->tag);
+	GString *buffer = g_string_new(NULL);
+	song_append_info(buffer, song);
+	client_puts(client, buffer->str);
+	g_string_free(buffer, true);
 }
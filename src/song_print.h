@@ -30,4 +30,18 @@ song_print_info(struct client *client, struct song *song);
 void
 song_print_uri(struct client *client, struct song *song);
 
+void
+song_print_cache_init(void);
+
+void
+song_print_cache_finish(void);
+
+/**
+ * Drops the cached response block for a song whose tags have changed
+ * or which is about to be freed.  Safe to call from the update
+ * thread.
+ */
+void
+song_print_cache_remove(const struct song *song);
+
 #endif
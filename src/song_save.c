@@ -23,6 +23,7 @@
 #include "tag_save.h"
 #include "directory.h"
 #include "tag.h"
+#include "replay_gain_info.h"
 #include "text_file.h"
 #include "string_util.h"
 
@@ -42,6 +43,39 @@ song_save_quark(void)
 	return g_quark_from_static_string("song_save");
 }
 
+/**
+ * Saves one replay gain tuple as a "gain peak" pair, in a
+ * locale-independent format.
+ */
+static void
+replay_gain_tuple_save(FILE *fp, const char *name,
+		       const struct replay_gain_tuple *tuple)
+{
+	char gain[G_ASCII_DTOSTR_BUF_SIZE], peak[G_ASCII_DTOSTR_BUF_SIZE];
+
+	g_ascii_dtostr(gain, sizeof(gain), tuple->gain);
+	g_ascii_dtostr(peak, sizeof(peak), tuple->peak);
+	fprintf(fp, "%s: %s %s\n", name, gain, peak);
+}
+
+/**
+ * Parses a "gain peak" pair into the song's replay gain data,
+ * allocating it if necessary.
+ */
+static void
+song_parse_replay_gain(struct song *song, unsigned i, const char *value)
+{
+	if (song->replay_gain == NULL) {
+		song->replay_gain = g_new(struct replay_gain_info, 1);
+		replay_gain_info_init(song->replay_gain);
+	}
+
+	struct replay_gain_tuple *tuple = &song->replay_gain->tuples[i];
+	char *endptr;
+	tuple->gain = g_ascii_strtod(value, &endptr);
+	tuple->peak = g_ascii_strtod(endptr, NULL);
+}
+
 void
 song_save(FILE *fp, const struct song *song)
 {
@@ -55,6 +89,22 @@ song_save(FILE *fp, const struct song *song)
 	if (song->tag != NULL)
 		tag_save(fp, song->tag);
 
+	if (song->replay_gain != NULL) {
+		const struct replay_gain_info *rg = song->replay_gain;
+
+		if (replay_gain_tuple_defined(&rg->tuples[REPLAY_GAIN_TRACK]))
+			replay_gain_tuple_save(fp, "ReplayGainTrack",
+					       &rg->tuples[REPLAY_GAIN_TRACK]);
+		if (replay_gain_tuple_defined(&rg->tuples[REPLAY_GAIN_ALBUM]))
+			replay_gain_tuple_save(fp, "ReplayGainAlbum",
+					       &rg->tuples[REPLAY_GAIN_ALBUM]);
+	}
+
+	if (song->mixramp_start != NULL)
+		fprintf(fp, "MixRampStart: %s\n", song->mixramp_start);
+	if (song->mixramp_end != NULL)
+		fprintf(fp, "MixRampEnd: %s\n", song->mixramp_end);
+
 	fprintf(fp, SONG_MTIME ": %li\n", (long)song->mtime);
 	fprintf(fp, SONG_END "\n");
 }
@@ -109,6 +159,16 @@ song_load(FILE *fp, struct directory *parent, const char *uri,
 			song->tag->has_playlist = strcmp(value, "yes") == 0;
 		} else if (strcmp(line, SONG_MTIME) == 0) {
 			song->mtime = atoi(value);
+		} else if (strcmp(line, "MixRampStart") == 0) {
+			g_free(song->mixramp_start);
+			song->mixramp_start = g_strdup(value);
+		} else if (strcmp(line, "MixRampEnd") == 0) {
+			g_free(song->mixramp_end);
+			song->mixramp_end = g_strdup(value);
+		} else if (strcmp(line, "ReplayGainTrack") == 0) {
+			song_parse_replay_gain(song, REPLAY_GAIN_TRACK, value);
+		} else if (strcmp(line, "ReplayGainAlbum") == 0) {
+			song_parse_replay_gain(song, REPLAY_GAIN_ALBUM, value);
 		} else if (strcmp(line, "Range") == 0) {
 			char *endptr;
 
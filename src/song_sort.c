@@ -21,13 +21,13 @@
 #include "song_sort.h"
 #include "song.h"
 #include "util/list.h"
-#include "util/list_sort.h"
 #include "tag.h"
 
 #include <glib.h>
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 static const char *
 tag_get_value_checked(const struct tag *tag, enum tag_type type)
@@ -37,85 +37,99 @@ tag_get_value_checked(const struct tag *tag, enum tag_type type)
 		: NULL;
 }
 
-static int
-compare_utf8_string(const char *a, const char *b)
-{
-	if (a == NULL)
-		return b == NULL ? 0 : -1;
-
-	if (b == NULL)
-		return 1;
-
-	return g_utf8_collate(a, b);
-}
-
 /**
- * Compare two string tag values, ignoring case.  Either one may be
- * NULL.
+ * Parse a tag value which should contain an integer (e.g. disc or
+ * track number); non-numbers and missing values map to 0, which
+ * sorts first.
  */
-static int
-compare_string_tag_item(const struct tag *a, const struct tag *b,
-			enum tag_type type)
+static unsigned long
+number_tag_value(const struct tag *tag, enum tag_type type)
 {
-	return compare_utf8_string(tag_get_value_checked(a, type),
-				   tag_get_value_checked(b, type));
+	const char *value = tag_get_value_checked(tag, type);
+	if (value == NULL)
+		return 0;
+
+	long n = strtol(value, NULL, 10);
+	return n > 0 ? (unsigned long)n : 0;
 }
 
 /**
- * Compare two tag values which should contain an integer value
- * (e.g. disc or track number).  Either one may be NULL.
+ * Builds the complete sort key of one song: the album collation key,
+ * the disc and track numbers in fixed width and the file name
+ * collation key, concatenated so that the whole song order is a
+ * single strcmp().
+ *
+ * The collation keys come from g_utf8_collate_key_for_filename(),
+ * which is locale aware and orders embedded numbers naturally
+ * ("Track 2" before "Track 10").
  */
-static int
-compare_number_string(const char *a, const char *b)
+static char *
+song_collate_key(const struct song *song)
 {
-	long ai = a == NULL ? 0 : strtol(a, NULL, 10);
-	long bi = b == NULL ? 0 : strtol(b, NULL, 10);
+	const char *album = tag_get_value_checked(song->tag, TAG_ALBUM);
 
-	if (ai <= 0)
-		return bi <= 0 ? 0 : -1;
+	char *album_key = album != NULL
+		? g_utf8_collate_key_for_filename(album, -1)
+		: g_strdup("");
+	char *uri_key = g_utf8_collate_key_for_filename(song->uri, -1);
 
-	if (bi <= 0)
-		return 1;
+	char *key = g_strdup_printf("%s\1%010lu\1%010lu\1%s",
+				    album_key,
+				    number_tag_value(song->tag, TAG_DISC),
+				    number_tag_value(song->tag, TAG_TRACK),
+				    uri_key);
 
-	return ai - bi;
-}
+	g_free(album_key);
+	g_free(uri_key);
 
-static int
-compare_tag_item(const struct tag *a, const struct tag *b, enum tag_type type)
-{
-	return compare_number_string(tag_get_value_checked(a, type),
-				     tag_get_value_checked(b, type));
+	return key;
 }
 
-/* Only used for sorting/searchin a songvec, not general purpose compares */
+struct song_sort_item {
+	struct song *song;
+	char *key;
+};
+
 static int
-song_cmp(G_GNUC_UNUSED void *priv, struct list_head *_a, struct list_head *_b)
+song_sort_item_cmp(const void *_a, const void *_b)
 {
-	const struct song *a = (const struct song *)_a;
-	const struct song *b = (const struct song *)_b;
-	int ret;
-
-	/* first sort by album */
-	ret = compare_string_tag_item(a->tag, b->tag, TAG_ALBUM);
-	if (ret != 0)
-		return ret;
-
-	/* then sort by disc */
-	ret = compare_tag_item(a->tag, b->tag, TAG_DISC);
-	if (ret != 0)
-		return ret;
-
-	/* then by track number */
-	ret = compare_tag_item(a->tag, b->tag, TAG_TRACK);
-	if (ret != 0)
-		return ret;
-
-	/* still no difference?  compare file name */
-	return g_utf8_collate(a->uri, b->uri);
+	const struct song_sort_item *a = _a;
+	const struct song_sort_item *b = _b;
+
+	return strcmp(a->key, b->key);
 }
 
 void
 song_list_sort(struct list_head *songs)
 {
-	list_sort(NULL, songs, song_cmp);
+	unsigned n = 0;
+	struct song *song;
+	list_for_each_entry(song, songs, siblings)
+		++n;
+
+	if (n < 2)
+		return;
+
+	/* collate every name exactly once per pass: build the sort
+	   keys up front, and let qsort() compare the precomputed keys
+	   with memcmp-style speed, instead of re-collating the same
+	   strings in every comparison */
+	struct song_sort_item *items = g_new(struct song_sort_item, n);
+	unsigned i = 0;
+	list_for_each_entry(song, songs, siblings) {
+		items[i].song = song;
+		items[i].key = song_collate_key(song);
+		++i;
+	}
+
+	qsort(items, n, sizeof(items[0]), song_sort_item_cmp);
+
+	/* relink the list in the sorted order */
+	INIT_LIST_HEAD(songs);
+	for (i = 0; i < n; ++i) {
+		list_add_tail(&items[i].song->siblings, songs);
+		g_free(items[i].key);
+	}
+
+	g_free(items);
 }
@@ -81,4 +81,21 @@ sticker_song_find(struct directory *directory, const char *name,
 			       gpointer user_data),
 		  gpointer user_data);
 
+/**
+ * Lists all stickers of all songs below the specified directory with
+ * one ranged database query.  All values of one song arrive in
+ * consecutive callback invocations.
+ *
+ * Caller must lock the #db_mutex.
+ *
+ * @param directory the base directory to list
+ * @return true on success (even if no sticker was found), false on
+ * failure
+ */
+bool
+sticker_song_list_find(struct directory *directory,
+		       void (*func)(struct song *song, const char *name,
+				    const char *value, gpointer user_data),
+		       gpointer user_data);
+
 #endif
@@ -27,8 +27,11 @@
 #include "tag_ape.h"
 #include "tag_id3.h"
 #include "tag.h"
+#include "replay_gain_ape.h"
+#include "replay_gain_info.h"
 #include "tag_handler.h"
 #include "input_stream.h"
+#include "input/limit_input_plugin.h"
 
 #include <glib.h>
 
@@ -74,6 +77,67 @@ tag_scan_fallback(const char *path,
 		tag_id3_scan(path, handler, handler_ctx);
 }
 
+/**
+ * Captures MixRamp name-value pairs for the database, and forwards
+ * everything to #full_tag_handler, which fills the song's tag.
+ */
+static void
+song_scan_duration(unsigned seconds, void *ctx)
+{
+	struct song *song = ctx;
+
+	tag_handler_invoke_duration(&full_tag_handler, song->tag, seconds);
+}
+
+static void
+song_scan_tag(enum tag_type type, const char *value, void *ctx)
+{
+	struct song *song = ctx;
+
+	tag_handler_invoke_tag(&full_tag_handler, song->tag, type, value);
+}
+
+static void
+song_scan_pair(const char *key, const char *value, void *ctx)
+{
+	struct song *song = ctx;
+
+	if (g_ascii_strcasecmp(key, "mixramp_start") == 0) {
+		g_free(song->mixramp_start);
+		song->mixramp_start = g_strdup(value);
+	} else if (g_ascii_strcasecmp(key, "mixramp_end") == 0) {
+		g_free(song->mixramp_end);
+		song->mixramp_end = g_strdup(value);
+	}
+
+	tag_handler_invoke_pair(&full_tag_handler, song->tag, key, value);
+}
+
+static const struct tag_handler song_scan_handler = {
+	.duration = song_scan_duration,
+	.tag = song_scan_tag,
+	.pair = song_scan_pair,
+};
+
+/**
+ * Attempts to load replay gain data from the file's APE or ID3 tag,
+ * to be stored in the database.
+ *
+ * @return a newly allocated object, or NULL if the file has none
+ */
+static struct replay_gain_info *
+song_load_replay_gain(const char *path_fs)
+{
+	struct replay_gain_info info;
+	replay_gain_info_init(&info);
+
+	if (!replay_gain_ape_read(path_fs, &info) &&
+	    !tag_id3_replay_gain(path_fs, &info))
+		return NULL;
+
+	return g_memdup(&info, sizeof(info));
+}
+
 bool
 song_file_update(struct song *song)
 {
@@ -104,6 +168,10 @@ song_file_update(struct song *song)
 		song->tag = NULL;
 	}
 
+	g_free(song->mixramp_start);
+	g_free(song->mixramp_end);
+	song->mixramp_start = song->mixramp_end = NULL;
+
 	if (stat(path_fs, &st) < 0 || !S_ISREG(st.st_mode)) {
 		g_free(path_fs);
 		return false;
@@ -123,7 +191,7 @@ song_file_update(struct song *song)
 		/* load file tag */
 		song->tag = tag_new();
 		if (decoder_plugin_scan_file(plugin, path_fs,
-					     &full_tag_handler, song->tag))
+					     &song_scan_handler, song))
 			break;
 
 		tag_free(song->tag);
@@ -140,13 +208,23 @@ song_file_update(struct song *song)
 						       NULL);
 			}
 
-			/* now try the stream_tag() method */
+			/* now try the stream_tag() method, bounding
+			   the read I/O to the plugin's declared
+			   budget */
 			if (is != NULL) {
+				struct input_stream *limit =
+					input_limit_open(is,
+							 plugin->scan_read_limit);
+
 				song->tag = tag_new();
-				if (decoder_plugin_scan_stream(plugin, is,
-							       &full_tag_handler,
-							       song->tag))
+				if (decoder_plugin_scan_stream(plugin, limit,
+							       &song_scan_handler,
+							       song)) {
+					input_stream_close(limit);
 					break;
+				}
+
+				input_stream_close(limit);
 
 				tag_free(song->tag);
 				song->tag = NULL;
@@ -167,7 +245,12 @@ song_file_update(struct song *song)
 	}
 
 	if (song->tag != NULL && tag_is_empty(song->tag))
-		tag_scan_fallback(path_fs, &full_tag_handler, song->tag);
+		tag_scan_fallback(path_fs, &song_scan_handler, song);
+
+	g_free(song->replay_gain);
+	song->replay_gain = song->tag != NULL
+		? song_load_replay_gain(path_fs)
+		: NULL;
 
 	g_free(path_fs);
 	return song->tag != NULL;
@@ -24,11 +24,14 @@
 #include "playlist_state.h"
 #include "volume.h"
 #include "text_file.h"
+#include "io_thread.h"
 #include "glib_compat.h"
 
 #include <glib.h>
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
 #include <errno.h>
 
 #undef G_LOG_DOMAIN
@@ -46,15 +49,156 @@ static guint save_state_source_id;
 static unsigned prev_volume_version, prev_output_version,
 	prev_playlist_version;
 
+#ifndef G_OS_WIN32
+
+/**
+ * The serialized text of each state file section, cached between
+ * saves.  A section is re-generated only when its version has
+ * changed; with a big queue, the playlist section is by far the most
+ * expensive one.
+ */
+static GString *volume_section, *output_section, *playlist_section;
+
+/**
+ * Serialize one section with its FILE based save function into the
+ * given cache string, using an in-memory stream.
+ */
+static bool
+state_file_serialize(GString *section,
+		     void (*save)(FILE *fp, void *ctx), void *ctx)
+{
+	char *buffer = NULL;
+	size_t size = 0;
+
+	FILE *fp = open_memstream(&buffer, &size);
+	if (fp == NULL)
+		return false;
+
+	save(fp, ctx);
+
+	if (fclose(fp) != 0) {
+		free(buffer);
+		return false;
+	}
+
+	g_string_truncate(section, 0);
+	g_string_append_len(section, buffer, size);
+	free(buffer);
+	return true;
+}
+
 static void
-state_file_write(struct player_control *pc)
+save_volume_cb(FILE *fp, G_GNUC_UNUSED void *ctx)
+{
+	save_sw_volume_state(fp);
+}
+
+static void
+save_output_cb(FILE *fp, G_GNUC_UNUSED void *ctx)
+{
+	audio_output_state_save(fp);
+}
+
+static void
+save_playlist_cb(FILE *fp, void *ctx)
+{
+	playlist_state_save(fp, &g_playlist, (struct player_control *)ctx);
+}
+
+/**
+ * Build the complete state file text on the main thread,
+ * re-serializing only the sections whose version has changed.
+ * Returns NULL on error.
+ */
+static GString *
+state_file_snapshot(struct player_control *pc)
+{
+	if (volume_section == NULL) {
+		volume_section = g_string_new(NULL);
+		output_section = g_string_new(NULL);
+		playlist_section = g_string_new(NULL);
+
+		/* force the first serialization */
+		prev_volume_version = sw_volume_state_get_hash() - 1;
+		prev_output_version = audio_output_state_get_version() - 1;
+		prev_playlist_version =
+			playlist_state_get_hash(&g_playlist, pc) - 1;
+	}
+
+	if (prev_volume_version != sw_volume_state_get_hash() &&
+	    !state_file_serialize(volume_section, save_volume_cb, NULL))
+		return NULL;
+
+	if (prev_output_version != audio_output_state_get_version() &&
+	    !state_file_serialize(output_section, save_output_cb, NULL))
+		return NULL;
+
+	if (prev_playlist_version != playlist_state_get_hash(&g_playlist, pc) &&
+	    !state_file_serialize(playlist_section, save_playlist_cb, pc))
+		return NULL;
+
+	prev_volume_version = sw_volume_state_get_hash();
+	prev_output_version = audio_output_state_get_version();
+	prev_playlist_version = playlist_state_get_hash(&g_playlist, pc);
+
+	GString *text = g_string_sized_new(volume_section->len +
+					   output_section->len +
+					   playlist_section->len);
+	g_string_append_len(text, volume_section->str, volume_section->len);
+	g_string_append_len(text, output_section->str, output_section->len);
+	g_string_append_len(text, playlist_section->str,
+			    playlist_section->len);
+	return text;
+}
+
+/**
+ * Write the snapshot to disk; runs on the I/O thread.  Writes a
+ * temporary file first and renames it into place, so a crash never
+ * leaves a truncated state file.  Jobs run in submission order, so
+ * the latest snapshot always wins.
+ */
+static gboolean
+state_file_write_job(gpointer data)
+{
+	GString *text = data;
+	char *tmp_path = g_strconcat(state_file_path, ".tmp", NULL);
+
+	FILE *fp = fopen(tmp_path, "w");
+	if (G_UNLIKELY(fp == NULL)) {
+		g_warning("failed to create %s: %s",
+			  tmp_path, g_strerror(errno));
+		g_free(tmp_path);
+		g_string_free(text, true);
+		return false;
+	}
+
+	fwrite(text->str, 1, text->len, fp);
+
+	if (fclose(fp) != 0 || rename(tmp_path, state_file_path) != 0)
+		g_warning("failed to write %s: %s",
+			  state_file_path, g_strerror(errno));
+
+	g_free(tmp_path);
+	g_string_free(text, true);
+	return false;
+}
+
+static gpointer
+state_file_barrier(gpointer data)
+{
+	/* no-op: only used to wait for queued write jobs */
+	return data;
+}
+
+#endif /* !G_OS_WIN32 */
+
+static void
+state_file_write_sync(struct player_control *pc)
 {
 	FILE *fp;
 
 	assert(state_file_path != NULL);
 
-	g_debug("Saving state file %s", state_file_path);
-
 	fp = fopen(state_file_path, "w");
 	if (G_UNLIKELY(!fp)) {
 		g_warning("failed to create %s: %s",
@@ -73,6 +217,28 @@ state_file_write(struct player_control *pc)
 	prev_playlist_version = playlist_state_get_hash(&g_playlist, pc);
 }
 
+static void
+state_file_write(struct player_control *pc)
+{
+	assert(state_file_path != NULL);
+
+	g_debug("Saving state file %s", state_file_path);
+
+#ifndef G_OS_WIN32
+	GString *text = state_file_snapshot(pc);
+	if (text != NULL) {
+		/* hand the snapshot to the I/O thread, so the disk
+		   write does not stall the main loop */
+		io_thread_idle_add(state_file_write_job, text);
+		return;
+	}
+
+	/* fall back to the synchronous path */
+#endif
+
+	state_file_write_sync(pc);
+}
+
 static void
 state_file_read(struct player_control *pc)
 {
@@ -157,7 +323,20 @@ state_file_finish(struct player_control *pc)
 	if (save_state_source_id != 0)
 		g_source_remove(save_state_source_id);
 
-	state_file_write(pc);
+#ifndef G_OS_WIN32
+	/* wait for pending asynchronous writes before the final
+	   synchronous save, so the two cannot race */
+	io_thread_call(state_file_barrier, NULL);
+
+	if (volume_section != NULL) {
+		g_string_free(volume_section, true);
+		g_string_free(output_section, true);
+		g_string_free(playlist_section, true);
+		volume_section = output_section = playlist_section = NULL;
+	}
+#endif
+
+	state_file_write_sync(pc);
 
 	g_free(state_file_path);
 }
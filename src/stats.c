@@ -25,60 +25,203 @@
 #include "song.h"
 #include "client.h"
 #include "player_control.h"
-#include "strset.h"
 #include "client_internal.h"
 
 struct stats stats;
 
+/**
+ * Reference-counted multisets of the artist and album names in the
+ * database: the value maps to the number of songs carrying it, and
+ * the unique count is simply the table size.  Seeded by the full
+ * walk in stats_update(), then maintained incrementally by the
+ * update thread through stats_add_song()/stats_remove_song(), so
+ * "stats" does not re-scan the whole database after every update.
+ *
+ * The mutex guards the tables and the counters in #stats, because
+ * the hooks run in the update thread.
+ */
+static GStaticMutex stats_mutex = G_STATIC_MUTEX_INIT;
+static GHashTable *stats_artists, *stats_albums;
+
+/** do the tables hold a complete count?  Only then are the
+    incremental hooks applied */
+static bool stats_seeded;
+
 void stats_global_init(void)
 {
 	stats.timer = g_timer_new();
 }
 
+static void
+stats_table_free(GHashTable *table)
+{
+	if (table == NULL)
+		return;
+
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_hash_table_iter_init(&iter, table);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		g_free(key);
+
+	g_hash_table_destroy(table);
+}
+
 void stats_global_finish(void)
 {
+	stats_table_free(stats_artists);
+	stats_table_free(stats_albums);
 	g_timer_destroy(stats.timer);
 }
 
-struct visit_data {
-	struct strset *artists;
-	struct strset *albums;
-};
+/**
+ * Adds one reference to a value; the tables have no destroy
+ * functions, so re-inserting the stored key is safe.
+ */
+static void
+stats_set_add(GHashTable *table, const char *value)
+{
+	gpointer key, refs;
+
+	if (g_hash_table_lookup_extended(table, value, &key, &refs))
+		g_hash_table_insert(table, key,
+				    GUINT_TO_POINTER(GPOINTER_TO_UINT(refs) + 1));
+	else
+		g_hash_table_insert(table, g_strdup(value),
+				    GUINT_TO_POINTER(1));
+}
 
 static void
-visit_tag(struct visit_data *data, const struct tag *tag)
+stats_set_remove(GHashTable *table, const char *value)
 {
-	if (tag->time > 0)
-		stats.song_duration += tag->time;
+	gpointer key, refs;
+
+	if (!g_hash_table_lookup_extended(table, value, &key, &refs))
+		/* not accounted; can only happen after an unbalanced
+		   hook, which would be a bug elsewhere */
+		return;
+
+	unsigned n = GPOINTER_TO_UINT(refs);
+	if (n > 1)
+		g_hash_table_insert(table, key, GUINT_TO_POINTER(n - 1));
+	else {
+		g_hash_table_remove(table, key);
+		g_free(key);
+	}
+}
+
+/**
+ * Accounts one song's tag; "sign" is +1 for added and -1 for removed
+ * songs.
+ */
+static void
+stats_account_tag(const struct tag *tag, int sign,
+		  GHashTable *artists, GHashTable *albums)
+{
+	if (tag->time > 0) {
+		if (sign > 0)
+			stats.song_duration += tag->time;
+		else if (stats.song_duration >= (unsigned)tag->time)
+			stats.song_duration -= tag->time;
+	}
 
 	for (unsigned i = 0; i < tag->num_items; ++i) {
 		const struct tag_item *item = tag->items[i];
+		GHashTable *table;
 
 		switch (item->type) {
 		case TAG_ARTIST:
-			strset_add(data->artists, item->value);
+			table = artists;
 			break;
 
 		case TAG_ALBUM:
-			strset_add(data->albums, item->value);
+			table = albums;
 			break;
 
 		default:
-			break;
+			continue;
 		}
+
+		if (sign > 0)
+			stats_set_add(table, item->value);
+		else
+			stats_set_remove(table, item->value);
+	}
+}
+
+void
+stats_add_song(const struct song *song)
+{
+	g_static_mutex_lock(&stats_mutex);
+
+	if (stats_seeded) {
+		++stats.song_count;
+
+		if (song->tag != NULL)
+			stats_account_tag(song->tag, 1,
+					  stats_artists, stats_albums);
 	}
+
+	g_static_mutex_unlock(&stats_mutex);
+}
+
+void
+stats_remove_song(const struct song *song)
+{
+	g_static_mutex_lock(&stats_mutex);
+
+	if (stats_seeded) {
+		if (stats.song_count > 0)
+			--stats.song_count;
+
+		if (song->tag != NULL)
+			stats_account_tag(song->tag, -1,
+					  stats_artists, stats_albums);
+	}
+
+	g_static_mutex_unlock(&stats_mutex);
 }
 
+struct visit_data {
+	unsigned song_count;
+	unsigned long song_duration;
+
+	GHashTable *artists;
+	GHashTable *albums;
+};
+
 static bool
 collect_stats_song(struct song *song, void *_data,
 		   G_GNUC_UNUSED GError **error_r)
 {
 	struct visit_data *data = _data;
 
-	++stats.song_count;
+	++data->song_count;
+
+	const struct tag *tag = song->tag;
+	if (tag == NULL)
+		return true;
 
-	if (song->tag != NULL)
-		visit_tag(data, song->tag);
+	if (tag->time > 0)
+		data->song_duration += tag->time;
+
+	for (unsigned i = 0; i < tag->num_items; ++i) {
+		const struct tag_item *item = tag->items[i];
+
+		switch (item->type) {
+		case TAG_ARTIST:
+			stats_set_add(data->artists, item->value);
+			break;
+
+		case TAG_ALBUM:
+			stats_set_add(data->albums, item->value);
+			break;
+
+		default:
+			break;
+		}
+	}
 
 	return true;
 }
@@ -89,40 +232,61 @@ static const struct db_visitor collect_stats_visitor = {
 
 void stats_update(void)
 {
-	struct visit_data data;
+	g_static_mutex_lock(&stats_mutex);
+
+	if (stats_seeded) {
+		/* the counters are maintained incrementally; just
+		   refresh the unique counts from the table sizes */
+		stats.artist_count = g_hash_table_size(stats_artists);
+		stats.album_count = g_hash_table_size(stats_albums);
+		g_static_mutex_unlock(&stats_mutex);
+		return;
+	}
 
-	stats.song_count = 0;
-	stats.song_duration = 0;
-	stats.artist_count = 0;
+	g_static_mutex_unlock(&stats_mutex);
 
-	data.artists = strset_new();
-	data.albums = strset_new();
+	/* walk into local tables first: the mutex must not be held
+	   during the walk, because the update thread takes it while
+	   holding the database lock */
+	struct visit_data data = {
+		.song_count = 0,
+		.song_duration = 0,
+		.artists = g_hash_table_new(g_str_hash, g_str_equal),
+		.albums = g_hash_table_new(g_str_hash, g_str_equal),
+	};
 
 	db_walk("", &collect_stats_visitor, &data, NULL);
 
-	stats.artist_count = strset_size(data.artists);
-	stats.album_count = strset_size(data.albums);
+	g_static_mutex_lock(&stats_mutex);
+
+	stats_table_free(stats_artists);
+	stats_table_free(stats_albums);
+	stats_artists = data.artists;
+	stats_albums = data.albums;
+
+	stats.song_count = data.song_count;
+	stats.song_duration = data.song_duration;
+	stats.artist_count = g_hash_table_size(stats_artists);
+	stats.album_count = g_hash_table_size(stats_albums);
+
+	/* song pointers stay stable only in the simple database;
+	   elsewhere the hooks never fire, so a full re-scan remains
+	   necessary */
+	stats_seeded = db_is_simple();
 
-	strset_free(data.artists);
-	strset_free(data.albums);
+	g_static_mutex_unlock(&stats_mutex);
 }
 
 int stats_print(struct client *client)
 {
-	client_printf(client,
-		      "artists: %u\n"
-		      "albums: %u\n"
-		      "songs: %i\n"
-		      "uptime: %li\n"
-		      "playtime: %li\n"
-		      "db_playtime: %li\n"
-		      "db_update: %li\n",
-		      stats.artist_count,
-		      stats.album_count,
-		      stats.song_count,
-		      (long)g_timer_elapsed(stats.timer, NULL),
-		      (long)(pc_get_total_play_time(client->player_control) + 0.5),
-		      stats.song_duration,
-		      (long)db_get_mtime());
+	client_write_pair_uint(client, "artists", stats.artist_count);
+	client_write_pair_uint(client, "albums", stats.album_count);
+	client_write_pair_int(client, "songs", stats.song_count);
+	client_write_pair_int(client, "uptime",
+			      (long)g_timer_elapsed(stats.timer, NULL));
+	client_write_pair_int(client, "playtime",
+			      (long)(pc_get_total_play_time(client->player_control) + 0.5));
+	client_write_pair_int(client, "db_playtime", stats.song_duration);
+	client_write_pair_int(client, "db_update", (long)db_get_mtime());
 	return 0;
 }
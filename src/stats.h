@@ -23,6 +23,7 @@
 #include <glib.h>
 
 struct client;
+struct song;
 
 struct stats {
 	GTimer *timer;
@@ -49,6 +50,18 @@ void stats_global_finish(void);
 
 void stats_update(void);
 
+/**
+ * Incremental accounting hooks, called by the update thread when a
+ * song enters or leaves the database (call remove/add around an
+ * in-place tag change).  No-ops until stats_update() has seeded the
+ * counters with a full walk.
+ */
+void
+stats_add_song(const struct song *song);
+
+void
+stats_remove_song(const struct song *song);
+
 int stats_print(struct client *client);
 
 #endif
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2003-2012 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "status_print.h"
+#include "client.h"
+#include "client_internal.h"
+#include "player_control.h"
+#include "playlist.h"
+#include "volume.h"
+#include "update.h"
+#include "audio_format.h"
+
+#include <glib.h>
+
+#define COMMAND_STATUS_STATE            "state"
+#define COMMAND_STATUS_REPEAT           "repeat"
+#define COMMAND_STATUS_SINGLE           "single"
+#define COMMAND_STATUS_CONSUME          "consume"
+#define COMMAND_STATUS_RANDOM           "random"
+#define COMMAND_STATUS_PLAYLIST         "playlist"
+#define COMMAND_STATUS_PLAYLIST_LENGTH  "playlistlength"
+#define COMMAND_STATUS_SONG             "song"
+#define COMMAND_STATUS_SONGID           "songid"
+#define COMMAND_STATUS_NEXTSONG         "nextsong"
+#define COMMAND_STATUS_NEXTSONGID       "nextsongid"
+#define COMMAND_STATUS_TIME             "time"
+#define COMMAND_STATUS_BITRATE          "bitrate"
+#define COMMAND_STATUS_ERROR            "error"
+#define COMMAND_STATUS_CROSSFADE	"xfade"
+#define COMMAND_STATUS_MIXRAMPDB	"mixrampdb"
+#define COMMAND_STATUS_MIXRAMPDELAY	"mixrampdelay"
+#define COMMAND_STATUS_AUDIO		"audio"
+#define COMMAND_STATUS_BUFFERED		"buffered_chunks"
+#define COMMAND_STATUS_UPDATING_DB	"updating_db"
+
+void
+status_print(struct client *client)
+{
+	const char *state = NULL;
+	struct player_status player_status;
+	int updateJobId;
+	char *error;
+	int song;
+
+	pc_get_status(client->player_control, &player_status);
+
+	switch (player_status.state) {
+	case PLAYER_STATE_STOP:
+		state = "stop";
+		break;
+	case PLAYER_STATE_PAUSE:
+		state = "pause";
+		break;
+	case PLAYER_STATE_PLAY:
+		state = "play";
+		break;
+	}
+
+	/* this command dominates the protocol traffic; fixed text and
+	   fast integer conversions instead of printf, see
+	   client_write_pair() */
+
+	client_write_pair_int(client, "volume", volume_level_get());
+	client_write_pair_int(client, COMMAND_STATUS_REPEAT,
+			      playlist_get_repeat(&g_playlist));
+	client_write_pair_int(client, COMMAND_STATUS_RANDOM,
+			      playlist_get_random(&g_playlist));
+	client_write_pair_int(client, COMMAND_STATUS_SINGLE,
+			      playlist_get_single(&g_playlist));
+	client_write_pair_int(client, COMMAND_STATUS_CONSUME,
+			      playlist_get_consume(&g_playlist));
+	client_write_pair_uint(client, COMMAND_STATUS_PLAYLIST,
+			       playlist_get_version(&g_playlist));
+	client_write_pair_int(client, COMMAND_STATUS_PLAYLIST_LENGTH,
+			      playlist_get_length(&g_playlist));
+	client_write_pair_int(client, COMMAND_STATUS_CROSSFADE,
+			      (int)(pc_get_cross_fade(client->player_control) + 0.5));
+	client_printf(client,
+		      COMMAND_STATUS_MIXRAMPDB ": %f\n"
+		      COMMAND_STATUS_MIXRAMPDELAY ": %f\n",
+		      pc_get_mixramp_db(client->player_control),
+		      pc_get_mixramp_delay(client->player_control));
+	client_write_pair(client, COMMAND_STATUS_STATE, state);
+
+	song = playlist_get_current_song(&g_playlist);
+	if (song >= 0) {
+		client_write_pair_int(client, COMMAND_STATUS_SONG, song);
+		client_write_pair_uint(client, COMMAND_STATUS_SONGID,
+				       playlist_get_song_id(&g_playlist, song));
+	}
+
+	if (player_status.state != PLAYER_STATE_STOP) {
+		struct audio_format_string af_string;
+
+		client_puts(client, COMMAND_STATUS_TIME ": ");
+		client_write_int(client,
+				 (int)(player_status.elapsed_time + 0.5));
+		client_puts(client, ":");
+		client_write_int(client,
+				 (int)(player_status.total_time + 0.5));
+		client_puts(client, "\n");
+		client_printf(client, "elapsed: %1.3f\n",
+			      player_status.elapsed_time);
+		client_write_pair_uint(client, COMMAND_STATUS_BITRATE,
+				       player_status.bit_rate);
+		client_write_pair(client, COMMAND_STATUS_AUDIO,
+				  audio_format_to_string(&player_status.audio_format,
+							 &af_string));
+		client_write_pair_uint(client, COMMAND_STATUS_BUFFERED,
+				       player_status.buffered_chunks);
+	}
+
+	if ((updateJobId = isUpdatingDB()))
+		client_write_pair_int(client, COMMAND_STATUS_UPDATING_DB,
+				      updateJobId);
+
+	error = pc_get_error_message(client->player_control);
+	if (error != NULL) {
+		client_write_pair(client, COMMAND_STATUS_ERROR, error);
+		g_free(error);
+	}
+
+	song = playlist_get_next_song(&g_playlist);
+	if (song >= 0) {
+		client_write_pair_int(client, COMMAND_STATUS_NEXTSONG, song);
+		client_write_pair_uint(client, COMMAND_STATUS_NEXTSONGID,
+				       playlist_get_song_id(&g_playlist, song));
+	}
+}
@@ -20,10 +20,12 @@
 #include "config.h"
 #include "sticker.h"
 #include "idle.h"
+#include "conf.h"
 
 #include <glib.h>
 #include <sqlite3.h>
 #include <assert.h>
+#include <string.h>
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "sticker"
@@ -44,6 +46,7 @@ enum sticker_sql {
 	STICKER_SQL_DELETE,
 	STICKER_SQL_DELETE_VALUE,
 	STICKER_SQL_FIND,
+	STICKER_SQL_LIST_PREFIX,
 };
 
 static const char *const sticker_sql[] = {
@@ -61,6 +64,9 @@ static const char *const sticker_sql[] = {
 	"DELETE FROM sticker WHERE type=? AND uri=? AND name=?",
 	[STICKER_SQL_FIND] =
 	"SELECT uri,value FROM sticker WHERE type=? AND uri LIKE (? || '%') AND name=?",
+	[STICKER_SQL_LIST_PREFIX] =
+	"SELECT uri,name,value FROM sticker WHERE type=? AND uri LIKE (? || '%') "
+	"ORDER BY uri",
 };
 
 static const char sticker_sql_create[] =
@@ -77,6 +83,43 @@ static const char sticker_sql_create[] =
 static sqlite3 *sticker_db;
 static sqlite3_stmt *sticker_stmt[G_N_ELEMENTS(sticker_sql)];
 
+/**
+ * Is a batch transaction open?  Sticker writes are collected into
+ * one transaction which is committed when the main loop runs out of
+ * events, so a burst of "sticker set" commands pays for one commit
+ * instead of one per value.
+ */
+static bool sticker_in_batch;
+
+/** the GSource id of the scheduled batch commit */
+static guint sticker_commit_source_id;
+
+/**
+ * An entry in the sticker value cache.
+ */
+struct sticker_cache_entry {
+	/** the cache key: type, uri and name, separated by an
+	    unprintable byte */
+	char *key;
+
+	/** the sticker value; NULL records that the sticker does not
+	    exist (a "negative" entry) */
+	char *value;
+};
+
+/**
+ * Maps a cache key to its GList node in #sticker_cache_lru.  The
+ * cache is write-through: every successful write updates it, so a
+ * hit is always current.
+ */
+static GHashTable *sticker_cache;
+
+/** the cache entries, most recently used first */
+static GQueue *sticker_cache_lru;
+
+/** the maximum number of cache entries; 0 disables the cache */
+static unsigned sticker_cache_max;
+
 static GQuark
 sticker_quark(void)
 {
@@ -100,6 +143,190 @@ sticker_prepare(const char *sql, GError **error_r)
 	return stmt;
 }
 
+static void
+sticker_batch_commit(void)
+{
+	int ret;
+
+	if (!sticker_in_batch)
+		return;
+
+	ret = sqlite3_exec(sticker_db, "COMMIT", NULL, NULL, NULL);
+	if (ret != SQLITE_OK)
+		g_warning("COMMIT failed: %s", sqlite3_errmsg(sticker_db));
+
+	sticker_in_batch = false;
+}
+
+static gboolean
+sticker_commit_event(G_GNUC_UNUSED gpointer data)
+{
+	sticker_commit_source_id = 0;
+	sticker_batch_commit();
+	return false;
+}
+
+/**
+ * Opens the batch transaction (unless one is open already) and
+ * schedules its commit for when the main loop becomes idle.  Call
+ * this before every write.
+ */
+static void
+sticker_batch_begin(void)
+{
+	int ret;
+
+	if (sticker_in_batch)
+		return;
+
+	ret = sqlite3_exec(sticker_db, "BEGIN", NULL, NULL, NULL);
+	if (ret != SQLITE_OK) {
+		/* no transaction, then - the write gets committed
+		   implicitly, as before */
+		g_warning("BEGIN failed: %s", sqlite3_errmsg(sticker_db));
+		return;
+	}
+
+	sticker_in_batch = true;
+	sticker_commit_source_id = g_idle_add(sticker_commit_event, NULL);
+}
+
+/**
+ * The byte which separates the key components; it cannot occur in
+ * any of them.
+ */
+#define STICKER_CACHE_SEPARATOR "\x1e"
+
+static char *
+sticker_cache_key(const char *type, const char *uri, const char *name)
+{
+	return g_strconcat(type, STICKER_CACHE_SEPARATOR,
+			   uri, STICKER_CACHE_SEPARATOR, name, NULL);
+}
+
+static void
+sticker_cache_entry_free(struct sticker_cache_entry *entry)
+{
+	g_free(entry->key);
+	g_free(entry->value);
+	g_free(entry);
+}
+
+/**
+ * Looks up a sticker value in the cache.  On a hit, the entry is
+ * moved to the front of the LRU list.
+ *
+ * @param value_r on a hit, a copy of the value (or NULL if the entry
+ * is negative) is stored here; free with g_free()
+ * @return true on a cache hit
+ */
+static bool
+sticker_cache_get(const char *type, const char *uri, const char *name,
+		  char **value_r)
+{
+	char *key;
+	GList *node;
+	const struct sticker_cache_entry *entry;
+
+	if (sticker_cache == NULL)
+		return false;
+
+	key = sticker_cache_key(type, uri, name);
+	node = g_hash_table_lookup(sticker_cache, key);
+	g_free(key);
+
+	if (node == NULL)
+		return false;
+
+	g_queue_unlink(sticker_cache_lru, node);
+	g_queue_push_head_link(sticker_cache_lru, node);
+
+	entry = node->data;
+	*value_r = g_strdup(entry->value);
+	return true;
+}
+
+/**
+ * Stores a sticker value in the cache, evicting the least recently
+ * used entry if the cache is full.  Pass value=NULL to record that
+ * the sticker does not exist.
+ */
+static void
+sticker_cache_put(const char *type, const char *uri, const char *name,
+		  const char *value)
+{
+	char *key;
+	GList *node;
+	struct sticker_cache_entry *entry;
+
+	if (sticker_cache == NULL)
+		return;
+
+	key = sticker_cache_key(type, uri, name);
+	node = g_hash_table_lookup(sticker_cache, key);
+	if (node != NULL) {
+		/* refresh the existing entry */
+		g_free(key);
+
+		entry = node->data;
+		g_free(entry->value);
+		entry->value = g_strdup(value);
+
+		g_queue_unlink(sticker_cache_lru, node);
+		g_queue_push_head_link(sticker_cache_lru, node);
+		return;
+	}
+
+	entry = g_new(struct sticker_cache_entry, 1);
+	entry->key = key;
+	entry->value = g_strdup(value);
+
+	g_queue_push_head(sticker_cache_lru, entry);
+	g_hash_table_insert(sticker_cache, entry->key,
+			    g_queue_peek_head_link(sticker_cache_lru));
+
+	if (g_queue_get_length(sticker_cache_lru) > sticker_cache_max) {
+		/* evict the least recently used entry */
+		entry = g_queue_pop_tail(sticker_cache_lru);
+		g_hash_table_remove(sticker_cache, entry->key);
+		sticker_cache_entry_free(entry);
+	}
+}
+
+/**
+ * Removes all cache entries of the specified object, no matter what
+ * their name is.  Used by sticker_delete(), which does not know the
+ * names it deletes.
+ */
+static void
+sticker_cache_delete_uri(const char *type, const char *uri)
+{
+	char *prefix;
+	size_t prefix_length;
+	GList *node, *next;
+
+	if (sticker_cache == NULL)
+		return;
+
+	prefix = g_strconcat(type, STICKER_CACHE_SEPARATOR,
+			     uri, STICKER_CACHE_SEPARATOR, NULL);
+	prefix_length = strlen(prefix);
+
+	for (node = sticker_cache_lru->head; node != NULL; node = next) {
+		struct sticker_cache_entry *entry = node->data;
+		next = node->next;
+
+		if (memcmp(entry->key, prefix, prefix_length) != 0)
+			continue;
+
+		g_hash_table_remove(sticker_cache, entry->key);
+		g_queue_delete_link(sticker_cache_lru, node);
+		sticker_cache_entry_free(entry);
+	}
+
+	g_free(prefix);
+}
+
 bool
 sticker_global_init(const char *path, GError **error_r)
 {
@@ -119,6 +346,26 @@ sticker_global_init(const char *path, GError **error_r)
 		return false;
 	}
 
+	if (config_get_bool(CONF_STICKER_WAL, true)) {
+#if SQLITE_VERSION_NUMBER >= 3007000
+		/* write-ahead logging moves the fsync out of the
+		   write path: "sticker set" storms no longer stall
+		   the main thread, and readers are not blocked by a
+		   writer.  Not fatal if it fails (e.g. database on a
+		   network file system). */
+		ret = sqlite3_exec(sticker_db,
+				   "PRAGMA journal_mode=WAL;"
+				   "PRAGMA synchronous=NORMAL;",
+				   NULL, NULL, NULL);
+		if (ret != SQLITE_OK)
+			g_warning("Failed to enable WAL on '%s': %s",
+				  path, sqlite3_errmsg(sticker_db));
+#else
+		g_warning("\"" CONF_STICKER_WAL "\" is not available; "
+			  "libsqlite3 is too old");
+#endif
+	}
+
 	/* create the table and index */
 
 	ret = sqlite3_exec(sticker_db, sticker_sql_create, NULL, NULL, NULL);
@@ -139,6 +386,12 @@ sticker_global_init(const char *path, GError **error_r)
 			return false;
 	}
 
+	sticker_cache_max = config_get_unsigned(CONF_STICKER_CACHE_SIZE, 1024);
+	if (sticker_cache_max > 0) {
+		sticker_cache = g_hash_table_new(g_str_hash, g_str_equal);
+		sticker_cache_lru = g_queue_new();
+	}
+
 	return true;
 }
 
@@ -149,6 +402,23 @@ sticker_global_finish(void)
 		/* not configured */
 		return;
 
+	if (sticker_commit_source_id != 0)
+		g_source_remove(sticker_commit_source_id);
+	sticker_batch_commit();
+
+	if (sticker_cache != NULL) {
+		struct sticker_cache_entry *entry;
+
+		while ((entry = g_queue_pop_tail(sticker_cache_lru)) != NULL)
+			sticker_cache_entry_free(entry);
+
+		g_queue_free(sticker_cache_lru);
+		sticker_cache_lru = NULL;
+
+		g_hash_table_destroy(sticker_cache);
+		sticker_cache = NULL;
+	}
+
 	for (unsigned i = 0; i < G_N_ELEMENTS(sticker_stmt); ++i) {
 		assert(sticker_stmt[i] != NULL);
 
@@ -179,6 +449,9 @@ sticker_load_value(const char *type, const char *uri, const char *name)
 	if (*name == 0)
 		return NULL;
 
+	if (sticker_cache_get(type, uri, name, &value))
+		return value;
+
 	sqlite3_reset(stmt);
 
 	ret = sqlite3_bind_text(stmt, 1, type, -1, NULL);
@@ -222,6 +495,9 @@ sticker_load_value(const char *type, const char *uri, const char *name)
 	sqlite3_reset(stmt);
 	sqlite3_clear_bindings(stmt);
 
+	/* remember the result, including "not found" */
+	sticker_cache_put(type, uri, name, value);
+
 	return value;
 }
 
@@ -419,8 +695,14 @@ sticker_store_value(const char *type, const char *uri,
 	if (*name == 0)
 		return false;
 
-	return sticker_update_value(type, uri, name, value) ||
-		sticker_insert_value(type, uri, name, value);
+	sticker_batch_begin();
+
+	if (!sticker_update_value(type, uri, name, value) &&
+	    !sticker_insert_value(type, uri, name, value))
+		return false;
+
+	sticker_cache_put(type, uri, name, value);
+	return true;
 }
 
 bool
@@ -433,6 +715,8 @@ sticker_delete(const char *type, const char *uri)
 	assert(type != NULL);
 	assert(uri != NULL);
 
+	sticker_batch_begin();
+
 	sqlite3_reset(stmt);
 
 	ret = sqlite3_bind_text(stmt, 1, type, -1, NULL);
@@ -462,6 +746,8 @@ sticker_delete(const char *type, const char *uri)
 	sqlite3_reset(stmt);
 	sqlite3_clear_bindings(stmt);
 
+	sticker_cache_delete_uri(type, uri);
+
 	idle_add(IDLE_STICKER);
 	return true;
 }
@@ -476,6 +762,8 @@ sticker_delete_value(const char *type, const char *uri, const char *name)
 	assert(type != NULL);
 	assert(uri != NULL);
 
+	sticker_batch_begin();
+
 	sqlite3_reset(stmt);
 
 	ret = sqlite3_bind_text(stmt, 1, type, -1, NULL);
@@ -514,6 +802,10 @@ sticker_delete_value(const char *type, const char *uri, const char *name)
 	sqlite3_reset(stmt);
 	sqlite3_clear_bindings(stmt);
 
+	/* whether a row was deleted or none existed, the sticker is
+	   gone now */
+	sticker_cache_put(type, uri, name, NULL);
+
 	idle_add(IDLE_STICKER);
 	return ret > 0;
 }
@@ -658,3 +950,62 @@ sticker_find(const char *type, const char *base_uri, const char *name,
 
 	return true;
 }
+
+bool
+sticker_list_find(const char *type, const char *base_uri,
+		  void (*func)(const char *uri, const char *name,
+			       const char *value, gpointer user_data),
+		  gpointer user_data)
+{
+	sqlite3_stmt *const stmt = sticker_stmt[STICKER_SQL_LIST_PREFIX];
+	int ret;
+
+	assert(type != NULL);
+	assert(func != NULL);
+	assert(sticker_enabled());
+
+	sqlite3_reset(stmt);
+
+	ret = sqlite3_bind_text(stmt, 1, type, -1, NULL);
+	if (ret != SQLITE_OK) {
+		g_warning("sqlite3_bind_text() failed: %s",
+			  sqlite3_errmsg(sticker_db));
+		return false;
+	}
+
+	if (base_uri == NULL)
+		base_uri = "";
+
+	ret = sqlite3_bind_text(stmt, 2, base_uri, -1, NULL);
+	if (ret != SQLITE_OK) {
+		g_warning("sqlite3_bind_text() failed: %s",
+			  sqlite3_errmsg(sticker_db));
+		return false;
+	}
+
+	do {
+		ret = sqlite3_step(stmt);
+		switch (ret) {
+		case SQLITE_ROW:
+			func((const char*)sqlite3_column_text(stmt, 0),
+			     (const char*)sqlite3_column_text(stmt, 1),
+			     (const char*)sqlite3_column_text(stmt, 2),
+			     user_data);
+			break;
+		case SQLITE_DONE:
+			break;
+		case SQLITE_BUSY:
+			/* no op */
+			break;
+		default:
+			g_warning("sqlite3_step() failed: %s",
+				  sqlite3_errmsg(sticker_db));
+			return false;
+		}
+	} while (ret != SQLITE_DONE);
+
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	return true;
+}
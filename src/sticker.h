@@ -156,4 +156,22 @@ sticker_find(const char *type, const char *base_uri, const char *name,
 			  gpointer user_data),
 	     gpointer user_data);
 
+/**
+ * Lists all stickers below the specified URI with one ranged query,
+ * no matter what their name is.  The callback is invoked once per
+ * sticker value; all values of one object arrive in consecutive
+ * calls.
+ *
+ * @param type the resource type, e.g. "song"
+ * @param base_uri the URI prefix of the resources, or NULL if all
+ * resources should be listed
+ * @return true on success (even if no sticker was found), false on
+ * failure
+ */
+bool
+sticker_list_find(const char *type, const char *base_uri,
+		  void (*func)(const char *uri, const char *name,
+			       const char *value, gpointer user_data),
+		  gpointer user_data);
+
 #endif
@@ -43,6 +43,39 @@ static const char PLAYLIST_COMMENT = '#';
 static unsigned playlist_max_length;
 bool playlist_saveAbsolutePaths = DEFAULT_PLAYLIST_SAVE_ABSOLUTE_PATHS;
 
+/**
+ * A cached stored playlist: the parsed contents of one playlist file.
+ */
+struct spl_cache_entry {
+	char *name;
+
+	/** the file's modification time when it was parsed */
+	time_t mtime;
+
+	/** the value of #spl_cache_counter at the last access; the
+	    entry with the lowest value is evicted */
+	unsigned last_used;
+
+	GPtrArray *list;
+};
+
+/**
+ * Maximum number of parsed playlists kept in memory.
+ */
+#define SPL_CACHE_MAX 8
+
+static GPtrArray *spl_cache;
+static unsigned spl_cache_counter;
+
+/**
+ * The cached result of spl_list(), valid as long as the playlist
+ * directory's modification time does not change.  A single stat()
+ * revalidates it, instead of opening the directory and stat'ing
+ * every playlist file on each "listplaylists".
+ */
+static GPtrArray *spl_listing;
+static time_t spl_listing_mtime;
+
 void
 spl_global_init(void)
 {
@@ -54,6 +87,107 @@ spl_global_init(void)
 				DEFAULT_PLAYLIST_SAVE_ABSOLUTE_PATHS);
 }
 
+static void
+spl_cache_entry_free(struct spl_cache_entry *entry)
+{
+	g_free(entry->name);
+	spl_free(entry->list);
+	g_free(entry);
+}
+
+static struct spl_cache_entry *
+spl_cache_lookup(const char *name_utf8)
+{
+	if (spl_cache == NULL)
+		return NULL;
+
+	for (unsigned i = 0; i < spl_cache->len; ++i) {
+		struct spl_cache_entry *entry =
+			g_ptr_array_index(spl_cache, i);
+		if (strcmp(entry->name, name_utf8) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void
+spl_cache_put(const char *name_utf8, time_t mtime, GPtrArray *list)
+{
+	if (spl_cache == NULL)
+		spl_cache = g_ptr_array_new();
+
+	if (spl_cache->len >= SPL_CACHE_MAX) {
+		/* evict the least recently used entry */
+		unsigned victim = 0;
+
+		for (unsigned i = 1; i < spl_cache->len; ++i) {
+			const struct spl_cache_entry *entry =
+				g_ptr_array_index(spl_cache, i);
+			const struct spl_cache_entry *v =
+				g_ptr_array_index(spl_cache, victim);
+			if (entry->last_used < v->last_used)
+				victim = i;
+		}
+
+		spl_cache_entry_free(g_ptr_array_remove_index_fast(spl_cache,
+								   victim));
+	}
+
+	struct spl_cache_entry *entry = g_new(struct spl_cache_entry, 1);
+	entry->name = g_strdup(name_utf8);
+	entry->mtime = mtime;
+	entry->last_used = ++spl_cache_counter;
+	entry->list = list;
+	g_ptr_array_add(spl_cache, entry);
+}
+
+static void
+spl_listing_invalidate(void)
+{
+	if (spl_listing == NULL)
+		return;
+
+	spl_list_free(spl_listing);
+	spl_listing = NULL;
+}
+
+void
+spl_cache_invalidate(const char *name_utf8)
+{
+	/* rewriting a playlist file in place changes its mtime, but
+	   not the directory's - drop the cached listing as well */
+	spl_listing_invalidate();
+
+	if (spl_cache == NULL)
+		return;
+
+	for (unsigned i = 0; i < spl_cache->len; ++i) {
+		struct spl_cache_entry *entry =
+			g_ptr_array_index(spl_cache, i);
+		if (strcmp(entry->name, name_utf8) == 0) {
+			spl_cache_entry_free(entry);
+			g_ptr_array_remove_index_fast(spl_cache, i);
+			return;
+		}
+	}
+}
+
+void
+spl_global_finish(void)
+{
+	spl_listing_invalidate();
+
+	if (spl_cache == NULL)
+		return;
+
+	for (unsigned i = 0; i < spl_cache->len; ++i)
+		spl_cache_entry_free(g_ptr_array_index(spl_cache, i));
+
+	g_ptr_array_free(spl_cache, true);
+	spl_cache = NULL;
+}
+
 bool
 spl_valid_name(const char *name_utf8)
 {
@@ -213,6 +347,34 @@ spl_list_free(GPtrArray *list)
 	g_ptr_array_free(list, true);
 }
 
+const GPtrArray *
+spl_list_cached(GError **error_r)
+{
+	const char *parent_path_fs = spl_map(error_r);
+	struct stat st;
+
+	if (parent_path_fs == NULL)
+		return NULL;
+
+	if (stat(parent_path_fs, &st) < 0) {
+		g_set_error_literal(error_r, g_file_error_quark(), errno,
+				    g_strerror(errno));
+		return NULL;
+	}
+
+	if (spl_listing != NULL && spl_listing_mtime == st.st_mtime)
+		return spl_listing;
+
+	GPtrArray *list = spl_list(error_r);
+	if (list == NULL)
+		return NULL;
+
+	spl_listing_invalidate();
+	spl_listing = list;
+	spl_listing_mtime = st.st_mtime;
+	return spl_listing;
+}
+
 static bool
 spl_save(GPtrArray *list, const char *utf8path, GError **error_r)
 {
@@ -240,25 +402,18 @@ spl_save(GPtrArray *list, const char *utf8path, GError **error_r)
 	}
 
 	fclose(file);
+
+	spl_cache_invalidate(utf8path);
 	return true;
 }
 
-GPtrArray *
-spl_load(const char *utf8path, GError **error_r)
+static GPtrArray *
+spl_load_internal(const char *path_fs, GError **error_r)
 {
 	FILE *file;
 	GPtrArray *list;
-	char *path_fs;
-
-	if (spl_map(error_r) == NULL)
-		return NULL;
-
-	path_fs = spl_map_to_fs(utf8path, error_r);
-	if (path_fs == NULL)
-		return NULL;
 
 	file = fopen(path_fs, "r");
-	g_free(path_fs);
 	if (file == NULL) {
 		playlist_errno(error_r);
 		return NULL;
@@ -293,6 +448,58 @@ spl_load(const char *utf8path, GError **error_r)
 	return list;
 }
 
+GPtrArray *
+spl_load(const char *utf8path, GError **error_r)
+{
+	char *path_fs = spl_map_to_fs(utf8path, error_r);
+	if (path_fs == NULL)
+		return NULL;
+
+	GPtrArray *list = spl_load_internal(path_fs, error_r);
+	g_free(path_fs);
+	return list;
+}
+
+const GPtrArray *
+spl_load_cached(const char *utf8path, GError **error_r)
+{
+	struct stat st;
+
+	char *path_fs = spl_map_to_fs(utf8path, error_r);
+	if (path_fs == NULL)
+		return NULL;
+
+	if (stat(path_fs, &st) < 0) {
+		playlist_errno(error_r);
+		g_free(path_fs);
+		return NULL;
+	}
+
+	struct spl_cache_entry *entry = spl_cache_lookup(utf8path);
+	if (entry != NULL && entry->mtime == st.st_mtime) {
+		g_free(path_fs);
+		entry->last_used = ++spl_cache_counter;
+		return entry->list;
+	}
+
+	GPtrArray *list = spl_load_internal(path_fs, error_r);
+	g_free(path_fs);
+	if (list == NULL)
+		return NULL;
+
+	if (entry != NULL) {
+		/* the file has changed on disk: replace the stale
+		   contents */
+		spl_free(entry->list);
+		entry->list = list;
+		entry->mtime = st.st_mtime;
+		entry->last_used = ++spl_cache_counter;
+	} else
+		spl_cache_put(utf8path, st.st_mtime, list);
+
+	return list;
+}
+
 void
 spl_free(GPtrArray *list)
 {
@@ -383,6 +590,7 @@ spl_clear(const char *utf8path, GError **error_r)
 
 	fclose(file);
 
+	spl_cache_invalidate(utf8path);
 	idle_add(IDLE_STORED_PLAYLIST);
 	return true;
 }
@@ -404,6 +612,7 @@ spl_delete(const char *name_utf8, GError **error_r)
 		return false;
 	}
 
+	spl_cache_invalidate(name_utf8);
 	idle_add(IDLE_STORED_PLAYLIST);
 	return true;
 }
@@ -473,6 +682,7 @@ spl_append_song(const char *utf8path, struct song *song, GError **error_r)
 
 	fclose(file);
 
+	spl_cache_invalidate(utf8path);
 	idle_add(IDLE_STORED_PLAYLIST);
 	return true;
 }
@@ -548,5 +758,10 @@ spl_rename(const char *utf8from, const char *utf8to, GError **error_r)
 	g_free(from_path_fs);
 	g_free(to_path_fs);
 
+	if (success) {
+		spl_cache_invalidate(utf8from);
+		spl_cache_invalidate(utf8to);
+	}
+
 	return success;
 }
@@ -40,6 +40,20 @@ extern bool playlist_saveAbsolutePaths;
 void
 spl_global_init(void);
 
+/**
+ * Free all resources, e.g. the stored playlist cache.
+ */
+void
+spl_global_finish(void);
+
+/**
+ * Removes the given playlist from the in-memory cache.  Must be
+ * called whenever a playlist file is modified by MPD itself; external
+ * modifications are caught by the modification time check.
+ */
+void
+spl_cache_invalidate(const char *name_utf8);
+
 /**
  * Determines whether the specified string is a valid name for a
  * stored playlist.
@@ -57,9 +71,29 @@ spl_list(GError **error_r);
 void
 spl_list_free(GPtrArray *list);
 
+/**
+ * Like spl_list(), but returns a cached listing of the playlist
+ * directory, revalidated with a single stat() of the directory.  The
+ * returned list is owned by the cache; the caller must not modify or
+ * free it, and it is valid only until the next stored playlist
+ * operation.
+ */
+const GPtrArray *
+spl_list_cached(GError **error_r);
+
 GPtrArray *
 spl_load(const char *utf8path, GError **error_r);
 
+/**
+ * Like spl_load(), but consults the in-memory cache first, so
+ * repeated reads of the same playlist do not parse the file over and
+ * over.  The returned list is owned by the cache; the caller must not
+ * modify or free it, and it is valid only until the next stored
+ * playlist operation.
+ */
+const GPtrArray *
+spl_load_cached(const char *utf8path, GError **error_r);
+
 void
 spl_free(GPtrArray *list);
 
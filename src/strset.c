@@ -24,20 +24,37 @@
 #include <string.h>
 #include <stdlib.h>
 
-#define NUM_SLOTS 16384
+/**
+ * The initial table capacity; must be a power of two.  The table is
+ * doubled when it becomes 3/4 full, so small "list" results stay
+ * small and large ones never degrade into long probe chains.
+ */
+#define INITIAL_CAPACITY 1024
 
-struct strset_slot {
-	struct strset_slot *next;
+struct strset_bucket {
+	/** NULL means the bucket is empty */
 	const char *value;
+
+	/** the cached hash of value, to avoid re-hashing during
+	    growth and to skip most strcmp() calls while probing */
+	unsigned hash;
 };
 
 struct strset {
 	unsigned size;
 
-	struct strset_slot *current_slot;
-	unsigned next_slot;
+	/** the table capacity minus one; the capacity is a power of
+	    two, so this doubles as the index bit mask */
+	unsigned mask;
+
+	/** grow the table when size exceeds this */
+	unsigned threshold;
+
+	/** open-addressing table with linear probing */
+	struct strset_bucket *buckets;
 
-	struct strset_slot slots[NUM_SLOTS];
+	/** the current position of the iterator */
+	unsigned next_bucket;
 };
 
 static unsigned calc_hash(const char *p) {
@@ -51,70 +68,97 @@ static unsigned calc_hash(const char *p) {
 	return hash;
 }
 
-G_GNUC_MALLOC struct strset *strset_new(void)
+/**
+ * Returns the bucket containing the value, or the empty bucket where
+ * it would be inserted.  Most candidates are rejected by the hash
+ * comparison; strings added via the tag pool are usually the very
+ * same pointer, which skips the strcmp() as well.
+ */
+static struct strset_bucket *
+strset_find(struct strset_bucket *buckets, unsigned mask,
+	    unsigned hash, const char *value)
 {
-	struct strset *set = g_new0(struct strset, 1);
-	return set;
+	for (unsigned i = hash & mask;; i = (i + 1) & mask) {
+		struct strset_bucket *b = &buckets[i];
+
+		if (b->value == NULL ||
+		    (b->hash == hash &&
+		     (b->value == value ||
+		      strcmp(b->value, value) == 0)))
+			return b;
+	}
 }
 
-void strset_free(struct strset *set)
+static void
+strset_grow(struct strset *set)
 {
-	unsigned i;
+	unsigned old_capacity = set->mask + 1;
+	unsigned new_capacity = old_capacity * 2;
+	struct strset_bucket *new_buckets =
+		g_new0(struct strset_bucket, new_capacity);
+	unsigned new_mask = new_capacity - 1;
+
+	for (unsigned i = 0; i < old_capacity; ++i) {
+		const struct strset_bucket *b = &set->buckets[i];
+
+		if (b->value == NULL)
+			continue;
 
-	for (i = 0; i < NUM_SLOTS; ++i) {
-		struct strset_slot *slot = set->slots[i].next, *next;
+		/* all values are unique already - probe for an empty
+		   bucket only */
+		unsigned j = b->hash & new_mask;
+		while (new_buckets[j].value != NULL)
+			j = (j + 1) & new_mask;
 
-		while (slot != NULL) {
-			next = slot->next;
-			g_free(slot);
-			slot = next;
-		}
+		new_buckets[j] = *b;
 	}
 
+	g_free(set->buckets);
+	set->buckets = new_buckets;
+	set->mask = new_mask;
+	set->threshold = new_capacity / 4 * 3;
+}
+
+G_GNUC_MALLOC struct strset *strset_new(void)
+{
+	struct strset *set = g_new0(struct strset, 1);
+
+	set->buckets = g_new0(struct strset_bucket, INITIAL_CAPACITY);
+	set->mask = INITIAL_CAPACITY - 1;
+	set->threshold = INITIAL_CAPACITY / 4 * 3;
+	return set;
+}
+
+void strset_free(struct strset *set)
+{
+	g_free(set->buckets);
 	g_free(set);
 }
 
 void strset_add(struct strset *set, const char *value)
 {
-	struct strset_slot *base_slot
-		= &set->slots[calc_hash(value) % NUM_SLOTS];
-	struct strset_slot *slot = base_slot;
-
-	if (base_slot->value == NULL) {
-		/* empty slot - put into base_slot */
-		assert(base_slot->next == NULL);
+	unsigned hash = calc_hash(value);
+	struct strset_bucket *b =
+		strset_find(set->buckets, set->mask, hash, value);
 
-		base_slot->value = value;
-		++set->size;
+	if (b->value != NULL)
+		/* found it - do nothing */
 		return;
-	}
 
-	for (slot = base_slot; slot != NULL; slot = slot->next)
-		if (strcmp(slot->value, value) == 0)
-			/* found it - do nothing */
-			return;
-
-	/* insert it into the slot chain */
-	slot = g_new(struct strset_slot, 1);
-	slot->next = base_slot->next;
-	slot->value = value;
-	base_slot->next = slot;
-	++set->size;
+	b->value = value;
+	b->hash = hash;
+
+	if (++set->size > set->threshold)
+		strset_grow(set);
 }
 
 int strset_get(const struct strset *set, const char *value)
 {
-	const struct strset_slot *slot = &set->slots[calc_hash(value)];
-
-	if (slot->value == NULL)
-		return 0;
-
-	for (slot = slot->next; slot != NULL; slot = slot->next)
-		if (strcmp(slot->value, value) == 0)
-			/* found it - do nothing */
-			return 1;
+	const struct strset_bucket *b =
+		strset_find(set->buckets, set->mask,
+			    calc_hash(value), value);
 
-	return 0;
+	return b->value != NULL;
 }
 
 unsigned strset_size(const struct strset *set)
@@ -124,25 +168,18 @@ unsigned strset_size(const struct strset *set)
 
 void strset_rewind(struct strset *set)
 {
-	set->current_slot = NULL;
-	set->next_slot = 0;
+	set->next_bucket = 0;
 }
 
 const char *strset_next(struct strset *set)
 {
-	if (set->current_slot != NULL && set->current_slot->next != NULL) {
-		set->current_slot = set->current_slot->next;
-		return set->current_slot->value;
-	}
-
-	while (set->next_slot < NUM_SLOTS &&
-	       set->slots[set->next_slot].value == NULL)
-		++set->next_slot;
+	while (set->next_bucket <= set->mask) {
+		const struct strset_bucket *b =
+			&set->buckets[set->next_bucket++];
 
-	if (set->next_slot >= NUM_SLOTS)
-		return NULL;
+		if (b->value != NULL)
+			return b->value;
+	}
 
-	set->current_slot = &set->slots[set->next_slot++];
-	return set->current_slot->value;
+	return NULL;
 }
-
@@ -21,6 +21,8 @@
 #include "tag.h"
 #include "tag_internal.h"
 #include "tag_pool.h"
+#include "utf8_check.h"
+#include "db_arena.h"
 #include "conf.h"
 #include "song.h"
 #include "mpd_error.h"
@@ -155,28 +157,62 @@ void tag_lib_init(void)
 
 struct tag *tag_new(void)
 {
-	struct tag *ret = g_new(struct tag, 1);
+	bool pooled = db_arena_is_active();
+	struct tag *ret = pooled
+		? db_arena_alloc(sizeof(*ret))
+		: g_new(struct tag, 1);
 	ret->items = NULL;
 	ret->time = -1;
+	refcount_init(&ret->ref);
 	ret->has_playlist = false;
+	ret->pooled = pooled;
 	ret->num_items = 0;
 	return ret;
 }
 
+struct tag *
+tag_ref(struct tag *tag)
+{
+	assert(tag != NULL);
+	assert(!tag->pooled);
+
+	refcount_inc(&tag->ref);
+	return tag;
+}
+
+void
+tag_alloc_items(struct tag *tag, unsigned num_items)
+{
+	assert(tag != NULL);
+	assert(tag->items == NULL);
+	assert(tag->num_items == 0);
+
+	if (num_items == 0)
+		return;
+
+	tag->num_items = num_items;
+	tag->items = tag->pooled
+		? db_arena_alloc(items_size(tag))
+		: g_malloc(items_size(tag));
+}
+
 static void tag_delete_item(struct tag *tag, unsigned idx)
 {
 	assert(idx < tag->num_items);
 	tag->num_items--;
 
-	g_mutex_lock(tag_pool_lock);
 	tag_pool_put_item(tag->items[idx]);
-	g_mutex_unlock(tag_pool_lock);
 
 	if (tag->num_items - idx > 0) {
 		memmove(tag->items + idx, tag->items + idx + 1,
 			(tag->num_items - idx) * sizeof(tag->items[0]));
 	}
 
+	if (tag->pooled)
+		/* the array lives in the arena and cannot be
+		   reallocated; just leave the unused slot behind */
+		return;
+
 	if (tag->num_items > 0) {
 		tag->items = g_realloc(tag->items, items_size(tag));
 	} else {
@@ -202,20 +238,25 @@ void tag_free(struct tag *tag)
 
 	assert(tag != NULL);
 
-	g_mutex_lock(tag_pool_lock);
+	if (!tag->pooled && !refcount_dec(&tag->ref))
+		/* there are still references to this tag */
+		return;
+
 	for (i = tag->num_items; --i >= 0; )
 		tag_pool_put_item(tag->items[i]);
-	g_mutex_unlock(tag_pool_lock);
 
 	if (tag->items == bulk.items) {
 #ifndef NDEBUG
 		assert(bulk.busy);
 		bulk.busy = false;
 #endif
-	} else
+	} else if (!tag->pooled)
 		g_free(tag->items);
 
-	g_free(tag);
+	if (!tag->pooled)
+		g_free(tag);
+	/* else: the arena memory is released in one sweep by
+	   db_arena_free() */
 }
 
 struct tag *tag_dup(const struct tag *tag)
@@ -228,13 +269,10 @@ struct tag *tag_dup(const struct tag *tag)
 	ret = tag_new();
 	ret->time = tag->time;
 	ret->has_playlist = tag->has_playlist;
-	ret->num_items = tag->num_items;
-	ret->items = ret->num_items > 0 ? g_malloc(items_size(tag)) : NULL;
+	tag_alloc_items(ret, tag->num_items);
 
-	g_mutex_lock(tag_pool_lock);
 	for (unsigned i = 0; i < tag->num_items; i++)
 		ret->items[i] = tag_pool_dup_item(tag->items[i]);
-	g_mutex_unlock(tag_pool_lock);
 
 	return ret;
 }
@@ -252,10 +290,7 @@ tag_merge(const struct tag *base, const struct tag *add)
 
 	ret = tag_new();
 	ret->time = add->time > 0 ? add->time : base->time;
-	ret->num_items = base->num_items + add->num_items;
-	ret->items = ret->num_items > 0 ? g_malloc(items_size(ret)) : NULL;
-
-	g_mutex_lock(tag_pool_lock);
+	tag_alloc_items(ret, base->num_items + add->num_items);
 
 	/* copy all items from "add" */
 
@@ -270,8 +305,6 @@ tag_merge(const struct tag *base, const struct tag *add)
 		if (!tag_has_type(add, base->items[i]->type))
 			ret->items[n++] = tag_pool_dup_item(base->items[i]);
 
-	g_mutex_unlock(tag_pool_lock);
-
 	assert(n <= ret->num_items);
 
 	if (n < ret->num_items) {
@@ -279,7 +312,8 @@ tag_merge(const struct tag *base, const struct tag *add)
 		assert(n > 0);
 
 		ret->num_items = n;
-		ret->items = g_realloc(ret->items, items_size(ret));
+		if (!ret->pooled)
+			ret->items = g_realloc(ret->items, items_size(ret));
 	}
 
 	return ret;
@@ -355,7 +389,7 @@ patch_utf8(const char *src, size_t length, const gchar *end)
 
 	do {
 		dest[end - src] = '?';
-	} while (!g_utf8_validate(end + 1, (src + length) - (end + 1), &end));
+	} while (!utf8_check(end + 1, (src + length) - (end + 1), &end));
 
 	return dest;
 }
@@ -370,7 +404,7 @@ fix_utf8(const char *str, size_t length)
 	assert(str != NULL);
 
 	/* check if the string is already valid UTF-8 */
-	if (g_utf8_validate(str, length, &end))
+	if (utf8_check(str, length, &end))
 		return NULL;
 
 	/* no, it's not - try to import it from ISO-Latin-1 */
@@ -406,10 +440,20 @@ void tag_end_add(struct tag *tag)
 		if (tag->num_items > 0) {
 			/* copy the tag items from the bulk list over
 			   to a new list (which fits exactly) */
-			tag->items = g_malloc(items_size(tag));
+			tag->items = tag->pooled
+				? db_arena_alloc(items_size(tag))
+				: g_malloc(items_size(tag));
 			memcpy(tag->items, bulk.items, items_size(tag));
 		} else
 			tag->items = NULL;
+	} else if (tag->pooled && tag->num_items > 0) {
+		/* the bulk list overflowed and the items were moved
+		   to the heap; move them into the arena now that the
+		   final size is known */
+		struct tag_item **items = db_arena_alloc(items_size(tag));
+		memcpy(items, tag->items, items_size(tag));
+		g_free(tag->items);
+		tag->items = items;
 	}
 
 #ifndef NDEBUG
@@ -475,25 +519,47 @@ fix_tag_value(const char *p, size_t length)
 	return cleared;
 }
 
+static struct tag_item *
+tag_intern_item(enum tag_type type, const char *value, size_t len)
+{
+	char *p = NULL;
+
+	/* a value which is interned already was validated and fixed
+	   when it was first added; skip the UTF-8 check for it */
+	struct tag_item *item = tag_pool_lookup_item(type, value, len);
+	if (item == NULL) {
+		p = fix_tag_value(value, len);
+		if (p != NULL) {
+			value = p;
+			len = strlen(value);
+		}
+
+		item = tag_pool_get_item(type, value, len);
+	}
+
+	g_free(p);
+	return item;
+}
+
 static void
 tag_add_item_internal(struct tag *tag, enum tag_type type,
 		      const char *value, size_t len)
 {
 	unsigned int i = tag->num_items;
-	char *p;
-
-	p = fix_tag_value(value, len);
-	if (p != NULL) {
-		value = p;
-		len = strlen(value);
-	}
 
 	tag->num_items++;
 
-	if (tag->items != bulk.items)
+	if (tag->items != bulk.items) {
 		/* bulk mode disabled */
+#ifndef NDEBUG
+		/* a pooled items array lives in the arena and must
+		   not be reallocated; a pooled tag may only grow
+		   while its bulk overflow list (which is on the
+		   heap) is active */
+		assert(!tag->pooled || bulk.busy);
+#endif
 		tag->items = g_realloc(tag->items, items_size(tag));
-	else if (tag->num_items >= BULK_MAX) {
+	} else if (tag->num_items >= BULK_MAX) {
 		/* bulk list already full - switch back to non-bulk */
 		assert(bulk.busy);
 
@@ -502,11 +568,7 @@ tag_add_item_internal(struct tag *tag, enum tag_type type,
 		       items_size(tag) - sizeof(struct tag_item *));
 	}
 
-	g_mutex_lock(tag_pool_lock);
-	tag->items[i] = tag_pool_get_item(type, value, len);
-	g_mutex_unlock(tag_pool_lock);
-
-	g_free(p);
+	tag->items[i] = tag_intern_item(type, value, len);
 }
 
 void tag_add_item_n(struct tag *tag, enum tag_type type,
@@ -521,3 +583,47 @@ void tag_add_item_n(struct tag *tag, enum tag_type type,
 
 	tag_add_item_internal(tag, type, value, len);
 }
+
+static bool
+tag_scan_item_valid(const struct tag_scan_item *item)
+{
+	return !ignore_tag_items[item->type] &&
+		item->value != NULL && item->length > 0;
+}
+
+void
+tag_add_items_n(struct tag *tag, const struct tag_scan_item *items,
+		unsigned n)
+{
+	if (tag->items == bulk.items) {
+		/* bulk mode: the fixed-size array and its overflow
+		   handling live in tag_add_item_internal() */
+		for (unsigned k = 0; k < n; ++k)
+			tag_add_item_n(tag, items[k].type,
+				       items[k].value, items[k].length);
+		return;
+	}
+
+	unsigned n_valid = 0;
+	for (unsigned k = 0; k < n; ++k)
+		if (tag_scan_item_valid(&items[k]))
+			++n_valid;
+
+	if (n_valid == 0)
+		return;
+
+#ifndef NDEBUG
+	/* see tag_add_item_internal() */
+	assert(!tag->pooled || bulk.busy);
+#endif
+
+	unsigned i = tag->num_items;
+	tag->num_items += n_valid;
+	tag->items = g_realloc(tag->items, items_size(tag));
+
+	for (unsigned k = 0; k < n; ++k)
+		if (tag_scan_item_valid(&items[k]))
+			tag->items[i++] = tag_intern_item(items[k].type,
+							  items[k].value,
+							  items[k].length);
+}
@@ -21,6 +21,7 @@
 #define MPD_TAG_H
 
 #include "gcc.h"
+#include "refcount.h"
 
 #include <stdint.h>
 #include <stddef.h>
@@ -89,16 +90,30 @@ struct tag {
 	int time;
 
 	/**
-	 * Does this file have an embedded playlist (e.g. embedded CUE
-	 * sheet)?
+	 * The reference counter; see tag_ref().  Not used for arena
+	 * tags, which are released in one sweep.
 	 */
-	bool has_playlist;
+	struct refcount ref;
 
 	/** an array of tag items */
 	struct tag_item **items;
 
 	/** the total number of tag items in the #items array */
 	unsigned num_items;
+
+	/**
+	 * Does this file have an embedded playlist (e.g. embedded CUE
+	 * sheet)?
+	 */
+	bool has_playlist;
+
+	/**
+	 * Was this object allocated from the database arena (see
+	 * db_arena_begin())?  If so, tag_free() releases the tag
+	 * items, but does not free the memory - that is done in one
+	 * sweep by db_arena_free().
+	 */
+	bool pooled;
 };
 
 /**
@@ -122,6 +137,15 @@ tag_name_parse_i(const char *name);
  */
 struct tag *tag_new(void);
 
+/**
+ * Allocates the items array of a #tag and sets #num_items, without
+ * filling in the item pointers; that is left to the caller.  This is
+ * a helper for loaders which obtain their items directly from the tag
+ * pool, and it is aware of the database arena.
+ */
+void
+tag_alloc_items(struct tag *tag, unsigned num_items);
+
 /**
  * Initializes the tag library.
  */
@@ -133,7 +157,20 @@ void tag_lib_init(void);
 void tag_clear_items_by_type(struct tag *tag, enum tag_type type);
 
 /**
- * Frees a #tag object and all its items.
+ * Adds a reference to the tag, so it can be shared without copying
+ * it.  Call tag_free() once for each reference; the object is
+ * deallocated when the last one is gone.  The tag must not be
+ * modified while it is shared.  Must not be used on database (arena)
+ * tags.
+ *
+ * @return the tag object, for convenience
+ */
+struct tag *
+tag_ref(struct tag *tag);
+
+/**
+ * Drops a reference to a #tag object; frees the object and all its
+ * items when the last reference is gone.
  */
 void tag_free(struct tag *tag);
 
@@ -162,6 +199,27 @@ void tag_end_add(struct tag *tag);
 void tag_add_item_n(struct tag *tag, enum tag_type type,
 		    const char *value, size_t len);
 
+/**
+ * One entry of a batched tag delivery, see tag_add_items_n().
+ */
+struct tag_scan_item {
+	enum tag_type type;
+
+	/** the value; must be null-terminated, #length is just the
+	    known string length */
+	const char *value;
+
+	size_t length;
+};
+
+/**
+ * Appends a batch of tag items with one call.  Grows the item array
+ * only once, instead of once per item.
+ */
+void
+tag_add_items_n(struct tag *tag, const struct tag_scan_item *items,
+		unsigned n);
+
 /**
  * Appends a new tag item.
  *
@@ -74,30 +74,21 @@ tag_ape_import_item(unsigned long flags,
 	}
 }
 
-struct tag_ape_ctx {
-	const struct tag_handler *handler;
-	void *handler_ctx;
-};
-
-static bool
-tag_ape_callback(unsigned long flags, const char *key,
-		 const char *value, size_t value_length, void *_ctx)
-{
-	struct tag_ape_ctx *ctx = _ctx;
-
-	tag_ape_import_item(flags, key, value, value_length,
-			    ctx->handler, ctx->handler_ctx);
-	return true;
-}
-
 bool
 tag_ape_scan2(const char *path_fs,
 	      const struct tag_handler *handler, void *handler_ctx)
 {
-	struct tag_ape_ctx ctx = {
-		.handler = handler,
-		.handler_ctx = handler_ctx,
-	};
+	struct ape_tag *tag = ape_tag_get(path_fs);
+	if (tag == NULL)
+		return false;
 
-	return tag_ape_scan(path_fs, tag_ape_callback, &ctx);
+	for (unsigned i = 0; i < ape_tag_count(tag); ++i) {
+		const struct ape_item *item = ape_tag_item(tag, i);
+		tag_ape_import_item(item->flags, item->key,
+				    item->value, item->value_length,
+				    handler, handler_ctx);
+	}
+
+	ape_tag_unref(tag);
+	return true;
 }
@@ -23,6 +23,7 @@
 #include "decoder_list.h"
 #include "decoder_plugin.h"
 #include "input_stream.h"
+#include "input/limit_input_plugin.h"
 
 #include <assert.h>
 #include <unistd.h> /* for SEEK_SET */
@@ -66,11 +67,20 @@ tag_file_scan(const char *path_fs,
 						       NULL);
 			}
 
-			/* now try the stream_tag() method */
+			/* now try the stream_tag() method, bounding
+			   the read I/O to the plugin's declared
+			   budget */
 			if (is != NULL) {
-				if (decoder_plugin_scan_stream(plugin, is,
-							       handler,
-							       handler_ctx))
+				struct input_stream *limit =
+					input_limit_open(is,
+							 plugin->scan_read_limit);
+				bool success =
+					decoder_plugin_scan_stream(plugin, limit,
+								   handler,
+								   handler_ctx);
+				input_stream_close(limit);
+
+				if (success)
 					break;
 
 				input_stream_lock_seek(is, 0, SEEK_SET, NULL);
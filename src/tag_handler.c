@@ -38,9 +38,18 @@ add_tag_tag(enum tag_type type, const char *value, void *ctx)
 	tag_add_item(tag, type, value);
 }
 
+static void
+add_tag_tags(const struct tag_scan_item *items, unsigned n, void *ctx)
+{
+	struct tag *tag = ctx;
+
+	tag_add_items_n(tag, items, n);
+}
+
 const struct tag_handler add_tag_handler = {
 	.duration = add_tag_duration,
 	.tag = add_tag_tag,
+	.tags = add_tag_tags,
 };
 
 static void
@@ -56,5 +65,6 @@ const struct tag_handler full_tag_handler = {
 	.duration = add_tag_duration,
 	.tag = add_tag_tag,
 	.pair = full_tag_pair,
+	.tags = add_tag_tags,
 };
 
@@ -49,6 +49,15 @@ struct tag_handler {
 	 * representation of tags.
 	 */
 	void (*pair)(const char *key, const char *value, void *ctx);
+
+	/**
+	 * A batch of tags has been read.  Optional; scanners use
+	 * tag_handler_invoke_tags(), which falls back to one tag()
+	 * call per item.  The pointers become invalid after
+	 * returning.
+	 */
+	void (*tags)(const struct tag_scan_item *items, unsigned n,
+		     void *ctx);
 };
 
 static inline void
@@ -73,6 +82,27 @@ tag_handler_invoke_tag(const struct tag_handler *handler, void *ctx,
 		handler->tag(type, value, ctx);
 }
 
+/**
+ * Delivers a batch of tags with one call, if the handler supports
+ * it; falls back to per-item delivery otherwise.  The values must be
+ * null-terminated.
+ */
+static inline void
+tag_handler_invoke_tags(const struct tag_handler *handler, void *ctx,
+			const struct tag_scan_item *items, unsigned n)
+{
+	assert(handler != NULL);
+
+	if (handler->tags != NULL) {
+		handler->tags(items, n, ctx);
+		return;
+	}
+
+	for (unsigned i = 0; i < n; ++i)
+		tag_handler_invoke_tag(handler, ctx,
+				       items[i].type, items[i].value);
+}
+
 static inline void
 tag_handler_invoke_pair(const struct tag_handler *handler, void *ctx,
 			const char *name, const char *value)
@@ -24,6 +24,8 @@
 #include "tag.h"
 #include "riff.h"
 #include "aiff.h"
+#include "tag_rva2.h"
+#include "replay_gain_info.h"
 #include "conf.h"
 
 #include <glib.h>
@@ -114,8 +116,9 @@ import_id3_string(bool is_id3v1, const id3_ucs4_t *ucs4)
 		}
 	}
 
-	utf8_stripped = (id3_utf8_t *)g_strdup(g_strstrip((gchar *)utf8));
-	g_free(utf8);
+	/* strip in place; g_strchug() moves the string to the front
+	   of the allocation, so the result can still be freed */
+	utf8_stripped = (id3_utf8_t *)g_strstrip((gchar *)utf8);
 
 	return utf8_stripped;
 }
@@ -393,6 +396,34 @@ struct tag *tag_id3_import(struct id3_tag * tag)
 	return ret;
 }
 
+/**
+ * A growable scratch buffer which is reused for all tag blocks read
+ * from one file, so that scanning a file does not allocate and free a
+ * separate buffer for every id3_tag_query() hit.
+ */
+struct id3_scratch {
+	id3_byte_t *data;
+	size_t capacity;
+};
+
+static id3_byte_t *
+id3_scratch_get(struct id3_scratch *scratch, size_t size)
+{
+	if (size > scratch->capacity) {
+		/* no need to preserve the old contents */
+		g_free(scratch->data);
+
+		if (scratch->capacity == 0)
+			scratch->capacity = 8192;
+		while (scratch->capacity < size)
+			scratch->capacity <<= 1;
+
+		scratch->data = g_malloc(scratch->capacity);
+	}
+
+	return scratch->data;
+}
+
 static int
 fill_buffer(void *buf, size_t size, FILE *stream, long offset, int whence)
 {
@@ -412,9 +443,9 @@ get_id3v2_footer_size(FILE *stream, long offset, int whence)
 }
 
 static struct id3_tag *
-tag_id3_read(FILE *stream, long offset, int whence)
+tag_id3_read(FILE *stream, struct id3_scratch *scratch,
+	     long offset, int whence)
 {
-	struct id3_tag *tag;
 	id3_byte_t query_buffer[ID3_TAG_QUERYSIZE];
 	id3_byte_t *tag_buffer;
 	int tag_size;
@@ -430,32 +461,25 @@ tag_id3_read(FILE *stream, long offset, int whence)
 	tag_size = id3_tag_query(query_buffer, query_buffer_size);
 	if (tag_size <= 0) return NULL;
 
-	/* Found a tag.  Allocate a buffer and read it in. */
-	tag_buffer = g_malloc(tag_size);
-	if (!tag_buffer) return NULL;
+	/* Found a tag.  Read it into the scratch buffer. */
+	tag_buffer = id3_scratch_get(scratch, tag_size);
 
 	tag_buffer_size = fill_buffer(tag_buffer, tag_size, stream, offset, whence);
-	if (tag_buffer_size < tag_size) {
-		g_free(tag_buffer);
+	if (tag_buffer_size < tag_size)
 		return NULL;
-	}
 
-	tag = id3_tag_parse(tag_buffer, tag_buffer_size);
-
-	g_free(tag_buffer);
-
-	return tag;
+	return id3_tag_parse(tag_buffer, tag_buffer_size);
 }
 
 static struct id3_tag *
-tag_id3_find_from_beginning(FILE *stream)
+tag_id3_find_from_beginning(FILE *stream, struct id3_scratch *scratch)
 {
 	struct id3_tag *tag;
 	struct id3_tag *seektag;
 	struct id3_frame *frame;
 	int seek;
 
-	tag = tag_id3_read(stream, 0, SEEK_SET);
+	tag = tag_id3_read(stream, scratch, 0, SEEK_SET);
 	if (!tag) {
 		return NULL;
 	} else if (tag_is_id3v1(tag)) {
@@ -472,7 +496,7 @@ tag_id3_find_from_beginning(FILE *stream)
 			break;
 
 		/* Get the tag specified by the SEEK frame */
-		seektag = tag_id3_read(stream, seek, SEEK_CUR);
+		seektag = tag_id3_read(stream, scratch, seek, SEEK_CUR);
 		if (!seektag || tag_is_id3v1(seektag))
 			break;
 
@@ -485,14 +509,14 @@ tag_id3_find_from_beginning(FILE *stream)
 }
 
 static struct id3_tag *
-tag_id3_find_from_end(FILE *stream)
+tag_id3_find_from_end(FILE *stream, struct id3_scratch *scratch)
 {
 	struct id3_tag *tag;
 	struct id3_tag *v1tag;
 	int tagsize;
 
 	/* Get an id3v1 tag from the end of file for later use */
-	v1tag = tag_id3_read(stream, -128, SEEK_END);
+	v1tag = tag_id3_read(stream, scratch, -128, SEEK_END);
 
 	/* Get the id3v2 tag size from the footer (located before v1tag) */
 	tagsize = get_id3v2_footer_size(stream, (v1tag ? -128 : 0) - 10, SEEK_END);
@@ -500,7 +524,7 @@ tag_id3_find_from_end(FILE *stream)
 		return v1tag;
 
 	/* Get the tag which the footer belongs to */
-	tag = tag_id3_read(stream, tagsize, SEEK_CUR);
+	tag = tag_id3_read(stream, scratch, tagsize, SEEK_CUR);
 	if (!tag)
 		return v1tag;
 
@@ -511,12 +535,11 @@ tag_id3_find_from_end(FILE *stream)
 }
 
 static struct id3_tag *
-tag_id3_riff_aiff_load(FILE *file)
+tag_id3_riff_aiff_load(FILE *file, struct id3_scratch *scratch)
 {
 	size_t size;
 	void *buffer;
 	size_t ret;
-	struct id3_tag *tag;
 
 	size = riff_seek_id3(file);
 	if (size == 0)
@@ -528,17 +551,14 @@ tag_id3_riff_aiff_load(FILE *file)
 		/* too large, don't allocate so much memory */
 		return NULL;
 
-	buffer = g_malloc(size);
+	buffer = id3_scratch_get(scratch, size);
 	ret = fread(buffer, size, 1, file);
 	if (ret != 1) {
 		g_warning("Failed to read RIFF chunk");
-		g_free(buffer);
 		return NULL;
 	}
 
-	tag = id3_tag_parse(buffer, size);
-	g_free(buffer);
-	return tag;
+	return id3_tag_parse(buffer, size);
 }
 
 bool
@@ -547,6 +567,7 @@ tag_id3_scan(const char *path_fs,
 {
 	struct id3_tag *tag;
 	FILE *stream;
+	struct id3_scratch scratch = { .data = NULL, .capacity = 0 };
 
 	stream = fopen(path_fs, "rb");
 	if (!stream) {
@@ -555,13 +576,14 @@ tag_id3_scan(const char *path_fs,
 		return false;
 	}
 
-	tag = tag_id3_find_from_beginning(stream);
+	tag = tag_id3_find_from_beginning(stream, &scratch);
 	if (tag == NULL)
-		tag = tag_id3_riff_aiff_load(stream);
+		tag = tag_id3_riff_aiff_load(stream, &scratch);
 	if (!tag)
-		tag = tag_id3_find_from_end(stream);
+		tag = tag_id3_find_from_end(stream, &scratch);
 
 	fclose(stream);
+	g_free(scratch.data);
 
 	if (!tag)
 		return false;
@@ -570,3 +592,72 @@ tag_id3_scan(const char *path_fs,
 	id3_tag_delete(tag);
 	return true;
 }
+
+bool
+tag_id3_parse_replay_gain(struct id3_tag *tag, struct replay_gain_info *info)
+{
+	bool found = false;
+
+	replay_gain_info_init(info);
+
+	struct id3_frame *frame;
+	for (unsigned i = 0;
+	     (frame = id3_tag_findframe(tag, "TXXX", i)) != NULL; ++i) {
+		if (frame->nfields < 3)
+			continue;
+
+		char *key = (char *)
+			id3_ucs4_latin1duplicate(id3_field_getstring(&frame->fields[1]));
+		char *value = (char *)
+			id3_ucs4_latin1duplicate(id3_field_getstring(&frame->fields[2]));
+
+		if (g_ascii_strcasecmp(key, "replaygain_track_gain") == 0) {
+			info->tuples[REPLAY_GAIN_TRACK].gain = atof(value);
+			found = true;
+		} else if (g_ascii_strcasecmp(key, "replaygain_album_gain") == 0) {
+			info->tuples[REPLAY_GAIN_ALBUM].gain = atof(value);
+			found = true;
+		} else if (g_ascii_strcasecmp(key, "replaygain_track_peak") == 0) {
+			info->tuples[REPLAY_GAIN_TRACK].peak = atof(value);
+			found = true;
+		} else if (g_ascii_strcasecmp(key, "replaygain_album_peak") == 0) {
+			info->tuples[REPLAY_GAIN_ALBUM].peak = atof(value);
+			found = true;
+		}
+
+		free(key);
+		free(value);
+	}
+
+	return found ||
+		/* fall back on RVA2 if no replaygain tags found */
+		tag_rva2_parse(tag, info);
+}
+
+bool
+tag_id3_replay_gain(const char *path_fs, struct replay_gain_info *info)
+{
+	struct id3_tag *tag;
+	FILE *stream;
+	struct id3_scratch scratch = { .data = NULL, .capacity = 0 };
+
+	stream = fopen(path_fs, "rb");
+	if (!stream)
+		return false;
+
+	tag = tag_id3_find_from_beginning(stream, &scratch);
+	if (tag == NULL)
+		tag = tag_id3_riff_aiff_load(stream, &scratch);
+	if (!tag)
+		tag = tag_id3_find_from_end(stream, &scratch);
+
+	fclose(stream);
+	g_free(scratch.data);
+
+	if (!tag)
+		return false;
+
+	bool found = tag_id3_parse_replay_gain(tag, info);
+	id3_tag_delete(tag);
+	return found;
+}
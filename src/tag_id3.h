@@ -26,6 +26,7 @@
 
 struct tag_handler;
 struct tag;
+struct replay_gain_info;
 
 #ifdef HAVE_ID3TAG
 
@@ -36,6 +37,23 @@ tag_id3_scan(const char *path_fs,
 struct id3_tag;
 struct tag *tag_id3_import(struct id3_tag *);
 
+/**
+ * Extracts replay gain data from the TXXX frames of the given tag,
+ * falling back on RVA2.
+ *
+ * @return true if replay gain data was found
+ */
+bool
+tag_id3_parse_replay_gain(struct id3_tag *tag, struct replay_gain_info *info);
+
+/**
+ * Loads the ID3 tag from a file and extracts its replay gain data.
+ *
+ * @return true if replay gain data was found
+ */
+bool
+tag_id3_replay_gain(const char *path_fs, struct replay_gain_info *info);
+
 #else
 
 #include <glib.h>
@@ -48,6 +66,13 @@ tag_id3_scan(G_GNUC_UNUSED const char *path_fs,
 	return false;
 }
 
+static inline bool
+tag_id3_replay_gain(G_GNUC_UNUSED const char *path_fs,
+		    G_GNUC_UNUSED struct replay_gain_info *info)
+{
+	return false;
+}
+
 #endif
 
 #endif
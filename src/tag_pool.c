@@ -22,12 +22,40 @@
 
 #include <assert.h>
 
-GMutex *tag_pool_lock = NULL;
-
 #define NUM_SLOTS 4096
 
+/* the pool is sharded to reduce contention between the update
+   thread, the decoder thread and the protocol threads; each shard
+   covers a contiguous range of hash slots */
+#define NUM_SHARDS 64
+
+static GStaticMutex tag_pool_shards[NUM_SHARDS] = {
+	[0 ... NUM_SHARDS - 1] = G_STATIC_MUTEX_INIT,
+};
+
+static inline GStaticMutex *
+tag_pool_shard(unsigned hash)
+{
+	return &tag_pool_shards[(hash % NUM_SLOTS) % NUM_SHARDS];
+}
+
 struct slot {
 	struct slot *next;
+
+	/**
+	 * The casefolded form of item.value (g_utf8_casefold()),
+	 * computed once at intern time for case-insensitive
+	 * searches; NULL if it is identical to the value itself.
+	 */
+	char *casefold;
+
+	/**
+	 * A bitmask of hashed byte trigrams of the casefolded value;
+	 * a needle whose trigram bits are not all contained in it
+	 * cannot be a substring.  See tag_pool_trigrams().
+	 */
+	guint64 trigrams;
+
 	unsigned char ref;
 	struct tag_item item;
 } mpd_packed;
@@ -66,11 +94,27 @@ tag_item_to_slot(struct tag_item *item)
 	return (struct slot*)(((char*)item) - offsetof(struct slot, item));
 }
 
+guint64
+tag_pool_trigrams(const char *s)
+{
+	guint64 mask = 0;
+
+	for (; s[0] != 0 && s[1] != 0 && s[2] != 0; ++s) {
+		unsigned hash = ((unsigned char)s[0] * 33u +
+				 (unsigned char)s[1]) * 33u +
+			(unsigned char)s[2];
+		mask |= (guint64)1 << (hash % 64);
+	}
+
+	return mask;
+}
+
 static struct slot *slot_alloc(struct slot *next,
 			       enum tag_type type,
 			       const char *value, int length)
 {
 	struct slot *slot;
+	char *casefold;
 
 	slot = g_malloc(sizeof(*slot) - sizeof(slot->item.value) + length + 1);
 	slot->next = next;
@@ -78,28 +122,42 @@ static struct slot *slot_alloc(struct slot *next,
 	slot->item.type = type;
 	memcpy(slot->item.value, value, length);
 	slot->item.value[length] = 0;
+
+	casefold = g_utf8_casefold(slot->item.value, -1);
+	if (strcmp(casefold, slot->item.value) == 0) {
+		/* already in casefolded form - don't waste memory on
+		   a duplicate */
+		g_free(casefold);
+		casefold = NULL;
+	}
+
+	slot->casefold = casefold;
+	slot->trigrams = tag_pool_trigrams(casefold != NULL
+					   ? casefold : slot->item.value);
+
 	return slot;
 }
 
 void tag_pool_init(void)
 {
-	g_assert(tag_pool_lock == NULL);
-	tag_pool_lock = g_mutex_new();
+	/* nothing to do; the shard mutexes are statically
+	   initialized */
 }
 
 void tag_pool_deinit(void)
 {
-	g_assert(tag_pool_lock != NULL);
-	g_mutex_free(tag_pool_lock);
-	tag_pool_lock = NULL;
 }
 
 struct tag_item *
 tag_pool_get_item(enum tag_type type, const char *value, size_t length)
 {
 	struct slot **slot_p, *slot;
+	unsigned hash = calc_hash_n(type, value, length);
+	GStaticMutex *shard = tag_pool_shard(hash);
+
+	g_static_mutex_lock(shard);
 
-	slot_p = &slots[calc_hash_n(type, value, length) % NUM_SLOTS];
+	slot_p = &slots[hash % NUM_SLOTS];
 	for (slot = *slot_p; slot != NULL; slot = slot->next) {
 		if (slot->item.type == type &&
 		    length == strlen(slot->item.value) &&
@@ -107,34 +165,66 @@ tag_pool_get_item(enum tag_type type, const char *value, size_t length)
 		    slot->ref < 0xff) {
 			assert(slot->ref > 0);
 			++slot->ref;
+			g_static_mutex_unlock(shard);
 			return &slot->item;
 		}
 	}
 
 	slot = slot_alloc(*slot_p, type, value, length);
 	*slot_p = slot;
+	g_static_mutex_unlock(shard);
 	return &slot->item;
 }
 
+struct tag_item *
+tag_pool_lookup_item(enum tag_type type, const char *value, size_t length)
+{
+	struct slot *slot;
+	unsigned hash = calc_hash_n(type, value, length);
+	GStaticMutex *shard = tag_pool_shard(hash);
+
+	g_static_mutex_lock(shard);
+
+	for (slot = slots[hash % NUM_SLOTS]; slot != NULL;
+	     slot = slot->next) {
+		if (slot->item.type == type &&
+		    length == strlen(slot->item.value) &&
+		    memcmp(value, slot->item.value, length) == 0 &&
+		    slot->ref < 0xff) {
+			assert(slot->ref > 0);
+			++slot->ref;
+			g_static_mutex_unlock(shard);
+			return &slot->item;
+		}
+	}
+
+	g_static_mutex_unlock(shard);
+	return NULL;
+}
+
 struct tag_item *tag_pool_dup_item(struct tag_item *item)
 {
 	struct slot *slot = tag_item_to_slot(item);
+	size_t length = strlen(item->value);
+	unsigned hash = calc_hash_n(item->type, item->value, length);
+	GStaticMutex *shard = tag_pool_shard(hash);
+
+	g_static_mutex_lock(shard);
 
 	assert(slot->ref > 0);
 
 	if (slot->ref < 0xff) {
 		++slot->ref;
+		g_static_mutex_unlock(shard);
 		return item;
 	} else {
 		/* the reference counter overflows above 0xff;
 		   duplicate the item, and start with 1 */
-		size_t length = strlen(item->value);
-		struct slot **slot_p =
-			&slots[calc_hash_n(item->type, item->value,
-					   length) % NUM_SLOTS];
+		struct slot **slot_p = &slots[hash % NUM_SLOTS];
 		slot = slot_alloc(*slot_p, item->type,
-				  item->value, strlen(item->value));
+				  item->value, length);
 		*slot_p = slot;
+		g_static_mutex_unlock(shard);
 		return &slot->item;
 	}
 }
@@ -142,20 +232,43 @@ struct tag_item *tag_pool_dup_item(struct tag_item *item)
 void tag_pool_put_item(struct tag_item *item)
 {
 	struct slot **slot_p, *slot;
+	unsigned hash = calc_hash(item->type, item->value);
+	GStaticMutex *shard = tag_pool_shard(hash);
+
+	g_static_mutex_lock(shard);
 
 	slot = tag_item_to_slot(item);
 	assert(slot->ref > 0);
 	--slot->ref;
 
-	if (slot->ref > 0)
+	if (slot->ref > 0) {
+		g_static_mutex_unlock(shard);
 		return;
+	}
 
-	for (slot_p = &slots[calc_hash(item->type, item->value) % NUM_SLOTS];
+	for (slot_p = &slots[hash % NUM_SLOTS];
 	     *slot_p != slot;
 	     slot_p = &(*slot_p)->next) {
 		assert(*slot_p != NULL);
 	}
 
 	*slot_p = slot->next;
+	g_static_mutex_unlock(shard);
+	g_free(slot->casefold);
 	g_free(slot);
 }
+
+const char *
+tag_item_casefold(const struct tag_item *item)
+{
+	const struct slot *slot =
+		tag_item_to_slot((struct tag_item *)item);
+
+	return slot->casefold != NULL ? slot->casefold : item->value;
+}
+
+guint64
+tag_item_trigrams(const struct tag_item *item)
+{
+	return tag_item_to_slot((struct tag_item *)item)->trigrams;
+}
@@ -24,7 +24,9 @@
 
 #include <glib.h>
 
-extern GMutex *tag_pool_lock;
+/* locking is internal to the pool now: the hash slots are sharded
+   over a set of mutexes, so callers no longer serialize on a single
+   global lock */
 
 struct tag_item;
 
@@ -35,8 +37,44 @@ void tag_pool_deinit(void);
 struct tag_item *
 tag_pool_get_item(enum tag_type type, const char *value, size_t length);
 
+/**
+ * Looks up an interned item without inserting one, and increases its
+ * reference counter on success.  Since every value is validated
+ * before it is interned, a hit proves that the value is well-formed,
+ * and the caller may skip the UTF-8 check.
+ *
+ * @return the interned item, or NULL if this value has not been
+ * interned (or its reference counter is saturated)
+ */
+struct tag_item *
+tag_pool_lookup_item(enum tag_type type, const char *value, size_t length);
+
 struct tag_item *tag_pool_dup_item(struct tag_item *item);
 
 void tag_pool_put_item(struct tag_item *item);
 
+/**
+ * Returns the casefolded form (g_utf8_casefold()) of the item's
+ * value, which was computed once when the item was interned.  The
+ * returned string is owned by the pool and lives as long as the
+ * item.
+ */
+const char *
+tag_item_casefold(const struct tag_item *item);
+
+/**
+ * Returns the bitmask of hashed byte trigrams of the item's
+ * casefolded value.  A needle can only be a substring if all of its
+ * own trigram bits (tag_pool_trigrams()) are contained in this mask.
+ */
+guint64
+tag_item_trigrams(const struct tag_item *item);
+
+/**
+ * Computes the trigram bitmask of the given string; see
+ * tag_item_trigrams().
+ */
+guint64
+tag_pool_trigrams(const char *s);
+
 #endif
@@ -37,12 +37,14 @@ void tag_print_types(struct client *client)
 
 void tag_print(struct client *client, const struct tag *tag)
 {
-	if (tag->time >= 0)
-		client_printf(client, SONG_TIME "%i\n", tag->time);
-
-	for (unsigned i = 0; i < tag->num_items; i++) {
-		client_printf(client, "%s: %s\n",
-			      tag_item_names[tag->items[i]->type],
-			      tag->items[i]->value);
+	if (tag->time >= 0) {
+		client_puts(client, SONG_TIME);
+		client_write_int(client, tag->time);
+		client_puts(client, "\n");
 	}
+
+	for (unsigned i = 0; i < tag->num_items; i++)
+		client_write_pair(client,
+				  tag_item_names[tag->items[i]->type],
+				  tag->items[i]->value);
 }
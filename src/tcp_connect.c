@@ -19,6 +19,7 @@
 
 #include "config.h"
 #include "tcp_connect.h"
+#include "resolver_async.h"
 #include "fd_util.h"
 #include "io_thread.h"
 #include "glib_compat.h"
@@ -32,6 +33,7 @@
 #include <winsock.h>
 #else
 #include <sys/socket.h>
+#include <netdb.h>
 #include <unistd.h>
 #endif
 
@@ -249,3 +251,184 @@ tcp_connect_free(struct tcp_connect *c)
 
 	g_free(c);
 }
+
+struct tcp_connect_host {
+	unsigned default_port;
+	unsigned timeout_ms;
+
+	const struct tcp_connect_handler *handler;
+	void *handler_ctx;
+
+	/**
+	 * The pending lookup, or NULL if it has completed.
+	 */
+	struct resolver_async *resolve;
+
+	/**
+	 * The lookup result, and the address currently being tried.
+	 */
+	struct addrinfo *ai, *current;
+
+	/**
+	 * The pending connect attempt, or NULL.
+	 */
+	struct tcp_connect *connect;
+};
+
+static void
+tcp_connect_host_try(struct tcp_connect_host *h);
+
+static void
+tcp_connect_host_success(int fd, void *ctx)
+{
+	struct tcp_connect_host *h = ctx;
+
+	h->handler->success(fd, h->handler_ctx);
+}
+
+static void
+tcp_connect_host_error(GError *error, void *ctx)
+{
+	struct tcp_connect_host *h = ctx;
+
+	if (h->current->ai_next != NULL) {
+		/* this address failed, but there are more: try the
+		   next one */
+		g_error_free(error);
+
+		h->current = h->current->ai_next;
+
+		if (h->connect != NULL) {
+			tcp_connect_free(h->connect);
+			h->connect = NULL;
+		}
+
+		tcp_connect_host_try(h);
+		return;
+	}
+
+	h->handler->error(error, h->handler_ctx);
+}
+
+static void
+tcp_connect_host_timeout(void *ctx)
+{
+	struct tcp_connect_host *h = ctx;
+
+	h->handler->timeout(h->handler_ctx);
+}
+
+static void
+tcp_connect_host_canceled(void *ctx)
+{
+	struct tcp_connect_host *h = ctx;
+
+	h->handler->canceled(h->handler_ctx);
+}
+
+static const struct tcp_connect_handler tcp_connect_host_handler = {
+	.success = tcp_connect_host_success,
+	.error = tcp_connect_host_error,
+	.timeout = tcp_connect_host_timeout,
+	.canceled = tcp_connect_host_canceled,
+};
+
+static void
+tcp_connect_host_try(struct tcp_connect_host *h)
+{
+	assert(h->connect == NULL);
+	assert(h->current != NULL);
+
+	tcp_connect_address(h->current->ai_addr, h->current->ai_addrlen,
+			    h->timeout_ms, &tcp_connect_host_handler, h,
+			    &h->connect);
+}
+
+static void
+tcp_connect_host_resolved(struct addrinfo *ai, void *ctx)
+{
+	struct tcp_connect_host *h = ctx;
+
+	assert(h->resolve != NULL);
+	assert(h->ai == NULL);
+
+	h->resolve = NULL;
+	h->ai = ai;
+	h->current = ai;
+
+	tcp_connect_host_try(h);
+}
+
+static void
+tcp_connect_host_resolve_error(GError *error, void *ctx)
+{
+	struct tcp_connect_host *h = ctx;
+
+	assert(h->resolve != NULL);
+
+	h->resolve = NULL;
+	h->handler->error(error, h->handler_ctx);
+}
+
+static const struct resolver_async_handler tcp_connect_host_resolver_handler = {
+	.success = tcp_connect_host_resolved,
+	.error = tcp_connect_host_resolve_error,
+};
+
+void
+tcp_connect_host(const char *host_port, unsigned default_port,
+		 unsigned timeout_ms,
+		 const struct tcp_connect_handler *handler, void *ctx,
+		 struct tcp_connect_host **handle_r)
+{
+	assert(host_port != NULL);
+	assert(handler != NULL);
+	assert(handler->success != NULL);
+	assert(handler->error != NULL);
+	assert(handler->canceled != NULL);
+	assert(handler->timeout != NULL || timeout_ms == 0);
+	assert(handle_r != NULL);
+	assert(*handle_r == NULL);
+
+	struct tcp_connect_host *h = g_new0(struct tcp_connect_host, 1);
+	h->default_port = default_port;
+	h->timeout_ms = timeout_ms;
+	h->handler = handler;
+	h->handler_ctx = ctx;
+
+	*handle_r = h;
+
+	h->resolve = resolver_async_start(host_port, default_port,
+					  0, SOCK_STREAM,
+					  &tcp_connect_host_resolver_handler,
+					  h);
+}
+
+void
+tcp_connect_host_cancel(struct tcp_connect_host *h)
+{
+	if (h->resolve != NULL) {
+		/* the lookup cannot deliver a result any more; since
+		   no other callback will come, report the
+		   cancellation right away */
+		resolver_async_cancel(h->resolve);
+		h->resolve = NULL;
+
+		h->handler->canceled(h->handler_ctx);
+	} else if (h->connect != NULL)
+		tcp_connect_cancel(h->connect);
+}
+
+void
+tcp_connect_host_free(struct tcp_connect_host *h)
+{
+	assert(h->resolve == NULL);
+
+	if (h->connect != NULL)
+		tcp_connect_free(h->connect);
+
+	if (h->ai != NULL)
+		freeaddrinfo(h->ai);
+
+	g_free(h);
+}
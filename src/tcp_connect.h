@@ -93,4 +93,43 @@ tcp_connect_cancel(struct tcp_connect *handle);
 void
 tcp_connect_free(struct tcp_connect *handle);
 
+struct tcp_connect_host;
+
+/**
+ * Resolve a host name asynchronously (in a worker thread pool, see
+ * resolver_async.h) and establish a TCP connection to the first
+ * address which accepts one, trying each resolved address in turn.
+ * Neither the lookup nor the connect blocks the calling thread; all
+ * handler methods are invoked in the I/O thread.
+ *
+ * The handler semantics are the same as tcp_connect_address(); the
+ * timeout applies to each connect attempt (the lookup itself cannot
+ * be bounded, but never blocks the caller).
+ *
+ * The caller must free this object with tcp_connect_host_free().
+ *
+ * @param host_port a "host", "host:port" or "[host]:port"
+ * specification
+ * @param default_port used when the specification contains no port
+ */
+void
+tcp_connect_host(const char *host_port, unsigned default_port,
+		 unsigned timeout_ms,
+		 const struct tcp_connect_handler *handler, void *ctx,
+		 struct tcp_connect_host **handle_r);
+
+/**
+ * Cancel the operation; see tcp_connect_cancel() for the semantics.
+ * Must be called from the I/O thread.
+ */
+void
+tcp_connect_host_cancel(struct tcp_connect_host *handle);
+
+/**
+ * Free memory used by this object, with the same restrictions as
+ * tcp_connect_free().
+ */
+void
+tcp_connect_host_free(struct tcp_connect_host *handle);
+
 #endif
@@ -26,6 +26,13 @@
 
 #include <string.h>
 
+/**
+ * The size of the read buffer.  Reading from the underlying stream in
+ * large blocks matters for remote playlists: each read may be a
+ * network round trip.
+ */
+#define TEXT_INPUT_BUFFER_SIZE 65536
+
 struct text_input_stream {
 	struct input_stream *is;
 
@@ -40,7 +47,7 @@ text_input_stream_new(struct input_stream *is)
 	struct text_input_stream *tis = g_new(struct text_input_stream, 1);
 
 	tis->is = is;
-	tis->buffer = fifo_buffer_new(4096);
+	tis->buffer = fifo_buffer_new(TEXT_INPUT_BUFFER_SIZE);
 	tis->line = NULL;
 
 	return tis;
@@ -54,43 +61,77 @@ text_input_stream_free(struct text_input_stream *tis)
 	g_free(tis);
 }
 
-const char *
-text_input_stream_read(struct text_input_stream *tis)
+/**
+ * Read the next block from the underlying stream into the buffer.
+ *
+ * @return false if the buffer is full, on error or end of stream
+ */
+static bool
+text_input_stream_fill(struct text_input_stream *tis)
 {
 	GError *error = NULL;
-	void *dest;
-	const char *src, *p;
-	size_t length, nbytes;
 
+	size_t length;
+	void *dest = fifo_buffer_write(tis->buffer, &length);
+	if (dest == NULL)
+		return false;
+
+	size_t nbytes = input_stream_lock_read(tis->is, dest, length, &error);
+	if (nbytes == 0) {
+		if (error != NULL) {
+			g_warning("%s", error->message);
+			g_error_free(error);
+		}
+
+		return false;
+	}
+
+	fifo_buffer_append(tis->buffer, nbytes);
+	return true;
+}
+
+const char *
+text_input_stream_read(struct text_input_stream *tis)
+{
 	g_free(tis->line);
 	tis->line = NULL;
 
-	do {
-		dest = fifo_buffer_write(tis->buffer, &length);
-		if (dest != NULL) {
-			nbytes = input_stream_lock_read(tis->is, dest, length,
-							&error);
-			if (nbytes > 0)
-				fifo_buffer_append(tis->buffer, nbytes);
-			else if (error != NULL) {
-				g_warning("%s", error->message);
-				g_error_free(error);
-				return NULL;
-			}
+	while (true) {
+		size_t length;
+		char *src = (char *)fifo_buffer_read(tis->buffer, &length);
+		char *p = src != NULL
+			? memchr(src, '\n', length)
+			: NULL;
+
+		if (p != NULL) {
+			/* a complete line is already buffered: split
+			   it off in place, without copying and
+			   without touching the (possibly remote)
+			   stream */
+			size_t consume = p - src + 1;
+			while (p > src && g_ascii_isspace(p[-1]))
+				--p;
+			*p = 0;
+
+			fifo_buffer_consume(tis->buffer, consume);
+			return src;
 		}
 
-		src = fifo_buffer_read(tis->buffer, &length);
-		if (src == NULL)
-			return NULL;
+		if (text_input_stream_fill(tis))
+			continue;
 
-		p = memchr(src, '\n', length);
-	} while (p == NULL);
+		/* end of stream, or a line which does not fit into
+		   the buffer: return what we have */
+
+		if (src == NULL || length == 0)
+			return NULL;
 
-	length = p - src + 1;
-	while (p > src && g_ascii_isspace(p[-1]))
-		--p;
+		p = src + length;
+		while (p > src && g_ascii_isspace(p[-1]))
+			--p;
 
-	tis->line = g_strndup(src, p - src);
-	fifo_buffer_consume(tis->buffer, length);
-	return tis->line;
+		tis->line = g_strndup(src, p - src);
+		fifo_buffer_consume(tis->buffer, length);
+		return tis->line;
+	}
 }
@@ -0,0 +1,463 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "threaded_encoder.h"
+#include "encoder_plugin.h"
+#include "fifo_buffer.h"
+#include "growing_fifo.h"
+
+#include <assert.h>
+#include <string.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "threaded_encoder"
+
+/** the maximum number of PCM bytes in the queue; when it is
+    exceeded, threaded_encoder_write() blocks, applying back pressure
+    to the output */
+#define THREADED_ENCODER_MAX_QUEUE (512 * 1024)
+
+/**
+ * An entry of the PCM queue.
+ */
+struct encoder_buffer {
+	size_t size;
+
+	/**
+	 * Dynamic array containing the PCM data.
+	 */
+	gchar data[sizeof(long)];
+};
+
+struct threaded_encoder {
+	struct encoder base;
+
+	/**
+	 * The wrapped encoder.  While the thread is running, it is
+	 * used only by the thread, except when the thread is idle
+	 * (#busy is false and #queue is empty) and the #mutex is
+	 * held.
+	 */
+	struct encoder *next;
+
+	/**
+	 * Protects the following attributes.
+	 */
+	GMutex *mutex;
+	GCond *cond;
+
+	/**
+	 * A queue of #encoder_buffer objects, filled by
+	 * threaded_encoder_write() and consumed by the thread.
+	 */
+	GQueue *queue;
+
+	/**
+	 * The number of PCM bytes in the #queue.
+	 */
+	size_t queue_size;
+
+	/**
+	 * Encoded data, filled by the thread and consumed by
+	 * threaded_encoder_read().
+	 */
+	struct fifo_buffer *output;
+
+	/**
+	 * True while the thread is running the codec on a buffer
+	 * (with the #mutex released).
+	 */
+	bool busy;
+
+	/**
+	 * Tells the thread to exit after it has drained the #queue.
+	 */
+	bool quit;
+
+	/**
+	 * An error which has occurred in the thread.  It is reported
+	 * by the next synchronous method call.
+	 */
+	GError *error;
+
+	GThread *thread;
+};
+
+static const struct encoder_plugin threaded_encoder_plugin;
+
+/**
+ * Copies all pending output of the wrapped encoder into the output
+ * buffer.  The caller must hold the mutex, and must own the wrapped
+ * encoder (see #next).
+ */
+static void
+threaded_encoder_read_next(struct threaded_encoder *te)
+{
+	char buffer[4096];
+	size_t nbytes;
+
+	while ((nbytes = encoder_read(te->next, buffer,
+				      sizeof(buffer))) > 0)
+		growing_fifo_append(&te->output, buffer, nbytes);
+}
+
+static gpointer
+threaded_encoder_task(gpointer arg)
+{
+	struct threaded_encoder *te = arg;
+
+	g_mutex_lock(te->mutex);
+
+	while (true) {
+		struct encoder_buffer *buffer = g_queue_pop_head(te->queue);
+
+		if (buffer == NULL) {
+			/* the queue has been drained: wake up
+			   threads waiting in
+			   threaded_encoder_drain() */
+			g_cond_broadcast(te->cond);
+
+			if (te->quit)
+				break;
+
+			g_cond_wait(te->cond, te->mutex);
+			continue;
+		}
+
+		assert(te->queue_size >= buffer->size);
+		te->queue_size -= buffer->size;
+		te->busy = true;
+
+		/* wake up a thread waiting for queue space */
+		g_cond_broadcast(te->cond);
+
+		if (te->error == NULL) {
+			GError *error = NULL;
+
+			/* release the mutex while the codec runs, so
+			   the output thread can meanwhile queue more
+			   data and read encoded output */
+			g_mutex_unlock(te->mutex);
+
+			bool success = encoder_write(te->next, buffer->data,
+						     buffer->size, &error);
+
+			g_mutex_lock(te->mutex);
+
+			if (success)
+				threaded_encoder_read_next(te);
+			else
+				/* defer the error to the next
+				   synchronous method call */
+				te->error = error;
+		}
+
+		te->busy = false;
+		g_free(buffer);
+	}
+
+	g_mutex_unlock(te->mutex);
+	return NULL;
+}
+
+/**
+ * Waits until the thread has consumed the whole PCM queue and is
+ * idle.  Caller must hold the mutex; on success, the caller owns the
+ * wrapped encoder until the mutex is released.
+ *
+ * @return false if an error has occurred in the thread
+ */
+static bool
+threaded_encoder_drain(struct threaded_encoder *te, GError **error_r)
+{
+	while ((!g_queue_is_empty(te->queue) || te->busy) &&
+	       te->error == NULL)
+		g_cond_wait(te->cond, te->mutex);
+
+	if (te->error != NULL) {
+		g_propagate_error(error_r, te->error);
+		te->error = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+static struct encoder *
+threaded_encoder_init(G_GNUC_UNUSED const struct config_param *param,
+		      G_GNUC_UNUSED GError **error)
+{
+	/* this pseudo plugin is not available through the
+	   configuration; use threaded_encoder_new() instead */
+	assert(false);
+	return NULL;
+}
+
+static void
+threaded_encoder_finish(struct encoder *_encoder)
+{
+	struct threaded_encoder *te = (struct threaded_encoder *)_encoder;
+
+	assert(te->thread == NULL);
+	assert(g_queue_is_empty(te->queue));
+
+	encoder_finish(te->next);
+
+	g_queue_free(te->queue);
+	fifo_buffer_free(te->output);
+	g_cond_free(te->cond);
+	g_mutex_free(te->mutex);
+	g_free(te);
+}
+
+static bool
+threaded_encoder_open(struct encoder *_encoder,
+		      struct audio_format *audio_format,
+		      GError **error)
+{
+	struct threaded_encoder *te = (struct threaded_encoder *)_encoder;
+
+	assert(te->thread == NULL);
+	assert(g_queue_is_empty(te->queue));
+
+	/* the thread is not running yet: no locking required */
+
+	if (!encoder_open(te->next, audio_format, error))
+		return false;
+
+	te->busy = false;
+	te->quit = false;
+
+	te->thread = g_thread_create(threaded_encoder_task, te, true, error);
+	if (te->thread == NULL) {
+		encoder_close(te->next);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+threaded_encoder_close(struct encoder *_encoder)
+{
+	struct threaded_encoder *te = (struct threaded_encoder *)_encoder;
+
+	assert(te->thread != NULL);
+
+	g_mutex_lock(te->mutex);
+	te->quit = true;
+	g_cond_signal(te->cond);
+	g_mutex_unlock(te->mutex);
+
+	g_thread_join(te->thread);
+	te->thread = NULL;
+
+	assert(g_queue_is_empty(te->queue));
+	assert(te->queue_size == 0);
+
+	/* discard encoded data which was never read, and deferred
+	   errors */
+
+	fifo_buffer_clear(te->output);
+
+	if (te->error != NULL) {
+		g_error_free(te->error);
+		te->error = NULL;
+	}
+
+	encoder_close(te->next);
+}
+
+static bool
+threaded_encoder_flush(struct encoder *_encoder, GError **error)
+{
+	struct threaded_encoder *te = (struct threaded_encoder *)_encoder;
+	bool success;
+
+	g_mutex_lock(te->mutex);
+
+	success = threaded_encoder_drain(te, error) &&
+		encoder_flush(te->next, error);
+	if (success)
+		threaded_encoder_read_next(te);
+
+	g_mutex_unlock(te->mutex);
+	return success;
+}
+
+static bool
+threaded_encoder_pre_tag(struct encoder *_encoder, GError **error)
+{
+	struct threaded_encoder *te = (struct threaded_encoder *)_encoder;
+	bool success;
+
+	g_mutex_lock(te->mutex);
+
+	success = threaded_encoder_drain(te, error) &&
+		encoder_pre_tag(te->next, error);
+	if (success)
+		threaded_encoder_read_next(te);
+
+	g_mutex_unlock(te->mutex);
+	return success;
+}
+
+static bool
+threaded_encoder_tag(struct encoder *_encoder, const struct tag *tag,
+		     GError **error)
+{
+	struct threaded_encoder *te = (struct threaded_encoder *)_encoder;
+	bool success;
+
+	g_mutex_lock(te->mutex);
+
+	success = threaded_encoder_drain(te, error) &&
+		encoder_tag(te->next, tag, error);
+	if (success)
+		threaded_encoder_read_next(te);
+
+	g_mutex_unlock(te->mutex);
+	return success;
+}
+
+static bool
+threaded_encoder_write(struct encoder *_encoder,
+		       const void *data, size_t length,
+		       GError **error)
+{
+	struct threaded_encoder *te = (struct threaded_encoder *)_encoder;
+	struct encoder_buffer *buffer;
+
+	g_mutex_lock(te->mutex);
+
+	if (te->error != NULL) {
+		g_propagate_error(error, te->error);
+		te->error = NULL;
+		g_mutex_unlock(te->mutex);
+		return false;
+	}
+
+	/* apply back pressure, so a slow codec does not accumulate
+	   unbounded amounts of PCM data */
+	while (te->queue_size >= THREADED_ENCODER_MAX_QUEUE &&
+	       te->error == NULL)
+		g_cond_wait(te->cond, te->mutex);
+
+	buffer = g_malloc(sizeof(*buffer) - sizeof(buffer->data) + length);
+	buffer->size = length;
+	memcpy(buffer->data, data, length);
+
+	g_queue_push_tail(te->queue, buffer);
+	te->queue_size += length;
+	g_cond_signal(te->cond);
+
+	g_mutex_unlock(te->mutex);
+	return true;
+}
+
+static size_t
+threaded_encoder_read(struct encoder *_encoder, void *dest, size_t length)
+{
+	struct threaded_encoder *te = (struct threaded_encoder *)_encoder;
+	const char *p;
+	size_t available;
+
+	g_mutex_lock(te->mutex);
+
+	p = fifo_buffer_read(te->output, &available);
+	if (p == NULL) {
+		g_mutex_unlock(te->mutex);
+		return 0;
+	}
+
+	if (length > available)
+		length = available;
+
+	memcpy(dest, p, length);
+	fifo_buffer_consume(te->output, length);
+
+	g_mutex_unlock(te->mutex);
+	return length;
+}
+
+static const char *
+threaded_encoder_get_mime_type(struct encoder *_encoder)
+{
+	struct threaded_encoder *te = (struct threaded_encoder *)_encoder;
+
+	return encoder_get_mime_type(te->next);
+}
+
+static const struct encoder_plugin threaded_encoder_plugin = {
+	.name = "threaded",
+	.init = threaded_encoder_init,
+	.finish = threaded_encoder_finish,
+	.open = threaded_encoder_open,
+	.close = threaded_encoder_close,
+	.flush = threaded_encoder_flush,
+	.pre_tag = threaded_encoder_pre_tag,
+	.tag = threaded_encoder_tag,
+	.write = threaded_encoder_write,
+	.read = threaded_encoder_read,
+	.get_mime_type = threaded_encoder_get_mime_type,
+};
+
+/**
+ * A variant without the tag methods, for wrapping encoders which do
+ * not implement them.  Callers inspect encoder_plugin.tag to decide
+ * how to deliver tags, and must see the wrapped encoder's
+ * capability.
+ */
+static const struct encoder_plugin threaded_encoder_notag_plugin = {
+	.name = "threaded",
+	.init = threaded_encoder_init,
+	.finish = threaded_encoder_finish,
+	.open = threaded_encoder_open,
+	.close = threaded_encoder_close,
+	.flush = threaded_encoder_flush,
+	.write = threaded_encoder_write,
+	.read = threaded_encoder_read,
+	.get_mime_type = threaded_encoder_get_mime_type,
+};
+
+struct encoder *
+threaded_encoder_new(struct encoder *next)
+{
+	struct threaded_encoder *te = g_new(struct threaded_encoder, 1);
+
+	assert(next != NULL);
+
+	encoder_struct_init(&te->base,
+			    next->plugin->tag != NULL
+			    ? &threaded_encoder_plugin
+			    : &threaded_encoder_notag_plugin);
+	te->next = next;
+	te->mutex = g_mutex_new();
+	te->cond = g_cond_new();
+	te->queue = g_queue_new();
+	te->queue_size = 0;
+	te->output = growing_fifo_new();
+	te->busy = false;
+	te->quit = false;
+	te->error = NULL;
+	te->thread = NULL;
+
+	return &te->base;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_THREADED_ENCODER_H
+#define MPD_THREADED_ENCODER_H
+
+struct encoder;
+
+/**
+ * Wraps an encoder in a proxy object which runs the real encoder in a
+ * dedicated thread.  encoder_write() only copies the PCM data into a
+ * queue, and encoder_read() only copies already-encoded data out of a
+ * buffer, so the calling (output) thread never blocks on the codec;
+ * with several encoded outputs, their encoders run in parallel.
+ *
+ * encoder_flush(), encoder_pre_tag() and encoder_tag() remain
+ * synchronous: they wait until the thread has caught up with the
+ * queue.
+ *
+ * The proxy takes ownership of the wrapped encoder; it is freed by
+ * encoder_finish() on the proxy.
+ */
+struct encoder *
+threaded_encoder_new(struct encoder *next);
+
+#endif
@@ -20,21 +20,47 @@
 #include "config.h"
 #include "timer.h"
 #include "audio_format.h"
+#include "perf.h"
 
 #include <glib.h>
 
 #include <assert.h>
 #include <limits.h>
-#include <sys/time.h>
 #include <stddef.h>
+#include <sys/time.h>
+
+#ifdef HAVE_CLOCK_GETTIME
+#include <time.h>
+#endif
+
+#ifdef HAVE_TIMERFD_CREATE
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+/* the timerfd code assumes deadlines on the same clock as now() */
+#if defined(HAVE_TIMERFD_CREATE) && defined(HAVE_CLOCK_GETTIME)
+#define USE_TIMERFD
+#endif
 
 static uint64_t now(void)
 {
+#ifdef HAVE_CLOCK_GETTIME
+	/* CLOCK_MONOTONIC: unlike gettimeofday(), it is neither
+	   stepped by ntpd nor by the administrator, which would
+	   otherwise glitch the pacing */
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000) + ts.tv_nsec / 1000;
+#else
 	struct timeval tv;
 
 	gettimeofday(&tv, NULL);
 
 	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+#endif
 }
 
 struct timer *timer_new(const struct audio_format *af)
@@ -44,11 +70,21 @@ struct timer *timer_new(const struct audio_format *af)
 	timer->started = 0;
 	timer->rate = af->sample_rate * audio_format_frame_size(af);
 
+	timer->fd = -1;
+#ifdef USE_TIMERFD
+	timer->fd = timerfd_create(CLOCK_MONOTONIC, 0);
+#endif
+
 	return timer;
 }
 
 void timer_free(struct timer *timer)
 {
+#ifdef USE_TIMERFD
+	if (timer->fd >= 0)
+		close(timer->fd);
+#endif
+
 	g_free(timer);
 }
 
@@ -84,13 +120,56 @@ timer_delay(const struct timer *timer)
 	return delay;
 }
 
-void timer_sync(struct timer *timer)
+/**
+ * Accounts how much too late the wakeup was, for the "timer_jitter"
+ * perfstats counter.
+ */
+static void
+timer_account_jitter(G_GNUC_UNUSED const struct timer *timer)
 {
-	int64_t sleep_duration;
+#ifdef ENABLE_PERF_COUNTERS
+	const uint64_t t = now();
+
+	if (t > timer->time) {
+		++perf_counters[PERF_TIMER_JITTER].calls;
+		perf_counters[PERF_TIMER_JITTER].time_ns +=
+			(t - timer->time) * 1000;
+	}
+#endif
+}
 
+void timer_sync(struct timer *timer)
+{
 	assert(timer->started);
 
-	sleep_duration = timer->time - now();
-	if (sleep_duration > 0)
-		g_usleep(sleep_duration);
+	int64_t sleep_duration = timer->time - now();
+	if (sleep_duration <= 0)
+		return;
+
+#ifdef USE_TIMERFD
+	if (timer->fd >= 0) {
+		/* an absolute timerfd wakeup: since timer->time is
+		   the accumulated ideal deadline (not "now plus
+		   delta"), oversleeping one cycle shortens the next
+		   automatically, and no drift builds up */
+		const struct itimerspec its = {
+			.it_value = {
+				.tv_sec = timer->time / 1000000,
+				.tv_nsec = (timer->time % 1000000) * 1000,
+			},
+		};
+		uint64_t expirations;
+
+		if (timerfd_settime(timer->fd, TFD_TIMER_ABSTIME,
+				    &its, NULL) == 0 &&
+		    read(timer->fd, &expirations,
+			 sizeof(expirations)) == (ssize_t)sizeof(expirations)) {
+			timer_account_jitter(timer);
+			return;
+		}
+	}
+#endif
+
+	g_usleep(sleep_duration);
+	timer_account_jitter(timer);
 }
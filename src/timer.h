@@ -25,9 +25,14 @@
 struct audio_format;
 
 struct timer {
+	/** the absolute deadline [us, CLOCK_MONOTONIC where
+	    available] up to which the submitted data lasts */
 	uint64_t time;
 	int started;
 	int rate;
+
+	/** a timerfd for precise absolute wakeups, or -1 */
+	int fd;
 };
 
 struct timer *timer_new(const struct audio_format *af);
@@ -17,6 +17,13 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include "config.h"
+
+#ifdef HAVE_RECVMMSG
+/* recvmmsg() is a GNU extension */
+#define _GNU_SOURCE 1
+#endif
+
 #include "udp_server.h"
 #include "io_thread.h"
 #include "glib_socket.h"
@@ -24,6 +31,7 @@
 
 #include <glib.h>
 #include <unistd.h>
+#include <string.h>
 #include <sys/time.h>
 #include <errno.h>
 
@@ -41,6 +49,12 @@
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
 #endif
 
+/**
+ * The maximum number of datagrams received and processed in one main
+ * loop dispatch (see recvmmsg(2)).
+ */
+#define UDP_BATCH_SIZE 8
+
 struct udp_server {
 	const struct udp_server_handler *handler;
 	void *handler_ctx;
@@ -49,9 +63,33 @@ struct udp_server {
 	GIOChannel *channel;
 	GSource *source;
 
-	char buffer[8192];
+	char buffer[UDP_BATCH_SIZE][8192];
 };
 
+#ifndef WIN32
+
+/**
+ * Extracts the kernel receive timestamp (SO_TIMESTAMP) from the
+ * control data.  Returns NULL if there is none.
+ */
+static const struct timeval *
+udp_cmsg_timestamp(struct msghdr *msg)
+{
+#ifdef SO_TIMESTAMP
+	for (const struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+	     cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg))
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_TIMESTAMP &&
+		    cmsg->cmsg_len >= CMSG_LEN(sizeof(struct timeval)))
+			return (const struct timeval *)CMSG_DATA(cmsg);
+#else
+	(void)msg;
+#endif
+	return NULL;
+}
+
+#endif
+
 static gboolean
 udp_in_event(G_GNUC_UNUSED GIOChannel *source,
 	     G_GNUC_UNUSED GIOCondition condition,
@@ -59,22 +97,88 @@ udp_in_event(G_GNUC_UNUSED GIOChannel *source,
 {
 	struct udp_server *udp = data;
 
+#ifdef HAVE_RECVMMSG
+	/* receive a whole batch of datagrams with one system call */
+
+	struct mmsghdr msgs[UDP_BATCH_SIZE];
+	struct iovec iovs[UDP_BATCH_SIZE];
+	struct sockaddr_storage addresses[UDP_BATCH_SIZE];
+	union {
+		struct cmsghdr align;
+		char buffer[CMSG_SPACE(sizeof(struct timeval))];
+	} controls[UDP_BATCH_SIZE];
+
+	memset(msgs, 0, sizeof(msgs));
+
+	for (unsigned i = 0; i < UDP_BATCH_SIZE; ++i) {
+		iovs[i].iov_base = udp->buffer[i];
+		iovs[i].iov_len = sizeof(udp->buffer[i]);
+
+		struct msghdr *msg = &msgs[i].msg_hdr;
+		msg->msg_name = &addresses[i];
+		msg->msg_namelen = sizeof(addresses[i]);
+		msg->msg_iov = &iovs[i];
+		msg->msg_iovlen = 1;
+		msg->msg_control = controls[i].buffer;
+		msg->msg_controllen = sizeof(controls[i].buffer);
+	}
+
+	int n = recvmmsg(udp->fd, msgs, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+	for (int i = 0; i < n; ++i) {
+		struct msghdr *msg = &msgs[i].msg_hdr;
+
+		udp->handler->datagram(udp->fd, udp->buffer[i],
+				       msgs[i].msg_len,
+				       (struct sockaddr *)&addresses[i],
+				       msg->msg_namelen,
+				       udp_cmsg_timestamp(msg),
+				       udp->handler_ctx);
+	}
+#elif !defined(WIN32)
+	struct sockaddr_storage address_storage;
+	struct iovec iov = {
+		.iov_base = udp->buffer[0],
+		.iov_len = sizeof(udp->buffer[0]),
+	};
+	union {
+		struct cmsghdr align;
+		char buffer[CMSG_SPACE(sizeof(struct timeval))];
+	} control;
+
+	struct msghdr msg = {
+		.msg_name = &address_storage,
+		.msg_namelen = sizeof(address_storage),
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buffer,
+		.msg_controllen = sizeof(control.buffer),
+	};
+
+	ssize_t nbytes = recvmsg(udp->fd, &msg, MSG_DONTWAIT);
+	if (nbytes <= 0)
+		return true;
+
+	udp->handler->datagram(udp->fd, udp->buffer[0], nbytes,
+			       (struct sockaddr *)&address_storage,
+			       msg.msg_namelen,
+			       udp_cmsg_timestamp(&msg),
+			       udp->handler_ctx);
+#else
 	struct sockaddr_storage address_storage;
 	struct sockaddr *address = (struct sockaddr *)&address_storage;
 	socklen_t address_length = sizeof(address_storage);
 
-	ssize_t nbytes = recvfrom(udp->fd, udp->buffer, sizeof(udp->buffer),
-#ifdef WIN32
-				  0,
-#else
-				  MSG_DONTWAIT,
-#endif
+	ssize_t nbytes = recvfrom(udp->fd, udp->buffer[0],
+				  sizeof(udp->buffer[0]), 0,
 				  address, &address_length);
 	if (nbytes <= 0)
 		return true;
 
-	udp->handler->datagram(udp->fd, udp->buffer, nbytes,
-			       address, address_length, udp->handler_ctx);
+	udp->handler->datagram(udp->fd, udp->buffer[0], nbytes,
+			       address, address_length, NULL,
+			       udp->handler_ctx);
+#endif
+
 	return true;
 }
 
@@ -102,6 +206,13 @@ udp_server_new(unsigned port,
 #endif
 	};
 
+#ifdef SO_TIMESTAMP
+	/* ask the kernel to timestamp incoming datagrams, so NTP
+	   replies are not skewed by our scheduling latency */
+	const int yes = 1;
+	setsockopt(fd, SOL_SOCKET, SO_TIMESTAMP, &yes, sizeof(yes));
+#endif
+
 	if (bind(fd, (const struct sockaddr *)&address, sizeof(address)) < 0) {
 		g_set_error(error_r, udp_server_quark(), errno,
 			    "failed to bind UDP port %u: %s",
@@ -25,14 +25,19 @@
 #include <stddef.h>
 
 struct sockaddr;
+struct timeval;
 
 struct udp_server_handler {
 	/**
 	 * A datagram was received.
+	 *
+	 * @param received the kernel's receive timestamp
+	 * (SO_TIMESTAMP), or NULL if it is not available
 	 */
 	void (*datagram)(int fd, const void *data, size_t length,
 			 const struct sockaddr *source_address,
-			 size_t source_address_length, void *ctx);
+			 size_t source_address_length,
+			 const struct timeval *received, void *ctx);
 };
 
 static inline GQuark
@@ -116,6 +116,11 @@ update_enqueue(const char *path, bool _discard)
 	if (!mapper_has_music_directory())
 		return 0;
 
+	if (!db_ready())
+		/* the update would race with the asynchronous database
+		   load */
+		return 0;
+
 	if (progress != UPDATE_PROGRESS_IDLE) {
 		unsigned next_task_id =
 			update_queue_push(path, discard, update_task_id);
@@ -149,6 +154,7 @@ static void update_finished_event(void)
 	if (modified) {
 		/* send "idle" events */
 		playlist_increment_version_all(&g_playlist);
+		db_increment_version();
 		idle_add(IDLE_DATABASE);
 	}
 
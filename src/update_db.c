@@ -20,8 +20,11 @@
 #include "config.h" /* must be first for large file support */
 #include "update_db.h"
 #include "update_remove.h"
+#include "db_changes.h"
 #include "directory.h"
 #include "song.h"
+#include "song_print.h"
+#include "stats.h"
 #include "playlist_vector.h"
 #include "db_lock.h"
 
@@ -38,6 +41,13 @@ delete_song(struct directory *dir, struct song *del)
 
 	db_unlock(); /* temporary unlock, because update_remove_song() blocks */
 
+	char *uri = song_get_uri(del);
+	db_changes_record(DB_CHANGE_REMOVE, uri);
+	g_free(uri);
+
+	song_print_cache_remove(del);
+	stats_remove_song(del);
+
 	/* now take it out of the playlist (in the main_task) */
 	update_remove_song(del);
 
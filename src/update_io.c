@@ -42,6 +42,21 @@ stat_directory(const struct directory *directory, struct stat *st)
 	return ret;
 }
 
+#ifdef HAVE_OPENAT
+
+int
+stat_child_at(int parent_fd, const char *name_fs, struct stat *st)
+{
+	int ret = fstatat(parent_fd, name_fs, st, 0);
+	if (ret < 0)
+		g_warning("Failed to stat %s: %s",
+			  name_fs, g_strerror(errno));
+
+	return ret;
+}
+
+#endif
+
 int
 stat_directory_child(const struct directory *parent, const char *name,
 		     struct stat *st)
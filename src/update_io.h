@@ -34,6 +34,18 @@ int
 stat_directory_child(const struct directory *parent, const char *name,
 		     struct stat *st);
 
+#ifdef HAVE_OPENAT
+/**
+ * Wrapper for fstatat() using the parent directory's file handle, to
+ * spare the kernel - and, on network file systems, the server - the
+ * full path walk of a plain stat().
+ *
+ * @param name_fs the child's name in the file system character set
+ */
+int
+stat_child_at(int parent_fd, const char *name_fs, struct stat *st);
+#endif
+
 bool
 directory_exists(const struct directory *directory);
 
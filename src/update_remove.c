@@ -22,6 +22,7 @@
 #include "event_pipe.h"
 #include "song.h"
 #include "playlist.h"
+#include "search_cache.h"
 #include "main.h"
 
 #ifdef ENABLE_SQLITE
@@ -61,6 +62,10 @@ song_remove_event(void)
 
 	playlist_delete_song(&g_playlist, global_player_control, removed_song);
 
+	/* the update thread will free the song right after this
+	   event; invalidate all cached search results */
+	search_cache_song_removed();
+
 	/* clear "removed_song" and send signal to update thread */
 	g_mutex_lock(remove_mutex);
 	removed_song = NULL;
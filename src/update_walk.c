@@ -21,11 +21,15 @@
 #include "update_internal.h"
 #include "update_io.h"
 #include "update_db.h"
+#include "db_changes.h"
 #include "database.h"
 #include "db_lock.h"
+#include "db_index.h"
 #include "exclude.h"
 #include "directory.h"
 #include "song.h"
+#include "song_print.h"
+#include "stats.h"
 #include "playlist_vector.h"
 #include "uri.h"
 #include "mapper.h"
@@ -54,7 +58,42 @@
 #include <errno.h>
 
 static bool walk_discard;
-static bool modified;
+
+/** set when the walk modified the database; written by the walk
+    thread and by the tag scanner workers, hence atomic */
+static volatile gint modified;
+
+static inline void
+set_modified(void)
+{
+	g_atomic_int_set(&modified, true);
+}
+
+/**
+ * Number of threads scanning song files in parallel; 1 means the
+ * classic single-threaded walk.
+ */
+static unsigned update_num_threads = 1;
+
+/** the worker pool of the current walk, NULL in single-threaded
+    mode */
+static GThreadPool *update_pool;
+
+static GMutex *update_pool_mutex;
+static GCond *update_pool_cond;
+
+/** number of queued/running worker tasks, protected by
+    update_pool_mutex */
+static unsigned update_pool_pending;
+
+/**
+ * Upper bound for the number of queued scanner tasks.  The walk
+ * blocks when the queue is full, so a fast directory walk cannot pile
+ * up an unbounded amount of work (and memory) for the tag scanner
+ * workers; disk seeks for tag extraction dominate, and this keeps the
+ * two stages running at the same pace.
+ */
+enum { UPDATE_POOL_MAX_PENDING = 256 };
 
 #ifndef WIN32
 
@@ -68,6 +107,17 @@ static bool follow_outside_symlinks;
 
 #endif
 
+/**
+ * Skip unchanged directories entirely?  The mtime recorded in the
+ * database acts as a journal: when it matches the filesystem, the
+ * directory is not opened and its songs are not stat'ed, and only the
+ * known subdirectories are visited.  This makes routine updates
+ * proportional to the changed set, at the cost of not detecting
+ * in-place file modifications which leave the directory mtime
+ * untouched.
+ */
+static bool update_prune_unchanged;
+
 void
 update_walk_global_init(void)
 {
@@ -80,11 +130,23 @@ update_walk_global_init(void)
 		config_get_bool(CONF_FOLLOW_OUTSIDE_SYMLINKS,
 				DEFAULT_FOLLOW_OUTSIDE_SYMLINKS);
 #endif
+
+	update_prune_unchanged =
+		config_get_bool(CONF_UPDATE_PRUNE_UNCHANGED, false);
+
+	update_num_threads = config_get_unsigned(CONF_UPDATE_THREADS, 1);
+	if (update_num_threads < 1)
+		update_num_threads = 1;
+
+	update_pool_mutex = g_mutex_new();
+	update_pool_cond = g_cond_new();
 }
 
 void
 update_walk_global_finish(void)
 {
+	g_cond_free(update_pool_cond);
+	g_mutex_free(update_pool_mutex);
 }
 
 static void
@@ -97,7 +159,7 @@ directory_set_stat(struct directory *dir, const struct stat *st)
 
 static void
 remove_excluded_from_directory(struct directory *directory,
-			       GSList *exclude_list)
+			       const struct exclude_list *exclude_list)
 {
 	db_lock();
 
@@ -107,7 +169,7 @@ remove_excluded_from_directory(struct directory *directory,
 
 		if (exclude_list_check(exclude_list, name_fs)) {
 			delete_directory(child);
-			modified = true;
+			set_modified();
 		}
 
 		g_free(name_fs);
@@ -120,7 +182,7 @@ remove_excluded_from_directory(struct directory *directory,
 		char *name_fs = utf8_to_fs_charset(song->uri);
 		if (exclude_list_check(exclude_list, name_fs)) {
 			delete_song(directory, song);
-			modified = true;
+			set_modified();
 		}
 
 		g_free(name_fs);
@@ -141,7 +203,7 @@ removeDeletedFromDirectory(struct directory *directory)
 		delete_directory(child);
 		db_unlock();
 
-		modified = true;
+		set_modified();
 	}
 
 	struct song *song, *ns;
@@ -154,7 +216,7 @@ removeDeletedFromDirectory(struct directory *directory)
 			delete_song(directory, song);
 			db_unlock();
 
-			modified = true;
+			set_modified();
 		}
 
 		g_free(path);
@@ -237,9 +299,14 @@ update_archive_tree(struct directory *directory, char *name)
 			song = song_file_load(name, directory);
 			if (song != NULL) {
 				directory_add_song(directory, song);
-				modified = true;
+				stats_add_song(song);
+				set_modified();
 				g_message("added %s/%s",
 					  directory_get_path(directory), name);
+
+				char *uri = song_get_uri(song);
+				db_changes_record(DB_CHANGE_ADD, uri);
+				g_free(uri);
 			}
 		}
 	}
@@ -335,7 +402,7 @@ update_container_file(	struct directory* directory,
 			delete_directory(contdir);
 			contdir = NULL;
 
-			modified = true;
+			set_modified();
 		}
 		else {
 			db_unlock();
@@ -364,12 +431,20 @@ update_container_file(	struct directory* directory,
 					 &add_tag_handler, song->tag);
 		g_free(child_path_fs);
 
+		db_lock();
 		directory_add_song(contdir, song);
+		db_unlock();
 
-		modified = true;
+		stats_add_song(song);
+		set_modified();
 
 		g_message("added %s/%s",
 			  directory_get_path(directory), vtrack);
+
+		char *uri = song_get_uri(song);
+		db_changes_record(DB_CHANGE_ADD, uri);
+		g_free(uri);
+
 		g_free(vtrack);
 	}
 
@@ -430,25 +505,126 @@ update_song_file(struct directory *directory,
 			return;
 		}
 
+		db_lock();
 		directory_add_song(directory, song);
-		modified = true;
+		db_unlock();
+
+		stats_add_song(song);
+		set_modified();
 		g_message("added %s/%s",
 			  directory_get_path(directory), name);
+
+		char *uri = song_get_uri(song);
+		db_changes_record(DB_CHANGE_ADD, uri);
+		g_free(uri);
 	} else if (st->st_mtime != song->mtime || walk_discard) {
 		g_message("updating %s/%s",
 			  directory_get_path(directory), name);
-		if (!song_file_update(song)) {
+
+		/* the new tag invalidates the song's index entries */
+		db_lock();
+		db_index_remove_song(song);
+		db_unlock();
+
+		/* account the old tag out before it is replaced */
+		stats_remove_song(song);
+
+		if (song_file_update(song)) {
+			db_lock();
+			db_index_add_song(song);
+			db_unlock();
+
+			stats_add_song(song);
+
+			char *uri = song_get_uri(song);
+			db_changes_record(DB_CHANGE_MODIFY, uri);
+			g_free(uri);
+
+			song_print_cache_remove(song);
+		} else {
 			g_debug("deleting unrecognized file %s/%s",
 				directory_get_path(directory), name);
+
+			/* re-add the song to the counters, so that
+			   the removal hook inside delete_song()
+			   balances out */
+			stats_add_song(song);
+
 			db_lock();
 			delete_song(directory, song);
 			db_unlock();
 		}
 
-		modified = true;
+		set_modified();
 	}
 }
 
+/**
+ * A song file queued for a scanner worker.
+ */
+struct update_file_task {
+	struct directory *directory;
+	char *name;
+	struct stat st;
+	const struct decoder_plugin *plugin;
+};
+
+static void
+update_file_task_func(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+	struct update_file_task *task = data;
+
+	update_song_file(task->directory, task->name, &task->st,
+			 task->plugin);
+
+	g_free(task->name);
+	g_free(task);
+
+	g_mutex_lock(update_pool_mutex);
+	assert(update_pool_pending > 0);
+	--update_pool_pending;
+	/* wake up the walk thread, which may be blocked in
+	   update_pool_push() (queue full) or update_pool_drain() */
+	g_cond_signal(update_pool_cond);
+	g_mutex_unlock(update_pool_mutex);
+}
+
+static void
+update_pool_push(struct directory *directory, const char *name,
+		 const struct stat *st,
+		 const struct decoder_plugin *plugin)
+{
+	struct update_file_task *task = g_new(struct update_file_task, 1);
+	task->directory = directory;
+	task->name = g_strdup(name);
+	task->st = *st;
+	task->plugin = plugin;
+
+	g_mutex_lock(update_pool_mutex);
+	while (update_pool_pending >= UPDATE_POOL_MAX_PENDING)
+		g_cond_wait(update_pool_cond, update_pool_mutex);
+	++update_pool_pending;
+	g_mutex_unlock(update_pool_mutex);
+
+	g_thread_pool_push(update_pool, task, NULL);
+}
+
+/**
+ * Wait until all queued scanner tasks have finished.  Must be called
+ * before deleting objects a worker might still reference.
+ */
+static void
+update_pool_drain(void)
+{
+	if (update_pool == NULL)
+		return;
+
+	g_mutex_lock(update_pool_mutex);
+	while (update_pool_pending > 0)
+		g_cond_wait(update_pool_cond, update_pool_mutex);
+	g_mutex_unlock(update_pool_mutex);
+}
+
 static void
 update_regular_file(struct directory *directory,
 		    const char *name, const struct stat *st)
@@ -463,7 +639,13 @@ update_regular_file(struct directory *directory,
 
 	if ((plugin = decoder_plugin_from_suffix(suffix, false)) != NULL)
 	{
-		update_song_file(directory, name, st, plugin);
+		if (update_pool != NULL)
+			/* hand the file to a scanner worker; tag
+			   extraction is the expensive part of the
+			   walk */
+			update_pool_push(directory, name, st, plugin);
+		else
+			update_song_file(directory, name, st, plugin);
 #ifdef ENABLE_ARCHIVE
 	} else if ((archive = archive_plugin_from_suffix(suffix))) {
 		update_archive_file(directory, name, st, archive);
@@ -473,7 +655,7 @@ update_regular_file(struct directory *directory,
 		db_lock();
 		if (playlist_vector_update_or_add(&directory->playlists, name,
 						  st->st_mtime))
-			modified = true;
+			set_modified();
 		db_unlock();
 	}
 }
@@ -590,16 +772,212 @@ skip_symlink(const struct directory *directory, const char *utf8_name)
 #endif
 }
 
+/**
+ * The directory has not changed since the last update: do not open
+ * it, just visit the subdirectories already known to the database.
+ */
+static void
+update_directory_pruned(struct directory *directory)
+{
+	struct directory *child, *n;
+	directory_for_each_child_safe(child, n, directory) {
+		struct stat st2;
+
+		if (child->device == DEVICE_INARCHIVE ||
+		    child->device == DEVICE_CONTAINER)
+			/* virtual directories are rescanned together
+			   with the file they live in, which this
+			   unchanged directory did not touch */
+			continue;
+
+		if (stat_directory(child, &st2) == 0 &&
+		    S_ISDIR(st2.st_mode)) {
+			updateDirectory(child, &st2);
+		} else {
+			db_lock();
+			delete_directory(child);
+			db_unlock();
+
+			set_modified();
+		}
+	}
+}
+
+/**
+ * A directory entry gathered by updateDirectory(), to be examined
+ * later.
+ */
+struct update_walk_dirent {
+	/** the entry's name in the file system character set */
+	char *name_fs;
+
+	/** was the entry's d_type conclusive that this is not a
+	    symbolic link?  Then the readlink() check can be
+	    skipped */
+	bool not_symlink;
+};
+
+#ifdef HAVE_OPENAT
+
+/** the number of threads stat'ing ahead of the walk; a network file
+    system only delivers its throughput with several requests in
+    flight */
+#define UPDATE_STAT_PREFETCH_THREADS 4
+
+/** directories smaller than this are stat'ed inline; spawning
+    threads would cost more than it saves */
+#define UPDATE_STAT_PREFETCH_MIN 16
+
+struct stat_prefetch {
+	int dir_fd;
+
+	const struct update_walk_dirent *entries;
+	unsigned n;
+
+	struct stat *st;
+
+	/** 0 if the entry was stat'ed successfully, the errno
+	    otherwise */
+	int *error;
+
+	/** per-entry completion flags (atomic) */
+	gint *done;
+
+	/** the next index to be claimed by a worker (atomic) */
+	gint next;
+
+	/** for waking up the walk thread waiting in
+	    stat_prefetch_get() */
+	GMutex *mutex;
+	GCond *cond;
+
+	GThread *threads[UPDATE_STAT_PREFETCH_THREADS];
+	unsigned num_threads;
+};
+
+static gpointer
+stat_prefetch_task(gpointer data)
+{
+	struct stat_prefetch *p = data;
+
+	int i;
+	while ((i = g_atomic_int_exchange_and_add(&p->next, 1)) <
+	       (int)p->n) {
+		p->error[i] = stat_child_at(p->dir_fd,
+					    p->entries[i].name_fs,
+					    &p->st[i]) == 0
+			? 0 : errno;
+
+		g_mutex_lock(p->mutex);
+		g_atomic_int_set(&p->done[i], true);
+		g_cond_broadcast(p->cond);
+		g_mutex_unlock(p->mutex);
+	}
+
+	return NULL;
+}
+
+static void
+stat_prefetch_start(struct stat_prefetch *p, int dir_fd,
+		    const struct update_walk_dirent *entries, unsigned n)
+{
+	p->dir_fd = dir_fd;
+	p->entries = entries;
+	p->n = n;
+	p->num_threads = 0;
+
+	if (dir_fd < 0 || n < UPDATE_STAT_PREFETCH_MIN)
+		return;
+
+	p->st = g_new(struct stat, n);
+	p->error = g_new(int, n);
+	p->done = g_new0(gint, n);
+	p->next = 0;
+	p->mutex = g_mutex_new();
+	p->cond = g_cond_new();
+
+	for (unsigned k = 0; k < UPDATE_STAT_PREFETCH_THREADS; ++k) {
+		GThread *thread =
+			g_thread_create(stat_prefetch_task, p, true, NULL);
+		if (thread == NULL)
+			/* out of resources; the workers already
+			   running (if any) will do */
+			break;
+
+		p->threads[p->num_threads++] = thread;
+	}
+
+	if (p->num_threads == 0) {
+		g_cond_free(p->cond);
+		g_mutex_free(p->mutex);
+		g_free(p->done);
+		g_free(p->error);
+		g_free(p->st);
+	}
+}
+
+static inline bool
+stat_prefetch_active(const struct stat_prefetch *p)
+{
+	return p->num_threads > 0;
+}
+
+static int
+stat_prefetch_get(struct stat_prefetch *p, unsigned i, struct stat *st)
+{
+	assert(stat_prefetch_active(p));
+	assert(i < p->n);
+
+	g_mutex_lock(p->mutex);
+	while (!g_atomic_int_get(&p->done[i]))
+		g_cond_wait(p->cond, p->mutex);
+	g_mutex_unlock(p->mutex);
+
+	if (p->error[i] != 0) {
+		errno = p->error[i];
+		return -1;
+	}
+
+	*st = p->st[i];
+	return 0;
+}
+
+static void
+stat_prefetch_finish(struct stat_prefetch *p)
+{
+	if (p->num_threads == 0)
+		return;
+
+	for (unsigned k = 0; k < p->num_threads; ++k)
+		g_thread_join(p->threads[k]);
+
+	g_cond_free(p->cond);
+	g_mutex_free(p->mutex);
+	g_free(p->done);
+	g_free(p->error);
+	g_free(p->st);
+}
+
+#endif /* HAVE_OPENAT */
+
 static bool
 updateDirectory(struct directory *directory, const struct stat *st)
 {
 	DIR *dir;
 	struct dirent *ent;
 	char *path_fs, *exclude_path_fs;
-	GSList *exclude_list;
+	struct exclude_list *exclude_list;
 
 	assert(S_ISDIR(st->st_mode));
 
+	if (update_prune_unchanged && !walk_discard &&
+	    directory->mtime != 0 &&
+	    directory->mtime == st->st_mtime) {
+		directory_set_stat(directory, st);
+		update_directory_pruned(directory);
+		return true;
+	}
+
 	directory_set_stat(directory, st);
 
 	path_fs = map_directory_fs(directory);
@@ -625,32 +1003,89 @@ updateDirectory(struct directory *directory, const struct stat *st)
 
 	removeDeletedFromDirectory(directory);
 
-	while ((ent = readdir(dir))) {
-		char *utf8;
-		struct stat st2;
+	/* read all entries first: stat'ing them is the expensive part
+	   on a network file system, and with the names known up
+	   front, the stat calls can be prefetched concurrently */
 
+	GArray *entries = g_array_new(false, false,
+				      sizeof(struct update_walk_dirent));
+
+	while ((ent = readdir(dir))) {
 		if (skip_path(ent->d_name) ||
 		    exclude_list_check(exclude_list, ent->d_name))
 			continue;
 
-		utf8 = fs_charset_to_utf8(ent->d_name);
+		struct update_walk_dirent entry = {
+			.name_fs = g_strdup(ent->d_name),
+			.not_symlink = false,
+		};
+
+#ifdef DT_LNK
+		/* a conclusive d_type spares us the readlink()
+		   check, which is another full round trip on a
+		   network file system */
+		entry.not_symlink = ent->d_type != DT_UNKNOWN &&
+			ent->d_type != DT_LNK;
+#endif
+
+		g_array_append_val(entries, entry);
+	}
+
+#ifdef HAVE_OPENAT
+	struct stat_prefetch prefetch;
+	stat_prefetch_start(&prefetch, dirfd(dir),
+			    (const struct update_walk_dirent *)entries->data,
+			    entries->len);
+#endif
+
+	for (unsigned i = 0; i < entries->len; ++i) {
+		const struct update_walk_dirent *entry =
+			&g_array_index(entries, struct update_walk_dirent, i);
+		struct stat st2;
+
+		char *utf8 = fs_charset_to_utf8(entry->name_fs);
 		if (utf8 == NULL)
 			continue;
 
-		if (skip_symlink(directory, utf8)) {
-			modified |= delete_name_in(directory, utf8);
+		if (!entry->not_symlink && skip_symlink(directory, utf8)) {
+			if (delete_name_in(directory, utf8))
+				set_modified();
 			g_free(utf8);
 			continue;
 		}
 
-		if (stat_directory_child(directory, utf8, &st2) == 0)
-			updateInDirectory(directory, utf8, &st2);
+		int ret;
+#ifdef HAVE_OPENAT
+		if (stat_prefetch_active(&prefetch))
+			ret = stat_prefetch_get(&prefetch, i, &st2);
+		else if (prefetch.dir_fd >= 0)
+			ret = stat_child_at(prefetch.dir_fd,
+					    entry->name_fs, &st2);
 		else
-			modified |= delete_name_in(directory, utf8);
+			ret = stat_directory_child(directory, utf8, &st2);
+#else
+		ret = stat_directory_child(directory, utf8, &st2);
+#endif
+
+		if (ret == 0)
+			updateInDirectory(directory, utf8, &st2);
+		else if (delete_name_in(directory, utf8))
+			set_modified();
 
 		g_free(utf8);
 	}
 
+#ifdef HAVE_OPENAT
+	/* the workers borrow the entry names and the directory
+	   handle; join them before freeing either */
+	stat_prefetch_finish(&prefetch);
+#endif
+
+	for (unsigned i = 0; i < entries->len; ++i)
+		g_free(g_array_index(entries, struct update_walk_dirent,
+				     i).name_fs);
+	g_array_free(entries, true);
+
 	exclude_list_free(exclude_list);
 
 	closedir(dir);
@@ -677,7 +1112,10 @@ directory_make_child_checked(struct directory *parent, const char *name_utf8)
 		return NULL;
 
 	/* if we're adding directory paths, make sure to delete filenames
-	   with potentially the same name */
+	   with potentially the same name; wait for the scanner workers
+	   first, because one of them may still reference the song */
+	update_pool_drain();
+
 	db_lock();
 	struct song *conflicting = directory_get_song(parent, name_utf8);
 	if (conflicting)
@@ -730,8 +1168,8 @@ updatePath(const char *path)
 
 	if (stat_directory_child(parent, name, &st) == 0)
 		updateInDirectory(parent, name, &st);
-	else
-		modified |= delete_name_in(parent, name);
+	else if (delete_name_in(parent, name))
+		set_modified();
 
 	g_free(name);
 }
@@ -742,6 +1180,11 @@ update_walk(const char *path, bool discard)
 	walk_discard = discard;
 	modified = false;
 
+	if (update_num_threads > 1)
+		update_pool = g_thread_pool_new(update_file_task_func, NULL,
+						update_num_threads, FALSE,
+						NULL);
+
 	if (path != NULL && !isRootDirectory(path)) {
 		updatePath(path);
 	} else {
@@ -752,5 +1195,12 @@ update_walk(const char *path, bool discard)
 			updateDirectory(directory, &st);
 	}
 
+	if (update_pool != NULL) {
+		/* wait for the scanner workers before the tree is
+		   considered complete */
+		g_thread_pool_free(update_pool, FALSE, TRUE);
+		update_pool = NULL;
+	}
+
 	return modified;
 }
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "utf8_check.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__SSE2__)
+/* SSE2 is part of the x86-64 baseline; on i386, it must have been
+   enabled explicitly */
+#define UTF8_CHECK_SSE2
+#include <emmintrin.h>
+#endif
+
+/**
+ * Skips the leading run of plain ASCII bytes (0x01..0x7f), a whole
+ * block at a time.  Stops at the first non-ASCII or NUL byte.
+ *
+ * @return the number of bytes skipped
+ */
+static size_t
+utf8_skip_ascii(const char *p, size_t length)
+{
+	size_t i = 0;
+
+#ifdef UTF8_CHECK_SSE2
+	const __m128i zero = _mm_setzero_si128();
+
+	while (i + 16 <= length) {
+		const __m128i v =
+			_mm_loadu_si128((const __m128i *)(p + i));
+
+		/* the sign bit finds non-ASCII bytes, the comparison
+		   finds embedded NUL bytes */
+		if (_mm_movemask_epi8(v) != 0 ||
+		    _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0)
+			break;
+
+		i += 16;
+	}
+#else
+	/* word-at-a-time fallback; the constant truncates to
+	   0x80808080 on 32 bit machines */
+	const uintptr_t high = (uintptr_t)0x8080808080808080ULL;
+	const uintptr_t low = (uintptr_t)0x0101010101010101ULL;
+
+	while (i + sizeof(uintptr_t) <= length) {
+		uintptr_t w;
+		memcpy(&w, p + i, sizeof(w));
+
+		/* the second term is the usual "has a zero byte"
+		   bit trick */
+		if ((w & high) != 0 || ((w - low) & ~w & high) != 0)
+			break;
+
+		i += sizeof(w);
+	}
+#endif
+
+	while (i < length &&
+	       (unsigned char)p[i] - 1u < 0x7f)
+		++i;
+
+	return i;
+}
+
+/**
+ * Validates one multi-byte sequence, rejecting overlong encodings,
+ * UTF-16 surrogates and code points beyond U+10FFFF.
+ *
+ * @return the length of the sequence, or 0 if it is invalid or
+ * truncated
+ */
+static size_t
+utf8_check_sequence(const unsigned char *p, size_t remaining)
+{
+	const unsigned char c = p[0];
+
+	if (c < 0xc2)
+		/* a NUL byte, a stray continuation byte or an
+		   overlong two-byte sequence */
+		return 0;
+
+	if (c < 0xe0)
+		return remaining >= 2 && (p[1] & 0xc0) == 0x80
+			? 2 : 0;
+
+	if (c < 0xf0) {
+		if (remaining < 3 ||
+		    (p[1] & 0xc0) != 0x80 || (p[2] & 0xc0) != 0x80)
+			return 0;
+
+		if (c == 0xe0 && p[1] < 0xa0)
+			/* overlong */
+			return 0;
+
+		if (c == 0xed && p[1] >= 0xa0)
+			/* UTF-16 surrogate */
+			return 0;
+
+		return 3;
+	}
+
+	if (c < 0xf5) {
+		if (remaining < 4 ||
+		    (p[1] & 0xc0) != 0x80 || (p[2] & 0xc0) != 0x80 ||
+		    (p[3] & 0xc0) != 0x80)
+			return 0;
+
+		if (c == 0xf0 && p[1] < 0x90)
+			/* overlong */
+			return 0;
+
+		if (c == 0xf4 && p[1] >= 0x90)
+			/* beyond U+10FFFF */
+			return 0;
+
+		return 4;
+	}
+
+	return 0;
+}
+
+bool
+utf8_check(const char *p, size_t length, const char **end_r)
+{
+	size_t i = 0;
+
+	while (true) {
+		i += utf8_skip_ascii(p + i, length - i);
+		if (i >= length)
+			break;
+
+		const size_t n =
+			utf8_check_sequence((const unsigned char *)(p + i),
+					    length - i);
+		if (n == 0) {
+			if (end_r != NULL)
+				*end_r = p + i;
+			return false;
+		}
+
+		i += n;
+	}
+
+	if (end_r != NULL)
+		*end_r = p + length;
+	return true;
+}
+
+bool
+utf8_check_string(const char *s)
+{
+	return utf8_check(s, strlen(s), NULL);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_UTF8_CHECK_H
+#define MPD_UTF8_CHECK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Checks whether the buffer contains valid UTF-8.  This is a faster
+ * replacement for g_utf8_validate(): runs of ASCII bytes - the common
+ * case for tag values and protocol arguments - are skipped a whole
+ * block at a time (with SSE2 where available) instead of being
+ * decoded character by character.
+ *
+ * Like g_utf8_validate(), NUL bytes within the buffer are considered
+ * invalid, as are overlong encodings, UTF-16 surrogates and code
+ * points beyond U+10FFFF.
+ *
+ * @param p the buffer to check; does not need to be NUL-terminated
+ * @param length the length of the buffer in bytes
+ * @param end_r if not NULL, it receives a pointer to the first
+ * invalid byte (on failure) or to the end of the buffer (on success)
+ * @return true if the buffer is valid UTF-8
+ */
+bool
+utf8_check(const char *p, size_t length, const char **end_r);
+
+/**
+ * Checks whether the NUL-terminated string is valid UTF-8; see
+ * utf8_check().
+ */
+bool
+utf8_check_string(const char *s);
+
+#endif
@@ -20,10 +20,14 @@
 #include "config.h"
 #include "zeroconf-internal.h"
 #include "listen.h"
+#include "io_thread.h"
 #include "mpd_error.h"
 
 #include <glib.h>
 
+#include <assert.h>
+#include <stdbool.h>
+
 #include <avahi-client/client.h>
 #include <avahi-client/publish.h>
 
@@ -38,13 +42,72 @@
 #define G_LOG_DOMAIN "avahi"
 
 static char *avahiName;
-static int avahiRunning;
 static AvahiGLibPoll *avahi_glib_poll;
 static const AvahiPoll *avahi_poll;
 static AvahiClient *avahiClient;
 static AvahiEntryGroup *avahiGroup;
 
+/**
+ * The initial retry interval after a failure.  Doubled after each
+ * failed attempt, up to #AVAHI_RETRY_MAX_SECONDS.
+ */
+#define AVAHI_RETRY_MIN_SECONDS 2
+#define AVAHI_RETRY_MAX_SECONDS 60
+
+static unsigned avahi_retry_seconds;
+static GSource *avahi_retry_source;
+
+/** set by avahi_finish(); suppresses pending connect callbacks */
+static bool avahi_aborted;
+
 static void avahiRegisterService(AvahiClient * c);
+static void avahi_connect(void);
+
+static gboolean
+avahi_retry_callback(G_GNUC_UNUSED gpointer data)
+{
+	avahi_retry_source = NULL;
+
+	if (avahi_aborted)
+		return false;
+
+	/* this runs outside of any avahi callback, where freeing the
+	   client is safe */
+	if (avahiGroup) {
+		avahi_entry_group_free(avahiGroup);
+		avahiGroup = NULL;
+	}
+
+	if (avahiClient) {
+		avahi_client_free(avahiClient);
+		avahiClient = NULL;
+	}
+
+	avahi_connect();
+	return false;
+}
+
+/**
+ * Schedule another connect attempt with exponential backoff; the
+ * service registration must never give up for good, and must never
+ * stall the rest of the daemon.
+ */
+static void
+avahi_schedule_retry(void)
+{
+	if (avahi_retry_source != NULL)
+		return;
+
+	g_message("Retrying in %u seconds", avahi_retry_seconds);
+
+	avahi_retry_source =
+		io_thread_timeout_add_seconds(avahi_retry_seconds,
+					      avahi_retry_callback, NULL);
+
+	avahi_retry_seconds *= 2;
+	if (avahi_retry_seconds > AVAHI_RETRY_MAX_SECONDS)
+		avahi_retry_seconds = AVAHI_RETRY_MAX_SECONDS;
+}
 
 /* Callback when the EntryGroup changes state */
 static void avahiGroupCallback(AvahiEntryGroup * g,
@@ -81,7 +144,7 @@ static void avahiGroupCallback(AvahiEntryGroup * g,
 			  avahi_strerror(avahi_client_errno
 					 (avahi_entry_group_get_client(g))));
 		/* Some kind of failure happened while we were registering our services */
-		avahiRunning = 0;
+		avahi_schedule_retry();
 		break;
 
 	case AVAHI_ENTRY_GROUP_UNCOMMITED:
@@ -134,7 +197,7 @@ static void avahiRegisterService(AvahiClient * c)
 	return;
 
 fail:
-	avahiRunning = 0;
+	avahi_schedule_retry();
 }
 
 /* Callback when avahi changes state */
@@ -151,6 +214,9 @@ static void avahiClientCallback(AvahiClient * c, AvahiClientState state,
 	case AVAHI_CLIENT_S_RUNNING:
 		g_debug("Client is RUNNING");
 
+		/* connected successfully: reset the retry backoff */
+		avahi_retry_seconds = AVAHI_RETRY_MIN_SECONDS;
+
 		/* The server has startup successfully and registered its host
 		 * name on the network, so it's time to create our services */
 		if (!avahiGroup)
@@ -175,12 +241,12 @@ static void avahiClientCallback(AvahiClient * c, AvahiClientState state,
 			if (!avahiClient) {
 				g_warning("Could not reconnect: %s",
 					  avahi_strerror(reason));
-				avahiRunning = 0;
+				avahi_schedule_retry();
 			}
 		} else {
-			g_warning("Client failure: %s (terminal)",
+			g_warning("Client failure: %s, will retry",
 				  avahi_strerror(reason));
-			avahiRunning = 0;
+			avahi_schedule_retry();
 		}
 		break;
 
@@ -213,20 +279,21 @@ static void avahiClientCallback(AvahiClient * c, AvahiClientState state,
 	}
 }
 
-void init_avahi(const char *serviceName)
+/**
+ * Create the client; all I/O runs in the I/O thread.
+ */
+static void
+avahi_connect(void)
 {
 	int error;
-	g_debug("Initializing interface");
 
-	if (!avahi_is_valid_service_name(serviceName))
-		MPD_ERROR("Invalid zeroconf_name \"%s\"", serviceName);
-
-	avahiName = avahi_strdup(serviceName);
+	assert(io_thread_inside());
 
-	avahiRunning = 1;
-
-	avahi_glib_poll = avahi_glib_poll_new(NULL, G_PRIORITY_DEFAULT);
-	avahi_poll = avahi_glib_poll_get(avahi_glib_poll);
+	if (avahi_glib_poll == NULL) {
+		avahi_glib_poll = avahi_glib_poll_new(io_thread_context(),
+						      G_PRIORITY_DEFAULT);
+		avahi_poll = avahi_glib_poll_get(avahi_glib_poll);
+	}
 
 	avahiClient = avahi_client_new(avahi_poll, AVAHI_CLIENT_NO_FAIL,
 				       avahiClientCallback, NULL, &error);
@@ -234,19 +301,48 @@ void init_avahi(const char *serviceName)
 	if (!avahiClient) {
 		g_warning("Failed to create client: %s",
 			  avahi_strerror(error));
-		goto fail;
+		avahi_schedule_retry();
 	}
+}
 
-	return;
+static gboolean
+avahi_connect_callback(G_GNUC_UNUSED gpointer data)
+{
+	if (!avahi_aborted)
+		avahi_connect();
 
-fail:
-	avahi_finish();
+	return false;
 }
 
-void avahi_finish(void)
+void init_avahi(const char *serviceName)
+{
+	g_debug("Initializing interface");
+
+	if (!avahi_is_valid_service_name(serviceName))
+		MPD_ERROR("Invalid zeroconf_name \"%s\"", serviceName);
+
+	avahiName = avahi_strdup(serviceName);
+	avahi_retry_seconds = AVAHI_RETRY_MIN_SECONDS;
+
+	/* connect in the I/O thread, off the startup critical path; a
+	   slow avahi-daemon must not delay the first client
+	   connection */
+	io_thread_idle_add(avahi_connect_callback, NULL);
+}
+
+static gpointer
+avahi_finish_callback(G_GNUC_UNUSED gpointer data)
 {
 	g_debug("Shutting down interface");
 
+	avahi_aborted = true;
+
+	if (avahi_retry_source != NULL) {
+		g_source_destroy(avahi_retry_source);
+		g_source_unref(avahi_retry_source);
+		avahi_retry_source = NULL;
+	}
+
 	if (avahiGroup) {
 		avahi_entry_group_free(avahiGroup);
 		avahiGroup = NULL;
@@ -264,4 +360,11 @@ void avahi_finish(void)
 
 	avahi_free(avahiName);
 	avahiName = NULL;
+
+	return NULL;
+}
+
+void avahi_finish(void)
+{
+	io_thread_call(avahi_finish_callback, NULL);
 }
@@ -20,6 +20,7 @@
 #include "config.h"
 #include "zeroconf-internal.h"
 #include "listen.h"
+#include "io_thread.h"
 
 #include <glib.h>
 
@@ -30,6 +31,8 @@
 
 static DNSServiceRef dnsReference;
 static GIOChannel *bonjour_channel;
+static GSource *bonjour_source;
+static char *bonjour_service_name;
 
 static void
 dnsRegisterCallback(G_GNUC_UNUSED DNSServiceRef sdRef,
@@ -58,10 +61,16 @@ bonjour_channel_event(G_GNUC_UNUSED GIOChannel *source,
 	return dnsReference != NULL;
 }
 
-void init_zeroconf_osx(const char *serviceName)
+static gboolean
+bonjour_register_callback(G_GNUC_UNUSED gpointer data)
 {
+	if (bonjour_service_name == NULL)
+		/* bonjour_finish() has already been called */
+		return false;
+
 	DNSServiceErrorType error = DNSServiceRegister(&dnsReference,
-						       0, 0, serviceName,
+						       0, 0,
+						       bonjour_service_name,
 						       SERVICE_TYPE, NULL, NULL,
 						       g_htons(listen_port), 0,
 						       NULL,
@@ -75,15 +84,37 @@ void init_zeroconf_osx(const char *serviceName)
 			DNSServiceRefDeallocate(dnsReference);
 			dnsReference = NULL;
 		}
-		return;
+		return false;
 	}
 
 	bonjour_channel = g_io_channel_unix_new(DNSServiceRefSockFD(dnsReference));
-	g_io_add_watch(bonjour_channel, G_IO_IN, bonjour_channel_event, NULL);
+	bonjour_source = g_io_create_watch(bonjour_channel, G_IO_IN);
+	g_source_set_callback(bonjour_source,
+			      (GSourceFunc)bonjour_channel_event, NULL, NULL);
+	g_source_attach(bonjour_source, io_thread_context());
+
+	return false;
 }
 
-void bonjour_finish(void)
+void init_zeroconf_osx(const char *serviceName)
+{
+	bonjour_service_name = g_strdup(serviceName);
+
+	/* register in the I/O thread, off the startup critical path;
+	   a slow mDNSResponder must not delay the first client
+	   connection */
+	io_thread_idle_add(bonjour_register_callback, NULL);
+}
+
+static gpointer
+bonjour_finish_callback(G_GNUC_UNUSED gpointer data)
 {
+	if (bonjour_source != NULL) {
+		g_source_destroy(bonjour_source);
+		g_source_unref(bonjour_source);
+		bonjour_source = NULL;
+	}
+
 	if (bonjour_channel != NULL) {
 		g_io_channel_unref(bonjour_channel);
 		bonjour_channel = NULL;
@@ -94,4 +125,14 @@ void bonjour_finish(void)
 		dnsReference = NULL;
 		g_debug("Deregistered Zeroconf service.");
 	}
+
+	g_free(bonjour_service_name);
+	bonjour_service_name = NULL;
+
+	return NULL;
+}
+
+void bonjour_finish(void)
+{
+	io_thread_call(bonjour_finish_callback, NULL);
 }
@@ -75,6 +75,13 @@ decoder_seek_error(G_GNUC_UNUSED struct decoder *decoder)
 {
 }
 
+bool
+decoder_supports_sample_format(G_GNUC_UNUSED struct decoder *decoder,
+			       G_GNUC_UNUSED enum sample_format sample_format)
+{
+	return true;
+}
+
 size_t
 decoder_read(G_GNUC_UNUSED struct decoder *decoder,
 	     struct input_stream *is,
@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A database scale benchmark: fabricates a synthetic music library
+ * (artist/album directories with realistic tag distributions, shared
+ * artist/album/genre values, unique titles) directly in the in-memory
+ * database, then times db_save, db_load and whole-database "search
+ * any" scans over it.
+ *
+ * Usage: run_db_bench DB_FILE [SONGS [FORMAT]]
+ *
+ * DB_FILE is created or OVERWRITTEN.  SONGS is the library size
+ * (default 100000); FORMAT is "text" (default) or "binary".  The
+ * output is one stable line per phase, so two builds can be compared
+ * with diff(1).
+ */
+
+#include "config.h"
+#include "conf.h"
+#include "db_plugin.h"
+#include "db_selection.h"
+#include "db_visitor.h"
+#include "db/simple_db_plugin.h"
+#include "db_arena.h"
+#include "db_lock.h"
+#include "directory.h"
+#include "song.h"
+#include "tag.h"
+#include "tag_pool.h"
+#include "locate.h"
+#include "path.h"
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static void
+my_log_func(const gchar *log_domain, G_GNUC_UNUSED GLogLevelFlags log_level,
+	    const gchar *message, G_GNUC_UNUSED gpointer user_data)
+{
+	if (log_domain != NULL)
+		g_printerr("%s: %s\n", log_domain, message);
+	else
+		g_printerr("%s\n", message);
+}
+
+static void
+bench_report(const char *name, double elapsed, unsigned songs)
+{
+	g_print("%-28s %8.3f s %12.0f songs/sec\n",
+		name, elapsed, songs / elapsed);
+}
+
+/** a small genre pool; real libraries have few distinct genres */
+static const char *const bench_genres[] = {
+	"Rock", "Pop", "Jazz", "Classical", "Electronic",
+	"Hip-Hop", "Folk", "Metal", "Ambient", "Blues",
+};
+
+/**
+ * Fabricates "Artist N/Album N/NN - Track N.ogg" songs until the
+ * requested library size is reached.  Artist, album, genre and date
+ * values repeat across songs (and thus share tag_pool items), titles
+ * are unique; the pseudo-random album and track counts are seeded, so
+ * every run builds exactly the same library.
+ */
+static void
+bench_generate(struct directory *root, unsigned n_songs)
+{
+	GRand *rand = g_rand_new_with_seed(42);
+	unsigned counter = 0, artist_n = 0;
+
+	db_lock();
+
+	while (counter < n_songs) {
+		char artist[32];
+		g_snprintf(artist, sizeof(artist), "Artist %u", ++artist_n);
+
+		struct directory *artist_dir =
+			directory_new_child(root, artist);
+
+		unsigned n_albums = g_rand_int_range(rand, 3, 17);
+		for (unsigned a = 1;
+		     a <= n_albums && counter < n_songs; ++a) {
+			char album[32], date[16];
+			g_snprintf(album, sizeof(album), "Album %u", a);
+			g_snprintf(date, sizeof(date), "%d",
+				   g_rand_int_range(rand, 1965, 2012));
+
+			struct directory *album_dir =
+				directory_new_child(artist_dir, album);
+
+			const char *genre =
+				bench_genres[artist_n %
+					     G_N_ELEMENTS(bench_genres)];
+
+			unsigned n_tracks = g_rand_int_range(rand, 8, 15);
+			for (unsigned t = 1;
+			     t <= n_tracks && counter < n_songs; ++t) {
+				char name[64], title[32], track[16];
+
+				++counter;
+				g_snprintf(name, sizeof(name),
+					   "%02u - Track %u.ogg", t, counter);
+				g_snprintf(title, sizeof(title),
+					   "Track %u", counter);
+				g_snprintf(track, sizeof(track), "%u", t);
+
+				struct song *song =
+					song_file_new(name, album_dir);
+				song->mtime = 1234567890;
+
+				struct tag *tag = tag_new();
+				tag->time = g_rand_int_range(rand, 90, 600);
+				tag_begin_add(tag);
+				tag_add_item(tag, TAG_ARTIST, artist);
+				tag_add_item(tag, TAG_ALBUM, album);
+				tag_add_item(tag, TAG_TITLE, title);
+				tag_add_item(tag, TAG_TRACK, track);
+				tag_add_item(tag, TAG_GENRE, genre);
+				tag_add_item(tag, TAG_DATE, date);
+				tag_end_add(tag);
+				song->tag = tag;
+
+				directory_add_song(album_dir, song);
+			}
+		}
+	}
+
+	db_unlock();
+	g_rand_free(rand);
+}
+
+struct search_stats {
+	const struct locate_item_list *criteria;
+
+	unsigned visited, matches;
+};
+
+static bool
+bench_visit_song(struct song *song, void *ctx,
+		 G_GNUC_UNUSED GError **error_r)
+{
+	struct search_stats *stats = ctx;
+
+	++stats->visited;
+	if (locate_song_search(song, stats->criteria))
+		++stats->matches;
+
+	return true;
+}
+
+static const struct db_visitor bench_search_visitor = {
+	.song = bench_visit_song,
+};
+
+/**
+ * Times a whole-database "search any NEEDLE" scan, the way
+ * handle_search() does it: casefolded criteria, one visit per song.
+ */
+static void
+bench_search(struct db *db, const char *needle)
+{
+	GError *error = NULL;
+	char name[64];
+
+	struct locate_item_list *list = locate_item_list_new(1);
+	list->items[0].tag = LOCATE_TAG_ANY_TYPE;
+	list->items[0].needle = g_strdup(needle);
+
+	struct locate_item_list *casefolded =
+		locate_item_list_casefold(list);
+
+	struct search_stats stats = {
+		.criteria = casefolded,
+	};
+
+	struct db_selection selection;
+	db_selection_init(&selection, "", true);
+
+	GTimer *timer = g_timer_new();
+	if (!db_plugin_visit(db, &selection, &bench_search_visitor,
+			     &stats, &error)) {
+		g_printerr("Search failed: %s\n", error->message);
+		g_error_free(error);
+	}
+	double elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	g_snprintf(name, sizeof(name), "search any \"%s\" (%u)",
+		   needle, stats.matches);
+	bench_report(name, elapsed, stats.visited);
+
+	locate_item_list_free(casefolded);
+	locate_item_list_free(list);
+}
+
+int main(int argc, char **argv)
+{
+	GError *error = NULL;
+	unsigned n_songs = 100000;
+	bool binary = false;
+
+	if (argc < 2 || argc > 4) {
+		g_printerr("Usage: run_db_bench DB_FILE [SONGS [FORMAT]]\n");
+		return 1;
+	}
+
+	if (argc > 2)
+		n_songs = strtoul(argv[2], NULL, 10);
+	if (argc > 3) {
+		if (strcmp(argv[3], "binary") == 0)
+			binary = true;
+		else if (strcmp(argv[3], "text") != 0) {
+			g_printerr("Unknown format: %s\n", argv[3]);
+			return 1;
+		}
+	}
+
+	if (n_songs == 0) {
+		g_printerr("Invalid library size\n");
+		return 1;
+	}
+
+	g_log_set_default_handler(my_log_func, NULL);
+
+	config_global_init();
+	path_global_init();
+	tag_pool_init();
+
+	/* the "path" block parameter must be absolute */
+	char *db_path = g_path_is_absolute(argv[1])
+		? g_strdup(argv[1])
+		: g_build_filename(g_get_current_dir(), argv[1], NULL);
+
+	/* start from scratch; the load phase below is timed
+	   explicitly */
+	unlink(db_path);
+
+	struct config_param *param = config_new_param("database", -1);
+	config_add_block_param(param, "path", db_path, -1);
+	config_add_block_param(param, "binary",
+			       binary ? "yes" : "no", -1);
+
+	struct db *db = db_plugin_new(&simple_db_plugin, param, &error);
+	config_param_free(param);
+	if (db == NULL) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+
+	if (!db_plugin_open(db, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+
+	g_print("# run_db_bench: %u songs, %s format\n",
+		n_songs, binary ? "binary" : "text");
+
+	/* phase 1: fabricate the library */
+
+	GTimer *timer = g_timer_new();
+	bench_generate(simple_db_get_root(db), n_songs);
+	bench_report("generate", g_timer_elapsed(timer, NULL), n_songs);
+
+	/* phase 2: save it (includes the prune/sort passes, like a
+	   real update) */
+
+	g_timer_start(timer);
+	if (!simple_db_save(db, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+	bench_report("db_save", g_timer_elapsed(timer, NULL), n_songs);
+
+	struct stat st;
+	if (stat(db_path, &st) == 0)
+		g_print("%-28s %8.1f MB\n", "db file size",
+			(double)st.st_size / (1024.0 * 1024.0));
+
+	/* phase 3: load it back */
+
+	db_plugin_close(db);
+
+	g_timer_start(timer);
+	if (!db_plugin_open(db, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+	bench_report("db_load", g_timer_elapsed(timer, NULL), n_songs);
+
+	/* phase 4: whole-database scans; one needle matching many
+	   songs, one matching none (the worst case, every tag value
+	   is inspected) */
+
+	bench_search(db, "track 99");
+	bench_search(db, "xyzzy");
+
+	g_timer_destroy(timer);
+
+	db_plugin_close(db);
+	db_plugin_free(db);
+	db_arena_free();
+	tag_pool_deinit();
+	config_global_finish();
+	g_free(db_path);
+
+	return 0;
+}
@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A decode throughput benchmark built on the run_decoder harness: it
+ * decodes a corpus of files with a null sink, several passes each, and
+ * reports the realtime multiple per file plus totals, the peak RSS and
+ * (for allocations going through g_malloc) the GLib allocation
+ * profile.
+ *
+ * Usage: run_decoder_bench DECODER PASSES URI...
+ *
+ * Run it once per decoder plugin (flac, mad, ffmpeg, vorbis, ...) to
+ * compare them on the same corpus.
+ */
+
+#include "config.h"
+#include "io_thread.h"
+#include "decoder_list.h"
+#include "decoder_api.h"
+#include "tag_pool.h"
+#include "input_init.h"
+#include "input_stream.h"
+#include "audio_format.h"
+#include "pcm_volume.h"
+#include "idle.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+static void
+my_log_func(const gchar *log_domain, G_GNUC_UNUSED GLogLevelFlags log_level,
+	    const gchar *message, G_GNUC_UNUSED gpointer user_data)
+{
+	if (log_domain != NULL)
+		g_printerr("%s: %s\n", log_domain, message);
+	else
+		g_printerr("%s\n", message);
+}
+
+/**
+ * No-op dummy.
+ */
+void
+idle_add(G_GNUC_UNUSED unsigned flags)
+{
+}
+
+/**
+ * No-op dummy.
+ */
+bool
+pcm_volume(G_GNUC_UNUSED void *buffer, G_GNUC_UNUSED size_t length,
+	   G_GNUC_UNUSED enum sample_format format,
+	   G_GNUC_UNUSED int volume)
+{
+	return true;
+}
+
+struct decoder {
+	const char *uri;
+
+	const struct decoder_plugin *plugin;
+
+	bool initialized;
+
+	struct audio_format audio_format;
+
+	/** the number of PCM bytes delivered by the plugin */
+	uint64_t bytes;
+};
+
+void
+decoder_initialized(struct decoder *decoder,
+		    const struct audio_format *audio_format,
+		    G_GNUC_UNUSED bool seekable,
+		    G_GNUC_UNUSED float total_time)
+{
+	assert(!decoder->initialized);
+	assert(audio_format_valid(audio_format));
+
+	decoder->audio_format = *audio_format;
+	decoder->initialized = true;
+}
+
+enum decoder_command
+decoder_get_command(G_GNUC_UNUSED struct decoder *decoder)
+{
+	return DECODE_COMMAND_NONE;
+}
+
+void decoder_command_finished(G_GNUC_UNUSED struct decoder *decoder)
+{
+}
+
+double decoder_seek_where(G_GNUC_UNUSED struct decoder *decoder)
+{
+	return 1.0;
+}
+
+void decoder_seek_error(G_GNUC_UNUSED struct decoder *decoder)
+{
+}
+
+bool
+decoder_supports_sample_format(G_GNUC_UNUSED struct decoder *decoder,
+			       G_GNUC_UNUSED enum sample_format sample_format)
+{
+	return true;
+}
+
+size_t
+decoder_read(G_GNUC_UNUSED struct decoder *decoder,
+	     struct input_stream *is,
+	     void *buffer, size_t length)
+{
+	return input_stream_lock_read(is, buffer, length, NULL);
+}
+
+void
+decoder_timestamp(G_GNUC_UNUSED struct decoder *decoder,
+		  G_GNUC_UNUSED double t)
+{
+}
+
+enum decoder_command
+decoder_data(struct decoder *decoder,
+	     G_GNUC_UNUSED struct input_stream *is,
+	     G_GNUC_UNUSED const void *data, size_t datalen,
+	     G_GNUC_UNUSED uint16_t kbit_rate)
+{
+	/* null sink: account for the data, but don't copy it
+	   anywhere */
+	decoder->bytes += datalen;
+	return DECODE_COMMAND_NONE;
+}
+
+enum decoder_command
+decoder_tag(G_GNUC_UNUSED struct decoder *decoder,
+	    G_GNUC_UNUSED struct input_stream *is,
+	    G_GNUC_UNUSED const struct tag *tag)
+{
+	return DECODE_COMMAND_NONE;
+}
+
+float
+decoder_replay_gain(G_GNUC_UNUSED struct decoder *decoder,
+		    G_GNUC_UNUSED const struct replay_gain_info *replay_gain_info)
+{
+	return 0.0;
+}
+
+void
+decoder_mixramp(G_GNUC_UNUSED struct decoder *decoder,
+		G_GNUC_UNUSED float replay_gain_db,
+		char *mixramp_start, char *mixramp_end)
+{
+	g_free(mixramp_start);
+	g_free(mixramp_end);
+}
+
+static bool
+decode_uri(struct decoder *decoder)
+{
+	GError *error = NULL;
+
+	decoder->initialized = false;
+
+	if (decoder->plugin->file_decode != NULL) {
+		decoder_plugin_file_decode(decoder->plugin, decoder,
+					   decoder->uri);
+	} else if (decoder->plugin->stream_decode != NULL) {
+		GMutex *mutex = g_mutex_new();
+		GCond *cond = g_cond_new();
+
+		struct input_stream *is =
+			input_stream_open(decoder->uri, mutex, cond, &error);
+		if (is == NULL) {
+			if (error != NULL) {
+				g_warning("%s", error->message);
+				g_error_free(error);
+			} else
+				g_printerr("input_stream_open() failed\n");
+
+			g_cond_free(cond);
+			g_mutex_free(mutex);
+			return false;
+		}
+
+		decoder_plugin_stream_decode(decoder->plugin, decoder, is);
+
+		input_stream_close(is);
+
+		g_cond_free(cond);
+		g_mutex_free(mutex);
+	} else {
+		g_printerr("Decoder plugin is not usable\n");
+		return false;
+	}
+
+	return decoder->initialized;
+}
+
+int main(int argc, char **argv)
+{
+	GError *error = NULL;
+	struct decoder decoder;
+	unsigned passes;
+	double total_audio = 0, total_elapsed = 0;
+	bool success = true;
+
+	if (argc < 4 || (passes = strtoul(argv[2], NULL, 10)) == 0) {
+		g_printerr("Usage: run_decoder_bench DECODER PASSES URI...\n");
+		return 1;
+	}
+
+	/* count g_malloc allocations; must be installed before the
+	   first allocation */
+	g_mem_set_vtable(glib_mem_profiler_table);
+
+	g_thread_init(NULL);
+	g_log_set_default_handler(my_log_func, NULL);
+
+	io_thread_init();
+	if (!io_thread_start(&error)) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	tag_pool_init();
+
+	if (!input_stream_global_init(&error)) {
+		g_warning("%s", error->message);
+		g_error_free(error);
+		return 2;
+	}
+
+	decoder_plugin_init_all();
+
+	decoder.plugin = decoder_plugin_from_name(argv[1]);
+	if (decoder.plugin == NULL) {
+		g_printerr("No such decoder: %s\n", argv[1]);
+		return 1;
+	}
+
+	for (int i = 3; i < argc; ++i) {
+		GTimer *timer;
+		uint64_t bytes = 0;
+		double elapsed;
+
+		decoder.uri = argv[i];
+
+		/* one warm-up pass, so the page cache state is the
+		   same for every file */
+		if (!decode_uri(&decoder)) {
+			g_printerr("Decoding failed: %s\n", decoder.uri);
+			success = false;
+			continue;
+		}
+
+		timer = g_timer_new();
+		for (unsigned pass = 0; pass < passes; ++pass) {
+			decoder.bytes = 0;
+			if (!decode_uri(&decoder)) {
+				g_printerr("Decoding failed: %s\n",
+					   decoder.uri);
+				success = false;
+				break;
+			}
+
+			bytes += decoder.bytes;
+		}
+
+		elapsed = g_timer_elapsed(timer, NULL);
+		g_timer_destroy(timer);
+
+		double audio_seconds = (double)bytes /
+			(double)audio_format_time_to_size(&decoder.audio_format);
+
+		g_print("%-48s %8.1fx realtime (%.1f s audio in %.3f s, %u passes)\n",
+			decoder.uri, audio_seconds / elapsed,
+			audio_seconds, elapsed, passes);
+
+		total_audio += audio_seconds;
+		total_elapsed += elapsed;
+	}
+
+	if (total_elapsed > 0)
+		g_print("%-48s %8.1fx realtime (%.1f s audio in %.3f s)\n",
+			"TOTAL", total_audio / total_elapsed,
+			total_audio, total_elapsed);
+
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		g_print("peak RSS: %ld kB\n", ru.ru_maxrss);
+
+	/* allocation counts (g_malloc only; the codec libraries'
+	   malloc() calls are not included) */
+	g_mem_profile();
+
+	decoder_plugin_deinit_all();
+	input_stream_global_finish();
+	io_thread_deinit();
+	tag_pool_deinit();
+
+	return success ? 0 : 1;
+}
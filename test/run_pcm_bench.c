@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * This program benchmarks MPD's PCM conversion kernels (pcm_convert.c,
+ * pcm_volume.c, including the resampler), printing one stable line per
+ * kernel with MB/s and ns/sample, so the output of two builds can be
+ * compared with diff(1) or a simple script.
+ *
+ * Usage: run_pcm_bench [SIZE_KB [SECONDS [CONVERTER]]]
+ *
+ * SIZE_KB is the source buffer size (default 256), SECONDS the
+ * measurement time per kernel (default 0.5), CONVERTER the
+ * samplerate_converter setting (e.g. "internal" or "polyphase").
+ *
+ * When the environment variable PCM_BENCH_MHZ is set to the CPU clock
+ * in MHz, a cycles/sample column is printed as well.
+ */
+
+#include "config.h"
+#include "audio_parser.h"
+#include "audio_format.h"
+#include "pcm_convert.h"
+#include "pcm_volume.h"
+#include "pcm_resample.h"
+#include "conf.h"
+
+#include <glib.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *converter_setting = "";
+
+/** the measurement time per kernel [seconds] */
+static double bench_seconds = 0.5;
+
+/** the source buffer size [bytes] */
+static size_t bench_size = 256 * 1024;
+
+/** CPU clock [MHz] for the cycles/sample column, or 0 */
+static double bench_mhz;
+
+const char *
+config_get_string(G_GNUC_UNUSED const char *name, const char *default_value)
+{
+	if (*converter_setting != 0)
+		return converter_setting;
+
+	return default_value;
+}
+
+static void
+bench_report(const char *name, size_t bytes_per_pass, size_t samples_per_pass,
+	     unsigned passes, double elapsed)
+{
+	double mb_per_sec = (double)bytes_per_pass * passes
+		/ elapsed / (1024.0 * 1024.0);
+	double ns_per_sample = elapsed * 1e9
+		/ ((double)samples_per_pass * passes);
+
+	g_print("%-32s %10.1f MB/s %8.2f ns/sample", name,
+		mb_per_sec, ns_per_sample);
+
+	if (bench_mhz > 0)
+		g_print(" %8.2f cycles/sample",
+			ns_per_sample * bench_mhz / 1000.0);
+
+	g_print("\n");
+}
+
+/**
+ * Fills the source buffer with deterministic pseudo-random data, so
+ * two builds measure exactly the same input.  Float buffers get
+ * proper samples in [-1,1]; random bit patterns would contain NaNs
+ * and denormals, which are disproportionately slow on some CPUs.
+ */
+static void
+bench_fill(void *buffer, size_t size, enum sample_format format)
+{
+	GRand *r = g_rand_new_with_seed(42);
+
+	if (format == SAMPLE_FORMAT_FLOAT) {
+		float *p = buffer;
+
+		for (size_t i = 0; i < size / sizeof(*p); ++i)
+			p[i] = (float)g_rand_double_range(r, -1.0, 1.0);
+	} else {
+		unsigned char *p = buffer;
+
+		for (size_t i = 0; i < size; ++i)
+			p[i] = g_rand_int_range(r, 0, 256);
+	}
+
+	g_rand_free(r);
+}
+
+static bool
+bench_parse_format(struct audio_format *af, const char *spec)
+{
+	GError *error = NULL;
+
+	if (!audio_format_parse(af, spec, false, &error)) {
+		g_printerr("Failed to parse audio format '%s': %s\n",
+			   spec, error->message);
+		g_error_free(error);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+bench_convert(const char *in_spec, const char *out_spec)
+{
+	struct audio_format in_audio_format, out_audio_format;
+	struct pcm_convert_state state;
+	GError *error = NULL;
+	GTimer *timer;
+	unsigned passes = 0;
+	char name[64];
+
+	if (!bench_parse_format(&in_audio_format, in_spec) ||
+	    !bench_parse_format(&out_audio_format, out_spec))
+		return;
+
+	size_t length = bench_size;
+	length -= length % audio_format_frame_size(&in_audio_format);
+
+	void *src = g_malloc(length);
+	bench_fill(src, length, (enum sample_format)in_audio_format.format);
+
+	size_t samples = length / audio_format_sample_size(&in_audio_format);
+
+	pcm_convert_init(&state);
+
+	/* one warm-up pass, so lazily allocated buffers and the
+	   dispatch setup are not measured */
+	size_t dest_size;
+	if (pcm_convert(&state, &in_audio_format, src, length,
+			&out_audio_format, &dest_size, &error) == NULL) {
+		g_printerr("Failed to convert %s -> %s: %s\n",
+			   in_spec, out_spec, error->message);
+		g_error_free(error);
+		g_free(src);
+		pcm_convert_deinit(&state);
+		return;
+	}
+
+	timer = g_timer_new();
+	do {
+		pcm_convert(&state, &in_audio_format, src, length,
+			    &out_audio_format, &dest_size, NULL);
+		++passes;
+	} while (g_timer_elapsed(timer, NULL) < bench_seconds);
+
+	g_snprintf(name, sizeof(name), "convert %s -> %s",
+		   in_spec, out_spec);
+	bench_report(name, length, samples, passes,
+		     g_timer_elapsed(timer, NULL));
+
+	g_timer_destroy(timer);
+	pcm_convert_deinit(&state);
+	g_free(src);
+}
+
+static void
+bench_volume(enum sample_format format, const char *format_name)
+{
+	GTimer *timer;
+	unsigned passes = 0;
+	char name[64];
+
+	size_t length = bench_size;
+	length -= length % sample_format_size(format);
+
+	void *buffer = g_malloc(length);
+	bench_fill(buffer, length, format);
+
+	size_t samples = length / sample_format_size(format);
+
+	/* alternate between 50% and 200%, so the signal neither
+	   decays to silence nor clips into a constant; their product
+	   is exactly 1.0 */
+	static const int volumes[2] = { PCM_VOLUME_1 / 2, PCM_VOLUME_1 * 2 };
+
+	pcm_volume(buffer, length, format, volumes[0]);
+
+	timer = g_timer_new();
+	do {
+		pcm_volume(buffer, length, format, volumes[passes & 1]);
+		++passes;
+	} while (g_timer_elapsed(timer, NULL) < bench_seconds);
+
+	g_snprintf(name, sizeof(name), "volume %s", format_name);
+	bench_report(name, length, samples, passes,
+		     g_timer_elapsed(timer, NULL));
+
+	g_timer_destroy(timer);
+	g_free(buffer);
+}
+
+int main(int argc, char **argv)
+{
+	GError *error = NULL;
+
+	if (argc > 1)
+		bench_size = strtoul(argv[1], NULL, 10) * 1024;
+	if (argc > 2)
+		bench_seconds = strtod(argv[2], NULL);
+	if (argc > 3)
+		converter_setting = argv[3];
+
+	if (bench_size == 0 || bench_seconds <= 0 || argc > 4) {
+		g_printerr("Usage: run_pcm_bench [SIZE_KB [SECONDS [CONVERTER]]]\n");
+		return 1;
+	}
+
+	const char *mhz = g_getenv("PCM_BENCH_MHZ");
+	if (mhz != NULL)
+		bench_mhz = strtod(mhz, NULL);
+
+	if (!pcm_resample_global_init(&error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+
+	g_print("# run_pcm_bench: %lu KB per pass, %.2f s per kernel\n",
+		(unsigned long)(bench_size / 1024), bench_seconds);
+
+	/* format conversions */
+
+	bench_convert("44100:16:2", "44100:24:2");
+	bench_convert("44100:16:2", "44100:32:2");
+	bench_convert("44100:16:2", "44100:f:2");
+	bench_convert("44100:24:2", "44100:16:2");
+	bench_convert("44100:32:2", "44100:16:2");
+	bench_convert("44100:f:2", "44100:16:2");
+
+	/* channel conversions */
+
+	bench_convert("44100:16:1", "44100:16:2");
+	bench_convert("44100:16:2", "44100:16:1");
+
+	/* resampling */
+
+	bench_convert("44100:16:2", "48000:16:2");
+	bench_convert("48000:16:2", "44100:16:2");
+	bench_convert("96000:24:2", "44100:24:2");
+
+	/* volume */
+
+	bench_volume(SAMPLE_FORMAT_S16, "S16");
+	bench_volume(SAMPLE_FORMAT_S24_P32, "S24_P32");
+	bench_volume(SAMPLE_FORMAT_S32, "S32");
+	bench_volume(SAMPLE_FORMAT_FLOAT, "FLOAT");
+
+	return 0;
+}
@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2003-2011 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A protocol load generator: opens a number of concurrent connections
+ * against a running mpd, replays a weighted command mix (status /
+ * playlistinfo / search / idle) for a while, and reports commands/sec
+ * and p50/p90/p99 round-trip latency.
+ *
+ * Usage: run_protocol_bench HOST PORT [CLIENTS [SECONDS]]
+ *
+ * A command's round trip is complete when the terminating "OK" (or
+ * "ACK ...") line has been received.  "idle" is sent pipelined with
+ * "noidle", which exercises the wakeup path without blocking on an
+ * actual event.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+/** one weighted entry of the command mix */
+struct bench_command {
+	const char *request;
+
+	/** the relative weight of this command in the mix */
+	unsigned weight;
+
+	/** the number of "OK"/"ACK" terminated responses to expect */
+	unsigned responses;
+};
+
+static const struct bench_command bench_commands[] = {
+	{ "status\n", 45, 1 },
+	{ "currentsong\n", 15, 1 },
+	{ "playlistinfo\n", 20, 1 },
+	{ "search any \"benchmark\"\n", 10, 1 },
+	/* pipelined with noidle, so the round trip measures the
+	   subscription and wakeup path instead of waiting for a real
+	   event */
+	{ "idle\nnoidle\n", 10, 2 },
+};
+
+static unsigned bench_total_weight;
+
+static unsigned bench_clients = 16;
+static double bench_seconds = 10;
+static const char *bench_host;
+static const char *bench_port;
+
+/** set to 1 when the measurement time is over */
+static volatile gint bench_stop;
+
+struct bench_client {
+	GThread *thread;
+
+	GRand *rand;
+
+	int fd;
+
+	/** receive buffer for line parsing */
+	char buffer[4096];
+	size_t buffer_fill;
+
+	/** all round-trip latencies [seconds] */
+	GArray *latencies;
+
+	bool failed;
+};
+
+static int
+bench_connect(void)
+{
+	struct addrinfo hints, *ai, *i;
+	int fd = -1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+
+	int ret = getaddrinfo(bench_host, bench_port, &hints, &ai);
+	if (ret != 0) {
+		g_printerr("Failed to resolve %s:%s: %s\n",
+			   bench_host, bench_port, gai_strerror(ret));
+		return -1;
+	}
+
+	for (i = ai; i != NULL; i = i->ai_next) {
+		fd = socket(i->ai_family, i->ai_socktype, i->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		if (connect(fd, i->ai_addr, i->ai_addrlen) == 0)
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(ai);
+
+	if (fd < 0)
+		g_printerr("Failed to connect to %s:%s\n",
+			   bench_host, bench_port);
+
+	return fd;
+}
+
+/**
+ * Reads the next line from the connection.  Returns a pointer into
+ * the client's buffer (without the newline), or NULL on error.
+ */
+static const char *
+bench_read_line(struct bench_client *client)
+{
+	while (true) {
+		char *newline = memchr(client->buffer, '\n',
+				       client->buffer_fill);
+		if (newline != NULL) {
+			*newline = 0;
+			return client->buffer;
+		}
+
+		if (client->buffer_fill >= sizeof(client->buffer)) {
+			g_printerr("Response line too long\n");
+			return NULL;
+		}
+
+		ssize_t nbytes = read(client->fd,
+				      client->buffer + client->buffer_fill,
+				      sizeof(client->buffer) -
+				      client->buffer_fill);
+		if (nbytes <= 0) {
+			if (nbytes < 0)
+				g_printerr("Failed to read: %s\n",
+					   g_strerror(errno));
+			return NULL;
+		}
+
+		client->buffer_fill += nbytes;
+	}
+}
+
+/**
+ * Discards the consumed line from the buffer.
+ */
+static void
+bench_consume_line(struct bench_client *client, const char *line)
+{
+	size_t length = strlen(line) + 1;
+
+	assert(length <= client->buffer_fill);
+
+	memmove(client->buffer, client->buffer + length,
+		client->buffer_fill - length);
+	client->buffer_fill -= length;
+}
+
+/**
+ * Reads response lines until the terminating "OK" or "ACK".
+ */
+static bool
+bench_read_response(struct bench_client *client)
+{
+	while (true) {
+		const char *line = bench_read_line(client);
+		if (line == NULL)
+			return false;
+
+		bool done = strcmp(line, "OK") == 0 ||
+			strncmp(line, "OK ", 3) == 0 ||
+			strncmp(line, "ACK ", 4) == 0;
+		bench_consume_line(client, line);
+
+		if (done)
+			return true;
+	}
+}
+
+static const struct bench_command *
+bench_pick_command(GRand *rand)
+{
+	unsigned n = g_rand_int_range(rand, 0, bench_total_weight);
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(bench_commands); ++i) {
+		if (n < bench_commands[i].weight)
+			return &bench_commands[i];
+
+		n -= bench_commands[i].weight;
+	}
+
+	/* unreachable */
+	assert(false);
+	return &bench_commands[0];
+}
+
+static gpointer
+bench_client_thread(gpointer data)
+{
+	struct bench_client *client = data;
+	GTimer *timer = g_timer_new();
+
+	while (g_atomic_int_get(&bench_stop) == 0) {
+		const struct bench_command *command =
+			bench_pick_command(client->rand);
+
+		g_timer_start(timer);
+
+		ssize_t nbytes = write(client->fd, command->request,
+				       strlen(command->request));
+		if (nbytes != (ssize_t)strlen(command->request)) {
+			client->failed = true;
+			break;
+		}
+
+		bool success = true;
+		for (unsigned i = 0; success && i < command->responses; ++i)
+			success = bench_read_response(client);
+
+		if (!success) {
+			client->failed = true;
+			break;
+		}
+
+		double elapsed = g_timer_elapsed(timer, NULL);
+		g_array_append_val(client->latencies, elapsed);
+	}
+
+	g_timer_destroy(timer);
+	return NULL;
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3 || argc > 5) {
+		g_printerr("Usage: run_protocol_bench HOST PORT [CLIENTS [SECONDS]]\n");
+		return 1;
+	}
+
+	bench_host = argv[1];
+	bench_port = argv[2];
+	if (argc > 3)
+		bench_clients = strtoul(argv[3], NULL, 10);
+	if (argc > 4)
+		bench_seconds = strtod(argv[4], NULL);
+
+	if (bench_clients == 0 || bench_seconds <= 0) {
+		g_printerr("Invalid arguments\n");
+		return 1;
+	}
+
+	g_thread_init(NULL);
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(bench_commands); ++i)
+		bench_total_weight += bench_commands[i].weight;
+
+	struct bench_client *clients =
+		g_new0(struct bench_client, bench_clients);
+
+	for (unsigned i = 0; i < bench_clients; ++i) {
+		clients[i].fd = bench_connect();
+		if (clients[i].fd < 0)
+			return 1;
+
+		clients[i].rand = g_rand_new_with_seed(i);
+		clients[i].latencies = g_array_new(false, false,
+						   sizeof(double));
+
+		/* consume the greeting before the measurement
+		   starts */
+		const char *line = bench_read_line(&clients[i]);
+		if (line == NULL || strncmp(line, "OK MPD ", 7) != 0) {
+			g_printerr("Malformed greeting\n");
+			return 1;
+		}
+
+		bench_consume_line(&clients[i], line);
+	}
+
+	GTimer *timer = g_timer_new();
+
+	for (unsigned i = 0; i < bench_clients; ++i)
+		clients[i].thread = g_thread_create(bench_client_thread,
+						    &clients[i], TRUE, NULL);
+
+	g_usleep((gulong)(bench_seconds * 1e6));
+	g_atomic_int_set(&bench_stop, 1);
+
+	for (unsigned i = 0; i < bench_clients; ++i)
+		g_thread_join(clients[i].thread);
+
+	double elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	/* merge and sort all samples */
+
+	GArray *all = g_array_new(false, false, sizeof(double));
+	bool failed = false;
+
+	for (unsigned i = 0; i < bench_clients; ++i) {
+		g_array_append_vals(all, clients[i].latencies->data,
+				    clients[i].latencies->len);
+		failed = failed || clients[i].failed;
+
+		g_array_free(clients[i].latencies, TRUE);
+		g_rand_free(clients[i].rand);
+		close(clients[i].fd);
+	}
+
+	if (all->len == 0) {
+		g_printerr("No commands completed\n");
+		return 1;
+	}
+
+	qsort(all->data, all->len, sizeof(double), compare_double);
+
+	const double *samples = (const double *)all->data;
+	double p50 = samples[all->len / 2];
+	double p90 = samples[(guint64)all->len * 90 / 100];
+	double p99 = samples[(guint64)all->len * 99 / 100];
+
+	g_print("%u clients, %u commands in %.1f s: %.0f commands/sec\n",
+		bench_clients, all->len, elapsed, all->len / elapsed);
+	g_print("latency: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		p50 * 1000, p90 * 1000, p99 * 1000,
+		samples[all->len - 1] * 1000);
+
+	g_array_free(all, TRUE);
+	g_free(clients);
+
+	return failed ? 1 : 0;
+}
@@ -34,7 +34,6 @@
 #include <netdb.h>
 #endif
 
-static struct tcp_connect *handle;
 static GMutex *mutex;
 static GCond *cond;
 static bool done, success;
@@ -107,18 +106,11 @@ static const struct tcp_connect_handler my_tcp_connect_handler = {
 int main(int argc, char **argv)
 {
 	if (argc != 2) {
-		g_printerr("Usage: run_tcp_connect IP:PORT\n");
+		g_printerr("Usage: run_tcp_connect HOST:PORT\n");
 		return 1;
 	}
 
 	GError *error = NULL;
-	struct addrinfo *ai = resolve_host_port(argv[1], 80, 0, SOCK_STREAM,
-						&error);
-	if (ai == NULL) {
-		g_printerr("%s\n", error->message);
-		g_error_free(error);
-		return EXIT_FAILURE;
-	}
 
 	/* initialize GLib */
 
@@ -128,30 +120,28 @@ int main(int argc, char **argv)
 
 	io_thread_init();
 	if (!io_thread_start(&error)) {
-		freeaddrinfo(ai);
 		g_printerr("%s", error->message);
 		g_error_free(error);
 		return EXIT_FAILURE;
 	}
 
-	/* open the connection */
+	/* open the connection; the host name is resolved
+	   asynchronously */
 
 	mutex = g_mutex_new();
 	cond = g_cond_new();
 
-	tcp_connect_address(ai->ai_addr, ai->ai_addrlen, 5000,
-			    &my_tcp_connect_handler, NULL,
-			    &handle);
-	freeaddrinfo(ai);
+	struct tcp_connect_host *handle = NULL;
+	tcp_connect_host(argv[1], 80, 5000,
+			 &my_tcp_connect_handler, NULL,
+			 &handle);
 
-	if (handle != NULL) {
-		g_mutex_lock(mutex);
-		while (!done)
-			g_cond_wait(cond, mutex);
-		g_mutex_unlock(mutex);
+	g_mutex_lock(mutex);
+	while (!done)
+		g_cond_wait(cond, mutex);
+	g_mutex_unlock(mutex);
 
-		tcp_connect_free(handle);
-	}
+	tcp_connect_host_free(handle);
 
 	g_cond_free(cond);
 	g_mutex_free(mutex);
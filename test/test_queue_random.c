@@ -0,0 +1,111 @@
+#include "queue.h"
+#include "song.h"
+
+#include <assert.h>
+#include <stdbool.h>
+
+void
+song_free(G_GNUC_UNUSED struct song *song)
+{
+}
+
+/**
+ * Verify that the order array is a permutation of all positions.
+ */
+static void
+check_permutation(const struct queue *queue)
+{
+	bool seen[32];
+
+	assert(queue_length(queue) <= G_N_ELEMENTS(seen));
+
+	for (unsigned i = 0; i < queue_length(queue); ++i)
+		seen[i] = false;
+
+	for (unsigned i = 0; i < queue_length(queue); ++i) {
+		unsigned position = queue_order_to_position(queue, i);
+		assert(position < queue_length(queue));
+		assert(!seen[position]);
+		seen[position] = true;
+	}
+}
+
+int
+main(G_GNUC_UNUSED int argc, G_GNUC_UNUSED char **argv)
+{
+	struct song songs[16];
+
+	struct queue queue;
+	queue_init(&queue, 32);
+
+	for (unsigned i = 0; i < G_N_ELEMENTS(songs); ++i)
+		queue_append(&queue, &songs[i]);
+
+	assert(queue_length(&queue) == G_N_ELEMENTS(songs));
+	assert(queue.priority_count == 0);
+
+	/* without priorities, enabling random mode must be lazy: no
+	   order entry is drawn yet */
+
+	queue.random = true;
+	queue_shuffle_order(&queue);
+	assert(queue.order_shuffled == 0);
+	check_permutation(&queue);
+
+	/* draw a prefix on demand */
+
+	queue_order_realize(&queue, 5);
+	assert(queue.order_shuffled == 6);
+	check_permutation(&queue);
+
+	/* pinning the current song must not be undone by later
+	   realization */
+
+	queue_shuffle_order(&queue);
+	assert(queue.order_shuffled == 0);
+
+	unsigned current_position = queue_order_to_position(&queue, 9);
+	queue_order_move_first(&queue, 9);
+	assert(queue.order_shuffled >= 1);
+	assert(queue_order_to_position(&queue, 0) == current_position);
+
+	queue_order_realize(&queue, queue_length(&queue) - 1);
+	assert(queue.order_shuffled == queue_length(&queue));
+	assert(queue_order_to_position(&queue, 0) == current_position);
+	check_permutation(&queue);
+
+	/* appended songs land in the (unrealized) suffix and keep the
+	   permutation intact */
+
+	struct song extra;
+	queue_append(&queue, &extra);
+	check_permutation(&queue);
+
+	/* deleting keeps the realized prefix consistent */
+
+	queue_delete(&queue, queue_order_to_position(&queue, 3));
+	assert(queue.order_shuffled <= queue_length(&queue));
+	check_permutation(&queue);
+
+	/* with priorities, the shuffle must be eager, so the order is
+	   grouped by priority up front */
+
+	queue_set_priority(&queue, 2, 10, -1);
+	assert(queue.priority_count == 1);
+
+	queue_shuffle_order(&queue);
+	assert(queue.order_shuffled == queue_length(&queue));
+	assert(queue_get_order(&queue, 0) == queue_get(&queue, 2));
+	check_permutation(&queue);
+
+	/* resetting the priority re-enables the lazy path */
+
+	queue_set_priority(&queue, 2, 0, -1);
+	assert(queue.priority_count == 0);
+
+	queue_shuffle_order(&queue);
+	assert(queue.order_shuffled == 0);
+
+	queue_finish(&queue);
+	return 0;
+}
@@ -0,0 +1,60 @@
+#include "config.h"
+#include "utf8_check.h"
+
+#include <glib.h>
+
+#include <assert.h>
+#include <string.h>
+
+static bool
+check(const char *s)
+{
+	return utf8_check(s, strlen(s), NULL);
+}
+
+int
+main(G_GNUC_UNUSED int argc, G_GNUC_UNUSED char **argv)
+{
+	const char *end;
+
+	/* plain ASCII, including strings longer than one SIMD block */
+
+	assert(check(""));
+	assert(check("foo"));
+	assert(check("The Dark Side of the Moon (Remastered Edition)"));
+
+	/* well-formed multi-byte sequences */
+
+	assert(check("caf\xc3\xa9"));			/* U+00E9 */
+	assert(check("\xe2\x82\xac" "100"));		/* U+20AC */
+	assert(check("\xf0\x9d\x84\x9e"));		/* U+1D11E */
+	assert(check("\xf4\x8f\xbf\xbf"));		/* U+10FFFF */
+
+	/* malformed input */
+
+	assert(!check("\x80"));			/* stray continuation */
+	assert(!check("\xc3"));			/* truncated sequence */
+	assert(!check("\xc0\xaf"));		/* overlong */
+	assert(!check("\xe0\x80\xaf"));		/* overlong */
+	assert(!check("\xed\xa0\x80"));		/* UTF-16 surrogate */
+	assert(!check("\xf4\x90\x80\x80"));	/* beyond U+10FFFF */
+	assert(!check("\xff"));
+	assert(!utf8_check("a\0b", 3, NULL));	/* embedded NUL */
+
+	/* ISO-Latin-1 hidden behind a long ASCII run, so the fast
+	   path has to hand over correctly */
+
+	assert(!check("This ASCII run is longer than a SIMD block\xe9"));
+
+	/* end_r points at the first invalid byte ... */
+
+	assert(!utf8_check("abc\xffxyz", 7, &end));
+	assert(*end == (char)0xff);
+
+	/* ... or at the end of a valid buffer */
+
+	assert(utf8_check("abc", 3, &end));
+	assert(strcmp(end, "") == 0);
+
+	return 0;
+}